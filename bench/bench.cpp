@@ -0,0 +1,179 @@
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+#include "bench.hpp"
+
+using namespace std;
+
+namespace bench {
+
+    vector<pair<string, BenchFun> > &registry()
+    {
+        static vector<pair<string, BenchFun> > r;
+        return r;
+    }
+
+    bool Runner::selected(const string &name) const
+    {
+        return _opt.filter.empty() || name.find(_opt.filter) != string::npos;
+    }
+
+    namespace {
+        double elapsed(const function<void(uint64_t)> &body, uint64_t n)
+        {
+            Clock::time_point t0 = Clock::now();
+            body(n);
+            return chrono::duration<double>(Clock::now() - t0).count();
+        }
+
+        string describe(const string &name, const Params &params)
+        {
+            string s = name;
+            for (auto &p : params) s += " " + p.first + "=" + p.second;
+            return s;
+        }
+
+        string quote(const string &s)
+        {
+            string q = "\"";
+            for (char c : s) {
+                if (c == '"' || c == '\\') q += '\\';
+                q += c;
+            }
+            return q + "\"";
+        }
+    }
+
+    double Runner::measure(const string &name, const Params &params,
+                           const function<void(uint64_t)> &body)
+    {
+        // calibration: the number of operations taking minTime
+        uint64_t n = 1;
+        double t = elapsed(body, n);
+        while (t < _opt.minTime / 10) {
+            uint64_t m = t > 0 ? uint64_t(n * _opt.minTime / 10 / t) : n * 10;
+            n = max(n * 2, min(m, n * 100));
+            t = elapsed(body, n);
+        }
+        n = max<uint64_t>(1, uint64_t(n * _opt.minTime / t));
+
+        vector<double> times;
+        for (int i = 0; i < _opt.reps; ++i)
+            times.push_back(elapsed(body, n) * 1e9 / n);
+        sort(times.begin(), times.end());
+
+        Result r;
+        r.name = name;
+        r.params = params;
+        r.ops = n;
+        r.reps = _opt.reps;
+        r.best = times.front();
+        r.median = times[times.size() / 2];
+        _results.push_back(r);
+
+        cerr << left << setw(48) << describe(name, params) << right
+             << fixed << setprecision(2) << setw(12) << r.median
+             << " ns/op  (best " << r.best << ", n=" << n << ")" << endl;
+        return r.median;
+    }
+
+    void Runner::metric(const string &name, double value)
+    {
+        _metrics.push_back(make_pair(name, value));
+    }
+
+    void Runner::writeJson(ostream &os) const
+    {
+        os << "{" << endl
+           << "  \"suite\": \"metasim-micro\"," << endl
+           << "  \"config\": {\"min_time\": " << _opt.minTime
+           << ", \"reps\": " << _opt.reps
+           << ", \"max_size\": " << _opt.maxSize << "}," << endl
+           << "  \"metrics\": {";
+        for (size_t i = 0; i < _metrics.size(); ++i)
+            os << (i ? ", " : "") << quote(_metrics[i].first) << ": "
+               << _metrics[i].second;
+        os << "}," << endl
+           << "  \"results\": [";
+        os << setprecision(4) << fixed;
+        for (size_t i = 0; i < _results.size(); ++i) {
+            const Result &r = _results[i];
+            os << (i ? "," : "") << endl
+               << "    {\"name\": " << quote(r.name) << ", \"params\": {";
+            for (size_t k = 0; k < r.params.size(); ++k)
+                os << (k ? ", " : "") << quote(r.params[k].first) << ": "
+                   << quote(r.params[k].second);
+            os << "}, \"ops\": " << r.ops << ", \"reps\": " << r.reps
+               << ", \"ns_per_op\": " << r.median
+               << ", \"best_ns_per_op\": " << r.best << "}";
+        }
+        os << endl << "  ]" << endl << "}" << endl;
+    }
+
+} // namespace bench
+
+namespace {
+    void usage(const char *prog)
+    {
+        cerr << "Usage: " << prog << " [options]" << endl
+             << "  --filter S     only the benchmarks whose name contains S" << endl
+             << "  --min-time T   minimum time of a measurement (s, default 0.1)" << endl
+             << "  --reps N       measurements per benchmark (default 5)" << endl
+             << "  --max-size N   largest queue size (default 1000000)" << endl
+             << "  --quick        short measurements, for smoke testing" << endl
+             << "  --full         queue sizes up to 10^7" << endl
+             << "  --out FILE     JSON output file (default stdout)" << endl
+             << "  --list         list the benchmarks" << endl;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    bench::Options opt;
+    for (int i = 1; i < argc; ++i) {
+        string a = argv[i];
+        bool hasArg = i + 1 < argc;
+        if (a == "--filter" && hasArg) opt.filter = argv[++i];
+        else if (a == "--min-time" && hasArg) opt.minTime = atof(argv[++i]);
+        else if (a == "--reps" && hasArg) opt.reps = max(1, atoi(argv[++i]));
+        else if (a == "--max-size" && hasArg) opt.maxSize = strtoull(argv[++i], NULL, 10);
+        else if (a == "--out" && hasArg) opt.out = argv[++i];
+        else if (a == "--quick") { opt.minTime = 0.005; opt.reps = 1; opt.maxSize = 10000; }
+        else if (a == "--full") opt.maxSize = 10000000;
+        else if (a == "--list") opt.list = true;
+        else { usage(argv[0]); return 1; }
+    }
+
+    bench::Runner runner(opt);
+    for (auto &b : bench::registry()) {
+        if (!runner.selected(b.first)) continue;
+        if (opt.list) cout << b.first << endl;
+        else b.second(runner);
+    }
+    if (opt.list) return 0;
+
+    if (opt.out == "-") runner.writeJson(cout);
+    else if (!opt.out.empty()) {
+        ofstream f(opt.out.c_str());
+        if (!f) {
+            cerr << "Cannot open " << opt.out << endl;
+            return 1;
+        }
+        runner.writeJson(f);
+        cerr << "Results written to " << opt.out << endl;
+    }
+    return 0;
+}
@@ -0,0 +1,143 @@
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef __BENCH_HPP__
+#define __BENCH_HPP__
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <iosfwd>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+   A minimal benchmark harness, without external dependencies.
+
+   A benchmark is a function registered with the BENCHMARK macro. It
+   prepares its model and then calls Runner::measure() once for
+   every configuration it wants to measure (e.g. every queue size),
+   passing a body that performs n operations:
+
+   @code
+   BENCHMARK(tick_add)
+   {
+       Tick t = 0;
+       r.measure("tick_add", {}, [&](uint64_t n) {
+               for (uint64_t i = 0; i < n; ++i) t += 1;
+           });
+       bench::keep(t);
+   }
+   @endcode
+
+   The runner first calibrates n so that a measurement takes at least
+   the minimum time, then it repeats the measurement several times
+   and reports the best and the median time per operation. All the
+   models use fixed seeds, so the results only depend on the machine.
+*/
+namespace bench {
+
+    typedef std::chrono::steady_clock Clock;
+    typedef std::vector<std::pair<std::string, std::string> > Params;
+
+    /// Prevents the compiler from optimising away a computed value
+    template <class T>
+    inline void keep(const T &v)
+    {
+        asm volatile("" : : "g"(&v) : "memory");
+    }
+
+    /// Converts a number to a parameter value
+    template <class T>
+    inline std::string par(const T &v) { return std::to_string(v); }
+
+    inline std::string par(double v)
+    {
+        std::ostringstream os;
+        os << v;
+        return os.str();
+    }
+
+    /// The result of a measurement
+    struct Result {
+        std::string name;
+        Params params;
+        uint64_t ops;
+        int reps;
+        double best;     // ns per operation
+        double median;   // ns per operation
+    };
+
+    struct Options {
+        /// minimum time of a measurement, in seconds
+        double minTime;
+        /// number of measurements
+        int reps;
+        /// largest queue size of the scheduling benchmarks
+        uint64_t maxSize;
+        /// only the benchmarks whose name contains this string
+        std::string filter;
+        /// JSON output file ("-" for stdout, empty for none)
+        std::string out;
+        bool list;
+
+        Options() : minTime(0.1), reps(5), maxSize(1000000),
+                    filter(), out("-"), list(false) {}
+    };
+
+    class Runner {
+        Options _opt;
+        std::vector<Result> _results;
+        std::vector<std::pair<std::string, double> > _metrics;
+    public:
+        explicit Runner(const Options &o) :
+            _opt(o), _results(), _metrics() {}
+
+        inline const Options &options() const { return _opt; }
+        inline const std::vector<Result> &results() const { return _results; }
+
+        /// true if the benchmark called name has to be measured
+        bool selected(const std::string &name) const;
+
+        /**
+           Measures body, which performs n operations per call, and
+           stores the result. The configuration is described by the
+           params. Returns the median time per operation, in ns.
+        */
+        double measure(const std::string &name, const Params &params,
+                       const std::function<void(uint64_t)> &body);
+
+        /// Stores a value that is not a time (e.g. the size of a
+        /// class), reported in the "metrics" of the output
+        void metric(const std::string &name, double value);
+
+        /// Writes all the results in JSON format
+        void writeJson(std::ostream &os) const;
+    };
+
+    typedef void (*BenchFun)(Runner &);
+
+    /// The list of the registered benchmarks
+    std::vector<std::pair<std::string, BenchFun> > &registry();
+
+    struct Registrar {
+        Registrar(const char *name, BenchFun f) {
+            registry().push_back(std::make_pair(std::string(name), f));
+        }
+    };
+
+} // namespace bench
+
+#define BENCHMARK(name)                                         \
+    static void bench_##name(bench::Runner &r);                 \
+    static bench::Registrar bench_reg_##name(#name, bench_##name); \
+    static void bench_##name(bench::Runner &r)
+
+#endif
@@ -0,0 +1,158 @@
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+#ifdef __unix__
+#include <sys/resource.h>
+#endif
+
+#include <event.hpp>
+#include <randomvar.hpp>
+#include <simul.hpp>
+
+#include "macro.hpp"
+
+using namespace std;
+using namespace MetaSim;
+
+namespace bench {
+
+    Args::Args(int argc, char *argv[]) :
+        _val(), _known(), _prog(argv[0]), _help(false)
+    {
+        for (int i = 1; i < argc; ++i) {
+            string a = argv[i];
+            if (a == "--help" || i + 1 == argc) _help = true;
+            else _val[a] = argv[++i];
+        }
+    }
+
+    string Args::get(const string &name, const string &def)
+    {
+        _known[name] = def;
+        auto i = _val.find(name);
+        return i == _val.end() ? def : i->second;
+    }
+
+    uint64_t Args::get(const string &name, uint64_t def)
+    {
+        string v = get(name, par(def));
+        return strtoull(v.c_str(), NULL, 10);
+    }
+
+    double Args::get(const string &name, double def)
+    {
+        return atof(get(name, par(def)).c_str());
+    }
+
+    bool Args::check() const
+    {
+        bool ok = !_help;
+        for (auto &v : _val)
+            if (_known.find(v.first) == _known.end()) {
+                cerr << "Unknown option " << v.first << endl;
+                ok = false;
+            }
+        if (!ok) {
+            cerr << "Usage: " << _prog << " [options]" << endl;
+            for (auto &k : _known)
+                cerr << "  " << left << setw(14) << k.first
+                     << " (default " << k.second << ")" << endl;
+        }
+        return ok;
+    }
+
+    long peakRss()
+    {
+#ifdef __unix__
+        struct rusage u;
+        if (getrusage(RUSAGE_SELF, &u) == 0) {
+#ifdef __APPLE__
+            return u.ru_maxrss / 1024;
+#else
+            return u.ru_maxrss;
+#endif
+        }
+#endif
+        return 0;
+    }
+
+    Macro::Macro(const string &name, Args &args,
+                 uint64_t length, uint64_t runs) :
+        _name(name), _params(), _args(args),
+        _length(args.get("--length", length)),
+        _runs(args.get("--runs", runs)),
+        _out(args.get("--out", "-"))
+    {
+        string queue = args.get("--queue", "");
+        RandNum seed = RandNum(args.get("--seed", 12345));
+        if (!queue.empty()) Event::setEventQueue(queue);
+        RandomVar::init(seed);
+        param("queue", queue.empty() ? "default" : queue);
+        param("seed", seed);
+    }
+
+    int Macro::run()
+    {
+        if (!_args.check()) return 1;
+        param("length", _length);
+        param("runs", _runs);
+
+        // the engine prints the number of every run on cout
+        streambuf *old = cout.rdbuf();
+        ostringstream discard;
+        cout.rdbuf(discard.rdbuf());
+        Clock::time_point t0 = Clock::now();
+        try {
+            SIMUL.run(Tick(int64_t(_length)), int(_runs));
+        } catch (exception &e) {
+            cout.rdbuf(old);
+            cerr << e.what() << endl;
+            return 1;
+        }
+        double wall = chrono::duration<double>(Clock::now() - t0).count();
+        cout.rdbuf(old);
+
+        uint64_t events = SIMUL.getExecutedEvents();
+        double eps = wall > 0 ? events / wall : 0;
+        long rss = peakRss();
+
+        cerr << _name;
+        for (auto &p : _params) cerr << " " << p.first << "=" << p.second;
+        cerr << endl << fixed << setprecision(3)
+             << "  wall time " << wall << " s, " << events << " events, "
+             << setprecision(0) << eps << " events/s, peak RSS "
+             << rss << " KB" << endl;
+
+        ofstream f;
+        if (_out != "-") {
+            f.open(_out.c_str());
+            if (!f) {
+                cerr << "Cannot open " << _out << endl;
+                return 1;
+            }
+        }
+        ostream &os = _out == "-" ? cout : f;
+        os << "{\"suite\": \"metasim-macro\", \"name\": \"" << _name
+           << "\", \"params\": {";
+        for (size_t k = 0; k < _params.size(); ++k)
+            os << (k ? ", " : "") << "\"" << _params[k].first << "\": \""
+               << _params[k].second << "\"";
+        os << "}, " << setprecision(6) << "\"wall_time\": " << wall
+           << ", \"events\": " << events
+           << ", \"events_per_sec\": " << fixed << setprecision(0) << eps
+           << ", \"peak_rss_kb\": " << rss << "}" << endl;
+        return 0;
+    }
+
+} // namespace bench
@@ -0,0 +1,105 @@
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef __MACRO_HPP__
+#define __MACRO_HPP__
+
+#include <cstdint>
+#include <map>
+#include <string>
+
+#include "bench.hpp"
+
+/**
+   Support for the macro benchmarks: complete models, derived from
+   the examples, whose size is set from the command line.
+
+   Every workload is a separate program. It reads its knobs with
+   Args, builds the model in the default context and lets Macro run
+   it with Simulation::run(), measuring the wall time, the executed
+   events and the peak resident memory of the process:
+
+   @code
+   int main(int argc, char *argv[])
+   {
+       bench::Args args(argc, argv);
+       size_t n = args.get("--states", 100);   // the knobs of the model
+       bench::Macro m("markov", args);
+       m.param("states", n);
+       // build the model
+       return m.run();
+   }
+   @endcode
+
+   The common knobs are --length (of each run, in ticks), --runs,
+   --seed, --queue (the event queue, see Event::setEventQueue()) and
+   --out (the JSON file, "-" for stdout).
+*/
+namespace bench {
+
+    /// The options of a macro benchmark, in the form --name value
+    class Args {
+        std::map<std::string, std::string> _val;
+        std::map<std::string, std::string> _known;
+        std::string _prog;
+        bool _help;
+    public:
+        Args(int argc, char *argv[]);
+
+        /// Returns the value of an option, or def if not given
+        std::string get(const std::string &name, const std::string &def);
+        std::string get(const std::string &name, const char *def) {
+            return get(name, std::string(def));
+        }
+        uint64_t get(const std::string &name, uint64_t def);
+        uint64_t get(const std::string &name, int def) {
+            return get(name, uint64_t(def));
+        }
+        double get(const std::string &name, double def);
+
+        /**
+           Prints the usage and returns false if an option is not
+           known, or if --help has been given. To be called after
+           reading all the options.
+        */
+        bool check() const;
+    };
+
+    /// Peak resident memory of the process, in KB (0 if unknown)
+    long peakRss();
+
+    /// Runs a model with Simulation::run() and reports the result
+    class Macro {
+        std::string _name;
+        Params _params;
+        Args &_args;
+        uint64_t _length;
+        uint64_t _runs;
+        std::string _out;
+    public:
+        /// Reads the common knobs and sets the event queue and the
+        /// seed of the default context
+        Macro(const std::string &name, Args &args,
+              uint64_t length = 1000000, uint64_t runs = 3);
+
+        /// Adds a knob of the model to the report
+        template <class T>
+        void param(const std::string &key, const T &v) {
+            _params.push_back(std::make_pair(key, par(v)));
+        }
+        void param(const std::string &key, const std::string &v) {
+            _params.push_back(std::make_pair(key, v));
+        }
+
+        /// Runs the simulation; returns the exit code of main()
+        int run();
+    };
+
+} // namespace bench
+
+#endif
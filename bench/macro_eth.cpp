@@ -0,0 +1,72 @@
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+/*
+  Ethernet segment with N nodes, built with the classes of
+  examples/eth. Every node sends messages to its two neighbours on
+  a ring; the interval between two messages is scaled with N so that
+  the offered load of the link is --load, as in the example.
+*/
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "link.hpp"
+#include "message.hpp"
+#include "netinterface.hpp"
+#include "node.hpp"
+#include "macro.hpp"
+
+using namespace std;
+using namespace MetaSim;
+
+const double AVG_LEN = 800;
+
+class CollisionStat : public StatCount {
+public:
+    CollisionStat(const char *name) : StatCount(name) {}
+    void probe(GEvent<EthernetLink> &e) { record(1); }
+};
+
+int main(int argc, char *argv[])
+{
+    bench::Args args(argc, argv);
+    uint64_t n = args.get("--nodes", 64);
+    double load = args.get("--load", 0.5);
+    bench::Macro m("ethernet", args, 1000000000, 3);
+    m.param("nodes", n);
+    m.param("load", load);
+
+    if (n < 2 || load <= 0) {
+        cerr << "At least 2 nodes and a positive load are needed" << endl;
+        return 1;
+    }
+
+    MessagePool messages;
+    EthernetLink link("Eth_Link");
+    vector<unique_ptr<Node> > nodes;
+    vector<unique_ptr<EthernetInterface> > interfaces;
+    for (uint64_t i = 0; i < n; ++i) {
+        nodes.emplace_back(new Node("Node_" + to_string(i)));
+        string name = "Interface_" + to_string(i);
+        interfaces.emplace_back(new EthernetInterface(name.c_str(),
+                                                      *nodes.back(), link));
+    }
+    for (uint64_t i = 0; i < n; ++i) {
+        nodes[i]->setMessagePool(messages);
+        nodes[i]->addDestNode(*nodes[(i + 1) % n]);
+        nodes[i]->addDestNode(*nodes[(i + n - 1) % n]);
+        nodes[i]->setInterval(unique_ptr<RandomVar>(
+                                  new UniformVar(1, 2 * n * AVG_LEN / load)));
+    }
+
+    CollisionStat collisions("collisions");
+    attach_stat(collisions, link._collision_evt);
+
+    return m.run();
+}
@@ -0,0 +1,63 @@
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+/*
+  Continuous time Markov chains with N states, built with the classes
+  of examples/markov. Every state has --links exits towards random
+  states. A chain has only one pending event, so --chains independent
+  chains are simulated together to scale the size of the event queue.
+*/
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "markov.hpp"
+#include "macro.hpp"
+
+using namespace std;
+using namespace MetaSim;
+
+int main(int argc, char *argv[])
+{
+    bench::Args args(argc, argv);
+    uint64_t n = args.get("--states", 1000);
+    uint64_t links = args.get("--links", 3);
+    uint64_t chains = args.get("--chains", 16);
+    bench::Macro m("markov", args, 1000000, 3);
+    m.param("states", n);
+    m.param("links", links);
+    m.param("chains", chains);
+
+    if (n == 0 || links == 0 || chains == 0) {
+        cerr << "States, links and chains must be positive" << endl;
+        return 1;
+    }
+
+    // the topology does not depend on the seed of the simulation
+    RandomGen topo(1);
+    vector<unique_ptr<State> > states;
+    vector<unique_ptr<AvgTimeStateStat> > stats;
+    for (uint64_t c = 0; c < chains; ++c) {
+        size_t first = states.size();
+        for (uint64_t i = 0; i < n; ++i) {
+            string name = "state_" + to_string(c) + "_" + to_string(i);
+            states.emplace_back(new State(name.c_str(), i == 0));
+        }
+        // jumps with rate 0.1, i.e. 10 ticks on average per link
+        for (uint64_t i = 0; i < n; ++i)
+            for (uint64_t l = 0; l < links; ++l) {
+                size_t dst = first + topo.sample() % n;
+                states[first + i]->put_link(0.1, states[dst].get());
+            }
+        string name = "time_" + to_string(c);
+        stats.emplace_back(new AvgTimeStateStat(name.c_str()));
+        attach_stat(*stats.back(), states[first]->_event);
+    }
+
+    return m.run();
+}
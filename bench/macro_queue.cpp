@@ -0,0 +1,102 @@
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+/*
+  Network of M/M/1 queues, built with the classes of examples/queue.
+
+  - tandem: one source feeds a line of N queues, the last one feeds
+    the sink;
+  - jackson: every queue has its own source, and after the service a
+    packet leaves the network with probability --exit, or joins a
+    random queue.
+
+  With the default rates every queue is loaded at 50%.
+*/
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "queue.hpp"
+#include "macro.hpp"
+
+using namespace std;
+using namespace MetaSim;
+
+/// Sends the packets to a random queue, or out of the network
+class Router : public Node {
+    vector<Queue *> *_queues;
+    Node *_exit;
+    double _pexit;
+    UniformVar _u;
+public:
+    Router(vector<Queue *> *q, Node *exit, double pexit, const string &n) :
+        Node(n.c_str()), _queues(q), _exit(exit), _pexit(pexit), _u(0, 1) {}
+
+    virtual void put() {
+        double x = _u.get();
+        if (x < _pexit) _exit->put();
+        else {
+            size_t k = size_t((x - _pexit) / (1 - _pexit) * _queues->size());
+            (*_queues)[min(k, _queues->size() - 1)]->put();
+        }
+    }
+};
+
+int main(int argc, char *argv[])
+{
+    bench::Args args(argc, argv);
+    string topology = args.get("--topology", "jackson");
+    uint64_t n = args.get("--queues", 64);
+    double service = args.get("--service", 10.0);
+    double pexit = args.get("--exit", 0.5);
+    bench::Macro m("queue_network", args, 1000000, 3);
+    m.param("topology", topology);
+    m.param("queues", n);
+
+    if (n == 0 || (topology != "tandem" && topology != "jackson")) {
+        cerr << "Wrong topology or number of queues" << endl;
+        return 1;
+    }
+    if (pexit <= 0 || pexit > 1) {
+        cerr << "The exit probability must be in (0, 1]" << endl;
+        return 1;
+    }
+    bool tandem = topology == "tandem";
+
+    Sink sink("sink");
+    ExponentialVar st(1 / service);
+    // 50% load: in the Jackson network the total arrival rate of
+    // a queue is its external rate divided by the exit probability
+    ExponentialVar at(tandem ? 0.5 / service : 0.5 * pexit / service);
+
+    vector<Queue *> queues(n);
+    vector<unique_ptr<Node> > nodes;
+    vector<unique_ptr<Source> > sources;
+    for (uint64_t i = n; i-- > 0; ) {
+        Node *next;
+        if (tandem) next = i + 1 < n ? (Node *)queues[i + 1] : &sink;
+        else {
+            nodes.emplace_back(new Router(&queues, &sink, pexit,
+                                          "router_" + to_string(i)));
+            next = nodes.back().get();
+        }
+        string name = "queue_" + to_string(i);
+        Queue *q = new Queue(next, &st, name.c_str());
+        nodes.emplace_back(q);
+        queues[i] = q;
+        if (!tandem || i == 0) {
+            name = "source_" + to_string(i);
+            sources.emplace_back(new Source(q, &at, name.c_str()));
+        }
+    }
+
+    AvgQueueSizeStat avgSize(*queues[0], "avg_queue_size");
+    attach_stat(avgSize, sources.back()->_prodEvent);
+
+    return m.run();
+}
@@ -0,0 +1,1077 @@
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+/*
+  Microbenchmarks of the simulation kernel: the scheduling loop, the
+  dispatch of the events, the particles, the random variables, the
+  statistics and the Tick arithmetic.
+*/
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <aliastable.hpp>
+#include <basestat.hpp>
+#include <bufferedstat.hpp>
+#include <chunktrace.hpp>
+#include <datafile.hpp>
+#include <entity.hpp>
+#include <event.hpp>
+#include <gevent.hpp>
+#include <history.hpp>
+#include <lambdaevent.hpp>
+#include <particle.hpp>
+#include <prefetchvar.hpp>
+#include <quantilesketch.hpp>
+#include <randomgen.hpp>
+#include <randomvar.hpp>
+#include <simloop.hpp>
+#include <simul.hpp>
+#include <statoutput.hpp>
+#include <trace.hpp>
+#include <tracebinary.hpp>
+#include <windowstat.hpp>
+
+#include "bench.hpp"
+
+using namespace std;
+using namespace MetaSim;
+
+namespace {
+
+    const RandNum SEED = 12345;
+
+    /// Table of exponential increments, shared by the hold events,
+    /// so that the random generator is not part of the measure.
+    class Increments {
+        vector<Tick> _v;
+        size_t _k;
+    public:
+        explicit Increments(double mean) : _v(4096), _k(0) {
+            RandomGen gen(SEED);
+            RandomVar::changeGenerator(&gen);
+            ExponentialVar e(mean);
+            RandomVar::restoreGenerator();
+            for (auto &t : _v) t = Tick(1 + e.get());
+        }
+        inline Tick next() { return _v[_k++ & (_v.size() - 1)]; }
+    };
+
+    /// Classic hold model: each executed event posts itself again
+    class HoldEvent : public Event {
+        Increments *_incr;
+    public:
+        explicit HoldEvent(Increments *i) : Event(), _incr(i) {}
+        HoldEvent(const HoldEvent &e) : Event(e), _incr(e._incr) {}
+        virtual void doit() { post(getTime() + _incr->next()); }
+    };
+
+    /// The hold model, with the events of an owner
+    class OwnedHoldEvent : public HoldEvent {
+        const void *_owner;
+    public:
+        OwnedHoldEvent(Increments *i, const void *o) : HoldEvent(i), _owner(o) {}
+        virtual const void *getOwner() const { return _owner; }
+    };
+
+    /// The hold model with 2 events in 5 posted again at the
+    /// current time
+    class ZeroDelayEvent : public Event {
+        Increments *_incr;
+        unsigned _k;
+    public:
+        explicit ZeroDelayEvent(Increments *i) : Event(), _incr(i), _k(0) {}
+        ZeroDelayEvent(const ZeroDelayEvent &e) : Event(e), _incr(e._incr), _k(0) {}
+        virtual void doit() {
+            post(getTime() + (++_k % 5 < 2 ? Tick(0) : _incr->next()));
+        }
+    };
+
+    /// PHOLD: each executed event dies, and a new disposable event
+    /// is created for a random site
+    class PholdEvent : public Event {
+        size_t _site;
+    public:
+        static Increments *incr;
+        static RandomGen *gen;
+        static size_t sites;
+
+        explicit PholdEvent(size_t s) : Event(), _site(s) {}
+        virtual void doit() {
+            size_t dst = (_site + gen->sample()) % sites;
+            Event::create<PholdEvent>(dst)->post(getTime() + incr->next(), true);
+        }
+    };
+
+    Increments *PholdEvent::incr = NULL;
+    RandomGen *PholdEvent::gen = NULL;
+    size_t PholdEvent::sites = 1;
+
+    vector<uint64_t> queueSizes(const bench::Runner &r)
+    {
+        vector<uint64_t> v;
+        for (uint64_t n = 10; n <= r.options().maxSize; n *= 10) v.push_back(n);
+        return v;
+    }
+
+    /// An entity whose handler reposts its own event
+    class Ticker : public Entity {
+    public:
+        GEvent<Ticker> tick;
+        uint64_t count;
+
+        Ticker() : Entity(""), tick(this, &Ticker::onTick), count(0) {}
+        void onTick(Event *e) { ++count; tick.post(SIMUL.getTime() + 1); }
+        void newRun() {}
+        void endRun() {}
+    };
+
+    /// Same as Ticker, with the handler bound at compile time
+    class BoundTicker : public Entity {
+    public:
+        void onTick(Event *e) { ++count; tick.post(SIMUL.getTime() + 1); }
+
+        GEvent<BoundTicker, &BoundTicker::onTick> tick;
+        uint64_t count;
+
+        BoundTicker() : Entity(""), tick(this), count(0) {}
+        void newRun() {}
+        void endRun() {}
+    };
+
+    /// Same as Ticker, with a virtual doit() instead of a GEvent
+    class TickEvent : public Event {
+    public:
+        uint64_t count;
+        TickEvent() : Event(), count(0) {}
+        virtual void doit() { ++count; post(getTime() + 1); }
+    };
+
+    class Counter : public Entity {
+    public:
+        void onEvent(Event *) { ++count; }
+
+        GEvent<Counter> evt;
+        GEvent<Counter, &Counter::onEvent> bound;
+        uint64_t count;
+
+        Counter() : Entity(""), evt(this, &Counter::onEvent), bound(this),
+                    count(0) {}
+        void newRun() {}
+        void endRun() {}
+    };
+
+    /// An entity without events, for the registry benchmarks
+    class Idle : public Entity {
+    public:
+        uint64_t runs;
+        explicit Idle(const string &n) : Entity(n), runs(0) {}
+        void newRun() { ++runs; }
+        void endRun() {}
+    };
+
+    /// An entity with some state to reset and a pending event,
+    /// and a disposable event of its own at every run
+    class Station : public Entity {
+        vector<double> _state;
+    public:
+        GEvent<Station> evt;
+
+        Station() : Entity(""), _state(64), evt(this, &Station::onEvent) {
+            setIndependent();
+        }
+        void onEvent(Event *) {}
+        void newRun() {
+            fill(_state.begin(), _state.end(), 0.0);
+            evt.post(Tick(getID() % 1000));
+        }
+        void endRun() {}
+    };
+
+    /// A station of a slotted model, with some work at every slot
+    class SlotStation : public Entity {
+        uint64_t _state;
+    public:
+        GEvent<SlotStation> slot;
+        unsigned work;
+
+        explicit SlotStation(unsigned w) : Entity(""), _state(getID()),
+                                           slot(this, &SlotStation::onSlot),
+                                           work(w) {}
+        void onSlot(Event *) {
+            for (unsigned i = 0; i < work; ++i)
+                _state = _state * 6364136223846793005ULL + 1442695040888963407ULL;
+            slot.post(SIMUL.getTime() + Tick(1 + int64_t(_state >> 63)));
+        }
+        void newRun() {}
+        void endRun() {}
+    };
+
+    /// A counter to be attached to an event with a particle
+    class ProbeCount : public StatCount {
+    public:
+        ProbeCount() : StatCount("") {}
+        void probe(Event &) { record(1); }
+    };
+
+    /// A mean of the event times, computed as the samples arrive
+    /// (S = StatMean) or in bulk (S = BufferedStat)
+    template <class S>
+    class ProbeTime : public S {
+    public:
+        template <class... A>
+        ProbeTime(A... a) : S(a...) {}
+        void probe(Event &e) { this->record(double(e.getTime())); }
+    };
+
+} // namespace
+
+/*
+  The sizes of the events: every pending event of a model costs at
+  least this memory, so they are tracked along with the times.
+*/
+BENCHMARK(layout)
+{
+    r.metric("sizeof_event", sizeof(Event));
+    r.metric("sizeof_gevent", sizeof(GEvent<Ticker>));
+    r.metric("sizeof_gevent_bound", sizeof(GEvent<Counter, &Counter::onEvent>));
+    r.metric("sizeof_lambda_event", sizeof(LambdaEvent));
+}
+
+BENCHMARK(hold)
+{
+    const char *queues[] = { "heap", "heap(4)", "calendar", "ladder", "set" };
+    for (const char *q : queues) {
+        for (uint64_t n : queueSizes(r)) {
+            SimContext ctx;
+            SimContext::Scope s(ctx);
+            ctx.setEventQueue(q);
+            Increments incr(100);
+            vector<HoldEvent> evts(n, HoldEvent(&incr));
+            for (auto &e : evts) e.post(incr.next());
+
+            Simulation &sim = ctx.getSimulation();
+            r.measure("hold", {{"queue", q}, {"size", bench::par(n)}},
+                      [&](uint64_t k) {
+                          for (uint64_t i = 0; i < k; ++i) sim.sim_step();
+                      });
+            sim.clearEventQueue();
+        }
+    }
+}
+
+BENCHMARK(loop)
+{
+    // the hold model driven by sim_step(), and by the main loop
+    // with and without the particles
+    const uint64_t n = 1000;
+    for (const char *mode : { "sim_step", "loop", "loop_bare" }) {
+        SimContext ctx;
+        SimContext::Scope s(ctx);
+        Increments incr(100);
+        vector<HoldEvent> evts(n, HoldEvent(&incr));
+        for (auto &e : evts) e.post(incr.next());
+
+        Simulation &sim = ctx.getSimulation();
+        const string m = mode;
+        r.measure("loop", {{"mode", mode}}, [&](uint64_t k) {
+                if (m == "sim_step")
+                    for (uint64_t i = 0; i < k; ++i) sim.sim_step();
+                else if (m == "loop")
+                    sim.loop(StopAfterEvents(k));
+                else
+                    sim.loop<LoopOptions<false, false> >(StopAfterEvents(k));
+            });
+        sim.clearEventQueue();
+    }
+}
+
+BENCHMARK(progress)
+{
+    // the cost of the progress reports (see Progress): none, every
+    // million events (the test of the counter) and every thousand
+    const uint64_t n = 1000;
+    for (uint64_t every : { uint64_t(0), uint64_t(1000000), uint64_t(1000) }) {
+        SimContext ctx;
+        SimContext::Scope s(ctx);
+        Increments incr(100);
+        vector<HoldEvent> evts(n, HoldEvent(&incr));
+        for (auto &e : evts) e.post(incr.next());
+
+        if (every > 0) ctx.enableProgress(every);
+        Simulation &sim = ctx.getSimulation();
+        sim.initRuns(1);
+        r.measure("progress", {{"every", bench::par(every)}},
+                  [&](uint64_t k) {
+                      for (uint64_t i = 0; i < k; ++i) sim.sim_step();
+                  });
+        sim.clearEventQueue();
+    }
+}
+
+BENCHMARK(immediate)
+{
+    // the hold model with 40% of zero-delay posts, with and without
+    // the lanes of the events of the current time
+    for (const char *q : { "heap", "ladder" }) {
+        for (bool lanes : { false, true }) {
+            for (uint64_t n : queueSizes(r)) {
+                SimContext ctx;
+                SimContext::Scope s(ctx);
+                ctx.setImmediateLanes(lanes);
+                ctx.setEventQueue(q);
+                Increments incr(100);
+                vector<ZeroDelayEvent> evts(n, ZeroDelayEvent(&incr));
+                for (auto &e : evts) e.post(incr.next());
+
+                Simulation &sim = ctx.getSimulation();
+                r.measure("immediate", {{"queue", q}, {"lanes", lanes ? "on" : "off"},
+                                        {"size", bench::par(n)}},
+                          [&](uint64_t k) {
+                              for (uint64_t i = 0; i < k; ++i) sim.sim_step();
+                          });
+                sim.clearEventQueue();
+            }
+        }
+    }
+}
+
+BENCHMARK(twolevel)
+{
+    // the hold model with n events, k events per entity
+    uint64_t n = min<uint64_t>(100000, r.options().maxSize);
+    for (const char *q : { "heap", "twolevel" }) {
+        for (uint64_t k : { 1, 16, 256 }) {
+            SimContext ctx;
+            SimContext::Scope s(ctx);
+            ctx.setEventQueue(q);
+            Increments incr(100);
+            vector<char> owners(n / k + 1);
+            vector<OwnedHoldEvent> evts;
+            evts.reserve(n);
+            for (uint64_t i = 0; i < n; ++i)
+                evts.push_back(OwnedHoldEvent(&incr, &owners[i / k]));
+            for (auto &e : evts) e.post(incr.next());
+
+            Simulation &sim = ctx.getSimulation();
+            r.measure("twolevel", {{"queue", q}, {"per_entity", bench::par(k)},
+                                   {"size", bench::par(n)}},
+                      [&](uint64_t m) {
+                          for (uint64_t i = 0; i < m; ++i) sim.sim_step();
+                      });
+            sim.clearEventQueue();
+        }
+    }
+}
+
+BENCHMARK(step)
+{
+    // 1000 stations of a slotted model, with the steps serial or
+    // parallel (see Simulation::setStepThreads())
+    const size_t n = 1000;
+    for (unsigned work : { 10, 1000 }) {
+        for (unsigned threads : { 1, 2, 4 }) {
+            SimContext ctx;
+            SimContext::Scope s(ctx);
+            Simulation &sim = ctx.getSimulation();
+            sim.setStepThreads(threads);
+            vector<unique_ptr<SlotStation> > st;
+            for (size_t i = 0; i < n; ++i) {
+                st.emplace_back(new SlotStation(work));
+                st.back()->slot.post(0);
+            }
+            uint64_t before = 0;
+            r.measure("step", {{"work", bench::par(work)},
+                               {"threads", bench::par(threads)}},
+                      [&](uint64_t k) {
+                          // k events, by whole steps
+                          before = sim.getExecutedEvents();
+                          while (sim.getExecutedEvents() - before < k) sim.sim_step();
+                      });
+            sim.clearEventQueue();
+        }
+    }
+}
+
+BENCHMARK(timer)
+{
+    // a timer re-armed many times before firing, among n events
+    const char *methods[] = { "drop_post", "reschedule", "cancel_lazy" };
+    for (const char *q : { "heap", "ladder", "set" }) {
+        for (const char *m : methods) {
+            uint64_t n = min<uint64_t>(10000, r.options().maxSize);
+            SimContext ctx;
+            SimContext::Scope s(ctx);
+            ctx.setEventQueue(q);
+            Increments incr(100);
+            vector<HoldEvent> evts(n, HoldEvent(&incr));
+            for (auto &e : evts) e.post(incr.next());
+            HoldEvent timer(&incr);
+            timer.post(incr.next());
+
+            string method = m;
+            r.measure("timer", {{"queue", q}, {"method", m},
+                                {"size", bench::par(n)}},
+                      [&](uint64_t k) {
+                          if (method == "drop_post")
+                              for (uint64_t i = 0; i < k; ++i) {
+                                  timer.drop();
+                                  timer.post(incr.next());
+                              }
+                          else if (method == "reschedule")
+                              for (uint64_t i = 0; i < k; ++i)
+                                  timer.reschedule(incr.next());
+                          else
+                              for (uint64_t i = 0; i < k; ++i) {
+                                  timer.cancelLazy();
+                                  timer.post(incr.next());
+                              }
+                      });
+            ctx.getSimulation().clearEventQueue();
+        }
+    }
+}
+
+BENCHMARK(phold)
+{
+    const size_t sites = 64;
+    for (uint64_t n : queueSizes(r)) {
+        if (n < 1000) continue;
+        SimContext ctx;
+        SimContext::Scope s(ctx);
+        Increments incr(100);
+        RandomGen gen(SEED);
+        PholdEvent::incr = &incr;
+        PholdEvent::gen = &gen;
+        PholdEvent::sites = sites;
+        for (uint64_t i = 0; i < n; ++i)
+            Event::create<PholdEvent>(i % sites)->post(incr.next(), true);
+
+        Simulation &sim = ctx.getSimulation();
+        r.measure("phold", {{"sites", bench::par(sites)},
+                            {"population", bench::par(n)}},
+                  [&](uint64_t k) {
+                      for (uint64_t i = 0; i < k; ++i) sim.sim_step();
+                  });
+        sim.clearEventQueue();
+    }
+}
+
+BENCHMARK(dispatch)
+{
+    {
+        SimContext ctx;
+        SimContext::Scope s(ctx);
+        TickEvent e;
+        e.post(0);
+        Simulation &sim = ctx.getSimulation();
+        r.measure("dispatch", {{"event", "virtual"}}, [&](uint64_t k) {
+                for (uint64_t i = 0; i < k; ++i) sim.sim_step();
+            });
+        bench::keep(e.count);
+    }
+    {
+        SimContext ctx;
+        SimContext::Scope s(ctx);
+        Ticker t;
+        t.tick.post(0);
+        Simulation &sim = ctx.getSimulation();
+        r.measure("dispatch", {{"event", "gevent"}}, [&](uint64_t k) {
+                for (uint64_t i = 0; i < k; ++i) sim.sim_step();
+            });
+        bench::keep(t.count);
+    }
+    {
+        SimContext ctx;
+        SimContext::Scope s(ctx);
+        BoundTicker t;
+        t.tick.post(0);
+        Simulation &sim = ctx.getSimulation();
+        r.measure("dispatch", {{"event", "gevent_bound"}}, [&](uint64_t k) {
+                for (uint64_t i = 0; i < k; ++i) sim.sim_step();
+            });
+        bench::keep(t.count);
+    }
+    {
+        SimContext ctx;
+        SimContext::Scope s(ctx);
+        uint64_t count = 0;
+        LambdaEvent e([&](Event *ev) { ++count; ev->post(ev->getTime() + 1); });
+        e.post(0);
+        Simulation &sim = ctx.getSimulation();
+        r.measure("dispatch", {{"event", "lambda"}}, [&](uint64_t k) {
+                for (uint64_t i = 0; i < k; ++i) sim.sim_step();
+            });
+        bench::keep(count);
+    }
+    {
+        // the handler call alone, without the event queue
+        SimContext ctx;
+        SimContext::Scope s(ctx);
+        Counter c;
+        Event &e = c.evt;
+        r.measure("dispatch", {{"event", "gevent_doit"}}, [&](uint64_t k) {
+                for (uint64_t i = 0; i < k; ++i) e.doit();
+            });
+        bench::keep(c.count);
+    }
+    {
+        SimContext ctx;
+        SimContext::Scope s(ctx);
+        Counter c;
+        Event &e = c.bound;
+        r.measure("dispatch", {{"event", "gevent_bound_doit"}}, [&](uint64_t k) {
+                for (uint64_t i = 0; i < k; ++i) e.doit();
+            });
+        bench::keep(c.count);
+    }
+}
+
+BENCHMARK(particle)
+{
+    const size_t probes[] = { 0, 1, 4, 16 };
+    for (size_t np : probes) {
+        SimContext ctx;
+        SimContext::Scope s(ctx);
+        Ticker t;
+        vector<unique_ptr<ProbeCount> > stats;
+        for (size_t i = 0; i < np; ++i) {
+            stats.emplace_back(new ProbeCount());
+            attach_stat(*stats.back(), t.tick);
+        }
+        t.tick.post(0);
+        Simulation &sim = ctx.getSimulation();
+        r.measure("particle", {{"probes", bench::par(np)}}, [&](uint64_t k) {
+                for (uint64_t i = 0; i < k; ++i) sim.sim_step();
+            });
+        sim.clearEventQueue();
+    }
+}
+
+BENCHMARK(particle_stat)
+{
+    const size_t probes[] = { 1, 4, 16 };
+    for (size_t np : probes)
+        for (int buffered = 0; buffered < 2; ++buffered) {
+            SimContext ctx;
+            SimContext::Scope s(ctx);
+            Ticker t;
+            vector<unique_ptr<BaseStat> > stats;
+            for (size_t i = 0; i < np; ++i) {
+                if (buffered) {
+                    auto p = new ProbeTime<BufferedStat>(BufferedStat::MEAN);
+                    stats.emplace_back(p);
+                    attach_stat(*p, t.tick);
+                } else {
+                    auto p = new ProbeTime<StatMean>();
+                    stats.emplace_back(p);
+                    attach_stat(*p, t.tick);
+                }
+            }
+            t.tick.post(0);
+            Simulation &sim = ctx.getSimulation();
+            r.measure("particle_stat",
+                      {{"probes", bench::par(np)},
+                       {"stat", buffered ? "buffered_mean" : "mean"}},
+                      [&](uint64_t k) {
+                    for (uint64_t i = 0; i < k; ++i) sim.sim_step();
+                });
+            for (auto &st : stats) bench::keep(st->getValue());
+            sim.clearEventQueue();
+        }
+}
+
+BENCHMARK(entity)
+{
+    const uint64_t sizes[] = { 1000, 100000 };
+    for (uint64_t n : sizes) {
+        if (n > r.options().maxSize) continue;
+        SimContext ctx;
+        SimContext::Scope s(ctx);
+        vector<unique_ptr<Idle> > v;
+        for (uint64_t i = 0; i < n; ++i)
+            v.emplace_back(new Idle("idle_" + to_string(i)));
+        // one operation is the reset of one entity
+        r.measure("entity_newrun", {{"entities", bench::par(n)}}, [&](uint64_t k) {
+                for (uint64_t i = 0; i < k; i += n) Entity::callNewRun();
+            });
+        vector<string> names;
+        for (uint64_t i = 0; i < 4096; ++i)
+            names.push_back("idle_" + to_string((i * 7919) % n));
+        Entity *last = NULL;
+        r.measure("entity_find", {{"entities", bench::par(n)}}, [&](uint64_t k) {
+                for (uint64_t i = 0; i < k; ++i) last = Entity::_find(names[i & 4095]);
+            });
+        bench::keep(last);
+        bench::keep(v[0]->runs);
+    }
+
+    // one operation is the creation and the destruction of an
+    // entity, with or without a name
+    for (int named = 0; named < 2; ++named) {
+        SimContext ctx;
+        SimContext::Scope s(ctx);
+        vector<string> names;
+        if (named)
+            for (uint64_t i = 0; i < 4096; ++i) names.push_back("idle_" + to_string(i));
+        r.measure("entity_create", {{"named", named ? "yes" : "no"}}, [&](uint64_t k) {
+                vector<unique_ptr<Idle> > v;
+                for (uint64_t i = 0; i < k; i += 4096) {
+                    uint64_t m = min<uint64_t>(4096, k - i);
+                    Entity::reserve(m);
+                    for (uint64_t j = 0; j < m; ++j)
+                        v.emplace_back(new Idle(named ? names[j] : string()));
+                    while (!v.empty()) v.pop_back();
+                }
+            });
+    }
+}
+
+/*
+  The reset between two short replicas: newRun() of every entity
+  (serial, or in parallel for the independent ones) and the clear
+  of the queue, with one pending event per entity and as many
+  disposable ones. One operation is a whole reset.
+*/
+BENCHMARK(replica_reset)
+{
+    const uint64_t sizes[] = { 1000, 100000 };
+    for (uint64_t n : sizes) {
+        if (n > r.options().maxSize) continue;
+        for (unsigned threads : { 1u, 4u }) {
+            SimContext ctx;
+            SimContext::Scope s(ctx);
+            vector<unique_ptr<Station> > v;
+            Entity::reserve(n);
+            for (uint64_t i = 0; i < n; ++i) v.emplace_back(new Station());
+            Entity::setNewRunThreads(threads);
+            Simulation &sim = ctx.getSimulation();
+            sim.initRuns();
+            r.measure("replica_reset",
+                      {{"entities", bench::par(n)}, {"threads", bench::par(threads)}},
+                      [&](uint64_t k) {
+                    for (uint64_t i = 0; i < k; ++i) {
+                        sim.initSingleRun();
+                        for (auto &e : v)
+                            Event::create<GEvent<Station> >(e.get(), &Station::onEvent)
+                                ->post(Tick(e->getID() % 777), true);
+                        sim.endSingleRun();
+                    }
+                });
+        }
+    }
+}
+
+BENCHMARK(randomvar)
+{
+    SimContext ctx;
+    SimContext::Scope s(ctx);
+    RandomVar::init(SEED);
+    vector<pair<const char *, unique_ptr<RandomVar> > > vars;
+    vars.emplace_back("delta", unique_ptr<RandomVar>(new DeltaVar(1)));
+    vars.emplace_back("uniform", unique_ptr<RandomVar>(new UniformVar(0, 1)));
+    vars.emplace_back("exponential", unique_ptr<RandomVar>(new ExponentialVar(1)));
+    vars.emplace_back("weibull", unique_ptr<RandomVar>(new WeibullVar(1, 2)));
+    vars.emplace_back("pareto", unique_ptr<RandomVar>(new ParetoVar(1, 2)));
+    vars.emplace_back("exponential_zig", unique_ptr<RandomVar>(
+                          new ExponentialVar(1, ExponentialVar::ZIGGURAT)));
+    vars.emplace_back("normal", unique_ptr<RandomVar>(new NormalVar(0, 1)));
+    vars.emplace_back("normal_bm", unique_ptr<RandomVar>(
+                          new NormalVar(0, 1, NormalVar::BOX_MULLER)));
+    vars.emplace_back("poisson", unique_ptr<RandomVar>(new PoissonVar(5)));
+    vars.emplace_back("poisson_200_inv", unique_ptr<RandomVar>(
+                          new PoissonVar(200, PoissonVar::INVERSION)));
+    vars.emplace_back("poisson_200", unique_ptr<RandomVar>(new PoissonVar(200)));
+
+    for (auto &v : vars) {
+        RandomVar *var = v.second.get();
+        double sum = 0;
+        r.measure("randomvar", {{"dist", v.first}}, [&](uint64_t k) {
+                for (uint64_t i = 0; i < k; ++i) sum += var->get();
+            });
+        bench::keep(sum);
+    }
+
+    // the same values in blocks, through fill() and BufferedVar,
+    // with the default and a 64 bits generator
+    const char *gens[] = { "minstd", "xoshiro" };
+    for (const char *g : gens) {
+        RandomVar::setGenerator(RandomGen::create(g, SEED));
+        vector<pair<const char *, unique_ptr<RandomVar> > > bvars;
+        bvars.emplace_back("uniform", unique_ptr<RandomVar>(new UniformVar(0, 1)));
+        bvars.emplace_back("exponential", unique_ptr<RandomVar>(new ExponentialVar(1)));
+        bvars.emplace_back("normal", unique_ptr<RandomVar>(new NormalVar(0, 1)));
+        for (auto &v : bvars) {
+            RandomVar *var = v.second.get();
+            double sum = 0;
+            r.measure("randomvar_get", {{"dist", v.first}, {"gen", g}}, [&](uint64_t k) {
+                    for (uint64_t i = 0; i < k; ++i) sum += var->get();
+                });
+            vector<double> block(256);
+            r.measure("randomvar_fill", {{"dist", v.first}, {"gen", g}}, [&](uint64_t k) {
+                    for (uint64_t i = 0; i < k; i += block.size()) {
+                        var->fill(block.data(), block.size());
+                        sum += block[0];
+                    }
+                });
+            BufferedVar buf(var->clone());
+            r.measure("randomvar_buffered", {{"dist", v.first}, {"gen", g}}, [&](uint64_t k) {
+                    for (uint64_t i = 0; i < k; ++i) sum += buf.get();
+                });
+            PrefetchVar pre(var->clone(), v.first);
+            r.measure("randomvar_prefetch", {{"dist", v.first}, {"gen", g}}, [&](uint64_t k) {
+                    for (uint64_t i = 0; i < k; ++i) sum += pre.get();
+                });
+            bench::keep(sum);
+        }
+    }
+}
+
+BENCHMARK(alias_table)
+{
+    // the sampling of a discrete PDF (GenericVar): the alias table
+    // against the linear walk of the CDF in a map
+    const size_t bins[] = { 16, 1024, 65536 };
+    for (size_t n : bins) {
+        RandomGen gen(SEED);
+        map<int, double> pdf;
+        vector<double> w;
+        for (size_t i = 0; i < n; ++i) {
+            pdf[int(i)] = 1.0 / n;
+            w.push_back(1.0 / n);
+        }
+        AliasTable t(w);
+        double sum = 0;
+        r.measure("alias_table", {{"bins", bench::par(n)}}, [&](uint64_t k) {
+                for (uint64_t i = 0; i < k; ++i) sum += t.sample(gen.uniform());
+            });
+        r.measure("cdf_walk", {{"bins", bench::par(n)}}, [&](uint64_t k) {
+                for (uint64_t i = 0; i < k; ++i) {
+                    double u = gen.uniform(), cdf = 0;
+                    for (auto &p : pdf) {
+                        cdf += p.second;
+                        if (cdf > u) { sum += p.first; break; }
+                    }
+                }
+            });
+        bench::keep(sum);
+    }
+}
+
+BENCHMARK(parse_util)
+{
+    // a line of a scenario, split in instructions and parameters,
+    // as strings and as views
+    const string line = "server(cpu, exp(0.5), 10ms); "
+        "client(unif(1, 2), 250us, gauss(3, 1)); link(a, b, 1.5ms);";
+    r.measure("parse_util", {{"mode", "string"}}, [&](uint64_t k) {
+            for (uint64_t i = 0; i < k; ++i)
+                for (const string &in : parse_util::split_instr(line))
+                    bench::keep(parse_util::split_param(parse_util::get_param(in)).size());
+        });
+    r.measure("parse_util", {{"mode", "view"}}, [&](uint64_t k) {
+            for (uint64_t i = 0; i < k; ++i)
+                for (parse_util::StrView in : parse_util::split_instr(parse_util::StrView(line)))
+                    bench::keep(parse_util::split_param(parse_util::get_param(in)).size());
+        });
+    const string t = "1.5ms";
+    r.measure("parse_util", {{"mode", "tick"}}, [&](uint64_t k) {
+            for (uint64_t i = 0; i < k; ++i) bench::keep(int64_t(Tick(t)));
+        });
+}
+
+BENCHMARK(randomvar_parse)
+{
+    // the same specification, parsed every time, copied from the
+    // prototype of parsevar() and created from a Spec
+    const string str = "normal(10, 2)";
+    RandomVar::clearParseCache();
+    r.measure("randomvar_parse", {{"mode", "uncached"}}, [&](uint64_t k) {
+            for (uint64_t i = 0; i < k; ++i) {
+                RandomVar::clearParseCache();
+                bench::keep(RandomVar::parsevar(str).get());
+            }
+        });
+    r.measure("randomvar_parse", {{"mode", "cached"}}, [&](uint64_t k) {
+            for (uint64_t i = 0; i < k; ++i)
+                bench::keep(RandomVar::parsevar(str).get());
+        });
+    RandomVar::Spec spec(str);
+    r.measure("randomvar_parse", {{"mode", "spec"}}, [&](uint64_t k) {
+            for (uint64_t i = 0; i < k; ++i)
+                bench::keep(spec.create().get());
+        });
+}
+
+BENCHMARK(detvar)
+{
+    // a trace of 10^6 values: opening and reading it as text, as a
+    // mapped binary file and as a stream
+    const size_t N = 1000000;
+    const string text = "bench_detvar.txt", bin = "bench_detvar.bin";
+    {
+        RandomGen gen(SEED);
+        ofstream f(text.c_str());
+        for (size_t i = 0; i < N; ++i) f << gen.uniform() << "\n";
+    }
+    DataFile::convert(text, bin);
+
+    const pair<const char *, DetVar::Mode> modes[] = {
+        { "text", DetVar::LOAD }, { "map", DetVar::MAP }, { "stream", DetVar::STREAM }
+    };
+    for (auto &m : modes) {
+        const string &file = m.second == DetVar::LOAD ? text : bin;
+        r.measure("detvar_open", {{"mode", m.first}}, [&](uint64_t k) {
+                for (uint64_t i = 0; i < k; ++i) {
+                    DetVar v(file, m.second);
+                    bench::keep(v.get());
+                }
+            });
+        DetVar v(file, m.second);
+        double sum = 0;
+        r.measure("detvar_get", {{"mode", m.first}}, [&](uint64_t k) {
+                for (uint64_t i = 0; i < k; ++i) sum += v.get();
+            });
+        bench::keep(sum);
+    }
+    remove(text.c_str());
+    remove(bin.c_str());
+}
+
+BENCHMARK(window)
+{
+    // the mean and the maximum of the last n samples: a scan of a
+    // history at every sample, and the sliding window
+    const size_t lengths[] = { 16, 256, 4096 };
+    RandomGen gen(SEED);
+    vector<double> v(4096);
+    for (double &x : v) x = gen.uniform();
+    for (size_t n : lengths) {
+        history<double> h(n, 0.0);
+        double acc = 0;
+        r.measure("window", {{"n", bench::par(n)}, {"mode", "scan"}}, [&](uint64_t k) {
+                for (uint64_t i = 0; i < k; ++i) {
+                    h.push(v[i & 4095]);
+                    double sum = 0, mx = h[0];
+                    for (size_t j = 0; j < n; ++j) {
+                        sum += h[j];
+                        mx = std::max(mx, h[j]);
+                    }
+                    acc += sum / n + mx;
+                }
+            });
+        SlidingWindow w(n);
+        r.measure("window", {{"n", bench::par(n)}, {"mode", "sliding"}}, [&](uint64_t k) {
+                for (uint64_t i = 0; i < k; ++i) {
+                    w.push(v[i & 4095]);
+                    acc += w.mean() + w.max();
+                }
+            });
+        bench::keep(acc);
+    }
+}
+
+BENCHMARK(stat_endrun)
+{
+    const size_t nstats[] = { 10, 100, 1000, 10000 };
+    for (size_t ns : nstats) {
+        SimContext ctx;
+        SimContext::Scope s(ctx);
+        vector<unique_ptr<StatMean> > stats;
+        for (size_t i = 0; i < ns; ++i) stats.emplace_back(new StatMean(""));
+        // the history of the runs is bounded by the benchmark
+        const size_t HISTORY = 100000;
+        BaseStat::init(HISTORY);
+        size_t runs = 0;
+        r.measure("stat_endrun", {{"stats", bench::par(ns)}}, [&](uint64_t k) {
+                for (uint64_t i = 0; i < k; ++i) {
+                    if (++runs == HISTORY) {
+                        BaseStat::init(HISTORY);
+                        runs = 1;
+                    }
+                    BaseStat::newRun();
+                    BaseStat::endRun();
+                }
+            });
+    }
+}
+
+BENCHMARK(stat_summary)
+{
+    // the means and the confidence intervals of all the stats,
+    // after 100 runs
+    const size_t nstats[] = { 100, 10000 };
+    for (size_t ns : nstats) {
+        SimContext ctx;
+        SimContext::Scope s(ctx);
+        vector<unique_ptr<StatMean> > stats;
+        for (size_t i = 0; i < ns; ++i) stats.emplace_back(new StatMean(""));
+        BaseStat::init(100);
+        for (size_t run = 0; run < 100; ++run) {
+            BaseStat::newRun();
+            for (size_t i = 0; i < ns; ++i) stats[i]->record(double(run * i % 7));
+            BaseStat::endRun();
+        }
+        BaseStat::endSim();
+        volatile double sink = 0;
+        r.measure("stat_summary", {{"stats", bench::par(ns)}}, [&](uint64_t k) {
+                for (uint64_t i = 0; i < k; ++i) {
+                    BaseStat &st = *stats[i % ns];
+                    sink = sink + st.getMean() + st.getConfInterval(0.95);
+                }
+            });
+    }
+}
+
+BENCHMARK(stat_output)
+{
+    // endRun() with the values of 100 stats written to a file:
+    // a row of the CSV or binary sink, against the gnuplot files
+    const size_t NS = 100;
+    const char *sinks[] = { "none", "csv", "binary", "gnuplot" };
+    for (const char *sink : sinks) {
+        SimContext ctx;
+        SimContext::Scope s(ctx);
+        vector<unique_ptr<StatMean> > stats;
+        for (size_t i = 0; i < NS; ++i)
+            stats.emplace_back(new StatMean("bench_stat" + to_string(i) + ".dat"));
+        const size_t HISTORY = 100000;
+        BaseStat::init(HISTORY);
+        unique_ptr<StatOutput> out;
+        string kind = sink;
+        if (kind == "csv") out.reset(new CsvOutput("bench_stats.csv"));
+        else if (kind == "binary") out.reset(new BinaryOutput("bench_stats.bin"));
+        else if (kind == "gnuplot") GnuPlotOutput::init();
+        // the confidence intervals of write() need three runs
+        size_t runs = 3;
+        for (size_t i = 0; i < runs; ++i) {
+            BaseStat::newRun();
+            BaseStat::endRun();
+        }
+        r.measure("stat_output", {{"sink", sink}}, [&](uint64_t k) {
+                for (uint64_t i = 0; i < k; ++i) {
+                    if (++runs == HISTORY) {
+                        BaseStat::init(HISTORY);
+                        for (runs = 1; runs < 4; ++runs) {
+                            BaseStat::newRun();
+                            BaseStat::endRun();
+                        }
+                    }
+                    BaseStat::newRun();
+                    for (auto &st : stats) st->record(double(i));
+                    BaseStat::endRun();
+                    if (kind == "gnuplot") {
+                        // the old sink: a line per stat at every write()
+                        BaseStat::endSim();
+                        GnuPlotOutput::write(i);
+                    }
+                }
+            });
+        out.reset();
+        GnuPlotOutput::close();
+    }
+    remove("bench_stats.csv");
+    remove("bench_stats.bin");
+    for (size_t i = 0; i < NS; ++i) remove(("bench_stat" + to_string(i) + ".dat").c_str());
+}
+
+BENCHMARK(trace_record)
+{
+    // a record of an event trace: a line of TraceAscii (on the
+    // stream, and through the ring of a writer thread) against a
+    // record of TraceBinary
+    {
+        TraceAscii t("bench_trace.txt");
+        r.measure("trace_record", {{"format", "ascii"}}, [&](uint64_t k) {
+                for (uint64_t i = 0; i < k; ++i) t.record(double(i));
+            });
+    }
+    {
+        TraceAscii t("bench_trace.txt", RingWriter::BLOCK);
+        r.measure("trace_record", {{"format", "ascii_ring"}}, [&](uint64_t k) {
+                for (uint64_t i = 0; i < k; ++i) t.record(double(i));
+            });
+    }
+    {
+        TraceBinary t("bench_trace.trc");
+        r.measure("trace_record", {{"format", "binary"}}, [&](uint64_t k) {
+                for (uint64_t i = 0; i < k; ++i)
+                    t.record(Tick(int64_t(i)), 1, 2, double(i));
+            });
+    }
+    {
+        ChunkedTraceWriter t("bench_trace.trc");
+        r.measure("trace_record", {{"format", "chunked"}}, [&](uint64_t k) {
+                for (uint64_t i = 0; i < k; ++i)
+                    t.record(Tick(int64_t(i)), 1, 2, double(i));
+            });
+    }
+    remove("bench_trace.txt");
+    remove("bench_trace.trc");
+}
+
+BENCHMARK(quantile_record)
+{
+    // the cost of record() of the quantile sketches, on
+    // exponential values, against the mean
+    const size_t N = 1 << 16;
+    RandomGen gen(SEED);
+    vector<double> v(N);
+    for (double &x : v) x = -log(gen.uniform()) * 10;
+
+    HdrHistogram h;
+    r.measure("quantile_record", {{"sketch", "hdr"}}, [&](uint64_t k) {
+            for (uint64_t i = 0; i < k; ++i) h.record(v[i & (N - 1)]);
+        });
+    bench::keep(h.quantile(0.99));
+    TDigest d;
+    r.measure("quantile_record", {{"sketch", "tdigest"}}, [&](uint64_t k) {
+            for (uint64_t i = 0; i < k; ++i) d.record(v[i & (N - 1)]);
+        });
+    bench::keep(d.quantile(0.99));
+    double sum = 0;
+    r.measure("quantile_record", {{"sketch", "sum"}}, [&](uint64_t k) {
+            for (uint64_t i = 0; i < k; ++i) sum += v[i & (N - 1)];
+        });
+    bench::keep(sum);
+}
+
+BENCHMARK(tick)
+{
+    vector<Tick> v(1024);
+    for (size_t i = 0; i < v.size(); ++i) v[i] = Tick(int64_t(i * 7919 % 1000));
+
+    Tick acc = 0;
+    r.measure("tick", {{"op", "add"}}, [&](uint64_t k) {
+            for (uint64_t i = 0; i < k; ++i) acc += v[i & 1023];
+        });
+    bench::keep(acc);
+
+    Tick m = 1;
+    r.measure("tick", {{"op", "mul"}}, [&](uint64_t k) {
+            for (uint64_t i = 0; i < k; ++i) { m = v[i & 1023]; m *= 3; }
+        });
+    bench::keep(m);
+
+    Tick lo = Tick(MAXTICK);
+    r.measure("tick", {{"op", "min"}}, [&](uint64_t k) {
+            for (uint64_t i = 0; i < k; ++i) if (v[i & 1023] < lo) lo = v[i & 1023];
+        });
+    bench::keep(lo);
+
+    double d = 0;
+    r.measure("tick", {{"op", "to_double"}}, [&](uint64_t k) {
+            for (uint64_t i = 0; i < k; ++i) d += double(v[i & 1023]);
+        });
+    bench::keep(d);
+}
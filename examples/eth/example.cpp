@@ -44,6 +44,11 @@ int main() {
     n1.addDestNode(n3);
     n2.addDestNode(n1);
     n3.addDestNode(n1);
+
+    MessagePool messages;
+    n1.setMessagePool(messages);
+    n2.setMessagePool(messages);
+    n3.setMessagePool(messages);
     
     EthernetLink link("Eth_Link");
     
@@ -80,4 +85,6 @@ int main() {
             cout << e.what() << endl;
         }
     }
+    cout << "Messages: peak = " << messages.peak()
+         << ", capacity = " << messages.capacity() << endl;
 }
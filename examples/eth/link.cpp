@@ -2,6 +2,7 @@
 
 #include "link.hpp"
 #include "message.hpp"
+#include "netinterface.hpp"
 
 using namespace std;
 using namespace MetaSim;
@@ -61,7 +62,7 @@ void EthernetLink::contend(EthernetInterface *eth, Message *m)
     DBGENTER(_ETHLINK_DBG);
  
     if (_isContending) {
-	_end_contention_evt.drop();
+	_end_contention_evt.cancelLazy();
 	if (!_isCollision) {
 	    _isCollision = true;
 	    _collision_evt.post(SIMUL.getTime() + 3);
@@ -116,6 +117,7 @@ void EthernetLink::onEndTransmission(Event *e)
     _isBusy = false;
     _message = 0;
 
-    dst->onMessageReceived(m);
-    src->onMessageSent(m);        
+    // the source gives the message to the destination
+    MessagePtr sent = src->onMessageSent(m);
+    dst->onMessageReceived(std::move(sent));
 }
@@ -59,4 +59,9 @@ public:
     Node *getDestNode();
 };
 
+// the messages are taken from a pool, and the ones still in the
+// queues at the end of a run are destroyed with it
+typedef MetaSim::ObjectPool<Message> MessagePool;
+typedef MessagePool::Handle MessagePtr;
+
 #endif
@@ -34,11 +34,8 @@ EthernetInterface::~EthernetInterface()
 
 void EthernetInterface::newRun()
 {
-        vector<Message *>::iterator i;
-
+        // the messages of the last run were destroyed with the pool
         _queue.clear();
-        for (i = _received.begin(); i != _received.end(); ++i) delete (*i);
-
         _received.clear();
         _blocked.clear();
 
@@ -49,11 +46,11 @@ void EthernetInterface::endRun()
 }
 
 
-void EthernetInterface::send(Message *m)
+void EthernetInterface::send(MessagePtr m)
 {
         DBGENTER(_ETHINTER_DBG);
 
-        _queue.push_back(m);
+        _queue.push_back(std::move(m));
   
         if (_queue.size() == 1) _trans_evt.process();
         else 
@@ -67,7 +64,7 @@ void EthernetInterface::onTransmit(Event *e)
         DBGENTER(_ETHINTER_DBG);
 
         if (_link->isBusy()) onCollision();
-        else _link->contend(this, _queue.front());
+        else _link->contend(this, _queue.front().get());
 
         
 }
@@ -81,10 +78,11 @@ void EthernetInterface::onCollision()
         
 }
 
-void EthernetInterface::onMessageSent(Message *m)
+MessagePtr EthernetInterface::onMessageSent(Message *m)
 {
         DBGENTER(_ETHINTER_DBG);
 
+        MessagePtr sent = std::move(_queue.front());
         _queue.pop_front();
 
         _coll = 0;
@@ -92,7 +90,7 @@ void EthernetInterface::onMessageSent(Message *m)
 
         if (!_queue.empty()) _trans_evt.process();
 
-        
+        return sent;
 }
 
 Tick EthernetInterface::nextTransTime()
@@ -108,38 +106,37 @@ Tick EthernetInterface::nextTransTime()
         return (Tick) a.get();
 }
 
-void EthernetInterface::onMessageReceived(Message *m)
+void EthernetInterface::onMessageReceived(MessagePtr m)
 {
         DBGENTER(_ETHINTER_DBG);
 
         vector<Node *>::iterator i = find(_blocked.begin(), _blocked.end(), m->getDestNode());
 
         if (i != _blocked.end()) {
-                (*i)->onMessageReceived(m);
+                (*i)->onMessageReceived(m.get());
                 _blocked.erase(i);
         }
         else 
-                _received.push_back(m);
+                _received.push_back(std::move(m));
 
         
 }
 
-Message * EthernetInterface::receive(Node *n)
+MessagePtr EthernetInterface::receive(Node *n)
 {
         DBGTAG(_ETHINTER_DBG, getName() + "::receive()");
 
-        vector<Message *>::iterator i = _received.begin();
-        Message *m = NULL;
+        vector<MessagePtr>::iterator i = _received.begin();
 
         while (i != _received.end()) {
                 if ((*i)->getDestNode() == n) {
-                        m = *i;
+                        MessagePtr m = std::move(*i);
                         _received.erase(i);
                         return m;
                 }
                 else ++i;
         }
         _blocked.push_back(n);
-        return m;
+        return MessagePtr();
 }
 
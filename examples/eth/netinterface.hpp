@@ -6,10 +6,11 @@
 
 #include <metasim.hpp>
 
+#include "message.hpp"
+
 #define _ETHINTER_DBG "EthernetInterface"
 
 class Node;
-class Message;
 class EthernetLink;
 
 class NetInterface : public MetaSim::Entity {
@@ -19,18 +20,19 @@ public:
   NetInterface(const char *name, Node &n);
   virtual ~NetInterface();
   
-  virtual void send(Message *m) = 0;
-  virtual Message * receive(Node *n) = 0;
+  virtual void send(MessagePtr m) = 0;
+  virtual MessagePtr receive(Node *n) = 0;
   
-  virtual void onMessageSent(Message *m) = 0;
-  virtual void onMessageReceived(Message *m) = 0;
+  // returns the message sent
+  virtual MessagePtr onMessageSent(Message *m) = 0;
+  virtual void onMessageReceived(MessagePtr m) = 0;
 };
 
 class EthernetInterface : public NetInterface {
 protected:
   EthernetLink* _link;
-  std::deque<Message*> _queue;
-  std::vector<Message*> _received;
+  std::deque<MessagePtr> _queue;
+  std::vector<MessagePtr> _received;
   std::vector<Node*> _blocked;
 
   int _cont_per;
@@ -46,12 +48,12 @@ public:
 
   MetaSim::Tick nextTransTime();
 
-  virtual void send(Message* m);
+  virtual void send(MessagePtr m);
   virtual void onCollision();
   virtual void onTransmit(MetaSim::Event* e);
-  virtual Message* receive(Node* n);
-  virtual void onMessageSent(Message* m); 
-  virtual void onMessageReceived(Message* m);
+  virtual MessagePtr receive(Node* n);
+  virtual MessagePtr onMessageSent(Message* m); 
+  virtual void onMessageReceived(MessagePtr m);
 
   void newRun();
   void endRun();
@@ -11,7 +11,7 @@ using namespace MetaSim;
 
 Node::Node(string const &name) 
         : Entity(name), _net_interf(0), _interval(nullptr),
-          _nodes(),
+          _nodes(), _pool(nullptr),
           _recv_evt(this, &Node::onReceive), 
           _send_evt(this, &Node::onSend)
 {
@@ -58,6 +58,11 @@ void Node::setInterval(unique_ptr<RandomVar> i)
     _interval = std::move(i);
 }
 
+void Node::setMessagePool(MessagePool &p)
+{
+    _pool = &p;
+}
+
 void Node::addDestNode(Node &n)
 {
     _nodes.push_back(&n);
@@ -73,7 +78,6 @@ void Node::onSend(Event *e)
     
     DBGPRINT("dest node = " << _nodes[i]->getName());
     // creates a new message and send it!! 
-    Message *m = new Message((int)len.get(), this, _nodes[i]);
-    _net_interf->send(m);
+    _net_interf->send(_pool->make((int)len.get(), this, _nodes[i]));
     _send_evt.post(SIMUL.getTime() + (Tick)_interval->get());    
 }
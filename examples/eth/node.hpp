@@ -11,7 +11,8 @@ using namespace std;
 
 #define _NODE_DBG "Node"
 
-class Message;
+#include "message.hpp"
+
 class NetInterface;
 
 class Node : public MetaSim::Entity {
@@ -22,6 +23,8 @@ class Node : public MetaSim::Entity {
 
   std::vector<Node*> _nodes;
 
+  MessagePool *_pool;
+
 public:
 
   MetaSim::GEvent<Node> _recv_evt;
@@ -33,6 +36,7 @@ public:
   void setNetInterface(NetInterface &n);
   void addDestNode(Node &n);
   void setInterval(std::unique_ptr<MetaSim::RandomVar> i);
+  void setMessagePool(MessagePool &p);
 
   void onMessageReceived(Message *m);
   void onReceive(MetaSim::Event *e);
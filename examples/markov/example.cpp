@@ -0,0 +1,57 @@
+#include "markov.hpp"
+
+using namespace std;
+using namespace MetaSim;
+
+int main()
+{
+        try {
+                cout << "         ###### Markov example ######\n\n";
+
+                State S2("primary", true);
+                State S1("backup");
+                State S0("fault");
+
+                S2.put_link(10.0, &S1);
+                S1.put_link(10.0, &S2);
+                S1.put_link(10.0, &S0);
+                S0.put_link(10.0, &S2);
+
+                AvgTimeStateStat stat_state2("stato2"); 
+                AvgTimeStateStat stat_state1("stato1"); 
+                AvgTimeStateStat stat_state0("stato0"); 
+
+                attach_stat(stat_state2, S2._event);
+                attach_stat(stat_state1, S1._event);
+                attach_stat(stat_state0, S0._event);
+                
+                // stat_state2.attach(&S2);
+                // stat_state1.attach(&S1);
+                // stat_state0.attach(&S0);
+
+                BaseStat::setTransitory(2000);
+  
+                SIMUL.dbg.setStream("log.txt");
+                SIMUL.dbg.enable(_MARKOV_DBG_LEV);
+                SIMUL.dbg.enable(_SIMUL_DBG_LEV);
+
+                SIMUL.run(10000, 5);
+
+                cout << "The average interval of time in state 2 is " 
+                     << stat_state2.getMean() 
+                     << endl;
+                cout << "with a 95% confidence interval of " 
+                     << stat_state2.getConfInterval() << endl;
+                cout << "The average interval of time in state 1 is " 
+                     << stat_state1.getMean() << endl;
+                cout << "with a 95% confidence interval of " 
+                     << stat_state1.getConfInterval() << endl;
+                cout << "The average interval of time in state 0 is " 
+                     << stat_state0.getMean() << endl;
+                cout << "with a 95% confidence interval of " 
+                     << stat_state0.getConfInterval() << endl;
+
+        } catch (exception& e) {
+                cout << "Exception: " << e.what() << endl;
+        }
+}
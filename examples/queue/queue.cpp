@@ -34,6 +34,9 @@ int main()
         //avgSizeStat.attach(&source);
         attach_stat(avgSizeStat, source._prodEvent);
 
+        StatTimeAvg lengthStat("avg_queue_length");
+        que.setLengthStat(lengthStat);
+
         BaseStat::setTransitory(2000);
   
         SIMUL.dbg.setStream("log.txt");
@@ -45,4 +48,7 @@ int main()
              << avgSizeStat.getMean() << endl;
         cout << "with a 95% confidence interval of " 
              << avgSizeStat.getConfInterval(BaseStat::C95) << endl;
+        cout << "The time average of the queue length is " 
+             << lengthStat.getMean() << " +/- "
+             << lengthStat.getConfInterval(BaseStat::C95) << endl;
 }//end main
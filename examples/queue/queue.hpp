@@ -104,6 +104,9 @@ class Queue: public Node {
      * The service time random variable. It is possible to define a
      * general distribution! */
     RandomVar *_st;
+
+    /// The time average of the length of the queue, if any
+    StatTimeAvg *_length;
     
 public:
     /**
@@ -139,17 +142,23 @@ public:
         _dest(d),
         _q(),
         _st(st),
+        _length(0),
         _servEvent(*this) 
         {}
+
+    /// The stat is updated when the length changes
+    void setLengthStat(StatTimeAvg &s) { _length = &s; }
     
     virtual void put() {
         _q.push_back(1);
+        if (_length) _length->update(_q.size());
         if (_q.size() == 1)
             _servEvent.post(SIMUL.getTime() + Tick(_st->get()));
     }
     
     void serve() {
         _q.pop_front();
+        if (_length) _length->update(_q.size());
         if (_q.size() != 0) 
             _servEvent.post(SIMUL.getTime() + Tick(_st->get()));
         _dest->put();
@@ -168,6 +177,10 @@ public:
 
 /* ----------------------------------------------------------------------*/
 
+/**
+ * The length of the queue seen by the arrivals (sampled at the
+ * events of the source). For the time average, see
+ * Queue::setLengthStat(). */
 class AvgQueueSizeStat : public StatMean {
     Queue &_queue;
     Particle<Source::ProduceEvent,AvgQueueSizeStat> *sp; 
@@ -0,0 +1,58 @@
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#include <aliastable.hpp>
+
+namespace MetaSim {
+
+    using namespace std;
+
+    AliasTable::AliasTable(const vector<double> &w) :
+        _prob(w.size()), _alias(w.size())
+    {
+        const size_t n = w.size();
+        double sum = 0;
+        for (double x : w) {
+            if (!(x >= 0)) throw Exc("Negative weight");
+            sum += x;
+        }
+        if (!(sum > 0)) throw Exc("The weights sum to 0");
+
+        // the columns below and above the mean weight
+        vector<size_t> small, large;
+        for (size_t i = 0; i < n; ++i) {
+            _prob[i] = w[i] * n / sum;
+            _alias[i] = i;
+            (_prob[i] < 1 ? small : large).push_back(i);
+        }
+        // each small column is filled up by a large one
+        while (!small.empty() && !large.empty()) {
+            size_t s = small.back(), l = large.back();
+            small.pop_back();
+            _alias[s] = l;
+            _prob[l] -= 1 - _prob[s];
+            if (_prob[l] < 1) {
+                large.pop_back();
+                small.push_back(l);
+            }
+        }
+        // only rounding errors are left
+        for (size_t i : large) _prob[i] = 1;
+        for (size_t i : small) _prob[i] = 1;
+    }
+
+    double AliasTable::getProbability(size_t i) const
+    {
+        const size_t n = _prob.size();
+        double p = _prob[i];
+        for (size_t j = 0; j < n; ++j)
+            if (_alias[j] == i && j != i) p += 1 - _prob[j];
+        return p / n;
+    }
+
+} // namespace MetaSim
@@ -0,0 +1,78 @@
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef __ALIASTABLE_HPP__
+#define __ALIASTABLE_HPP__
+
+#include <cstddef>
+#include <vector>
+
+#include <baseexc.hpp>
+
+namespace MetaSim {
+
+    /**
+       \ingroup metasim_random
+
+       The alias table of Walker, built with the method of Vose, for
+       sampling a discrete distribution of n outcomes in O(1): the
+       table has n columns of equal probability, and column i holds
+       outcome i with probability prob[i] and outcome alias[i]
+       otherwise. A sample needs one uniform number: its integer
+       part (times n) selects the column, its fractional part
+       selects between i and alias[i].
+
+       The table only maps a uniform number to an index in [0, n),
+       so it can be used by any discrete empirical distribution (see
+       GenericVar), with its own vector of values.
+    */
+    class AliasTable {
+        std::vector<double> _prob;
+        std::vector<size_t> _alias;
+    public:
+        /**
+           \ingroup metasim_exc
+
+           Exceptions for AliasTable.
+        */
+        class Exc : public BaseExc {
+        public:
+            Exc(const std::string &wh) :
+                BaseExc(wh, "AliasTable", "aliastable.hpp") {}
+        };
+
+        /// An empty table; sample() cannot be called
+        AliasTable() {}
+
+        /**
+           Builds the table of the weights w (not negative, with a
+           positive sum, not necessarily normalized), in O(n) time.
+           Throws Exc otherwise.
+        */
+        explicit AliasTable(const std::vector<double> &w);
+
+        /// The index of outcome of the uniform number u in [0, 1)
+        inline size_t sample(double u) const
+        {
+            double x = u * _prob.size();
+            size_t i = size_t(x);
+            // u too close to 1 for the rounding
+            if (i >= _prob.size()) i = _prob.size() - 1;
+            return (x - i < _prob[i]) ? i : _alias[i];
+        }
+
+        /// The number of outcomes
+        inline size_t size() const { return _prob.size(); }
+
+        /// The probability of outcome i, as given by the table
+        double getProbability(size_t i) const;
+    };
+
+} // namespace MetaSim
+
+#endif
@@ -0,0 +1,117 @@
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#include <asyncwriter.hpp>
+
+namespace MetaSim {
+
+    using namespace std;
+
+    const size_t AsyncWriter::DEFAULT_BUFFER;
+    const size_t AsyncWriter::MAX_PENDING;
+
+    AsyncWriter::AsyncWriter(const string &path, size_t buffer) :
+        WriterThread(path), _capacity(buffer ? buffer : DEFAULT_BUFFER),
+        _bytes(0), _busy(false)
+    {
+        _file = fopen(path.c_str(), "wb");
+        if (!_file) throw Exc("Cannot open file " + path);
+        // the buffers are ours
+        setvbuf(_file, NULL, _IONBF, 0);
+        _cur.reserve(_capacity);
+        _thread = thread(&AsyncWriter::run, this);
+    }
+
+    AsyncWriter::~AsyncWriter()
+    {
+        closeQuietly(*this);
+    }
+
+    void AsyncWriter::enqueue(vector<char> &&b)
+    {
+        unique_lock<mutex> l(_lock);
+        _cv.wait(l, [this] { return _pending.size() < MAX_PENDING || _error; });
+        checkError();
+        _bytes += b.size();
+        _pending.push_back(move(b));
+        _cv.notify_all();
+    }
+
+    void AsyncWriter::flush()
+    {
+        if (!_file) throw Exc("Writing " + _path + " after close()");
+        if (_cur.empty()) {
+            lock_guard<mutex> l(_lock);
+            checkError();
+            return;
+        }
+        vector<char> next;
+        {
+            lock_guard<mutex> l(_lock);
+            if (!_free.empty()) {
+                next = move(_free.back());
+                _free.pop_back();
+            }
+        }
+        next.clear();
+        next.reserve(_capacity);
+        enqueue(move(_cur));
+        _cur = move(next);
+    }
+
+    void AsyncWriter::post(const void *p, size_t n)
+    {
+        const char *c = static_cast<const char *>(p);
+        enqueue(vector<char>(c, c + n));
+    }
+
+    void AsyncWriter::sync()
+    {
+        flush();
+        unique_lock<mutex> l(_lock);
+        _cv.wait(l, [this] { return (_pending.empty() && !_busy) || _error; });
+        checkError();
+    }
+
+    void AsyncWriter::close()
+    {
+        if (!_file) return;
+        exception_ptr e;
+        try {
+            sync();
+        } catch (...) {
+            e = current_exception();
+        }
+        stopThread();
+        closeFile<Exc>(e);
+    }
+
+    void AsyncWriter::run()
+    {
+        unique_lock<mutex> l(_lock);
+        for (;;) {
+            _cv.wait(l, [this] { return !_pending.empty() || _stop; });
+            if (_pending.empty()) return;
+            vector<char> b = move(_pending.front());
+            _pending.pop_front();
+            _busy = true;
+
+            l.unlock();
+            bool ok = fwrite(b.data(), 1, b.size(), _file) == b.size();
+            l.lock();
+
+            _busy = false;
+            if (!ok) setError(make_exception_ptr(Exc("Cannot write file " + _path)));
+            // the buffers of the regular size are used again
+            if (b.capacity() == _capacity && _free.size() < MAX_PENDING)
+                _free.push_back(move(b));
+            _cv.notify_all();
+        }
+    }
+
+} // namespace MetaSim
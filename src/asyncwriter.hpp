@@ -0,0 +1,111 @@
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef __ASYNCWRITER_HPP__
+#define __ASYNCWRITER_HPP__
+
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include <baseexc.hpp>
+#include <writerthread.hpp>
+
+namespace MetaSim {
+
+    /**
+       \ingroup metasim_util
+
+       A file written by a helper thread. write() copies the data
+       in a large buffer of memory; a full buffer (or a buffer
+       passed by flush()) is written to the file by the thread,
+       while the simulation continues in the next buffer. The file
+       stays open until close(), so the cost of a write() is a
+       memcpy() and the system calls are one for each buffer.
+
+       At most MAX_PENDING buffers wait for the thread: beyond
+       that write() waits, so the memory is bounded. An error of
+       the file is rethrown by the next write(), flush(), sync()
+       or close().
+    */
+    class AsyncWriter : private WriterThread {
+    public:
+        /**
+           \ingroup metasim_exc
+        */
+        class Exc : public BaseExc {
+        public:
+            Exc(const std::string &msg) :
+                BaseExc(msg, "AsyncWriter", "asyncwriter.hpp") {}
+        };
+
+        /// Default size of the buffers, in bytes
+        static const size_t DEFAULT_BUFFER = 1 << 20;
+
+        /// Buffers waiting to be written, at most
+        static const size_t MAX_PENDING = 4;
+
+        /**
+           Creates (or truncates) the file.
+
+           @param path the name of the file
+           @param buffer the size of the buffers
+         */
+        explicit AsyncWriter(const std::string &path, size_t buffer = DEFAULT_BUFFER);
+
+        /// Writes the data and closes the file
+        ~AsyncWriter();
+
+        /// Appends n bytes
+        inline void write(const void *p, size_t n)
+        {
+            if (_cur.size() + n > _capacity) {
+                flush();
+                if (n > _capacity) { post(p, n); return; }
+            }
+            const char *c = static_cast<const char *>(p);
+            _cur.insert(_cur.end(), c, c + n);
+        }
+
+        inline void write(const std::string &s) { write(s.data(), s.size()); }
+
+        /// Passes the current buffer to the thread, without waiting
+        void flush();
+
+        /// Waits until all the data is in the file
+        void sync();
+
+        /// Writes all the data and closes the file
+        void close();
+
+        inline const std::string &getPath() const { return _path; }
+
+        /// Bytes passed to write() since the creation
+        inline size_t getBytes() const { return _bytes + _cur.size(); }
+
+    private:
+        /// writes a large block directly, after the pending ones
+        void post(const void *p, size_t n);
+        void enqueue(std::vector<char> &&b);
+        void run();
+
+        size_t _capacity;
+        size_t _bytes;
+        std::vector<char> _cur;
+
+        std::deque<std::vector<char> > _pending;
+        std::vector<std::vector<char> > _free;
+        // the buffer being written by the thread
+        bool _busy;
+    };
+
+} // namespace MetaSim
+
+#endif
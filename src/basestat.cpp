@@ -13,29 +13,25 @@
  ***************************************************************************/
 #include <algorithm>
 #include <cmath>
+#include <cstdint>
 #include <fstream>
 #include <iostream>
-#include <numeric>
+#include <map>
+#include <memory>
 
 #include <baseexc.hpp>
 #include <basestat.hpp>
 #include <basetype.hpp>
 #include <simul.hpp>
+#include <statoutput.hpp>
 #include <functional>
 
 using namespace std;
 
 namespace MetaSim {
 
-    double BaseStat::_TDistr[MAX_DISTR];
-    size_t BaseStat::_totalNumOfExp = 0;
-    size_t BaseStat::_expNum = 0;
-    bool BaseStat::_endOfSim = 0;
-    bool BaseStat::_initFlag = false;
-    Tick BaseStat::_transitory = 0;  
     bool TableOutput::_created = false;
     string TableOutput::_fname;
-    BaseStat::List BaseStat::_statList;
 
     // A bunch of customary exception messages
     const char* const EFFECTIVE_ATTACH = 
@@ -50,93 +46,205 @@ namespace MetaSim {
     const char* const NEED_3 =
         "Need at least 3 run to evaluate statistic";
 
-    static const char* const TOO_MUCH_RUNS =
-        "Too many runs! \n";
-
-    static double t1_table[30][2] = {
-        {6.314, 12.706},
-        {2.920, 4.303},
-        {2.353, 3.182},
-        {2.132, 2.776},
-        {2.015, 2.571},
-        {1.943, 2.447},
-        {1.895, 2.365},
-        {1.860, 2.306},
-        {1.833, 2.262},
-        {1.812, 2.228},
-        {1.796, 2.201},
-        {1.782, 2.179},
-        {1.771, 2.160},
-        {1.768, 2.145},
-        {1.753, 2.131},
-        {1.746, 2.120},
-        {1.740, 2.110},
-        {1.734, 2.101},
-        {1.729, 2.093},
-        {1.725, 2.086},
-        {1.721, 2.080},
-        {1.717, 2.074},
-        {1.714, 2.069},
-        {1.711, 2.064},
-        {1.708, 2.060},
-        {1.706, 2.056},
-        {1.703, 2.052},
-        {1.701, 2.048},
-        {1.699, 2.045},
-        {1.697, 2.042}
-    };
+    namespace {
+        // the normal quantile: Acklam's rational approximation
+        // (relative error 1.2e-9), and one step of Halley's method
+        double normalQuantile(double p)
+        {
+            static const double a[] = {
+                -3.969683028665376e+01, 2.209460984245205e+02,
+                -2.759285104469687e+02, 1.383577518672690e+02,
+                -3.066479806614716e+01, 2.506628277459239e+00 };
+            static const double b[] = {
+                -5.447609879822406e+01, 1.615858368580409e+02,
+                -1.556989798598866e+02, 6.680131188771972e+01,
+                -1.328068155288572e+01 };
+            static const double c[] = {
+                -7.784894002430293e-03, -3.223964580411365e-01,
+                -2.400758277161838e+00, -2.549732539343734e+00,
+                4.374664141464968e+00, 2.938163982698783e+00 };
+            static const double d[] = {
+                7.784695709041462e-03, 3.224671290700398e-01,
+                2.445134137142996e+00, 3.754408661907416e+00 };
+
+            double q = min(p, 1 - p), x;
+            if (q < 0.02425) {
+                double r = sqrt(-2 * log(q));
+                x = (((((c[0] * r + c[1]) * r + c[2]) * r + c[3]) * r + c[4]) * r + c[5]) /
+                    ((((d[0] * r + d[1]) * r + d[2]) * r + d[3]) * r + 1);
+                if (p > 0.5) x = -x;
+            } else {
+                double r = p - 0.5, t = r * r;
+                x = (((((a[0] * t + a[1]) * t + a[2]) * t + a[3]) * t + a[4]) * t + a[5]) * r /
+                    (((((b[0] * t + b[1]) * t + b[2]) * t + b[3]) * t + b[4]) * t + 1);
+            }
+            double e = 0.5 * erfc(-x / sqrt(2.0)) - p;
+            double u = e * sqrt(2 * M_PI) * exp(x * x / 2);
+            return x - u / (1 + x * u / 2);
+        }
+
+        // continued fraction of the incomplete beta function
+        // (modified Lentz's method)
+        double betaFraction(double a, double b, double x)
+        {
+            const double TINY = 1e-300, EPS = 1e-15;
+            double c = 1, d = 1 - (a + b) * x / (a + 1);
+            if (fabs(d) < TINY) d = TINY;
+            d = 1 / d;
+            double h = d;
+            for (int m = 1; m < 100000; ++m) {
+                double aa = m * (b - m) * x / ((a + 2 * m - 1) * (a + 2 * m));
+                d = 1 + aa * d;
+                if (fabs(d) < TINY) d = TINY;
+                c = 1 + aa / c;
+                if (fabs(c) < TINY) c = TINY;
+                d = 1 / d;
+                h *= d * c;
+                aa = -(a + m) * (a + b + m) * x / ((a + 2 * m) * (a + 2 * m + 1));
+                d = 1 + aa * d;
+                if (fabs(d) < TINY) d = TINY;
+                c = 1 + aa / c;
+                if (fabs(c) < TINY) c = TINY;
+                d = 1 / d;
+                double del = d * c;
+                h *= del;
+                if (fabs(del - 1) < EPS) break;
+            }
+            return h;
+        }
+
+        // the regularized incomplete beta function I_x(a, b)
+        double incompleteBeta(double a, double b, double x)
+        {
+            if (x <= 0) return 0;
+            if (x >= 1) return 1;
+            double f = exp(lgamma(a + b) - lgamma(a) - lgamma(b) +
+                           a * log(x) + b * log1p(-x));
+            if (x < (a + 1) / (a + b + 2)) return f * betaFraction(a, b, x) / a;
+            return 1 - f * betaFraction(b, a, 1 - x) / b;
+        }
+
+        // P(T > t) for t >= 0, and the density of T
+        double tTail(double t, double v)
+        {
+            return 0.5 * incompleteBeta(v / 2, 0.5, v / (v + t * t));
+        }
+
+        double tDensity(double t, double v)
+        {
+            return exp(lgamma((v + 1) / 2) - lgamma(v / 2) -
+                       (v + 1) / 2 * log1p(t * t / v)) / sqrt(v * M_PI);
+        }
+    }
 
     BaseStat::BaseStat(std::string n) :
-        _name(n)
+        _ctx(&SimContext::current()),
+        _name(n),
+        _slot(_ctx->_columns),
+        _gated(true)
     {
-        _statList.push_back(this);
+        SimContext &c = *_ctx;
+        // a new column in the runs already collected
+        if (!c._results.empty()) {
+            const size_t w = c._columns, rows = c._results.size() / w;
+            vector<double> r(rows * (w + 1), 0.0);
+            for (size_t i = 0; i < rows; ++i)
+                copy(&c._results[i * w], &c._results[i * w] + w, &r[i * (w + 1)]);
+            c._results.swap(r);
+        }
+        ++c._columns;
+        c._summaryRuns = SIZE_MAX;
+        c._stats.push_back(this);
     }
 
     BaseStat::~BaseStat()
     {
-        _statList.remove(this);
+        // the stats are usually destroyed in reverse order; the
+        // column stays until the next init()
+        SimContext &c = *_ctx;
+        auto i = find(c._stats.rbegin(), c._stats.rend(), this);
+        if (i != c._stats.rend()) c._stats.erase(next(i).base());
+        if (c._stats.empty()) {
+            c._results.clear();
+            c._columns = 0;
+        }
+        c._summaryRuns = SIZE_MAX;
+    }
+
+    // declared in particle.hpp, which cannot see the BaseStat
+    bool probeGated(const BaseStat *s)
+    {
+        return s->isGated();
     }
 
     void BaseStat::init(size_t n)  
     {
-        _totalNumOfExp = n;
-        _endOfSim = false;
-        _initFlag = true;
-        for_each(_statList.begin(), _statList.end(),
-                 mem_fun(&BaseStat::init));
+        SimContext &c = SimContext::current();
+        c._totalNumOfExp = n;
+        c._endOfSim = false;
+        c._initFlag = true;
+        // the columns of the stats destroyed are dropped
+        c._results.clear();
+        c._columns = c._stats.size();
+        for (size_t i = 0; i < c._stats.size(); ++i) c._stats[i]->_slot = i;
+        for (BaseStat *s : c._stats) s->init();
     }
   
     void BaseStat::init()
     {
-        _exper.clear();
-        _expNum = 0;
+        _ctx->_expNum = 0;
+        _ctx->_summaryRuns = SIZE_MAX;
     }  
 
     void BaseStat::setTransitory(Tick t)
     {
-        _transitory = t;
+        SimContext::current()._transitory = t;
     }
 
     bool BaseStat::chkTransitory()
     {
-        if (SIMUL.getTime() >= _transitory) return false;
+        SimContext &c = SimContext::current();
+        if (c.getSimulation().getTime() >= c._transitory) return false;
         else return true;
     }
 
     double BaseStat::t_student(int alfa, int dol)
     {
-        if (dol<1 || dol>30)
-            return -1;
-        switch (alfa) {
-        case 90:
-            return t1_table[dol-1][0];
-            break;
-        case 95:
-            return t1_table[dol-1][1];
-            break;
-        default:
+        if (dol < 1 || alfa <= 0 || alfa >= 100)
             return -1;
+        return tQuantile(0.5 + alfa / 200.0, dol);
+    }
+
+    double BaseStat::tQuantile(double p, double dof)
+    {
+        if (!(p > 0 && p < 1) || !(dof > 0))
+            throw Exc("Invalid parameters of the t quantile");
+        if (p < 0.5) return -tQuantile(1 - p, dof);
+        if (p == 0.5) return 0;
+        double q = 1 - p;
+
+        // the closed forms, and the normal limit
+        if (dof == 1) return tan(M_PI * (p - 0.5));
+        if (dof == 2) return (2 * p - 1) / sqrt(2 * p * q);
+        double z = normalQuantile(p);
+        if (dof > 1e7) return z;
+
+        // Newton's method on the tail, in a bracket, from the
+        // Cornish-Fisher expansion (Abramowitz & Stegun 26.7.5)
+        double z2 = z * z;
+        double x = z + z * (z2 + 1) / (4 * dof) +
+            z * ((5 * z2 + 16) * z2 + 3) / (96 * dof * dof);
+        double lo = 0, hi = max(x, 1.0);
+        while (tTail(hi, dof) > q) hi *= 2;
+        for (int i = 0; i < 100; ++i) {
+            double e = tTail(x, dof) - q;
+            if (e > 0) lo = x; else hi = x;
+            double next = x + e / tDensity(x, dof);
+            if (!(next > lo && next < hi)) next = (lo + hi) / 2;
+            if (fabs(next - x) <= 1e-14 * x) return next;
+            x = next;
         }
+        return x;
     }
 
     //
@@ -144,15 +252,55 @@ namespace MetaSim {
     //
     void BaseStat::endRun()
     {
-        for_each(_statList.begin(), _statList.end(),
-                 mem_fun(&BaseStat::collect));
-        if (++_expNum >= MAX_RUN)
-            throw Exc(TOO_MUCH_RUNS);
+        SimContext &c = SimContext::current();
+        // the values of the run, in a new row
+        const size_t w = c._columns, row = c._expNum * w;
+        if (c._results.size() < row + w) c._results.resize(row + w);
+        double *v = c._results.data() + row;
+        for (BaseStat *s : c._stats) {
+            s->flush();
+            v[s->_slot] = s->_val;
+        }
+        ++c._expNum;
+        c._summaryRuns = SIZE_MAX;
+        for (StatOutput *o : c._outputs) o->endRun();
+    }
+
+    void BaseStat::endRun(const vector<double> &values)
+    {
+        SimContext &c = SimContext::current();
+        if (values.size() != c._stats.size())
+            throw Exc("The model instance does not have the same stats");
+
+        size_t k = 0;
+        for (auto i = c._stats.begin(); i != c._stats.end(); ++i) 
+            (*i)->_val = values[k++];
+        endRun();
+    }
+
+    void BaseStat::merge(const BaseStat &s)
+    {
+        throw Exc("The stat " + _name + " cannot be merged");
+    }
+
+    void BaseStat::mergeShard(const SimContext &shard)
+    {
+        SimContext &c = SimContext::current();
+        if (shard._stats.size() != c._stats.size())
+            throw Exc("The shard does not have the same stats");
+
+        auto j = shard._stats.begin();
+        for (auto i = c._stats.begin(); i != c._stats.end(); ++i, ++j) {
+            (*j)->flush();
+            (*i)->merge(**j);
+        }
     }
 
     void BaseStat::endSim()
     {
-        _endOfSim = true;
+        SimContext &c = SimContext::current();
+        c._endOfSim = true;
+        for (StatOutput *o : c._outputs) o->endSim();
     }
 
     //
@@ -160,8 +308,8 @@ namespace MetaSim {
     //
     void BaseStat::newRun()
     {
-        for_each(_statList.begin(), _statList.end(),
-                 mem_fun(&BaseStat::initValue));
+        SimContext &c = SimContext::current();
+        for (BaseStat *s : c._stats) s->initValue();
     }
 
     //
@@ -169,65 +317,276 @@ namespace MetaSim {
     //
     double BaseStat::getMean()
     {
-        if (!_endOfSim) throw Exc(GET);
-        if (!_initFlag) throw Exc(NO_INIT);
+        if (!_ctx->_endOfSim) throw Exc(GET);
+        if (!_ctx->_initFlag) throw Exc(NO_INIT);
 
-        double sum = accumulate(_exper.begin(), _exper.end(), 0.0);
-        sum /= _expNum;
-  
-        return sum;
+        return sampleMean();
+    }
+
+    double BaseStat::sampleMean() const
+    {
+        summarize(*_ctx);
+        return _ctx->_means[_slot];
+    }
+
+    void BaseStat::summarize(SimContext &c)
+    {
+        const size_t n = c._expNum;
+        if (c._summaryRuns == n) return;
+        const size_t w = c._columns;
+        c._means.assign(w, 0.0);
+        c._stdErrors.assign(w, 0.0);
+        double *m = c._means.data(), *e = c._stdErrors.data();
+        const double *v = c._results.data();
+
+        // the runs are added in order, as the sums of a stat alone
+        for (size_t r = 0; r < n; ++r, v += w)
+            for (size_t i = 0; i < w; ++i) m[i] += v[i];
+        for (size_t i = 0; i < w; ++i) m[i] /= n;
+        v = c._results.data();
+        for (size_t r = 0; r < n; ++r, v += w)
+            for (size_t i = 0; i < w; ++i) {
+                double d = v[i] - m[i];
+                e[i] += d * d;
+            }
+        for (size_t i = 0; i < w; ++i) e[i] = sqrt(e[i] / ((n - 1) * n));
+        c._summaryRuns = n;
+        c._tConfidence = -1;
     }
 
     //
     // Returns the semi-confidence interval
     // (the mean vary in [mu - sci; mu + sci]) relative to prob (1 - a)
     //
-    namespace {
-        // Functor to use with accumulate() in order
-        // to evaluate the variance:
-        // sigma^2 = Sum( (exper[i] - _mu)^2 ) / N*(N-1)
-        // being N the number of rounds
-        class V {
-            double _mu;
-        public:
-            V(double m) : _mu(m) {}
-            double operator()(double result, double value) const 
-                { 
-                    return result + (value - _mu)*(value - _mu);
-                }
-        };
-    }
-
     //
     // Returns the variance for the experimental samples
     //
     double BaseStat::getVariance()
     {
-        double sum = 0;
-        double mu;		// the mean
-  
-        if (!_endOfSim) throw Exc(GET);
-        if (!_initFlag) throw Exc(NO_INIT);
-        if (_expNum < 3) throw Exc(NEED_3);
+        if (!_ctx->_endOfSim) throw Exc(GET);
+        if (!_ctx->_initFlag) throw Exc(NO_INIT);
+        if (_ctx->_expNum < 3) throw Exc(NEED_3);
+
+        return stdError();
+    }
 
-        mu = getMean();
+    double BaseStat::stdError() const
+    {
+        summarize(*_ctx);
+        return _ctx->_stdErrors[_slot];
+    }
 
-        sum = accumulate(_exper.begin(), _exper.end(), 0.0, V(mu));
-        return sqrt(sum/((_expNum - 1) * _expNum));
+    double BaseStat::halfWidth(double confidence) const
+    {
+        // the same quantile for all the stats of the context
+        SimContext &c = *_ctx;
+        summarize(c);
+        if (c._tConfidence != confidence) {
+            c._tQuantile = tQuantile((1 + confidence) / 2, double(c._expNum - 1));
+            c._tConfidence = confidence;
+        }
+        return c._tQuantile * c._stdErrors[_slot];
     }
 
     double BaseStat::getConfInterval(CONFIDENCE_INTERVAL c)
     {
-        double mu;		// the mean
-        double s;		// the variance
-  
-        if (!_endOfSim) throw Exc(GET);
-        if (!_initFlag) throw Exc(NO_INIT);
-        if (_expNum < 3) throw Exc(NEED_3);
+        return getConfInterval(c / 100.0);
+    }
+
+    double BaseStat::getConfInterval(double confidence)
+    {
+        if (!_ctx->_endOfSim) throw Exc(GET);
+        if (!_ctx->_initFlag) throw Exc(NO_INIT);
+        if (_ctx->_expNum < 3) throw Exc(NEED_3);
+        if (!(confidence > 0 && confidence < 1))
+            throw Exc("The confidence level must be in (0, 1)");
 
-        mu = getMean();
-        s = getVariance();
-        return t_student(c, (unsigned int) _expNum - 1) * s;
+        return halfWidth(confidence);
+    }
+
+    bool BaseStat::hasPrecision(double precision, double confidence) const
+    {
+        if (_ctx->_expNum < 3) return false;
+        return halfWidth(confidence) <= precision * fabs(sampleMean());
+    }
+
+    double BaseStat::getAutocorrelation(size_t lag)
+    {
+        if (!_ctx->_endOfSim) throw Exc(GET);
+        if (!_ctx->_initFlag) throw Exc(NO_INIT);
+        if (_ctx->_expNum < lag + 2) throw Exc("Not enough runs for the autocorrelation");
+
+        return correlation(lag);
+    }
+
+    double BaseStat::correlation(size_t lag) const
+    {
+        size_t n = _ctx->_expNum;
+        if (n < lag + 2) return 0;
+        double mu = sampleMean(), c0 = 0, c = 0;
+        for (size_t i = 0; i < n; ++i) {
+            double d = runValue(i) - mu;
+            c0 += d * d;
+            if (i >= lag) c += d * (runValue(i - lag) - mu);
+        }
+        return c0 > 0 ? c / c0 : 0;
+    }
+
+    void BaseStat::mergeBatches()
+    {
+        SimContext &c = SimContext::current();
+        const size_t n = c._expNum / 2, w = c._columns;
+        double *v = c._results.data();
+        for (size_t r = 0; r < n; ++r) {
+            const double *a = v + 2 * r * w, *b = a + w;
+            for (size_t i = 0; i < w; ++i) v[r * w + i] = (a[i] + b[i]) / 2;
+        }
+        c._results.resize(n * w);
+        c._expNum = n;
+        c._summaryRuns = SIZE_MAX;
+    }
+
+    double BaseStat::maxBatchCorrelation()
+    {
+        double r = 0;
+        for (BaseStat *s : SimContext::current()._stats)
+            r = max(r, fabs(s->correlation(1)));
+        return r;
+    }
+
+    size_t BaseStat::mser(const vector<double> &values, size_t m)
+    {
+        if (m == 0) throw Exc("The batches of MSER must not be empty");
+        // the means of the batches of m values (a last partial
+        // batch is ignored)
+        const size_t nb = values.size() / m;
+        if (nb < 2) return values.size();
+        vector<double> y(nb);
+        for (size_t j = 0; j < nb; ++j) {
+            double sum = 0;
+            for (size_t i = 0; i < m; ++i) sum += values[j * m + i];
+            y[j] = sum / double(m);
+        }
+
+        // MSE(d) = sum over j >= d of (y[j] - mean)^2, divided by
+        // (nb - d)^2, from the sums of the batches after d; at
+        // least 2 batches are kept
+        double s1 = y[nb - 1], s2 = y[nb - 1] * y[nb - 1];
+        size_t best = nb;
+        double bestMse = 0;
+        for (size_t d = nb - 1; d-- > 0; ) {
+            s1 += y[d];
+            s2 += y[d] * y[d];
+            const double k = double(nb - d);
+            const double mse = max(0.0, s2 - s1 * s1 / k) / (k * k);
+            if (best == nb || mse <= bestMse) {
+                best = d;
+                bestMse = mse;
+            }
+        }
+        // a minimum in the second half: the bias is still there
+        if (best > nb / 2) return values.size();
+        return best * m;
+    }
+
+    /*---------------------------------------------------*/
+
+    void StatMean::merge(const BaseStat &s)
+    {
+        const StatMean &m = sameStat<StatMean>(s);
+        if (m._count == 0) return;
+        double n = _count + m._count;
+        double d = m._val - (_count > 0 ? _val : 0);
+        _val = _count > 0 ? _val + d * m._count / n : m._val;
+        _m2 += m._m2 + d * d * _count * m._count / n;
+        _count = n;
+    }
+
+    void StatSqrMean::merge(const BaseStat &s)
+    {
+        const StatSqrMean &m = sameStat<StatSqrMean>(s);
+        if (m._count == 0) return;
+        double n = _count + m._count;
+        _val = _count > 0 ? _val + (m._val - _val) * m._count / n : m._val;
+        _count = n;
+    }
+
+    /*---------------------------------------------------*/
+
+    StatTimeAvg::StatTimeAvg(std::string name, double i) :
+        BaseStat(name), _ini(i), _current(i), _last(0), _integral(0)
+    {
+        // the changes of the transitory set the current value
+        setGated(false);
+    }
+
+    void StatTimeAvg::initValue()
+    {
+        _val = _current = _ini;
+        _last = 0;
+        _integral = 0;
+    }
+
+    double StatTimeAvg::integral(Tick now, Tick &from) const
+    {
+        from = getTransitory();
+        if (now <= from) return 0;
+        Tick last = max(_last, from);
+        return _integral + _current * double(now - last);
+    }
+
+    void StatTimeAvg::update(double v)
+    {
+        Tick now = getContext().getSimulation().getTime(), from;
+        _integral = integral(now, from);
+        _last = now;
+        _current = v;
+    }
+
+    void StatTimeAvg::flush()
+    {
+        // no time integrated: the value is left unchanged (e.g.
+        // the one of a parallel run, see endRun(values))
+        Tick now = getContext().getSimulation().getTime(), from;
+        double i = integral(now, from);
+        if (now > from) _val = i / double(now - from);
+    }
+
+    double StatTimeAvg::getIntegral() const
+    {
+        Tick from;
+        return integral(getContext().getSimulation().getTime(), from);
+    }
+
+    void StatTimeAvg::merge(const BaseStat &s)
+    {
+        const StatTimeAvg &t = sameStat<StatTimeAvg>(s);
+        Tick now = getContext().getSimulation().getTime(), from;
+        _integral = integral(now, from) + t.getIntegral();
+        _last = now;
+        _current += t._current;
+        flush();
+    }
+
+    /*---------------------------------------------------*/
+
+    StoppingRule::StoppingRule(double p, size_t max, double c, size_t min) :
+        precision(p), confidence(c), minRuns(min), maxRuns(max)
+    {
+    }
+
+    bool StoppingRule::isSatisfied() const
+    {
+        SimContext &c = SimContext::current();
+        if (c._expNum < max(minRuns, size_t(3))) return false;
+        if (stats.empty()) {
+            for (BaseStat *s : c._stats)
+                if (!s->hasPrecision(precision, confidence)) return false;
+        } else {
+            for (BaseStat *s : stats)
+                if (!s->hasPrecision(precision, confidence)) return false;
+        }
+        return true;
     }
 
     void BaseStat::printAll()
@@ -244,6 +603,15 @@ namespace MetaSim {
              << endl;
     }
   
+    namespace {
+        // the files of GnuPlotOutput, by name
+        map<string, unique_ptr<ofstream> > &gnuplotFiles()
+        {
+            static map<string, unique_ptr<ofstream> > files;
+            return files;
+        }
+    }
+
     /* Output class 
        This class produce formatted output to be read by gnuplot.
        Just call GnuPlotOutput::init() before simulation, and 
@@ -260,16 +628,38 @@ namespace MetaSim {
             BaseStat* p = *i;
             cout << "Name: " << p->getName() << endl;
 
-            if (p->getName() != "") {
-                ofstream f(p->getName().c_str());
-
-                if (!f.is_open())
-                    throw Exc("Cannot open file " + p->getName());
+            if (p->getName() != "")
+                stream(p->getName(), true) << "# " << p->getName() << '\n';
+            ++i;
+        }
+        flush();
+    }
 
-                f << "# " << p->getName() << endl;
+    ofstream &GnuPlotOutput::stream(const string &name, bool trunc)
+    {
+        unique_ptr<ofstream> &f = gnuplotFiles()[name];
+        if (f && trunc) f.reset();
+        if (!f) {
+            f.reset(new ofstream(name.c_str(), trunc ? ios::trunc : ios::app));
+            if (!f->is_open()) {
+                gnuplotFiles().erase(name);
+                throw Exc("Cannot open file " + name);
             }
-            ++i;
         }
+        return *f;
+    }
+
+    void GnuPlotOutput::flush()
+    {
+        for (auto &f : gnuplotFiles()) {
+            f.second->flush();
+            if (!*f.second) throw Exc("Cannot write file " + f.first);
+        }
+    }
+
+    void GnuPlotOutput::close()
+    {
+        gnuplotFiles().clear();
     }
   
     /* Output class 
@@ -303,14 +693,12 @@ namespace MetaSim {
         ofstream f(_fname.c_str());
         f << message << endl;
 
-        BaseStat::List::const_iterator i  = BaseStat::begin();
-        BaseStat* p = *i;
-        while (p != NULL) {
+        for (BaseStat::List::const_iterator i = BaseStat::begin();
+             i != BaseStat::end(); ++i) {
+            BaseStat* p = *i;
             f << p->getName() << "\t\t | "
               << p->getMean() << "\t\t | "
-              << p->getConfInterval() << endl;
-            ++i;
-            p = *i;
+              << p->getConfInterval() << '\n';
         }
     }
 }
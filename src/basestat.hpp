@@ -22,6 +22,8 @@
 #include <algorithm>
 
 #include <basetype.hpp>
+#include <simcontext.hpp>
+#include <statearchive.hpp>
 
 namespace MetaSim {
 
@@ -86,15 +88,13 @@ namespace MetaSim {
     ///  The basic statistical class. 
     class BaseStat {
     public:
-        typedef std::list<BaseStat*> List;
+        typedef std::vector<BaseStat*> List;
 
     private:
-        static const int MAX_DISTR = 10000;
-        static double _TDistr[MAX_DISTR];
-        static size_t _totalNumOfExp;
-        static size_t _expNum;
-        static bool _endOfSim;
-        static List _statList;
+        /// The simulation context of the stat object, which
+        /// holds the list of all stats and the number of the
+        /// current experiment (see SimContext).
+        SimContext *_ctx;
 
     protected:
 
@@ -118,34 +118,58 @@ namespace MetaSim {
         /// current computed value (during the run).
         double _val;
 
-        /// array of values, one for each run.
-        typedef std::vector<double> Experiments;
-        Experiments _exper;
+        /// the column of the stat in the values of the runs of
+        /// its context (see SimContext)
+        size_t _slot;
 
-        /** called at the end of the run, puts the current 
-            value in the array of experiments. */
-        inline void collect() {
-            if (_exper.size() <= _expNum) _exper.push_back(_val);
-            else _exper[_expNum] = _val;
+        /// see setGated()
+        bool _gated;
+
+        /// the value collected at a run
+        inline double runValue(size_t run) const {
+            return _ctx->_results[run * _ctx->_columns + _slot];
         }
 
-        // System-Wide data & functions needed to be visible 
+        /// computes the means and the standard errors of all the
+        /// stats of a context, if the runs changed since the last
+        /// time: a pass on the values of every run, for all the
+        /// stats at once
+        static void summarize(SimContext &c);
+
+        // System-Wide functions needed to be visible 
         // also to other kind of stats!
-        /// lenght of the transitory.
-        static Tick _transitory;
+        /// returns the t-student for a two-sided confidence of
+        /// alfa percent and dol degrees of freedom (-1 if dol < 1).
+        static double t_student(int alfa, int dol);
 
-        /// used to see if the base stat class has been
-        /// initialized. (???) 
-        static bool _initFlag;
+        /// the mean of the runs collected so far
+        double sampleMean() const;
 
-        /// t-student function
-        static double get_t_perc(double alpha);
+        /// the standard error of the mean of the runs collected
+        /// so far (at least 2), returned by getVariance()
+        double stdError() const;
 
-        /// computes the t-student with parameter n.
-        static void calc_t(int n);
+        /// the half width of the confidence interval of the runs
+        /// collected so far (at least 2), at the given confidence
+        double halfWidth(double confidence) const;
 
-        /// returns the t-student with parameter alfa and dol.
-        static double t_student(int alfa, int dol);
+        /// the autocorrelation of the runs collected so far
+        double correlation(size_t lag) const;
+
+        /// The simulation context of the stat
+        inline SimContext &getContext() const { return *_ctx; }
+
+        /// s as a T, for merge(); throws if it is not a T
+        template <class T>
+        const T &sameStat(const BaseStat &s) const
+        {
+            const T *p = dynamic_cast<const T *>(&s);
+            if (p == nullptr) throw Exc("Merging stats of different classes", "BaseStat");
+            return *p;
+        }
+
+        /// The end of the transitory in the context of the stat
+        inline Tick getTransitory() const { return _ctx->_transitory; }
 
     public:
         /// Constructors: enqueues the object in the global stat list
@@ -153,14 +177,51 @@ namespace MetaSim {
         virtual ~BaseStat();
   
         typedef List::const_iterator iterator;
-        static inline iterator begin() { return _statList.begin(); }
-        static inline iterator end() { return _statList.end(); }
+        /// Iterators on the stats of the current context
+        static inline iterator begin() { return SimContext::current()._stats.begin(); }
+        static inline iterator end() { return SimContext::current()._stats.end(); }
 
         /** 
             Level 1 function: it is called by the probe() (level 2) 
         */
         virtual void record(double) = 0;
         virtual void initValue() = 0;
+
+        /**
+            Computes the value from the samples recorded and not yet
+            processed, if the stat defers the computation (see
+            BufferedStat). It is called before the value is read
+            and at the end of every run.
+        */
+        virtual void flush() {}
+
+        /**
+            Saves the value collected in the current run, for the
+            rollbacks of the Time Warp engine (see
+            TimeWarpSimulation). Derived classes that keep more
+            state than _val must save it as well.
+        */
+        virtual void saveState(StateArchive &a) const { a.save(_val); }
+
+        /// Restores the state saved by saveState().
+        virtual void restoreState(StateArchive &a) { a.restore(_val); }
+
+        /**
+            Adds to the value of the current run the samples
+            recorded by another stat of the same class (e.g. the
+            same stat of another thread or logical process), as if
+            they had been recorded by this stat. The stats of
+            level 1 define it; the default throws an exception.
+        */
+        virtual void merge(const BaseStat &s);
+
+        /**
+            Merges all the stats of another context (e.g. a shard
+            of a model run by another thread) into the stats of the
+            current context, in order of creation, as endRun() with
+            the values of a run. Typically called before endRun().
+        */
+        static void mergeShard(const SimContext &shard);
   
         /** 
             level 2 function: called by the event action() method. 
@@ -194,17 +255,30 @@ namespace MetaSim {
         */
         inline std::string getName() { return _name; }
 
+        /**
+           The probes of the particles of a gated stat (the
+           default) are not called during the transitory, since
+           record() would discard the samples: until the first
+           event after the transitory, the events run as if they
+           had no particles. A stat whose probe keeps a state
+           across the events (e.g. the time of the last arrival,
+           or the current value of StatTimeAvg) must not be gated;
+           this is decided when a particle is attached.
+        */
+        inline void setGated(bool g) { _gated = g; }
+        inline bool isGated() const { return _gated; }
+
         /**
            Returns the current value of the stat object.
         */
-        inline double getValue() { return _val; }
+        inline double getValue() { flush(); return _val; }
 
         /**
            Returns the data collected in the last run
         */
         inline double getLastValue() {
-            if (_expNum > 0) 
-                return _exper[_expNum-1]; 
+            if (_ctx->_expNum > 0) 
+                return runValue(_ctx->_expNum - 1);
             else return 0;
         }
 
@@ -221,18 +295,47 @@ namespace MetaSim {
         };
 
         /** Returns the 90% or 95% confidence interval 
-            because of the underlying implementation 
-            of the t_student() function, which has
-            been pre-calculated only for 90% and 95%
-            values
 	
             @param c  can be C90 or C95 */
         double getConfInterval(CONFIDENCE_INTERVAL c = C95);
+
+        /** Returns the confidence interval at any level
+
+            @param confidence the level, in (0, 1) (e.g. 0.99) */
+        double getConfInterval(double confidence);
+
+        /**
+           True if the half width of the confidence interval of the
+           runs collected so far is at most precision times the
+           absolute value of the mean. It can be called during the
+           simulation (after endRun()), and it is false with less
+           than 3 runs.
+
+           @param precision the relative precision (e.g. 0.05)
+           @param confidence the level of the interval, in (0, 1)
+        */
+        bool hasPrecision(double precision, double confidence = 0.95) const;
+
+        /**
+           The autocorrelation of the values of the runs (or of the
+           batches, see Simulation::runBatches()) at the given lag:
+           close to 0 if the values are independent, as required by
+           getConfInterval(). It is 0 if the values are all equal.
+        */
+        double getAutocorrelation(size_t lag = 1);
+
+        /**
+           The quantile of order p of the Student's t distribution
+           with dof degrees of freedom, for any dof (the normal
+           quantile if dof is infinite). The two-sided interval of
+           confidence c uses tQuantile((1 + c) / 2, n - 1).
+        */
+        static double tQuantile(double p, double dof);
 	
         /*--------------------------------------------*/
 
         // debug!!
-        inline size_t getExpNum() { return _expNum; }
+        inline size_t getExpNum() { return _ctx->_expNum; }
         static void printAll();	
         void print();
 
@@ -247,16 +350,50 @@ namespace MetaSim {
         /// collects all stats.
         static void endRun();
 
+        /**
+           Collects a run whose values have been computed
+           elsewhere (e.g. by Simulation::run() with a
+           ModelFactory): values[i] is assigned to the i-th stat
+           of the current context, in order of creation, and then
+           all stats are collected as in endRun().
+        */
+        static void endRun(const std::vector<double> &values);
+
         /// automatically called at the beginning of the run, 
         /// prepare the int values
         static void newRun();
 
+        /**
+           Called by Simulation::runBatches(): replaces every pair
+           of consecutive values of all the stats with their mean,
+           i.e. doubles the size of the batches. An odd last value
+           is discarded.
+        */
+        static void mergeBatches();
+
+        /// The largest absolute autocorrelation at lag 1 of the
+        /// stats of the current context
+        static double maxBatchCorrelation();
+
+        /**
+           The MSER-m truncation point of a series of values (e.g.
+           the values of a stat in consecutive intervals of a run):
+           the number of initial values to delete so that the mean
+           of the rest has the smallest standard error, computed on
+           the means of batches of m values. It is values.size() if
+           the minimum is in the second half of the series, i.e.
+           the initial bias is not over (or the series is shorter
+           than 2 batches). See Simulation::setWarmupDetection().
+        */
+        static size_t mser(const std::vector<double> &values, size_t m = 5);
+
         /// automatically called at the end of the sim, 
         /// write the files.
         static void endSim();
 
         /// specify how long the transitory will be
         /// data collected during transitory is discarded
+        /// (see also Simulation::setWarmupDetection())
         static void setTransitory(Tick t);
     
         /// check if we are currently inside the transitory
@@ -273,8 +410,6 @@ namespace MetaSim {
        *next        : pointer to next BaseStat Object in the list of the event;
        *exper	: array of values for each experiment (dinamic alloc.);
 
-       get_t_perc() : get the percentile corresponding to alpha (0 < alpha < 1);
-
        val		: value
        init()	: initialize t_distr[];
        endRun()     : to be called after the end of the experiment
@@ -294,6 +429,44 @@ namespace MetaSim {
 		    
     */
 
+    /**
+       The rule of the sequential replications (see
+       Simulation::run(Tick, const StoppingRule &)): the runs
+       continue until the confidence interval of every selected
+       stat is at most precision times its mean, or until maxRuns
+       runs are done. No stat is selected by default, which
+       means all the stats of the context.
+
+       @code
+       StoppingRule rule(0.02, 500);   // 2%, at most 500 runs
+       rule.add(waiting);
+       size_t n = SIMUL.run(10000, rule);
+       @endcode
+    */
+    class StoppingRule {
+    public:
+        /// relative half width of the confidence intervals
+        double precision;
+        /// level of the confidence intervals, in (0, 1)
+        double confidence;
+        /// the precision is not checked before minRuns runs (at least 3)
+        size_t minRuns;
+        /// the maximum number of runs
+        size_t maxRuns;
+        /// the selected stats (empty: all the stats of the context)
+        std::vector<BaseStat *> stats;
+
+        explicit StoppingRule(double p, size_t max = 1000, double c = 0.95,
+                              size_t min = 5);
+
+        /// Selects a stat
+        inline StoppingRule &add(BaseStat &s) { stats.push_back(&s); return *this; }
+
+        /// True if all the selected stats of the current context
+        /// have the precision, with at least minRuns runs
+        bool isSatisfied() const;
+    };
+
     /** @name Some typical statistic classes (level 1) */
     //@{
     /// Computes the max value 
@@ -312,6 +485,8 @@ namespace MetaSim {
                 _val = std::max(_val, a);
             }
         virtual void initValue() { _val = _ini; }
+        virtual void merge(const BaseStat &s)
+            { _val = std::max(_val, sameStat<StatMax>(s)._val); }
     };
 
     /// Computes the min value
@@ -330,31 +505,53 @@ namespace MetaSim {
                 _val = std::min(_val, a);
             }
         virtual void initValue() { _val = _ini; }
+        virtual void merge(const BaseStat &s)
+            { _val = std::min(_val, sameStat<StatMin>(s)._val); }
     };
 
     /// Computes a mean value X_m = (Sigma{X_i}i=1,N)/N
+    /**
+       The mean and the sum of the squared deviations from it are
+       updated with the method of Welford, which is numerically
+       stable, and two partial results are combined by merge()
+       with the formula of Chan et al.
+    */
     class StatMean : public BaseStat {
     protected:
         double _ini;
         double _count;
+        /// Sigma{(X_i - X_m)^2}
+        double _m2;
     public:
         StatMean(std::string name = "", 
                  double i = 0) : 
-            BaseStat(name), _ini(i), _count(0) 
+            BaseStat(name), _ini(i), _count(0), _m2(0)
             {
             }
 
         virtual void record(double a)
             {
                 if (chkTransitory()) return;
-                _val = _val * _count + a;
-                _val /= ++_count;
+                double d = a - _val;
+                _val += d / ++_count;
+                _m2 += d * (a - _val);
             };
-        virtual void initValue() { _val = _ini; _count = 0; };
+        virtual void initValue() { _val = _ini; _count = 0; _m2 = 0; };
+        virtual void merge(const BaseStat &s);
+        virtual void saveState(StateArchive &a) const 
+            { a.save(_val); a.save(_count); a.save(_m2); }
+        virtual void restoreState(StateArchive &a) 
+            { a.restore(_val); a.restore(_count); a.restore(_m2); }
+
+        /// Number of samples of the current run
+        inline double getSamples() const { return _count; }
+
+        /// Variance of the samples of the current run
+        inline double getSampleVariance() const
+            { return _count > 1 ? _m2 / (_count - 1) : 0; }
     };
 
-    /// Computes the quadratic mean value 
-    /// X2_m = (Sigma{X_i^2}i=1,N)/(N*(N-1))
+    /// Computes the mean of the squares X2_m = (Sigma{X_i^2}i=1,N)/N
     class StatSqrMean : public BaseStat {
     protected:
         double _ini;
@@ -366,7 +563,17 @@ namespace MetaSim {
             {
             }
 
+        virtual void record(double a)
+            {
+                if (chkTransitory()) return;
+                _val += (a * a - _val) / ++_count;
+            }
         virtual void initValue() { _val = _ini; _count = 0; };
+        virtual void merge(const BaseStat &s);
+        virtual void saveState(StateArchive &a) const 
+            { a.save(_val); a.save(_count); }
+        virtual void restoreState(StateArchive &a) 
+            { a.restore(_val); a.restore(_count); }
     };
 
 
@@ -392,6 +599,11 @@ namespace MetaSim {
             }
   
         virtual void initValue() { _val = _ini; }
+        virtual void merge(const BaseStat &s)
+            {
+                const StatCount &c = sameStat<StatCount>(s);
+                _val += c._val - c._ini;
+            }
     };
 
 
@@ -426,6 +638,17 @@ namespace MetaSim {
                 _num = _ini;
                 _den = std::max(1.0,_ini);
             }
+        virtual void merge(const BaseStat &s)
+            {
+                const StatPercent &p = sameStat<StatPercent>(s);
+                _num += p._num - p._ini;
+                _den += p._den - std::max(1.0, p._ini);
+                _val = _num / _den;
+            }
+        virtual void saveState(StateArchive &a) const 
+            { a.save(_val); a.save(_num); a.save(_den); }
+        virtual void restoreState(StateArchive &a) 
+            { a.restore(_val); a.restore(_num); a.restore(_den); }
         int getNumSamples() 
             {
                 return _den;
@@ -433,6 +656,65 @@ namespace MetaSim {
     };
 
 
+    /// Computes the time average of a piecewise constant quantity
+    /**
+       The model calls update() when the quantity (e.g. the length
+       of a queue) changes, and no probe is needed on the other
+       events: the integral of the quantity over time is computed
+       lazily, from the time of the last change, and it is closed
+       at the current time when the value is read (at the end of
+       the run, by endRun()). The time before the end of the
+       transitory is not integrated:
+
+       _val = Integral{x(t) dt, T..now} / (now - T)
+
+       @code
+       void Queue::put(Packet *p) { _q.push_back(p); _length.update(_q.size()); }
+       @endcode
+    */
+    class StatTimeAvg : public BaseStat {
+    protected:
+        /// the value of the quantity at the start of a run
+        double _ini;
+        double _current;
+        Tick _last;
+        double _integral;
+
+        /// the integral up to now, and the start of the integration
+        double integral(Tick now, Tick &from) const;
+    public:
+        StatTimeAvg(std::string name = "", double i = 0);
+
+        /// The quantity changes to v, at the current time
+        void update(double v);
+
+        /// The quantity changes by d, at the current time
+        inline void add(double d) { update(_current + d); }
+
+        /// Same as update()
+        virtual void record(double v) { update(v); }
+        virtual void initValue();
+
+        /// Closes the integral at the current time
+        virtual void flush();
+
+        /// The integral of the quantity, up to the current time
+        double getIntegral() const;
+
+        /// The current value of the quantity
+        inline double getCurrent() const { return _current; }
+
+        /// Adds the integral of another quantity over the same
+        /// time: the result is the average of the sum of the
+        /// two quantities
+        virtual void merge(const BaseStat &s);
+
+        virtual void saveState(StateArchive &a) const
+            { a.save(_val); a.save(_current); a.save(_last); a.save(_integral); }
+        virtual void restoreState(StateArchive &a)
+            { a.restore(_val); a.restore(_current); a.restore(_last); a.restore(_integral); }
+    };
+
     /// Produces output in gnuplot format
     /**
        Output for gnuplot. This class open a file for each statistical object   
@@ -454,6 +736,9 @@ namespace MetaSim {
 
        after each simulation. The format string is the same as printf.
        There can be more than one parameter, and of different types!
+
+       The files stay open from init() (or from the first write()) to
+       close(), and every write() flushes each of them once.
     */
     class GnuPlotOutput {    
     public :
@@ -475,18 +760,23 @@ namespace MetaSim {
                 while (i != BaseStat::end()) {
                     BaseStat* p = *i;
                     if (p->getName() != "") {
-                        std::ofstream f(p->getName().c_str(),
-                                        std::ios::app);
-                        if (!f.is_open())
-                            throw Exc("Cannot open file " + p->getName());	
+                        std::ofstream &f = stream(p->getName(), false);
                         f << t << '\t' << p->getMean() 
                           << '\t' << p->getConfInterval()
-                          << std::endl;
+                          << '\n';
                     }
                     ++i;
                 }
+                flush();
             }
 
+        /// Closes all the files
+        static void close();
+
+    private:
+        /// The file of a stat, opened (truncated if trunc) if needed
+        static std::ofstream &stream(const std::string &name, bool trunc);
+        static void flush();
     };
 
     /**
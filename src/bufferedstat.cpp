@@ -0,0 +1,161 @@
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#include <algorithm>
+#include <limits>
+
+#include <bufferedstat.hpp>
+
+namespace MetaSim {
+
+    using namespace std;
+
+    namespace {
+        // The reductions: the samples of the transitory (keep ==
+        // false) leave the partial result unchanged
+        struct Sum {
+            static double identity() { return 0; }
+            static double step(double a, double x, bool keep) { return a + (keep ? x : 0); }
+            static double combine(double a, double b) { return a + b; }
+        };
+
+        struct SqrSum {
+            static double identity() { return 0; }
+            static double step(double a, double x, bool keep) { return a + (keep ? x * x : 0); }
+            static double combine(double a, double b) { return a + b; }
+        };
+
+        struct Min {
+            static double identity() { return numeric_limits<double>::max(); }
+            static double step(double a, double x, bool keep) { return keep && x < a ? x : a; }
+            static double combine(double a, double b) { return min(a, b); }
+        };
+
+        struct Max {
+            static double identity() { return numeric_limits<double>::lowest(); }
+            static double step(double a, double x, bool keep) { return keep && x > a ? x : a; }
+            static double combine(double a, double b) { return max(a, b); }
+        };
+
+        /*
+          Reduces n samples, adding the kept ones to count and
+          combining them with acc. The loop keeps LANES independent
+          partial results, so that the iterations do not depend on
+          each other and the compiler can vectorize them.
+        */
+        template <class Op>
+        void reduce(const double *v, const Tick::impl_t *t, size_t n,
+                    Tick::impl_t from, double &count, double &acc)
+        {
+            const size_t LANES = 4;
+            double c[LANES], a[LANES];
+            for (size_t l = 0; l < LANES; ++l) {
+                c[l] = 0;
+                a[l] = Op::identity();
+            }
+
+            size_t i = 0;
+            for (; i + LANES <= n; i += LANES)
+                for (size_t l = 0; l < LANES; ++l) {
+                    bool keep = t[i + l] >= from;
+                    c[l] += keep;
+                    a[l] = Op::step(a[l], v[i + l], keep);
+                }
+            for (; i < n; ++i) {
+                bool keep = t[i] >= from;
+                c[0] += keep;
+                a[0] = Op::step(a[0], v[i], keep);
+            }
+
+            for (size_t l = 0; l < LANES; ++l) {
+                count += c[l];
+                acc = Op::combine(acc, a[l]);
+            }
+        }
+    }
+
+    BufferedStat::BufferedStat(Reduction r, string name, size_t capacity) :
+        BaseStat(name), _red(r),
+        _values(max(capacity, size_t(1))), _times(max(capacity, size_t(1))),
+        _n(0), _count(0), _acc(0)
+    {
+        initValue();
+    }
+
+    void BufferedStat::initValue()
+    {
+        _n = 0;
+        _count = 0;
+        switch (_red) {
+        case MIN: _acc = Min::identity(); break;
+        case MAX: _acc = Max::identity(); break;
+        default:  _acc = 0;
+        }
+        _val = _red == MIN || _red == MAX ? _acc : 0;
+    }
+
+    void BufferedStat::flush()
+    {
+        if (_n == 0) return;
+
+        const double *v = _values.data();
+        const Tick::impl_t *t = _times.data();
+        Tick::impl_t from = Tick::impl_t(getTransitory());
+        switch (_red) {
+        case MEAN:
+        case COUNT:   reduce<Sum>(v, t, _n, from, _count, _acc); break;
+        case SQRMEAN: reduce<SqrSum>(v, t, _n, from, _count, _acc); break;
+        case MIN:     reduce<Min>(v, t, _n, from, _count, _acc); break;
+        case MAX:     reduce<Max>(v, t, _n, from, _count, _acc); break;
+        }
+        _n = 0;
+
+        if (_red == MEAN || _red == SQRMEAN)
+            _val = _count > 0 ? _acc / _count : 0;
+        else
+            _val = _acc;
+    }
+
+    void BufferedStat::merge(const BaseStat &s)
+    {
+        BufferedStat &b = const_cast<BufferedStat &>(sameStat<BufferedStat>(s));
+        if (b._red != _red) throw Exc("Merging stats of different reductions");
+        flush();
+        b.flush();
+
+        _count += b._count;
+        switch (_red) {
+        case MIN: _acc = Min::combine(_acc, b._acc); break;
+        case MAX: _acc = Max::combine(_acc, b._acc); break;
+        default:  _acc += b._acc;
+        }
+        if (_red == MEAN || _red == SQRMEAN)
+            _val = _count > 0 ? _acc / _count : 0;
+        else
+            _val = _acc;
+    }
+
+    void BufferedStat::saveState(StateArchive &a) const
+    {
+        // the state is the value of the reduction: saving the
+        // samples as well would make the checkpoints larger
+        const_cast<BufferedStat *>(this)->flush();
+        a.save(_val);
+        a.save(_count);
+        a.save(_acc);
+    }
+
+    void BufferedStat::restoreState(StateArchive &a)
+    {
+        _n = 0;
+        a.restore(_val);
+        a.restore(_count);
+        a.restore(_acc);
+    }
+
+} // namespace MetaSim
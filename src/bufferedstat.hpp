@@ -0,0 +1,117 @@
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef __BUFFEREDSTAT_HPP__
+#define __BUFFEREDSTAT_HPP__
+
+#include <string>
+#include <vector>
+
+#include <basestat.hpp>
+#include <simul.hpp>
+#include <tick.hpp>
+
+namespace MetaSim {
+
+    /**
+       \ingroup metasim_stat
+
+       A statistic that records its samples in a buffer and computes
+       the result in bulk. record() only appends the value and the
+       current time to two contiguous arrays (no virtual call when
+       it is called from the probe() of a derived class, and no
+       transitory check); the buffer is reduced when it is full, at
+       the end of the run, or when the value is read with
+       getValue(). The reduction loops over the arrays, without
+       branches, so that the compiler can vectorize them, and
+       discards the samples of the transitory (see
+       BaseStat::setTransitory()).
+
+       The reduction is chosen in the constructor, and it gives the
+       same value as the corresponding class of level 1:
+
+       - MEAN:    the mean of the samples (StatMean)
+       - MIN:     the minimum (StatMin)
+       - MAX:     the maximum (StatMax)
+       - SQRMEAN: the mean of the squares of the samples
+       - COUNT:   the sum of the samples, e.g. record(1) for every
+                  occurrence of an event (StatCount)
+
+       It is used like the other stats, by writing the probe() of
+       level 2:
+
+       @code
+       class WaitingTime : public BufferedStat {
+       public:
+           WaitingTime() : BufferedStat(MEAN, "waiting") {}
+           void probe(GEvent<Server> &e) { record(e.getWaiting()); }
+       };
+       @endcode
+    */
+    class BufferedStat : public BaseStat {
+    public:
+        enum Reduction { MEAN, MIN, MAX, SQRMEAN, COUNT };
+
+        /// Default number of samples in the buffer
+        static const size_t DEFAULT_CAPACITY = 1024;
+
+        /**
+           @param r the reduction of the samples
+           @param name the name of the stat
+           @param capacity the number of samples in the buffer
+                  (at least 1)
+         */
+        BufferedStat(Reduction r, std::string name = "",
+                     size_t capacity = DEFAULT_CAPACITY);
+
+        /// Appends a sample, with the current time
+        virtual void record(double v) final
+        {
+            _values[_n] = v;
+            _times[_n] = Tick::impl_t(getContext().getSimulation().getTime());
+            if (++_n == _values.size()) flush();
+        }
+
+        virtual void initValue();
+
+        /// Reduces the samples in the buffer
+        virtual void flush();
+
+        /// Combines the partial results of a stat with the same
+        /// reduction, after reducing both buffers
+        virtual void merge(const BaseStat &s);
+
+        /// The buffer is reduced before saving the state
+        virtual void saveState(StateArchive &a) const;
+
+        /// The samples in the buffer are discarded
+        virtual void restoreState(StateArchive &a);
+
+        inline Reduction getReduction() const { return _red; }
+
+        /// Number of samples reduced in the current run, except
+        /// the ones of the transitory
+        inline double getSamples() const { return _count; }
+
+        /// Number of samples in the buffer
+        inline size_t getBuffered() const { return _n; }
+
+    private:
+        Reduction _red;
+        std::vector<double> _values;
+        std::vector<Tick::impl_t> _times;
+        size_t _n;
+
+        // the partial results of the reductions
+        double _count;
+        double _acc;
+    };
+
+} // namespace MetaSim
+
+#endif
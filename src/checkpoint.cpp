@@ -0,0 +1,105 @@
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#include <basestat.hpp>
+#include <checkpoint.hpp>
+#include <entity.hpp>
+#include <randomgen.hpp>
+#include <simcontext.hpp>
+#include <simul.hpp>
+
+namespace MetaSim {
+
+    using namespace std;
+
+    Checkpoint::Checkpoint() : _ctx(SimContext::current())
+    {
+        take();
+    }
+
+    Checkpoint::Checkpoint(SimContext &ctx) : _ctx(ctx)
+    {
+        take();
+    }
+
+    void Checkpoint::take()
+    {
+        SimContext::Scope s(_ctx);
+        _now = _ctx.getSimulation().getTime();
+        _counter = _ctx._eventCounter;
+        _gen = _ctx._pstdgen;
+        _entities = _ctx._entities.size();
+        _stats = _ctx._stats.size();
+
+        vector<Event *> v;
+        _ctx.getEventQueue().dump(v);
+        _queue.reserve(v.size());
+        for (Event *e : v) {
+            if (e->_cancelled) continue;
+            Queued q = { e, e->_time, e->_order, e->_key, e->_priority };
+            _queue.push_back(q);
+            if (e->_disposable) {
+                e->_disposable = false;
+                _pinned.push_back(e);
+            }
+        }
+
+        _gen->saveState(_state);
+        for (Entity *e : _ctx._entities) if (e) e->saveState(_state);
+        for (BaseStat *st : _ctx._stats) st->saveState(_state);
+    }
+
+    Checkpoint::~Checkpoint()
+    {
+        SimContext::Scope s(_ctx);
+        for (Event *e : _pinned) {
+            // a queued event is recycled by the engine, as usual
+            if (e->_isInQueue) e->_disposable = true;
+            else e->dispose();
+        }
+    }
+
+    void Checkpoint::restore()
+    {
+        SimContext::Scope s(_ctx);
+        if (_ctx._entities.size() != _entities || _ctx._stats.size() != _stats)
+            throw Exc("Entities or stats created or destroyed after the checkpoint");
+
+        EventQueue &q = _ctx.getEventQueue();
+        vector<Event *> v;
+        q.dump(v);
+        q.clear();
+        for (Event *e : v) {
+            bool cancelled = e->_cancelled;
+            e->_isInQueue = false;
+            e->_cancelled = false;
+            // a cancelled event belongs to the model, as a dropped
+            // one; the pinned events are not disposable
+            if (e->_disposable && !cancelled) e->dispose();
+        }
+
+        _ctx.getSimulation().setTime(_now);
+        _ctx._eventCounter = _counter;
+        _ctx._pstdgen = _gen;
+        _state.rewind();
+        _gen->restoreState(_state);
+        for (Entity *e : _ctx._entities) if (e) e->restoreState(_state);
+        for (BaseStat *st : _ctx._stats) st->restoreState(_state);
+
+        for (const Queued &qe : _queue) {
+            Event *e = qe.e;
+            e->_time = qe.t;
+            e->_order = qe.order;
+            e->_key = qe.key;
+            e->_priority = qe.priority;
+            q.insert(e);
+            e->_isInQueue = true;
+        }
+    }
+
+} // namespace MetaSim
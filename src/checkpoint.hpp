@@ -0,0 +1,120 @@
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef __CHECKPOINT_HPP__
+#define __CHECKPOINT_HPP__
+
+#include <vector>
+
+#include <baseexc.hpp>
+#include <event.hpp>
+#include <statearchive.hpp>
+#include <tick.hpp>
+
+namespace MetaSim {
+
+    class RandomGen;
+    class SimContext;
+
+    /**
+       \ingroup metasim_ee
+
+       A snapshot of the state of a simulation context, that can be
+       restored any number of times: the clock, the FIFO counter,
+       the events in the queue (with their times and priorities),
+       the state of the default random generator, of the entities
+       (Entity::saveState()) and of the statistics
+       (BaseStat::saveState()). As for TimeWarpSimulation, the
+       entities must save all the members modified by their event
+       handlers, and the random generators other than the default
+       one and the substreams (see RandomVar::setStream()) are not
+       saved.
+
+       @code
+       SIMUL.initRuns();
+       SIMUL.initSingleRun();
+       SIMUL.run_to(warmup);
+       Checkpoint cp;
+       for (...) {
+           cp.restore();
+           SIMUL.run_to(length);
+           ...
+       }
+       @endcode
+
+       The disposable events in the queue when the checkpoint is
+       taken belong to the checkpoint until it is destroyed: they
+       are executed, but not recycled, so that restore() can put
+       them back in the queue. The checkpoint must be destroyed
+       before the entities and the context, and no entity or
+       statistic can be created or destroyed in the context while
+       it is alive.
+
+       See Simulation::runFromWarmup() for replications that share
+       their warm-up.
+    */
+    class Checkpoint {
+    public:
+        /**
+           \ingroup metasim_exc
+        */
+        class Exc : public BaseExc {
+        public:
+            Exc(const std::string &msg) :
+                BaseExc(msg, "Checkpoint", "checkpoint.hpp") {}
+        };
+
+        /// Takes a checkpoint of the current context
+        Checkpoint();
+
+        /// Takes a checkpoint of the context
+        explicit Checkpoint(SimContext &ctx);
+
+        /// Gives back the disposable events to the engine
+        ~Checkpoint();
+
+        /// Puts the context back in the state of the checkpoint
+        void restore();
+
+        /// The time of the checkpoint
+        inline Tick getTime() const { return _now; }
+
+        /// Number of events in the queue at the checkpoint
+        inline size_t getEvents() const { return _queue.size(); }
+
+        /// Size of the state of the entities and of the stats, in bytes
+        inline size_t getStateSize() const { return _state.size(); }
+
+    private:
+        struct Queued {
+            Event *e;
+            Tick t;
+            unsigned long order;
+            Event::SortKey key;
+            int priority;
+        };
+
+        void take();
+
+        SimContext &_ctx;
+        Tick _now;
+        long _counter;
+        RandomGen *_gen;
+        size_t _entities, _stats;
+        std::vector<Queued> _queue;
+        // the disposable events owned by the checkpoint
+        std::vector<Event *> _pinned;
+        StateArchive _state;
+
+        Checkpoint(const Checkpoint &);
+        Checkpoint &operator=(const Checkpoint &);
+    };
+
+} // namespace MetaSim
+
+#endif
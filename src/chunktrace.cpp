@@ -0,0 +1,365 @@
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#include <algorithm>
+#include <cstring>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define METASIM_HAVE_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef METASIM_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#include <chunktrace.hpp>
+
+namespace MetaSim {
+
+    using namespace std;
+
+    namespace {
+        const char MAGIC[8] = { 'M', 'S', 'C', 'H', 'U', 'N', 'K', '1' };
+        const uint64_t BOM = 0x0102030405060708ULL;
+        const uint64_t RECORD = sizeof(TraceRecord);
+        const char PAD[8] = { 0 };
+
+        uint64_t get64(const unsigned char *p)
+        {
+            uint64_t v;
+            memcpy(&v, p, 8);
+            return v;
+        }
+
+        // the i-th bytes of all the records together: the high bytes
+        // of the times and the types repeat, and compress much better
+        void shuffle(const TraceRecord *r, size_t n, unsigned char *out)
+        {
+            const unsigned char *b = reinterpret_cast<const unsigned char *>(r);
+            for (size_t i = 0; i < RECORD; ++i)
+                for (size_t k = 0; k < n; ++k)
+                    out[i * n + k] = b[k * RECORD + i];
+        }
+
+        void unshuffle(const unsigned char *in, size_t n, TraceRecord *r)
+        {
+            unsigned char *b = reinterpret_cast<unsigned char *>(r);
+            for (size_t i = 0; i < RECORD; ++i)
+                for (size_t k = 0; k < n; ++k)
+                    b[k * RECORD + i] = in[i * n + k];
+        }
+    }
+
+    static_assert(sizeof(ChunkedTrace::ChunkInfo) == 40, "ChunkInfo has padding");
+
+    const size_t ChunkedTrace::HEADER;
+    const size_t ChunkedTrace::FOOTER;
+    const size_t ChunkedTraceWriter::DEFAULT_CHUNK;
+    const size_t ChunkedTraceWriter::MAX_PENDING;
+
+    bool ChunkedTrace::hasCodec(Codec c)
+    {
+        switch (c) {
+        case NONE: return true;
+#ifdef METASIM_HAVE_ZLIB
+        case ZLIB: return true;
+#endif
+        default: return false;
+        }
+    }
+
+    ChunkedTrace::Codec ChunkedTrace::defaultCodec()
+    {
+        return hasCodec(ZLIB) ? ZLIB : NONE;
+    }
+
+    bool ChunkedTrace::isChunked(const string &path)
+    {
+        FILE *f = fopen(path.c_str(), "rb");
+        if (!f) return false;
+        char m[8];
+        bool ok = fread(m, 1, 8, f) == 8 && memcmp(m, MAGIC, 8) == 0;
+        fclose(f);
+        return ok;
+    }
+
+    /*---------------------------------------------------*/
+
+    ChunkedTraceWriter::ChunkedTraceWriter(const string &path,
+                                           ChunkedTrace::Codec codec, size_t chunk) :
+        WriterThread(path), _codec(codec), _chunk(max<size_t>(chunk, 1)),
+        _records(0), _filter(TraceFilter::fromEnv()), _offset(0)
+    {
+        if (!ChunkedTrace::hasCodec(codec))
+            throw ChunkedTrace::Exc("Codec not available for " + path);
+        _file = fopen(path.c_str(), "wb");
+        if (!_file) throw ChunkedTrace::Exc("Cannot open file " + path);
+        uint64_t c = uint64_t(codec);
+        write(MAGIC, 8);
+        write(&BOM, 8);
+        write(&RECORD, 8);
+        write(&c, 8);
+        _cur.reserve(_chunk);
+        _thread = thread(&ChunkedTraceWriter::run, this);
+    }
+
+    ChunkedTraceWriter::~ChunkedTraceWriter()
+    {
+        closeQuietly(*this);
+    }
+
+    void ChunkedTraceWriter::write(const void *p, size_t n)
+    {
+        if (fwrite(p, 1, n, _file) != n)
+            throw ChunkedTrace::Exc("Cannot write file " + _path);
+        _offset += n;
+    }
+
+    void ChunkedTraceWriter::post()
+    {
+        unique_lock<mutex> l(_lock);
+        // the compression is behind: the simulation waits for it
+        _cv.wait(l, [this] { return _pending.size() < MAX_PENDING || _error; });
+        checkError();
+        _records += _cur.size();
+        _pending.push_back(std::move(_cur));
+        _cur.clear();
+        if (!_free.empty()) {
+            _cur.swap(_free.back());
+            _free.pop_back();
+        }
+        else _cur.reserve(_chunk);
+        _cv.notify_all();
+    }
+
+    void ChunkedTraceWriter::run()
+    {
+        vector<TraceRecord> c;
+        for (;;) {
+            {
+                unique_lock<mutex> l(_lock);
+                _cv.wait(l, [this] { return _stop || !_pending.empty(); });
+                // at the stop, the chunks still pending are written
+                if (_pending.empty()) return;
+                c.swap(_pending.front());
+                _pending.pop_front();
+            }
+            try {
+                ChunkedTrace::ChunkInfo info;
+                info.offset = _offset;
+                info.count = c.size();
+                info.first = info.last = c.front().time;
+                for (const TraceRecord &r : c) {
+                    info.first = min(info.first, r.time);
+                    info.last = max(info.last, r.time);
+                }
+                const size_t n = c.size() * sizeof(TraceRecord);
+#ifdef METASIM_HAVE_ZLIB
+                if (_codec == ChunkedTrace::ZLIB) {
+                    uLongf len = compressBound(uLong(n));
+                    _out.resize(n + len);
+                    shuffle(c.data(), c.size(), _out.data());
+                    // the fastest level: the writer must keep up
+                    // with the simulation
+                    if (compress2(_out.data() + n, &len, _out.data(),
+                                  uLong(n), 1) != Z_OK)
+                        throw ChunkedTrace::Exc("Cannot compress a chunk of " + _path);
+                    write(_out.data() + n, len);
+                }
+                else
+#endif
+                    write(c.data(), n);
+                info.bytes = _offset - info.offset;
+                _index.push_back(info);
+            } catch (...) {
+                lock_guard<mutex> l(_lock);
+                setError(current_exception());
+            }
+            lock_guard<mutex> l(_lock);
+            c.clear();
+            _free.push_back(std::move(c));
+            c = vector<TraceRecord>();
+            _cv.notify_all();
+        }
+    }
+
+    void ChunkedTraceWriter::close()
+    {
+        if (!_file) return;
+        exception_ptr e;
+        try {
+            if (!_cur.empty()) post();
+        } catch (...) {
+            e = current_exception();
+        }
+        stopThread();
+        if (!e) e = _error;
+        _error = nullptr;
+        if (!e) {
+            try {
+                // the index is aligned, to be read in place
+                write(PAD, size_t((8 - _offset % 8) % 8));
+                uint64_t index = _offset;
+                uint64_t chunks = _index.size();
+                if (chunks > 0)
+                    write(_index.data(), _index.size() * sizeof(ChunkedTrace::ChunkInfo));
+                write(&index, 8);
+                write(&chunks, 8);
+                write(&BOM, 8);
+                write(MAGIC, 8);
+            } catch (...) {
+                e = current_exception();
+            }
+        }
+        closeFile<ChunkedTrace::Exc>(e);
+    }
+
+    /*---------------------------------------------------*/
+
+    ChunkedTraceReader::ChunkedTraceReader(const string &path) :
+        _path(path), _data(nullptr), _len(0), _addr(nullptr),
+        _codec(ChunkedTrace::NONE), _index(nullptr), _chunks(0), _records(0),
+        _decoded(0)
+    {
+        FILE *f = fopen(path.c_str(), "rb");
+        if (!f) throw ChunkedTrace::Exc("Cannot open " + path);
+        fseek(f, 0, SEEK_END);
+        long len = ftell(f);
+        if (len < long(ChunkedTrace::HEADER + ChunkedTrace::FOOTER)) {
+            fclose(f);
+            throw ChunkedTrace::Exc("Not a chunked trace: " + path);
+        }
+        _len = size_t(len);
+#ifdef METASIM_HAVE_MMAP
+        fclose(f);
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) throw ChunkedTrace::Exc("Cannot open " + path);
+        _addr = mmap(nullptr, _len, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (_addr == MAP_FAILED) {
+            _addr = nullptr;
+            throw ChunkedTrace::Exc("Cannot map " + path);
+        }
+        _data = static_cast<const unsigned char *>(_addr);
+#else
+        _copy.resize(_len);
+        fseek(f, 0, SEEK_SET);
+        size_t n = fread(_copy.data(), 1, _len, f);
+        fclose(f);
+        if (n != _len) throw ChunkedTrace::Exc("Cannot read " + path);
+        _data = _copy.data();
+#endif
+        const unsigned char *h = _data;
+        const unsigned char *t = _data + _len - ChunkedTrace::FOOTER;
+        string err;
+        if (memcmp(h, MAGIC, 8) != 0 || memcmp(t + 24, MAGIC, 8) != 0)
+            err = "Not a chunked trace (or not closed): ";
+        else if (get64(h + 8) != BOM || get64(h + 16) != RECORD || get64(t + 16) != BOM)
+            err = "Wrong byte order or record size: ";
+        else if (!ChunkedTrace::hasCodec(ChunkedTrace::Codec(get64(h + 24))))
+            err = "Codec not available for ";
+        else {
+            _codec = ChunkedTrace::Codec(get64(h + 24));
+            uint64_t index = get64(t);
+            _chunks = size_t(get64(t + 8));
+            if (index % 8 != 0 || index < ChunkedTrace::HEADER ||
+                index + _chunks * sizeof(ChunkedTrace::ChunkInfo) !=
+                _len - ChunkedTrace::FOOTER)
+                err = "Corrupted index: ";
+            else
+                _index = reinterpret_cast<const ChunkedTrace::ChunkInfo *>(_data + index);
+        }
+        if (!err.empty()) {
+#ifdef METASIM_HAVE_MMAP
+            munmap(_addr, _len);
+#endif
+            throw ChunkedTrace::Exc(err + path);
+        }
+        for (size_t i = 0; i < _chunks; ++i) _records += _index[i].count;
+#ifdef METASIM_HAVE_MMAP
+        // the chunks are read where the windows are
+        madvise(_addr, _len, MADV_RANDOM);
+#endif
+    }
+
+    ChunkedTraceReader::~ChunkedTraceReader()
+    {
+#ifdef METASIM_HAVE_MMAP
+        if (_addr) munmap(_addr, _len);
+#endif
+    }
+
+    void ChunkedTraceReader::readChunk(size_t i, vector<TraceRecord> &out)
+    {
+        if (i >= _chunks) throw ChunkedTrace::Exc("No such chunk in " + _path);
+        const ChunkedTrace::ChunkInfo &c = _index[i];
+        if (c.offset + c.bytes > _len - ChunkedTrace::FOOTER)
+            throw ChunkedTrace::Exc("Corrupted index: " + _path);
+        const size_t old = out.size();
+        const size_t n = size_t(c.count) * sizeof(TraceRecord);
+        out.resize(old + size_t(c.count));
+        bool ok = false;
+        switch (_codec) {
+        case ChunkedTrace::NONE:
+            ok = c.bytes == n;
+            if (ok) memcpy(out.data() + old, _data + c.offset, n);
+            break;
+#ifdef METASIM_HAVE_ZLIB
+        case ChunkedTrace::ZLIB: {
+            uLongf len = uLongf(n);
+            _buf.resize(n);
+            ok = uncompress(_buf.data(), &len, _data + c.offset,
+                            uLong(c.bytes)) == Z_OK && len == n;
+            if (ok) unshuffle(_buf.data(), size_t(c.count), out.data() + old);
+            break;
+        }
+#endif
+        default:
+            break;
+        }
+        if (!ok) {
+            out.resize(old);
+            throw ChunkedTrace::Exc("Corrupted chunk in " + _path);
+        }
+        ++_decoded;
+    }
+
+    size_t ChunkedTraceReader::window(Tick from, Tick to, vector<TraceRecord> &out)
+    {
+        const int64_t a = int64_t(from), b = int64_t(to);
+        const size_t old = out.size();
+        for (size_t i = 0; i < _chunks; ++i) {
+            const ChunkedTrace::ChunkInfo &c = _index[i];
+            if (c.last < a || c.first > b) continue;
+            if (c.first >= a && c.last <= b) {
+                readChunk(i, out);
+                continue;
+            }
+            _tmp.clear();
+            readChunk(i, _tmp);
+            for (const TraceRecord &r : _tmp)
+                if (r.time >= a && r.time <= b) out.push_back(r);
+        }
+        return out.size() - old;
+    }
+
+    void ChunkedTraceReader::payloads(vector<double> &out)
+    {
+        out.reserve(out.size() + size_t(_records));
+        for (size_t i = 0; i < _chunks; ++i) {
+            _tmp.clear();
+            readChunk(i, _tmp);
+            for (const TraceRecord &r : _tmp) out.push_back(r.payload);
+        }
+    }
+
+} // namespace MetaSim
@@ -0,0 +1,248 @@
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef __CHUNKTRACE_HPP__
+#define __CHUNKTRACE_HPP__
+
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include <baseexc.hpp>
+#include <tracebinary.hpp>
+#include <writerthread.hpp>
+
+namespace MetaSim {
+
+    /**
+       \ingroup metasim_stat
+
+       A trace of TraceRecords in compressed chunks, with an index:
+       a reader finds the chunks of a window of time in the index,
+       and decompresses only them.
+
+       The file is
+
+       <pre>
+       "MSCHUNK1"                  magic
+       uint64 0x0102030405060708   order of the bytes of the writer
+       uint64 24                   size of a record
+       uint64 codec
+       chunks, compressed (ZLIB: the bytes of the records are
+       shuffled, the first bytes of all the records, then the
+       second ones, and so on)
+       index: a ChunkInfo for each chunk
+       uint64 offset of the index
+       uint64 chunks
+       uint64 0x0102030405060708
+       "MSCHUNK1"
+       </pre>
+
+       so the index is found from the end of the file, and read in
+       place from a mapping of the file (ChunkedTraceReader).
+     */
+    class ChunkedTrace {
+    public:
+        /**
+           \ingroup metasim_exc
+        */
+        class Exc : public BaseExc {
+        public:
+            Exc(const std::string &msg) :
+                BaseExc(msg, "ChunkedTrace", "chunktrace.hpp") {}
+        };
+
+        /// The compression of the chunks
+        enum Codec {
+            NONE = 0,
+            /// deflate (zlib), if the library is built with it
+            ZLIB = 1
+        };
+
+        /// An entry of the index
+        struct ChunkInfo {
+            /// position in the file, and compressed size
+            uint64_t offset;
+            uint64_t bytes;
+            /// number of records
+            uint64_t count;
+            /// the smallest and the largest time of the records
+            int64_t first;
+            int64_t last;
+        };
+
+        static const size_t HEADER = 32;
+        static const size_t FOOTER = 32;
+
+        /// True if the library can write and read the codec
+        static bool hasCodec(Codec c);
+
+        /// The best codec available
+        static Codec defaultCodec();
+
+        /// True if the file is a chunked trace
+        static bool isChunked(const std::string &path);
+    };
+
+    /**
+       \ingroup metasim_stat
+
+       Writes a ChunkedTrace. record() appends the record to the
+       current chunk; a full chunk is compressed and written by
+       another thread, so the simulation only pays the copy of the
+       record. The index is written by close(). The records that
+       do not pass the filter (see setFilter()) are discarded.
+
+       @code
+       ChunkedTraceWriter trace("day.trc", ChunkedTrace::ZLIB);
+       attach_stat(trace, arrival);
+       @endcode
+     */
+    class ChunkedTraceWriter : private WriterThread {
+    public:
+        /// Default number of records of a chunk
+        static const size_t DEFAULT_CHUNK = 1 << 16;
+
+        /// Chunks waiting for the compression, at most
+        static const size_t MAX_PENDING = 4;
+
+        explicit ChunkedTraceWriter(const std::string &path,
+                                    ChunkedTrace::Codec codec = ChunkedTrace::defaultCodec(),
+                                    size_t chunk = DEFAULT_CHUNK);
+
+        /// Writes the last chunk and the index
+        ~ChunkedTraceWriter();
+
+        /// Records an event
+        inline void record(Tick t, uint32_t type, int32_t entity = -1,
+                           double payload = 0)
+        {
+            TraceRecord r;
+            r.time = int64_t(t);
+            r.type = type;
+            r.entity = entity;
+            r.payload = payload;
+            record(r);
+        }
+
+        inline void record(const TraceRecord &r)
+        {
+            if (!_filter.accept(r.time, r.type, r.entity)) return;
+            _cur.push_back(r);
+            if (_cur.size() == _chunk) post();
+        }
+
+        /// Records the time and the type of an event (see TraceBinary)
+        template <class E>
+        void probe(E &e)
+        {
+            record(e.getLastTime(), uint32_t(EventPool::typeId<E>()));
+        }
+
+        /// Sets the filter of the records (see TraceFilter)
+        inline void setFilter(const TraceFilter &f) { _filter = f; }
+
+        inline const TraceFilter &getFilter() const { return _filter; }
+
+        /// Writes all the chunks and the index, and closes the file
+        void close();
+
+        /// Number of records
+        inline uint64_t getRecords() const { return _records + _cur.size(); }
+
+        inline ChunkedTrace::Codec getCodec() const { return _codec; }
+
+    private:
+        // passes the current chunk to the thread
+        void post();
+        void run();
+        void write(const void *p, size_t n);
+
+        ChunkedTrace::Codec _codec;
+        size_t _chunk;
+        uint64_t _records;
+        std::vector<TraceRecord> _cur;
+        TraceFilter _filter;
+
+        std::deque<std::vector<TraceRecord> > _pending;
+        std::vector<std::vector<TraceRecord> > _free;
+
+        // of the thread
+        uint64_t _offset;
+        std::vector<ChunkedTrace::ChunkInfo> _index;
+        std::vector<unsigned char> _out;
+    };
+
+    /**
+       \ingroup metasim_stat
+
+       Reads a ChunkedTrace from a mapping of the file (or a copy
+       in memory where there is no mmap()). The index is used in
+       place, and a chunk is decompressed when it is read.
+
+       @code
+       ChunkedTraceReader in("day.trc");
+       std::vector<TraceRecord> v;
+       in.window(Tick(3600000), Tick(7200000), v);
+       @endcode
+     */
+    class ChunkedTraceReader {
+    public:
+        explicit ChunkedTraceReader(const std::string &path);
+        ~ChunkedTraceReader();
+
+        inline size_t getChunks() const { return _chunks; }
+
+        inline const ChunkedTrace::ChunkInfo &getChunk(size_t i) const { return _index[i]; }
+
+        inline ChunkedTrace::Codec getCodec() const { return _codec; }
+
+        /// Number of records of the trace
+        inline uint64_t getRecords() const { return _records; }
+
+        /// Number of chunks decompressed so far
+        inline uint64_t getDecoded() const { return _decoded; }
+
+        /// Appends the records of the i-th chunk
+        void readChunk(size_t i, std::vector<TraceRecord> &out);
+
+        /**
+           Appends the records with a time in [from, to], in the
+           order of the file; only the chunks whose times overlap
+           the window are decompressed. Returns the number of
+           records appended.
+         */
+        size_t window(Tick from, Tick to, std::vector<TraceRecord> &out);
+
+        /// Appends the payloads of all the records (for DetVar)
+        void payloads(std::vector<double> &out);
+
+    private:
+        ChunkedTraceReader(const ChunkedTraceReader &);
+        ChunkedTraceReader &operator=(const ChunkedTraceReader &);
+
+        std::string _path;
+        const unsigned char *_data;
+        size_t _len;
+        void *_addr;
+        std::vector<unsigned char> _copy;
+
+        ChunkedTrace::Codec _codec;
+        const ChunkedTrace::ChunkInfo *_index;
+        size_t _chunks;
+        uint64_t _records;
+        uint64_t _decoded;
+        std::vector<TraceRecord> _tmp;
+        std::vector<unsigned char> _buf;
+    };
+
+} // namespace MetaSim
+
+#endif
@@ -0,0 +1,195 @@
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#include <cstring>
+#include <map>
+#include <mutex>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define METASIM_HAVE_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <datafile.hpp>
+
+namespace MetaSim {
+
+    using namespace std;
+
+    namespace {
+        const char MAGIC[8] = { 'M', 'S', 'D', 'A', 'T', 'A', '0', '1' };
+        const uint64_t BOM = 0x0102030405060708ULL;
+
+        // the shared mappings, by path
+        mutex mapLock;
+        map<string, weak_ptr<const MappedData> > mappings;
+    }
+
+    bool DataFile::isBinary(const string &path)
+    {
+        ifstream in(path.c_str(), ios::binary);
+        char m[8];
+        return in.read(m, 8) && memcmp(m, MAGIC, 8) == 0;
+    }
+
+    uint64_t DataFile::readHeader(istream &in, const string &path)
+    {
+        char m[8];
+        uint64_t bom, n;
+        if (!in.read(m, 8) || memcmp(m, MAGIC, 8) != 0)
+            throw Exc("Not a binary data file: " + path);
+        if (!in.read(reinterpret_cast<char *>(&bom), 8) ||
+            !in.read(reinterpret_cast<char *>(&n), 8))
+            throw Exc("Truncated header: " + path);
+        if (bom != BOM) throw Exc("Wrong byte order: " + path);
+        if (n == 0) throw Exc("No values in " + path);
+        return n;
+    }
+
+    void DataFile::write(const string &path, const double *v, size_t n)
+    {
+        ofstream out(path.c_str(), ios::binary | ios::trunc);
+        uint64_t len = n;
+        out.write(MAGIC, 8);
+        out.write(reinterpret_cast<const char *>(&BOM), 8);
+        out.write(reinterpret_cast<const char *>(&len), 8);
+        out.write(reinterpret_cast<const char *>(v), n * sizeof(double));
+        if (!out) throw Exc("Cannot write " + path);
+    }
+
+    size_t DataFile::convert(const string &text, const string &path)
+    {
+        ifstream in(text.c_str());
+        if (!in.is_open()) throw Exc("Cannot open " + text);
+        vector<double> v;
+        double x;
+        while (in >> x) v.push_back(x);
+        if (!in.eof()) throw Exc("Not a number in " + text);
+        write(path, v.data(), v.size());
+        return v.size();
+    }
+
+    /*---------------------------------------------------*/
+
+    MappedData::MappedData(const string &path) :
+        _path(path), _data(nullptr), _size(0), _addr(nullptr), _len(0),
+        _dev(0), _ino(0), _mtime(0)
+    {
+        ifstream in(path.c_str(), ios::binary);
+        if (!in.is_open()) throw DataFile::Exc("Cannot open " + path);
+        _size = DataFile::readHeader(in, path);
+        in.seekg(0, ios::end);
+        if (uint64_t(in.tellg()) < DataFile::HEADER + _size * sizeof(double))
+            throw DataFile::Exc("Truncated file: " + path);
+        _len = DataFile::HEADER + _size * sizeof(double);
+
+#ifdef METASIM_HAVE_MMAP
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) throw DataFile::Exc("Cannot open " + path);
+        _addr = mmap(nullptr, _len, PROT_READ, MAP_SHARED, fd, 0);
+        struct stat st;
+        if (fstat(fd, &st) == 0) {
+            _dev = uint64_t(st.st_dev);
+            _ino = uint64_t(st.st_ino);
+            _mtime = int64_t(st.st_mtime);
+        }
+        ::close(fd);
+        if (_addr == MAP_FAILED) {
+            _addr = nullptr;
+            throw DataFile::Exc("Cannot map " + path);
+        }
+        // the values are read in order
+        madvise(_addr, _len, MADV_SEQUENTIAL);
+        _data = reinterpret_cast<const double *>(
+            static_cast<const char *>(_addr) + DataFile::HEADER);
+#else
+        _copy.resize(_size);
+        in.seekg(DataFile::HEADER);
+        in.read(reinterpret_cast<char *>(_copy.data()), _size * sizeof(double));
+        _data = _copy.data();
+#endif
+    }
+
+    MappedData::~MappedData()
+    {
+#ifdef METASIM_HAVE_MMAP
+        if (_addr) munmap(_addr, _len);
+#endif
+        lock_guard<mutex> g(mapLock);
+        auto i = mappings.find(_path);
+        if (i != mappings.end() && i->second.expired()) mappings.erase(i);
+    }
+
+    bool MappedData::isCurrent() const
+    {
+#ifdef METASIM_HAVE_MMAP
+        // the file may have been replaced
+        struct stat st;
+        return ::stat(_path.c_str(), &st) == 0 && uint64_t(st.st_dev) == _dev &&
+            uint64_t(st.st_ino) == _ino && int64_t(st.st_mtime) == _mtime &&
+            uint64_t(st.st_size) >= _len;
+#else
+        return true;
+#endif
+    }
+
+    shared_ptr<const MappedData> MappedData::open(const string &path)
+    {
+        lock_guard<mutex> g(mapLock);
+        weak_ptr<const MappedData> &w = mappings[path];
+        shared_ptr<const MappedData> m = w.lock();
+        if (!m || !m->isCurrent()) {
+            try {
+                m.reset(new MappedData(path));
+            } catch (...) {
+                mappings.erase(path);
+                throw;
+            }
+            w = m;
+        }
+        return m;
+    }
+
+    /*---------------------------------------------------*/
+
+    DataStream::DataStream(const string &path, size_t buffer) :
+        _path(path), _in(path.c_str(), ios::binary),
+        _buf(buffer > 0 ? buffer : 1), _pos(0), _len(0), _start(0)
+    {
+        if (!_in.is_open()) throw DataFile::Exc("Cannot open " + path);
+        _size = DataFile::readHeader(_in, path);
+    }
+
+    void DataStream::refill()
+    {
+        _start = (_start + _len) % _size;
+        if (_start == 0) {
+            _in.clear();
+            _in.seekg(DataFile::HEADER);
+        }
+        _len = size_t(min<uint64_t>(_buf.size(), _size - _start));
+        _in.read(reinterpret_cast<char *>(_buf.data()), _len * sizeof(double));
+        if (!_in) throw DataFile::Exc("Truncated file: " + _path);
+        _pos = 0;
+    }
+
+    void DataStream::seek(uint64_t i)
+    {
+        _start = i % _size;
+        _in.clear();
+        _in.seekg(DataFile::HEADER + _start * sizeof(double));
+        // the next refill() starts at _start
+        _len = 0;
+        _pos = 0;
+        refill();
+    }
+
+} // namespace MetaSim
@@ -0,0 +1,155 @@
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef __DATAFILE_HPP__
+#define __DATAFILE_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <baseexc.hpp>
+
+namespace MetaSim {
+
+    /**
+       \ingroup metasim_random
+
+       Binary files of doubles, for the trace driven variables
+       (DetVar). The file is a header of 24 bytes (the magic string
+       "MSDATA01", a byte order mark and the number of values, of 64
+       bits), followed by the values, in the byte order of the
+       machine that wrote it: a file of a machine with a different
+       order is refused, instead of being read wrongly.
+
+       A text trace is converted once with DataFile::convert(); then
+       the variables read the values without parsing, either from a
+       memory mapping of the file (MappedData) or through a bounded
+       buffer (DataStream).
+    */
+    class DataFile {
+    public:
+        /**
+           \ingroup metasim_exc
+
+           Exceptions for the binary data files.
+        */
+        class Exc : public BaseExc {
+        public:
+            Exc(const std::string &wh, const std::string &cl = "DataFile") :
+                BaseExc(wh, cl, "datafile.hpp") {}
+        };
+
+        /// Size of the header, in bytes
+        static const size_t HEADER = 24;
+
+        /// True if the file exists and starts with the magic string
+        static bool isBinary(const std::string &path);
+
+        /// Writes n values in a binary file
+        static void write(const std::string &path, const double *v, size_t n);
+
+        /// Converts a text file of numbers in a binary file, and
+        /// returns the number of values
+        static size_t convert(const std::string &text, const std::string &path);
+
+        /// Checks the header of an open file, and returns the
+        /// number of values
+        static uint64_t readHeader(std::istream &in, const std::string &path);
+    };
+
+    /**
+       \ingroup metasim_random
+
+       A binary data file mapped in memory (read only). The mappings
+       are shared: open() returns the same object for the same path,
+       as long as some variable uses it and the file is not
+       replaced, so that many variables
+       created from one trace do not multiply the memory or the
+       opening time. The pages are loaded by the operating system on
+       demand, so a file larger than the memory can be used.
+
+       On the systems without mmap() the file is read in memory.
+    */
+    class MappedData {
+        std::string _path;
+        const double *_data;
+        size_t _size;
+        // the mapping, or the values without mmap()
+        void *_addr;
+        size_t _len;
+        std::vector<double> _copy;
+        // the identity of the file that was mapped
+        uint64_t _dev, _ino;
+        int64_t _mtime;
+
+        explicit MappedData(const std::string &path);
+
+        // true if the path still names the mapped file
+        bool isCurrent() const;
+    public:
+        ~MappedData();
+
+        MappedData(const MappedData &) = delete;
+        MappedData &operator=(const MappedData &) = delete;
+
+        /// The mapping of the file (throws DataFile::Exc)
+        static std::shared_ptr<const MappedData> open(const std::string &path);
+
+        inline const double *data() const { return _data; }
+        inline size_t size() const { return _size; }
+        inline const std::string &getPath() const { return _path; }
+    };
+
+    /**
+       \ingroup metasim_random
+
+       Sequential reading of a binary data file with a buffer of a
+       fixed number of values: the memory used does not depend on
+       the size of the file. After the last value, the reading
+       starts over from the first one.
+    */
+    class DataStream {
+        std::string _path;
+        std::ifstream _in;
+        uint64_t _size;
+        std::vector<double> _buf;
+        size_t _pos, _len;
+        // the index of the first value in the buffer
+        uint64_t _start;
+
+        void refill();
+    public:
+        static const size_t DEFAULT_BUFFER = 1 << 16;
+
+        /// Opens the file, throws DataFile::Exc
+        DataStream(const std::string &path, size_t buffer = DEFAULT_BUFFER);
+
+        inline double next()
+        {
+            if (_pos == _len) refill();
+            return _buf[_pos++];
+        }
+
+        /// Moves to the value of index i (modulo the size)
+        void seek(uint64_t i);
+
+        /// The index of the next value
+        inline uint64_t tell() const { return (_start + _pos) % _size; }
+
+        inline uint64_t size() const { return _size; }
+        inline size_t getBufferSize() const { return _buf.size(); }
+        inline const std::string &getPath() const { return _path; }
+    };
+
+} // namespace MetaSim
+
+#endif
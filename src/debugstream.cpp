@@ -13,6 +13,8 @@
  ***************************************************************************/
 #include <algorithm>
 #include <iostream>
+#include <mutex>
+#include <unordered_map>
 
 #include <debugstream.hpp>
 #include <simul.hpp>
@@ -21,6 +23,29 @@ using namespace std;
 
 namespace MetaSim {
 
+    std::atomic<int> DebugStream::_active(0);
+
+    namespace {
+        mutex levelLock;
+
+        unordered_map<string, int> &levels()
+        {
+            static unordered_map<string, int> *l = new unordered_map<string, int>();
+            return *l;
+        }
+    }
+
+    int DebugStream::level(const std::string &s)
+    {
+        lock_guard<mutex> g(levelLock);
+        unordered_map<string, int> &l = levels();
+        auto i = l.find(s);
+        if (i != l.end()) return i->second;
+        int id = int(l.size());
+        l[s] = id;
+        return id;
+    }
+
     DebugStream::DebugStream() : 
         _os(&cerr),
         _autodelete(false),
@@ -28,8 +53,9 @@ namespace MetaSim {
         _isDebugAll(false),
         _isIndenting(false),
         _indentLevel(0),
-        _dbgLevels(),
+        _mask(),
         _dbgStack(),
+        _counted(false),
         _t1(0),
         _t2(MAXTICK)
     {    
@@ -37,9 +63,21 @@ namespace MetaSim {
 
     DebugStream::~DebugStream()
     { 
+        if (_counted) --_active;
         if (_autodelete) delete _os;
     }
 
+    void DebugStream::update()
+    {
+        bool on = _isDebugAll;
+        for (uint64_t w : _mask) on = on || w != 0;
+        if (on != _counted) {
+            if (on) ++_active;
+            else --_active;
+            _counted = on;
+        }
+    }
+
     void DebugStream::setStream(std::ostream& o)
     {
         if (_autodelete) delete _os;
@@ -58,55 +96,68 @@ namespace MetaSim {
     {
         if (s == "All") _isDebugAll = true;
         else {
-            _dbgLevels.push_back(s);
+            size_t id = size_t(level(s));
+            if (id / 64 >= _mask.size()) _mask.resize(id / 64 + 1, 0);
+            _mask[id / 64] |= uint64_t(1) << (id % 64);
         }
+        update();
     }
 
     void DebugStream::disable(std::string s) 
     {
         if (s == "All") _isDebugAll = false;
         else {
-            std::vector<std::string>::iterator i = 
-                find(_dbgLevels.begin(),_dbgLevels.end(),s);
-            if (i != _dbgLevels.end()) _dbgLevels.erase(i);
+            size_t id = size_t(level(s));
+            if (id / 64 < _mask.size())
+                _mask[id / 64] &= ~(uint64_t(1) << (id % 64));
         }
+        update();
     }
 
     void DebugStream::enter(std::string s) 
     {
-        _dbgStack.push_back(_isDebug);
-        std::vector<std::string>::iterator i = 
-            find(_dbgLevels.begin(), _dbgLevels.end(), s);
-        if (i == _dbgLevels.end()
-            || (SIMUL.getTime() < _t1) 
-            || (SIMUL.getTime() > _t2)) 
-            _isDebug = false;
-        else
-            _isDebug = true;
-        _isIndenting = true;
+        _dbgStack.push_back(push(level(s)));
     }
 
-    void DebugStream::enter(std::string s, std::string header) 
+    void DebugStream::enter(std::string s, std::string h) 
     {
         enter(s);
-        if (filter()) {
-            indent();
-            (*_os) << header << endl;
-            resetIndent();
-            _indentLevel++;
-        }
+        if (filter()) header(h);
     }
 
-    void DebugStream::exit() 
+    bool DebugStream::push(int id)
+    {
+        bool prev = _isDebug;
+        _isDebug = isEnabled(id) && SIMUL.getTime() >= _t1 &&
+            SIMUL.getTime() <= _t2;
+        _isIndenting = true;
+        return prev;
+    }
+
+    void DebugStream::leave(bool prev)
     {
         if (filter()) {
             _indentLevel--;
         }
-        _isDebug = _dbgStack.back();
-        _dbgStack.pop_back();
+        _isDebug = prev;
         _isIndenting = true;
     }
 
+    void DebugStream::header(const std::string &h)
+    {
+        indent();
+        (*_os) << h << endl;
+        resetIndent();
+        _indentLevel++;
+    }
+
+    void DebugStream::exit() 
+    {
+        bool prev = _dbgStack.back();
+        _dbgStack.pop_back();
+        leave(prev);
+    }
+
     void DebugStream::setTransitory(Tick t)
     {
         _t1 = t;
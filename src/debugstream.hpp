@@ -14,6 +14,8 @@
 #ifndef __DEBUGSTREAM_HPP__
 #define __DEBUGSTREAM_HPP__
 
+#include <atomic>
+#include <cstdint>
 #include <fstream>
 #include <string>
 #include <vector>
@@ -25,6 +27,11 @@ namespace MetaSim {
        \ingroup metasim_util
      
        Helper class used to manipulate the debug output.
+
+       The names of the levels are interned in small integers
+       (level()), and the enabled levels of a stream are a mask of
+       bits. While no stream has a level enabled, anyEnabled() is
+       false, and a DBGENTER or a DBGPRINT costs only its test.
     */
     class DebugStream {
     private:
@@ -34,16 +41,40 @@ namespace MetaSim {
         bool _isDebugAll;
         bool _isIndenting;
         int _indentLevel;
-        std::vector<std::string> _dbgLevels;
+        // a bit for each enabled level
+        std::vector<uint64_t> _mask;
         std::vector<bool> _dbgStack;
+        // this stream is counted in _active
+        bool _counted;
 
         Tick _t1;
         Tick _t2;
 
+        // the streams with some level enabled
+        static std::atomic<int> _active;
+
+        void update();
+
     public:
         DebugStream();
         ~DebugStream(); 
 
+        /// The identifier of a level: the same for the same name
+        static int level(const std::string &s);
+
+        /// True if some stream has some level enabled
+        static inline bool anyEnabled()
+        {
+            return _active.load(std::memory_order_relaxed) != 0;
+        }
+
+        /// True if the level is enabled (not counting "All")
+        inline bool isEnabled(int id) const
+        {
+            size_t w = size_t(id) >> 6;
+            return w < _mask.size() && ((_mask[w] >> (id & 63)) & 1);
+        }
+
         /**
          * Set the debug stream.
          */
@@ -85,6 +116,18 @@ namespace MetaSim {
          */  
         void exit();
 
+        /**
+         *  Enters the level id without the stack: returns the state
+         *  to give to leave() (see DbgObj).
+         */
+        bool push(int id);
+
+        /// Leaves the level entered by push()
+        void leave(bool prev);
+
+        /// Outputs the header of a level, and indents what follows
+        void header(const std::string &h);
+
         /**
          * Enables output from tick t 
          */
@@ -0,0 +1,401 @@
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <thread>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define METASIM_HAVE_SOCKETS 1
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#include <distrun.hpp>
+#include <randomgen.hpp>
+#include <randomvar.hpp>
+#include <statearchive.hpp>
+
+namespace MetaSim {
+
+    using namespace std;
+
+    namespace {
+        // A message: a header, and len bytes
+        const uint32_t MAGIC = 0x3152534d;   // "MSR1"
+        enum Kind : uint32_t { JOB = 1, RESULT = 2, FAILED = 3, STOP = 4 };
+        const uint64_t MAX_MESSAGE = uint64_t(1) << 30;
+
+        struct Header {
+            uint32_t magic;
+            uint32_t kind;
+            uint64_t len;
+        };
+
+        // followed by the state of the generator
+        struct Job {
+            uint64_t run;
+            uint64_t streams;
+            uint64_t point;
+            int64_t endTick;
+            int64_t transitory;
+            int64_t streamSeed;
+            uint8_t antithetic;
+        };
+
+        // followed by count values
+        struct Result {
+            uint64_t run;
+            uint64_t executed;
+            uint64_t count;
+        };
+
+#ifdef METASIM_HAVE_SOCKETS
+        bool sendAll(int fd, const char *p, size_t len)
+        {
+#ifdef MSG_NOSIGNAL
+            const int flags = MSG_NOSIGNAL;
+#else
+            const int flags = 0;
+#endif
+            while (len > 0) {
+                ssize_t k = send(fd, p, len, flags);
+                if (k < 0 && errno == EINTR) continue;
+                if (k <= 0) return false;
+                p += k;
+                len -= size_t(k);
+            }
+            return true;
+        }
+
+        bool recvAll(int fd, char *p, size_t len)
+        {
+            while (len > 0) {
+                ssize_t k = recv(fd, p, len, 0);
+                if (k < 0 && errno == EINTR) continue;
+                if (k <= 0) return false;
+                p += k;
+                len -= size_t(k);
+            }
+            return true;
+        }
+
+        bool sendMessage(int fd, uint32_t kind, const string &payload)
+        {
+            Header h = { MAGIC, kind, payload.size() };
+            string m(reinterpret_cast<const char *>(&h), sizeof(h));
+            m += payload;
+            return sendAll(fd, m.data(), m.size());
+        }
+
+        bool recvMessage(int fd, uint32_t &kind, string &payload)
+        {
+            Header h;
+            if (!recvAll(fd, reinterpret_cast<char *>(&h), sizeof(h)) ||
+                h.magic != MAGIC || h.len > MAX_MESSAGE)
+                return false;
+            kind = h.kind;
+            payload.resize(size_t(h.len));
+            return h.len == 0 || recvAll(fd, &payload[0], payload.size());
+        }
+
+        void noDelay(int fd)
+        {
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+#ifdef SO_NOSIGPIPE
+            setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+        }
+#endif
+    }
+
+    RunServer::RunServer(unsigned short port) :
+        _fd(-1), _port(port), _workers(), _reissued(0), _timeout(0), _point(0)
+    {
+#ifdef METASIM_HAVE_SOCKETS
+        _fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (_fd < 0) throw Exc("Cannot create a socket");
+        int one = 1;
+        setsockopt(_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+        sockaddr_in a;
+        memset(&a, 0, sizeof(a));
+        a.sin_family = AF_INET;
+        a.sin_addr.s_addr = htonl(INADDR_ANY);
+        a.sin_port = htons(port);
+        socklen_t len = sizeof(a);
+        if (bind(_fd, reinterpret_cast<sockaddr *>(&a), sizeof(a)) != 0 ||
+            listen(_fd, 64) != 0 ||
+            getsockname(_fd, reinterpret_cast<sockaddr *>(&a), &len) != 0) {
+            close(_fd);
+            throw Exc("Cannot listen on port " + to_string(port));
+        }
+        _port = ntohs(a.sin_port);
+#else
+        throw Exc("Sockets are not available");
+#endif
+    }
+
+    RunServer::~RunServer()
+    {
+#ifdef METASIM_HAVE_SOCKETS
+        for (Worker &w : _workers) sendMessage(w.fd, STOP, string());
+        dropAll();
+        if (_fd >= 0) close(_fd);
+#endif
+    }
+
+    void RunServer::accept()
+    {
+#ifdef METASIM_HAVE_SOCKETS
+        int fd = ::accept(_fd, NULL, NULL);
+        if (fd < 0) return;
+        noDelay(fd);
+        Worker w = { fd, -1 };
+        _workers.push_back(w);
+#endif
+    }
+
+    void RunServer::drop(size_t k)
+    {
+#ifdef METASIM_HAVE_SOCKETS
+        close(_workers[k].fd);
+        _workers.erase(_workers.begin() + k);
+#endif
+    }
+
+    void RunServer::dropAll()
+    {
+        while (!_workers.empty()) drop(_workers.size() - 1);
+    }
+
+    void RunServer::dispatch(Simulation &sim, const RandomGen &g, Tick endTick,
+                             size_t runs, const Collect &collect)
+    {
+#ifdef METASIM_HAVE_SOCKETS
+        // the part of the jobs common to all runs
+        Job job;
+        memset(&job, 0, sizeof(job));
+        const Simulation::ReplicaSetup setup = sim.replicaSetup();
+        job.streams = runs;
+        job.point = _point;
+        job.endTick = int64_t(endTick);
+        job.transitory = int64_t(setup.transitory);
+        job.streamSeed = setup.streamSeed;
+        job.antithetic = setup.antithetic;
+        StateArchive gen;
+        g.saveState(gen);
+
+        deque<size_t> pending;
+        for (size_t i = 0; i < runs; ++i) pending.push_back(i);
+        vector< vector<double> > results(runs);
+        vector<uint64_t> executed(runs, 0);
+        vector<bool> done(runs, false);
+        size_t next = 0;
+        auto last = chrono::steady_clock::now();
+
+        // a lost worker gives back its run
+        auto lose = [&](size_t k) {
+            if (_workers[k].run >= 0) {
+                pending.push_front(size_t(_workers[k].run));
+                ++_reissued;
+            }
+            drop(k);
+        };
+        auto fail = [&](const string &msg) {
+            dropAll();
+            throw Exc(msg);
+        };
+
+        while (next < runs) {
+            for (size_t k = 0; k < _workers.size() && !pending.empty(); ) {
+                if (_workers[k].run >= 0) { ++k; continue; }
+                job.run = pending.front();
+                string m(reinterpret_cast<const char *>(&job), sizeof(job));
+                m.append(gen.data(), gen.size());
+                if (!sendMessage(_workers[k].fd, JOB, m)) {
+                    drop(k);
+                    continue;
+                }
+                _workers[k].run = int64_t(job.run);
+                pending.pop_front();
+                ++k;
+            }
+
+            vector<pollfd> fds(_workers.size() + 1);
+            fds[0].fd = _fd;
+            fds[0].events = POLLIN;
+            for (size_t k = 0; k < _workers.size(); ++k) {
+                fds[k + 1].fd = _workers[k].fd;
+                fds[k + 1].events = POLLIN;
+            }
+            int n = poll(fds.data(), fds.size(), 200);
+            if (n < 0 && errno != EINTR) fail("poll() failed");
+            if (n <= 0) {
+                double idle = chrono::duration<double>(
+                    chrono::steady_clock::now() - last).count();
+                if (_timeout > 0 && idle > _timeout)
+                    fail("No answer from the workers for " + to_string(idle) + " s");
+                continue;
+            }
+
+            // from the last, as the lost workers are removed
+            for (size_t k = _workers.size(); k-- > 0; ) {
+                if (fds[k + 1].revents == 0) continue;
+                uint32_t kind;
+                string p;
+                if (!recvMessage(_workers[k].fd, kind, p)) {
+                    lose(k);
+                    continue;
+                }
+                last = chrono::steady_clock::now();
+                if (kind == FAILED && p.size() >= sizeof(uint64_t))
+                    fail("Run " + to_string(_workers[k].run) + " failed on a worker: " +
+                         p.substr(sizeof(uint64_t)));
+                Result r;
+                if (kind != RESULT || p.size() < sizeof(r)) {
+                    lose(k);
+                    continue;
+                }
+                memcpy(&r, p.data(), sizeof(r));
+                if (int64_t(r.run) != _workers[k].run ||
+                    p.size() != sizeof(r) + r.count * sizeof(double)) {
+                    lose(k);
+                    continue;
+                }
+                vector<double> &v = results[r.run];
+                v.resize(size_t(r.count));
+                if (r.count > 0) memcpy(v.data(), p.data() + sizeof(r), p.size() - sizeof(r));
+                executed[r.run] = r.executed;
+                done[r.run] = true;
+                _workers[k].run = -1;
+            }
+            if (fds[0].revents & POLLIN) {
+                accept();
+                last = chrono::steady_clock::now();
+            }
+
+            // the values go to the stats in run order
+            while (next < runs && done[next]) {
+                try {
+                    collect(next, results[next], executed[next]);
+                } catch (...) {
+                    dropAll();
+                    throw;
+                }
+                vector<double>().swap(results[next]);
+                ++next;
+            }
+        }
+#else
+        throw Exc("Sockets are not available");
+#endif
+    }
+
+    RunWorker::RunWorker(const string &host, unsigned short port, double wait) :
+        _fd(-1)
+    {
+#ifdef METASIM_HAVE_SOCKETS
+        addrinfo hints;
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        auto until = chrono::steady_clock::now() + chrono::duration<double>(wait);
+        while (true) {
+            addrinfo *res = NULL;
+            if (getaddrinfo(host.c_str(), to_string(port).c_str(), &hints, &res) == 0) {
+                for (addrinfo *a = res; a != NULL && _fd < 0; a = a->ai_next) {
+                    _fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+                    if (_fd < 0) continue;
+                    if (connect(_fd, a->ai_addr, a->ai_addrlen) != 0) {
+                        close(_fd);
+                        _fd = -1;
+                    }
+                }
+                freeaddrinfo(res);
+            }
+            if (_fd >= 0) break;
+            if (chrono::steady_clock::now() >= until)
+                throw Exc("Cannot connect to " + host + ":" + to_string(port));
+            this_thread::sleep_for(chrono::milliseconds(100));
+        }
+        noDelay(_fd);
+#else
+        throw Exc("Sockets are not available");
+#endif
+    }
+
+    RunWorker::~RunWorker()
+    {
+#ifdef METASIM_HAVE_SOCKETS
+        if (_fd >= 0) close(_fd);
+#endif
+    }
+
+    size_t RunWorker::serve(const Simulation::ModelFactory &factory)
+    {
+        return serve([&factory](size_t) { return factory(); });
+    }
+
+    size_t RunWorker::serve(const PointFactory &factory)
+    {
+        size_t n = 0;
+#ifdef METASIM_HAVE_SOCKETS
+        uint32_t kind;
+        string p;
+        vector<double> values;
+        while (recvMessage(_fd, kind, p) && kind == JOB && p.size() >= sizeof(Job)) {
+            Job job;
+            memcpy(&job, p.data(), sizeof(job));
+            string answer;
+            try {
+                StateArchive a;
+                a.assign(p.data() + sizeof(job), p.size() - sizeof(job));
+                unique_ptr<RandomGen> gen = RandomVar::getDefaultGenerator().clone();
+                gen->restoreState(a);
+
+                Simulation::ReplicaSetup setup = { long(job.streamSeed),
+                                                   job.antithetic != 0,
+                                                   Tick(job.transitory) };
+                const size_t point = size_t(job.point);
+                Simulation::ModelFactory build = [&]() { return factory(point); };
+                Result r;
+                r.run = job.run;
+                r.executed = Simulation::runReplica(setup, Tick(job.endTick),
+                                                    size_t(job.run), size_t(job.streams),
+                                                    *gen, build, values, nullptr);
+                r.count = values.size();
+                answer.assign(reinterpret_cast<const char *>(&r), sizeof(r));
+                answer.append(reinterpret_cast<const char *>(values.data()),
+                              values.size() * sizeof(double));
+                kind = RESULT;
+            } catch (exception &e) {
+                answer.assign(reinterpret_cast<const char *>(&job.run), sizeof(job.run));
+                answer += e.what();
+                kind = FAILED;
+            } catch (...) {
+                answer.assign(reinterpret_cast<const char *>(&job.run), sizeof(job.run));
+                answer += "unknown exception";
+                kind = FAILED;
+            }
+            if (!sendMessage(_fd, kind, answer)) break;
+            ++n;
+        }
+#endif
+        return n;
+    }
+
+} // namespace MetaSim
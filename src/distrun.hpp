@@ -0,0 +1,183 @@
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef __DISTRUN_HPP__
+#define __DISTRUN_HPP__
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <baseexc.hpp>
+#include <simul.hpp>
+
+namespace MetaSim {
+
+    class RandomGen;
+
+    /**
+       \ingroup metasim_ee
+
+       The coordinator of distributed replications: it listens on a
+       TCP port for the worker processes (see RunWorker), which can
+       be on other nodes, and Simulation::run(Tick, int, RunServer &)
+       gives one run at a time to every connected worker. A run is
+       described by its index, its stream of the generator of the
+       coordinator and the settings of the substreams, so the
+       results do not depend on which worker performs it; a worker
+       sends back the values of the stats of its model instance,
+       which are collected in run order as soon as they arrive.
+
+       If a worker disconnects (it crashed, or its node is gone)
+       before sending the values of its run, the run is given to
+       another worker (see getReissued()). If the model throws an
+       exception in a worker, the run fails: all the workers are
+       disconnected and Simulation::run() throws RunServer::Exc.
+
+       The workers connected when a run() returns stay connected
+       for the next one, so a sweep over the points of a parameter
+       (see setPoint()) uses the same workers. The coordinator and
+       the workers must run the same program on the same
+       architecture: the messages are not converted.
+
+       @code
+       // coordinator
+       RunServer server(5000);
+       auto master = buildModel();
+       for (size_t p = 0; p < points; ++p) {
+           server.setPoint(p);
+           SIMUL.run(10000, 100, server);
+           ...
+       }
+
+       // on every node
+       RunWorker worker("coordinator", 5000, 60);
+       worker.serve([](size_t p) { return buildModel(rate[p]); });
+       @endcode
+    */
+    class RunServer {
+    public:
+        /**
+           \ingroup metasim_exc
+        */
+        class Exc : public BaseExc {
+        public:
+            Exc(const std::string &msg) :
+                BaseExc(msg, "RunServer", "distrun.hpp") {}
+        };
+
+        /// Listens on a port of all the interfaces (0: any free
+        /// port, see getPort())
+        explicit RunServer(unsigned short port = 0);
+
+        /// Stops the workers
+        ~RunServer();
+
+        /// The port of the server
+        inline unsigned short getPort() const { return _port; }
+
+        /// Number of connected workers
+        inline size_t getWorkers() const { return _workers.size(); }
+
+        /// Number of runs given again, after their worker was lost
+        inline size_t getReissued() const { return _reissued; }
+
+        /**
+           A run fails if no worker sends a message for this time,
+           in seconds (0, the default: waits forever, e.g. for the
+           first worker).
+        */
+        inline void setTimeout(double seconds) { _timeout = seconds; }
+
+        /// The point of the sweep given to the factory of the
+        /// workers (RunWorker::PointFactory), 0 by default
+        inline void setPoint(size_t p) { _point = p; }
+        inline size_t getPoint() const { return _point; }
+
+    private:
+        friend class Simulation;
+
+        /// Receives the values of run i, in run order
+        typedef std::function<void(size_t i, std::vector<double> &values,
+                                   uint64_t executed)> Collect;
+
+        /// Performs the runs [0, runs) of sim on the workers, with
+        /// the streams of the generator g
+        void dispatch(Simulation &sim, const RandomGen &g, Tick endTick,
+                      size_t runs, const Collect &collect);
+
+        void accept();
+        void drop(size_t k);
+        void dropAll();
+
+        struct Worker {
+            int fd;
+            int64_t run;        // -1: idle
+        };
+
+        int _fd;
+        unsigned short _port;
+        std::vector<Worker> _workers;
+        size_t _reissued;
+        double _timeout;
+        size_t _point;
+
+        RunServer(const RunServer &);
+        RunServer &operator=(const RunServer &);
+    };
+
+    /**
+       \ingroup metasim_ee
+
+       A worker process of distributed replications: it connects to
+       a RunServer and performs the runs it receives, each on a new
+       model instance built by the factory, in a new context (as
+       the parallel replications of Simulation::run()), until the
+       server stops it.
+    */
+    class RunWorker {
+    public:
+        /**
+           \ingroup metasim_exc
+        */
+        class Exc : public BaseExc {
+        public:
+            Exc(const std::string &msg) :
+                BaseExc(msg, "RunWorker", "distrun.hpp") {}
+        };
+
+        /// Builds the model of a point of a sweep (see
+        /// RunServer::setPoint())
+        typedef std::function<std::shared_ptr<void>(size_t point)> PointFactory;
+
+        /// Connects to the server, trying again for wait seconds
+        /// if it does not answer yet
+        RunWorker(const std::string &host, unsigned short port,
+                  double wait = 0);
+
+        ~RunWorker();
+
+        /// Performs runs until the server stops, or is lost;
+        /// returns the number of runs
+        size_t serve(const Simulation::ModelFactory &factory);
+
+        /// The same, with a model for every point of the sweep
+        size_t serve(const PointFactory &factory);
+
+    private:
+        int _fd;
+
+        RunWorker(const RunWorker &);
+        RunWorker &operator=(const RunWorker &);
+    };
+
+} // namespace MetaSim
+
+#endif
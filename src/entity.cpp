@@ -11,8 +11,13 @@
  *   (at your option) any later version.                                   *
  *                                                                         *
  ***************************************************************************/
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <exception>
+#include <thread>
 #include <typeinfo>
-#include <sstream>
+#include <vector>
 
 #include <entity.hpp>
 #include <simul.hpp>
@@ -22,95 +27,182 @@ namespace MetaSim {
 
     using namespace std;
 
-    map<int, Entity*> Entity::_globMap;
-    map<string, Entity *> Entity::_index;
-    int Entity::_IDcount = 0;
+    namespace {
+        // below this number of independent entities, starting the
+        // threads costs more than a serial newRun()
+        const size_t MIN_PARALLEL_NEWRUN = 64;
+        // consecutive entities given to a thread at once
+        const size_t NEWRUN_CHUNK = 256;
+    }
 
     void Entity::_init()
     {
-        if (_name == "") {
-            std::stringstream ss;
-            ss << _IDcount + 1;
-            _name = string(typeid(*this).name()) + ss.str();
-        }
-
-        if (_index.find(_name) != _index.end())
+        // only the entities with a name are in the index: the
+        // default names contain the ID (see _find())
+        if (_name != "" && _find(_name) != NULL)
             throw Exc("Creating an entity with the same name " + _name);
 
-        _IDcount++;
-        _ID = _IDcount;
-        _globMap[_ID] = this;
+        _ID = ++_ctx->_entityCount;
+        if (_ctx->_entities.empty()) _ctx->_entityBase = _ID - 1;
+        _ctx->_entities.resize(_ID - _ctx->_entityBase, NULL);
+        _ctx->_entities.back() = this;
 
         DBGENTER(_ENTITY_DBG_LEV);
 
         DBGPRINT_2("Entity ID: ", _ID);
-        DBGPRINT_2("Entity type: ",  typeid(*this).name());
         DBGPRINT_2("Entity name:", _name);
 
-        _index[_name] = this;
+        if (_name != "") _ctx->_entityIndex[_name] = this;
+    }
+
+    string Entity::defaultName() const
+    {
+        string n = string(typeid(*this).name()) + to_string(_ID);
+        // the default names are not in the index, and an entity
+        // may have been created with the same name
+        auto i = _ctx->_entityIndex.find(n);
+        if (i != _ctx->_entityIndex.end() && i->second != this)
+            throw Exc("The default name " + n + " is the name of another entity");
+        return n;
     }
 
-    Entity::Entity(const string &n) : _name(n) 
+    Entity::Entity(const string &n) :
+        _ctx(&SimContext::current()), _independent(false), _name(n) 
     {
         _init();
     }
 
     Entity::~Entity()
     {
-        _globMap.erase(_ID);
-        _index.erase(_name);
+        vector<Entity *> &v = _ctx->_entities;
+        v[_ID - _ctx->_entityBase - 1] = NULL;
+        while (!v.empty() && v.back() == NULL) v.pop_back();
+        auto i = _ctx->_entityIndex.find(_name);
+        if (i != _ctx->_entityIndex.end() && i->second == this)
+            _ctx->_entityIndex.erase(i);
     }
 
 
     Entity::Entity(const Entity &obj) :
-        _name("")
+        _ctx(&SimContext::current()),
+        _independent(obj._independent),
+        _name(obj.getName() + "_copy_" + to_string(_ctx->_entityCount + 1))
     {
-        std::stringstream ss;
-        ss << obj._name << "_copy_" << _IDcount + 1;
-        _name = ss.str();
         _init();
     }
     
+    void Entity::reserve(size_t n)
+    {
+        SimContext &c = SimContext::current();
+        c._entities.reserve(c._entities.size() + n);
+        c._entityIndex.reserve(c._entityIndex.size() + n);
+    }
 
-    void Entity::callNewRun()
+    void Entity::setNewRunThreads(unsigned n)
     {
-        typedef map<int, Entity*>::iterator EI;
+        if (n == 0) n = max(1u, thread::hardware_concurrency());
+        SimContext::current()._newRunThreads = n;
+    }
 
-        EI p = _globMap.begin();
+    void Entity::callNewRun()
+    {
+        SimContext &c = SimContext::current();
+        vector<Entity *> &v = c._entities;
+
+        // in order of ID; the entities cannot be created or
+        // destroyed by newRun(), so the vector does not change
+        vector<size_t> indep;
+        if (c._newRunThreads > 1)
+            for (size_t i = 0; i < v.size(); ++i)
+                if (v[i] != NULL && v[i]->_independent) indep.push_back(i);
+        if (indep.size() < MIN_PARALLEL_NEWRUN) {
+            for (Entity *e : v) {
+                if (e == NULL) continue;
+                DBGENTER(_ENTITY_DBG_LEV);
+                DBGPRINT_2("Calling the newRun() of ", e->getID());
+                e->newRun();
+            }
+            return;
+        }
 
-        while (p != _globMap.end()) {
+        // the independent entities first, in parallel, by chunks
+        // of consecutive ones; the posts are collected by chunk,
+        // with the end of the posts of every entity
+        const size_t nChunks = (indep.size() + NEWRUN_CHUNK - 1) / NEWRUN_CHUNK;
+        vector< vector<SimContext::DeferredOp> > posts(nChunks);
+        vector<size_t> ends(indep.size());
+        vector<exception_ptr> errors(nChunks);
+        atomic<size_t> next(0);
+        auto worker = [&]() {
+            SimContext::Scope s(c);
+            size_t ch;
+            while ((ch = next++) < nChunks) {
+                SimContext::_deferred = &posts[ch];
+                size_t last = min(indep.size(), (ch + 1) * NEWRUN_CHUNK);
+                try {
+                    for (size_t k = ch * NEWRUN_CHUNK; k < last; ++k) {
+                        v[indep[k]]->newRun();
+                        ends[k] = posts[ch].size();
+                    }
+                } catch (...) {
+                    errors[ch] = current_exception();
+                }
+            }
+            SimContext::_deferred = nullptr;
+        };
+        c._deferOps = true;
+        vector<thread> pool;
+        size_t nThreads = min<size_t>(c._newRunThreads, indep.size());
+        for (size_t i = 1; i < nThreads; ++i) pool.push_back(thread(worker));
+        worker();
+        for (auto &t : pool) t.join();
+        c._deferOps = false;
+        for (auto &e : errors)
+            if (e) rethrow_exception(e);
+
+        // then, in order of ID, their posts and the newRun() of
+        // the others
+        for (size_t i = 0, k = 0; i < v.size(); ++i) {
+            if (v[i] == NULL) continue;
+            if (k < indep.size() && indep[k] == i) {
+                const vector<SimContext::DeferredOp> &p = posts[k / NEWRUN_CHUNK];
+                for (size_t j = k % NEWRUN_CHUNK ? ends[k - 1] : 0; j < ends[k]; ++j)
+                    p[j].apply();
+                ++k;
+                continue;
+            }
             DBGENTER(_ENTITY_DBG_LEV);
-            DBGPRINT_2("Calling the newRun() of ",
-                       p->second->getID());
-            
-
-            p->second->newRun();
-            p++;
-        }           
+            DBGPRINT_2("Calling the newRun() of ", v[i]->getID());
+            v[i]->newRun();
+        }
     }
 
     void Entity::callEndRun()
     {
-        typedef map<int, Entity*>::iterator EI;
-
-        EI p = _globMap.begin();
-        while (p != _globMap.end()) {
-            p->second->endRun();
-            p++;
-        }
-                
-                
+        for (Entity *e : SimContext::current()._entities)
+            if (e != NULL) e->endRun();
     }
 
     Entity *Entity::_find(string n)
     {
-        Entity *res = 0;
- 
-        typedef map<string, Entity *>::iterator NI;
-
-        NI i = _index.find(n);
-        if (i != _index.end()) res = (*i).second;
-        return res;
+        unordered_map<string, Entity *> &m = SimContext::current()._entityIndex;
+        auto i = m.find(n);
+        if (i != m.end()) return i->second;
+
+        // a default name is the name of the class followed by the
+        // ID, and the name of the class may end with digits too:
+        // every split of the digits at the end is tried
+        size_t k = n.find_last_not_of("0123456789");
+        k = k == string::npos ? 0 : k + 1;
+        if (n.size() - k > 9) k = n.size() - 9;
+        for (; k < n.size(); ++k) {
+            if (n[k] == '0') continue;
+            Entity *e = getPointer(atoi(n.c_str() + k));
+            if (e == NULL || n.compare(0, k, typeid(*e).name()) != 0) continue;
+            // an entity with a name of its own is in the index
+            if (e->_name.empty() || e->_name == n) return e;
+        }
+        return NULL;
     }
 
 } // end namespace MetaSim
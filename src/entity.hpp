@@ -29,11 +29,13 @@
 #ifndef __ENTITY_HPP___
 #define __ENTITY_HPP___
 
-#include <map>
 #include <string>
+#include <vector>
 
 #include <baseexc.hpp>
 #include <basetype.hpp>
+#include <simcontext.hpp>
+#include <statearchive.hpp>
 
 namespace MetaSim {
 
@@ -69,26 +71,21 @@ namespace MetaSim {
         Entity(const Entity &);
 
     private:
-                /** 
-            It contains pairs <ID, pointer to entity>. It's
-            used mainly to keep track of all the entities
-            present in the system. */
-        static std::map<int , Entity *> _globMap;
-  
         /**
-           It contains pairs <string, pointer to entity>. It
-           is used to refer entities by name. The string must
-           be unique!! */
-        static std::map<std::string, Entity *> _index;
-        
-        /// counter for assigning unique IDs to entities
-        static int _IDcount;
-        
+           The simulation context of the entity. The registries
+           of all the entities (by ID and by name) are kept in the
+           context, see SimContext. */
+        SimContext *_ctx;
+
         /// unique ID for the entity
         int _ID;
+
+        /// newRun() can run in parallel with the others
+        bool _independent;
         
-        /// unique name for the entity
-        std::string _name;
+        /// unique name for the entity, generated by getName()
+        /// (and cached) for the entities created without a name
+        mutable std::string _name;
         
         /**
            \ingroup metasim_exc
@@ -106,6 +103,9 @@ namespace MetaSim {
            different constructors, Entity(char *) and
            Entity(string) */
         void _init();
+
+        /// The name of an entity created without a name
+        std::string defaultName() const;
         
     public:
         /** 
@@ -113,15 +113,21 @@ namespace MetaSim {
             
             @param n A (possibly unique) name for the entity:
             by default the entity name is set equal to the
-            typeid() + the entity ID. */
+            typeid() + the entity ID. The default name is only
+            generated when it is needed, by getName() or
+            _find(), so it is the name of the most derived class
+            and unnamed entities are cheap to create. A name
+            cannot be the one of another entity, given or default:
+            Exc from the constructor, or from getName() if the
+            default name was given to an entity before. */
         Entity(const std::string &n);
         
         /// Destructor
         virtual ~Entity();
         
         /** 
-            Obtains the pointer to the object from the ID.
-            Quite useful for debugging.
+            Obtains the pointer to the object from the ID, in the
+            current context. Quite useful for debugging.
             
             @param id the object ID.  
             
@@ -129,9 +135,10 @@ namespace MetaSim {
             to that ID, or NULL if it doesn't exist an object
             with that ID. */
         static inline Entity* getPointer(int id) {
-            std::map<int, Entity*>::const_iterator p = _globMap.find(id);
-            if (p == _globMap.end()) return NULL;
-            else return p->second;
+            const SimContext &c = SimContext::current();
+            size_t k = size_t(id - c._entityBase - 1);
+            if (id <= c._entityBase || k >= c._entities.size()) return NULL;
+            else return c._entities[k];
         };
         
         /** 
@@ -139,9 +146,17 @@ namespace MetaSim {
             spoecified name or NULL if such entity does not
             exists.  */
         static Entity * _find(std::string n);  
+
+        /**
+            Reserves the space for n more entities in the
+            registries of the current context. To be called
+            before creating a large number of entities, so that
+            the registries are allocated once.
+        */
+        static void reserve(size_t n);
         
         /** 
-            Calls newRun() on every entity in the system.  It is
+            Calls newRun() on every entity of the current context.  It is
             automatically called at the beginning of every run by the
             Simulation class. Not to be called by the user!!  In a
             future release will be hidden.
@@ -149,6 +164,32 @@ namespace MetaSim {
             @see callNewRun */
         static void callNewRun();
 
+        /**
+            Declares that the newRun() of this entity only reads
+            and writes the state of the entity, and posts its own
+            events: the newRun() of the independent entities can
+            then be called in parallel (see setNewRunThreads()).
+            Such a newRun() must not create events with
+            Event::create(), draw numbers from the default random
+            generator (a variable with its own substream, see
+            RandomVar::setStream(), is fine) or record statistics.
+            The posts (and the drops) are collected and applied to
+            the queue after all the newRun(), in order of ID, so
+            the events have the same order as with a serial
+            newRun().
+        */
+        inline void setIndependent(bool i = true) { _independent = i; }
+        inline bool isIndependent() const { return _independent; }
+
+        /**
+            Number of threads that call the newRun() of the
+            independent entities of the current context (0: one
+            per hardware thread; 1, the default: no parallel
+            newRun()). Worth it for many entities with an
+            expensive newRun() and short runs.
+        */
+        static void setNewRunThreads(unsigned n);
+
         /** 
             The same as callNewRun(), but it is called at the
             end of every run.
@@ -158,9 +199,16 @@ namespace MetaSim {
         
         /// Get the entity ID
         inline int getID() const { return _ID; }
+
+        /// Get the simulation context of the entity
+        inline SimContext &getContext() const { return *_ctx; }
         
-        ///Get the Entity name
-        inline std::string getName() const { return _name; }
+        /// Get the Entity name (Exc if the default name was given
+        /// to another entity, see Entity())
+        inline std::string getName() const {
+            if (_name.empty()) _name = defaultName();
+            return _name;
+        }
         
         /** 
             Resets the entity status at the beginning of every
@@ -179,6 +227,23 @@ namespace MetaSim {
             etc.)  Warning: in endRun() is not permitted to
             create/destroy new entity objects. */
         virtual void endRun() = 0;
+
+        /** 
+            Saves the state of the entity, so that it can be
+            restored after a rollback by the Time Warp engine
+            (see TimeWarpSimulation). It is called between two
+            events, and must save all the members that the event
+            handlers of the entity modify. The default
+            implementation saves nothing, which is correct only
+            for stateless entities.
+
+            @see restoreState */
+        virtual void saveState(StateArchive &a) const {}
+
+        /** 
+            Restores the state saved by saveState(), reading the
+            values in the same order. */
+        virtual void restoreState(StateArchive &a) {}
     };
 }
 
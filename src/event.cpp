@@ -17,124 +17,230 @@
 
 #include <entity.hpp>
 #include <event.hpp>
+#include <eventqueue.hpp>
+#include <profiler.hpp>
+#include <simcontext.hpp>
 #include <simul.hpp>
 
 namespace MetaSim {
-    /** ------------------------------------------------------------
-     * Initialize static members of class Event
-     * ------------------------------------------------------------
-     */
-    Event::EventQueue Event::_eventQueue;
-
-    long Event::counter = 0;
-
     /**
      * Constructor for Event. 
      */
     Event::Event(int p) :
-        _order(0),
-        _isInQueue(false),
-        _particles(),
+        _ctx(&SimContext::current()),
+        _key(),
         _time(MAXTICK),
         _lastTime(MAXTICK),
+        _order(0),
+        _qpos(0),
+        _particles(),
         _priority(p),
         _std_priority(p),
+        _poolId(-1),
+        _isInQueue(false),
+        _cancelled(false),
         _disposable(false)                
     {
     }
 
     Event::~Event()
     {
-        drop();
+        extract();
     }
 
     // Copy constructor
     Event::Event(const Event &e) :
-        _order(0),
-        _isInQueue(false),
-        _particles(),
+        _ctx(&SimContext::current()),
+        _key(),
         _time(MAXTICK),
         _lastTime(MAXTICK),
+        _order(0),
+        _qpos(0),
+        _particles(),
         _priority(e._priority),
         _std_priority(e._std_priority),
+        _poolId(-1),
+        _isInQueue(false),
+        _cancelled(false),
         _disposable(e._disposable)
     {
-        for (auto &p : e._particles) 
-            p->clone_to(*this);
+        if (e._particles)
+            for (auto &p : e._particles->slots)
+                p.particle->clone_to(*this);
     }
 
     
-    bool Event::Cmp::operator() (Event* e1, Event* e2) const {
-        Tick firstTime, secondTime;
-	
-        firstTime  = e1->getTime();
-        secondTime = e2->getTime();
-	
-        if (firstTime < secondTime) return true;
-        else if (firstTime == secondTime) {
-            if (e1->getPriority() < e2->getPriority()) return true;
-            else if (e1->getPriority() == e2->getPriority()) {
-                if (e1->_order < (unsigned long)e2->_order) 
-                    return true;
-                else return false;
-            }
-            else return false;
+    void Event::dispose()
+    {
+        if (_poolId < 0) {
+            delete this;
+            return;
         }
-        else return false;
+        SimContext *c = _ctx;
+        int id = _poolId;
+        void *p = dynamic_cast<void *>(this);
+        this->~Event();
+        c->freeEvent(id, p);
     }
-    
-    void Event::post(Tick myTime, bool disp) throw (Exc, BaseExc)
+
+    void Event::setEventQueue(const std::string &spec)
     {
+        SimContext::current().setEventQueue(spec);
+    }
+
+    void Event::updateKey()
+    {
+        // flipping the sign bit keeps the order of negative times
+        uint64_t t = uint64_t(int64_t(_time)) ^ (uint64_t(1) << 63);
+        uint64_t l = (uint64_t(_priority - MIN_PRIORITY) << 48) |
+            (uint64_t(_order) & ((uint64_t(1) << 48) - 1));
+#if defined(__SIZEOF_INT128__)
+        _key = (SortKey(t) << 64) | l;
+#else
+        _key = SortKey(t, l);
+#endif
+    }
+
+    unsigned long Event::nextOrder()
+    {
+        if (uint64_t(_ctx->_eventCounter) > MAX_ORDER)
+            throw Exc("Too many posts in a run: the order of the events "
+                      "would wrap around");
+        return _ctx->_eventCounter++;
+    }
+
+    void Event::post(Tick myTime, bool disp)
+    {
+        // posted from another context: the router decides (and
+        // the event must not be touched from here)
+        if (_ctx->_router != nullptr) {
+            SimContext &cur = SimContext::current();
+            if (&cur != _ctx) {
+                _ctx->_router->route(cur, this, myTime, disp);
+                return;
+            }
+        }
+
+        // from a parallel newRun() or step: inserted later, in
+        // order
+        if (_ctx->defer(SimContext::DeferredOp::POST, this, myTime, disp)) return;
+
         if (_isInQueue) {
             std::stringstream str;
-            str << "Time: " << SIMUL.getTime() 
+            str << "Time: " << _ctx->getSimulation().getTime() 
                 << " -- Event" 
                 << typeid(*this).name() << " already posted";
             throw Exc(str.str());
         }
 
-        if (myTime < SIMUL.getTime()) {
+        if (myTime < _ctx->getSimulation().getTime()) {
             std::stringstream str;
-            str << "Time: " << SIMUL.getTime() 
+            str << "Time: " << _ctx->getSimulation().getTime() 
                 << " -- Posting event" 
                 << typeid(*this).name() << " in the past at time: " 
                 << myTime;
             throw Exc(str.str());
         }
 
-        setTime(myTime);
-
-        _order = counter++;
-
-        std::pair<EventQueue::iterator,bool> p;
-        p =_eventQueue.insert(this);
-    
-        if (!p.second) {
+        if (_priority < MIN_PRIORITY || _priority > MAX_PRIORITY) {
             std::stringstream str;
-            str << "Time: " << SIMUL.getTime() 
+            str << "Time: " << _ctx->getSimulation().getTime() 
                 << " -- Posting event" 
-                << typeid(*this).name() << " Already in queue!, at time = " << myTime;
+                << typeid(*this).name() << " with priority out of range: " 
+                << _priority;
             throw Exc(str.str());
         }
 
+        if (_cancelled) {
+            // still in the queue: moved in place
+            _cancelled = false;
+            _ctx->getEventQueue().reschedule(this, myTime, nextOrder());
+        }
+        else {
+            setTime(myTime);
+
+            _order = nextOrder();
+            updateKey();
+
+            _ctx->getEventQueue().insert(this);
+        }
+
         _isInQueue = true;
         _disposable = disp;
 
+        if (_ctx->_profiler)
+            _ctx->_profiler->posted(this, _ctx->getEventQueue().size());
+
         DBGENTER(_EVENT_DBG_LEV);
         print();
         
     }
 
+    void Event::reschedule(Tick myTime)
+    {
+        if (_ctx->defer(SimContext::DeferredOp::RESCHEDULE, this, myTime)) return;
+
+        if (!_isInQueue) {
+            post(myTime, _disposable);
+            return;
+        }
+
+        if (myTime < _ctx->getSimulation().getTime()) {
+            std::stringstream str;
+            str << "Time: " << _ctx->getSimulation().getTime() 
+                << " -- Rescheduling event" 
+                << typeid(*this).name() << " in the past at time: " 
+                << myTime;
+            throw Exc(str.str());
+        }
+
+        _ctx->getEventQueue().reschedule(this, myTime, nextOrder());
+
+        if (_ctx->_profiler)
+            _ctx->_profiler->posted(this, _ctx->getEventQueue().size());
+
+        DBGENTER(_EVENT_DBG_LEV);
+        print();
+    }
+
     // erase the event from the event queue
     void Event::drop()
     {
         DBGENTER(_EVENT_DBG_LEV);
         print();
         
-        _eventQueue.erase(this);
+        if (_ctx->defer(SimContext::DeferredOp::DROP, this)) return;
+
+        if (_isInQueue) {
+            _ctx->getEventQueue().erase(this);
+            if (_ctx->_profiler) _ctx->_profiler->dropped(this);
+        }
+        else if (_cancelled) _ctx->getEventQueue().erase(this);
         _isInQueue = false;
+        _cancelled = false;
     };
 
+    void Event::cancelLazy()
+    {
+        DBGENTER(_EVENT_DBG_LEV);
+        print();
+
+        if (_ctx->defer(SimContext::DeferredOp::CANCEL, this)) return;
+
+        if (_isInQueue) {
+            _isInQueue = false;
+            _cancelled = true;
+            if (_ctx->_profiler) _ctx->_profiler->dropped(this);
+        }
+    }
+
+    void Event::extract()
+    {
+        if (_isInQueue || _cancelled) _ctx->getEventQueue().erase(this);
+        _isInQueue = false;
+        _cancelled = false;
+    }
+
 
     void Event::process(bool disp)
     {
@@ -142,12 +248,12 @@ namespace MetaSim {
         drop();
         print();
         setPriority(_IMMEDIATE_PRIORITY);
-        post(SIMUL.getTime(), disp);
+        post(_ctx->getSimulation().getTime(), disp);
     }
 
     // Function to set the event time 
     // (only if the event is not in any queue).
-    void Event::setTime(Tick actTime) throw(Exc)
+    void Event::setTime(Tick actTime)
     {
         if (_isInQueue)
             throw Exc("Cannot set the time if the event is already queued\n");
@@ -167,6 +273,12 @@ namespace MetaSim {
         // restore old priority
         restorePriority();
 
+        // the profiler measures doit() and the probes
+        if (_ctx->_profiler) {
+            _ctx->_profiler->execute(this);
+            return;
+        }
+
         // the doit(), probe() and record() could raise
         // arbitrary exception...  hence, I can't specify the
         // exception type in the interface!
@@ -176,14 +288,26 @@ namespace MetaSim {
         // for(its = _stats.begin(); its != _stats.end(); its++)
         //     (*its)->probe(this);
 
+        runProbes();
+    }
+
+    void Event::runProbes()
+    {
         // the new way of doing statistics. The old way
         // remains valid, but it is deprecated.
+        if (!_particles) return;
+        // the stats discard the samples of the transitory: their
+        // particles are not called until it is over (see
+        // Simulation::initSingleRun())
+        const bool gate = _ctx->_gateProbes;
+        if (gate && _particles->ungated == 0) return;
         DBGPRINT_2("Calling the particle probes, size = ", 
-                   _particles.size());
-        for (auto itp = _particles.begin(); itp != _particles.end(); itp++) {
+                   _particles->slots.size());
+        for (auto &p : _particles->slots) {
+            if (gate && p.gated) continue;
             DBGPRINT("Calling probe");
-            (*itp)->probe();
-        } 
+            p.particle->probe();
+        }
     }
 
     // DEBUG!!! Prints events data on the dbg stream.
@@ -198,8 +322,14 @@ namespace MetaSim {
     {
         DBGENTER(_EVENT_DBG_LEV);
         DBGPRINT_2("Event name ", typeid(*this).name());
-        _particles.push_back(std::move(s));
-        DBGPRINT_2("size is now: ", _particles.size());
+        if (!_particles) {
+            _particles.reset(new Particles());
+            _particles->ungated = 0;
+        }
+        const bool gated = s->gated();
+        if (!gated) ++_particles->ungated;
+        _particles->slots.push_back(ParticleSlot{ std::move(s), gated });
+        DBGPRINT_2("size is now: ", _particles->slots.size());
     }
 
 } // namespace MetaSim 
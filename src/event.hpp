@@ -1,16 +1,20 @@
 #ifndef __EVENT_HPP__
 #define __EVENT_HPP__
 
-#include <deque>
 #include <iostream>
 #include <limits>
+#include <new>
 #include <typeinfo>
 #include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 #include <simul.hpp>
 #include <basestat.hpp>
+#include <eventqueue.hpp>
 #include <particle.hpp>
-#include <plist.hpp>
+#include <simcontext.hpp>
 #include <trace.hpp>
 
 
@@ -30,8 +34,10 @@ namespace MetaSim {
         need to derive a class from this, overriding the virtual
         doit() method.
 
-        This class also inclides a static qevent queue, where all
-        "active" events are enqueued. To insert an event in the
+        Every event belongs to a simulation context (see
+        SimContext), which includes the event queue where all
+        "active" events are enqueued (see EventQueue for the
+        available implementations). To insert an event in the
         queue, you can call the post() method specyfing a
         triggering time. Events are ordered in the queue by
         triggering time. In case of two events with the same
@@ -78,47 +84,69 @@ namespace MetaSim {
                 : BaseExc(message,cl,md) {} ;
         };
   
-    private:
+    public:
         /**
            Template specialization for less function
            object. It is used to order the event in the event
            queue. Events are ordered by triggering time, and
            in case of tie, by priority. In case of another
-           tie, event objects are ordered by pointer
-           value. This is because the implementation of the
-           priority queue does not allows ties. If you try to
-           insert an event object twice, you get an exception!
+           tie, event objects are ordered by insertion order
+           (FIFO).  All the implementations of EventQueue use
+           this order.
         */
         class Cmp {
         public:
-            bool operator() (Event* e1, Event* e2) const;
+            inline bool operator() (const Event* e1, const Event* e2) const {
+                return e1->_key < e2->_key;
+            }
         };
-                
-        typedef priority_list<Event*, Cmp> EventQueue;
-  
-        /**
-           Event queue. This is the global event queue, used
-           by the simulation engine.
-        */ 
-        static EventQueue _eventQueue;
 
         /**
-           counter for fifo insertion
+           Sorting key of an event. It packs, in this order of
+           significance, the triggering time (64 bits), the
+           priority (16 bits) and the insertion order (48 bits),
+           so that Cmp is a single integer comparison. If the
+           compiler does not provide a 128 bits integer, a pair
+           of 64 bits integers is used instead.
         */
-        static long counter;
+#if defined(__SIZEOF_INT128__)
+        __extension__ typedef unsigned __int128 SortKey;
+#else
+        struct SortKey {
+            uint64_t hi, lo;
+            SortKey(uint64_t h = 0, uint64_t l = 0) : hi(h), lo(l) {}
+            inline bool operator<(const SortKey &k) const {
+                return hi < k.hi || (hi == k.hi && lo < k.lo);
+            }
+        };
+#endif
 
+    private:
         /**
-           number of fifo insertion
+           The simulation context this event belongs to: the
+           event is always posted in the event queue of this
+           context. It is the current context at construction
+           time (see SimContext).
+        */
+        SimContext *_ctx;
+
+        friend class Checkpoint;
+        friend class EventQueue;
+        friend class Profiler;
+        friend class SimContext;
+        friend class Simulation;
+        friend class TimeWarpSimulation;
+
+        /*
+          The fields are sorted by size, so that there is no padding
+          between them: the events are the most numerous objects of
+          a simulation, and their size is tracked by the benchmarks
+          (see bench/microbench.cpp).
         */
-        unsigned long _order; 
-  
-        /// Tells if the element is in the event queue;
-        bool _isInQueue;
-  
-        /// A queue of all the statistical object. All these
-        /// objects will be "invoked" after the event handler
-        /// (doit()) has been processed.  
-        std::deque<std::unique_ptr<ParticleInterface> > _particles;
+
+        /// Sorting key, computed by updateKey() when the event is
+        /// posted.
+        SortKey _key;
 
         /// Triggering time of the event.
         Tick _time;
@@ -128,6 +156,34 @@ namespace MetaSim {
         /// traces and statistics.
         Tick _lastTime;
 
+        /**
+           number of fifo insertion
+        */
+        unsigned long _order; 
+
+        /// Position of the event inside the event queue, managed
+        /// by the queue implementation (see EventQueue::handle()).
+        size_t _qpos;
+
+        struct ParticleSlot {
+            std::unique_ptr<ParticleInterface> particle;
+            bool gated;         // see ParticleInterface::gated()
+        };
+
+        struct Particles {
+            std::vector<ParticleSlot> slots;
+            // the particles called during the transitory
+            size_t ungated;
+        };
+
+        /// A queue of all the statistical object. All these
+        /// objects will be "invoked" after the event handler
+        /// (doit()) has been processed. It is allocated when
+        /// the first particle is added, and it is null for the
+        /// events without particles. During the transitory, only
+        /// the particles that are not gated are invoked.
+        std::unique_ptr<Particles> _particles;
+
         /** 
             Event priority. This is used to give an order to
             events with the same time, in the event queue. We
@@ -139,18 +195,46 @@ namespace MetaSim {
         int _priority;
 
         int _std_priority;
-	
+
+        /// Identifier of the EventPool the event has been
+        /// allocated from, or -1 if it was not created with
+        /// create<T>().
+        int _poolId;
+
+        /// Tells if the element is in the event queue;
+        bool _isInQueue : 1;
+
+        /// Tells if the event has been cancelled by cancelLazy()
+        /// and it is still physically in the event queue (a
+        /// tombstone).
+        bool _cancelled : 1;
+
         /// We hide operator= to avoid improper use.
         Event& operator=(Event &);
+
+        /// Removes the event from the queue, like drop(), but it
+        /// is not counted as a drop by the Profiler. Used by the
+        /// engine to extract the event to process.
+        void extract();
+
+        /// Calls the probes of all the particles
+        void runProbes();
     protected:
         /// Indicates if the event has to be destroyed after
         /// bein processed. Normally, this flag is set to
         /// false.
-        bool _disposable;
+        bool _disposable : 1;
 
         /// Checks that the event is not queued, and set the
         /// _time field;
-        void setTime(Tick actTime) throw(Exc);
+        void setTime(Tick actTime);
+
+        /// Computes _key from _time, _priority and _order.
+        void updateKey();
+
+        /// The order of the next post of the context (Exc past
+        /// MAX_ORDER)
+        unsigned long nextOrder();
 
         /** 
             Copy constructor. This is defined to allow dynamic
@@ -162,9 +246,20 @@ namespace MetaSim {
     public:
         /**
            The default priority for an event is 8. The lower
-           this number the higher the priority.  */
+           this number the higher the priority. Priorities must be
+           in the range [MIN_PRIORITY, MAX_PRIORITY].  */
         static const int _DEFAULT_PRIORITY = 8;
         static const int _IMMEDIATE_PRIORITY = 0;
+        static const int MIN_PRIORITY = -32768;
+        static const int MAX_PRIORITY = 32767;
+        /**
+           The events of equal time and priority are executed in
+           the order of their posts. The order is kept in 48 bits
+           of the key: a run can post or reschedule up to
+           MAX_ORDER events, then post() and reschedule() throw
+           Exc. The count restarts at every run (see
+           Simulation::clearEventQueue()). */
+        static const uint64_t MAX_ORDER = (uint64_t(1) << 48) - 1;
 
         /** 
             Contructor.
@@ -176,6 +271,46 @@ namespace MetaSim {
         /// Destructor.
         virtual ~Event();
 
+        /**
+           Creates an event of type T, passing args to its
+           constructor, in the memory pool of the current context
+           (see EventPool). This is much cheaper than new, and it
+           is the preferred way of creating disposable events:
+
+           @code
+           Event::create<MyEvent>(arg1, arg2)->post(t, true);
+           @endcode
+
+           An event created in this way must never be deleted:
+           when posted as disposable the engine recycles it after
+           processing it; otherwise, call dispose().
+        */
+        template <class T, class... Args>
+        static T *create(Args&&... args) {
+            static_assert(std::is_base_of<Event, T>::value, 
+                          "Event::create<T>: T must derive from Event");
+            SimContext &c = SimContext::current();
+            int id = EventPool::typeId<T>();
+            void *p = c.allocEvent(id, sizeof(T));
+            T *e;
+            try {
+                e = new (p) T(std::forward<Args>(args)...);
+            } catch (...) {
+                c.freeEvent(id, p);
+                throw;
+            }
+            e->_poolId = id;
+            return e;
+        }
+
+        /**
+           Destroys a dynamically created event: it gives the
+           memory back to its pool if the event was created with
+           create<T>(), otherwise it deletes it. The engine calls
+           it on disposable events after processing them.
+        */
+        void dispose();
+
         /** 
             Inserts the event into the event queue. If the
             event is already in the event queue, an exception
@@ -193,17 +328,32 @@ namespace MetaSim {
 
             Warning!!  Never set disp = true for a statically
             declared event (i.e., an event that was not
-            created with new) unless you want a good old core
-            dump.
+            created with new or create<T>()) unless you want a
+            good old core dump.
      
             @param myTime triggering time for the event.
             @param disp set it to true if the event object
             must be disposed.
         */
-        void post(Tick myTime, bool disp = false) throw(Exc, BaseExc);
+        void post(Tick myTime, bool disp = false);
 
         /**
-           Processes the event immediately. 
+           Moves the event to time myTime. If the event is
+           already in the queue, this is equivalent to drop()
+           followed by post(), but the queue updates the position
+           of the event in place when possible, without searching
+           it and without allocating memory. Otherwise, it is
+           equivalent to post(myTime). The disposable flag is left
+           unchanged.
+        */
+        void reschedule(Tick myTime);
+
+        /**
+           Processes the event immediately, after the events of the
+           current time with a higher priority: it is posted now
+           with _IMMEDIATE_PRIORITY (in a FIFO lane of the queue,
+           without ordering it, if the context has the
+           ImmediateLanes).
         */
         void process(bool disp=false);
 
@@ -214,6 +364,24 @@ namespace MetaSim {
         */
         void drop();
 
+        /**
+           Cancels the event like drop(), in constant time: the
+           event is only marked as cancelled (a tombstone), and
+           it stays in the queue until it reaches the head, where
+           the engine discards it without processing it. If the
+           event is posted again before that, it is moved in place,
+           as with reschedule(). This is the cheapest way to handle
+           timers that are frequently cancelled and re-armed, such
+           as timeouts and backoff timers.
+
+           After cancelLazy() the event is not pending (see
+           isInQueue()), but it must not be destroyed by the
+           engine: as for drop(), a disposable event is not
+           recycled. The number of tombstones discarded is
+           returned by SimContext::getSkippedTombstones().
+        */
+        void cancelLazy();
+
         /** 
             Returns the first event in the event queue.  This
             function is used by the main simulation engine and
@@ -221,12 +389,27 @@ namespace MetaSim {
             object. The event is not extracted from the queue
         */
         static inline Event *getFirst() {
-            if (_eventQueue.empty()) 
-                return NULL;
-            else
-                return _eventQueue.front();
+            return SimContext::current().firstEvent();
+        }
+
+        /**
+            Returns the event queue of the current context,
+            creating the default implementation if needed.
+        */
+        static inline EventQueue &getEventQueue() {
+            return SimContext::current().getEventQueue();
         }
 
+        /**
+            Changes the implementation of the event queue of the
+            current context. The specification is one of the names
+            described in EventQueue, e.g. "heap(4)",
+            "calendar", "ladder" or "set". Events already in
+            the queue are moved into the new one, so it can be
+            called at any time outside of the event handlers.
+        */
+        static void setEventQueue(const std::string &spec);
+
         /** 
             Returns the event priority.  It is a identifier
             for the event priority. In the old version, events
@@ -238,7 +421,8 @@ namespace MetaSim {
         /** 
             Set the event priority.  It is a identifier for
             the event priority. The lower the number, the
-            higher the priority.
+            higher the priority. The new priority is used the next
+            time the event is posted.
         */
         inline void setPriority(int p) { _priority = p;};
 
@@ -288,8 +472,13 @@ namespace MetaSim {
         inline bool isDisposable() {return _disposable;};  
 
 
+        /// Tells if the event is pending, i.e. posted and not
+        /// dropped or cancelled.
         inline bool isInQueue() { return _isInQueue; }
 
+        /// Returns the simulation context of the event.
+        inline SimContext &getContext() const { return *_ctx; }
+
         /** 
             Add a new particle to this event.  This is the new
             way to add statistics and traces to this object.
@@ -316,6 +505,19 @@ namespace MetaSim {
            method is called from the action() method.  */
         virtual void doit() = 0; 
 
+        /**
+           The object the event acts on (e.g. the entity of a
+           GEvent), or NULL: the queues that keep the pending
+           events of every object together (see TwoLevelQueue)
+           group the events by owner. It must not change while
+           the event is queued.
+        */
+        virtual const void *getOwner() const { return NULL; }
+
+        /// The entity the event acts on, or NULL (used to label
+        /// the event, e.g. in a Timeline)
+        virtual const Entity *getEntity() const { return NULL; }
+
         /**
            for debugging.
         */
@@ -325,16 +527,27 @@ namespace MetaSim {
             for debugging
         */
         static void printQueue() {
-            EventQueue::iterator it;
-    
-            for (it = _eventQueue.begin(); 
-                 it != _eventQueue.end(); 
-                 it++) 
-                (*it)->print();
+            std::vector<Event *> v;
+            getEventQueue().dump(v);
+            for (size_t i = 0; i < v.size(); ++i) 
+                v[i]->print();
         }
 
     };
 
+    inline Event *SimContext::firstEvent()
+    {
+        EventQueue &q = getEventQueue();
+        Event *e = q.front();
+        while (e != NULL && e->_cancelled) {
+            q.erase(e);
+            e->_cancelled = false;
+            ++_tombstones;
+            e = q.front();
+        }
+        return e;
+    }
+
 }
 
 #endif
@@ -0,0 +1,79 @@
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#include <algorithm>
+#include <atomic>
+
+#include <eventpool.hpp>
+
+namespace MetaSim {
+
+    using namespace std;
+
+    namespace {
+        const size_t ALIGN = alignof(max_align_t);
+    }
+
+    EventPool::EventPool(size_t size, size_t chunkBlocks) :
+        _blockSize((max(size, sizeof(void *)) + ALIGN - 1) / ALIGN * ALIGN),
+        _chunkBlocks(chunkBlocks),
+        _chunks(),
+        _free(nullptr),
+        _live(0)
+    {
+    }
+
+    // puts all the blocks of a chunk in the free list, so that
+    // they are allocated in address order
+    void EventPool::pushChunk(char *c)
+    {
+        for (size_t i = _chunkBlocks; i-- > 0; ) {
+            void *b = c + i * _blockSize;
+            *static_cast<void **>(b) = _free;
+            _free = b;
+        }
+    }
+
+    void EventPool::grow()
+    {
+        _chunks.push_back(unique_ptr<char[]>(new char[_blockSize * _chunkBlocks]));
+        pushChunk(_chunks.back().get());
+    }
+
+    void *EventPool::allocate()
+    {
+        if (_free == nullptr) grow();
+        void *b = _free;
+        _free = *static_cast<void **>(b);
+        ++_live;
+        return b;
+    }
+
+    void EventPool::release(void *p)
+    {
+        *static_cast<void **>(p) = _free;
+        _free = p;
+        --_live;
+    }
+
+    bool EventPool::reset()
+    {
+        if (_live != 0) return false;
+        _free = nullptr;
+        for (size_t k = _chunks.size(); k-- > 0; ) 
+            pushChunk(_chunks[k].get());
+        return true;
+    }
+
+    int EventPool::newId()
+    {
+        static atomic<int> counter(0);
+        return counter++;
+    }
+
+} // namespace MetaSim
@@ -0,0 +1,76 @@
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef __EVENTPOOL_HPP__
+#define __EVENTPOOL_HPP__
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+namespace MetaSim {
+
+    /**
+       \ingroup metasim_ee
+
+       A pool of memory blocks of the same size, used to allocate
+       the events created with Event::create<T>(). There is one pool
+       for every event type in every SimContext. Memory is taken
+       from the system in chunks of many blocks, and the blocks of
+       the destroyed events are kept in a free list, so that in the
+       steady state a disposable event costs no system allocation
+       at all.
+    */
+    class EventPool {
+        size_t _blockSize;
+        size_t _chunkBlocks;
+        std::vector<std::unique_ptr<char[]> > _chunks;
+        // free list, linked through the free blocks
+        void *_free;
+        size_t _live;
+
+        void pushChunk(char *c);
+        void grow();
+    public:
+        /// Creates a pool of blocks of (at least) size bytes
+        explicit EventPool(size_t size, size_t chunkBlocks = 64);
+        
+        /// Returns a free block
+        void *allocate();
+
+        /// Gives back a block obtained with allocate()
+        void release(void *p);
+
+        /// Number of blocks currently allocated
+        inline size_t live() const { return _live; }
+
+        /// Number of blocks (allocated or free) in the pool
+        inline size_t capacity() const { return _chunks.size() * _chunkBlocks; }
+
+        /**
+           If no block is allocated, rebuilds the free list in
+           address order, so that the next run allocates events
+           sequentially in memory, and returns true. Otherwise it
+           does nothing and returns false.
+        */
+        bool reset();
+
+        /// Returns a new identifier for a pool
+        static int newId();
+
+        /// The pool identifier of the events of type T
+        template <class T>
+        static int typeId() {
+            static const int id = newId();
+            return id;
+        }
+    };
+
+} // namespace MetaSim
+
+#endif
@@ -0,0 +1,990 @@
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#include <algorithm>
+#include <cstdlib>
+#include <limits>
+
+#include <event.hpp>
+#include <eventqueue.hpp>
+#include <factory.hpp>
+#include <plist.hpp>
+#include <strtoken.hpp>
+
+namespace MetaSim {
+
+    using namespace std;
+    using namespace parse_util;
+
+    namespace {
+        inline int64_t evtTime(const Event *e)
+        {
+            return int64_t(e->getTime());
+        }
+
+        const Event::Cmp cmp = Event::Cmp();
+    }
+
+    unique_ptr<EventQueue> EventQueue::create(const string &spec)
+    {
+        string token = remove_spaces(get_token(spec));
+        vector<string> parms = split_param(get_param(spec));
+
+        unique_ptr<EventQueue> q(FACT(EventQueue).create(token, parms));
+        if (q.get() == nullptr) throw ParseExc("EventQueue::create", spec);
+
+        return q;
+    }
+
+    void EventQueue::reschedule(Event *e, Tick t, unsigned long order)
+    {
+        erase(e);
+        setKey(e, t, order);
+        insert(e);
+    }
+
+    void EventQueue::drain(vector<Event *> &v)
+    {
+        vector<Event *> d;
+        dump(d);
+        v.insert(v.end(), d.begin(), d.end());
+        clear();
+    }
+
+    size_t &EventQueue::handle(Event *e)
+    {
+        return e->_qpos;
+    }
+
+    void EventQueue::setKey(Event *e, Tick t, unsigned long order)
+    {
+        e->_time = t;
+        e->_order = order;
+        e->updateKey();
+    }
+
+    /*-----------------------------------------------------*/
+
+    class SetQueue::Impl : public priority_list<Event *, Event::Cmp> {};
+
+    SetQueue::SetQueue() : _impl(new Impl())
+    {
+    }
+
+    SetQueue::~SetQueue()
+    {
+    }
+
+    unique_ptr<SetQueue> SetQueue::createInstance(vector<string> &par)
+    {
+        if (par.size() != 0)
+            throw ParseExc("Wrong number of parameters", "SetQueue");
+        return unique_ptr<SetQueue>(new SetQueue());
+    }
+
+    void SetQueue::insert(Event *e) { _impl->insert(e); }
+
+    void SetQueue::erase(Event *e) { _impl->erase(e); }
+
+    Event *SetQueue::front()
+    {
+        if (_impl->empty()) return NULL;
+        return _impl->front();
+    }
+
+    bool SetQueue::empty() const { return _impl->size() == 0; }
+
+    size_t SetQueue::size() const { return _impl->size(); }
+
+    void SetQueue::clear() { _impl->clear(); }
+
+    void SetQueue::dump(vector<Event *> &v) const
+    {
+        v.assign(_impl->begin(), _impl->end());
+    }
+
+    void SetQueue::drain(vector<Event *> &v)
+    {
+        v.insert(v.end(), _impl->begin(), _impl->end());
+        _impl->clear();
+    }
+
+    /*-----------------------------------------------------*/
+
+    template <unsigned D>
+    void DaryHeapQueue<D>::siftUp(size_t i)
+    {
+        Event *e = _heap[i];
+        while (i > 0) {
+            size_t p = (i - 1) / D;
+            if (!cmp(e, _heap[p])) break;
+            place(i, _heap[p]);
+            i = p;
+        }
+        place(i, e);
+    }
+
+    template <unsigned D>
+    void DaryHeapQueue<D>::siftDown(size_t i)
+    {
+        Event *e = _heap[i];
+        size_t n = _heap.size();
+        while (true) {
+            size_t c = D * i + 1;
+            if (c >= n) break;
+            size_t last = std::min(c + D, n);
+            size_t best = c;
+            for (size_t k = c + 1; k < last; ++k)
+                if (cmp(_heap[k], _heap[best])) best = k;
+            if (!cmp(_heap[best], e)) break;
+            place(i, _heap[best]);
+            i = best;
+        }
+        place(i, e);
+    }
+
+    template <unsigned D>
+    void DaryHeapQueue<D>::removeAt(size_t i)
+    {
+        Event *last = _heap.back();
+        _heap.pop_back();
+        if (i == _heap.size()) return;
+        place(i, last);
+        if (i > 0 && cmp(last, _heap[(i - 1) / D])) siftUp(i);
+        else siftDown(i);
+    }
+
+    template <unsigned D>
+    bool DaryHeapQueue<D>::contains(Event *e)
+    {
+        size_t i = handle(e);
+        return i < _heap.size() && _heap[i] == e;
+    }
+
+    template <unsigned D>
+    void DaryHeapQueue<D>::insert(Event *e)
+    {
+        _heap.push_back(e);
+        siftUp(_heap.size() - 1);
+    }
+
+    template <unsigned D>
+    void DaryHeapQueue<D>::erase(Event *e)
+    {
+        if (contains(e)) removeAt(handle(e));
+    }
+
+    template <unsigned D>
+    void DaryHeapQueue<D>::reschedule(Event *e, Tick t, unsigned long order)
+    {
+        if (!contains(e)) {
+            EventQueue::reschedule(e, t, order);
+            return;
+        }
+        size_t i = handle(e);
+        setKey(e, t, order);
+        if (i > 0 && cmp(e, _heap[(i - 1) / D])) siftUp(i);
+        else siftDown(i);
+    }
+
+    template <unsigned D>
+    void DaryHeapQueue<D>::dump(vector<Event *> &v) const
+    {
+        v = _heap;
+        sort(v.begin(), v.end(), cmp);
+    }
+
+    template <unsigned D>
+    void DaryHeapQueue<D>::drain(vector<Event *> &v)
+    {
+        v.insert(v.end(), _heap.begin(), _heap.end());
+        _heap.clear();
+    }
+
+    template class DaryHeapQueue<2>;
+    template class DaryHeapQueue<4>;
+    template class DaryHeapQueue<8>;
+
+    unique_ptr<EventQueue> HeapQueue::createInstance(vector<string> &par)
+    {
+        if (par.size() > 1)
+            throw ParseExc("Wrong number of parameters", "HeapQueue");
+
+        int d = par.empty() ? 4 : atoi(par[0].c_str());
+        switch (d) {
+        case 2: return unique_ptr<EventQueue>(new DaryHeapQueue<2>());
+        case 4: return unique_ptr<EventQueue>(new DaryHeapQueue<4>());
+        case 8: return unique_ptr<EventQueue>(new DaryHeapQueue<8>());
+        default:
+            throw ParseExc("HeapQueue arity", par[0]);
+        }
+    }
+
+    /*-----------------------------------------------------*/
+
+    CalendarQueue::CalendarQueue(size_t nbuckets, int64_t width) :
+        _buckets(),
+        _width(width < 1 ? 1 : width),
+        _curVB(0),
+        _size(0),
+        _first(NULL)
+    {
+        // the number of buckets is always a power of 2
+        size_t nb = 2;
+        while (nb < nbuckets) nb *= 2;
+        _buckets.resize(nb);
+    }
+
+    unique_ptr<CalendarQueue> CalendarQueue::createInstance(vector<string> &par)
+    {
+        if (par.size() > 2)
+            throw ParseExc("Wrong number of parameters", "CalendarQueue");
+
+        size_t nb = par.size() > 0 ? atol(par[0].c_str()) : 2;
+        int64_t w = par.size() > 1 ? atoll(par[1].c_str()) : 1;
+        return unique_ptr<CalendarQueue>(new CalendarQueue(nb, w));
+    }
+
+    int64_t CalendarQueue::vbucket(Event *e) const
+    {
+        int64_t t = evtTime(e);
+        if (t >= 0) return t / _width;
+        else return -((-(t + 1)) / _width) - 1;
+    }
+
+    // buckets are sorted in descending order, so that the first
+    // event of a bucket can be extracted with a pop_back()
+    void CalendarQueue::bucketInsert(Bucket &b, Event *e)
+    {
+        Bucket::iterator i = lower_bound(b.begin(), b.end(), e,
+                                         [](Event *a, Event *x) { return cmp(x, a); });
+        b.insert(i, e);
+    }
+
+    void CalendarQueue::insert(Event *e)
+    {
+        int64_t vb = vbucket(e);
+        if (_size == 0 || vb < _curVB) _curVB = vb;
+
+        size_t i = size_t(uint64_t(vb) & (_buckets.size() - 1));
+        bucketInsert(_buckets[i], e);
+        ++_size;
+
+        if (_first != NULL && cmp(e, _first)) _first = e;
+
+        if (_size > 2 * _buckets.size())
+            resize(2 * _buckets.size());
+    }
+
+    void CalendarQueue::erase(Event *e)
+    {
+        if (_size == 0) return;
+
+        int64_t vb = vbucket(e);
+        Bucket &b = _buckets[size_t(uint64_t(vb) & (_buckets.size() - 1))];
+
+        if (!b.empty() && b.back() == e) b.pop_back();
+        else {
+            Bucket::iterator i = find(b.begin(), b.end(), e);
+            if (i == b.end()) return;
+            b.erase(i);
+        }
+        --_size;
+
+        if (e == _first) {
+            // all remaining events come after the first one
+            _first = NULL;
+            _curVB = vb;
+        }
+
+        if (_buckets.size() > 2 && _size < _buckets.size() / 2)
+            resize(_buckets.size() / 2);
+    }
+
+    void CalendarQueue::locateFirst()
+    {
+        size_t n = _buckets.size();
+
+        // scan one year, starting from the current day
+        for (size_t step = 0; step < n; ++step) {
+            if (_curVB > numeric_limits<int64_t>::max() - int64_t(step)) break;
+            int64_t vb = _curVB + int64_t(step);
+            size_t i = size_t(uint64_t(vb) & (n - 1));
+            Bucket &b = _buckets[i];
+            if (!b.empty() && vbucket(b.back()) == vb) {
+                _curVB = vb;
+                _first = b.back();
+                return;
+            }
+        }
+
+        // nothing found in this year: direct search of the minimum
+        Event *best = NULL;
+        for (size_t i = 0; i < n; ++i) {
+            if (!_buckets[i].empty() && (best == NULL || cmp(_buckets[i].back(), best)))
+                best = _buckets[i].back();
+        }
+        _first = best;
+        if (best != NULL) _curVB = vbucket(best);
+    }
+
+    Event *CalendarQueue::front()
+    {
+        if (_size == 0) return NULL;
+        if (_first == NULL) locateFirst();
+        return _first;
+    }
+
+    void CalendarQueue::resize(size_t nb)
+    {
+        vector<Event *> all;
+        all.reserve(_size);
+        for (size_t i = 0; i < _buckets.size(); ++i)
+            all.insert(all.end(), _buckets[i].begin(), _buckets[i].end());
+
+        // estimate the bucket width from the average separation of
+        // the first events, discarding the outliers (Brown, 1988)
+        size_t s = std::min(all.size(), size_t(25));
+        partial_sort(all.begin(), all.begin() + s, all.end(), cmp);
+        if (s > 1) {
+            double avg = double(evtTime(all[s - 1]) - evtTime(all[0])) / (s - 1);
+            double sum = 0;
+            int cnt = 0;
+            for (size_t i = 1; i < s; ++i) {
+                double d = double(evtTime(all[i]) - evtTime(all[i - 1]));
+                if (d <= 2 * avg) { sum += d; cnt++; }
+            }
+            double w = cnt > 0 ? 3 * sum / cnt : 0;
+            _width = w >= 1 ? int64_t(w) : 1;
+        }
+
+        _buckets.clear();
+        _buckets.resize(nb);
+        _first = NULL;
+        _curVB = all.empty() ? 0 : vbucket(all[0]);
+
+        for (size_t i = 0; i < all.size(); ++i) {
+            int64_t vb = vbucket(all[i]);
+            bucketInsert(_buckets[size_t(uint64_t(vb) & (nb - 1))], all[i]);
+        }
+    }
+
+    void CalendarQueue::clear()
+    {
+        for (size_t i = 0; i < _buckets.size(); ++i) _buckets[i].clear();
+        _size = 0;
+        _first = NULL;
+    }
+
+    void CalendarQueue::dump(vector<Event *> &v) const
+    {
+        v.clear();
+        for (size_t i = 0; i < _buckets.size(); ++i)
+            v.insert(v.end(), _buckets[i].begin(), _buckets[i].end());
+        sort(v.begin(), v.end(), cmp);
+    }
+
+    void CalendarQueue::drain(vector<Event *> &v)
+    {
+        for (size_t i = 0; i < _buckets.size(); ++i)
+            v.insert(v.end(), _buckets[i].begin(), _buckets[i].end());
+        clear();
+    }
+
+    /*-----------------------------------------------------*/
+
+    const size_t LadderQueue::THRESHOLD;
+    const size_t LadderQueue::MAX_RUNGS;
+
+    LadderQueue::LadderQueue() :
+        _top(),
+        _topMin(numeric_limits<int64_t>::max()),
+        _topMax(numeric_limits<int64_t>::min()),
+        _topLimit(numeric_limits<int64_t>::min()),
+        _rungs(MAX_RUNGS),
+        _nRungs(0),
+        _bottom(),
+        _botHead(0),
+        _size(0)
+    {
+    }
+
+    unique_ptr<LadderQueue> LadderQueue::createInstance(vector<string> &par)
+    {
+        if (par.size() != 0)
+            throw ParseExc("Wrong number of parameters", "LadderQueue");
+        return unique_ptr<LadderQueue>(new LadderQueue());
+    }
+
+    // Spreads the events of src into a new rung, covering the
+    // interval of times [start, start + span - 1].
+    void LadderQueue::spawnRung(Bucket &src, int64_t start, uint64_t span)
+    {
+        Rung &r = _rungs[_nRungs++];
+        uint64_t n = src.size();
+        uint64_t w = span / n + (span % n != 0 ? 1 : 0);
+        if (w == 0) w = 1;
+        size_t nb = size_t((span - 1) / w + 1);
+
+        r.start = start;
+        r.width = int64_t(w);
+        r.cur = 0;
+        r.count = src.size();
+        for (size_t k = 0; k < r.buckets.size() && k < nb; ++k) r.buckets[k].clear();
+        r.buckets.resize(nb);
+
+        for (size_t i = 0; i < src.size(); ++i) {
+            size_t k = size_t(uint64_t(evtTime(src[i]) - start) / w);
+            r.buckets[k].push_back(src[i]);
+        }
+        src.clear();
+    }
+
+    bool LadderQueue::refillBottom()
+    {
+        _bottom.clear();
+        _botHead = 0;
+
+        while (true) {
+            if (_nRungs == 0) {
+                if (_top.empty()) return false;
+                int64_t start = _topMin;
+                uint64_t span = uint64_t(_topMax) - uint64_t(_topMin) + 1;
+                if (span == 0) span = numeric_limits<uint64_t>::max();
+                _topLimit = _topMax;
+                _topMin = numeric_limits<int64_t>::max();
+                _topMax = numeric_limits<int64_t>::min();
+                spawnRung(_top, start, span);
+                continue;
+            }
+
+            Rung &r = _rungs[_nRungs - 1];
+            while (r.cur < r.buckets.size() && r.buckets[r.cur].empty()) ++r.cur;
+            if (r.cur == r.buckets.size()) {
+                --_nRungs;
+                continue;
+            }
+
+            Bucket &b = r.buckets[r.cur];
+            int64_t bstart = r.curStart();
+            r.cur++;
+            r.count -= b.size();
+
+            if (b.size() > THRESHOLD && r.width > 1 && _nRungs < MAX_RUNGS) {
+                spawnRung(b, bstart, uint64_t(r.width));
+                continue;
+            }
+
+            _bottom.swap(b);
+            sort(_bottom.begin(), _bottom.end(), cmp);
+            return true;
+        }
+    }
+
+    void LadderQueue::bottomInsert(Event *e)
+    {
+        Bucket::iterator i = upper_bound(_bottom.begin() + _botHead, _bottom.end(), e, cmp);
+        if (i == _bottom.begin() + _botHead && _botHead > 0) {
+            _bottom[--_botHead] = e;
+            return;
+        }
+        _bottom.insert(i, e);
+
+        // too many events in the bottom: spread them in a new rung,
+        // which covers all times up to the current limit of the bottom
+        size_t n = _bottom.size() - _botHead;
+        if (n > THRESHOLD && _nRungs < MAX_RUNGS) {
+            int64_t tmin = evtTime(_bottom[_botHead]);
+            int64_t tmax = evtTime(_bottom.back());
+            int64_t limit = _nRungs > 0 ? _rungs[_nRungs - 1].curStart() - 1 : _topLimit;
+            if (tmin != tmax && limit >= tmax) {
+                Bucket src(_bottom.begin() + _botHead, _bottom.end());
+                _bottom.clear();
+                _botHead = 0;
+                spawnRung(src, tmin, uint64_t(limit) - uint64_t(tmin) + 1);
+            }
+        }
+    }
+
+    void LadderQueue::insert(Event *e)
+    {
+        int64_t t = evtTime(e);
+        ++_size;
+
+        if (t > _topLimit) {
+            _top.push_back(e);
+            _topMin = std::min(_topMin, t);
+            _topMax = std::max(_topMax, t);
+            return;
+        }
+
+        for (size_t j = 0; j < _nRungs; ++j) {
+            Rung &r = _rungs[j];
+            if (t >= r.curStart()) {
+                size_t k = size_t(uint64_t(t - r.start) / uint64_t(r.width));
+                r.buckets[k].push_back(e);
+                r.count++;
+                return;
+            }
+        }
+
+        bottomInsert(e);
+    }
+
+    bool LadderQueue::removeFrom(Bucket &b, Event *e)
+    {
+        Bucket::iterator i = find(b.begin(), b.end(), e);
+        if (i == b.end()) return false;
+        *i = b.back();
+        b.pop_back();
+        return true;
+    }
+
+    void LadderQueue::erase(Event *e)
+    {
+        if (_size == 0) return;
+
+        bool found = false;
+        if (_botHead < _bottom.size() && _bottom[_botHead] == e) {
+            ++_botHead;
+            found = true;
+        }
+        else {
+            int64_t t = evtTime(e);
+            if (t > _topLimit) found = removeFrom(_top, e);
+            else {
+                size_t j = 0;
+                for (; j < _nRungs; ++j) {
+                    Rung &r = _rungs[j];
+                    if (t >= r.curStart()) {
+                        size_t k = size_t(uint64_t(t - r.start) / uint64_t(r.width));
+                        found = removeFrom(r.buckets[k], e);
+                        if (found) r.count--;
+                        break;
+                    }
+                }
+                if (j == _nRungs) {
+                    Bucket::iterator i = find(_bottom.begin() + _botHead, _bottom.end(), e);
+                    if (i != _bottom.end()) {
+                        _bottom.erase(i);
+                        found = true;
+                    }
+                }
+            }
+        }
+
+        if (found && --_size == 0) clear();
+    }
+
+    Event *LadderQueue::front()
+    {
+        if (_size == 0) return NULL;
+        if (_botHead == _bottom.size() && !refillBottom()) return NULL;
+        return _bottom[_botHead];
+    }
+
+    void LadderQueue::clear()
+    {
+        _top.clear();
+        _topMin = numeric_limits<int64_t>::max();
+        _topMax = numeric_limits<int64_t>::min();
+        _topLimit = numeric_limits<int64_t>::min();
+        for (size_t j = 0; j < _nRungs; ++j)
+            for (size_t k = 0; k < _rungs[j].buckets.size(); ++k)
+                _rungs[j].buckets[k].clear();
+        _nRungs = 0;
+        _bottom.clear();
+        _botHead = 0;
+        _size = 0;
+    }
+
+    void LadderQueue::dump(vector<Event *> &v) const
+    {
+        v.assign(_top.begin(), _top.end());
+        for (size_t j = 0; j < _nRungs; ++j)
+            for (size_t k = _rungs[j].cur; k < _rungs[j].buckets.size(); ++k)
+                v.insert(v.end(), _rungs[j].buckets[k].begin(), _rungs[j].buckets[k].end());
+        v.insert(v.end(), _bottom.begin() + _botHead, _bottom.end());
+        sort(v.begin(), v.end(), cmp);
+    }
+
+    void LadderQueue::drain(vector<Event *> &v)
+    {
+        v.insert(v.end(), _top.begin(), _top.end());
+        for (size_t j = 0; j < _nRungs; ++j)
+            for (size_t k = _rungs[j].cur; k < _rungs[j].buckets.size(); ++k)
+                v.insert(v.end(), _rungs[j].buckets[k].begin(), _rungs[j].buckets[k].end());
+        v.insert(v.end(), _bottom.begin() + _botHead, _bottom.end());
+        clear();
+    }
+
+    /*-----------------------------------------------------*/
+
+    namespace {
+        // the handle of an event in a lane: the lane and the slot
+        const size_t IN_LANE = size_t(1) << (numeric_limits<size_t>::digits - 1);
+        const int LANE_SHIFT = numeric_limits<size_t>::digits - 8;
+        const size_t SLOT_MASK = (size_t(1) << LANE_SHIFT) - 1;
+    }
+
+    ImmediateLanes::ImmediateLanes(unique_ptr<EventQueue> q) :
+        _main(move(q)), _lanes(), _byPriority(), _live(0), _laneTime(0),
+        _now(0), _hasNow(false), _lastFront(NULL)
+    {
+        _lanes.reserve(MAX_LANES);
+    }
+
+    unique_ptr<ImmediateLanes> ImmediateLanes::createInstance(vector<string> &par)
+    {
+        if (par.size() > 1)
+            throw ParseExc("Wrong number of parameters", "ImmediateLanes");
+        return unique_ptr<ImmediateLanes>(
+            new ImmediateLanes(EventQueue::create(par.empty() ? "heap" : par[0])));
+    }
+
+    bool ImmediateLanes::inLane(Event *e)
+    {
+        return (handle(e) & IN_LANE) != 0;
+    }
+
+    ImmediateLanes::Lane *ImmediateLanes::laneFor(Event *e)
+    {
+        if (!_hasNow || e->getTime() != _now) return NULL;
+        if (_live > 0 && _laneTime != _now) return NULL;
+
+        const int p = e->getPriority();
+        size_t k = 0;
+        while (k < _byPriority.size() && _lanes[_byPriority[k]].priority < p) ++k;
+        if (k < _byPriority.size() && _lanes[_byPriority[k]].priority == p) {
+            Lane &l = _lanes[_byPriority[k]];
+            // FIFO: a restored event may come before the last one
+            if (l.live > 0 && cmp(e, l.slots.back())) return NULL;
+            return &l;
+        }
+
+        // a new priority: a free lane takes it
+        size_t free = _lanes.size();
+        for (size_t i = 0; i < _lanes.size(); ++i)
+            if (_lanes[i].live == 0) { free = i; break; }
+        if (free == _lanes.size()) {
+            if (_lanes.size() == MAX_LANES) return NULL;
+            _lanes.push_back(Lane{ p, vector<Event *>(), 0, 0 });
+        }
+        else {
+            _byPriority.erase(find(_byPriority.begin(), _byPriority.end(), free));
+            _lanes[free].priority = p;
+            k = 0;
+            while (k < _byPriority.size() && _lanes[_byPriority[k]].priority < p) ++k;
+        }
+        _byPriority.insert(_byPriority.begin() + k, free);
+        return &_lanes[free];
+    }
+
+    void ImmediateLanes::insert(Event *e)
+    {
+        Lane *l = laneFor(e);
+        if (l == NULL) {
+            handle(e) = 0;
+            _main->insert(e);
+            return;
+        }
+        handle(e) = IN_LANE | (size_t(l - &_lanes[0]) << LANE_SHIFT) | l->slots.size();
+        l->slots.push_back(e);
+        ++l->live;
+        ++_live;
+        _laneTime = _now;
+    }
+
+    void ImmediateLanes::laneErase(Event *e)
+    {
+        size_t h = handle(e);
+        Lane &l = _lanes[(h & ~IN_LANE) >> LANE_SHIFT];
+        size_t slot = h & SLOT_MASK;
+        handle(e) = 0;
+        l.slots[slot] = NULL;
+        --_live;
+        if (--l.live == 0) {
+            l.slots.clear();
+            l.head = 0;
+            return;
+        }
+        while (l.slots[l.head] == NULL) ++l.head;
+        while (l.slots.back() == NULL) l.slots.pop_back();
+
+        // a lane that never empties: the slots taken are reused
+        if (l.head >= 1024 && 2 * l.head >= l.slots.size()) {
+            size_t lane = h & ~IN_LANE & ~SLOT_MASK;
+            l.slots.erase(l.slots.begin(), l.slots.begin() + l.head);
+            l.head = 0;
+            for (size_t i = 0; i < l.slots.size(); ++i)
+                if (l.slots[i] != NULL) handle(l.slots[i]) = IN_LANE | lane | i;
+        }
+    }
+
+    void ImmediateLanes::erase(Event *e)
+    {
+        // taken from the front: the time of the simulation
+        if (e == _lastFront) {
+            _now = e->getTime();
+            _hasNow = true;
+            _lastFront = NULL;
+        }
+        if (inLane(e)) laneErase(e);
+        else _main->erase(e);
+    }
+
+    void ImmediateLanes::reschedule(Event *e, Tick t, unsigned long order)
+    {
+        if (inLane(e) || (_hasNow && t == _now)) {
+            erase(e);
+            setKey(e, t, order);
+            insert(e);
+        }
+        else _main->reschedule(e, t, order);
+    }
+
+    Event *ImmediateLanes::front()
+    {
+        Event *m = _main->front();
+        if (_live > 0) {
+            // the first lane, by priority, that is not empty
+            for (size_t i : _byPriority) {
+                const Lane &l = _lanes[i];
+                if (l.live == 0) continue;
+                Event *f = l.slots[l.head];
+                if (m == NULL || cmp(f, m)) m = f;
+                break;
+            }
+        }
+        _lastFront = m;
+        return m;
+    }
+
+    void ImmediateLanes::clear()
+    {
+        for (Lane &l : _lanes) {
+            for (size_t i = l.head; i < l.slots.size(); ++i)
+                if (l.slots[i] != NULL) handle(l.slots[i]) = 0;
+            l.slots.clear();
+            l.head = l.live = 0;
+        }
+        _live = 0;
+        _lastFront = NULL;
+        _main->clear();
+    }
+
+    void ImmediateLanes::dump(vector<Event *> &v) const
+    {
+        _main->dump(v);
+        if (_live == 0) return;
+        // the lanes are in order of priority, of the same time
+        size_t mid = v.size();
+        for (size_t i : _byPriority)
+            for (size_t j = _lanes[i].head; j < _lanes[i].slots.size(); ++j)
+                if (_lanes[i].slots[j] != NULL) v.push_back(_lanes[i].slots[j]);
+        inplace_merge(v.begin(), v.begin() + mid, v.end(), cmp);
+    }
+
+    void ImmediateLanes::drain(vector<Event *> &v)
+    {
+        _main->drain(v);
+        for (const Lane &l : _lanes)
+            for (size_t j = l.head; j < l.slots.size(); ++j)
+                if (l.slots[j] != NULL) v.push_back(l.slots[j]);
+        clear();
+    }
+
+    /*-----------------------------------------------------*/
+
+    namespace {
+        // the order of the events of a group: decreasing
+        inline bool later(const Event *a, const Event *b) { return cmp(b, a); }
+    }
+
+    TwoLevelQueue::TwoLevelQueue() :
+        _groups(), _freeGroups(), _byOwner(), _heap(), _size(0)
+    {
+    }
+
+    unique_ptr<TwoLevelQueue> TwoLevelQueue::createInstance(vector<string> &par)
+    {
+        if (par.size() != 0)
+            throw ParseExc("Wrong number of parameters", "TwoLevelQueue");
+        return unique_ptr<TwoLevelQueue>(new TwoLevelQueue());
+    }
+
+    bool TwoLevelQueue::before(size_t g, size_t h) const
+    {
+        return cmp(_groups[g].events.back(), _groups[h].events.back());
+    }
+
+    void TwoLevelQueue::siftUp(size_t i)
+    {
+        size_t g = _heap[i];
+        while (i > 0) {
+            size_t p = (i - 1) / D;
+            if (!before(g, _heap[p])) break;
+            place(i, _heap[p]);
+            i = p;
+        }
+        place(i, g);
+    }
+
+    void TwoLevelQueue::siftDown(size_t i)
+    {
+        size_t g = _heap[i];
+        size_t n = _heap.size();
+        while (true) {
+            size_t c = D * i + 1;
+            if (c >= n) break;
+            size_t last = std::min<size_t>(c + D, n);
+            size_t best = c;
+            for (size_t k = c + 1; k < last; ++k)
+                if (before(_heap[k], _heap[best])) best = k;
+            if (!before(_heap[best], g)) break;
+            place(i, _heap[best]);
+            i = best;
+        }
+        place(i, g);
+    }
+
+    void TwoLevelQueue::removeAt(size_t i)
+    {
+        size_t last = _heap.back();
+        _heap.pop_back();
+        if (i == _heap.size()) return;
+        place(i, last);
+        if (i > 0 && before(last, _heap[(i - 1) / D])) siftUp(i);
+        else siftDown(i);
+    }
+
+    size_t TwoLevelQueue::groupFor(Event *e)
+    {
+        const void *owner = e->getOwner();
+        if (owner != NULL) {
+            auto it = _byOwner.find(owner);
+            if (it != _byOwner.end()) return it->second;
+        }
+        size_t g;
+        if (owner == NULL && !_freeGroups.empty()) {
+            g = _freeGroups.back();
+            _freeGroups.pop_back();
+        }
+        else {
+            g = _groups.size();
+            _groups.push_back(Group{ owner, vector<Event *>(), 0 });
+            if (owner != NULL) _byOwner[owner] = g;
+        }
+        return g;
+    }
+
+    bool TwoLevelQueue::find(Event *e, size_t &pos) const
+    {
+        size_t g = handle(e);
+        if (g >= _groups.size()) return false;
+        const vector<Event *> &v = _groups[g].events;
+        pos = lower_bound(v.begin(), v.end(), e, later) - v.begin();
+        return pos < v.size() && v[pos] == e;
+    }
+
+    void TwoLevelQueue::insert(Event *e)
+    {
+        size_t g = groupFor(e);
+        handle(e) = g;
+        vector<Event *> &v = _groups[g].events;
+        const bool first = v.empty() || cmp(e, v.back());
+        v.insert(upper_bound(v.begin(), v.end(), e, later), e);
+        ++_size;
+        if (v.size() == 1) {
+            _heap.push_back(g);
+            siftUp(_heap.size() - 1);
+        }
+        else if (first) siftUp(_groups[g].heapPos);
+    }
+
+    void TwoLevelQueue::erase(Event *e)
+    {
+        size_t pos;
+        if (!find(e, pos)) return;
+        Group &grp = _groups[handle(e)];
+        const bool first = pos + 1 == grp.events.size();
+        grp.events.erase(grp.events.begin() + pos);
+        --_size;
+        if (grp.events.empty()) {
+            removeAt(grp.heapPos);
+            if (grp.owner == NULL) _freeGroups.push_back(handle(e));
+        }
+        else if (first) siftDown(grp.heapPos);
+    }
+
+    Event *TwoLevelQueue::front()
+    {
+        if (_heap.empty()) return NULL;
+        return _groups[_heap[0]].events.back();
+    }
+
+    void TwoLevelQueue::clear()
+    {
+        _groups.clear();
+        _freeGroups.clear();
+        _byOwner.clear();
+        _heap.clear();
+        _size = 0;
+    }
+
+    void TwoLevelQueue::dump(vector<Event *> &v) const
+    {
+        v.clear();
+        for (size_t g : _heap)
+            v.insert(v.end(), _groups[g].events.begin(), _groups[g].events.end());
+        sort(v.begin(), v.end(), cmp);
+    }
+
+    void TwoLevelQueue::drain(vector<Event *> &v)
+    {
+        for (size_t g : _heap)
+            v.insert(v.end(), _groups[g].events.begin(), _groups[g].events.end());
+        clear();
+    }
+
+    /*-----------------------------------------------------*/
+
+    namespace __queue_stub
+    {
+        static registerInFactory<EventQueue,
+                                 SetQueue,
+                                 EventQueue::BASE_KEY_TYPE>
+        registerSet("set");
+
+        static registerInFactory<EventQueue,
+                                 HeapQueue,
+                                 EventQueue::BASE_KEY_TYPE>
+        registerHeap("heap");
+
+        static registerInFactory<EventQueue,
+                                 CalendarQueue,
+                                 EventQueue::BASE_KEY_TYPE>
+        registerCalendar("calendar");
+
+        static registerInFactory<EventQueue,
+                                 LadderQueue,
+                                 EventQueue::BASE_KEY_TYPE>
+        registerLadder("ladder");
+
+        static registerInFactory<EventQueue,
+                                 ImmediateLanes,
+                                 EventQueue::BASE_KEY_TYPE>
+        registerLanes("lanes");
+
+        static registerInFactory<EventQueue,
+                                 TwoLevelQueue,
+                                 EventQueue::BASE_KEY_TYPE>
+        registerTwoLevel("twolevel");
+    } // namespace __queue_stub
+
+} // namespace MetaSim
@@ -0,0 +1,407 @@
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef __EVENTQUEUE_HPP__
+#define __EVENTQUEUE_HPP__
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <tick.hpp>
+
+namespace MetaSim {
+
+    class Event;
+
+    /**
+       \ingroup metasim_ee
+
+       Abstract interface of the event queue used by the simulation
+       engine. All implementations order events in exactly the same
+       way: by triggering time, then by priority, and then by
+       insertion order (FIFO). Therefore, the choice of the
+       implementation does not change the results of a simulation,
+       only its speed.
+
+       The available implementations are:
+
+       - "set"      : a balanced tree (the historical implementation);
+       - "heap(d)"  : a d-ary implicit heap in a contiguous array,
+                      with d = 2, 4 or 8 (default 4);
+       - "calendar" : a calendar queue (R. Brown, 1988) with automatic
+                      resizing of the year;
+       - "ladder"   : a ladder queue (Tang, Goh and Thng, 2005);
+       - "twolevel" : a sorted list of events per entity, and a
+                      heap of the entities (see TwoLevelQueue).
+
+       The implementation is selected with Event::setEventQueue(),
+       using the names above. The default one is chosen at build time
+       (CMake variable METASIM_EVENT_QUEUE) and can be overridden at
+       run time by setting the environment variable
+       METASIM_EVENT_QUEUE.
+
+       New implementations can be added by registering them in the
+       genericFactory<EventQueue>, in the same way random variables
+       are registered in regvar.cpp.
+    */
+    class EventQueue {
+    public:
+        typedef std::string BASE_KEY_TYPE;
+
+        virtual ~EventQueue() {}
+
+        /// Inserts an event. The event must not be already queued.
+        virtual void insert(Event *e) = 0;
+
+        /// Removes an event from the queue. Does nothing if the
+        /// event is not in the queue.
+        virtual void erase(Event *e) = 0;
+
+        /// Returns the first event without removing it, or NULL
+        /// if the queue is empty.
+        virtual Event *front() = 0;
+
+        virtual bool empty() const = 0;
+
+        virtual size_t size() const = 0;
+
+        /// Removes all events from the queue.
+        virtual void clear() = 0;
+
+        /**
+            Moves an event already in the queue to time t, with
+            the given insertion order. The default implementation
+            removes and re-inserts the event; implementations that
+            can update the position in place override it.
+        */
+        virtual void reschedule(Event *e, Tick t, unsigned long order);
+
+        /// Copies all the queued events, in order, in v. Only for
+        /// debugging: it can be slow.
+        virtual void dump(std::vector<Event *> &v) const = 0;
+
+        /**
+            Appends all the queued events to v, in no particular
+            order, and leaves the queue empty, in linear time. The
+            default implementation uses dump() and clear().
+        */
+        virtual void drain(std::vector<Event *> &v);
+
+        /**
+            Creates an event queue from a specification string of
+            the form "name(par1, ...)", like "heap(4)" or
+            "calendar". Throws a parse_util::ParseExc if the name
+            is unknown.
+        */
+        static std::unique_ptr<EventQueue> create(const std::string &spec);
+
+    protected:
+        /// The intrusive handle of the event, reserved to the
+        /// implementation that holds it (e.g. a heap index).
+        static size_t &handle(Event *e);
+
+        /// Changes the ordering key of an event, which must not
+        /// be inside any data structure while doing so.
+        static void setKey(Event *e, Tick t, unsigned long order);
+    };
+
+    /**
+       The historical event queue, a balanced tree (std::set).
+    */
+    class SetQueue : public EventQueue {
+        class Impl;
+        std::unique_ptr<Impl> _impl;
+    public:
+        SetQueue();
+        ~SetQueue();
+
+        static std::unique_ptr<SetQueue> createInstance(std::vector<std::string> &par);
+
+        virtual void insert(Event *e);
+        virtual void erase(Event *e);
+        virtual Event *front();
+        virtual bool empty() const;
+        virtual size_t size() const;
+        virtual void clear();
+        virtual void dump(std::vector<Event *> &v) const;
+        virtual void drain(std::vector<Event *> &v);
+    };
+
+    /**
+       A d-ary implicit heap stored in a contiguous vector. A larger
+       arity makes the tree shallower and the sift-down loop more
+       cache friendly, at the price of more comparisons per
+       level. The createInstance() function accepts the arity as
+       optional parameter (2, 4 or 8).
+
+       Each event stores its index in the heap (see
+       EventQueue::handle()), so erase() and reschedule() take
+       O(log n) time without searching.
+    */
+    template <unsigned D>
+    class DaryHeapQueue : public EventQueue {
+        std::vector<Event *> _heap;
+
+        void place(size_t i, Event *e) { _heap[i] = e; handle(e) = i; }
+        void siftUp(size_t i);
+        void siftDown(size_t i);
+        void removeAt(size_t i);
+        bool contains(Event *e);
+    public:
+        DaryHeapQueue() : _heap() {}
+
+        virtual void insert(Event *e);
+        virtual void erase(Event *e);
+        virtual void reschedule(Event *e, Tick t, unsigned long order);
+        virtual Event *front() { return _heap.empty() ? NULL : _heap[0]; }
+        virtual bool empty() const { return _heap.empty(); }
+        virtual size_t size() const { return _heap.size(); }
+        virtual void clear() { _heap.clear(); }
+        virtual void dump(std::vector<Event *> &v) const;
+        virtual void drain(std::vector<Event *> &v);
+    };
+
+    /**
+       Factory helper for the d-ary heaps: "heap(2)", "heap(4)" and
+       "heap(8)".
+    */
+    class HeapQueue {
+    public:
+        static std::unique_ptr<EventQueue> createInstance(std::vector<std::string> &par);
+    };
+
+    /**
+       Calendar queue. Events are hashed by time into an array of
+       buckets ("days") of fixed width; a complete scan of the array
+       is a "year". Each bucket is kept sorted, so that if the width
+       is well chosen, insertion and extraction take O(1) time on
+       average. The number of buckets is doubled or halved when the
+       number of events crosses a threshold, and in that case the
+       width is re-estimated from the separation of the first events
+       in the queue.
+
+       Optional parameters: initial number of buckets and initial
+       width in ticks, e.g. "calendar(1024, 100)".
+    */
+    class CalendarQueue : public EventQueue {
+        typedef std::vector<Event *> Bucket;
+
+        std::vector<Bucket> _buckets;
+        int64_t _width;
+        // virtual bucket (i.e. time / width) of the scan position:
+        // all queued events are in this virtual bucket or later.
+        int64_t _curVB;
+        size_t _size;
+        // cached first event (NULL if it must be searched)
+        Event *_first;
+
+        int64_t vbucket(Event *e) const;
+        void locateFirst();
+        void resize(size_t nb);
+        void bucketInsert(Bucket &b, Event *e);
+    public:
+        CalendarQueue(size_t nbuckets = 2, int64_t width = 1);
+
+        static std::unique_ptr<CalendarQueue> createInstance(std::vector<std::string> &par);
+
+        virtual void insert(Event *e);
+        virtual void erase(Event *e);
+        virtual Event *front();
+        virtual bool empty() const { return _size == 0; }
+        virtual size_t size() const { return _size; }
+        virtual void clear();
+        virtual void dump(std::vector<Event *> &v) const;
+        virtual void drain(std::vector<Event *> &v);
+    };
+
+    /**
+       Ladder queue. Events far in the future are kept unsorted in
+       the "top" list; when the near future is needed, they are
+       spread into the buckets of a "rung", and buckets with too many
+       events are recursively spread into finer rungs. Only small
+       buckets are sorted, in the "bottom" list, from which events
+       are extracted in order. The resulting amortized cost is O(1)
+       per event, and the structure adapts to any distribution of
+       the event times without resizing.
+    */
+    class LadderQueue : public EventQueue {
+        typedef std::vector<Event *> Bucket;
+
+        struct Rung {
+            int64_t start;     // start time of the first bucket
+            int64_t width;     // bucket width
+            size_t cur;        // index of the current bucket
+            size_t count;      // number of events in the rung
+            std::vector<Bucket> buckets;
+
+            int64_t curStart() const { return start + int64_t(cur) * width; }
+        };
+
+        /// maximum number of events sorted in the bottom and in a
+        /// bucket before spawning a new rung
+        static const size_t THRESHOLD = 50;
+        static const size_t MAX_RUNGS = 8;
+
+        // events later than _topLimit are kept, unsorted, in the top
+        Bucket _top;
+        int64_t _topMin, _topMax, _topLimit;
+
+        std::vector<Rung> _rungs;
+        size_t _nRungs;
+
+        // sorted in ascending order, starting from _botHead
+        Bucket _bottom;
+        size_t _botHead;
+
+        size_t _size;
+
+        void spawnRung(Bucket &src, int64_t start, uint64_t span);
+        bool refillBottom();
+        void bottomInsert(Event *e);
+        static bool removeFrom(Bucket &b, Event *e);
+    public:
+        LadderQueue();
+
+        static std::unique_ptr<LadderQueue> createInstance(std::vector<std::string> &par);
+
+        virtual void insert(Event *e);
+        virtual void erase(Event *e);
+        virtual Event *front();
+        virtual bool empty() const { return _size == 0; }
+        virtual size_t size() const { return _size; }
+        virtual void clear();
+        virtual void dump(std::vector<Event *> &v) const;
+        virtual void drain(std::vector<Event *> &v);
+    };
+
+    /**
+       A fast lane for the events posted at the current time (by
+       Event::process() and by the zero-delay posts), on top of
+       another queue: they are kept in a FIFO per priority, without
+       ordering them, and front() compares the first of them with
+       the first event of the other queue only. The order of the
+       events is the same as the one of the other queue.
+
+       The current time is the one of the last event taken from
+       the front of the queue. The lanes hold events of the same
+       time, for at most MAX_LANES priorities; the other events go
+       to the other queue.
+
+       SimContext::setImmediateLanes() puts the lanes on top of
+       the queues of a context; the specification "lanes(heap(4))"
+       (e.g. in METASIM_EVENT_QUEUE) creates them explicitly.
+    */
+    class ImmediateLanes : public EventQueue {
+        struct Lane {
+            int priority;
+            std::vector<Event *> slots;     // NULL: erased
+            size_t head;
+            size_t live;
+        };
+
+        static const size_t MAX_LANES = 8;
+
+        std::unique_ptr<EventQueue> _main;
+        std::vector<Lane> _lanes;
+        // indexes of _lanes, by priority
+        std::vector<size_t> _byPriority;
+        size_t _live;
+        Tick _laneTime;
+        // the current time, and the last event returned by front()
+        Tick _now;
+        bool _hasNow;
+        Event *_lastFront;
+
+        static bool inLane(Event *e);
+        Lane *laneFor(Event *e);
+        void laneErase(Event *e);
+    public:
+        explicit ImmediateLanes(std::unique_ptr<EventQueue> q);
+
+        static std::unique_ptr<ImmediateLanes> createInstance(std::vector<std::string> &par);
+
+        /// The queue of the other events
+        inline EventQueue &getMain() { return *_main; }
+
+        /// Number of events in the lanes
+        inline size_t getLaneEvents() const { return _live; }
+
+        virtual void insert(Event *e);
+        virtual void erase(Event *e);
+        virtual void reschedule(Event *e, Tick t, unsigned long order);
+        virtual Event *front();
+        virtual bool empty() const { return _live == 0 && _main->empty(); }
+        virtual size_t size() const { return _live + _main->size(); }
+        virtual void clear();
+        virtual void dump(std::vector<Event *> &v) const;
+        virtual void drain(std::vector<Event *> &v);
+    };
+
+    /**
+       A two-level queue: the pending events of every owner (see
+       Event::getOwner(), the entity of a GEvent) are kept in a
+       small sorted list, and a 4-ary heap orders the owners by
+       their first event. The heap holds one entry per entity with
+       pending events instead of one per event, and the events of
+       an entity stay together in memory; it is the faster choice
+       when the entities keep many events each (e.g. the
+       interfaces of a network); with one event per entity, the
+       lookup of the owner makes it slower than "heap". An event
+       without an owner is a group of its own.
+
+       The groups of the owners are also the unit of a partition of
+       the model in logical processes, for a parallel simulation.
+    */
+    class TwoLevelQueue : public EventQueue {
+        struct Group {
+            const void *owner;          // NULL: a single event
+            // in decreasing order: the first event is the last
+            std::vector<Event *> events;
+            size_t heapPos;
+        };
+
+        static const unsigned D = 4;
+
+        std::vector<Group> _groups;
+        std::vector<size_t> _freeGroups;
+        std::unordered_map<const void *, size_t> _byOwner;
+        // indexes of the groups that are not empty
+        std::vector<size_t> _heap;
+        size_t _size;
+
+        bool before(size_t g, size_t h) const;
+        void place(size_t i, size_t g) { _heap[i] = g; _groups[g].heapPos = i; }
+        void siftUp(size_t i);
+        void siftDown(size_t i);
+        void removeAt(size_t i);
+        size_t groupFor(Event *e);
+        bool find(Event *e, size_t &pos) const;
+    public:
+        TwoLevelQueue();
+
+        static std::unique_ptr<TwoLevelQueue> createInstance(std::vector<std::string> &par);
+
+        /// Number of groups with pending events
+        inline size_t getGroups() const { return _heap.size(); }
+
+        virtual void insert(Event *e);
+        virtual void erase(Event *e);
+        virtual Event *front();
+        virtual bool empty() const { return _size == 0; }
+        virtual size_t size() const { return _size; }
+        virtual void clear();
+        virtual void dump(std::vector<Event *> &v) const;
+        virtual void drain(std::vector<Event *> &v);
+    };
+
+} // namespace MetaSim
+
+#endif
@@ -29,9 +29,9 @@
 #define __FACTORY_HPP__
 
 #include <iostream>
-#include <map>
 #include <memory>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 typedef std::string defaultIDKeyType;
@@ -41,6 +41,7 @@ typedef std::string defaultIDKeyType;
 template <class manufacturedObj, typename classIDKey=defaultIDKeyType>
 class genericFactory 
 {
+public:
     // a BASE_CREATE_FN is a function that takes no parameters
     // and returns an unique_ptr<> to a manufactuedObj.  Note that
     // we use no parameters, but you could add them
@@ -48,10 +49,12 @@ class genericFactory
     //   typedef std::unique_ptr<manufacturedObj> (*BASE_CREATE_FN)(int);
     typedef std::unique_ptr<manufacturedObj> (*BASE_CREATE_FN)(std::vector<std::string> &par);
 
+private:
     // FN_REGISTRY is the registry of all the BASE_CREATE_FN
-    // pointers registered.  Functions are registered using the
+    // pointers registered, hashed by class ID (the key must
+    // have a std::hash).  Functions are registered using the
     // regCreateFn member function (see below).
-    typedef std::map<classIDKey, BASE_CREATE_FN> FN_REGISTRY;
+    typedef std::unordered_map<classIDKey, BASE_CREATE_FN> FN_REGISTRY;
     FN_REGISTRY registry;
 
     // Singleton implementation - private ctor & copying, with
@@ -71,6 +74,10 @@ public:
 
     // Create a new class of the type specified by className.
     std::unique_ptr<manufacturedObj> create(const classIDKey &className, std::vector<std::string> &parms) const;
+
+    // The creation function of className (nullptr if it is not
+    // registered), to create many objects with one lookup.
+    BASE_CREATE_FN find(const classIDKey &className) const;
 };
 
 ////////////////////////////////////////////////////////////////////////
@@ -114,6 +121,14 @@ std::unique_ptr<manufacturedObj> genericFactory<manufacturedObj, classIDKey>::cr
   return ret;
 }
 
+template <class manufacturedObj, typename classIDKey>
+typename genericFactory<manufacturedObj, classIDKey>::BASE_CREATE_FN
+genericFactory<manufacturedObj, classIDKey>::find(const classIDKey &className) const
+{
+  typename FN_REGISTRY::const_iterator regEntry=registry.find(className);
+  return regEntry != registry.end() ? regEntry->second : nullptr;
+}
+
 // Helper template to make registration painless and simple.
 template <class ancestorType,
           class manufacturedObj,
@@ -91,26 +91,28 @@ namespace MetaSim {
         }
 
         readPDF(inFile);
+        buildTable();
     }
 
-    double GenericVar::get()
+    void GenericVar::buildTable()
     {
-        double v, CDF;
-        map<int, double>::iterator i;
-
-        v = UniformVar::get();
-        CDF = 0;
-
-        for(i = _pdf.begin(); i != _pdf.end(); i++) {
-            CDF = CDF + i->second;
-            if (CDF > v) {
-                return i->first;
-            }
+        vector<double> w;
+        for (auto &p : _pdf) {
+            _values.push_back(p.first);
+            w.push_back(p.second);
         }
+        _table = AliasTable(w);
+    }
 
-        /* We cannot arrive here... */
-        /* It means that v > 1 or that lim_{i -> \infty} CDF < 1... */
-        throw Exc("Panic", "GenericVar");
+    double GenericVar::get()
+    {
+        return _values[_table.sample(UniformVar::get())];
+    }
+
+    void GenericVar::fill(double *out, size_t n)
+    {
+        fillUnit(out, n);
+        for (size_t i = 0; i < n; ++i) out[i] = _values[_table.sample(out[i])];
     }
     
     RandomVar *GenericVar::createInstance(vector<string> &par)
@@ -51,17 +51,28 @@
 
 #include <iostream>
 #include <map>
+#include <vector>
 
+#include <aliastable.hpp>
 #include <randomvar.hpp>
 
 namespace MetaSim {
 
     /**
        This random variable is used to model a generic distribution.
+       The PDF is read from a file of pairs "value probability"; an
+       alias table (see AliasTable) is built after reading it, so
+       that every sample costs one uniform number and O(1)
+       operations, whatever the number of values.
     */
     class GenericVar: public UniformVar {
         std::map<int, double> _pdf;
+        // the values of the PDF, in the order of the table
+        std::vector<int> _values;
+        AliasTable _table;
+
         void readPDF(std::ifstream &f, int mode = 0);// throw(Exc);
+        void buildTable();
     public:
         GenericVar(const std::string &filename);
 
@@ -70,7 +81,10 @@ namespace MetaSim {
         static RandomVar *createInstance(std::vector<std::string> &par);
         
         virtual double get(void);
+        virtual void fill(double *out, size_t n);
 
+        /// The PDF, as read from the file
+        const std::map<int, double> &getPDF() const { return _pdf; }
   };
 
 } // namespace metasim
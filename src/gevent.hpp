@@ -23,9 +23,24 @@
 #ifndef __GEVENT_HPP__
 #define __GEVENT_HPP__
 
+#include <type_traits>
+
+#include <entity.hpp>
 #include <event.hpp>
 
 namespace MetaSim {
+
+    /// The object of a GEvent, if it is an entity
+    template <class X>
+    inline typename std::enable_if<std::is_base_of<Entity, X>::value,
+                                   const Entity *>::type
+    entityOf(const X *obj) { return obj; }
+
+    template <class X>
+    inline typename std::enable_if<!std::is_base_of<Entity, X>::value,
+                                   const Entity *>::type
+    entityOf(const X *) { return NULL; }
+
     /**
        \ingroup metasim_ee
 
@@ -58,9 +73,32 @@ namespace MetaSim {
        \until register_handler
 
        Handler onTransmit() is called whenever the event is triggered.
+
+       The handler can also be bound at compile time, by passing it
+       as second template argument: then doit() calls it directly,
+       and the compiler can inline it, without the null checks and
+       the call through a pointer to member, and the event does not
+       store the pointer:
+
+       @code
+       GEvent<EthernetInterface, &EthernetInterface::onTransmit> _trans_evt;
+
+       EthernetInterface::EthernetInterface(...) : ..., _trans_evt(this) {}
+       @endcode
+
+       Inside the class X, the handler must be declared before the
+       event. The last template argument only selects the
+       implementation and must not be given.
     */
-    template<class X>
-    class GEvent : public Event {
+    template <class X, void (X::*F)(Event *) = nullptr,
+              bool = std::is_same<
+                  std::integral_constant<void (X::*)(Event *), F>,
+                  std::integral_constant<void (X::*)(Event *), nullptr> >::value>
+    class GEvent;
+
+    /// GEvent with the handler chosen at run time
+    template <class X, void (X::*F)(Event *)>
+    class GEvent<X, F, true> : public Event {
         typedef void (X::* Pmemfun)(Event *);
         
         X *_obj;
@@ -68,7 +106,7 @@ namespace MetaSim {
         
     public:
 
-        GEvent(X *obj, typename GEvent<X>::Pmemfun fun, int p = Event::_DEFAULT_PRIORITY) :
+        GEvent(X *obj, Pmemfun fun, int p = Event::_DEFAULT_PRIORITY) :
             Event(p), _obj(obj), _fun(fun) {}
         
         /**
@@ -76,14 +114,14 @@ namespace MetaSim {
            same type for the same \b object. (Remember: all these
            events point to the same object!)
         */
-        GEvent(const GEvent<X> &e) : Event(e) { 
+        GEvent(const GEvent &e) : Event(e) { 
             _obj = e._obj; _fun = e._fun; 
         }
 
         /** A more generic constructor: the new copied event points to
          * a different object of the same type, the function to be
          * called is the same */
-        GEvent(const GEvent<X> &e, X& obj) : Event(e) { 
+        GEvent(const GEvent &e, X& obj) : Event(e) { 
             _obj = &obj; _fun = e._fun; 
         }
         
@@ -96,6 +134,34 @@ namespace MetaSim {
             if ((_obj != NULL) && (_fun != NULL))
                 (_obj->*_fun)(this);
         }
+
+        /// The object of the handler
+        virtual const void *getOwner() const { return _obj; }
+
+        virtual const Entity *getEntity() const { return entityOf(_obj); }
+    };
+
+    /// GEvent with the handler F bound at compile time
+    template <class X, void (X::*F)(Event *)>
+    class GEvent<X, F, false> : public Event {
+        X *_obj;
+
+    public:
+        explicit GEvent(X *obj, int p = Event::_DEFAULT_PRIORITY) :
+            Event(p), _obj(obj) {}
+
+        GEvent(const GEvent &e) : Event(e), _obj(e._obj) {}
+
+        /// Copies the event, pointing to a different object
+        GEvent(const GEvent &e, X &obj) : Event(e), _obj(&obj) {}
+
+        /// Calls F on the object
+        virtual void doit() final { (_obj->*F)(this); }
+
+        /// The object of the handler
+        virtual const void *getOwner() const { return _obj; }
+
+        virtual const Entity *getEntity() const { return entityOf(_obj); }
     };
     
     /**
@@ -77,27 +77,23 @@ public:
     c(h.c), _size(h._size), curr_pos(h.curr_pos) {}
 	
   size_type size() const { return _size; }
+
+  // the position wraps without a division (see also WindowRing
+  // in windowstat.hpp, for the aggregates of a sliding window)
   void push_back(const T& v) 
   { 
-    c[curr_pos] = v; curr_pos = (curr_pos + 1) % _size;
+    c[curr_pos] = v; if (size_type(++curr_pos) == _size) curr_pos = 0;
   }
   
-  void push(const T& v)
-  { 
-    c[curr_pos] = v; curr_pos = (curr_pos + 1) % _size;
-  }
-	
-  void push_back(T& v) 
-  { 
-    c[curr_pos] = v; curr_pos = (curr_pos + 1) % _size;
-  }
-  
-  void push(T& v)
+  void push(const T& v) { push_back(v); }
+
+  /// The i-th most recent value (0: the last one pushed)
+  reference operator[](int i) 
   { 
-    c[curr_pos] = v; curr_pos = (curr_pos + 1) % _size;
+    int pos = curr_pos - 1 - i; if (pos < 0) pos += _size; return c[pos];
   }
 
-  T operator[](int i) 
+  const_reference operator[](int i) const
   { 
     int pos = curr_pos - 1 - i; if (pos < 0) pos += _size; return c[pos];
   }
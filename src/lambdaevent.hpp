@@ -0,0 +1,90 @@
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef __LAMBDAEVENT_HPP__
+#define __LAMBDAEVENT_HPP__
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include <event.hpp>
+
+namespace MetaSim {
+
+    /**
+       \ingroup metasim_ee
+
+       An event that executes a callable object (typically a lambda
+       expression), stored inside the event itself: unlike
+       std::function, no memory is allocated on the heap, and the
+       call is a direct call through one function pointer. The
+       callable can take no argument, or the event (Event *):
+
+       @code
+       Event::create<LambdaEvent>([this, pkt] { deliver(pkt); })
+           ->post(SIMUL.getTime() + delay, true);
+       @endcode
+
+       The callable must fit in Size bytes (48 by default, enough
+       for 6 pointers): a larger one is a compilation error, and a
+       larger buffer must be chosen with BasicLambdaEvent. Since the
+       size of the event does not depend on the callable, all the
+       LambdaEvent created with Event::create() share the same pool.
+
+       The event cannot be copied.
+    */
+    template <size_t Size>
+    class BasicLambdaEvent : public Event {
+        typedef typename std::aligned_storage<Size, alignof(std::max_align_t)>::type Buffer;
+
+        Buffer _buf;
+        void (*_invoke)(void *, Event *);
+        void (*_destroy)(void *);
+
+        // calls f(e) or f(), whichever is valid
+        template <class F>
+        static auto call(F &f, Event *e, int) -> decltype(f(e), void()) { f(e); }
+        template <class F>
+        static void call(F &f, Event *, long) { f(); }
+
+        template <class F>
+        static void invoke(void *p, Event *e) { call(*static_cast<F *>(p), e, 0); }
+
+        template <class F>
+        static void destroy(void *p) { static_cast<F *>(p)->~F(); }
+
+        BasicLambdaEvent(const BasicLambdaEvent &);
+        BasicLambdaEvent &operator=(const BasicLambdaEvent &);
+    public:
+        template <class F, class = typename std::enable_if<
+                     !std::is_base_of<Event, typename std::decay<F>::type>::value>::type>
+        explicit BasicLambdaEvent(F &&f, int p = _DEFAULT_PRIORITY) : Event(p)
+        {
+            typedef typename std::decay<F>::type T;
+            static_assert(sizeof(T) <= Size,
+                          "LambdaEvent: the callable does not fit in the buffer");
+            static_assert(alignof(T) <= alignof(std::max_align_t),
+                          "LambdaEvent: over-aligned callable");
+            new (&_buf) T(std::forward<F>(f));
+            _invoke = &invoke<T>;
+            _destroy = &destroy<T>;
+        }
+
+        ~BasicLambdaEvent() { _destroy(&_buf); }
+
+        /// Calls the callable object
+        virtual void doit() final { _invoke(&_buf, this); }
+    };
+
+    typedef BasicLambdaEvent<48> LambdaEvent;
+
+} // namespace MetaSim
+
+#endif
@@ -0,0 +1,53 @@
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef __LPSYNC_HPP__
+#define __LPSYNC_HPP__
+
+#include <condition_variable>
+#include <mutex>
+
+#include <tick.hpp>
+
+/*
+  The synchronization of the logical processes, shared by the
+  parallel engines (pdes.cpp, timewarp.cpp): not installed.
+*/
+
+namespace MetaSim {
+
+    /// A reusable barrier for a fixed number of threads
+    class LPBarrier {
+        std::mutex _m;
+        std::condition_variable _cv;
+        size_t _n, _count, _gen;
+    public:
+        explicit LPBarrier(size_t n) : _n(n), _count(0), _gen(0) {}
+
+        void wait() {
+            std::unique_lock<std::mutex> l(_m);
+            size_t g = _gen;
+            if (++_count == _n) {
+                _count = 0;
+                ++_gen;
+                _cv.notify_all();
+            }
+            else _cv.wait(l, [this, g] { return _gen != g; });
+        }
+    };
+
+    /// a + b, or MAXTICK if either is MAXTICK or the sum overflows
+    inline Tick addSat(Tick a, Tick b)
+    {
+        if (a == MAXTICK || b == MAXTICK || a > Tick(MAXTICK) - b) return MAXTICK;
+        return a + b;
+    }
+
+} // namespace MetaSim
+
+#endif
@@ -19,22 +19,53 @@
 #ifndef __METASIM_HPP__
 #define __METASIM_HPP__
 
+#include <aliastable.hpp>
+#include <asyncwriter.hpp>
 #include <baseexc.hpp>
 #include <basestat.hpp>
 #include <basetype.hpp>
+#include <bufferedstat.hpp>
+#include <checkpoint.hpp>
+#include <chunktrace.hpp>
+#include <datafile.hpp>
 #include <debugstream.hpp>
+#include <distrun.hpp>
 #include <entity.hpp>
 #include <event.hpp>
+#include <eventpool.hpp>
+#include <eventqueue.hpp>
 #include <factory.hpp>
 #include <genericvar.hpp>
 #include <gevent.hpp>
 #include <history.hpp>
+#include <lambdaevent.hpp>
+#include <objectpool.hpp>
+#include <pdes.hpp>
 #include <plist.hpp>
+#include <prefetchvar.hpp>
+#include <process.hpp>
+#include <profiler.hpp>
+#include <progress.hpp>
+#include <quantilesketch.hpp>
+#include <quantilestat.hpp>
+#include <randomgen.hpp>
 #include <randomvar.hpp>
 #include <regvar.hpp>
+#include <ringwriter.hpp>
+#include <simcontext.hpp>
+#include <simloop.hpp>
 #include <simul.hpp>
+#include <statearchive.hpp>
+#include <statoutput.hpp>
 #include <strtoken.hpp>
+#include <sweep.hpp>
 #include <tick.hpp>
+#include <timeline.hpp>
+#include <timewarp.hpp>
 #include <trace.hpp>
+#include <tracebinary.hpp>
+#include <tracefilter.hpp>
+#include <windowstat.hpp>
+#include <ziggurat.hpp>
 
 #endif
@@ -0,0 +1,30 @@
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#include <algorithm>
+
+#include <objectpool.hpp>
+#include <simcontext.hpp>
+
+namespace MetaSim {
+
+    using namespace std;
+
+    ObjectPoolBase::ObjectPoolBase() : _ctx(&SimContext::current())
+    {
+        _ctx->_objectPools.push_back(this);
+    }
+
+    ObjectPoolBase::~ObjectPoolBase()
+    {
+        if (_ctx == nullptr) return;
+        vector<ObjectPoolBase *> &v = _ctx->_objectPools;
+        v.erase(find(v.begin(), v.end(), this));
+    }
+
+} // namespace MetaSim
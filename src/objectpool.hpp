@@ -0,0 +1,226 @@
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef __OBJECTPOOL_HPP__
+#define __OBJECTPOOL_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace MetaSim {
+
+    class SimContext;
+
+    /**
+       \ingroup metasim_ee
+
+       The part of an ObjectPool that does not depend on the type of
+       the objects: a pool is bound to the current context when it
+       is constructed, and the engine resets it at the end of every
+       run (see SimContext::resetObjectPools()).
+    */
+    class ObjectPoolBase {
+        friend class SimContext;
+        SimContext *_ctx;       // NULL: the context is gone
+
+        ObjectPoolBase(const ObjectPoolBase &);
+        ObjectPoolBase &operator=(const ObjectPoolBase &);
+    protected:
+        ObjectPoolBase();
+        virtual ~ObjectPoolBase();
+    public:
+        /// Destroys all the live objects
+        virtual void reset() = 0;
+    };
+
+    /**
+       \ingroup metasim_ee
+
+       A pool of the objects of type T that a model creates and
+       destroys all the time (e.g. the messages of a network), the
+       counterpart of the event pools (see EventPool) for the
+       payloads of the events. The memory is taken in chunks of
+       CHUNK objects and reused through a free list; the objects
+       still alive at the end of a run are destroyed in bulk by
+       Simulation::endSingleRun(), so a model does not have to track
+       the ones left in its queues.
+
+       make() returns a Handle, which owns the object and destroys
+       it when it goes out of scope, unless the pool was reset in
+       the meantime: a handle outliving the run is harmless (but
+       not one outliving the pool). A handle can give its object
+       to the pool with release(), so that it is destroyed with
+       destroy() or at the end of the run.
+
+       @code
+       ObjectPool<Message> messages;
+       ...
+       ObjectPool<Message>::Handle m = messages.make(len, src, dst);
+       iface.send(std::move(m));
+       @endcode
+
+       The pool must be destroyed before its context, as the other
+       objects of a model.
+    */
+    template <class T>
+    class ObjectPool : public ObjectPoolBase {
+        struct Slot {
+            typename std::aligned_storage<sizeof(T), alignof(T)>::type data;
+            // incremented when the object is destroyed
+            uint32_t gen;
+            bool live;
+            Slot *next;         // free list
+        };
+
+        std::vector<std::unique_ptr<Slot[]> > _chunks;
+        Slot *_free;
+        size_t _live;
+        size_t _peak;
+
+        static Slot *slotOf(T *p) { return reinterpret_cast<Slot *>(p); }
+
+        void grow() {
+            _chunks.emplace_back(new Slot[CHUNK]);
+            Slot *c = _chunks.back().get();
+            for (size_t i = CHUNK; i-- > 0; ) {
+                c[i].gen = 0;
+                c[i].live = false;
+                c[i].next = _free;
+                _free = &c[i];
+            }
+        }
+
+        void free(Slot *s) {
+            reinterpret_cast<T *>(&s->data)->~T();
+            s->live = false;
+            ++s->gen;
+            s->next = _free;
+            _free = s;
+            --_live;
+        }
+
+    public:
+        static const size_t CHUNK = 64;
+
+        /**
+           Owner of an object of the pool: destroys it, unless the
+           pool was reset after the object was made. Move only.
+        */
+        class Handle {
+            ObjectPool *_pool;
+            T *_obj;
+            uint32_t _gen;
+
+            friend class ObjectPool;
+            Handle(ObjectPool *p, T *o) : _pool(p), _obj(o), _gen(slotOf(o)->gen) {}
+        public:
+            Handle() : _pool(nullptr), _obj(nullptr), _gen(0) {}
+            Handle(Handle &&h) noexcept : _pool(h._pool), _obj(h._obj), _gen(h._gen) {
+                h._obj = nullptr;
+            }
+            Handle &operator=(Handle &&h) noexcept {
+                if (this != &h) {
+                    reset();
+                    _pool = h._pool;
+                    _obj = h._obj;
+                    _gen = h._gen;
+                    h._obj = nullptr;
+                }
+                return *this;
+            }
+            ~Handle() { reset(); }
+
+            /// The object, or NULL if the handle is empty or the
+            /// object was destroyed by a reset of the pool
+            T *get() const { return valid() ? _obj : nullptr; }
+            T &operator*() const { return *get(); }
+            T *operator->() const { return get(); }
+            explicit operator bool() const { return valid(); }
+
+            /// The object is still alive
+            bool valid() const {
+                return _obj != nullptr && slotOf(_obj)->gen == _gen;
+            }
+
+            /// Destroys the object now, if it is still alive
+            void reset() {
+                if (valid()) _pool->free(slotOf(_obj));
+                _obj = nullptr;
+            }
+
+            /// Gives the object to the pool, and returns it
+            T *release() {
+                T *o = get();
+                _obj = nullptr;
+                return o;
+            }
+
+            Handle(const Handle &) = delete;
+            Handle &operator=(const Handle &) = delete;
+        };
+
+        ObjectPool() : _chunks(), _free(nullptr), _live(0), _peak(0) {}
+
+        ~ObjectPool() { reset(); }
+
+        /// Creates an object with the given arguments
+        template <class... A>
+        Handle make(A&&... a) {
+            if (_free == nullptr) grow();
+            Slot *s = _free;
+            new (&s->data) T(std::forward<A>(a)...);
+            _free = s->next;
+            s->live = true;
+            if (++_live > _peak) _peak = _live;
+            return Handle(this, reinterpret_cast<T *>(&s->data));
+        }
+
+        /// Destroys an object given to the pool (see
+        /// Handle::release())
+        void destroy(T *p) { if (slotOf(p)->live) free(slotOf(p)); }
+
+        /**
+           Destroys all the live objects, and rebuilds the free
+           list in address order, so that the objects of the next
+           run are allocated sequentially in memory.
+        */
+        virtual void reset() {
+            _free = nullptr;
+            for (size_t c = _chunks.size(); c-- > 0; ) {
+                Slot *s = _chunks[c].get();
+                for (size_t i = CHUNK; i-- > 0; ) {
+                    if (s[i].live) {
+                        reinterpret_cast<T *>(&s[i].data)->~T();
+                        s[i].live = false;
+                        ++s[i].gen;
+                    }
+                    s[i].next = _free;
+                    _free = &s[i];
+                }
+            }
+            _live = 0;
+        }
+
+        /// Number of live objects
+        inline size_t live() const { return _live; }
+
+        /// The largest number of live objects at the same time
+        inline size_t peak() const { return _peak; }
+
+        /// Number of objects (live or free) in the pool
+        inline size_t capacity() const { return _chunks.size() * CHUNK; }
+    };
+
+} // namespace MetaSim
+
+#endif
@@ -22,7 +22,14 @@
 
 namespace MetaSim {
 
+    class BaseStat;
     class Event;
+
+    /// True if the probes of the particles of s are skipped during
+    /// the transitory (see BaseStat::setGated()); the probes of the
+    /// other objects (e.g. the traces) are always called
+    bool probeGated(const BaseStat *s);
+    inline bool probeGated(const void *) { return false; }
     
     /**
        \ingroup metasim
@@ -40,6 +47,9 @@ namespace MetaSim {
         virtual void probe() = 0;
 
         virtual void clone_to(Event &e) = 0;
+
+        /// The probe is skipped during the transitory
+        virtual bool gated() const { return false; }
     };
 
     /**
@@ -103,6 +113,8 @@ namespace MetaSim {
             staptr_->probe(*evtptr_);
         }
 
+        virtual bool gated() const { return probeGated(staptr_); }
+
         /**
            Copies a particle to a new event. It uses a static_cast<>
            to force type of event. This is not clean, but for the
@@ -0,0 +1,231 @@
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#include <algorithm>
+#include <sstream>
+#include <thread>
+#include <typeinfo>
+
+#include <event.hpp>
+#include <lpsync.hpp>
+#include <pdes.hpp>
+#include <simul.hpp>
+
+namespace MetaSim {
+
+    using namespace std;
+
+    ParallelSimulation::ParallelSimulation(size_t nLP) :
+        _lps(), _index(), _la(nLP * nLP, MAXTICK), _outbox(nLP),
+        _bound(nLP, 0), _errors(nLP), _barrier(),
+        _inWindow(false), _done(false), _endTick(0), _windows(0)
+    {
+        if (nLP == 0) throw Exc("At least one logical process is needed");
+        for (size_t i = 0; i < nLP; ++i) {
+            _lps.push_back(unique_ptr<SimContext>(new SimContext()));
+            _lps[i]->setRouter(this);
+            _index[_lps[i].get()] = i;
+        }
+    }
+
+    ParallelSimulation::~ParallelSimulation()
+    {
+        for (auto &lp : _lps) lp->setRouter(nullptr);
+    }
+
+    SimContext &ParallelSimulation::getLP(size_t i)
+    {
+        if (i >= _lps.size()) throw Exc("Wrong logical process index");
+        return *_lps[i];
+    }
+
+    void ParallelSimulation::setLookahead(size_t from, size_t to, Tick l)
+    {
+        size_t n = _lps.size();
+        if (from >= n || to >= n) throw Exc("Wrong logical process index");
+        if (l < 1) throw Exc("The lookahead must be at least 1 tick");
+        _la[from * n + to] = l;
+    }
+
+    void ParallelSimulation::setLookahead(Tick l)
+    {
+        for (size_t i = 0; i < _lps.size(); ++i)
+            for (size_t j = 0; j < _lps.size(); ++j)
+                if (i != j) setLookahead(i, j, l);
+    }
+
+    void ParallelSimulation::route(SimContext &from, Event *e, Tick t, bool disp)
+    {
+        // outside of the windows (e.g. in newRun()), everything
+        // is sequential: post it directly
+        if (!_inWindow) {
+            SimContext::Scope s(e->getContext());
+            e->post(t, disp);
+            return;
+        }
+
+        auto i = _index.find(&from);
+        if (i == _index.end())
+            throw Exc("Posting an event in a logical process from outside");
+        size_t src = i->second;
+        size_t dst = _index.at(&e->getContext());
+
+        Tick la = _la[src * _lps.size() + dst];
+        Tick now = from.getSimulation().getTime();
+        if (la == MAXTICK || t < addSat(now, la)) {
+            stringstream str;
+            str << "Time: " << now << " -- Posting event "
+                << typeid(*e).name() << " from LP " << src
+                << " to LP " << dst << " at time " << t
+                << " violates the lookahead";
+            throw Exc(str.str());
+        }
+        _outbox[src].push_back(Message{ e, t, disp, src, _outbox[src].size() });
+    }
+
+    Tick ParallelSimulation::nextTime(size_t i)
+    {
+        Event *f = _lps[i]->firstEvent();
+        return f == NULL ? Tick(MAXTICK) : f->getTime();
+    }
+
+    void ParallelSimulation::deliver()
+    {
+        vector<Message> msgs;
+        for (auto &o : _outbox) {
+            msgs.insert(msgs.end(), o.begin(), o.end());
+            o.clear();
+        }
+        sort(msgs.begin(), msgs.end(), [](const Message &a, const Message &b) {
+                if (a.t != b.t) return a.t < b.t;
+                if (a.e->getPriority() != b.e->getPriority())
+                    return a.e->getPriority() < b.e->getPriority();
+                if (a.src != b.src) return a.src < b.src;
+                return a.seq < b.seq;
+            });
+        for (auto &m : msgs) {
+            size_t dst = _index.at(&m.e->getContext());
+            try {
+                SimContext::Scope s(m.e->getContext());
+                m.e->post(m.t, m.disp);
+            } catch (...) {
+                if (!_errors[dst]) _errors[dst] = current_exception();
+            }
+        }
+    }
+
+    void ParallelSimulation::computeWindow()
+    {
+        size_t n = _lps.size();
+        vector<Tick> next(n);
+        bool pending = false, error = false;
+        for (size_t i = 0; i < n; ++i) {
+            next[i] = nextTime(i);
+            if (next[i] < _endTick) pending = true;
+            if (_errors[i]) error = true;
+        }
+        _done = error || !pending;
+        if (_done) return;
+
+        for (size_t j = 0; j < n; ++j) {
+            Tick b = _endTick;
+            for (size_t i = 0; i < n; ++i)
+                if (i != j) b = min(b, addSat(next[i], _la[i * n + j]));
+            _bound[j] = b;
+        }
+        ++_windows;
+    }
+
+    void ParallelSimulation::worker(size_t i)
+    {
+        SimContext &ctx = *_lps[i];
+        SimContext::Scope s(ctx);
+        Simulation &sim = ctx.getSimulation();
+
+        while (true) {
+            _barrier->wait();
+            if (_done) break;
+
+            if (!_errors[i]) {
+                try {
+                    Tick b = _bound[i];
+                    Event *f;
+                    while ((f = ctx.firstEvent()) != NULL &&
+                           f->getTime() < b)
+                        sim.sim_step();
+                } catch (...) {
+                    _errors[i] = current_exception();
+                }
+            }
+
+            _barrier->wait();
+            if (i == 0) {
+                _inWindow = false;
+                deliver();
+                computeWindow();
+                _inWindow = true;
+            }
+        }
+    }
+
+    void ParallelSimulation::singleRun()
+    {
+        size_t n = _lps.size();
+
+        for (auto &lp : _lps) lp->getSimulation().initSingleRun();
+
+        _barrier.reset(new LPBarrier(n));
+        computeWindow();
+        _inWindow = true;
+        vector<thread> th;
+        for (size_t i = 1; i < n; ++i)
+            th.push_back(thread(&ParallelSimulation::worker, this, i));
+        worker(0);
+        for (auto &t : th) t.join();
+        _inWindow = false;
+
+        for (size_t i = 0; i < n; ++i)
+            if (_errors[i]) {
+                exception_ptr e = _errors[i];
+                fill(_errors.begin(), _errors.end(), exception_ptr());
+                for (auto &lp : _lps) lp->getSimulation().endSingleRun();
+                rethrow_exception(e);
+            }
+
+        // like the sequential engine, execute the first event
+        // at or after the end of the simulation
+        size_t first = n;
+        Event *fe = NULL;
+        for (size_t i = 0; i < n; ++i) {
+            Event *f = _lps[i]->firstEvent();
+            if (f == NULL) continue;
+            if (fe == NULL || f->getTime() < fe->getTime() ||
+                (f->getTime() == fe->getTime() &&
+                 f->getPriority() < fe->getPriority())) {
+                fe = f;
+                first = i;
+            }
+        }
+        if (fe != NULL) _lps[first]->getSimulation().sim_step();
+
+        for (auto &lp : _lps) lp->getSimulation().endSingleRun();
+    }
+
+    void ParallelSimulation::run(Tick endTick, int runs)
+    {
+        if (runs < 1) throw Exc("The number of runs must be positive");
+        if (runs == 2) runs = 3;
+
+        _endTick = endTick;
+        _windows = 0;
+        for (auto &lp : _lps) lp->getSimulation().initRuns(runs);
+        for (int r = 0; r < runs; ++r) singleRun();
+        for (auto &lp : _lps) lp->getSimulation().endSim();
+    }
+
+} // namespace MetaSim
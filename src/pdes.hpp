@@ -0,0 +1,151 @@
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef __PDES_HPP__
+#define __PDES_HPP__
+
+#include <exception>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include <baseexc.hpp>
+#include <basetype.hpp>
+#include <simcontext.hpp>
+
+namespace MetaSim {
+
+    class Event;
+    class LPBarrier;
+
+    /**
+       \ingroup metasim_ee
+
+       Conservative parallel simulation engine, based on the YAWNS
+       window protocol.
+
+       The model is partitioned into logical processes (LP). Each LP
+       is a SimContext, with its own event queue, clock, entities
+       and statistics, and is executed by its own thread. The user
+       creates the entities of each LP inside a scope of that LP,
+       and declares the lookahead of the links between LPs, that is
+       the minimum delay between the time of an event executed in
+       one LP and the time of an event it posts in another LP:
+
+       @code
+       ParallelSimulation psim(2);
+       psim.setLookahead(0, 1, 10);
+       psim.setLookahead(1, 0, 10);
+       {
+           SimContext::Scope s(psim.getLP(0));
+           // create the entities of LP 0
+       }
+       // same for LP 1
+       psim.run(100000);
+       @endcode
+
+       The simulation proceeds in windows. At the beginning of each
+       window, every LP j computes the bound
+       B_j = min_i (next_i + lookahead(i, j)), where next_i is the
+       time of the first event of LP i; all the LPs then execute in
+       parallel the events earlier than their bound. An event posted
+       in LP j from LP i is not inserted immediately: it is buffered
+       and delivered at the end of the window, in an order that only
+       depends on the model (time, priority, sending LP, order of
+       sending), so the simulation is deterministic. Posting an
+       event in a LP closer than the lookahead, or across a link
+       without lookahead, raises an exception.
+
+       The execution is equivalent to the sequential Simulation::run()
+       (including the execution of the first event after the end of
+       the simulation), except for the order of simultaneous events
+       with equal priority coming from different LPs.
+
+       Since the sending LP does not touch the posted event, a LP can
+       post the events of another LP (e.g. the GEvent of an entity
+       of that LP). However, the event must not be posted or dropped
+       by its own LP during the same window.
+    */
+    class ParallelSimulation : public EventRouter {
+    public:
+        /**
+           \ingroup metasim_exc
+        */
+        class Exc : public BaseExc {
+        public:
+            Exc(const std::string &msg) :
+                BaseExc(msg, "ParallelSimulation", "pdes.cpp") {}
+        };
+
+        /// Creates nLP logical processes, with no link between them
+        explicit ParallelSimulation(size_t nLP);
+        ~ParallelSimulation();
+
+        /// Number of logical processes
+        inline size_t getLPNum() const { return _lps.size(); }
+
+        /// Returns the context of the i-th logical process
+        SimContext &getLP(size_t i);
+
+        /// Declares the lookahead (at least 1 tick) of the link
+        /// from LP "from" to LP "to"
+        void setLookahead(size_t from, size_t to, Tick l);
+
+        /// Declares the same lookahead for all the links
+        void setLookahead(Tick l);
+
+        /**
+           Runs the simulation. Like Simulation::run(), it calls
+           newRun() and endRun() on all the entities for each run,
+           and collects the statistics of all the LPs.
+        */
+        void run(Tick endTick, int runs = 1);
+
+        /// Number of windows executed in the last call of run()
+        inline size_t getWindows() const { return _windows; }
+
+        virtual void route(SimContext &from, Event *e, Tick t, bool disp);
+
+    private:
+        struct Message {
+            Event *e;
+            Tick t;
+            bool disp;
+            size_t src;
+            size_t seq;
+        };
+
+
+        std::vector<std::unique_ptr<SimContext> > _lps;
+        std::map<const SimContext *, size_t> _index;
+        // lookahead matrix, _la[from * n + to]
+        std::vector<Tick> _la;
+        // messages sent in the current window, one list per sender
+        std::vector<std::vector<Message> > _outbox;
+        // end of the current window, for each LP
+        std::vector<Tick> _bound;
+        std::vector<std::exception_ptr> _errors;
+        std::unique_ptr<LPBarrier> _barrier;
+        bool _inWindow;
+        bool _done;
+        Tick _endTick;
+        size_t _windows;
+
+        Tick nextTime(size_t i);
+        void deliver();
+        void computeWindow();
+        void worker(size_t i);
+        void singleRun();
+
+        ParallelSimulation(const ParallelSimulation &);
+        ParallelSimulation &operator=(const ParallelSimulation &);
+    };
+
+} // namespace MetaSim
+
+#endif
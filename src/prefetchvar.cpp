@@ -0,0 +1,151 @@
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#include <prefetchvar.hpp>
+
+namespace MetaSim {
+
+    using namespace std;
+
+    PrefetchVar::PrefetchVar(unique_ptr<RandomVar> v, const string &key,
+                             size_t capacity) :
+        _var(move(v)), _key(key), _src(getStream(key)), _private(),
+        _epoch(getStreamEpoch()), _seen(0)
+    {
+        _gen = _src;
+        init(capacity);
+    }
+
+    PrefetchVar::PrefetchVar(const PrefetchVar &p) :
+        RandomVar(p), _var(p._var->clone()), _key(p._key), _src(p._src),
+        _private(), _epoch(p._epoch), _seen(0)
+    {
+        init(p._ring.size());
+    }
+
+    PrefetchVar::~PrefetchVar()
+    {
+        halt();
+    }
+
+    void PrefetchVar::init(size_t capacity)
+    {
+        size_t c = 16;
+        while (c < capacity) c <<= 1;
+        _ring.assign(c, 0);
+        _mask = c - 1;
+        // the helper thread writes a quarter of the ring at a time
+        _block = c / 4;
+        _head = _tail = 0;
+        _known = 0;
+        _running = false;
+        _stop = false;
+        _producerWaiting = _consumerWaiting = false;
+        _failed = false;
+    }
+
+    void PrefetchVar::restart()
+    {
+        halt();
+        // the state of the substream at the beginning of the run
+        _private = _src->clone();
+        _var->useGenerator(_private.get());
+        _seen = *_epoch;
+        _head = _tail = 0;
+        _known = 0;
+        _stop = false;
+        _failed = false;
+        _error = nullptr;
+        _thread = thread(&PrefetchVar::produce, this);
+        _running = true;
+    }
+
+    void PrefetchVar::halt()
+    {
+        if (!_running) return;
+        {
+            lock_guard<mutex> g(_lock);
+            _stop = true;
+        }
+        _cv.notify_all();
+        _thread.join();
+        _running = false;
+    }
+
+    void PrefetchVar::produce()
+    {
+        const size_t cap = _ring.size();
+        try {
+            while (!_stop.load()) {
+                size_t t = _tail.load(memory_order_relaxed);
+                if (t + _block - _head.load(memory_order_acquire) > cap) {
+                    unique_lock<mutex> g(_lock);
+                    _producerWaiting.store(true);
+                    atomic_thread_fence(memory_order_seq_cst);
+                    _cv.wait(g, [&] {
+                            return _stop.load() ||
+                                t + _block - _head.load(memory_order_acquire) <= cap;
+                        });
+                    _producerWaiting.store(false);
+                    continue;
+                }
+                // t is a multiple of the block: the block is contiguous
+                _var->fill(&_ring[t & _mask], _block);
+                _tail.store(t + _block, memory_order_release);
+                atomic_thread_fence(memory_order_seq_cst);
+                if (_consumerWaiting.load()) {
+                    lock_guard<mutex> g(_lock);
+                    _cv.notify_all();
+                }
+            }
+        } catch (...) {
+            lock_guard<mutex> g(_lock);
+            _error = current_exception();
+            _failed = true;
+            _cv.notify_all();
+        }
+    }
+
+    void PrefetchVar::waitData(size_t h)
+    {
+        size_t t = _tail.load(memory_order_acquire);
+        // a short spin, before sleeping
+        for (int i = 0; t == h && i < 256; ++i) {
+            this_thread::yield();
+            t = _tail.load(memory_order_acquire);
+        }
+        if (t == h) {
+            unique_lock<mutex> g(_lock);
+            _consumerWaiting.store(true);
+            atomic_thread_fence(memory_order_seq_cst);
+            _cv.wait(g, [&] {
+                    return _tail.load(memory_order_acquire) != h || _failed.load();
+                });
+            _consumerWaiting.store(false);
+            t = _tail.load(memory_order_acquire);
+            // the values before the exception have been read
+            if (t == h) rethrow_exception(_error);
+        }
+        _known = t;
+    }
+
+    void PrefetchVar::wakeProducer()
+    {
+        atomic_thread_fence(memory_order_seq_cst);
+        if (_producerWaiting.load(memory_order_relaxed)) {
+            lock_guard<mutex> g(_lock);
+            _cv.notify_all();
+        }
+    }
+
+    void PrefetchVar::fill(double *out, size_t n)
+    {
+        for (size_t i = 0; i < n; ++i) out[i] = get();
+    }
+
+} // namespace MetaSim
@@ -0,0 +1,134 @@
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef __PREFETCHVAR_HPP__
+#define __PREFETCHVAR_HPP__
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <randomvar.hpp>
+
+namespace MetaSim {
+
+    /**
+       \ingroup metasim_random
+
+       A variable whose values are computed in advance by a helper
+       thread, and kept in a lock-free ring (one producer, one
+       consumer): get() only reads the next value of the ring, and
+       the mathematical transforms of the wrapped variable run on
+       another core.
+
+       The wrapped variable draws from the substream of the given
+       key (see RandomVar::setStream()), through a private copy of
+       it that only the helper thread uses, so the values do not
+       depend on the timing of the threads: they are the ones that
+       the variable would give with setStream(key). At the
+       beginning of every run the substreams are seeded again: the
+       next get() notices it, discards the values in the ring and
+       starts again from the new state of the substream.
+
+       @code
+       _service.reset(new PrefetchVar(RandomVar::parsevar("normal(5, 1)"),
+                                      "service/cpu0"));
+       @endcode
+
+       The thread is started by the first get(), so a variable that
+       is never used costs nothing. The helper thread sleeps when
+       the ring is full. An exception of the wrapped variable is
+       rethrown by get(), after the values of the blocks (a quarter
+       of the ring) completed before it.
+
+       A copy starts again from the beginning of the substream of
+       the run, with its own thread.
+    */
+    class PrefetchVar : public RandomVar {
+    public:
+        /// Default number of values in the ring
+        static const size_t DEFAULT_CAPACITY = 4096;
+
+        /**
+           @param v the variable to prefetch
+           @param key the key of its substream
+           @param capacity the size of the ring (rounded up to a
+                  power of 2, at least 16)
+         */
+        PrefetchVar(std::unique_ptr<RandomVar> v, const std::string &key,
+                    size_t capacity = DEFAULT_CAPACITY);
+
+        PrefetchVar(const PrefetchVar &p);
+
+        ~PrefetchVar();
+
+        CLONEABLE(RandomVar, PrefetchVar)
+
+        inline virtual double get() final
+        {
+            if (!_running || *_epoch != _seen) restart();
+            size_t h = _head.load(std::memory_order_relaxed);
+            if (h == _known) waitData(h);
+            double x = _ring[h & _mask];
+            _head.store(h + 1, std::memory_order_release);
+            // the helper thread waits for a free block
+            if (((h + 1) & (_block - 1)) == 0) wakeProducer();
+            return x;
+        }
+
+        virtual void fill(double *out, size_t n);
+
+        virtual double getMaximum() { return _var->getMaximum(); }
+        virtual double getMinimum() { return _var->getMinimum(); }
+
+        inline const std::string &getKey() const { return _key; }
+        inline size_t getCapacity() const { return _ring.size(); }
+
+    private:
+        std::unique_ptr<RandomVar> _var;
+        std::string _key;
+        // the substream, and the copy used by the helper thread
+        RandomGen *_src;
+        std::unique_ptr<RandomGen> _private;
+        const uint64_t *_epoch;
+        uint64_t _seen;
+
+        std::vector<double> _ring;
+        size_t _mask;
+        size_t _block;
+        // the next value to read, and the end of the written ones
+        std::atomic<size_t> _head, _tail;
+        // the last value of _tail seen by get()
+        size_t _known;
+
+        std::thread _thread;
+        bool _running;
+        std::atomic<bool> _stop;
+        std::atomic<bool> _producerWaiting, _consumerWaiting;
+        std::atomic<bool> _failed;
+        std::exception_ptr _error;
+        std::mutex _lock;
+        std::condition_variable _cv;
+
+        void init(size_t capacity);
+        void produce();
+        void restart();
+        void halt();
+        void waitData(size_t h);
+        void wakeProducer();
+    };
+
+} // namespace MetaSim
+
+#endif
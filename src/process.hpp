@@ -0,0 +1,386 @@
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef __PROCESS_HPP__
+#define __PROCESS_HPP__
+
+/*
+  The processes are C++20 coroutines: this header is empty unless
+  it is compiled as C++20 (the library itself is C++14, and does
+  not depend on it). METASIM_HAVE_COROUTINES tells if it is
+  available.
+*/
+#if defined(__cpp_impl_coroutine) && defined(__has_include)
+#if __has_include(<coroutine>)
+#define METASIM_HAVE_COROUTINES 1
+#endif
+#endif
+
+#ifdef METASIM_HAVE_COROUTINES
+
+#include <algorithm>
+#include <coroutine>
+#include <cstddef>
+#include <deque>
+#include <new>
+
+#include <baseexc.hpp>
+#include <event.hpp>
+#include <eventpool.hpp>
+#include <simcontext.hpp>
+#include <simul.hpp>
+#include <tick.hpp>
+
+namespace MetaSim {
+
+    class Waitlist;
+
+    /**
+       \ingroup metasim_ee
+
+       The memory of the frames of the processes: the frames are
+       taken from the event pools (see EventPool) of the current
+       context, one pool for every size class of GRAIN bytes, up to
+       MAX_POOLED bytes; larger frames are allocated with new.
+    */
+    class ProcessFrames {
+        struct alignas(std::max_align_t) Header {
+            SimContext *ctx;    // NULL: allocated with new
+            int id;
+        };
+
+        static int poolId(size_t cls) {
+            struct Ids {
+                int v[MAX_POOLED / GRAIN + 1];
+                Ids() { for (int &i : v) i = EventPool::newId(); }
+            };
+            static const Ids ids;
+            return ids.v[cls];
+        }
+
+    public:
+        static const size_t GRAIN = 64;
+        static const size_t MAX_POOLED = 2048;
+
+        static void *allocate(size_t n) {
+            size_t cls = (n + sizeof(Header) + GRAIN - 1) / GRAIN;
+            Header *h;
+            if (cls * GRAIN > MAX_POOLED) {
+                h = static_cast<Header *>(::operator new(n + sizeof(Header)));
+                h->ctx = nullptr;
+            }
+            else {
+                SimContext &c = SimContext::current();
+                h = static_cast<Header *>(c.allocEvent(poolId(cls), cls * GRAIN));
+                h->ctx = &c;
+                h->id = poolId(cls);
+            }
+            return h + 1;
+        }
+
+        static void release(void *p) noexcept {
+            Header *h = static_cast<Header *>(p) - 1;
+            if (h->ctx) h->ctx->freeEvent(h->id, h);
+            else ::operator delete(h);
+        }
+    };
+
+    /**
+       \ingroup metasim_ee
+
+       A process: a coroutine that describes the behaviour of an
+       entity as a sequence of steps, instead of a state machine
+       spread over several event handlers. The coroutine suspends
+       itself with co_await on delay(t), on a Signal or on the
+       acquisition of a Resource, and it is resumed by one event,
+       owned by the process, which is posted again at every
+       suspension: a process costs no event object per step. The
+       frame of the coroutine is taken from the event pools of the
+       context (see ProcessFrames).
+
+       A member function of an entity becomes a process by
+       returning a Process. The process starts suspended, and
+       start() posts its first step; destroying the Process object
+       destroys the coroutine, wherever it is suspended (it leaves
+       the event queue and the waiting lists).
+
+       @code
+       class Server : public Entity {
+           Resource _cpu;
+           Process _body;
+           Process body() {
+               while (true) {
+                   co_await _cpu.acquire();
+                   co_await delay(_service.get());
+                   _cpu.release();
+               }
+           }
+       public:
+           void newRun() { _cpu.reset(); _body = body(); _body.start(0); }
+           void endRun() {}
+       };
+       @endcode
+
+       An exception thrown by the coroutine goes out of the
+       simulation step, as one thrown by an event handler, and the
+       process is then finished. The process must not destroy its
+       own Process object while it runs.
+
+       This header needs C++20 (see METASIM_HAVE_COROUTINES).
+    */
+    class Process {
+    public:
+        /**
+           \ingroup metasim_exc
+        */
+        class Exc : public BaseExc {
+        public:
+            Exc(const std::string &msg) :
+                BaseExc(msg, "Process", "process.hpp") {}
+        };
+
+        struct promise_type;
+        typedef std::coroutine_handle<promise_type> Handle;
+
+        /// The event that resumes a process
+        class Resume : public Event {
+            Handle _h;
+        public:
+            explicit Resume(Handle h) : Event(), _h(h) {}
+            void doit() { if (!_h.done()) _h.resume(); }
+        };
+
+        struct promise_type {
+            Resume event;
+            Waitlist *waiting;   // the list where it waits, if any
+
+            promise_type() : event(Handle::from_promise(*this)), waiting(nullptr) {}
+            ~promise_type();
+
+            Process get_return_object() {
+                return Process(Handle::from_promise(*this));
+            }
+            std::suspend_always initial_suspend() noexcept { return {}; }
+            std::suspend_always final_suspend() noexcept { return {}; }
+            void return_void() {}
+            void unhandled_exception() { throw; }
+
+            static void *operator new(size_t n) {
+                return ProcessFrames::allocate(n);
+            }
+            static void operator delete(void *p) noexcept {
+                ProcessFrames::release(p);
+            }
+        };
+
+        /// No process
+        Process() : _h() {}
+
+        Process(Process &&p) noexcept : _h(p._h) { p._h = Handle(); }
+
+        Process &operator=(Process &&p) noexcept {
+            if (this != &p) {
+                kill();
+                _h = p._h;
+                p._h = Handle();
+            }
+            return *this;
+        }
+
+        ~Process() { kill(); }
+
+        /// Posts the first step of the process at time t (Exc if
+        /// there is no coroutine)
+        void start(Tick t) { handle().promise().event.post(t); }
+
+        /// The process was started and it returned
+        bool done() const { return _h && _h.done(); }
+
+        /// There is a coroutine
+        explicit operator bool() const { return bool(_h); }
+
+        /// The event of the process, e.g. to set its priority (Exc
+        /// if there is no coroutine)
+        Event &getEvent() { return handle().promise().event; }
+
+        /// Destroys the coroutine, wherever it is suspended
+        void kill() {
+            if (_h) _h.destroy();
+            _h = Handle();
+        }
+
+    private:
+        explicit Process(Handle h) : _h(h) {}
+
+        Handle handle() const {
+            if (!_h) throw Exc("No coroutine in the process");
+            return _h;
+        }
+
+        Handle _h;
+
+        Process(const Process &);
+        Process &operator=(const Process &);
+    };
+
+    /**
+       \ingroup metasim_ee
+
+       co_await delay(t) suspends a process for t ticks (0: after
+       the other events of the current time).
+    */
+    struct Delay {
+        Tick t;
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(Process::Handle h) {
+            h.promise().event.post(SIMUL.getTime() + t);
+        }
+        void await_resume() const noexcept {}
+    };
+
+    inline Delay delay(Tick t) { return Delay{ t }; }
+
+    /**
+       \ingroup metasim_ee
+
+       The processes suspended on a Signal or a Resource, in FIFO
+       order.
+    */
+    class Waitlist {
+    public:
+        Waitlist() : _waiting() {}
+
+        ~Waitlist() { clear(); }
+
+        /// Number of waiting processes
+        size_t waiting() const { return _waiting.size(); }
+
+        /// Forgets the waiting processes (they stay suspended)
+        void clear() {
+            for (Process::promise_type *p : _waiting) p->waiting = nullptr;
+            _waiting.clear();
+        }
+
+    protected:
+        void wait(Process::promise_type &p) {
+            _waiting.push_back(&p);
+            p.waiting = this;
+        }
+
+        /// Posts the step of the first waiting process, now
+        void wakeFirst() {
+            Process::promise_type *p = _waiting.front();
+            _waiting.pop_front();
+            p->waiting = nullptr;
+            p->event.post(SIMUL.getTime());
+        }
+
+    private:
+        friend struct Process::promise_type;
+
+        void remove(Process::promise_type *p) {
+            _waiting.erase(std::find(_waiting.begin(), _waiting.end(), p));
+        }
+
+        std::deque<Process::promise_type *> _waiting;
+
+        Waitlist(const Waitlist &);
+        Waitlist &operator=(const Waitlist &);
+    };
+
+    inline Process::promise_type::~promise_type()
+    {
+        if (waiting) waiting->remove(this);
+    }
+
+    /**
+       \ingroup metasim_ee
+
+       co_await signal suspends a process until notify() (all the
+       waiting processes) or notifyOne() (the first one). The
+       processes are resumed at the time of the notification, in
+       the order they started waiting.
+    */
+    class Signal : public Waitlist {
+    public:
+        struct Awaiter {
+            Signal &s;
+            bool await_ready() const noexcept { return false; }
+            void await_suspend(Process::Handle h) { s.wait(h.promise()); }
+            void await_resume() const noexcept {}
+        };
+
+        Awaiter operator co_await() { return Awaiter{ *this }; }
+
+        /// Resumes all the waiting processes
+        void notify() { while (waiting() > 0) wakeFirst(); }
+
+        /// Resumes the first waiting process, if any
+        void notifyOne() { if (waiting() > 0) wakeFirst(); }
+    };
+
+    /**
+       \ingroup metasim_ee
+
+       A resource with a number of units: co_await res.acquire()
+       takes a unit, or suspends the process until release() gives
+       one to it, in FIFO order.
+    */
+    class Resource : public Waitlist {
+    public:
+        /**
+           \ingroup metasim_exc
+        */
+        class Exc : public BaseExc {
+        public:
+            Exc(const std::string &msg) :
+                BaseExc(msg, "Resource", "process.hpp") {}
+        };
+
+        struct Acquire {
+            Resource &r;
+            bool await_ready() noexcept {
+                if (r._free == 0 || r.waiting() > 0) return false;
+                --r._free;
+                return true;
+            }
+            void await_suspend(Process::Handle h) { r.wait(h.promise()); }
+            void await_resume() const noexcept {}
+        };
+
+        explicit Resource(size_t units = 1) : _units(units), _free(units) {}
+
+        /// Takes a unit (to be awaited)
+        Acquire acquire() { return Acquire{ *this }; }
+
+        /// Gives back a unit: to the first waiting process, if any
+        void release() {
+            if (waiting() > 0) wakeFirst();
+            else if (_free < _units) ++_free;
+            else throw Exc("Releasing a unit that was not acquired");
+        }
+
+        /// Number of free units
+        size_t available() const { return _free; }
+
+        /// All the units free, and no process waiting
+        void reset() {
+            clear();
+            _free = _units;
+        }
+
+    private:
+        size_t _units;
+        size_t _free;
+    };
+
+} // namespace MetaSim
+
+#endif // METASIM_HAVE_COROUTINES
+
+#endif
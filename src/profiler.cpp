@@ -0,0 +1,230 @@
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#include <algorithm>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <typeinfo>
+
+#ifdef __GNUG__
+#include <cxxabi.h>
+#endif
+
+#include <event.hpp>
+#include <profiler.hpp>
+
+namespace MetaSim {
+
+    using namespace std;
+
+    namespace {
+        // removes the arguments of GEvent that are not written by
+        // the user: GEvent<X, (void (X::*)(Event*))0, true> is
+        // shown as GEvent<X>, GEvent<X, &X::f, false> as GEvent<X, &X::f>
+        string tidyGEvent(string n)
+        {
+            const string g = "MetaSim::GEvent<";
+            if (n.compare(0, g.size(), g) != 0) return n;
+            const string dyn = ", true>", bound = ", false>";
+            size_t d = n.find(", (void (");
+            if (n.size() > dyn.size() &&
+                n.compare(n.size() - dyn.size(), dyn.size(), dyn) == 0 &&
+                d != string::npos)
+                return n.substr(0, d) + ">";
+            if (n.size() > bound.size() &&
+                n.compare(n.size() - bound.size(), bound.size(), bound) == 0)
+                return n.substr(0, n.size() - bound.size()) + ">";
+            return n;
+        }
+
+        string typeName(const type_info &t)
+        {
+#ifdef __GNUG__
+            int status = 0;
+            unique_ptr<char, void (*)(void *)>
+                n(abi::__cxa_demangle(t.name(), NULL, NULL, &status), free);
+            if (status == 0 && n) return tidyGEvent(n.get());
+#endif
+            return t.name();
+        }
+
+        inline double seconds(Profiler::Clock::duration d)
+        {
+            return chrono::duration<double>(d).count();
+        }
+    }
+
+    Profiler::Profiler() :
+        _entries(), _byType(), _byEvent(), _byName(),
+        _maxQueue(0), _wallTime(0), _runStart(), _out(&clog),
+        _timeline()
+    {
+    }
+
+    size_t Profiler::named(const string &name)
+    {
+        auto i = _byName.find(name);
+        if (i != _byName.end()) return i->second;
+        _entries.push_back(Entry(name));
+        _byName[name] = _entries.size() - 1;
+        return _entries.size() - 1;
+    }
+
+    void Profiler::setTag(const Event &e, const string &tag)
+    {
+        _byEvent[&e] = named(tag);
+    }
+
+    Profiler::Entry &Profiler::entry(const Event *e)
+    {
+        if (!_byEvent.empty()) {
+            auto i = _byEvent.find(e);
+            if (i != _byEvent.end()) return _entries[i->second];
+        }
+        type_index t(typeid(*e));
+        auto i = _byType.find(t);
+        if (i != _byType.end()) return _entries[i->second];
+        size_t k = named(typeName(typeid(*e)));
+        _byType[t] = k;
+        return _entries[k];
+    }
+
+    void Profiler::reset()
+    {
+        for (auto &e : _entries) e = Entry(e.name);
+        _maxQueue = 0;
+        _wallTime = 0;
+    }
+
+    void Profiler::merge(const Profiler &p)
+    {
+        for (auto &e : p._entries) {
+            Entry &d = _entries[named(e.name)];
+            d.posted += e.posted;
+            d.dropped += e.dropped;
+            d.executed += e.executed;
+            d.doitTime += e.doitTime;
+            d.probeTime += e.probeTime;
+        }
+        _maxQueue = max(_maxQueue, p._maxQueue);
+        _wallTime += p._wallTime;
+    }
+
+    const Profiler::Entry *Profiler::find(const string &name) const
+    {
+        auto i = _byName.find(name);
+        return i == _byName.end() ? NULL : &_entries[i->second];
+    }
+
+    uint64_t Profiler::getExecuted() const
+    {
+        uint64_t n = 0;
+        for (auto &e : _entries) n += e.executed;
+        return n;
+    }
+
+    double Profiler::getEventsPerSec() const
+    {
+        return _wallTime > 0 ? getExecuted() / _wallTime : 0;
+    }
+
+    void Profiler::posted(const Event *e, size_t queueSize)
+    {
+        ++entry(e).posted;
+        _maxQueue = max(_maxQueue, queueSize);
+    }
+
+    void Profiler::dropped(const Event *e)
+    {
+        ++entry(e).dropped;
+    }
+
+    void Profiler::execute(Event *e)
+    {
+        // the handler may post the event again
+        const Tick t = e->getTime();
+        const bool rec = _timeline && _timeline->accept(t);
+        const size_t queue = rec ? e->_ctx->getEventQueue().size() : 0;
+        Clock::time_point t0 = Clock::now();
+        e->doit();
+        Clock::time_point t1 = Clock::now();
+        e->runProbes();
+        Clock::time_point t2 = Clock::now();
+        // after the handler, which may add entries
+        Entry &en = entry(e);
+        ++en.executed;
+        en.doitTime += seconds(t1 - t0);
+        en.probeTime += seconds(t2 - t1);
+        if (rec)
+            _timeline->record(&en - &_entries[0], en.name, e->getEntity(),
+                              t, queue, t0, t1, t2);
+    }
+
+    void Profiler::startRun()
+    {
+        _runStart = Clock::now();
+        if (_timeline) _timeline->startRun();
+    }
+
+    void Profiler::stopRun()
+    {
+        _wallTime += seconds(Clock::now() - _runStart);
+        if (_timeline) _timeline->flush();
+    }
+
+    Timeline &Profiler::enableTimeline(const string &path)
+    {
+        // the old file is closed first, as it may be the same
+        _timeline.reset();
+        _timeline.reset(new Timeline(path));
+        return *_timeline;
+    }
+
+    void Profiler::disableTimeline()
+    {
+        _timeline.reset();
+    }
+
+    void Profiler::report(ostream &os) const
+    {
+        vector<const Entry *> v;
+        for (auto &e : _entries) v.push_back(&e);
+        sort(v.begin(), v.end(), [](const Entry *a, const Entry *b) {
+                return a->doitTime > b->doitTime;
+            });
+
+        ios::fmtflags f = os.flags();
+        os << "==== MetaSim profile ====" << endl
+           << "executed events : " << getExecuted() << endl
+           << "wall time (s)   : " << _wallTime << endl
+           << "events / s      : " << getEventsPerSec() << endl
+           << "max queue size  : " << _maxQueue << endl;
+        os << setw(12) << "executed" << setw(12) << "posted"
+           << setw(12) << "dropped" << setw(12) << "doit (ms)"
+           << setw(12) << "probe (ms)" << setw(12) << "us/event"
+           << "  event" << endl;
+        os << fixed << setprecision(3);
+        for (const Entry *e : v) {
+            double per = e->executed > 0 ?
+                1e6 * (e->doitTime + e->probeTime) / e->executed : 0;
+            os << setw(12) << e->executed << setw(12) << e->posted
+               << setw(12) << e->dropped << setw(12) << 1e3 * e->doitTime
+               << setw(12) << 1e3 * e->probeTime << setw(12) << per
+               << "  " << e->name << endl;
+        }
+        os.flags(f);
+    }
+
+    void Profiler::report() const
+    {
+        if (_out != NULL) report(*_out);
+    }
+
+} // namespace MetaSim
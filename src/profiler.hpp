@@ -0,0 +1,161 @@
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef __PROFILER_HPP__
+#define __PROFILER_HPP__
+
+#include <chrono>
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <string>
+#include <typeindex>
+#include <unordered_map>
+#include <vector>
+
+#include <timeline.hpp>
+
+namespace MetaSim {
+
+    class Event;
+
+    /**
+       \ingroup metasim_ee
+
+       Profiler of the simulation engine. For each type of event
+       (or for each tag, see setTag()) it counts the events posted,
+       dropped and executed, and measures the wall time spent in
+       their doit() and in their particle probes. It also records
+       the maximum size of the event queue, and the number of
+       events executed per second of wall time.
+
+       The profiler is disabled by default, and then it costs a
+       test of a NULL pointer per post and per executed event. It
+       is enabled on a context with SimContext::enableProfiler(),
+       or in all contexts by setting the environment variable
+       METASIM_PROFILE to 1, without recompiling the model:
+
+       @code
+       SimContext::getDefault().enableProfiler();
+       SIMUL.run(10000, 10);   // prints the report at the end
+       Profiler *p = SimContext::getDefault().getProfiler();
+       @endcode
+
+       The data are reset by Simulation::initRuns() and the report
+       is printed by the engine at the end of the simulation (see
+       setOutput()). With the parallel replications of
+       Simulation::run(), the data of all the runs are merged in the
+       profiler of the calling context.
+
+       The profiler can also record a timeline of the events (see
+       Timeline), to find when they are slow.
+    */
+    class Profiler {
+    public:
+        typedef std::chrono::steady_clock Clock;
+
+        /// The counters of a type of event
+        struct Entry {
+            std::string name;
+            uint64_t posted;
+            uint64_t dropped;
+            uint64_t executed;
+            /// wall time in doit(), in seconds
+            double doitTime;
+            /// wall time in the particle probes, in seconds
+            double probeTime;
+
+            explicit Entry(const std::string &n = "") :
+                name(n), posted(0), dropped(0), executed(0),
+                doitTime(0), probeTime(0) {}
+        };
+
+        Profiler();
+
+        /**
+           Gives the name tag to an event, so that it is counted
+           separately from the other events of the same type (e.g.
+           to distinguish the GEvent members of an entity). The
+           events with the same tag share the same entry. The tag
+           is bound to the address of the event, so it is meant
+           for events that live as long as the model.
+        */
+        void setTag(const Event &e, const std::string &tag);
+
+        /// Sets the stream of the report printed at the end of the
+        /// simulation (std::clog by default, NULL for none)
+        inline void setOutput(std::ostream *os) { _out = os; }
+
+        /// Removes all the data
+        void reset();
+
+        /// Adds the data of another profiler to this one
+        void merge(const Profiler &p);
+
+        /// Returns the entries, one per type of event or tag
+        inline const std::vector<Entry> &getEntries() const { return _entries; }
+
+        /// Returns the entry with the given name, or NULL
+        const Entry *find(const std::string &name) const;
+
+        /// Total number of executed events
+        uint64_t getExecuted() const;
+
+        /// Maximum number of events in the queue
+        inline size_t getMaxQueueSize() const { return _maxQueue; }
+
+        /// Wall time spent in the runs, in seconds
+        inline double getWallTime() const { return _wallTime; }
+
+        /// Executed events per second of wall time
+        double getEventsPerSec() const;
+
+        /// Prints the report, sorted by decreasing time in doit()
+        void report(std::ostream &os) const;
+
+        /// Prints the report on the output stream, if any
+        void report() const;
+
+        /// Records the timeline of the events in a file (see
+        /// Timeline), replacing the current one
+        Timeline &enableTimeline(const std::string &path);
+
+        /// Stops recording the timeline, and closes its file
+        void disableTimeline();
+
+        /// The timeline, or NULL if disabled
+        inline Timeline *getTimeline() const { return _timeline.get(); }
+
+        /// \name Engine interface
+        //@{
+        void posted(const Event *e, size_t queueSize);
+        void dropped(const Event *e);
+        /// Executes doit() and the probes of e, measuring them
+        void execute(Event *e);
+        void startRun();
+        void stopRun();
+        //@}
+
+    private:
+        std::vector<Entry> _entries;
+        std::unordered_map<std::type_index, size_t> _byType;
+        std::unordered_map<const Event *, size_t> _byEvent;
+        std::unordered_map<std::string, size_t> _byName;
+        size_t _maxQueue;
+        double _wallTime;
+        Clock::time_point _runStart;
+        std::ostream *_out;
+        std::unique_ptr<Timeline> _timeline;
+
+        Entry &entry(const Event *e);
+        size_t named(const std::string &name);
+    };
+
+} // namespace MetaSim
+
+#endif
@@ -0,0 +1,92 @@
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#include <cstdio>
+#include <fstream>
+#include <ostream>
+
+#include <progress.hpp>
+
+namespace MetaSim {
+
+    using namespace std;
+
+    Progress::Progress(uint64_t every) :
+        _every(every == 0 ? 1 : every), _callback(), _path(),
+        _start(Clock::now()), _lastWall(_start), _lastEvents(0),
+        _lastTime(0), _last()
+    {
+    }
+
+    void Progress::setInterval(uint64_t every)
+    {
+        _every = every == 0 ? 1 : every;
+    }
+
+    void Progress::start(uint64_t events)
+    {
+        _start = _lastWall = Clock::now();
+        _lastEvents = events;
+        _lastTime = 0;
+    }
+
+    void Progress::report(Sample &s)
+    {
+        Clock::time_point now = Clock::now();
+        s.wallTime = chrono::duration<double>(now - _start).count();
+        double dt = chrono::duration<double>(now - _lastWall).count();
+        // a new run starts again from time 0
+        double ds = s.time >= _lastTime ? s.time - _lastTime : s.time;
+        if (dt > 0) {
+            s.eventsPerSec = double(s.events - _lastEvents) / dt;
+            s.simPerSec = ds / dt;
+        }
+        else {
+            s.eventsPerSec = _last.eventsPerSec;
+            s.simPerSec = _last.simPerSec;
+        }
+        if (s.final) s.eta = 0;
+        else if (s.done > 0) s.eta = s.wallTime * (1 - s.done) / s.done;
+        else s.eta = -1;
+
+        _lastWall = now;
+        _lastEvents = s.events;
+        _lastTime = s.time;
+        _last = s;
+
+        if (_callback) _callback(s);
+        if (!_path.empty()) {
+            // written aside, then renamed: a reader never sees
+            // half a report
+            string tmp = _path + ".tmp";
+            {
+                ofstream f(tmp.c_str());
+                writeJson(f, s);
+            }
+            rename(tmp.c_str(), _path.c_str());
+        }
+    }
+
+    void Progress::writeJson(ostream &os, const Sample &s)
+    {
+        os << "{\"run\": " << s.run
+           << ", \"runs\": " << s.runs
+           << ", \"time\": " << s.time
+           << ", \"end_time\": " << s.endTime
+           << ", \"events\": " << s.events
+           << ", \"queue\": " << s.queueSize
+           << ", \"wall\": " << s.wallTime
+           << ", \"events_per_sec\": " << s.eventsPerSec
+           << ", \"sim_per_sec\": " << s.simPerSec
+           << ", \"done\": " << s.done
+           << ", \"eta\": " << s.eta
+           << ", \"final\": " << (s.final ? "true" : "false")
+           << "}\n";
+    }
+
+} // namespace MetaSim
@@ -0,0 +1,122 @@
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef __PROGRESS_HPP__
+#define __PROGRESS_HPP__
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <iosfwd>
+#include <string>
+
+namespace MetaSim {
+
+    /**
+       \ingroup metasim_ee
+
+       The progress of a long simulation, reported every n events
+       executed by the engine (a counter is tested per event, the
+       clock is read only at the reports), at the end of every run
+       and at the end of the simulation: the simulated time against
+       the wall time, the events per second, the size of the queue,
+       the current run and an estimate of the time left. A report
+       goes to a callback, and to a JSON file that is replaced
+       atomically, so that another process (e.g. the scheduler of
+       a cluster, to stop the stragglers) can poll it.
+
+       It is enabled on a context with SimContext::enableProgress(),
+       or in all contexts by setting the environment variable
+       METASIM_PROGRESS to the name of the file:
+
+       @code
+       Progress &p = SimContext::getDefault().enableProgress(1000000);
+       p.setCallback([](const Progress::Sample &s) {
+           cerr << s.eventsPerSec << " events/s, ETA " << s.eta << " s\n";
+       });
+       SIMUL.run(endTick, 100);
+       @endcode
+
+       The estimate of the time left assumes that the runs advance
+       at the same pace in simulated time. The parallel replications
+       of Simulation::run() are not reported.
+    */
+    class Progress {
+    public:
+        typedef std::chrono::steady_clock Clock;
+
+        /// A report
+        struct Sample {
+            /// Index of the current run, and number of runs
+            size_t run;
+            size_t runs;
+            /// Simulated time, and end of the run
+            double time;
+            double endTime;
+            /// Events executed since the start of the simulation
+            uint64_t events;
+            /// Pending events
+            size_t queueSize;
+            /// Seconds of wall time since the start of the
+            /// simulation
+            double wallTime;
+            /// Events and ticks of simulated time per second of
+            /// wall time, since the last report
+            double eventsPerSec;
+            double simPerSec;
+            /// Fraction of the simulation done, in [0, 1]
+            double done;
+            /// Estimated seconds of wall time left (-1: unknown)
+            double eta;
+            /// The simulation is over
+            bool final;
+        };
+
+        typedef std::function<void(const Sample &)> Callback;
+
+        /// Reports every n executed events
+        explicit Progress(uint64_t every = 1000000);
+
+        inline uint64_t getInterval() const { return _every; }
+        void setInterval(uint64_t every);
+
+        /// The function called at every report (empty: none)
+        inline void setCallback(const Callback &c) { _callback = c; }
+
+        /// The file written at every report (empty: none)
+        inline void setFile(const std::string &path) { _path = path; }
+        inline const std::string &getFile() const { return _path; }
+
+        /// The last report
+        inline const Sample &last() const { return _last; }
+
+        /// Writes a report as a JSON object
+        static void writeJson(std::ostream &os, const Sample &s);
+
+    private:
+        friend class Simulation;
+
+        /// The simulation starts
+        void start(uint64_t events);
+
+        /// Completes the wall time fields of s, and reports it
+        void report(Sample &s);
+
+        uint64_t _every;
+        Callback _callback;
+        std::string _path;
+        Clock::time_point _start;
+        Clock::time_point _lastWall;
+        uint64_t _lastEvents;
+        double _lastTime;
+        Sample _last;
+    };
+
+} // namespace MetaSim
+
+#endif
@@ -0,0 +1,235 @@
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#include <algorithm>
+#include <cmath>
+
+#include <quantilesketch.hpp>
+
+namespace MetaSim {
+
+    using namespace std;
+
+    const unsigned HdrHistogram::DEFAULT_PRECISION;
+
+    HdrHistogram::HdrHistogram(double lowest, double highest, unsigned precision) :
+        _lowest(lowest), _highest(highest), _shift(52 - precision)
+    {
+        if (!(lowest > 0) || !(highest > lowest) || std::isinf(highest))
+            throw Exc("Invalid range of the histogram");
+        if (precision < 1 || precision > 20)
+            throw Exc("The precision must be from 1 to 20 bits");
+        _base = (bits(lowest) >> _shift) - 1;
+        _counts.resize(size_t((bits(highest) >> _shift) - _base + 1));
+        reset();
+    }
+
+    void HdrHistogram::reset()
+    {
+        fill(_counts.begin(), _counts.end(), 0);
+        _count = 0;
+        _sum = 0;
+        _min = numeric_limits<double>::max();
+        _max = numeric_limits<double>::lowest();
+    }
+
+    double HdrHistogram::value(size_t i) const
+    {
+        if (i == 0) return _min;
+        if (i == _counts.size() - 1) return _max;
+        uint64_t b = (uint64_t(i) + _base) << _shift;
+        double lo, hi;
+        memcpy(&lo, &b, sizeof(lo));
+        b += uint64_t(1) << _shift;
+        memcpy(&hi, &b, sizeof(hi));
+        return (lo + hi) / 2;
+    }
+
+    double HdrHistogram::quantile(double q) const
+    {
+        if (_count == 0) return 0;
+        if (q <= 0) return _min;
+        if (q >= 1) return _max;
+
+        uint64_t rank = max(uint64_t(1), uint64_t(ceil(q * _count)));
+        uint64_t seen = 0;
+        size_t i = 0;
+        for (; i < _counts.size(); ++i)
+            if ((seen += _counts[i]) >= rank) break;
+        return min(_max, max(_min, value(i)));
+    }
+
+    void HdrHistogram::merge(const HdrHistogram &h)
+    {
+        if (h._shift != _shift || h._base != _base || h.size() != size())
+            throw Exc("Merging histograms of different ranges");
+        for (size_t i = 0; i < _counts.size(); ++i) _counts[i] += h._counts[i];
+        _count += h._count;
+        _sum += h._sum;
+        _min = min(_min, h._min);
+        _max = max(_max, h._max);
+    }
+
+    void HdrHistogram::saveState(StateArchive &a) const
+    {
+        a.save(_count);
+        a.save(_sum);
+        a.save(_min);
+        a.save(_max);
+        size_t n = _counts.size() - size_t(count(_counts.begin(), _counts.end(), 0));
+        a.save(n);
+        for (size_t i = 0; i < _counts.size(); ++i)
+            if (_counts[i]) {
+                a.save(i);
+                a.save(_counts[i]);
+            }
+    }
+
+    void HdrHistogram::restoreState(StateArchive &a)
+    {
+        fill(_counts.begin(), _counts.end(), 0);
+        a.restore(_count);
+        a.restore(_sum);
+        a.restore(_min);
+        a.restore(_max);
+        size_t n, i;
+        a.restore(n);
+        while (n-- > 0) {
+            a.restore(i);
+            if (i >= _counts.size()) throw Exc("Restoring a different histogram");
+            a.restore(_counts[i]);
+        }
+    }
+
+    /*---------------------------------------------------*/
+
+    const unsigned TDigest::DEFAULT_COMPRESSION;
+
+    namespace {
+        // the k1 scale function: a centroid starting at rank q0
+        // can grow up to the rank kLimit(q0) (k grows by 1)
+        inline double kLimit(double q0, double compression)
+        {
+            double k = compression / (2 * M_PI) * asin(2 * q0 - 1) + 1;
+            double x = min(k * 2 * M_PI / compression, M_PI / 2);
+            return (sin(x) + 1) / 2;
+        }
+    }
+
+    TDigest::TDigest(unsigned compression, size_t buffer) :
+        _compression(compression),
+        _capacity(buffer ? buffer : 5 * size_t(compression))
+    {
+        if (compression < 10)
+            throw Exc("The compression must be at least 10");
+        _centroids.reserve(compression);
+        _buf.reserve(_capacity);
+        _tmp.reserve(_capacity + compression);
+        reset();
+    }
+
+    void TDigest::reset()
+    {
+        _centroids.clear();
+        _buf.clear();
+        _count = 0;
+        _min = numeric_limits<double>::max();
+        _max = numeric_limits<double>::lowest();
+    }
+
+    void TDigest::compress()
+    {
+        if (_buf.empty()) return;
+        auto less = [](const Centroid &a, const Centroid &b) { return a.mean < b.mean; };
+        sort(_buf.begin(), _buf.end(), less);
+        _tmp.resize(_centroids.size() + _buf.size());
+        std::merge(_centroids.begin(), _centroids.end(), _buf.begin(), _buf.end(),
+                   _tmp.begin(), less);
+        _buf.clear();
+
+        _centroids.clear();
+        double done = 0;
+        double limit = _count * kLimit(0, _compression);
+        Centroid cur = _tmp[0];
+        for (size_t i = 1; i < _tmp.size(); ++i) {
+            const Centroid &x = _tmp[i];
+            if (done + cur.weight + x.weight <= limit) {
+                cur.weight += x.weight;
+                cur.mean += (x.mean - cur.mean) * x.weight / cur.weight;
+            } else {
+                done += cur.weight;
+                _centroids.push_back(cur);
+                limit = _count * kLimit(done / _count, _compression);
+                cur = x;
+            }
+        }
+        _centroids.push_back(cur);
+    }
+
+    double TDigest::quantile(double q)
+    {
+        compress();
+        if (_count == 0) return 0;
+        if (q <= 0) return _min;
+        if (q >= 1) return _max;
+        size_t n = _centroids.size();
+        if (n == 1) return _centroids[0].mean;
+
+        // linear interpolation between the centres of the
+        // centroids, and with the extremes in the tails
+        double target = q * _count;
+        const Centroid &first = _centroids[0], &last = _centroids[n - 1];
+        if (target < first.weight / 2)
+            return _min + (first.mean - _min) * target / (first.weight / 2);
+        double cum = 0;
+        for (size_t i = 0; i + 1 < n; ++i) {
+            const Centroid &a = _centroids[i], &b = _centroids[i + 1];
+            double left = cum + a.weight / 2, right = cum + a.weight + b.weight / 2;
+            if (target < right)
+                return a.mean + (b.mean - a.mean) * (target - left) / (right - left);
+            cum += a.weight;
+        }
+        double left = _count - last.weight / 2;
+        return min(_max, last.mean + (_max - last.mean) * (target - left) / (last.weight / 2));
+    }
+
+    void TDigest::merge(const TDigest &d)
+    {
+        for (const Centroid &c : d._centroids) record(c.mean, c.weight);
+        for (const Centroid &c : d._buf) record(c.mean, c.weight);
+        _min = min(_min, d._min);
+        _max = max(_max, d._max);
+    }
+
+    void TDigest::saveState(StateArchive &a) const
+    {
+        a.save(_count);
+        a.save(_min);
+        a.save(_max);
+        a.save(_centroids.size());
+        for (const Centroid &c : _centroids) a.save(c);
+        a.save(_buf.size());
+        for (const Centroid &c : _buf) a.save(c);
+    }
+
+    void TDigest::restoreState(StateArchive &a)
+    {
+        a.restore(_count);
+        a.restore(_min);
+        a.restore(_max);
+        size_t n;
+        a.restore(n);
+        _centroids.resize(n);
+        for (Centroid &c : _centroids) a.restore(c);
+        a.restore(n);
+        if (n > _capacity) throw Exc("Restoring a different digest");
+        _buf.resize(n);
+        for (Centroid &c : _buf) a.restore(c);
+    }
+
+} // namespace MetaSim
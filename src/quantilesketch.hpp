@@ -0,0 +1,205 @@
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef __QUANTILESKETCH_HPP__
+#define __QUANTILESKETCH_HPP__
+
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include <baseexc.hpp>
+#include <statearchive.hpp>
+
+namespace MetaSim {
+
+    /**
+       \ingroup metasim_stat
+
+       A histogram with logarithmic buckets, as the HDR histogram
+       of Tene: every power of 2 in [lowest, highest) is divided in
+       2^precision buckets of the same width, so a quantile is
+       computed with a relative error of at most 2^-(precision + 1).
+       record() takes the bucket from the bits of the double, in
+       constant time and without branches on the value; the memory
+       is fixed by the range (8 bytes for each bucket, e.g. 51 KB
+       for the default range and precision).
+
+       The values below lowest (and 0) are counted in one bucket,
+       the values above highest in the last one; the quantiles are
+       always in [getMin(), getMax()], which are exact.
+    */
+    class HdrHistogram {
+    public:
+        /**
+           \ingroup metasim_exc
+        */
+        class Exc : public BaseExc {
+        public:
+            Exc(const std::string &msg) :
+                BaseExc(msg, "HdrHistogram", "quantilesketch.hpp") {}
+        };
+
+        /// Default number of bits of each power of 2
+        static const unsigned DEFAULT_PRECISION = 7;
+
+        /**
+           @param lowest the smallest value distinguished (> 0)
+           @param highest the largest value distinguished
+           @param precision the number of bits of the buckets
+                  (from 1 to 20)
+        */
+        explicit HdrHistogram(double lowest = 1e-6, double highest = 1e9,
+                              unsigned precision = DEFAULT_PRECISION);
+
+        /// Adds a value
+        inline void record(double v)
+        {
+            ++_counts[index(v)];
+            ++_count;
+            _sum += v;
+            if (v < _min) _min = v;
+            if (v > _max) _max = v;
+        }
+
+        /// The value of order q, in [0, 1]
+        double quantile(double q) const;
+
+        /// Adds the values of another histogram, with the same
+        /// range and precision
+        void merge(const HdrHistogram &h);
+
+        /// Removes all the values
+        void reset();
+
+        inline uint64_t getCount() const { return _count; }
+        inline double getMean() const { return _count ? _sum / _count : 0; }
+        inline double getMin() const { return _min; }
+        inline double getMax() const { return _max; }
+
+        /// Number of buckets
+        inline size_t size() const { return _counts.size(); }
+
+        /// Saves the non-empty buckets
+        void saveState(StateArchive &a) const;
+        void restoreState(StateArchive &a);
+
+    private:
+        static inline uint64_t bits(double v)
+        {
+            uint64_t b;
+            std::memcpy(&b, &v, sizeof(b));
+            return b;
+        }
+
+        inline size_t index(double v) const
+        {
+            // the exponent and the first bits of the mantissa
+            if (!(v > _lowest)) return 0;
+            if (v >= _highest) return _counts.size() - 1;
+            return size_t((bits(v) >> _shift) - _base);
+        }
+
+        /// the centre of bucket i
+        double value(size_t i) const;
+
+        double _lowest, _highest;
+        unsigned _shift;
+        uint64_t _base;
+        std::vector<uint64_t> _counts;
+        uint64_t _count;
+        double _sum, _min, _max;
+    };
+
+    /**
+       \ingroup metasim_stat
+
+       The merging t-digest of Dunning: the values are summarized
+       by at most about compression clusters (centroids), small in
+       the tails and large in the middle (the k1 scale function),
+       so the error of the quantiles is small in relative rank at
+       the extremes (p99, p999). record() appends to a buffer of
+       fixed size, which is sorted and merged with the centroids
+       when it is full; the memory does not depend on the number
+       of values. The digests can be merged, and the result is
+       again a digest of the same compression.
+    */
+    class TDigest {
+    public:
+        /**
+           \ingroup metasim_exc
+        */
+        class Exc : public BaseExc {
+        public:
+            Exc(const std::string &msg) :
+                BaseExc(msg, "TDigest", "quantilesketch.hpp") {}
+        };
+
+        static const unsigned DEFAULT_COMPRESSION = 100;
+
+        /**
+           @param compression the maximum number of centroids
+                  (approximately, at least 10)
+           @param buffer the size of the buffer (0 means 5 times
+                  the compression)
+        */
+        explicit TDigest(unsigned compression = DEFAULT_COMPRESSION,
+                         size_t buffer = 0);
+
+        /// Adds a value, with a weight
+        inline void record(double v, double w = 1)
+        {
+            _buf.push_back(Centroid{ v, w });
+            _count += w;
+            if (v < _min) _min = v;
+            if (v > _max) _max = v;
+            if (_buf.size() >= _capacity) compress();
+        }
+
+        /// The value of order q, in [0, 1]; the buffer is merged
+        double quantile(double q);
+
+        /// Adds the values of another digest
+        void merge(const TDigest &d);
+
+        /// Removes all the values
+        void reset();
+
+        /// Merges the buffer with the centroids
+        void compress();
+
+        inline double getCount() const { return _count; }
+        inline double getMin() const { return _min; }
+        inline double getMax() const { return _max; }
+
+        /// Number of centroids (after compress())
+        inline size_t size() const { return _centroids.size(); }
+
+        void saveState(StateArchive &a) const;
+        void restoreState(StateArchive &a);
+
+    private:
+        struct Centroid {
+            double mean;
+            double weight;
+        };
+
+        unsigned _compression;
+        size_t _capacity;
+        std::vector<Centroid> _centroids;
+        std::vector<Centroid> _buf;
+        // the merge of the centroids with the buffer
+        std::vector<Centroid> _tmp;
+        double _count, _min, _max;
+    };
+
+} // namespace MetaSim
+
+#endif
@@ -0,0 +1,178 @@
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef __QUANTILESTAT_HPP__
+#define __QUANTILESTAT_HPP__
+
+#include <cstdint>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <basestat.hpp>
+#include <quantilesketch.hpp>
+
+namespace MetaSim {
+
+    /**
+       \ingroup metasim_stat
+
+       A statistic that computes quantiles of the recorded values
+       (e.g. the p50, p99 and p999 of a latency) with a sketch of
+       fixed memory: HdrHistogram (StatHistogram) or TDigest
+       (StatDigest). The values are not stored.
+
+       The value of the stat in a run is the first quantile; every
+       other quantile is a stat of its own, getQuantile(i), named
+       after the stat ("latency.p99", "latency.p99.9"), so the mean
+       and the confidence interval of every quantile across the
+       runs are the ones of BaseStat, and the quantiles are
+       transferred by the parallel replications like the other
+       stats.
+
+       @code
+       class Latency : public StatHistogram {
+       public:
+           Latency() : StatHistogram("latency", {0.5, 0.99, 0.999}) {}
+           void probe(GEvent<Server> &e) { record(e.getLatency()); }
+       };
+       ...
+       lat.getQuantile(1).getMean();          // p99
+       lat.getQuantile(1).getConfInterval();
+       @endcode
+
+       The sketches of two stats (e.g. of the same metric computed
+       by two threads) are combined with merge().
+    */
+    template <class Sketch>
+    class StatQuantiles : public BaseStat {
+    public:
+        /// A quantile of the sketch of another stat
+        class Quantile : public BaseStat {
+            StatQuantiles &_parent;
+            double _q;
+            uint64_t _seen;
+        public:
+            Quantile(StatQuantiles &p, double q, const std::string &name) :
+                BaseStat(name), _parent(p), _q(q), _seen(0) {}
+
+            /// The values are recorded (and merged) by the parent
+            virtual void record(double) {}
+            virtual void merge(const BaseStat &) {}
+            virtual void initValue() { _val = 0; }
+            virtual void flush()
+            {
+                if (_seen == _parent._version) return;
+                _seen = _parent._version;
+                _val = _parent._sketch.quantile(_q);
+            }
+
+            inline double getOrder() const { return _q; }
+        };
+
+        /**
+           @param name the name of the stat
+           @param q the orders of the quantiles, in [0, 1]
+           @param s the sketch, which defines the range and
+                  the precision
+        */
+        StatQuantiles(std::string name = "",
+                      const std::vector<double> &q = {0.5, 0.99, 0.999},
+                      const Sketch &s = Sketch()) :
+            BaseStat(name), _sketch(s), _q(q.empty() ? 0.5 : q[0]),
+            _version(0), _seen(0)
+        {
+            for (double x : q)
+                if (!(x >= 0 && x <= 1)) throw Exc("The order of a quantile must be in [0, 1]");
+            for (size_t i = 1; i < q.size(); ++i)
+                _quantiles.emplace_back(new Quantile(*this, q[i], quantileName(name, q[i])));
+        }
+
+        virtual void record(double v)
+        {
+            if (chkTransitory()) return;
+            _sketch.record(v);
+            ++_version;
+        }
+
+        virtual void initValue()
+        {
+            _sketch.reset();
+            _val = 0;
+            ++_version;
+        }
+
+        virtual void flush()
+        {
+            if (_seen == _version) return;
+            _seen = _version;
+            _val = _sketch.quantile(_q);
+        }
+
+        /// Adds the values recorded by another stat
+        void merge(const StatQuantiles &s)
+        {
+            _sketch.merge(s._sketch);
+            ++_version;
+        }
+
+        virtual void merge(const BaseStat &s) { merge(sameStat<StatQuantiles>(s)); }
+
+        virtual void saveState(StateArchive &a) const
+        {
+            BaseStat::saveState(a);
+            _sketch.saveState(a);
+        }
+
+        virtual void restoreState(StateArchive &a)
+        {
+            BaseStat::restoreState(a);
+            _sketch.restoreState(a);
+            ++_version;
+        }
+
+        /// Number of quantiles
+        inline size_t getQuantiles() const { return _quantiles.size() + 1; }
+
+        /// The stat of the i-th quantile (the stat itself for i = 0)
+        inline BaseStat &getQuantile(size_t i)
+        {
+            if (i == 0) return *this;
+            return *_quantiles.at(i - 1);
+        }
+
+        /// The sketch of the current run
+        inline Sketch &getSketch() { return _sketch; }
+
+    private:
+        static std::string quantileName(const std::string &name, double q)
+        {
+            if (name.empty()) return name;
+            std::ostringstream s;
+            s << name << ".p" << q * 100;
+            return s.str();
+        }
+
+        Sketch _sketch;
+        double _q;
+        // incremented when the sketch changes
+        uint64_t _version;
+        uint64_t _seen;
+        std::vector<std::unique_ptr<Quantile> > _quantiles;
+    };
+
+    /// Quantiles with a logarithmic histogram (see HdrHistogram)
+    typedef StatQuantiles<HdrHistogram> StatHistogram;
+
+    /// Quantiles with a t-digest (see TDigest)
+    typedef StatQuantiles<TDigest> StatDigest;
+
+} // namespace MetaSim
+
+#endif
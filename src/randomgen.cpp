@@ -0,0 +1,248 @@
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#include <randomgen.hpp>
+
+namespace MetaSim {
+
+    using namespace std;
+
+    namespace {
+        /// Expands a seed into 64 bits words (splitmix64), as
+        /// recommended by the authors of xoshiro
+        inline uint64_t splitmix(uint64_t &x)
+        {
+            uint64_t z = (x += 0x9e3779b97f4a7c15ULL);
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+            return z ^ (z >> 31);
+        }
+
+        /// 128 bits arithmetic modulo 2^128, for PCG64
+        struct U128 {
+            uint64_t hi, lo;
+        };
+
+        inline U128 add(U128 a, U128 b)
+        {
+            U128 r = { a.hi + b.hi, a.lo + b.lo };
+            if (r.lo < a.lo) ++r.hi;
+            return r;
+        }
+
+        inline U128 mul(U128 a, U128 b)
+        {
+            // the low 64 x 64 product, with 32 bits halves
+            uint64_t a0 = a.lo & 0xffffffff, a1 = a.lo >> 32;
+            uint64_t b0 = b.lo & 0xffffffff, b1 = b.lo >> 32;
+            uint64_t p00 = a0 * b0, p01 = a0 * b1, p10 = a1 * b0, p11 = a1 * b1;
+            uint64_t mid = (p00 >> 32) + (p01 & 0xffffffff) + (p10 & 0xffffffff);
+            U128 r;
+            r.lo = (mid << 32) | (p00 & 0xffffffff);
+            r.hi = p11 + (p01 >> 32) + (p10 >> 32) + (mid >> 32) +
+                a.hi * b.lo + a.lo * b.hi;
+            return r;
+        }
+    }
+
+    unique_ptr<RandomGen> RandomGen::create(const string &name, RandNum s)
+    {
+        if (name == "minstd") return unique_ptr<RandomGen>(new RandomGen(s));
+        if (name == "xoshiro256**" || name == "xoshiro")
+            return unique_ptr<RandomGen>(new Xoshiro256Gen(s));
+        if (name == "pcg64") return unique_ptr<RandomGen>(new Pcg64Gen(s));
+        if (name == "philox") return unique_ptr<RandomGen>(new PhiloxGen(s));
+        throw Exc("Unknown random generator " + name);
+    }
+
+    /*---------------------------------------------------*/
+
+    Xoshiro256Gen::Xoshiro256Gen(RandNum s) : RandomGen64(s)
+    {
+        init(s);
+    }
+
+    unique_ptr<RandomGen> Xoshiro256Gen::clone() const
+    {
+        return unique_ptr<RandomGen>(new Xoshiro256Gen(*this));
+    }
+
+    void Xoshiro256Gen::init(RandNum s)
+    {
+        RandomGen::init(s);
+        uint64_t x = uint64_t(s);
+        for (auto &w : _s) w = splitmix(x);
+    }
+
+    void Xoshiro256Gen::setState(const uint64_t s[4])
+    {
+        if ((s[0] | s[1] | s[2] | s[3]) == 0)
+            throw Exc("The state of xoshiro256** cannot be zero", "Xoshiro256Gen");
+        for (int i = 0; i < 4; ++i) _s[i] = s[i];
+    }
+
+    void Xoshiro256Gen::jump(uint64_t n)
+    {
+        while (n-- > 0) next();
+    }
+
+    void Xoshiro256Gen::jump128()
+    {
+        static const uint64_t JUMP[] = {
+            0x180ec6d33cfd0abaULL, 0xd5a61266f0c9392cULL,
+            0xa9582618e03fc9aaULL, 0x39abdc4529b1661cULL
+        };
+        uint64_t t[4] = { 0, 0, 0, 0 };
+        for (uint64_t j : JUMP)
+            for (int b = 0; b < 64; ++b) {
+                if (j & (uint64_t(1) << b))
+                    for (int i = 0; i < 4; ++i) t[i] ^= _s[i];
+                next();
+            }
+        for (int i = 0; i < 4; ++i) _s[i] = t[i];
+    }
+
+    void Xoshiro256Gen::stream(uint64_t k, uint64_t n)
+    {
+        while (k-- > 0) jump128();
+    }
+
+    /*---------------------------------------------------*/
+
+    Pcg64Gen::Pcg64Gen(RandNum s) : RandomGen64(s)
+    {
+        init(s);
+    }
+
+    unique_ptr<RandomGen> Pcg64Gen::clone() const
+    {
+        return unique_ptr<RandomGen>(new Pcg64Gen(*this));
+    }
+
+    void Pcg64Gen::init(RandNum s)
+    {
+        // as pcg64_srandom(), with the default increment
+        RandomGen::init(s);
+        uint64_t x = uint64_t(s);
+        uint64_t hi = splitmix(x), lo = splitmix(x);
+        _hi = _lo = 0;
+        step();
+        U128 st = add(U128{ _hi, _lo }, U128{ hi, lo });
+        _hi = st.hi;
+        _lo = st.lo;
+        step();
+    }
+
+    void Pcg64Gen::stepPortable()
+    {
+        U128 st = add(mul(U128{ _hi, _lo }, U128{ MUL_HI, MUL_LO }),
+                      U128{ INC_HI, INC_LO });
+        _hi = st.hi;
+        _lo = st.lo;
+    }
+
+    void Pcg64Gen::advance(uint64_t dhi, uint64_t dlo)
+    {
+        // Brown, "Random number generation with arbitrary
+        // strides": the composition of d steps of the LCG
+        U128 accMul = { 0, 1 }, accPlus = { 0, 0 };
+        U128 curMul = { MUL_HI, MUL_LO }, curPlus = { INC_HI, INC_LO };
+        while (dhi != 0 || dlo != 0) {
+            if (dlo & 1) {
+                accMul = mul(accMul, curMul);
+                accPlus = add(mul(accPlus, curMul), curPlus);
+            }
+            curPlus = mul(add(curMul, U128{ 0, 1 }), curPlus);
+            curMul = mul(curMul, curMul);
+            dlo = (dlo >> 1) | (dhi << 63);
+            dhi >>= 1;
+        }
+        U128 st = add(mul(accMul, U128{ _hi, _lo }), accPlus);
+        _hi = st.hi;
+        _lo = st.lo;
+    }
+
+    /*---------------------------------------------------*/
+
+    PhiloxGen::PhiloxGen(RandNum s) : RandomGen64(s)
+    {
+        init(s);
+    }
+
+    unique_ptr<RandomGen> PhiloxGen::clone() const
+    {
+        return unique_ptr<RandomGen>(new PhiloxGen(*this));
+    }
+
+    void PhiloxGen::init(RandNum s)
+    {
+        RandomGen::init(s);
+        uint64_t x = uint64_t(s);
+        uint64_t k = splitmix(x);
+        _key[0] = uint32_t(k);
+        _key[1] = uint32_t(k >> 32);
+        _stream = 0;
+        _pos = 0;
+    }
+
+    void PhiloxGen::block(const uint32_t c[4], const uint32_t k[2],
+                          uint32_t out[4])
+    {
+        const uint32_t M0 = 0xd2511f53, M1 = 0xcd9e8d57;
+        const uint32_t W0 = 0x9e3779b9, W1 = 0xbb67ae85;
+        uint32_t x0 = c[0], x1 = c[1], x2 = c[2], x3 = c[3];
+        uint32_t k0 = k[0], k1 = k[1];
+        for (int r = 0; r < 10; ++r) {
+            uint64_t p0 = uint64_t(M0) * x0, p1 = uint64_t(M1) * x2;
+            uint32_t y0 = uint32_t(p1 >> 32) ^ x1 ^ k0;
+            uint32_t y1 = uint32_t(p1);
+            uint32_t y2 = uint32_t(p0 >> 32) ^ x3 ^ k1;
+            uint32_t y3 = uint32_t(p0);
+            x0 = y0; x1 = y1; x2 = y2; x3 = y3;
+            k0 += W0;
+            k1 += W1;
+        }
+        out[0] = x0; out[1] = x1; out[2] = x2; out[3] = x3;
+    }
+
+    void PhiloxGen::fill()
+    {
+        uint64_t b = _pos >> 1;
+        uint32_t c[4] = { uint32_t(b), uint32_t(b >> 32),
+                          uint32_t(_stream), uint32_t(_stream >> 32) };
+        block(c, _key, _block);
+    }
+
+    void PhiloxGen::jump(uint64_t n)
+    {
+        _pos += n;
+        // the next value is the second half of a block
+        if (_pos & 1) fill();
+    }
+
+    void PhiloxGen::stream(uint64_t k, uint64_t n)
+    {
+        if (k == 0) return;
+        _stream += k;
+        _pos = 0;
+    }
+
+    void PhiloxGen::saveState(StateArchive &a) const
+    {
+        a.save(_stream);
+        a.save(_pos);
+    }
+
+    void PhiloxGen::restoreState(StateArchive &a)
+    {
+        a.restore(_stream);
+        a.restore(_pos);
+        if (_pos & 1) fill();
+    }
+
+} // namespace MetaSim
@@ -0,0 +1,205 @@
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef __RANDOMGEN_HPP__
+#define __RANDOMGEN_HPP__
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include <randomvar.hpp>
+
+namespace MetaSim {
+
+    /**
+       \ingroup metasim_random
+
+       Base class of the generators that produce 64 random bits at a
+       time. sample() returns 31 bits, in [0, getModule()), for the
+       code written for RandomGen; uniform() uses the 53 most
+       significant bits of next64(), without divisions.
+    */
+    class RandomGen64 : public RandomGen {
+    public:
+        explicit RandomGen64(RandNum s) : RandomGen(s) {}
+
+        /// The next 64 random bits
+        virtual uint64_t next64() = 0;
+
+        virtual RandNum sample()
+        {
+            // maps the 32 high bits on [0, M) with a product
+            uint64_t x = next64() >> 32;
+            return RandNum((x * uint64_t(RandomGen::getModule())) >> 32);
+        }
+
+        virtual double uniform() { return toUniform(next64()); }
+
+    protected:
+        /// the centre of one of 2^53 intervals, never 0 or 1
+        static inline double toUniform(uint64_t x)
+        {
+            return (double(x >> 11) + 0.5) * (1.0 / 9007199254740992.0);
+        }
+
+        /// fillUniform() with the inline next() of the class G
+        template <class G>
+        static void fillWith(G &g, double *out, size_t n)
+        {
+            for (size_t i = 0; i < n; ++i) out[i] = toUniform(g.next());
+        }
+    };
+
+    /**
+       \ingroup metasim_random
+
+       The xoshiro256** generator of Blackman and Vigna: 256 bits of
+       state, period 2^256 - 1, a few shifts and rotations per
+       number. The streams are 2^128 numbers apart (the jump
+       polynomial of the authors); jump(n) takes O(n) time for this
+       generator, so stream() is the way to split it.
+    */
+    class Xoshiro256Gen : public RandomGen64 {
+        uint64_t _s[4];
+
+        static inline uint64_t rotl(uint64_t x, int k) {
+            return (x << k) | (x >> (64 - k));
+        }
+    public:
+        explicit Xoshiro256Gen(RandNum s);
+
+        inline uint64_t next() {
+            const uint64_t r = rotl(_s[1] * 5, 7) * 9;
+            const uint64_t t = _s[1] << 17;
+            _s[2] ^= _s[0];
+            _s[3] ^= _s[1];
+            _s[1] ^= _s[2];
+            _s[0] ^= _s[3];
+            _s[2] ^= t;
+            _s[3] = rotl(_s[3], 45);
+            return r;
+        }
+
+        virtual uint64_t next64() { return next(); }
+        virtual void fillUniform(double *out, size_t n) { fillWith(*this, out, n); }
+        virtual std::unique_ptr<RandomGen> clone() const;
+        virtual std::string getName() const { return "xoshiro256**"; }
+        virtual void init(RandNum s);
+        virtual void jump(uint64_t n);
+        virtual void stream(uint64_t k, uint64_t n);
+        virtual void saveState(StateArchive &a) const { a.save(_s); }
+        virtual void restoreState(StateArchive &a) { a.restore(_s); }
+
+        /// Advances the sequence by 2^128 numbers
+        void jump128();
+
+        /// Sets the 256 bits of the state (not all zero)
+        void setState(const uint64_t s[4]);
+    };
+
+    /**
+       \ingroup metasim_random
+
+       The PCG64 generator of O'Neill (XSL RR 128/64): a 128 bits
+       linear congruential generator, period 2^128, permuted to 64
+       bits of output. jump(n) takes O(log n) time, and the streams
+       are 2^64 numbers apart.
+    */
+    class Pcg64Gen : public RandomGen64 {
+        // the state, as high and low 64 bits
+        uint64_t _hi, _lo;
+
+        // the multiplier and the increment of the LCG
+        static const uint64_t MUL_HI = 0x2360ed051fc65da4ULL;
+        static const uint64_t MUL_LO = 0x4385df649fccf645ULL;
+        static const uint64_t INC_HI = 0x5851f42d4c957f2dULL;
+        static const uint64_t INC_LO = 0x14057b7ef767814fULL;
+
+        inline void step() {
+#if defined(__SIZEOF_INT128__)
+            __extension__ typedef unsigned __int128 u128;
+            u128 x = ((u128(_hi) << 64) | _lo) * ((u128(MUL_HI) << 64) | MUL_LO) +
+                ((u128(INC_HI) << 64) | INC_LO);
+            _hi = uint64_t(x >> 64);
+            _lo = uint64_t(x);
+#else
+            stepPortable();
+#endif
+        }
+        void stepPortable();
+
+        /// Advances the sequence by the 128 bits number (dhi, dlo)
+        void advance(uint64_t dhi, uint64_t dlo);
+    public:
+        explicit Pcg64Gen(RandNum s);
+
+        inline uint64_t next() {
+            step();
+            uint64_t x = _hi ^ _lo;
+            unsigned r = unsigned(_hi >> 58);
+            return (x >> r) | (x << ((64 - r) & 63));
+        }
+
+        virtual uint64_t next64() { return next(); }
+        virtual void fillUniform(double *out, size_t n) { fillWith(*this, out, n); }
+        virtual std::unique_ptr<RandomGen> clone() const;
+        virtual std::string getName() const { return "pcg64"; }
+        virtual void init(RandNum s);
+        virtual void jump(uint64_t n) { advance(0, n); }
+        virtual void stream(uint64_t k, uint64_t n) { advance(k, 0); }
+        virtual void saveState(StateArchive &a) const { a.save(_hi); a.save(_lo); }
+        virtual void restoreState(StateArchive &a) { a.restore(_hi); a.restore(_lo); }
+    };
+
+    /**
+       \ingroup metasim_random
+
+       The counter based generator Philox4x32-10 of Salmon et al.:
+       every block of 128 random bits is a function (10 rounds of
+       multiplications) of a 128 bits counter and of a 64 bits key,
+       derived from the seed. The low half of the counter is the
+       position in the stream, the high half is the stream: jump()
+       and stream() only change the counter, in constant time, and
+       every stream is 2^65 numbers long.
+    */
+    class PhiloxGen : public RandomGen64 {
+        uint32_t _key[2];
+        uint64_t _stream;
+        // number of values returned in the stream
+        uint64_t _pos;
+        uint32_t _block[4];
+
+        void fill();
+    public:
+        explicit PhiloxGen(RandNum s);
+
+        /// computes the block of counter c with key k
+        static void block(const uint32_t c[4], const uint32_t k[2],
+                          uint32_t out[4]);
+
+        inline uint64_t next() {
+            if ((_pos & 1) == 0) fill();
+            const uint32_t *b = _block + 2 * (_pos++ & 1);
+            return (uint64_t(b[0]) << 32) | b[1];
+        }
+
+        virtual uint64_t next64() { return next(); }
+        virtual void fillUniform(double *out, size_t n) { fillWith(*this, out, n); }
+        virtual std::unique_ptr<RandomGen> clone() const;
+        virtual std::string getName() const { return "philox"; }
+        virtual void init(RandNum s);
+        virtual void jump(uint64_t n);
+        virtual void stream(uint64_t k, uint64_t n);
+        virtual void saveState(StateArchive &a) const;
+        virtual void restoreState(StateArchive &a);
+    };
+
+} // namespace MetaSim
+
+#endif
@@ -11,9 +11,12 @@
  *   (at your option) any later version.                                   *
  *                                                                         *
  ***************************************************************************/
+#include <algorithm>
 #include <cmath>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include <cstdlib>
@@ -21,21 +24,20 @@
 #include <limits>
 #include <cmath>
 
+#include <chunktrace.hpp>
 #include <randomvar.hpp>
+#include <simcontext.hpp>
 #include <simul.hpp>
 #include <strtoken.hpp>
 #include <factory.hpp>
 #include <regvar.hpp>
+#include <ziggurat.hpp>
 
 namespace MetaSim {
 
     using namespace std;
     using namespace parse_util;
 
-    RandomGen RandomVar::_stdgen(1);
-
-    RandomGen* RandomVar::_pstdgen(&_stdgen);
-
     const RandNum RandomGen::A = 16807;
     const RandNum RandomGen::M = 2147483647;
     const RandNum RandomGen::Q = 127773; // M div A
@@ -49,8 +51,13 @@ namespace MetaSim {
 
     /*---------------------------------------------------*/
 
-    RandomGen::RandomGen(RandNum s) : _seed(s), _xn(s)
+    RandomGen::RandomGen(RandNum s) : _seed(s), _xn(s), _antithetic(false)
+    {
+    }
+
+    unique_ptr<RandomGen> RandomGen::clone() const
     {
+        return unique_ptr<RandomGen>(new RandomGen(*this));
     }
 
     RandNum RandomGen::sample()
@@ -66,16 +73,49 @@ namespace MetaSim {
         return _xn;
     };
 
+    double RandomGen::uniform()
+    {
+        // sample() is in [1, M - 1]
+        static const double INV_M = 1.0 / M;
+        return sample() * INV_M;
+    }
+
+    void RandomGen::fillUniform(double *out, size_t n)
+    {
+        for (size_t i = 0; i < n; ++i) out[i] = uniform();
+    }
+
+    void RandomGen::jump(uint64_t n)
+    {
+        // x_{k+n} = A^n x_k mod M
+        uint64_t a = A, m = M, r = 1;
+        while (n > 0) {
+            if (n & 1) r = (r * a) % m;
+            a = (a * a) % m;
+            n >>= 1;
+        }
+        _xn = RandNum((r * uint64_t(_xn)) % m);
+    }
+
+    void RandomGen::stream(uint64_t k, uint64_t n)
+    {
+        if (n == 0 || k >= n)
+            throw Exc("Stream " + to_string(k) + " of " + to_string(n));
+        jump(k * (uint64_t(M - 1) / n));
+    }
+
     void RandomGen::init(RandNum s)
     {
-        _xn = _seed = s;
+        _seed = s;
+        if (s <= 0 || s >= M) s = RandNum(uint64_t(s) % uint64_t(M - 1)) + 1;
+        _xn = s;
     }
 
     /*---------------------------------------------------*/
 
     const unsigned long PoissonVar::CUTOFF = 10000;
 
-    RandomVar::RandomVar() : _gen(_pstdgen)
+    RandomVar::RandomVar() : _gen(SimContext::current()._pstdgen)
     {
       __regrandvar_init();
     }
@@ -88,16 +128,102 @@ namespace MetaSim {
     {
     }
 
+    void RandomVar::init(RandNum s)
+    {
+        SimContext &c = SimContext::current();
+        c._pstdgen->init(s);
+        c._streamSeed = s;
+    }
+
     RandomGen* RandomVar::changeGenerator(RandomGen *g)
     { 
-        RandomGen *old = _pstdgen;
-        _pstdgen = g; 
+        SimContext &c = SimContext::current();
+        RandomGen *old = c._pstdgen;
+        c._pstdgen = g; 
         return old;
     }
 
     void RandomVar::restoreGenerator()
     {
-        _pstdgen = &_stdgen;
+        SimContext &c = SimContext::current();
+        c._pstdgen = c._stdgen.get();
+    }
+
+    void RandomVar::setGenerator(unique_ptr<RandomGen> g)
+    {
+        SimContext &c = SimContext::current();
+        c._oldgens.push_back(move(c._stdgen));
+        c._stdgen = move(g);
+        c._pstdgen = c._stdgen.get();
+        c._streamSeed = c._stdgen->getSeed();
+    }
+
+    RandomGen &RandomVar::getDefaultGenerator()
+    {
+        return *SimContext::current()._stdgen;
+    }
+
+    namespace {
+        inline uint64_t mix(uint64_t z)
+        {
+            // the finalizer of splitmix64
+            z += 0x9e3779b97f4a7c15ULL;
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+            return z ^ (z >> 31);
+        }
+
+        // the seed of a substream (positive, 63 bits)
+        RandNum streamSeed(RandNum base, const string &key, size_t run)
+        {
+            uint64_t h = 0xcbf29ce484222325ULL;   // FNV-1a
+            for (unsigned char ch : key) h = (h ^ ch) * 0x100000001b3ULL;
+            return RandNum(mix(mix(uint64_t(base) ^ mix(h)) ^ run) >> 1);
+        }
+    }
+
+    RandomGen *RandomVar::getStream(const string &key)
+    {
+        SimContext &c = SimContext::current();
+        unique_ptr<RandomGen> &g = c._streams[key];
+        if (!g) {
+            g = c._pstdgen->clone();
+            g->setAntithetic(false);
+            g->init(streamSeed(c._streamSeed, key, c._firstRun));
+        }
+        return g.get();
+    }
+
+    const uint64_t *RandomVar::getStreamEpoch()
+    {
+        return &SimContext::current()._streamEpoch;
+    }
+
+    void RandomVar::setStream(const string &key)
+    {
+        _gen = getStream(key);
+    }
+
+    void RandomVar::setAntitheticRuns(bool a)
+    {
+        SimContext::current()._antitheticRuns = a;
+    }
+
+    void RandomVar::initStreams(size_t run)
+    {
+        SimContext &c = SimContext::current();
+        bool anti = c._antitheticRuns && (run & 1);
+        if (c._antitheticRuns) run /= 2;
+        for (auto &s : c._streams) {
+            s.second->init(streamSeed(c._streamSeed, s.first, run));
+            s.second->setAntithetic(anti);
+        }
+        ++c._streamEpoch;
+    }
+
+    void RandomVar::fill(double *out, size_t n)
+    {
+        for (size_t i = 0; i < n; ++i) out[i] = get();
     }
 
 
@@ -115,13 +241,25 @@ namespace MetaSim {
 
     double UniformVar::get()
     {
-        double tmp;
-        tmp = _gen->sample();
-        tmp = tmp * (_max - _min) / _gen->getModule() + _min;
-  
-        return tmp;
+        double u = _gen->uniform();
+        if (_antithetic != _gen->isAntithetic()) u = 1 - u;
+        return u * (_max - _min) + _min;
     };
 
+    void UniformVar::fillUnit(double *out, size_t n)
+    {
+        _gen->fillUniform(out, n);
+        if (_antithetic != _gen->isAntithetic())
+            for (size_t i = 0; i < n; ++i) out[i] = 1 - out[i];
+    }
+
+    void UniformVar::fill(double *out, size_t n)
+    {
+        fillUnit(out, n);
+        const double w = _max - _min, m = _min;
+        for (size_t i = 0; i < n; ++i) out[i] = out[i] * w + m;
+    }
+
     unique_ptr<UniformVar> UniformVar::createInstance(vector<string> &par) 
     {
         double a,b;
@@ -138,16 +276,36 @@ namespace MetaSim {
 
     double ExponentialVar::get()
     {
+        if (_method == ZIGGURAT) return ziggurat::exponential(*_gen) / _lambda;
         return -log(UniformVar::get()) / _lambda;
     }
 
+    void ExponentialVar::fill(double *out, size_t n)
+    {
+        if (_method == ZIGGURAT) {
+            for (size_t i = 0; i < n; ++i)
+                out[i] = ziggurat::exponential(*_gen) / _lambda;
+            return;
+        }
+        // the uniform numbers of UniformVar(0, 1) as they are
+        fillUnit(out, n);
+        const double l = _lambda;
+        for (size_t i = 0; i < n; ++i) out[i] = -log(out[i]) / l;
+    }
+
     std::unique_ptr<ExponentialVar> ExponentialVar::createInstance(vector<string> &par)
     {
-        if (par.size() != 1)
+        if (par.size() != 1 && par.size() != 2)
             throw ParseExc("Wrong number of parameters", "ExponentialVar");
 
         double a = atof(par[0].c_str());
-        return unique_ptr<ExponentialVar>(new ExponentialVar(a));
+        Method m = INVERSION;
+        if (par.size() == 2) {
+            if (par[1] == "ziggurat") m = ZIGGURAT;
+            else if (par[1] != "inversion")
+                throw ParseExc("Unknown method " + par[1], "ExponentialVar");
+        }
+        return unique_ptr<ExponentialVar>(new ExponentialVar(a, m));
     }
 
     /*-----------------------------------------------------*/
@@ -157,6 +315,13 @@ namespace MetaSim {
         return _l * pow(-log(UniformVar::get()), 1.0 / _k);
     }
 
+    void WeibullVar::fill(double *out, size_t n)
+    {
+        fillUnit(out, n);
+        const double l = _l, e = 1.0 / _k;
+        for (size_t i = 0; i < n; ++i) out[i] = l * pow(-log(out[i]), e);
+    }
+
     std::unique_ptr<WeibullVar> WeibullVar::createInstance(vector<string> &par)
     {
         if (par.size() != 2)
@@ -175,6 +340,13 @@ namespace MetaSim {
         return _mu * pow (UniformVar::get(), -1/_order);
     };
 
+    void ParetoVar::fill(double *out, size_t n)
+    {
+        fillUnit(out, n);
+        const double m = _mu, e = -1 / _order;
+        for (size_t i = 0; i < n; ++i) out[i] = m * pow(out[i], e);
+    }
+
     unique_ptr<ParetoVar> ParetoVar::createInstance(vector<string> &par) 
     {
         double a,b;
@@ -191,15 +363,15 @@ namespace MetaSim {
 
     double NormalVar::get()
     {
+        if (_method == ZIGGURAT) return ziggurat::normal(*_gen) * _sigma + _mu;
+
         const double epsilon = std::numeric_limits<double>::min();
         const double two_pi = 2.0*3.14159265358979323846;
 
-        static double z0, z1;
-        static bool generate;
-        generate = !generate;
-        
-        if (!generate)
-            return z1 * _sigma + _mu;
+        if (_yes) {
+            _yes = false;
+            return _oldv * _sigma + _mu;
+        }
         
         // generate two uniform samples
         double u1, u2;
@@ -210,31 +382,91 @@ namespace MetaSim {
         }
         while ( u1 <= epsilon );
         
-        z0 = sqrt(-2.0 * log(u1)) * cos(two_pi * u2);
-        z1 = sqrt(-2.0 * log(u1)) * sin(two_pi * u2);
-        return z0 * _sigma + _mu;
+        double r = sqrt(-2.0 * log(u1));
+        _oldv = r * sin(two_pi * u2);
+        _yes = true;
+        return r * cos(two_pi * u2) * _sigma + _mu;
     }
 
 
+    void NormalVar::fill(double *out, size_t n)
+    {
+        if (_method == ZIGGURAT) {
+            for (size_t i = 0; i < n; ++i)
+                out[i] = ziggurat::normal(*_gen) * _sigma + _mu;
+            return;
+        }
+
+        const double two_pi = 2.0*3.14159265358979323846;
+        const size_t pairs = n / 2;
+
+        // Box-Muller on the pairs (u1, u2) of the block, in place:
+        // the uniform numbers are never 0
+        fillUnit(out, 2 * pairs);
+        for (size_t i = 0; i < pairs; ++i) {
+            double r = sqrt(-2.0 * log(out[2 * i]));
+            double a = two_pi * out[2 * i + 1];
+            out[2 * i] = r * cos(a) * _sigma + _mu;
+            out[2 * i + 1] = r * sin(a) * _sigma + _mu;
+        }
+        if (n & 1) {
+            double u[2];
+            fillUnit(u, 2);
+            out[n - 1] = sqrt(-2.0 * log(u[0])) * cos(two_pi * u[1]) * _sigma + _mu;
+        }
+    }
+
     std::unique_ptr<NormalVar> NormalVar::createInstance(vector<string> &par) 
     {
         double a,b;
 
-        if (par.size() != 2) 
+        if (par.size() != 2 && par.size() != 3) 
             throw ParseExc("Wrong number of parameters", "NormalVar");
 
         a = atof(par[0].c_str());
         b = atof(par[1].c_str());
-        return unique_ptr<NormalVar>(new NormalVar(a,b));
+        Method m = ZIGGURAT;
+        if (par.size() == 3) {
+            if (par[2] == "boxmuller") m = BOX_MULLER;
+            else if (par[2] != "ziggurat")
+                throw ParseExc("Unknown method " + par[2], "NormalVar");
+        }
+        return unique_ptr<NormalVar>(new NormalVar(a, b, m));
     } 
 
 
     /*-----------------------------------------------------*/
 
-    double PoissonVar::get() 
+    const double PoissonVar::PTRS_MIN = 10;
+
+    PoissonVar::PoissonVar(double l) :
+        UniformVar(0, 1), _lambda(l), _method(l < PTRS_MIN ? INVERSION : PTRS)
     {
-        double u = UniformVar::get();
-        double F = exp(-_lambda);
+        setup();
+    }
+
+    PoissonVar::PoissonVar(double l, Method m) :
+        UniformVar(0, 1), _lambda(l), _method(m)
+    {
+        if (m == PTRS && l < PTRS_MIN)
+            throw Exc("PTRS needs lambda >= " + to_string(PTRS_MIN), "PoissonVar");
+        setup();
+    }
+
+    void PoissonVar::setup()
+    {
+        _expl = exp(-_lambda);
+        _slam = sqrt(_lambda);
+        _loglam = log(_lambda);
+        _b = 0.931 + 2.53 * _slam;
+        _a = -0.059 + 0.02483 * _b;
+        _invalpha = 1.1239 + 1.1328 / (_b - 3.4);
+        _vr = 0.9277 - 3.6224 / (_b - 2);
+    }
+
+    double PoissonVar::invert(double u) const
+    {
+        double F = _expl;
         double S = F;
 
         for (unsigned int i = 1; i < CUTOFF; ++i) {
@@ -245,28 +477,94 @@ namespace MetaSim {
         return CUTOFF;
     }
 
+    double PoissonVar::ptrs()
+    {
+        for (;;) {
+            double u = _gen->uniform() - 0.5;
+            double v = _gen->uniform();
+            double us = 0.5 - fabs(u);
+            double k = floor((2 * _a / us + _b) * u + _lambda + 0.43);
+            // the squeeze accepts most of the values
+            if (us >= 0.07 && v <= _vr) return k;
+            if (k < 0 || (us < 0.013 && v > us)) continue;
+            if (log(v * _invalpha / (_a / (us * us) + _b)) <=
+                -_lambda + k * _loglam - lgamma(k + 1))
+                return k;
+        }
+    }
+
+    double PoissonVar::get() 
+    {
+        if (_method == PTRS) return ptrs();
+        return invert(UniformVar::get());
+    }
+
+    void PoissonVar::fill(double *out, size_t n)
+    {
+        if (_method == PTRS) {
+            for (size_t i = 0; i < n; ++i) out[i] = ptrs();
+            return;
+        }
+        fillUnit(out, n);
+        for (size_t i = 0; i < n; ++i) out[i] = invert(out[i]);
+    }
+
     unique_ptr<PoissonVar> PoissonVar::createInstance(vector<string> &par) 
     {
         double a;
 
-        if (par.size() != 1)
+        if (par.size() != 1 && par.size() != 2)
             throw ParseExc("Wrong number of parameters", "PoissonVar");
         a = atof(par[0].c_str());
-        return unique_ptr<PoissonVar>(new PoissonVar(a));
+        if (par.size() == 1) return unique_ptr<PoissonVar>(new PoissonVar(a));
+
+        Method m;
+        if (par[1] == "inversion") m = INVERSION;
+        else if (par[1] == "ptrs") m = PTRS;
+        else throw ParseExc("Unknown method " + par[1], "PoissonVar");
+        return unique_ptr<PoissonVar>(new PoissonVar(a, m));
     } 
 
 
     /*-----------------------------------------------------*/
 
-    DetVar::DetVar(const std::string &filename) :
-        _array()
+    DetVar::DetVar(const std::string &filename, Mode mode, size_t buffer) :
+        _array(), _count(0), _mode(mode), _mapPos(0)
     {
         DBGENTER(_RANDOMVAR_DBG_LEV);
+        DBGPRINT_2("Reading from ", filename);
+
+        if (!DataFile::isBinary(filename)) _mode = LOAD;
+        try {
+            if (ChunkedTrace::isChunked(filename)) {
+                // the payloads of the records, decompressed once
+                ChunkedTraceReader in(filename);
+                in.payloads(_array);
+                return;
+            }
+            switch (_mode) {
+            case MAP: _map = MappedData::open(filename); break;
+            case STREAM: _stream.reset(new DataStream(filename, buffer)); break;
+            case LOAD: load(filename); break;
+            }
+        } catch (DataFile::Exc &e) {
+            throw Exc(e.what(), "DetVar");
+        } catch (ChunkedTrace::Exc &e) {
+            throw Exc(e.what(), "DetVar");
+        }
+    }
+
+    void DetVar::load(const std::string &filename)
+    {
+        if (DataFile::isBinary(filename)) {
+            shared_ptr<const MappedData> m = MappedData::open(filename);
+            _array.assign(m->data(), m->data() + m->size());
+            return;
+        }
+
         ifstream inFile;
         double v;
 
-        DBGPRINT_2("Reading from ", filename);
-
         inFile.open(filename.c_str());
         if (!inFile.is_open()) {
             string errMsg = Exc::_FILEOPEN  + string(filename) + "\n";
@@ -278,63 +576,226 @@ namespace MetaSim {
             DBGVAR(_array.back());
         }
         inFile.close();
-        _count = 0;
     };
 
-    DetVar::DetVar(vector<double> &a) : _array(a) 
+    DetVar::DetVar(vector<double> &a) : _array(a), _count(0), _mode(LOAD),
+                                        _mapPos(0)
     {
-        _count = 0;
     }
 
-    DetVar::DetVar(double *a, int s)
+    DetVar::DetVar(double *a, int s) : _count(0), _mode(LOAD), _mapPos(0)
     {
         for (int i = 0; i < s; ++i) 
             _array.push_back(a[i]);
-        _count = 0;
+    }
+
+    DetVar::DetVar(const DetVar &d) :
+        RandomVar(d), _array(d._array), _count(d._count), _mode(d._mode),
+        _map(d._map), _mapPos(d._mapPos)
+    {
+        if (d._stream) {
+            _stream.reset(new DataStream(d._stream->getPath(),
+                                         d._stream->getBufferSize()));
+            _stream->seek(d._stream->tell());
+        }
+    }
+
+    size_t DetVar::size() const
+    {
+        switch (_mode) {
+        case MAP: return _map->size();
+        case STREAM: return size_t(_stream->size());
+        default: return _array.size();
+        }
     }
 
     double DetVar::get() 
     {
+        if (_mode == MAP) {
+            if (_mapPos >= _map->size()) _mapPos = 0;
+            return _map->data()[_mapPos++];
+        }
+        if (_mode == STREAM) return _stream->next();
         if (_count >= _array.size())
             _count = 0;
         return _array[_count++];
     }
 
-    double DetVar::getMaximum() throw(MaxException)
+    void DetVar::fill(double *out, size_t n)
+    {
+        if (_mode != MAP) {
+            RandomVar::fill(out, n);
+            return;
+        }
+        // whole runs of the mapping
+        const double *d = _map->data();
+        const size_t sz = _map->size();
+        while (n > 0) {
+            if (_mapPos >= sz) _mapPos = 0;
+            size_t k = min(n, sz - _mapPos);
+            copy(d + _mapPos, d + _mapPos + k, out);
+            _mapPos += k;
+            out += k;
+            n -= k;
+        }
+    }
+
+    namespace {
+        // the minimum (or the maximum) of all the values
+        template <class Less>
+        double extreme(DetVar::Mode mode, const vector<double> &a,
+                       const MappedData *m, const DataStream *s, Less less)
+        {
+            if (mode == DetVar::MAP) {
+                if (m->size() == 0) return 0;
+                return *min_element(m->data(), m->data() + m->size(), less);
+            }
+            if (mode == DetVar::STREAM) {
+                // scans the file with another buffer
+                DataStream scan(s->getPath(), s->getBufferSize());
+                double r = scan.next();
+                for (uint64_t i = 1; i < scan.size(); ++i) {
+                    double v = scan.next();
+                    if (less(v, r)) r = v;
+                }
+                return r;
+            }
+            if (a.empty()) return 0;
+            return *min_element(a.begin(), a.end(), less);
+        }
+    }
+
+    double DetVar::getMaximum()
     {
-        if (_array.empty()) return 0;
-        double max = _array[0];
-        for (unsigned int i = 1; i < _array.size(); i++)
-            if (_array[i] > max) max = _array[i];
-        return max;
+        return extreme(_mode, _array, _map.get(), _stream.get(),
+                       [](double x, double y) { return x > y; });
     }
 
-    double DetVar::getMinimum() throw(MaxException)
+    double DetVar::getMinimum()
     {
-        if (_array.empty()) return 0;
-        double min = _array[0];
-        for (unsigned int i = 1; i < _array.size(); i++)
-            if (_array[i] < min) min = _array[i];
-        return min;
+        return extreme(_mode, _array, _map.get(), _stream.get(),
+                       [](double x, double y) { return x < y; });
     }
 
     unique_ptr<DetVar> DetVar::createInstance(vector<string> &par) 
     {
-        if (par.size() != 1) 
+        if (par.size() != 1 && par.size() != 2) 
             throw ParseExc("Wrong number of parameters", "DetVar");
 
-        return unique_ptr<DetVar>(new DetVar(par[0]));
+        Mode m = MAP;
+        if (par.size() == 2) {
+            if (par[1] == "stream") m = STREAM;
+            else if (par[1] == "load") m = LOAD;
+            else if (par[1] != "map")
+                throw ParseExc("Unknown mode " + par[1], "DetVar");
+        }
+        return unique_ptr<DetVar>(new DetVar(par[0], m));
     } 
 
+    /*-----------------------------------------------------*/
+
+    BufferedVar::BufferedVar(unique_ptr<RandomVar> v, size_t block) :
+        _var(move(v)), _buf(block > 0 ? block : 1), _pos(_buf.size())
+    {
+    }
+
+    BufferedVar::BufferedVar(const BufferedVar &r) :
+        RandomVar(r), _var(r._var->clone()), _buf(r._buf), _pos(r._pos)
+    {
+    }
+
+    void BufferedVar::refill()
+    {
+        _var->fill(_buf.data(), _buf.size());
+        _pos = 0;
+    }
+
+    void BufferedVar::fill(double *out, size_t n)
+    {
+        // first the values in the buffer, then directly from the
+        // variable
+        size_t k = min(n, _buf.size() - _pos);
+        copy(_buf.begin() + _pos, _buf.begin() + _pos + k, out);
+        _pos += k;
+        if (n > k) _var->fill(out + k, n - k);
+    }
+
+    namespace {
+        // the prototypes of the strings parsed by parsevar(), for
+        // all the contexts
+        struct ParseCache {
+            mutex m;
+            unordered_map<string, shared_ptr<const RandomVar> > protos;
+        };
+
+        ParseCache &parseCache()
+        {
+            static ParseCache c;
+            return c;
+        }
+
+        // the variables that read a file when they are created
+        inline bool readsFile(const string &token)
+        {
+            return token == "trace" || token == "PDF";
+        }
+    }
+
     unique_ptr<RandomVar> RandomVar::parsevar(const std::string &str)
     {
-        string token = get_token(str);
+        ParseCache &c = parseCache();
+        {
+            lock_guard<mutex> l(c.m);
+            auto i = c.protos.find(str);
+            if (i != c.protos.end()) return instantiate(*i->second);
+        }
+
+        string token;
+        unique_ptr<RandomVar> var = build(str, token);
+        if (!readsFile(token)) {
+            shared_ptr<const RandomVar> proto(var->clone());
+            lock_guard<mutex> l(c.m);
+            c.protos.emplace(str, move(proto));
+        }
+        return var;
+    }
+
+    void RandomVar::clearParseCache()
+    {
+        ParseCache &c = parseCache();
+        lock_guard<mutex> l(c.m);
+        c.protos.clear();
+    }
+
+    unique_ptr<RandomVar> RandomVar::instantiate(const RandomVar &proto)
+    {
+        unique_ptr<RandomVar> v = proto.clone();
+        v->_gen = SimContext::current()._pstdgen;
+        return v;
+    }
+
+    RandomVar::Spec::Spec(const string &str) : _str(str), _proto()
+    {
+        string token;
+        _proto = build(str, token);
+    }
+
+    unique_ptr<RandomVar> RandomVar::Spec::create() const
+    {
+        return instantiate(*_proto);
+    }
+
+    unique_ptr<RandomVar> RandomVar::build(const std::string &str, string &token)
+    {
+        // views of str: only the token and the parameters are copied
+        StrView s(str);
+        token = get_token(s).str();
         DBGPRINT_2("token = ",  token);
                 
-        string p = get_param(str);
+        StrView p = get_param(s);
         DBGPRINT_2("parms = ", p);
 
-        vector<string> parms = split_param(p);
+        vector<string> parms = to_strings(split_param(p));
   
         for (size_t i = 0; i < parms.size(); ++i) 
             DBGPRINT_4("par[", i, "] = ", parms[i]);
@@ -14,6 +14,9 @@
 #ifndef __RANDOMVAR_HPP__
 #define __RANDOMVAR_HPP__
 
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
 #include <fstream>
 #include <iostream>
 #include <string>
@@ -22,6 +25,8 @@
 
 #include <baseexc.hpp>
 #include <cloneable.hpp>
+#include <datafile.hpp>
+#include <statearchive.hpp>
 
 #ifdef _MSC_VER
 #pragma warning(disable: 4290)
@@ -55,10 +60,24 @@ namespace MetaSim {
     //@{
     /** 
         The basic class for Random Number Generator. It is possible to
-        derive from this class to implement a new generator. */
+        derive from this class to implement a new generator.
+
+        This class implements the minimal standard generator of Park
+        and Miller (31 bits, period 2^31 - 2), which is the default
+        generator of every SimContext. The faster generators with a
+        longer period (see randomgen.hpp) derive from it and redefine
+        the virtual functions; RandomGen::create() builds one of them
+        by name, and RandomVar::setGenerator() installs it in the
+        current context.
+
+        A generator can be split in non-overlapping streams (see
+        stream()), one for every replica or logical process, and its
+        whole state can be saved and restored (see saveState()).
+    */
     class RandomGen {
         RandNum _seed;
         RandNum _xn;
+        bool _antithetic;
 
         // constants used by the internal pseudo-causal number generator. 
         static const RandNum A;
@@ -67,25 +86,102 @@ namespace MetaSim {
         static const RandNum R;	// M mod A
 
     public:
+        /**
+           \ingroup metasim_exc
+
+           Exceptions for RandomGen.
+        */
+        class Exc : public BaseExc {
+        public:
+            Exc(const std::string &wh, const std::string &cl = "RandomGen") :
+                BaseExc(wh, cl, "randomvar.hpp") {}
+        };
+
         /**
            Creates a Random Generator with s as initial seed.
            See file include/seeds.h for a list of seeds.
         */
         RandomGen(RandNum s);
 
-        /** Initialize the generator with seed s */
-        void init(RandNum s);
+        virtual ~RandomGen() {}
+
+        /**
+           Creates a generator by name, initialized with seed s:
+           "minstd" (this class), "xoshiro256**" (or "xoshiro"),
+           "pcg64" and "philox" (see randomgen.hpp). Throws Exc
+           if the name is unknown.
+        */
+        static std::unique_ptr<RandomGen> create(const std::string &name,
+                                                 RandNum s);
+
+        /// A copy of the generator, in the same state
+        virtual std::unique_ptr<RandomGen> clone() const;
+
+        /// The name of the generator, as accepted by create()
+        virtual std::string getName() const { return "minstd"; }
+
+        /** Initialize the generator with seed s. For this
+            generator, a seed out of [1, M - 1] is reduced in
+            that interval. */
+        virtual void init(RandNum s);
+
+        /// The seed of the last init()
+        inline RandNum getSeed() const { return _seed; }
+
+        /** If true, UniformVar and the variables computed from
+            it by inversion use 1 - u in place of every uniform
+            number u of this generator (antithetic variates). */
+        inline void setAntithetic(bool a) { _antithetic = a; }
+        inline bool isAntithetic() const { return _antithetic; }
 
         /** extract the next random number from the
-            sequence */
-        RandNum sample();
+            sequence, in [0, getModule()) */
+        virtual RandNum sample();
+
+        /** A uniformly distributed double in (0, 1). The default
+            implementation divides sample() by the module; the 64
+            bits generators use 53 random bits. */
+        virtual double uniform();
+
+        /** Writes n uniform doubles in (0, 1) in out, the same
+            numbers as n calls of uniform(). The 64 bits
+            generators redefine it with a loop on their inline
+            next(), without virtual calls. */
+        virtual void fillUniform(double *out, size_t n);
+
+        /** advances the sequence by n numbers, as if sample() was
+            called n times, in O(log n) time. A derived class must
+            redefine it, with stream(), clone() and the state
+            functions. */
+        virtual void jump(uint64_t n);
+
+        /** 
+            Moves the generator to the beginning of the k-th of n
+            streams, starting from the current state. The streams
+            of different k do not overlap: here they are n equal
+            segments of the period; the 64 bits generators have
+            streams of fixed length (2^64 numbers at least), and
+            ignore n.
+        */
+        virtual void stream(uint64_t k, uint64_t n);
 
-        /** Returns the current sequence number. */
+        /// Saves the current state of the sequence
+        virtual void saveState(StateArchive &a) const { a.save(_xn); }
+
+        /// Restores the state saved by saveState()
+        virtual void restoreState(StateArchive &a) { a.restore(_xn); }
+
+        /** Returns the current sequence number. Only for this
+            class: use saveState() for any generator. */
         RandNum getCurrSeed() { return _xn; }
 
+        /** Moves the sequence to a number previously returned
+            by getCurrSeed(), without changing the seed. */
+        void setCurrSeed(RandNum x) { _xn = x; }
+
         /** return the constant M (the module of this random
             generator */
-        RandNum getModule() { return M; }
+        virtual RandNum getModule() { return M; }
     };
 
     /**
@@ -96,17 +192,20 @@ namespace MetaSim {
         static RandNum _seed;
         static RandNum _xn;
 
-        /// Default generator.
-        static RandomGen _stdgen;
-
-        /** Pointer to the current generator (used by the next
-            RandomVar object to be created. */
-        static RandomGen *_pstdgen;
-
         /** The current random generator (used by this
-            object). By default, it is equal to _pstdgen */
+            object). By default, it is the current generator of
+            the current SimContext, when the object is created. */
         RandomGen *_gen;
 
+        /// The substream of a key in the current context (see
+        /// setStream()), created if needed
+        static RandomGen *getStream(const std::string &key);
+
+        /// The counter of the context, incremented by
+        /// initStreams(): a change means that the substreams have
+        /// been seeded again
+        static const uint64_t *getStreamEpoch();
+
     public:
 
         typedef std::string BASE_KEY_TYPE;
@@ -156,24 +255,79 @@ namespace MetaSim {
         
         virtual ~RandomVar();
         
-        /// Initialize the standard generator with a given
-        /// seed
-        static inline void init(RandNum s) { _pstdgen->init(s); }
+        /// Initialize the standard generator of the current
+        /// context with a given seed
+        static void init(RandNum s);
   
-        /// Change the standard generator
+        /// Change the standard generator (used by the next
+        /// RandomVar objects created in the current context)
         static RandomGen *changeGenerator(RandomGen *g);
 
-        /// Restore the standard generator
+        /// Restore the default generator of the current context
         static void restoreGenerator();
 
+        /// Replaces the default generator of the current context
+        /// (e.g. with one made by RandomGen::create()), and makes
+        /// it the standard generator. The RandomVar objects that
+        /// already exist keep using the old one (which is kept
+        /// by the context), so it is called before creating the
+        /// model.
+        static void setGenerator(std::unique_ptr<RandomGen> g);
+
+        /// The default generator of the current context
+        static RandomGen &getDefaultGenerator();
+
+        /**
+           Draws the numbers of this variable from its own substream,
+           identified by a stable key (e.g. "arrivals/source1"),
+           instead of the default generator. The substream is a
+           generator of the same type of the current one, seeded at
+           the beginning of every run from the seed of the context
+           (see init()), the key and the index of the run: the
+           variables of a model with the same keys get the same
+           numbers in run k, whatever the other draws of the model
+           (common random numbers). It must be called before the
+           first run. Variables with the same key share the
+           substream.
+        */
+        void setStream(const std::string &key);
+
+        /// The variable draws its numbers from g, which must
+        /// live longer than the variable
+        inline void useGenerator(RandomGen *g) { _gen = g; }
+
+        /**
+           If true, the runs are paired: run 2j + 1 uses the
+           substreams of run 2j (see setStream()) with antithetic
+           numbers (see RandomGen::setAntithetic()).
+        */
+        static void setAntitheticRuns(bool a);
+
+        /// Seeds again all the substreams of the current context
+        /// for the given run (called by the Simulation)
+        static void initStreams(size_t run);
+
         /** 
             This method must be overloaded in each derived
             class to return a double according to the propoer
             distriibution. */
         virtual double get() = 0;
 
-        virtual double getMaximum() throw(MaxException) = 0;
-        virtual double getMinimum() throw(MaxException) = 0;
+        /**
+           Writes n values of the variable in out. The default
+           implementation calls get() n times; the continuous
+           distributions redefine it to draw all the uniform numbers
+           from the generator at once, and to transform them in a
+           separate loop, that the compiler can unroll and vectorize
+           (e.g. with the vector math library of glibc, when
+           compiled with -ffast-math or -fopenmp-simd). The values
+           are the same as the ones of n calls of get(), except for
+           NormalVar (see there). See also BufferedVar.
+        */
+        virtual void fill(double *out, size_t n);
+
+        virtual double getMaximum() = 0;
+        virtual double getMinimum() = 0;
 
 
         /** Parses a random variable from a string. String is in the
@@ -183,8 +337,53 @@ namespace MetaSim {
 
             - par1, par2, ... are parameters of the distribution, and their
               number and type depends on the specific distribution.
+
+            The string is parsed once: the variable is kept as a
+            prototype, and the next calls with the same string
+            return a copy of it, bound to the generator of the
+            current context. The variables that read a file
+            ("trace", "PDF") are not kept, as the file may change
+            between two calls.
         */
         static std::unique_ptr<RandomVar> parsevar(const std::string &str);
+
+        /// Forgets the prototypes of parsevar()
+        static void clearParseCache();
+
+        /**
+           A specification of a variable, parsed once: create()
+           returns a copy of its prototype, bound to the generator
+           of the current context. A file is read when the Spec is
+           built.
+
+           @code
+           RandomVar::Spec service(config["service"]);
+           for (auto &s : servers) s->setService(service.create());
+           @endcode
+        */
+        class Spec {
+        public:
+            /// Parses the string (throws parse_util::ParseExc)
+            explicit Spec(const std::string &str);
+
+            /// A new variable of the specification
+            std::unique_ptr<RandomVar> create() const;
+
+            /// The string of the specification
+            inline const std::string &str() const { return _str; }
+
+        private:
+            std::string _str;
+            std::shared_ptr<const RandomVar> _proto;
+        };
+
+    private:
+        /// Parses a string, without the cache
+        static std::unique_ptr<RandomVar> build(const std::string &str,
+                                                std::string &token);
+
+        /// A copy of a prototype, on the current generator
+        static std::unique_ptr<RandomVar> instantiate(const RandomVar &proto);
     };
 
     /**  
@@ -202,8 +401,9 @@ namespace MetaSim {
         static std::unique_ptr<DeltaVar> createInstance(std::vector<std::string> &par);  
         
         virtual double get() { return _var; } 
-        virtual double getMaximum() throw(MaxException) {return _var;}
-        virtual double getMinimum() throw(MaxException) {return _var;}
+        virtual void fill(double *out, size_t n) { std::fill(out, out + n, _var); }
+        virtual double getMaximum() {return _var;}
+        virtual double getMinimum() {return _var;}
     };
 
     /** 
@@ -211,37 +411,69 @@ namespace MetaSim {
         and max. */
     class UniformVar : public RandomVar {
         double _min, _max;
+        bool _antithetic;
+    protected:
+        /// n uniform numbers in (0, 1), with 1 - u if antithetic
+        void fillUnit(double *out, size_t n);
     public:
         UniformVar(double min, double max) 
-            : RandomVar(), _min(min), _max(max) {}
+            : RandomVar(), _min(min), _max(max), _antithetic(false) {}
 
         CLONEABLE(RandomVar, UniformVar)
 
         static std::unique_ptr<UniformVar> createInstance(std::vector<std::string> &par);
         
         virtual double get();
-                virtual double getMaximum() throw(MaxException) {return _max;}
-        virtual double getMinimum() throw(MaxException) {return _min;}
+        virtual void fill(double *out, size_t n);
+                virtual double getMaximum() {return _max;}
+        virtual double getMinimum() {return _min;}
+
+        /**
+           If true, every uniform number u is replaced by 1 - u. In
+           the derived classes that compute the value by inversion
+           (ExponentialVar and PoissonVar with INVERSION, WeibullVar,
+           ParetoVar, GenericVar) the values are then negatively
+           correlated with the ones of the same stream; the rejection
+           methods ignore it. The generator can also be antithetic
+           (see RandomGen::setAntithetic()): the two flags cancel out.
+        */
+        inline void setAntithetic(bool a) { _antithetic = a; }
+        inline bool isAntithetic() const { return _antithetic; }
     };
 
     /**
        This class implements an exponential distribution, with mean m. */
     class ExponentialVar : public UniformVar {
-        double _lambda;
     public :
-        ExponentialVar(double m) : 
-            UniformVar(0, 1), _lambda(m) {}
+        /**
+           INVERSION computes -log(u) / rate from one uniform number
+           u, so the value is a monotone function of u (as needed by
+           common and antithetic random numbers); ZIGGURAT is faster,
+           and uses a variable number of uniform numbers (see
+           ziggurat.hpp).
+        */
+        enum Method { INVERSION, ZIGGURAT };
+
+        ExponentialVar(double m, Method meth = INVERSION) : 
+            UniformVar(0, 1), _lambda(m), _method(meth) {}
 
         CLONEABLE(RandomVar, ExponentialVar)
 
         static std::unique_ptr<ExponentialVar> createInstance(std::vector<std::string> &par);
         
         virtual double get();
+        virtual void fill(double *out, size_t n);
 
-        virtual double getMaximum() throw(MaxException)
+        virtual double getMaximum()
             {throw MaxException("ExponentialVar");}
-        virtual double getMinimum() throw(MaxException)
+        virtual double getMinimum()
             {return 0;}
+
+        inline Method getMethod() const { return _method; }
+
+    private:
+        double _lambda;
+        Method _method;
     };
 
     /**
@@ -260,9 +492,10 @@ namespace MetaSim {
         static std::unique_ptr<WeibullVar> createInstance(std::vector<std::string> &par);
 
         virtual double get();
+        virtual void fill(double *out, size_t n);
 
-        virtual double getMaximum() throw(MaxException) { throw MaxException("WeibullVar"); }
-        virtual double getMinimum() throw(MaxException) { return 0; }
+        virtual double getMaximum() { throw MaxException("WeibullVar"); }
+        virtual double getMinimum() { return 0; }
     };
 
     /**
@@ -278,25 +511,36 @@ namespace MetaSim {
         static std::unique_ptr<ParetoVar> createInstance(std::vector<std::string> &par);
 
         virtual double get();
+        virtual void fill(double *out, size_t n);
 
-        virtual double getMaximum() throw(MaxException)
+        virtual double getMaximum()
             {throw MaxException("ExponentialVar");}
-        virtual double getMinimum() throw(MaxException)
+        virtual double getMinimum()
             {throw MaxException("ExponentialVar");}
     };
 
     /**
-       This class implements a normal distribution, with mean m variance
-       sigma. In this class, we use the cephes library function
-       ndtri(). */
+       This class implements a normal distribution, with mean m and
+       standard deviation s. By default the values are computed
+       with the Ziggurat method (see ziggurat.hpp); with BOX_MULLER,
+       they are computed in pairs from two uniform numbers, and the
+       second value of a pair is kept in the object for the next
+       call of get(). */
     class NormalVar : public UniformVar {
+    public:
+        enum Method { BOX_MULLER, ZIGGURAT };
+
+    private:
         double _mu, _sigma;
+        Method _method;
+        // the second value of the last pair (Box-Muller)
         bool _yes;
         double _oldv;
   
     public:
-        NormalVar(double m, double s) : 
-            UniformVar(0, 1), _mu(m), _sigma(s), _yes(false)
+        NormalVar(double m, double s, Method meth = ZIGGURAT) : 
+            UniformVar(0, 1), _mu(m), _sigma(s), _method(meth), _yes(false),
+            _oldv(0)
             {}
 
         CLONEABLE(RandomVar, NormalVar)
@@ -304,32 +548,79 @@ namespace MetaSim {
         static std::unique_ptr<NormalVar> createInstance(std::vector<std::string> &par);
 
         virtual double get();
-        virtual double getMaximum() throw(MaxException)
+
+        /// With BOX_MULLER, the values are computed in pairs, as
+        /// in get(), but from the uniform numbers of a single
+        /// block: the sequence is not the same of n calls of
+        /// get(), and the second value of the last pair is
+        /// discarded when n is odd.
+        virtual void fill(double *out, size_t n);
+
+        virtual double getMaximum()
             {throw MaxException("NormalVar");}
-        virtual double getMinimum() throw(MaxException)
+        virtual double getMinimum()
             {throw MaxException("NormalVar");}
+
+        inline Method getMethod() const { return _method; }
     };
 
 
     /**
-       This class implements a Poisson distribution, with mean lambda */
+       This class implements a Poisson distribution, with mean lambda.
+
+       Two methods are available:
+
+       - INVERSION searches the value from 0, with one uniform number
+         and O(lambda) operations (at most CUTOFF);
+       - PTRS is the transformed rejection of Hoermann ("The
+         transformed rejection method for generating Poisson random
+         variables", 1993): O(1) operations and about 1.2 pairs of
+         uniform numbers per value, for lambda >= PTRS_MIN.
+
+       By default, INVERSION is used for lambda < PTRS_MIN, so the
+       models with a small lambda have the same sequences as
+       before, and PTRS otherwise. The constants of both methods are
+       computed in the constructor.
+    */
     class PoissonVar : public UniformVar {
-        double _lambda;
     public:
+        enum Method { INVERSION, PTRS };
+
         static const unsigned long CUTOFF;
-        PoissonVar(double l) : 
-            UniformVar(0, 1), _lambda(l) {}
+
+        /// The smallest lambda of the default PTRS method
+        static const double PTRS_MIN;
+
+        PoissonVar(double l);
+
+        /// Throws Exc if m is PTRS and l < PTRS_MIN
+        PoissonVar(double l, Method m);
 
         CLONEABLE(RandomVar, PoissonVar)
 
         static std::unique_ptr<PoissonVar> createInstance(std::vector<std::string> &par);
         
         virtual double get();
+        virtual void fill(double *out, size_t n);
+
+        inline Method getMethod() const { return _method; }
 
-        virtual double getMaximum() throw(MaxException)
+        virtual double getMaximum()
             {throw MaxException("PoissonVar");}
-        virtual double getMinimum() throw(MaxException)
+        virtual double getMinimum()
             {throw MaxException("PoissonVar");}
+
+    private:
+        double _lambda;
+        Method _method;
+        // exp(-lambda), for the inversion
+        double _expl;
+        // the constants of PTRS
+        double _slam, _loglam, _a, _b, _invalpha, _vr;
+
+        void setup();
+        double invert(double u) const;
+        double ptrs();
     };
 
     /**
@@ -339,24 +630,121 @@ namespace MetaSim {
        call of get() returns one of the numbers in the sequence.  When
        the last number in the sequence has been read, the sequence
        starts over.
+
+       The file can be a text file of numbers, which is read in
+       memory, or a binary data file (see DataFile::convert()),
+       which is used without parsing:
+
+       - MAP (the default) maps the file in memory, and the
+         variables of the same file share the mapping (see
+         MappedData);
+       - STREAM reads the file in order with a buffer of a bounded
+         size (see DataStream);
+       - LOAD reads the values in a vector of the object.
+
+       A ChunkedTrace is read as the sequence of the payloads of
+       its records, decompressed once: a trace of a run drives the
+       next one. The mode of a text file or of a chunked trace is
+       always LOAD. In the factory:
+       "trace(file)" or "trace(file, stream)".
     */
     class DetVar : public RandomVar {
+    public:
+        enum Mode { LOAD, MAP, STREAM };
+
+    private:
         std::vector<double> _array;
         unsigned int _count;
+        Mode _mode;
+        std::shared_ptr<const MappedData> _map;
+        std::unique_ptr<DataStream> _stream;
+        size_t _mapPos;
+
+        void load(const std::string &filename);
     public:
-        DetVar(const std::string &filename);
+        /**
+           @param filename a text or a binary file
+           @param mode how a binary file is read
+           @param buffer the number of values in the buffer of
+                  the STREAM mode
+         */
+        DetVar(const std::string &filename, Mode mode = MAP,
+               size_t buffer = DataStream::DEFAULT_BUFFER);
         DetVar(std::vector<double> &a);
         DetVar(double a[], int s);
+
+        /// The copy continues the sequence from the same point,
+        /// and shares the mapping of the file
+        DetVar(const DetVar &d);
         
         CLONEABLE(RandomVar, DetVar)
         
         static std::unique_ptr<DetVar> createInstance(std::vector<std::string> &par);
 
         virtual double get();
-        virtual double getMaximum() throw(MaxException);
-        virtual double getMinimum() throw(MaxException);
+        virtual void fill(double *out, size_t n);
+        virtual double getMaximum();
+        virtual double getMinimum();
+
+        inline Mode getMode() const { return _mode; }
 
+        /// The number of values in the sequence
+        size_t size() const;
     };
+
+    /**
+       An adapter that draws the values of another variable in
+       blocks, with RandomVar::fill(), and returns them one at a time:
+       get() is then a read from an array, and the virtual call to
+       the generator and the mathematical functions are amortized
+       over the block. The values are the ones of the wrapped
+       variable, in the same order (see fill()).
+
+       @code
+       _at.reset(new BufferedVar(RandomVar::parsevar("exp(0.1)")));
+       @endcode
+
+       The buffer is drawn in advance, so the variable consumes up
+       to a block of numbers more than the ones used; reset()
+       discards the values not yet returned.
+    */
+    class BufferedVar : public RandomVar {
+        std::unique_ptr<RandomVar> _var;
+        std::vector<double> _buf;
+        size_t _pos;
+
+        void refill();
+    public:
+        /// Default number of values in a block
+        static const size_t DEFAULT_BLOCK = 256;
+
+        explicit BufferedVar(std::unique_ptr<RandomVar> v,
+                             size_t block = DEFAULT_BLOCK);
+
+        /// The copy has a copy of the wrapped variable, and
+        /// the values not yet returned
+        BufferedVar(const BufferedVar &r);
+
+        CLONEABLE(RandomVar, BufferedVar)
+
+        inline virtual double get() final
+        {
+            if (_pos == _buf.size()) refill();
+            return _buf[_pos++];
+        }
+
+        virtual void fill(double *out, size_t n);
+
+        virtual double getMaximum() { return _var->getMaximum(); }
+        virtual double getMinimum() { return _var->getMinimum(); }
+
+        /// Discards the values in the buffer
+        void reset() { _pos = _buf.size(); }
+
+        /// The wrapped variable
+        RandomVar &getVar() { return *_var; }
+    };
+
     //@}
 
 } // namespace MetaSim
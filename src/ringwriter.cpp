@@ -0,0 +1,182 @@
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#include <chrono>
+
+#include <ringwriter.hpp>
+
+namespace MetaSim {
+
+    using namespace std;
+
+    const size_t RingWriter::DEFAULT_RING;
+
+    namespace {
+        // the writer looks at the ring at least so often
+        const chrono::milliseconds POLL(1);
+
+        // the buffer of the file, between the ring and the system
+        const size_t FILE_BUFFER = 1 << 16;
+    }
+
+    RingWriter::RingWriter(const string &path, size_t ring, Policy policy) :
+        WriterThread(path), _policy(policy),
+        _size(64), _cachedHead(0), _spilled(0), _dropped(0), _droppedBytes(0),
+        _tail(0), _head(0), _spilling(false), _spillBytes(0),
+        _flushed(0), _failed(false)
+    {
+        _file = fopen(path.c_str(), "wb");
+        if (!_file) throw Exc("Cannot open file " + path);
+        while (_size < ring) _size *= 2;
+        _mask = _size - 1;
+        _ring.resize(_size);
+        setvbuf(_file, NULL, _IOFBF, FILE_BUFFER);
+        _thread = thread(&RingWriter::run, this);
+    }
+
+    RingWriter::~RingWriter()
+    {
+        closeQuietly(*this);
+    }
+
+    bool RingWriter::full(const void *p, size_t n)
+    {
+        const char *c = static_cast<const char *>(p);
+        switch (_policy) {
+        case DROP:
+            ++_dropped;
+            _droppedBytes += n;
+            return false;
+
+        case BLOCK:
+            // a block larger than the ring goes in pieces
+            while (n > 0) {
+                size_t k = min(n, _size);
+                uint64_t t = _tail.load(memory_order_relaxed);
+                while (t + k - _cachedHead > _size) {
+                    _cv.notify_one();
+                    this_thread::yield();
+                    _cachedHead = _head.load(memory_order_acquire);
+                }
+                copy(t, c, k);
+                _tail.store(t + k, memory_order_release);
+                c += k;
+                n -= k;
+            }
+            return true;
+
+        case SPILL:
+            break;
+        }
+
+        {
+            lock_guard<mutex> l(_lock);
+            if (!_spilling.load(memory_order_relaxed)) {
+                // the writer may have drained the ring meanwhile
+                uint64_t t = _tail.load(memory_order_relaxed);
+                _cachedHead = _head.load(memory_order_acquire);
+                if (t + n - _cachedHead <= _size) {
+                    copy(t, c, n);
+                    _tail.store(t + n, memory_order_release);
+                    return true;
+                }
+            }
+            _spill.insert(_spill.end(), c, c + n);
+            _spillBytes.fetch_add(n, memory_order_release);
+            _spilled += n;
+            _spilling.store(true, memory_order_release);
+        }
+        _cv.notify_one();
+        return true;
+    }
+
+    void RingWriter::fail()
+    {
+        lock_guard<mutex> l(_lock);
+        setError(make_exception_ptr(Exc("Cannot write file " + _path)));
+        _failed.store(true);
+    }
+
+    void RingWriter::run()
+    {
+        vector<char> spill;
+        // the spilled bytes written
+        uint64_t spilled = 0;
+        for (;;) {
+            uint64_t h = _head.load(memory_order_relaxed);
+            uint64_t t = _tail.load(memory_order_acquire);
+            if (h != t) {
+                size_t i = size_t(h & _mask);
+                size_t len = size_t(min<uint64_t>(t - h, _size - i));
+                if (!_failed.load() && fwrite(&_ring[i], 1, len, _file) != len) fail();
+                _head.store(h + len, memory_order_release);
+                continue;
+            }
+
+            if (_spilling.load(memory_order_acquire)) {
+                {
+                    lock_guard<mutex> l(_lock);
+                    // the data of the ring comes first: while spilling,
+                    // the producer does not write in the ring
+                    if (_tail.load(memory_order_acquire) != h) continue;
+                    spill.swap(_spill);
+                    _spilling.store(false, memory_order_release);
+                }
+                if (!_failed.load() &&
+                    fwrite(spill.data(), 1, spill.size(), _file) != spill.size()) fail();
+                _spillBytes.fetch_sub(spill.size(), memory_order_release);
+                spilled += spill.size();
+                spill.clear();
+                continue;
+            }
+
+            // the ring is empty
+            if (!_failed.load() && fflush(_file) != 0) fail();
+            unique_lock<mutex> l(_lock);
+            _flushed = h + spilled;
+            _cv.notify_all();
+            if (_stop) return;
+            _cv.wait_for(l, POLL, [this, h] {
+                    return _stop || _tail.load(memory_order_acquire) != h ||
+                        _spilling.load(memory_order_acquire);
+                });
+        }
+    }
+
+    void RingWriter::flush()
+    {
+        _cv.notify_one();
+    }
+
+    void RingWriter::sync()
+    {
+        if (!_file) throw Exc("Writing " + _path + " after close()");
+        // all the bytes accepted so far, in the ring and spilled
+        uint64_t target = _tail.load(memory_order_relaxed) + _spilled;
+        unique_lock<mutex> l(_lock);
+        while (_flushed < target && !_failed.load()) {
+            _cv.notify_all();
+            _cv.wait_for(l, POLL);
+        }
+        checkError();
+    }
+
+    void RingWriter::close()
+    {
+        if (!_file) return;
+        exception_ptr e;
+        try {
+            sync();
+        } catch (...) {
+            e = current_exception();
+        }
+        stopThread();
+        closeFile<Exc>(e);
+    }
+
+} // namespace MetaSim
@@ -0,0 +1,180 @@
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef __RINGWRITER_HPP__
+#define __RINGWRITER_HPP__
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <baseexc.hpp>
+#include <writerthread.hpp>
+
+namespace MetaSim {
+
+    /**
+       \ingroup metasim_util
+
+       A file written by a helper thread through a lock-free ring
+       of bytes, with one producer (the thread of the simulation)
+       and one consumer (the writer). write() copies the data in
+       the ring and publishes it with a store: no lock and no system
+       call, unless the ring is full; the writer drains the ring in
+       the file as the data comes.
+
+       When the ring is full, write() follows the policy of the
+       writer:
+
+       - BLOCK: it waits for the writer (no data is lost);
+       - DROP: it drops the data, and counts it (getDropped());
+       - SPILL: it appends the data to a buffer of memory without
+         bound, drained by the writer after the ring (no data is
+         lost, and the order is kept).
+
+       The data of a write() is dropped or kept as a whole, so a
+       record is never cut. An error of the file is rethrown by
+       sync() or close().
+
+       Unlike AsyncWriter, which passes whole buffers to its thread
+       under a lock, the writer follows the ring byte by byte and
+       polls it: the producer never takes a lock nor waits for a
+       buffer, and the data reaches the file with a small delay,
+       whatever the rate of the writes. The two share the thread,
+       the errors and the closing (see WriterThread).
+    */
+    class RingWriter : private WriterThread {
+    public:
+        /**
+           \ingroup metasim_exc
+        */
+        class Exc : public BaseExc {
+        public:
+            Exc(const std::string &msg) :
+                BaseExc(msg, "RingWriter", "ringwriter.hpp") {}
+        };
+
+        /// What write() does when the ring is full
+        enum Policy { BLOCK, DROP, SPILL };
+
+        /// Default size of the ring, in bytes
+        static const size_t DEFAULT_RING = 1 << 22;
+
+        /**
+           Creates (or truncates) the file.
+
+           @param path the name of the file
+           @param ring the size of the ring, rounded up to a power of 2
+           @param policy what write() does when the ring is full
+         */
+        explicit RingWriter(const std::string &path, size_t ring = DEFAULT_RING,
+                            Policy policy = BLOCK);
+
+        /// Writes the data and closes the file
+        ~RingWriter();
+
+        /// Appends n bytes; false if they have been dropped
+        inline bool write(const void *p, size_t n)
+        {
+            uint64_t t = _tail.load(std::memory_order_relaxed);
+            if (t + n - _cachedHead > _size) {
+                _cachedHead = _head.load(std::memory_order_acquire);
+                if (t + n - _cachedHead > _size) return full(p, n);
+            }
+            if (_spilling.load(std::memory_order_acquire)) return full(p, n);
+            copy(t, p, n);
+            _tail.store(t + n, std::memory_order_release);
+            return true;
+        }
+
+        inline bool write(const std::string &s) { return write(s.data(), s.size()); }
+
+        /// Wakes up the writer, without waiting
+        void flush();
+
+        /// Waits until all the data is in the file
+        void sync();
+
+        /// Writes all the data and closes the file
+        void close();
+
+        inline const std::string &getPath() const { return _path; }
+
+        inline Policy getPolicy() const { return _policy; }
+
+        /// Size of the ring, in bytes
+        inline size_t getSize() const { return _size; }
+
+        /// Bytes not yet written in the file (in the ring and spilled)
+        inline size_t getBacklog() const
+        {
+            return size_t(_tail.load(std::memory_order_acquire) -
+                          _head.load(std::memory_order_acquire)) +
+                _spillBytes.load(std::memory_order_acquire);
+        }
+
+        /// Bytes that have been spilled out of the ring so far
+        inline uint64_t getSpilled() const { return _spilled; }
+
+        /// Number of write() dropped (policy DROP)
+        inline uint64_t getDropped() const { return _dropped; }
+
+        /// Number of bytes dropped (policy DROP)
+        inline uint64_t getDroppedBytes() const { return _droppedBytes; }
+
+    private:
+        inline void copy(uint64_t t, const void *p, size_t n)
+        {
+            size_t i = size_t(t & _mask), first = std::min(n, _size - i);
+            std::memcpy(&_ring[i], p, first);
+            std::memcpy(&_ring[0], static_cast<const char *>(p) + first, n - first);
+        }
+
+        // the slow path of write()
+        bool full(const void *p, size_t n);
+        void run();
+        void fail();
+
+        Policy _policy;
+        size_t _size;
+        size_t _mask;
+        std::vector<char> _ring;
+
+        // written by the producer only
+        uint64_t _cachedHead;
+        uint64_t _spilled;
+        uint64_t _dropped;
+        uint64_t _droppedBytes;
+
+        // the indexes never wrap: a byte i is at _ring[i & _mask];
+        // the producer writes _tail, the writer _head, on different
+        // cache lines
+        char _pad0[64];
+        std::atomic<uint64_t> _tail;
+        char _pad1[64];
+        std::atomic<uint64_t> _head;
+        char _pad2[64];
+
+        // the spilled data, after the data of the ring
+        std::atomic<bool> _spilling;
+        std::atomic<size_t> _spillBytes;
+        std::vector<char> _spill;
+
+        // the bytes in the file (flushed), for sync()
+        uint64_t _flushed;
+        std::atomic<bool> _failed;
+    };
+
+} // namespace MetaSim
+
+#endif
@@ -0,0 +1,203 @@
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <event.hpp>
+#include <eventqueue.hpp>
+#include <objectpool.hpp>
+#include <randomvar.hpp>
+#include <simcontext.hpp>
+#include <simul.hpp>
+
+// Default event queue implementation, see eventqueue.hpp
+#ifndef METASIM_DEFAULT_EVENT_QUEUE
+#define METASIM_DEFAULT_EVENT_QUEUE "heap"
+#endif
+
+namespace MetaSim {
+
+    using namespace std;
+
+    thread_local SimContext *SimContext::_current = nullptr;
+    thread_local vector<SimContext::DeferredOp> *SimContext::_deferred = nullptr;
+
+    SimContext::SimContext() :
+        _eventQueue(),
+        _queueSpec(),
+        _lanes(false),
+        _eventCounter(0),
+        _tombstones(0),
+        _pools(),
+        _objectPools(),
+        _entities(),
+        _entityIndex(),
+        _entityCount(0),
+        _entityBase(0),
+        _newRunThreads(1),
+        _deferOps(false),
+        _lockPools(false),
+        _poolMutex(),
+        _stats(),
+        _results(),
+        _columns(0),
+        _means(),
+        _stdErrors(),
+        _summaryRuns(SIZE_MAX),
+        _tConfidence(-1),
+        _tQuantile(0),
+        _totalNumOfExp(0),
+        _expNum(0),
+        _endOfSim(false),
+        _initFlag(false),
+        _transitory(0),
+        _gateProbes(false),
+        _stdgen(new RandomGen(1)),
+        _pstdgen(_stdgen.get()),
+        _oldgens(),
+        _streams(),
+        _streamSeed(1),
+        _antitheticRuns(false),
+        _streamEpoch(0),
+        _firstRun(0),
+        _sim(),
+        _router(nullptr),
+        _profiler(),
+        _progress()
+    {
+        _sim.reset(new Simulation(*this));
+        const char *prof = getenv("METASIM_PROFILE");
+        if (prof != NULL && string(prof) == "1") enableProfiler();
+        const char *prog = getenv("METASIM_PROGRESS");
+        if (prog != NULL && *prog != 0) enableProgress().setFile(prog);
+    }
+
+    SimContext::~SimContext()
+    {
+        // disposable events still in the queue belong to us
+        if (_eventQueue) _sim->clearEventQueue();
+        for (ObjectPoolBase *p : _objectPools) p->_ctx = nullptr;
+    }
+
+    SimContext &SimContext::getDefault()
+    {
+        // never destroyed, as it may be used by static objects
+        static SimContext *def = []() {
+            SimContext *c = new SimContext();
+            // only here: the other contexts (e.g. of the parallel
+            // replications) would overwrite the file
+            const char *tl = getenv("METASIM_TIMELINE");
+            if (tl != NULL && *tl != 0) {
+                c->enableProfiler();
+                c->_profiler->enableTimeline(tl);
+            }
+            return c;
+        }();
+        return *def;
+    }
+
+    void SimContext::enableProfiler(bool on)
+    {
+        if (!on) _profiler.reset();
+        else if (!_profiler) _profiler.reset(new Profiler());
+    }
+
+    Progress &SimContext::enableProgress(uint64_t every)
+    {
+        if (!_progress) _progress.reset(new Progress(every));
+        else _progress->setInterval(every);
+        return *_progress;
+    }
+
+    void SimContext::disableProgress()
+    {
+        _progress.reset();
+    }
+
+    void SimContext::initEventQueue()
+    {
+        const char *spec = getenv("METASIM_EVENT_QUEUE");
+        if (spec == NULL || *spec == 0) spec = METASIM_DEFAULT_EVENT_QUEUE;
+        _queueSpec = spec;
+        _eventQueue = makeEventQueue(_queueSpec);
+    }
+
+    unique_ptr<EventQueue> SimContext::makeEventQueue(const string &spec) const
+    {
+        unique_ptr<EventQueue> q = EventQueue::create(spec);
+        if (_lanes && dynamic_cast<ImmediateLanes *>(q.get()) == nullptr)
+            q = unique_ptr<EventQueue>(new ImmediateLanes(std::move(q)));
+        return q;
+    }
+
+    void SimContext::DeferredOp::apply() const
+    {
+        switch (kind) {
+        case POST: e->post(t, disp); break;
+        case DROP: e->drop(); break;
+        case RESCHEDULE: e->reschedule(t); break;
+        case CANCEL: e->cancelLazy(); break;
+        }
+    }
+
+    void *SimContext::allocEvent(int id, size_t size)
+    {
+        unique_lock<mutex> lock(_poolMutex, defer_lock);
+        if (_lockPools) lock.lock();
+        if (size_t(id) >= _pools.size()) _pools.resize(id + 1);
+        if (!_pools[id]) _pools[id].reset(new EventPool(size));
+        return _pools[id]->allocate();
+    }
+
+    void SimContext::freeEvent(int id, void *p)
+    {
+        unique_lock<mutex> lock(_poolMutex, defer_lock);
+        if (_lockPools) lock.lock();
+        _pools[id]->release(p);
+    }
+
+    void SimContext::resetEventPools()
+    {
+        for (auto &p : _pools) 
+            if (p) p->reset();
+    }
+
+    void SimContext::resetObjectPools()
+    {
+        for (ObjectPoolBase *p : _objectPools) p->reset();
+    }
+
+    void SimContext::setImmediateLanes(bool on)
+    {
+        if (on == _lanes) return;
+        _lanes = on;
+        if (_eventQueue) setEventQueue(_queueSpec);
+    }
+
+    void SimContext::setEventQueue(const string &spec)
+    {
+        unique_ptr<EventQueue> q = makeEventQueue(spec);
+        _queueSpec = spec;
+        if (_eventQueue) {
+            // the order of insertion does not matter: the events
+            // keep their time and their insertion order
+            vector<Event *> v;
+            _eventQueue->drain(v);
+            for (size_t i = 0; i < v.size(); ++i) {
+                // the cancelled events are left behind
+                if (v[i]->_cancelled) v[i]->_cancelled = false;
+                else q->insert(v[i]);
+            }
+        }
+        _eventQueue = std::move(q);
+    }
+
+} // namespace MetaSim
@@ -0,0 +1,344 @@
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef __SIMCONTEXT_HPP__
+#define __SIMCONTEXT_HPP__
+
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <basetype.hpp>
+#include <eventpool.hpp>
+#include <eventqueue.hpp>
+#include <profiler.hpp>
+#include <progress.hpp>
+
+namespace MetaSim {
+
+    class BaseStat;
+    class Entity;
+    class Event;
+    class ObjectPoolBase;
+    class RandomGen;
+    class SimContext;
+    class Simulation;
+    class StatOutput;
+
+    /**
+       \ingroup metasim_ee
+
+       Receives the events that are posted in a context from the code
+       executing in another context (e.g. by a different logical
+       process of a ParallelSimulation). A context without router
+       accepts posts from anywhere, as if they came from itself.
+    */
+    class EventRouter {
+    public:
+        virtual ~EventRouter() {}
+
+        /**
+           Called by Event::post() instead of inserting the event in
+           the queue of its context, when the current context is
+           different from the context of the event.
+        */
+        virtual void route(SimContext &from, Event *e, Tick t, bool disp) = 0;
+    };
+
+    /**
+       \ingroup metasim_ee
+
+       A simulation context. It holds all the state that used to be
+       global: the event queue and the FIFO counter, the registry of
+       the entities, the registry of the statistics, the default
+       random generator and the simulation engine (with its clock).
+
+       Every Event, Entity, BaseStat and RandomVar is bound, when it
+       is constructed, to the <i>current</i> context of the calling
+       thread. The current context is the default one, unless
+       another context has been activated with a SimContext::Scope:
+
+       @code
+       SimContext ctx;
+       {
+           SimContext::Scope s(ctx);
+           MyModel model;          // bound to ctx
+           SIMUL.run(1000);        // the engine of ctx
+       }
+       @endcode
+
+       Therefore, existing models that only use SIMUL and the static
+       functions keep working unchanged on the default context, while
+       independent models can be run in the same process, also on
+       different threads (one context per thread at a time).
+
+       All the objects bound to a context must be destroyed before
+       the context itself. The default context is never destroyed.
+    */
+    class SimContext {
+        // event queue, created from _queueSpec (with the
+        // ImmediateLanes on top, if _lanes)
+        std::unique_ptr<EventQueue> _eventQueue;
+        std::string _queueSpec;
+        bool _lanes;
+        long _eventCounter;
+        // cancelled events removed from the queue by firstEvent()
+        uint64_t _tombstones;
+
+        // memory of the events created with Event::create<T>(),
+        // indexed by EventPool::typeId<T>()
+        std::vector<std::unique_ptr<EventPool> > _pools;
+        // the pools of the objects of the model (see ObjectPool)
+        std::vector<ObjectPoolBase *> _objectPools;
+
+        // entities, indexed by ID - _entityBase - 1: the IDs are
+        // dense, so the vector only has a hole (NULL) for every
+        // destroyed entity; the IDs before _entityBase belong to
+        // entities that have all been destroyed
+        std::vector<Entity *> _entities;
+        std::unordered_map<std::string, Entity *> _entityIndex;
+        int _entityCount;
+        int _entityBase;
+        // threads of the newRun() of the independent entities
+        // (see Entity::setIndependent())
+        unsigned _newRunThreads;
+
+        // while the independent entities run newRun() in
+        // parallel, or the events of a step run in parallel (see
+        // Simulation::setStepThreads()), the changes of the queue
+        // are collected in the vector of the calling thread, and
+        // applied in order after
+        struct DeferredOp {
+            enum Kind { POST, DROP, RESCHEDULE, CANCEL };
+            Kind kind;
+            Event *e;
+            Tick t;
+            bool disp;
+
+            void apply() const;
+        };
+        bool _deferOps;
+        static thread_local std::vector<DeferredOp> *_deferred;
+
+        /// Collects an operation on the queue, if they are
+        /// deferred; returns false otherwise
+        inline bool defer(DeferredOp::Kind k, Event *e, Tick t = 0,
+                          bool disp = false) {
+            if (!_deferOps || _deferred == nullptr) return false;
+            _deferred->push_back(DeferredOp{ k, e, t, disp });
+            return true;
+        }
+
+        // the event pools are shared by the threads of a parallel
+        // step
+        bool _lockPools;
+        std::mutex _poolMutex;
+
+        // statistics, in order of creation
+        std::vector<BaseStat *> _stats;
+        // the values of the stats in the runs: a row of _columns
+        // values for each run, one for each stat (BaseStat::_slot;
+        // the columns of the stats destroyed stay until init())
+        std::vector<double> _results;
+        size_t _columns;
+        // by column, the means and the standard errors over the
+        // first _summaryRuns runs (-1: to compute again), and the
+        // t quantile of the last confidence interval
+        std::vector<double> _means;
+        std::vector<double> _stdErrors;
+        size_t _summaryRuns;
+        double _tConfidence;
+        double _tQuantile;
+        size_t _totalNumOfExp;
+        size_t _expNum;
+        bool _endOfSim;
+        bool _initFlag;
+        Tick _transitory;
+        // the gated particles are not called (see
+        // BaseStat::setGated()): set at the start of a run with a
+        // transitory, reset by the first event after it
+        bool _gateProbes;
+        // the files of the values of the runs (see StatOutput)
+        std::list<StatOutput *> _outputs;
+
+        // random generation
+        std::unique_ptr<RandomGen> _stdgen;
+        RandomGen *_pstdgen;
+        // generators replaced by RandomVar::setGenerator(), still
+        // used by the variables created before
+        std::vector<std::unique_ptr<RandomGen> > _oldgens;
+        // the substreams of the variables, by key (see
+        // RandomVar::setStream()), seeded again at every run from
+        // _streamSeed, the key and the index of the run
+        std::map<std::string, std::unique_ptr<RandomGen> > _streams;
+        long _streamSeed;       // a RandNum
+        bool _antitheticRuns;
+        // incremented when the substreams are seeded again
+        uint64_t _streamEpoch;
+        // the index of the first run of this context (for the
+        // parallel replications)
+        size_t _firstRun;
+
+        // the engine
+        std::unique_ptr<Simulation> _sim;
+
+        // receives the posts from other contexts, if not NULL
+        EventRouter *_router;
+
+        // NULL if profiling is disabled
+        std::unique_ptr<Profiler> _profiler;
+
+        // NULL if the progress is not reported
+        std::unique_ptr<Progress> _progress;
+
+        static thread_local SimContext *_current;
+
+        void initEventQueue();
+        std::unique_ptr<EventQueue> makeEventQueue(const std::string &spec) const;
+
+        void *allocEvent(int id, size_t size);
+        void freeEvent(int id, void *p);
+
+        SimContext(const SimContext &);
+        SimContext &operator=(const SimContext &);
+
+        friend class BaseStat;
+        friend class Checkpoint;
+        friend class Entity;
+        friend class Event;
+        friend class ObjectPoolBase;
+        friend class ProcessFrames;
+        friend class RandomVar;
+        friend class Simulation;
+        friend class StatOutput;
+        friend class StoppingRule;
+        friend class Sweep;
+        friend class TimeWarpSimulation;
+    public:
+        SimContext();
+        ~SimContext();
+
+        /// Returns the default context, the one used when no
+        /// other context has been activated.
+        static SimContext &getDefault();
+
+        /// Returns the current context of the calling thread.
+        static inline SimContext &current() {
+            return _current != nullptr ? *_current : getDefault();
+        }
+
+        /**
+           Makes a context the current one for the calling thread,
+           until the end of the scope.
+        */
+        class Scope {
+            SimContext *_old;
+            Scope(const Scope &);
+            Scope &operator=(const Scope &);
+        public:
+            explicit Scope(SimContext &c) : _old(_current) { _current = &c; }
+            ~Scope() { _current = _old; }
+        };
+
+        /// The simulation engine of this context.
+        inline Simulation &getSimulation() { return *_sim; }
+
+        /**
+            Returns the event queue of this context, creating the
+            default implementation if needed (see
+            Event::setEventQueue()).
+        */
+        inline EventQueue &getEventQueue() {
+            if (!_eventQueue) initEventQueue();
+            return *_eventQueue;
+        }
+
+        /// See Event::setEventQueue().
+        void setEventQueue(const std::string &spec);
+
+        /**
+           Puts the events posted at the current time in FIFO
+           lanes, on top of the queue (see ImmediateLanes). The
+           order of the events does not change; it pays off when
+           many events are posted with no delay, and costs a few
+           nanoseconds per event otherwise, so it is off by
+           default.
+        */
+        void setImmediateLanes(bool on);
+
+        inline bool hasImmediateLanes() const { return _lanes; }
+
+        /**
+           Returns the first pending event of the queue, or NULL.
+           The events cancelled with Event::cancelLazy() found at
+           the head of the queue are removed on the way.
+        */
+        inline Event *firstEvent();
+
+        /**
+           Number of events cancelled with Event::cancelLazy() and
+           skipped by the engine since the last
+           Simulation::initRuns().
+        */
+        inline uint64_t getSkippedTombstones() const { return _tombstones; }
+
+        /// Sets the router of the posts coming from other contexts
+        /// (NULL to remove it).
+        inline void setRouter(EventRouter *r) { _router = r; }
+
+        inline EventRouter *getRouter() const { return _router; }
+
+        /// Enables or disables the profiler of this context (see
+        /// Profiler). Disabling it discards its data.
+        void enableProfiler(bool on = true);
+
+        /// The profiler of this context, or NULL if disabled
+        inline Profiler *getProfiler() const { return _profiler.get(); }
+
+        /// Reports the progress of the simulations of this context
+        /// every n executed events (see Progress), from the next
+        /// initRuns(); if it is already enabled, only the interval
+        /// changes.
+        Progress &enableProgress(uint64_t every = 1000000);
+
+        /// Stops the reports of the progress
+        void disableProgress();
+
+        /// The progress of this context, or NULL if disabled
+        inline Progress *getProgress() const { return _progress.get(); }
+
+        /// Returns the pool of the events of type T, or NULL if no
+        /// such event has been created in this context.
+        template <class T>
+        const EventPool *getEventPool() const {
+            size_t id = EventPool::typeId<T>();
+            return id < _pools.size() ? _pools[id].get() : nullptr;
+        }
+
+        /**
+           Resets the event pools that have no live event (see
+           EventPool::reset()). It is called by the engine at the
+           end of every run.
+        */
+        void resetEventPools();
+
+        /**
+           Destroys the live objects of all the object pools of
+           this context (see ObjectPool::reset()). It is called by
+           the engine at the end of every run.
+        */
+        void resetObjectPools();
+    };
+
+} // namespace MetaSim
+
+#endif
@@ -0,0 +1,82 @@
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef __SIMLOOP_HPP__
+#define __SIMLOOP_HPP__
+
+#include <debugstream.hpp>
+#include <event.hpp>
+#include <simcontext.hpp>
+#include <simul.hpp>
+
+/*
+  The definitions of Simulation::loop() and Simulation::advance():
+  they need the complete Event and Simulation, that simul.hpp and
+  event.hpp cannot both see, as they include each other.
+*/
+
+namespace MetaSim {
+
+    template <class Options, class Stop>
+    Simulation::LoopStatus Simulation::loop(Stop stop)
+    {
+        SimContext::Scope scope(_ctx);
+        const uint64_t first = execEvents;
+        for (;;) {
+            Event *e = _ctx.firstEvent();
+            if (e == NULL) return LOOP_EMPTY;
+            const Tick t = e->_time;
+            if (stop(globTime, t, execEvents - first)) return LOOP_STOPPED;
+
+            if (Options::steps && e->getOwner() != NULL) {
+                globTime = parallelStep(e);
+            }
+            else {
+                // the first event is in the queue, and not cancelled
+                _ctx.getEventQueue().erase(e);
+                e->_isInQueue = false;
+
+                globTime = t;
+                if (_ctx._gateProbes && t >= _ctx._transitory)
+                    _ctx._gateProbes = false;
+                ++execEvents;
+
+                if (Options::debug) {
+                    DBGPRINT_3("Executing event action at time [", t, "]: ");
+                    e->print();
+                }
+                if (Options::profile || Options::debug) e->action();
+                else {
+                    e->_lastTime = t;
+                    e->restorePriority();
+                    e->doit();
+                    if (Options::particles) e->runProbes();
+                }
+                if (e->_disposable) e->dispose();
+            }
+            if (execEvents >= _reportAt) reportProgress(false);
+        }
+    }
+
+    template <class Stop>
+    Simulation::LoopStatus Simulation::advance(Stop stop)
+    {
+        if (_ctx._profiler)
+            return loop<LoopOptions<true, true> >(stop);
+        if (_stepThreads > 1 && _ctx._router == nullptr)
+            return loop<LoopOptions<false, true, false, true> >(stop);
+#ifdef __DEBUG__
+        if (DebugStream::anyEnabled())
+            return loop<LoopOptions<false, true, true> >(stop);
+#endif
+        return loop<DefaultLoop>(stop);
+    }
+
+} // namespace MetaSim
+
+#endif
@@ -11,35 +11,63 @@
  *   (at your option) any later version.                                   *
  *                                                                         *
  ***************************************************************************/
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cmath>
+#include <condition_variable>
 #include <deque>
-
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <sstream>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define METASIM_HAVE_FORK 1
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
 
+#include <checkpoint.hpp>
+#include <distrun.hpp>
 #include <entity.hpp>
+#include <randomvar.hpp>
+#include <simloop.hpp>
 #include <simul.hpp>
 
 namespace MetaSim {
     using namespace std;
 
-    Simulation *Simulation::instance_ = 0;
-        
     class NoMoreEventsInQueue {};
 
 
-    Simulation::Simulation() : dbg(), numRuns(0), 
+    Simulation::Simulation(SimContext &ctx) : _ctx(ctx),
+                               dbg(), numRuns(0), 
                                actRuns(0),
                                globTime (0),
-                               end (false)
+                               end (false),
+                               execEvents(0),
+                               _verbose(true),
+                               _stepThreads(1),
+                               _stepPool(),
+                               _parallelSteps(0),
+                               _reportAt(UINT64_MAX),
+                               _runEnd(0),
+                               _warmupInterval(0),
+                               _warmupMax(0),
+                               _warmupBatch(5),
+                               _warmupEnd(0)
     {
     }
 
-    Simulation& Simulation::getInstance()
+    Simulation::~Simulation()
     {
-        if (instance_ == 0) instance_ = new Simulation();
-                
-        return *instance_;
     }
-        
+
         
     const Tick Simulation::getTime()
     {
@@ -49,6 +77,9 @@ namespace MetaSim {
     void Simulation::setTime(Tick t)
     {
         globTime = t;
+        // the particles of the stats are called again, from the
+        // first event after the transitory
+        if (_ctx._gateProbes && t >= _ctx._transitory) _ctx._gateProbes = false;
     }
 
         
@@ -56,14 +87,21 @@ namespace MetaSim {
     // It returns the tick after the simulation step has been completed
     const Tick Simulation::sim_step() 
     {
+        SimContext::Scope scope(_ctx);
         Event *temp;
         Tick mytime;
 
         DBGENTER(_SIMUL_DBG_LEV);
 
-        temp = Event::getFirst();   // takes the first event in the queue ...
+        temp = _ctx.firstEvent();   // takes the first event in the queue ...
         if (temp == NULL) throw NoMoreEventsInQueue();
-        temp->drop();               // ... and extract it!
+        if (_stepThreads > 1 && temp->getOwner() != NULL &&
+            !_ctx._profiler && _ctx._router == nullptr) {
+            mytime = parallelStep(temp);
+            if (execEvents >= _reportAt) reportProgress(false);
+            return mytime;
+        }
+        temp->extract();            // ... and extract it!
           
         mytime = temp->getTime();   // stores the current time 
           
@@ -75,21 +113,211 @@ namespace MetaSim {
 
         setTime(mytime);
           
+        ++execEvents;
         temp->action();               // do what it is supposed to do...
         if (temp->isDisposable())     // if it has to be deleted...
-            delete temp;                // delete it!
+            temp->dispose();            // recycle it!
+        if (execEvents >= _reportAt) reportProgress(false);
           
         return mytime;
     }
+
+    /*
+      The state of the parallel steps: a pool of threads that run
+      the same job (starting threads at every step would cost more
+      than the events), and the buffers of a step, kept from one
+      step to the next.
+    */
+    class Simulation::StepPool {
+        unsigned _n;
+        vector<thread> _threads;
+        mutex _m;
+        condition_variable _wake, _done;
+        const function<void()> *_job;
+        uint64_t _round;
+        size_t _busy;
+        bool _stop;
+
+        void loop() {
+            uint64_t seen = 0;
+            unique_lock<mutex> l(_m);
+            while (true) {
+                _wake.wait(l, [&]() { return _stop || _round != seen; });
+                if (_stop) return;
+                seen = _round;
+                l.unlock();
+                (*_job)();
+                l.lock();
+                if (--_busy == 0) _done.notify_one();
+            }
+        }
+    public:
+        // the events of the step, and their operations
+        vector<Event *> evts;
+        vector< vector<SimContext::DeferredOp> > ops;
+        vector<exception_ptr> errors;
+        // the events of every task, in order: an owner is always
+        // in the same task
+        vector<size_t> byTask;
+        vector<size_t> start;
+        vector<unsigned> taskOf;
+
+        explicit StepPool(unsigned n) :
+            _n(n), _threads(), _m(), _wake(), _done(), _job(nullptr),
+            _round(0), _busy(0), _stop(false) {}
+
+        ~StepPool() {
+            {
+                lock_guard<mutex> l(_m);
+                _stop = true;
+            }
+            _wake.notify_all();
+            for (auto &t : _threads) t.join();
+        }
+
+        /// Runs job on all the threads, the calling one included
+        void run(const function<void()> &job) {
+            if (_threads.empty())
+                for (unsigned i = 1; i < _n; ++i)
+                    _threads.push_back(thread(&StepPool::loop, this));
+            {
+                lock_guard<mutex> l(_m);
+                _job = &job;
+                _busy = _threads.size();
+                ++_round;
+            }
+            _wake.notify_all();
+            job();
+            unique_lock<mutex> l(_m);
+            _done.wait(l, [&]() { return _busy == 0; });
+        }
+    };
+
+    namespace {
+        // below this number of events, a step runs on the calling
+        // thread (with the same deferred operations)
+        const size_t MIN_PARALLEL_STEP = 32;
+        // tasks of a step per thread, taken one at a time
+        const size_t STEP_TASKS = 8;
+    }
+
+    void Simulation::setStepThreads(unsigned n)
+    {
+        if (n == 0) n = max(1u, thread::hardware_concurrency());
+        _stepThreads = n;
+        _stepPool.reset();
+    }
+
+    const Tick Simulation::parallelStep(Event *first)
+    {
+        if (!_stepPool) _stepPool.reset(new StepPool(_stepThreads));
+        StepPool &p = *_stepPool;
+
+        // the step: the first events with the same time and
+        // priority, and an owner
+        const Tick t = first->getTime();
+        const int prio = first->getPriority();
+        vector<Event *> &evts = p.evts;
+        evts.clear();
+        Event *e = first;
+        do {
+            e->extract();
+            evts.push_back(e);
+            e = _ctx.firstEvent();
+        } while (e != NULL && e->getTime() == t && e->getPriority() == prio &&
+                 e->getOwner() != NULL);
+
+        setTime(t);
+        const size_t n = evts.size();
+        execEvents += n;
+        if (n == 1) {
+            first->action();
+            if (first->isDisposable()) first->dispose();
+            return t;
+        }
+        ++_parallelSteps;
+
+        // the events go to the tasks by a hash of their owner, so
+        // the ones of an owner run in order, on the same thread
+        const size_t nTasks = size_t(_stepThreads) * STEP_TASKS;
+        p.taskOf.resize(n);
+        p.start.assign(nTasks + 1, 0);
+        for (size_t i = 0; i < n; ++i) {
+            uint64_t h = uint64_t(reinterpret_cast<uintptr_t>(evts[i]->getOwner()) >> 4);
+            p.taskOf[i] = unsigned((h * 0x9E3779B97F4A7C15ULL >> 32) % nTasks);
+            ++p.start[p.taskOf[i] + 1];
+        }
+        for (size_t k = 0; k < nTasks; ++k) p.start[k + 1] += p.start[k];
+        p.byTask.resize(n);
+        for (size_t i = 0; i < n; ++i) p.byTask[p.start[p.taskOf[i]]++] = i;
+        for (size_t k = nTasks; k > 0; --k) p.start[k] = p.start[k - 1];
+        p.start[0] = 0;
+
+        if (p.ops.size() < n) p.ops.resize(n);
+        p.errors.assign(n, exception_ptr());
+        atomic<size_t> next(0);
+        // an exception stops all the tasks: the step is lost
+        atomic<bool> failed(false);
+        function<void()> work = [&]() {
+            SimContext::Scope s(_ctx);
+            size_t k;
+            while (!failed && (k = next++) < nTasks) {
+                for (size_t j = p.start[k]; j < p.start[k + 1] && !failed; ++j) {
+                    const size_t i = p.byTask[j];
+                    Event *ev = evts[i];
+                    SimContext::_deferred = &p.ops[i];
+                    try {
+                        ev->_lastTime = ev->_time;
+                        ev->restorePriority();
+                        ev->doit();
+                    } catch (...) {
+                        p.errors[i] = current_exception();
+                        failed = true;
+                    }
+                }
+            }
+            SimContext::_deferred = nullptr;
+        };
+
+        _ctx._deferOps = true;
+        if (n >= MIN_PARALLEL_STEP) {
+            _ctx._lockPools = true;
+            p.run(work);
+            _ctx._lockPools = false;
+        }
+        else work();
+        _ctx._deferOps = false;
+        // the events of the step are out of the queue, and their
+        // operations are discarded: the disposable ones are
+        // recycled, as a serial simulation does with the event
+        // that throws
+        for (size_t i = 0; i < n; ++i)
+            if (p.errors[i]) {
+                for (size_t j = 0; j < n; ++j) {
+                    p.ops[j].clear();
+                    if (evts[j]->isDisposable()) evts[j]->dispose();
+                }
+                rethrow_exception(p.errors[i]);
+            }
+
+        // in the order of the queue, as in a serial simulation
+        for (size_t i = 0; i < n; ++i) {
+            for (const SimContext::DeferredOp &op : p.ops[i]) op.apply();
+            p.ops[i].clear();
+            evts[i]->runProbes();
+            if (evts[i]->isDisposable()) evts[i]->dispose();
+        }
+        return t;
+    }
         
     // this event returns the time of the first event in the queue
     // (i.e. the next event to be processed) or throws and exception 
     // if there is no more events in the queue
     const Tick Simulation::getNextEventTime()
     {
-        Event *temp = Event::getFirst();
+        Event *temp = _ctx.firstEvent();
         if (temp == NULL) throw NoMoreEventsInQueue();
-        else return Event::getFirst()->getTime();
+        else return temp->getTime();
     }
 
     // this function will run until a specified time, 
@@ -99,14 +327,10 @@ namespace MetaSim {
     // it stops before executing the first event after stop
     const Tick Simulation::run_to(const Tick &stop)
     {
-        try {
-            while (getNextEventTime() <= stop) {
-                globTime = sim_step();
-            }
-        } catch (NoMoreEventsInQueue &e) {
+        SimContext::Scope scope(_ctx);
+        if (advance(StopAfter(stop)) == LOOP_EMPTY)
             cerr << "No more events in queue: simulation time = " 
                  << globTime << endl;
-        }
 
         if (globTime < stop) globTime = stop; 
 
@@ -116,29 +340,53 @@ namespace MetaSim {
                 
     void Simulation::initRuns(int nRuns)
     {
+        SimContext::Scope scope(_ctx);
         BaseStat::init(nRuns);
         globTime = 0;
         end = false;          
+        execEvents = 0;
+        _parallelSteps = 0;
+        _ctx._tombstones = 0;
+        if (_ctx._profiler) _ctx._profiler->reset();
+        _reportAt = UINT64_MAX;
+        if (_ctx._progress) {
+            _ctx._progress->start(0);
+            _reportAt = _ctx._progress->getInterval();
+        }
     }
 
     void Simulation::initSingleRun()
     {
+        SimContext::Scope scope(_ctx);
         globTime = 0;
 
+        // the substreams of the variables depend on the run
+        RandomVar::initStreams(_ctx._firstRun + actRuns);
+
         // Run Initialization:
         // Before each run, call the newRun() of every entity
         // and setup statistics
         Entity::callNewRun();
 
         BaseStat::newRun();
+
+        // the particles of the stats are not called until the end
+        // of the transitory (see setTime())
+        _ctx._gateProbes = _ctx._transitory > 0;
+
+        if (_ctx._profiler) _ctx._profiler->startRun();
     }
 
     void Simulation::endSingleRun()
     {
+        SimContext::Scope scope(_ctx);
+        if (_ctx._profiler) _ctx._profiler->stopRun();
         Entity::callEndRun();
         BaseStat::endRun();
 
         clearEventQueue();
+        _ctx.resetEventPools();
+        _ctx.resetObjectPools();
     }
 
 
@@ -146,82 +394,550 @@ namespace MetaSim {
     // This is the simulation engine
     void Simulation::run(Tick endTick, int nRuns) 
     {
+        SimContext::Scope scope(_ctx);
         DBGENTER(_SIMUL_DBG_LEV);
         bool initializeRuns = true;
         bool terminateSim = true;
 	
         if (nRuns < -1) {
-            cout << "Initialize stats" << endl;
+            if (_verbose) cout << "Initialize stats" << endl;
             initializeRuns = true;
             terminateSim = false;
             numRuns = 1;
             nRuns = -nRuns;
         }
         else if (nRuns == -1) {
-            cout << "Will not initialize stats" << endl;
+            if (_verbose) cout << "Will not initialize stats" << endl;
             initializeRuns = false;
             terminateSim = false;
             numRuns = 1;
         }
         else if (nRuns == 0) {
-            cout << "Last Sim in the batch" << endl;
+            if (_verbose) cout << "Last Sim in the batch" << endl;
             initializeRuns = false;
             terminateSim = true;
             numRuns = 1;	    
         }
         else if (nRuns == 1) {
-            cout << "One single run" << endl;
+            if (_verbose) cout << "One single run" << endl;
             initializeRuns = true;
             terminateSim = true; 
             numRuns = 1;	    
         }
-        else numRuns = nRuns;
+        else numRuns = checkRuns(nRuns);
+
+        if (initializeRuns) initRuns(numRuns);
 
-        if (numRuns == 2) {
+        // Ok, now starts the main cycle of the simulation.
+        // remember that actRuns is the actual run number
+        // while numRuns is the maximum number of runs.
+        actRuns = 0;
+        while (actRuns < numRuns) {
+            if (_verbose) cout << "\n Run #" << actRuns << endl;
+
+            singleRun(endTick);
+                                
+            actRuns++;   // next run....
+        }
+        end = true;
+        if (terminateSim) endSim();      // the simulation is over!!
+    }
+
+    void Simulation::singleRun(Tick endTick)
+    {
+        _runEnd = endTick;
+        initSingleRun();
+
+        // MAIN CYCLE!!
+        if (advance(StopAt(endTick)) == LOOP_EMPTY)
+            cerr << "No more events in queue: simulation time =" 
+                 << globTime << endl;
+
+        if (_ctx._progress) reportProgress(false);
+        endSingleRun();
+    }
+
+    // Sequential replications: the stopping rule is checked
+    // at the end of every run
+    size_t Simulation::run(Tick endTick, const StoppingRule &rule)
+    {
+        SimContext::Scope scope(_ctx);
+        DBGENTER(_SIMUL_DBG_LEV);
+
+        if (rule.maxRuns < 3) throw BaseExc("At least 3 runs are needed",
+                                            "Simulation", "simul.cpp");
+        numRuns = rule.maxRuns;
+        initRuns(numRuns);
+        actRuns = 0;
+        while (actRuns < numRuns) {
+            singleRun(endTick);
+            actRuns++;
+            if (rule.isSatisfied()) break;
+        }
+        end = true;
+        endSim();
+        return actRuns;
+    }
+
+    // Batch means: one long run, the stats are collected at the
+    // end of every batch as if it were a run
+    const unsigned Simulation::ADAPTIVE_LEVELS;
+
+    size_t Simulation::runBatches(Tick endTick, size_t batches, BatchMode mode)
+    {
+        SimContext::Scope scope(_ctx);
+        DBGENTER(_SIMUL_DBG_LEV);
+
+        if (batches < 3) throw BaseExc("At least 3 batches are needed",
+                                       "Simulation", "simul.cpp");
+        size_t n = mode == BATCH_ADAPTIVE ? batches << ADAPTIVE_LEVELS : batches;
+        if (_warmupInterval <= 0 && (endTick - _ctx._transitory) / int64_t(n) <= 0)
+            throw BaseExc("The batches are too short", "Simulation", "simul.cpp");
+
+        numRuns = 1;
+        initRuns(n);
+        actRuns = 0;
+        _runEnd = endTick;
+        initSingleRun();
+        const Tick start = warmup(endTick);
+        const Tick length = (endTick - start) / int64_t(n);
+        if (length <= 0) throw BaseExc("The batches are too short",
+                                       "Simulation", "simul.cpp");
+        for (size_t b = 1; b <= n; ++b) {
+            Tick stop = b == n ? endTick : start + length * int64_t(b);
+            advance(StopBefore(stop));
+            globTime = stop;
+            // the last batch is collected by endSingleRun()
+            if (b < n) {
+                BaseStat::endRun();
+                BaseStat::newRun();
+            }
+        }
+        endSingleRun();
+        actRuns = 1;
+
+        if (mode == BATCH_ADAPTIVE)
+            while (n > batches &&
+                   BaseStat::maxBatchCorrelation() > 1.96 / sqrt(double(n))) {
+                BaseStat::mergeBatches();
+                n /= 2;
+            }
+        end = true;
+        endSim();
+        return n;
+    }
+
+    unsigned Simulation::threads(unsigned nThreads)
+    {
+        if (nThreads == 0) nThreads = std::thread::hardware_concurrency();
+        if (nThreads == 0) nThreads = 1;
+        return nThreads;
+    }
+
+    int Simulation::checkRuns(int nRuns)
+    {
+        if (nRuns < 1) throw BaseExc("The number of runs must be positive",
+                                     "Simulation", "simul.cpp");
+        if (nRuns == 2) {
             cout << "Warning: Simulation cannot be "
                 "initialized with 2 runs" << endl;
             cout << "         Executing 3 runs!" << endl;
-            numRuns = 3;
+            return 3;
         }
+        return nRuns;
+    }
 
-        if (initializeRuns) initRuns(numRuns);
+    // Parallel replications: each run is performed on a new
+    // model instance, in its own context, with its own random
+    // stream. The results are then merged in run order.
+    void Simulation::run(Tick endTick, int nRuns, 
+                         const ModelFactory &factory, unsigned nThreads)
+    {
+        SimContext::Scope scope(_ctx);
+        DBGENTER(_SIMUL_DBG_LEV);
 
-        // Ok, now starts the main cycle of the simulation.
-        // remember that actRuns is the actual run number
-        // while numRuns is the maximum number of runs.
+        numRuns = checkRuns(nRuns);
+
+        initRuns(numRuns);
+        actRuns = 0;
+        runReplicas(endTick, 0, numRuns, numRuns, factory, threads(nThreads));
+        end = true;
+        endSim();
+    }
+
+    // Distributed replications: the runs are performed by the
+    // workers of the server, and collected in run order
+    void Simulation::run(Tick endTick, int nRuns, RunServer &server)
+    {
+        SimContext::Scope scope(_ctx);
+        DBGENTER(_SIMUL_DBG_LEV);
+
+        numRuns = checkRuns(nRuns);
+
+        initRuns(numRuns);
+        actRuns = 0;
+        const size_t nStats = _ctx._stats.size();
+        server.dispatch(*this, *_ctx._pstdgen, endTick, numRuns,
+                        [&](size_t i, vector<double> &values, uint64_t executed) {
+            if (values.size() != nStats)
+                throw BaseExc("Run " + to_string(i) + " has " +
+                              to_string(values.size()) + " stats instead of " +
+                              to_string(nStats), "Simulation", "simul.cpp");
+            BaseStat::endRun(values);
+            execEvents += executed;
+            ++actRuns;
+        });
+        end = true;
+        endSim();
+    }
+
+    size_t Simulation::run(Tick endTick, const StoppingRule &rule,
+                           const ModelFactory &factory, unsigned nThreads,
+                           size_t batch)
+    {
+        SimContext::Scope scope(_ctx);
+        DBGENTER(_SIMUL_DBG_LEV);
+
+        if (rule.maxRuns < 3) throw BaseExc("At least 3 runs are needed",
+                                            "Simulation", "simul.cpp");
+        nThreads = threads(nThreads);
+        if (batch == 0) batch = nThreads;
+        numRuns = rule.maxRuns;
+
+        initRuns(numRuns);
         actRuns = 0;
         while (actRuns < numRuns) {
-            cout << "\n Run #" << actRuns << endl;
+            runReplicas(endTick, actRuns, min(batch, numRuns - actRuns),
+                        numRuns, factory, nThreads);
+            if (rule.isSatisfied()) break;
+        }
+        end = true;
+        endSim();
+        return actRuns;
+    }
 
-            initSingleRun();
+    void Simulation::runReplicas(Tick endTick, size_t first, size_t count,
+                                 size_t streams, const ModelFactory &factory,
+                                 unsigned nThreads)
+    {
+        if (nThreads > count) nThreads = count;
 
-            // MAIN CYCLE!!
-            try {
-                while (globTime < endTick) {
-                    globTime = sim_step();
+        // every run has a stream of the generator (a copy of it,
+        // see RandomGen::stream()), starting from its current state
+        const RandomGen &gen = *_ctx._pstdgen;
+
+        vector< vector<double> > results(count);
+        vector<exception_ptr> errors(count);
+        vector<unique_ptr<Profiler> > profiles(count);
+        vector<uint64_t> executed(count, 0);
+        bool profile = _ctx._profiler != nullptr;
+        atomic<size_t> next(0);
+
+        const ReplicaSetup setup = replicaSetup();
+        auto worker = [&]() {
+            size_t i;
+            while ((i = next++) < count) {
+                try {
+                    executed[i] = runReplica(setup, endTick, first + i, streams,
+                                             gen, factory, results[i],
+                                             profile ? &profiles[i] : nullptr);
+                } catch (...) {
+                    errors[i] = current_exception();
                 }
-            } catch (NoMoreEventsInQueue &e) {
-                cerr << "No more events in queue: simulation time =" 
-                     << globTime << endl;
             }
+        };
 
-            endSingleRun();
-                                
-            actRuns++;   // next run....
+        vector<thread> pool;
+        for (unsigned i = 1; i < nThreads; ++i) pool.push_back(thread(worker));
+        worker();
+        for (auto &t : pool) t.join();
+
+        for (size_t i = 0; i < count; ++i)
+            if (errors[i]) rethrow_exception(errors[i]);
+
+        for (size_t i = 0; i < count; ++i, ++actRuns) {
+            BaseStat::endRun(results[i]);
+            execEvents += executed[i];
+            if (profiles[i]) _ctx._profiler->merge(*profiles[i]);
+        }
+    }
+
+    Simulation::ReplicaSetup Simulation::replicaSetup() const
+    {
+        ReplicaSetup s = { _ctx._streamSeed, _ctx._antitheticRuns,
+                           _ctx._transitory };
+        return s;
+    }
+
+    uint64_t Simulation::runReplica(const ReplicaSetup &setup, Tick endTick,
+                                    size_t r, size_t streams,
+                                    const RandomGen &gen,
+                                    const ModelFactory &factory,
+                                    vector<double> &values,
+                                    unique_ptr<Profiler> *profile)
+    {
+        SimContext ctx;
+        SimContext::Scope s(ctx);
+        if (profile) ctx.enableProfiler();
+        // only the context of the simulation reports its progress
+        ctx.disableProgress();
+        unique_ptr<RandomGen> g = gen.clone();
+        g->stream(r, streams);
+        RandomVar::setGenerator(move(g));
+        // the substreams of run r, as in a sequential run
+        ctx._streamSeed = setup.streamSeed;
+        ctx._antitheticRuns = setup.antithetic;
+        ctx._firstRun = r;
+        ctx._transitory = setup.transitory;
+
+        shared_ptr<void> model = factory();
+        Simulation &sim = ctx.getSimulation();
+        sim.initRuns(1);
+        sim.singleRun(endTick);
+        values.clear();
+        for (auto k = BaseStat::begin(); k != BaseStat::end(); ++k)
+            values.push_back((*k)->getValue());
+        if (profile) *profile = move(ctx._profiler);
+        return sim.execEvents;
+    }
+
+    // Replications from a shared warm-up: a checkpoint restored
+    // in this process, or a child process for each run
+    void Simulation::runFromWarmup(Tick endTick, int nRuns, WarmupMode mode,
+                                   unsigned nProcs)
+    {
+        SimContext::Scope scope(_ctx);
+        DBGENTER(_SIMUL_DBG_LEV);
+
+        numRuns = checkRuns(nRuns);
+        if (_warmupInterval <= 0 && _ctx._transitory > endTick)
+            throw BaseExc("The transitory is longer than the runs",
+                          "Simulation", "simul.cpp");
+
+        initRuns(numRuns);
+        // the warm-up has the substreams of the run numRuns
+        actRuns = numRuns;
+        _runEnd = endTick;
+        initSingleRun();
+        warmup(endTick);
+        actRuns = 0;
+
+        if (mode == WARMUP_FORK) forkRuns(endTick, threads(nProcs));
+        else {
+            Checkpoint cp(_ctx);
+            while (actRuns < numRuns) {
+                if (actRuns > 0) cp.restore();
+                continueRun(endTick, actRuns);
+                if (_ctx._progress) reportProgress(false);
+                Entity::callEndRun();
+                BaseStat::endRun();
+                actRuns++;
+            }
         }
+
+        if (_ctx._profiler) _ctx._profiler->stopRun();
+        clearEventQueue();
+        _ctx.resetEventPools();
+        _ctx.resetObjectPools();
         end = true;
-        if (terminateSim) endSim();      // the simulation is over!!
+        endSim();
+    }
+
+    void Simulation::setWarmupDetection(Tick interval, Tick maxWarmup, size_t m)
+    {
+        if (m == 0) throw BaseExc("The batches of MSER must not be empty",
+                                  "Simulation", "simul.cpp");
+        _warmupInterval = interval;
+        _warmupMax = maxWarmup;
+        _warmupBatch = m;
+    }
+
+    Tick Simulation::warmup(Tick endTick)
+    {
+        if (_warmupInterval <= 0) {
+            const Tick t = _ctx._transitory;
+            advance(StopBefore(t));
+            globTime = t;
+            return _warmupEnd = t;
+        }
+
+        // the stats record from the start, and are reset at the
+        // end of every interval
+        _ctx._transitory = 0;
+        _ctx._gateProbes = false;
+        const Tick limit = min(_warmupMax, endTick);
+        const size_t minIntervals = 10 * _warmupBatch;
+        vector< vector<double> > series(_ctx._stats.size());
+        size_t intervals = 0;
+        Tick stop = 0;
+        for (;;) {
+            stop = min(stop + _warmupInterval, limit);
+            advance(StopBefore(stop));
+            globTime = stop;
+            size_t k = 0;
+            for (BaseStat *st : _ctx._stats) {
+                series[k++].push_back(st->getValue());
+                st->initValue();
+            }
+
+            bool over = ++intervals >= minIntervals;
+            for (k = 0; over && k < series.size(); ++k)
+                over = BaseStat::mser(series[k], _warmupBatch) < series[k].size();
+            if (over) break;
+            if (stop >= limit) {
+                cerr << "Warning: the warm-up is not over at time "
+                     << stop << endl;
+                break;
+            }
+        }
+        _ctx._transitory = stop;
+        return _warmupEnd = stop;
+    }
+
+    void Simulation::continueRun(Tick endTick, size_t r)
+    {
+        _ctx._pstdgen->stream(r, numRuns);
+        RandomVar::initStreams(_ctx._firstRun + r);
+        if (advance(StopAt(endTick)) == LOOP_EMPTY)
+            cerr << "No more events in queue: simulation time =" 
+                 << globTime << endl;
     }
 
+    void Simulation::forkRuns(Tick endTick, unsigned nProcs)
+    {
+#ifdef METASIM_HAVE_FORK
+        struct Child {
+            pid_t pid;
+            int fd;
+        };
+        const size_t nStats = _ctx._stats.size();
+        vector< vector<double> > results(numRuns);
+        vector<uint64_t> executed(numRuns, 0);
+        deque<Child> running;
+        size_t next = 0, done = 0;
+        string error;
+
+        // reads the values of the oldest child, in run order
+        auto collect = [&]() {
+            Child c = running.front();
+            running.pop_front();
+            vector<double> v(nStats + 1);
+            char *p = reinterpret_cast<char *>(v.data());
+            size_t len = v.size() * sizeof(double), got = 0;
+            ssize_t k;
+            while (got < len && (k = read(c.fd, p + got, len - got)) != 0) {
+                if (k > 0) got += size_t(k);
+                else if (errno != EINTR) break;
+            }
+            close(c.fd);
+            int status = 0;
+            while (waitpid(c.pid, &status, 0) < 0 && errno == EINTR) {}
+            if (got != len || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+                if (error.empty()) error = "Run " + to_string(done) + " failed";
+            }
+            else {
+                executed[done] = uint64_t(v.back());
+                v.pop_back();
+                results[done] = move(v);
+            }
+            ++done;
+        };
+
+        // the buffers would be written again by every child
+        cout.flush();
+        cerr.flush();
+        fflush(NULL);
+        while (done < next || next < numRuns) {
+            if (next < numRuns && running.size() < nProcs && error.empty()) {
+                int fd[2];
+                if (pipe(fd) != 0) {
+                    error = "Cannot create a pipe";
+                    continue;
+                }
+                pid_t pid = fork();
+                if (pid < 0) {
+                    close(fd[0]);
+                    close(fd[1]);
+                    error = "Cannot fork";
+                    continue;
+                }
+                if (pid == 0) {
+                    close(fd[0]);
+                    // the threads of the steps are not in the child
+                    _stepPool.release();
+                    // nor is the progress reported by the child
+                    _reportAt = UINT64_MAX;
+                    int code = 0;
+                    try {
+                        uint64_t before = execEvents;
+                        actRuns = next;
+                        continueRun(endTick, next);
+                        Entity::callEndRun();
+                        vector<double> v;
+                        for (auto k = BaseStat::begin(); k != BaseStat::end(); ++k)
+                            v.push_back((*k)->getValue());
+                        v.push_back(double(execEvents - before));
+                        const char *p = reinterpret_cast<const char *>(v.data());
+                        size_t len = v.size() * sizeof(double);
+                        while (len > 0) {
+                            ssize_t k = write(fd[1], p, len);
+                            if (k < 0 && errno == EINTR) continue;
+                            if (k <= 0) { code = 1; break; }
+                            p += k;
+                            len -= size_t(k);
+                        }
+                    } catch (exception &e) {
+                        cerr << e.what() << endl;
+                        code = 1;
+                    } catch (...) {
+                        code = 1;
+                    }
+                    cout.flush();
+                    cerr.flush();
+                    // no destructor of the parent state runs twice
+                    _exit(code);
+                }
+                close(fd[1]);
+                Child c = { pid, fd[0] };
+                running.push_back(c);
+                ++next;
+            }
+            else if (!running.empty()) collect();
+            else break;
+        }
+        if (!error.empty()) throw BaseExc(error, "Simulation", "simul.cpp");
+
+        // the parent sees the end of the runs, as the children
+        Entity::callEndRun();
+        for (size_t i = 0; i < numRuns; ++i, ++actRuns) {
+            BaseStat::endRun(results[i]);
+            execEvents += executed[i];
+        }
+#else
+        throw BaseExc("fork() is not available", "Simulation", "simul.cpp");
+#endif
+    }
 
     void Simulation::clearEventQueue()
     {
-        Event *temp;
-        while ((temp = Event::getFirst()) != NULL) {
-            temp->drop();
-            if (temp->isDisposable()) // if it has to be deleted...
-                delete temp;                 
+        SimContext::Scope scope(_ctx);
+        // all the events are detached at once, instead of
+        // extracting them one by one from the head
+        EventQueue &q = _ctx.getEventQueue();
+        vector<Event *> v;
+        v.reserve(q.size());
+        q.drain(v);
+        for (Event *e : v) {
+            bool cancelled = e->_cancelled;
+            e->_isInQueue = false;
+            e->_cancelled = false;
+            // a tombstone is discarded, as by firstEvent()
+            if (cancelled) ++_ctx._tombstones;
+            else if (e->_disposable) e->dispose();
         }
+        // the orders of the posts start again: no event is left
+        // with an older one (see Event::MAX_ORDER)
+        _ctx._eventCounter = 0;
         globTime = 0;
     }
                 
@@ -245,15 +961,59 @@ namespace MetaSim {
         dbg.enter(lev, ss.str());
     }
                 
+    bool Simulation::dbgEnter(int lev, const char *header)
+    {
+        bool prev = dbg.push(lev);
+        if (dbg.filter()) {
+            stringstream ss;
+            ss << "t = [" << globTime << "] --> " << header;
+            dbg.header(ss.str());
+        }
+        return prev;
+    }
+
     void Simulation::dbgExit()
     {
         dbg.exit();
     }
 
+    void Simulation::dbgExit(bool prev)
+    {
+        dbg.leave(prev);
+    }
+
     void Simulation::endSim() 
     {
+        SimContext::Scope scope(_ctx);
         // Collect statistics
         BaseStat::endSim();
+
+        if (_ctx._profiler) _ctx._profiler->report();
+        if (_ctx._progress) reportProgress(true);
+    }
+
+    void Simulation::reportProgress(bool final)
+    {
+        Progress &p = *_ctx._progress;
+        _reportAt = final ? UINT64_MAX : execEvents + p.getInterval();
+
+        Progress::Sample s = Progress::Sample();
+        s.runs = numRuns;
+        // at the end actRuns is numRuns, as during the warm-up of
+        // runFromWarmup()
+        if (actRuns < numRuns) s.run = actRuns;
+        else s.run = final && numRuns > 0 ? numRuns - 1 : 0;
+        s.time = double(globTime);
+        s.endTime = double(_runEnd);
+        s.events = execEvents;
+        s.queueSize = _ctx._eventQueue ? _ctx._eventQueue->size() : 0;
+        s.final = final;
+        if (final || numRuns == 0) s.done = 1;
+        else {
+            double run = s.endTime > 0 ? min(1.0, s.time / s.endTime) : 1;
+            s.done = min(1.0, (double(s.run) + run) / double(numRuns));
+        }
+        p.report(s);
     }
 }
 
@@ -14,20 +14,104 @@
 #ifndef __SIMUL_HPP__
 #define __SIMUL_HPP__
 
+#include <cstdint>
+#include <functional>
+#include <memory>
+
 #include <basestat.hpp>
 #include <debugstream.hpp>
 #include <entity.hpp>
 #include <event.hpp>
+#include <simcontext.hpp>
+#include <tick.hpp>
 
 namespace MetaSim {
 
 #define _SIMUL_DBG_LEV "Simul"
-  
-    /** 
+
+    class RunServer;
+
+    /**
+       \ingroup metasim_ee
+
+       The compile-time options of Simulation::loop(). A disabled
+       option costs nothing in the loop:
+       - PROFILE: the events go through Event::action(), which
+         lets the profiler measure them (without it the profiler
+         of the context, if any, does not see them);
+       - PARTICLES: the particle probes of the events are called
+         (without it the stats attached to the events record
+         nothing);
+       - DEBUG: the events are traced on the debug stream, as by
+         sim_step();
+       - STEPS: the events of the same time may run in parallel
+         (see Simulation::setStepThreads()).
+    */
+    template <bool PROFILE, bool PARTICLES, bool DEBUG = false,
+              bool STEPS = false>
+    struct LoopOptions {
+        static const bool profile = PROFILE;
+        static const bool particles = PARTICLES;
+        static const bool debug = DEBUG;
+        static const bool steps = STEPS;
+    };
+
+    /// The options of a production run: only the particles
+    typedef LoopOptions<false, true> DefaultLoop;
+
+    /**
+       \ingroup metasim_ee
+
+       The stopping conditions of Simulation::loop(). A condition is
+       any object callable as cond(now, next, executed), where now
+       is the current time, next the time of the next event, and
+       executed the number of events executed by the loop so far;
+       the loop stops, before the next event, when it returns true.
+
+       @code
+       sim.loop(StopBefore(1000));
+       sim.loop(StopAfterEvents(100000));
+       sim.loop([&](Tick, Tick, uint64_t) { return server.isIdle(); });
+       @endcode
+    */
+    //@{
+    /// Stops once the time has reached t: the first event at or
+    /// after t is the last one executed (as by Simulation::run())
+    struct StopAt {
+        Tick t;
+        explicit StopAt(Tick x) : t(x) {}
+        bool operator()(Tick now, Tick, uint64_t) const { return now >= t; }
+    };
+
+    /// Executes all the events up to t, included (as run_to())
+    struct StopAfter {
+        Tick t;
+        explicit StopAfter(Tick x) : t(x) {}
+        bool operator()(Tick, Tick next, uint64_t) const { return next > t; }
+    };
+
+    /// Executes all the events before t
+    struct StopBefore {
+        Tick t;
+        explicit StopBefore(Tick x) : t(x) {}
+        bool operator()(Tick, Tick next, uint64_t) const { return next >= t; }
+    };
+
+    /// Executes n events
+    struct StopAfterEvents {
+        uint64_t n;
+        explicit StopAfterEvents(uint64_t x) : n(x) {}
+        bool operator()(Tick, Tick, uint64_t executed) const { return executed >= n; }
+    };
+    //@}
+
+    /**
         \ingroup metasim_ee
   
-        This singleton implements the simulation engine and some
-        debugging facilities. The main function is <i>run(Tick
+        This class implements the simulation engine and some
+        debugging facilities. There is one engine for each
+        simulation context (see SimContext): getInstance() (and the
+        SIMUL macro) returns the engine of the current context. The main function is <i>run(Tick
         lenght, size_t runs)</i> that is responsible for running
         the simulation for one or more times.
    
@@ -38,12 +122,30 @@ namespace MetaSim {
     */
     //@{
     class Simulation {
-        Simulation();
+        explicit Simulation(SimContext &ctx);
         Simulation(const Simulation &);
 
-        static Simulation *instance_;
+        /// The context that owns this engine. All the functions
+        /// below make it the current context while executing.
+        SimContext &_ctx;
+
+        friend class Checkpoint;
+        friend class SimContext;
+        friend class ParallelSimulation;
+        friend class RunServer;
+        friend class RunWorker;
+        friend class Sweep;
+        friend class TimeWarpSimulation;
     public:
-        static Simulation &getInstance();
+        ~Simulation();
+
+        /// Returns the engine of the current context
+        static inline Simulation &getInstance() {
+            return SimContext::current().getSimulation();
+        }
+
+        /// Returns the context of this engine
+        inline SimContext &getContext() { return _ctx; }
                
         /**
            Enters the <i>lev</i> debug level.
@@ -64,6 +166,14 @@ namespace MetaSim {
            @see DebugStream
         */
         void dbgEnter(std::string lev, std::string header);
+
+        /**
+           Enters the debug level of identifier lev (see
+           DebugStream::level()); the header is built only if the
+           level is enabled. Returns the state to give to
+           dbgExit(bool).
+        */
+        bool dbgEnter(int lev, const char *header);
                
 
         /**
@@ -76,6 +186,9 @@ namespace MetaSim {
         */
         void dbgExit();
 
+        /// Exits from a level entered by dbgEnter(int, const char *)
+        void dbgExit(bool prev);
+
         /**
            This function is the main simulator engine. After defining all
            the objects in a simulation, this function should be invoked
@@ -105,14 +218,278 @@ namespace MetaSim {
         */
         void run(Tick length, int runs = 1);
 
+        /**
+           A function that builds one instance of the model
+           (entities, events, random variables and statistics),
+           and returns an object that owns it. The instance is
+           destroyed when the returned pointer is released.
+        */
+        typedef std::function<std::shared_ptr<void>()> ModelFactory;
+
+        /**
+           Runs independent replicas of the simulation in parallel.
+
+           Each run is performed in a new SimContext, on a new
+           model instance built by the factory, on a pool of
+           nThreads threads (0 means one per hardware thread). The
+           standard random generator of each run is initialized at
+           a different point of the sequence of the generator of
+           this context, i.e. the runs use disjoint streams (see
+           RandomGen::stream()). The substreams of the variables
+           (see RandomVar::setStream()) of run k are the ones of
+           the sequential run k, so two configurations of a model
+           see the same numbers in the same run (common random
+           numbers).
+
+           The statistics of each model instance are matched, in
+           order of creation, with the statistics of this context,
+           which receive the values of all runs in run order. So
+           the results (getMean(), getConfInterval(), ...) do not
+           depend on the number of threads. Typically:
+
+           @code
+           std::shared_ptr<void> buildModel();  // creates a Model
+
+           auto master = buildModel();  // the statistics to fill
+           SIMUL.run(10000, 30, buildModel);
+           master_stat.getMean();
+           @endcode
+
+           The entities of this context are not involved in the
+           simulation. If a run throws an exception, the first one
+           (in run order) is rethrown after all threads complete.
+
+           @param length Length of each simulation run.
+           @param runs Number of replicas.
+           @param factory Builds one model instance.
+           @param nThreads Number of threads.
+        */
+        void run(Tick length, int runs, const ModelFactory &factory,
+                 unsigned nThreads = 0);
+
+        /**
+           Distributed replications: as
+           run(Tick, int, const ModelFactory &, unsigned), but the
+           runs are performed by the worker processes connected to
+           the server (see RunWorker), possibly on other nodes. Each
+           run receives its stream of the generator of this context
+           and its substreams from here, so the results are the ones
+           of the parallel replications, whatever the number of
+           workers. The values of the stats are collected in run
+           order as soon as they arrive; the run of a worker that
+           disconnects is given to another one.
+
+           @code
+           RunServer server(5000);
+           auto master = buildModel();
+           SIMUL.run(10000, 1000, server);
+           @endcode
+
+           @param length Length of each simulation run.
+           @param runs Number of replicas.
+           @param server The workers.
+        */
+        void run(Tick length, int runs, RunServer &server);
+
+        /**
+           Sequential replications: runs the simulation until the
+           stopping rule is satisfied, i.e. until the confidence
+           intervals of the selected statistics are small enough
+           (see StoppingRule), or until rule.maxRuns runs are done.
+
+           @code
+           size_t n = SIMUL.run(10000, StoppingRule(0.01, 1000));
+           @endcode
+
+           @param length Length of each simulation run.
+           @param rule The precision and the bounds on the runs.
+           @return the number of runs.
+        */
+        size_t run(Tick length, const StoppingRule &rule);
+
+        /**
+           Sequential replications in parallel: as
+           run(Tick, int, const ModelFactory &, unsigned), in
+           batches of runs; the stopping rule is checked on the
+           statistics of this context after every batch. The
+           streams of the generator are the ones of a parallel
+           simulation of rule.maxRuns runs, so the results depend
+           on the size of the batches but not on the number of
+           threads.
+
+           @param length Length of each simulation run.
+           @param rule The precision and the bounds on the runs.
+           @param factory Builds one model instance.
+           @param nThreads Number of threads.
+           @param batch Number of runs between two checks of the
+                  rule (0 means nThreads).
+           @return the number of runs.
+        */
+        size_t run(Tick length, const StoppingRule &rule,
+                   const ModelFactory &factory, unsigned nThreads = 0,
+                   size_t batch = 0);
+
+        /// The modes of runBatches()
+        enum BatchMode { BATCH_FIXED, BATCH_ADAPTIVE };
+
+        /// Number of halvings of the batches in the adaptive mode
+        static const unsigned ADAPTIVE_LEVELS = 4;
+
+        /**
+           Batch means: one long run, whose part after the
+           transitory (see BaseStat::setTransitory()) is divided in
+           batches of the same length; the value of every stat in
+           a batch is collected as the value of a run, so the
+           warm-up is simulated only once, and getMean(),
+           getConfInterval() and getExpNum() of the stats refer to
+           the batches. The entities see one run (one newRun()
+           and one endRun()), and the stats are reset (initValue())
+           at the start of every batch.
+
+           With BATCH_FIXED the run has the given number of
+           batches. With BATCH_ADAPTIVE it starts with
+           batches * 2^ADAPTIVE_LEVELS batches, which are merged
+           in pairs (BaseStat::mergeBatches()) while the lag 1
+           autocorrelation of some stat is significant (larger
+           than 1.96 / sqrt(batches), see
+           BaseStat::getAutocorrelation()), down to the given
+           number. As with replications, the confidence intervals
+           assume that the value of a stat is a mean, e.g. StatMean.
+
+           @param length Length of the run.
+           @param batches Number of batches (at least 3).
+           @param mode Fixed or adaptive batches.
+           @return the number of batches.
+        */
+        size_t runBatches(Tick length, size_t batches,
+                          BatchMode mode = BATCH_FIXED);
+
+        /// The modes of runFromWarmup()
+        enum WarmupMode { WARMUP_RESTORE, WARMUP_FORK };
+
+        /**
+           Replications that share their warm-up: the model is
+           simulated once until the end of the transitory (see
+           BaseStat::setTransitory()), and every run continues from
+           that state until length, with its own stream of the
+           default generator (RandomGen::stream()) and its own
+           substreams (RandomVar::setStream()). The warm-up is
+           simulated with the substreams of the run of index runs,
+           so they are not reused by the runs. The entities see
+           one newRun(), before the warm-up, and an endRun() for
+           every run (with WARMUP_FORK, in the child of the run,
+           and once in this process at the end).
+
+           With WARMUP_RESTORE the runs are executed one after the
+           other in this process, and each one starts by restoring
+           a Checkpoint taken at the end of the warm-up, so the
+           entities must save their state (see Checkpoint). With
+           WARMUP_FORK each run is executed by a child process
+           (fork()), which starts with a copy-on-write copy of the
+           state, and sends the values of the stats back through a
+           pipe; at most nProcs children run at the same time (0
+           means one per core). The children only have the thread
+           that called fork(), so no asynchronous trace or other
+           writer thread can be used by the model in this mode.
+
+           @param length Length of each simulation run.
+           @param runs Number of runs.
+           @param mode In-process restore, or child processes.
+           @param nProcs Maximum number of children.
+        */
+        void runFromWarmup(Tick length, int runs,
+                           WarmupMode mode = WARMUP_RESTORE,
+                           unsigned nProcs = 0);
+
+        /**
+           Detects the end of the warm-up of runFromWarmup() and
+           runBatches(), instead of the fixed transitory of
+           BaseStat::setTransitory(): the warm-up is simulated in
+           intervals of the given length, with the value of every
+           stat of the context taken at the end of each interval
+           (and reset, with initValue()). After at least 10 * m
+           intervals, the warm-up ends at the end of the first
+           interval where the MSER-m truncation point of every
+           stat (see BaseStat::mser()) is in the first half of its
+           values, so that the runs start as soon as the initial
+           bias is over; it ends at maxWarmup (or at the end of
+           the runs) with a warning if this never happens. The
+           transitory of the context is then set to the end of the
+           warm-up (see getWarmupEnd()).
+
+           @param interval Length of the intervals (0: no
+           detection, the default).
+           @param maxWarmup The longest warm-up.
+           @param m Number of intervals of the batches of MSER.
+        */
+        void setWarmupDetection(Tick interval, Tick maxWarmup, size_t m = 5);
+
+        /// The end of the last warm-up of runFromWarmup() or
+        /// runBatches()
+        inline Tick getWarmupEnd() const { return _warmupEnd; }
+
         /**
            Returns the current simulation time.
         */
         const Tick getTime();
+
+        /**
+           Returns the number of events executed since the last
+           initRuns(), in all the runs (with the parallel
+           replications, in all the model instances).
+        */
+        inline uint64_t getExecutedEvents() const { return execEvents; }
+
+        /**
+           Runs the events of a step in parallel, on n threads (0:
+           one per hardware thread; 1, the default: one event at a
+           time). A step is the sequence of the first events of
+           the queue with the same time and priority, and an
+           owner (see Event::getOwner()): it is taken from the
+           queue at once, and the doit() of the events of
+           different owners run in parallel, the ones of the same
+           owner in order. It is meant for the synchronous models
+           (slotted protocols, clocked hardware), where the
+           events of a time touch different entities.
+
+           While the events of a step run, their post(), drop(),
+           reschedule() and cancelLazy() are collected, and they
+           are applied after the step, with the particle probes,
+           in the order of the events in the queue: the results do
+           not depend on the number of threads, and they are the
+           ones of a serial simulation if the handlers obey these
+           rules:
+           - a handler only reads and writes the state of its own
+             entity, and draws numbers from its own generators
+             (not from the default generator of the context);
+           - it records statistics only through particles;
+           - it does not cancel or post again the other events
+             of its step, and it does not test isInQueue() on
+             the events it changed in the same step.
+
+           Event::create() can be used in the handlers. The steps
+           are not parallel while the profiler is enabled, or in a
+           ParallelSimulation.
+
+           If a handler throws, the whole step is lost: the other
+           handlers of the step stop at the next event, the
+           operations of the step are discarded, its events are out
+           of the queue (the disposable ones are disposed), and the
+           first exception, in the order of the queue, is rethrown.
+        */
+        void setStepThreads(unsigned n);
+
+        inline unsigned getStepThreads() const { return _stepThreads; }
+
+        /// Number of steps with more than one event since the last
+        /// initRuns() (see setStepThreads())
+        inline uint64_t getParallelSteps() const { return _parallelSteps; }
                                 
         /**
            Drops and eventually deletes all events in the queue. To be
            called after an exception!
+           The order of the posts starts again from 0 (see
+           Event::MAX_ORDER).
         */
         void clearEventQueue();
                 
@@ -130,6 +507,50 @@ namespace MetaSim {
         */
         const Tick sim_step();
 
+        /// The outcome of loop()
+        enum LoopStatus {
+            LOOP_STOPPED,       ///< the stopping condition holds
+            LOOP_EMPTY          ///< the event queue is empty
+        };
+
+        /**
+           Executes the events of the current run until the
+           stopping condition stop holds (see StopAt), or the
+           queue is empty: the main loop of run(), without the
+           exceptions and the repeated tests of sim_step(). It
+           does not initialize or end the run.
+
+           The options select at compile time what the loop does
+           for every event (see LoopOptions): with DefaultLoop it
+           only takes the first event from the queue, executes its
+           doit() and its particles, and recycles it. The options
+           are not checked against the context: a profiler or the
+           step threads are ignored unless the options enable
+           them. advance() chooses the options from the context.
+
+           The definition is in simloop.hpp.
+
+           @code
+           #include <simloop.hpp>
+           ...
+           sim.initRuns();
+           sim.initSingleRun();
+           if (sim.loop<LoopOptions<false, false> >(StopAfter(1000)) ==
+               Simulation::LOOP_EMPTY) ...
+           @endcode
+        */
+        template <class Options = DefaultLoop, class Stop>
+        LoopStatus loop(Stop stop);
+
+        /// Like loop(), with the options that the context requires
+        /// (the profiler, the debug levels, the step threads)
+        template <class Stop>
+        LoopStatus advance(Stop stop);
+
+        /// Prints the number of every run, and the mode of run(),
+        /// on the standard output (the default)
+        inline void setVerbose(bool v) { _verbose = v; }
+
                 
         /**
            Function to help testing and debugging.
@@ -194,21 +615,112 @@ namespace MetaSim {
 
         void endSim();
 
+        /// Performs one run, from initSingleRun() to endSingleRun()
+        void singleRun(Tick endTick);
+
+        /// Performs the runs [first, first + count) on model
+        /// instances, with the streams of a simulation of
+        /// streams runs, and collects them in this context
+        void runReplicas(Tick endTick, size_t first, size_t count,
+                         size_t streams, const ModelFactory &factory,
+                         unsigned nThreads);
+
+        /// The settings of a context that a replica inherits
+        struct ReplicaSetup {
+            long streamSeed;
+            bool antithetic;
+            Tick transitory;
+        };
+
+        ReplicaSetup replicaSetup() const;
+
+        /// Performs run r (of streams runs) on a new model
+        /// instance, in a new context whose generator is a copy of
+        /// gen; returns the executed events, and the values of
+        /// the stats in values
+        static uint64_t runReplica(const ReplicaSetup &setup, Tick endTick,
+                                   size_t r, size_t streams,
+                                   const RandomGen &gen,
+                                   const ModelFactory &factory,
+                                   std::vector<double> &values,
+                                   std::unique_ptr<Profiler> *profile);
+
+        /// The number of threads of the parallel replications
+        static unsigned threads(unsigned nThreads);
+
+        /// The number of runs to execute for nRuns: 3 instead of
+        /// 2, with a warning (Exc if nRuns < 1)
+        static int checkRuns(int nRuns);
+
+        /// Runs a step, from its first event (see setStepThreads())
+        const Tick parallelStep(Event *first);
+
+        /// The threads of the parallel steps
+        class StepPool;
+
+        /// Continues a run from the end of the warm-up until
+        /// endTick, with the streams of run r
+        void continueRun(Tick endTick, size_t r);
+
+        /// The runs of runFromWarmup() in child processes
+        void forkRuns(Tick endTick, unsigned nProcs);
+
+        /// Simulates the warm-up of a run that ends at endTick,
+        /// until the end of the transitory or the one detected
+        /// (see setWarmupDetection()); returns its end
+        Tick warmup(Tick endTick);
+
+        /// Reports the progress (see SimContext::enableProgress())
+        void reportProgress(bool final);
+
         const Tick getNextEventTime();
                 
         size_t numRuns;
         size_t actRuns;
         Tick globTime;
         bool end;
+        uint64_t execEvents;
+        bool _verbose;
+
+        unsigned _stepThreads;
+        std::unique_ptr<StepPool> _stepPool;
+        uint64_t _parallelSteps;
+
+        // the events after which the progress is reported (-1:
+        // never), and the end of the current run
+        uint64_t _reportAt;
+        Tick _runEnd;
+
+        // see setWarmupDetection()
+        Tick _warmupInterval;
+        Tick _warmupMax;
+        size_t _warmupBatch;
+        Tick _warmupEnd;
     };
 
+    /**
+       The scope of a DBGENTER. While no debug level is enabled (see
+       DebugStream::anyEnabled()), the constructor and the destructor
+       only test a flag; otherwise the level is interned once for
+       the call site (lev returns its identifier).
+    */
     class DbgObj {
+        bool _on;
+        bool _prev;
     public:
-        DbgObj(const std::string &x, const std::string &y) {
-            Simulation::getInstance().dbgEnter(x,y);
+        DbgObj(const std::string &x, const std::string &y) :
+            _on(true), _prev(false) {
+            _prev = Simulation::getInstance().dbgEnter(DebugStream::level(x),
+                                                       y.c_str());
         }
+
+        DbgObj(int (*lev)(), const char *y) :
+            _on(DebugStream::anyEnabled()), _prev(false) {
+            if (_on) _prev = Simulation::getInstance().dbgEnter(lev(), y);
+        }
+
         ~DbgObj() {
-            Simulation::getInstance().dbgExit();
+            if (_on) Simulation::getInstance().dbgExit(_prev);
         }
     };
 
@@ -223,7 +735,9 @@ extern "C" {
 
 #ifdef __DEBUG__
 
-#define DBGENTER(x) DbgObj __dbg_obj__(x,__PRETTY_FUNCTION__)
+#define DBGENTER(x) DbgObj __dbg_obj__(                             \
+        []() { static const int l = MetaSim::DebugStream::level(x); \
+               return l; }, __PRETTY_FUNCTION__)
 
 #define DBGTAG(x,y)   do { SIMUL.dbgEnter(x,y);       \
                            SIMUL.dbgExit();} while(0)
@@ -235,12 +749,13 @@ extern "C" {
                       SIMUL.dbg.exit();               \
                       SIMUL.dbg.disable("__FORCE__"); } while(0)
 
-#define DBGPRINT(x)   SIMUL.dbg << x << std::endl
-#define DBGPRINT_2(x,y) SIMUL.dbg << x << y << std::endl
-#define DBGPRINT_3(x,y,z) SIMUL.dbg << x << y << z << std::endl
-#define DBGPRINT_4(x,y,z,w) SIMUL.dbg << x << y << z << w << std::endl
-#define DBGPRINT_5(x,y,z,w,r) SIMUL.dbg << x << y << z << w << r << std::endl
-#define DBGPRINT_6(x,y,z,w,r,s) SIMUL.dbg << x << y << z << w << r << s << std::endl
+#define DBGPRINT(x)   do { if (MetaSim::DebugStream::anyEnabled()) \
+            SIMUL.dbg << x << std::endl; } while (0)
+#define DBGPRINT_2(x,y) DBGPRINT(x << y)
+#define DBGPRINT_3(x,y,z) DBGPRINT(x << y << z)
+#define DBGPRINT_4(x,y,z,w) DBGPRINT(x << y << z << w)
+#define DBGPRINT_5(x,y,z,w,r) DBGPRINT(x << y << z << w << r)
+#define DBGPRINT_6(x,y,z,w,r,s) DBGPRINT(x << y << z << w << r << s)
 
 #define DBGVAR(x) DBGPRINT_2("  --> " #x " = ", x)
 
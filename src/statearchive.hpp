@@ -0,0 +1,100 @@
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef __STATEARCHIVE_HPP__
+#define __STATEARCHIVE_HPP__
+
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+#include <baseexc.hpp>
+
+namespace MetaSim {
+
+    /**
+       \ingroup metasim_ee
+
+       A binary buffer holding a snapshot of the state of entities
+       and statistics (see Entity::saveState()). Values are appended
+       by save() and read back, in the same order, by restore():
+
+       @code
+       void MyEntity::saveState(StateArchive &a) const
+       {
+           a.save(_counter);
+           a.save(_lastTime);
+       }
+       void MyEntity::restoreState(StateArchive &a)
+       {
+           a.restore(_counter);
+           a.restore(_lastTime);
+       }
+       @endcode
+
+       Only trivially copyable values (numbers, Tick, plain
+       structures) can be saved directly; containers must be saved
+       element by element, after their size.
+    */
+    class StateArchive {
+        std::vector<char> _buf;
+        size_t _pos;
+    public:
+        /**
+           \ingroup metasim_exc
+        */
+        class Exc : public BaseExc {
+        public:
+            Exc(const std::string &msg) :
+                BaseExc(msg, "StateArchive", "statearchive.hpp") {}
+        };
+
+        StateArchive() : _buf(), _pos(0) {}
+
+        /// Appends a value to the archive
+        template <class T>
+        void save(const T &v) {
+            static_assert(std::is_trivially_copyable<T>::value,
+                          "StateArchive::save: T must be trivially copyable");
+            const char *p = reinterpret_cast<const char *>(&v);
+            _buf.insert(_buf.end(), p, p + sizeof(T));
+        }
+
+        /// Reads the next value of the archive
+        template <class T>
+        void restore(T &v) {
+            static_assert(std::is_trivially_copyable<T>::value,
+                          "StateArchive::restore: T must be trivially copyable");
+            if (_pos + sizeof(T) > _buf.size())
+                throw Exc("Restoring more data than saved");
+            std::memcpy(&v, &_buf[_pos], sizeof(T));
+            _pos += sizeof(T);
+        }
+
+        /// Restarts reading from the first value
+        inline void rewind() { _pos = 0; }
+
+        /// Removes all the values
+        inline void clear() { _buf.clear(); _pos = 0; }
+
+        /// Size of the archive in bytes
+        inline size_t size() const { return _buf.size(); }
+
+        /// The bytes of the archive, to send it elsewhere
+        inline const char *data() const { return _buf.data(); }
+
+        /// Replaces the values with the bytes of another archive
+        void assign(const char *p, size_t n) {
+            _buf.assign(p, p + n);
+            _pos = 0;
+        }
+    };
+
+} // namespace MetaSim
+
+#endif
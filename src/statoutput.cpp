@@ -0,0 +1,211 @@
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+
+#include <basestat.hpp>
+#include <simcontext.hpp>
+#include <statoutput.hpp>
+
+namespace MetaSim {
+
+    using namespace std;
+
+    StatOutput::StatOutput(const string &path, size_t buffer) :
+        _file(path, buffer), _ctx(&SimContext::current()), _rows(0)
+    {
+        _ctx->_outputs.push_back(this);
+    }
+
+    StatOutput::~StatOutput()
+    {
+        _ctx->_outputs.remove(this);
+    }
+
+    void StatOutput::add(BaseStat &s)
+    {
+        if (_rows > 0) throw Exc("Adding a column after the first row");
+        _columns.push_back(&s);
+    }
+
+    string StatOutput::columnName(size_t i) const
+    {
+        string n = _columns[i]->getName();
+        return n.empty() ? "stat" + to_string(i) : n;
+    }
+
+    void StatOutput::endRun()
+    {
+        if (_rows == 0) {
+            if (_columns.empty())
+                _columns.assign(_ctx->_stats.begin(), _ctx->_stats.end());
+            vector<string> names;
+            for (size_t i = 0; i < _columns.size(); ++i)
+                names.push_back(columnName(i));
+            writeHeader(names);
+        }
+        _row.resize(_columns.size());
+        for (size_t i = 0; i < _columns.size(); ++i)
+            _row[i] = _columns[i]->getLastValue();
+        writeRow(_ctx->_expNum - 1, _row);
+        ++_rows;
+    }
+
+    void StatOutput::endSim()
+    {
+        _file.flush();
+    }
+
+    void StatOutput::sync()
+    {
+        _file.sync();
+    }
+
+    /*---------------------------------------------------*/
+
+    namespace {
+        // a field of RFC 4180
+        string quote(const string &s)
+        {
+            if (s.find_first_of(",\"\r\n") == string::npos) return s;
+            string q = "\"";
+            for (char c : s) {
+                if (c == '"') q += '"';
+                q += c;
+            }
+            return q + '"';
+        }
+    }
+
+    CsvOutput::CsvOutput(const string &path, size_t buffer) :
+        StatOutput(path, buffer)
+    {
+    }
+
+    CsvOutput::~CsvOutput()
+    {
+    }
+
+    void CsvOutput::writeHeader(const vector<string> &names)
+    {
+        string h = "run";
+        for (const string &n : names) h += "," + quote(n);
+        h += "\n";
+        _file.write(h);
+    }
+
+    void CsvOutput::writeRow(size_t run, const vector<double> &values)
+    {
+        // 17 digits: the values are read back exactly
+        char buf[32];
+        int n = snprintf(buf, sizeof(buf), "%zu", run);
+        _file.write(buf, n);
+        for (double v : values) {
+            n = snprintf(buf, sizeof(buf), ",%.17g", v);
+            _file.write(buf, n);
+        }
+        _file.write("\n", 1);
+    }
+
+    /*---------------------------------------------------*/
+
+    const size_t BinaryOutput::DEFAULT_GROUP;
+
+    namespace {
+        const char MAGIC[8] = { 'M', 'S', 'S', 'T', 'A', 'T', '0', '1' };
+        const uint64_t ORDER = 0x0102030405060708ULL;
+    }
+
+    BinaryOutput::BinaryOutput(const string &path, size_t group, size_t buffer) :
+        StatOutput(path, buffer), _group(group ? group : DEFAULT_GROUP), _pending(0)
+    {
+    }
+
+    BinaryOutput::~BinaryOutput()
+    {
+        if (_pending > 0) writeGroup();
+    }
+
+    void BinaryOutput::writeHeader(const vector<string> &names)
+    {
+        _file.write(MAGIC, sizeof(MAGIC));
+        _file.write(&ORDER, sizeof(ORDER));
+        uint64_t n = names.size();
+        _file.write(&n, sizeof(n));
+        for (const string &s : names) {
+            n = s.size();
+            _file.write(&n, sizeof(n));
+            _file.write(s);
+        }
+        _buf.assign(names.size(), vector<double>());
+        for (auto &c : _buf) c.reserve(_group);
+    }
+
+    void BinaryOutput::writeRow(size_t, const vector<double> &values)
+    {
+        for (size_t i = 0; i < values.size(); ++i) _buf[i].push_back(values[i]);
+        if (++_pending == _group) writeGroup();
+    }
+
+    void BinaryOutput::writeGroup()
+    {
+        uint64_t n = _pending;
+        _file.write(&n, sizeof(n));
+        for (auto &c : _buf) {
+            _file.write(c.data(), c.size() * sizeof(double));
+            c.clear();
+        }
+        _pending = 0;
+    }
+
+    void BinaryOutput::endSim()
+    {
+        if (_pending > 0) writeGroup();
+        StatOutput::endSim();
+    }
+
+    BinaryOutput::Table BinaryOutput::read(const string &path)
+    {
+        ifstream f(path.c_str(), ios::binary);
+        if (!f.is_open()) throw Exc("Cannot open file " + path);
+
+        char magic[sizeof(MAGIC)];
+        uint64_t order, n;
+        f.read(magic, sizeof(magic));
+        f.read(reinterpret_cast<char *>(&order), sizeof(order));
+        f.read(reinterpret_cast<char *>(&n), sizeof(n));
+        if (!f || !equal(magic, magic + sizeof(magic), MAGIC))
+            throw Exc(path + " is not a stat table");
+        if (order != ORDER)
+            throw Exc(path + " was written with a different byte order");
+
+        Table t;
+        t.names.resize(n);
+        t.columns.resize(n);
+        for (string &s : t.names) {
+            uint64_t len;
+            f.read(reinterpret_cast<char *>(&len), sizeof(len));
+            if (!f) throw Exc("Truncated file " + path);
+            s.resize(len);
+            f.read(&s[0], len);
+        }
+        uint64_t rows;
+        while (f.read(reinterpret_cast<char *>(&rows), sizeof(rows))) {
+            for (auto &c : t.columns) {
+                size_t k = c.size();
+                c.resize(k + rows);
+                f.read(reinterpret_cast<char *>(c.data() + k), rows * sizeof(double));
+            }
+            if (!f) throw Exc("Truncated file " + path);
+        }
+        return t;
+    }
+
+} // namespace MetaSim
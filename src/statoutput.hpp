@@ -0,0 +1,172 @@
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef __STATOUTPUT_HPP__
+#define __STATOUTPUT_HPP__
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <asyncwriter.hpp>
+#include <baseexc.hpp>
+
+namespace MetaSim {
+
+    class BaseStat;
+    class SimContext;
+
+    /**
+       \ingroup metasim_stat
+
+       A file that receives the value of the stats at every run
+       (or batch, see Simulation::runBatches()): one row for each
+       endRun(), one column for each stat. The file is opened once
+       and written by an AsyncWriter, so a row costs a copy in
+       memory, and the file is flushed (without waiting) at
+       endSim().
+
+       An output is attached to the current context when it is
+       created. The columns are the stats passed to add() or, if
+       none, all the stats of the context at the first row.
+
+       @code
+       CsvOutput out("runs.csv");
+       SIMUL.run(10000, 100);
+       @endcode
+     */
+    class StatOutput {
+    public:
+        /**
+           \ingroup metasim_exc
+        */
+        class Exc : public BaseExc {
+        public:
+            Exc(const std::string &msg) :
+                BaseExc(msg, "StatOutput", "statoutput.hpp") {}
+        };
+
+        /// Detaches the output; the file is written and closed
+        virtual ~StatOutput();
+
+        /// Adds a column
+        void add(BaseStat &s);
+
+        /// Called by BaseStat::endRun(), after the collection
+        void endRun();
+
+        /// Called by BaseStat::endSim()
+        virtual void endSim();
+
+        /// Waits until all the rows are in the file
+        void sync();
+
+        /// Number of rows written
+        inline size_t getRows() const { return _rows; }
+
+        inline const std::string &getPath() const { return _file.getPath(); }
+
+    protected:
+        StatOutput(const std::string &path, size_t buffer);
+
+        /// Writes the header, before the first row
+        virtual void writeHeader(const std::vector<std::string> &names) = 0;
+
+        /// Writes a row: the index of the run, and a value per column
+        virtual void writeRow(size_t run, const std::vector<double> &values) = 0;
+
+        /// The name of the i-th column ("stat<i>" if the stat has no name)
+        std::string columnName(size_t i) const;
+
+        AsyncWriter _file;
+
+    private:
+        StatOutput(const StatOutput &);
+        StatOutput &operator=(const StatOutput &);
+
+        SimContext *_ctx;
+        std::vector<BaseStat *> _columns;
+        std::vector<double> _row;
+        size_t _rows;
+    };
+
+    /**
+       \ingroup metasim_stat
+
+       A wide CSV table (RFC 4180): the header is "run" and the name
+       of the stats, then a line for each run.
+     */
+    class CsvOutput : public StatOutput {
+    public:
+        explicit CsvOutput(const std::string &path,
+                           size_t buffer = AsyncWriter::DEFAULT_BUFFER);
+        virtual ~CsvOutput();
+
+    protected:
+        virtual void writeHeader(const std::vector<std::string> &names);
+        virtual void writeRow(size_t run, const std::vector<double> &values);
+    };
+
+    /**
+       \ingroup metasim_stat
+
+       A compact binary table, written by columns. The file is
+
+       <pre>
+       "MSSTAT01"                  magic
+       uint64 0x0102030405060708   order of the bytes of the writer
+       uint64 columns
+       columns x (uint64 length, chars)
+       groups of rows:
+           uint64 rows
+           columns x rows doubles, a column after the other
+       </pre>
+
+       A group holds up to getGroup() rows; the rows left are
+       written as a group at endSim(). read() loads a file.
+     */
+    class BinaryOutput : public StatOutput {
+    public:
+        /// Default number of rows of a group
+        static const size_t DEFAULT_GROUP = 1024;
+
+        /// The content of a file
+        struct Table {
+            std::vector<std::string> names;
+            /// a vector for each column
+            std::vector<std::vector<double> > columns;
+        };
+
+        explicit BinaryOutput(const std::string &path,
+                              size_t group = DEFAULT_GROUP,
+                              size_t buffer = AsyncWriter::DEFAULT_BUFFER);
+        virtual ~BinaryOutput();
+
+        virtual void endSim();
+
+        inline size_t getGroup() const { return _group; }
+
+        /// Reads a file written by a BinaryOutput
+        static Table read(const std::string &path);
+
+    protected:
+        virtual void writeHeader(const std::vector<std::string> &names);
+        virtual void writeRow(size_t run, const std::vector<double> &values);
+
+    private:
+        void writeGroup();
+
+        size_t _group;
+        size_t _pending;
+        // the rows of the group, by column
+        std::vector<std::vector<double> > _buf;
+    };
+
+} // namespace MetaSim
+
+#endif
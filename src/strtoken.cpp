@@ -5,37 +5,96 @@ namespace parse_util {
 
     using namespace std;
 
+    const StrView::size_type StrView::npos;
+
+    StrView::size_type StrView::find(char c, size_type pos) const
+    {
+        if (pos >= _n) return npos;
+        const void *q = memchr(_p + pos, c, _n - pos);
+        return q ? static_cast<const char *>(q) - _p : npos;
+    }
+
+    StrView::size_type StrView::find(StrView s, size_type pos) const
+    {
+        if (s._n == 0) return pos <= _n ? pos : npos;
+        for (; pos < _n && _n - pos >= s._n; ++pos) {
+            pos = find(s._p[0], pos);
+            if (pos == npos || _n - pos < s._n) return npos;
+            if (memcmp(_p + pos, s._p, s._n) == 0) return pos;
+        }
+        return npos;
+    }
+
+    StrView::size_type StrView::find_first_of(StrView s, size_type pos) const
+    {
+        for (; pos < _n; ++pos)
+            if (memchr(s._p, _p[pos], s._n)) return pos;
+        return npos;
+    }
+
+    StrView::size_type StrView::find_first_not_of(StrView s, size_type pos) const
+    {
+        for (; pos < _n; ++pos)
+            if (!memchr(s._p, _p[pos], s._n)) return pos;
+        return npos;
+    }
+
+    StrView::size_type StrView::find_last_of(StrView s, size_type pos) const
+    {
+        if (_n == 0) return npos;
+        for (size_type i = pos < _n ? pos + 1 : _n; i-- > 0; )
+            if (memchr(s._p, _p[i], s._n)) return i;
+        return npos;
+    }
+
+    StrView::size_type StrView::find_last_not_of(StrView s, size_type pos) const
+    {
+        if (_n == 0) return npos;
+        for (size_type i = pos < _n ? pos + 1 : _n; i-- > 0; )
+            if (!memchr(s._p, _p[i], s._n)) return i;
+        return npos;
+    }
+
+    vector<string> to_strings(const vector<StrView> &v)
+    {
+        vector<string> temp;
+        temp.reserve(v.size());
+        for (StrView s : v) temp.push_back(s.str());
+        return temp;
+    }
+
     //removes the spaces at the beginning and at the end of the string
     string remove_spaces(const string &tk)
     {
-        string temp = tk;
-        string::size_type pos = 0;
+        return remove_spaces(StrView(tk)).str();
+    }
 
-        if (tk == "") return temp;
-        // remove spaces at the beginning...
-        temp.erase(0, temp.find_first_not_of(' '));
-        pos = temp.find_last_not_of(' ');
-        temp.erase(pos+1, temp.size() - pos - 1);
-        return temp;
+    StrView remove_spaces(StrView tk)
+    {
+        StrView::size_type first = tk.find_first_not_of(" ");
+        if (first == StrView::npos) return tk.substr(tk.size());
+        return tk.substr(first, tk.find_last_not_of(" ") - first + 1);
     }
 
     vector<string> split(const string &code, const string &sep)
     {
-        vector<string> temp;
-        string::size_type pos = 0;
-        string::size_type old_pos = 0;
-        int count = 0;
+        return to_strings(split(StrView(code), StrView(sep)));
+    }
+
+    vector<StrView> split(StrView code, StrView sep)
+    {
+        vector<StrView> temp;
+        StrView::size_type pos = 0;
+        StrView::size_type old_pos = 0;
 
-        while (pos != string::npos) {
+        while (pos != StrView::npos) {
             pos = code.find(sep, old_pos);
-            if (pos != string::npos) {
+            if (pos != StrView::npos) {
                 temp.push_back(remove_spaces(code.substr(old_pos,pos-old_pos)));
                 old_pos = pos + sep.size();
-                count ++;
             }
             else {
-                temp.push_back(remove_spaces(code.substr(old_pos, code.size()
-                                                         - old_pos)));
+                temp.push_back(remove_spaces(code.substr(old_pos)));
             }
         }
 
@@ -44,13 +103,18 @@ namespace parse_util {
 
     vector<string> split_instr(const string &code)
     {
-        vector<string> temp;
-        string::size_type pos = 0;
-        string::size_type old_pos = 0;
+        return to_strings(split_instr(StrView(code)));
+    }
+
+    vector<StrView> split_instr(StrView code)
+    {
+        vector<StrView> temp;
+        StrView::size_type pos = 0;
+        StrView::size_type old_pos = 0;
 
-        while (pos != string::npos) {
+        while (pos != StrView::npos) {
             pos = code.find(';', old_pos);
-            if (pos != string::npos) {
+            if (pos != StrView::npos) {
                 temp.push_back(remove_spaces(code.substr(old_pos,pos-old_pos)));
                 old_pos = ++pos;
             }
@@ -61,82 +125,113 @@ namespace parse_util {
 
     string get_token(const string &instr, const string &open_par)
     {
-        string temp;
-
-        string::size_type pos = instr.find(open_par);
-        string::size_type pos1 = instr.find_first_not_of(" \n");
+        return get_token(StrView(instr), StrView(open_par)).str();
+    }
 
-        temp = instr.substr(pos1, pos - pos1);
+    StrView get_token(StrView instr, StrView open_par)
+    {
+        StrView::size_type pos = instr.find(open_par);
+        StrView::size_type pos1 = instr.find_first_not_of(" \n");
 
-        return temp;
+        return instr.substr(pos1, pos - pos1);
     }
 
     string get_param(const string &instr, const string &open_par,
                      const string &close_par)
     {
-        string temp("");
-        string::size_type pos = instr.find(open_par);
+        return get_param(StrView(instr), StrView(open_par), StrView(close_par)).str();
+    }
+
+    StrView get_param(StrView instr, StrView open_par, StrView close_par)
+    {
+        StrView::size_type pos = instr.find(open_par);
 
-        if (pos != string::npos) {
-            string::size_type end = instr.find_last_of(close_par);
-            temp = instr.substr(pos+1, end-pos-1);
+        if (pos != StrView::npos) {
+            StrView::size_type end = instr.find_last_of(close_par);
+            return instr.substr(pos+1, end-pos-1);
         }
 
-        return temp;
+        return StrView();
     }
 
     vector<string> split_param(const string &p, const string &sep,
                                char open_par, char close_par)
     {
-        vector<string> temp;
-        string::size_type pos = 0;
-        string::size_type old_pos = 0;
+        return to_strings(split_param(StrView(p), StrView(sep), open_par, close_par));
+    }
 
-        string symbols = sep + open_par;
+    vector<StrView> split_param(StrView p, StrView sep,
+                                char open_par, char close_par)
+    {
+        vector<StrView> temp;
+        StrView::size_type pos = 0;
+        StrView::size_type old_pos = 0;
+
+        // the separators and the open parenthesis
+        char buf[16];
+        string big;
+        const char *symbols = buf;
+        if (sep.size() < sizeof(buf)) {
+            memcpy(buf, sep.data(), sep.size());
+            buf[sep.size()] = open_par;
+        }
+        else {
+            big = sep.str() + open_par;
+            symbols = big.data();
+        }
+        StrView syms(symbols, sep.size() + 1);
 
         while (pos <= p.size()) {
-            pos = p.find_first_of(symbols, pos);
+            pos = p.find_first_of(syms, pos);
 
-            if (pos != string::npos)
+            if (pos != StrView::npos)
                 if (p[pos] == open_par) {
+                    // unbalanced: the rest is the last parameter
                     pos = p.find(close_par, pos);
-                    if (pos == p.size()) pos = string::npos;
-                    else ++pos;
+                    if (pos != StrView::npos) ++pos;
                 }
 
-            if (pos != string::npos) {
-                string t = remove_spaces(p.substr(old_pos, pos - old_pos));
-
-                temp.push_back(t);
+            if (pos != StrView::npos) {
+                temp.push_back(remove_spaces(p.substr(old_pos, pos - old_pos)));
 
                 old_pos = ++pos;
             }
         }
 
         if (pos != old_pos) {
-            string t = remove_spaces(p.substr(old_pos, p.size() - old_pos));
+            StrView t = remove_spaces(p.substr(old_pos));
 
-            if (t != "") temp.push_back(t);
+            if (!t.empty()) temp.push_back(t);
         }
 
         return temp;
     }
 
-
     void parse_double(const string &nums, double &res, string &unit)
     {
-        string tmp = remove_spaces(nums);
-        string::size_type pos = 0;
-        string symb = "smnu";
-
-        pos = tmp.find_first_of(symb, pos);
-
-        if (pos != string::npos)
-            unit = tmp.substr(pos, tmp.size() - pos);
-        else unit = "";
+        StrView u;
+        parse_double(StrView(nums), res, u);
+        unit = u.str();
+    }
 
-        string snum = tmp.substr(0,pos);
-        res = atof(snum.c_str());
+    void parse_double(StrView nums, double &res, StrView &unit)
+    {
+        StrView tmp = remove_spaces(nums);
+        StrView::size_type pos = tmp.find_first_of("smnu");
+
+        if (pos != StrView::npos) unit = tmp.substr(pos);
+        else unit = StrView();
+
+        // atof() needs a terminated string: short numbers are
+        // copied on the stack
+        StrView snum = tmp.substr(0, pos);
+        char buf[64];
+        if (snum.size() < sizeof(buf)) {
+            memcpy(buf, snum.data(), snum.size());
+            buf[snum.size()] = '\0';
+            res = atof(buf);
+        }
+        else res = atof(snum.str().c_str());
     }
 
     ParseExc::ParseExc(const string &where, const string &par) :
@@ -14,10 +14,16 @@
 #ifndef __STRTOKEN_HPP__
 #define __STRTOKEN_HPP__
 
+#include <cstddef>
+#include <cstring>
+#include <ostream>
 #include <stdexcept>
 #include <string>
 #include <sstream>
 #include <vector>
+#if __cplusplus >= 201703L
+#include <string_view>
+#endif
 
 #include <baseexc.hpp>
 
@@ -30,11 +36,78 @@
  */
 namespace parse_util {
 
+    /**
+       A view of a sequence of characters owned by someone else (a
+       string, a buffer with the content of a file): the parsing
+       functions that take a StrView return views of the same
+       characters, without allocating, and they are valid as long
+       as the characters are. It is the std::string_view of C++17,
+       to which it converts, for a library built as C++14.
+
+       The functions that take a std::string call the ones that
+       take a StrView: a string literal must be passed as a
+       StrView("...") to select the latter.
+    */
+    class StrView {
+    public:
+        typedef std::size_t size_type;
+        static const size_type npos = size_type(-1);
+
+        StrView() : _p(""), _n(0) {}
+        StrView(const char *s) : _p(s), _n(std::strlen(s)) {}
+        StrView(const char *s, size_type n) : _p(s), _n(n) {}
+        StrView(const std::string &s) : _p(s.data()), _n(s.size()) {}
+#if __cplusplus >= 201703L
+        StrView(std::string_view s) : _p(s.data()), _n(s.size()) {}
+        operator std::string_view() const { return std::string_view(_p, _n); }
+#endif
+
+        const char *data() const { return _p; }
+        size_type size() const { return _n; }
+        bool empty() const { return _n == 0; }
+        char operator[](size_type i) const { return _p[i]; }
+        const char *begin() const { return _p; }
+        const char *end() const { return _p + _n; }
+
+        /// A copy of the characters
+        std::string str() const { return std::string(_p, _n); }
+
+        /// As std::string::substr() (throws std::out_of_range)
+        StrView substr(size_type pos, size_type n = npos) const {
+            if (pos > _n) throw std::out_of_range("StrView::substr");
+            return StrView(_p + pos, n < _n - pos ? n : _n - pos);
+        }
+
+        size_type find(char c, size_type pos = 0) const;
+        size_type find(StrView s, size_type pos = 0) const;
+        size_type find_first_of(StrView s, size_type pos = 0) const;
+        size_type find_first_not_of(StrView s, size_type pos = 0) const;
+        size_type find_last_of(StrView s, size_type pos = npos) const;
+        size_type find_last_not_of(StrView s, size_type pos = npos) const;
+
+        friend bool operator==(StrView a, StrView b) {
+            return a._n == b._n && std::memcmp(a._p, b._p, a._n) == 0;
+        }
+        friend bool operator!=(StrView a, StrView b) { return !(a == b); }
+        friend std::ostream &operator<<(std::ostream &os, StrView s) {
+            return os.write(s._p, s._n);
+        }
+
+    private:
+        const char *_p;
+        size_type _n;
+    };
+
+    /// The copies of a sequence of views
+    std::vector<std::string> to_strings(const std::vector<StrView> &v);
+
     /**
        Removes trailing spaces from the beginning and from the end of
        the string \c tk.
     */
     std::string remove_spaces(const std::string &tk);
+    StrView remove_spaces(StrView tk);
+    inline std::string remove_spaces(const char *tk) { return remove_spaces(std::string(tk)); }
 
     /**
        Given a string \c code, consisting of many substrings separated
@@ -43,6 +116,10 @@ namespace parse_util {
        vector containing strings "fixed(1)" and "wait(R)".
     */
     std::vector<std::string> split(const std::string &code, const std::string &sep);
+    std::vector<StrView> split(StrView code, StrView sep);
+    inline std::vector<std::string> split(const char *code, const char *sep) {
+        return split(std::string(code), std::string(sep));
+    }
 
     /**
        Given a sequence of "instructions" spearated by ';', returns a
@@ -52,12 +129,20 @@ namespace parse_util {
        @todo add sintax error checking!
     */
     std::vector<std::string> split_instr(const std::string &code);
+    std::vector<StrView> split_instr(StrView code);
+    inline std::vector<std::string> split_instr(const char *code) {
+        return split_instr(std::string(code));
+    }
 
     /**
        Given an instruction \c instr of the form "token(p1)" returns the
        token.
     */
     std::string get_token(const std::string &instr, const std::string &open_par = "(");
+    StrView get_token(StrView instr, StrView open_par = "(");
+    inline std::string get_token(const char *instr, const std::string &open_par = "(") {
+        return get_token(std::string(instr), open_par);
+    }
 
     /**
        Given an instruction \c instr of the form "token(p1,p2)" returns the
@@ -65,6 +150,11 @@ namespace parse_util {
     */
     std::string get_param(const std::string &instr, const std::string &open_par = "(",
                      const std::string &close_par = ")");
+    StrView get_param(StrView instr, StrView open_par = "(", StrView close_par = ")");
+    inline std::string get_param(const char *instr, const std::string &open_par = "(",
+                                 const std::string &close_par = ")") {
+        return get_param(std::string(instr), open_par, close_par);
+    }
 
     /**
        Given an instruction \c instr of the form "token = param1,
@@ -79,6 +169,12 @@ namespace parse_util {
     */
     std::vector<std::string> split_param(const std::string &p, const std::string &sep = ",",
                                char open_par = '(', char close_par = ')');
+    std::vector<StrView> split_param(StrView p, StrView sep = ",",
+                                     char open_par = '(', char close_par = ')');
+    inline std::vector<std::string> split_param(const char *p, const std::string &sep = ",",
+                                                char open_par = '(', char close_par = ')') {
+        return split_param(std::string(p), sep, open_par, close_par);
+    }
 
     /**
        Given a string of the form "123.75ms" returns the double number
@@ -86,6 +182,7 @@ namespace parse_util {
        unit.
     */
     void parse_double(const std::string &nums, double &res, std::string &unit);
+    void parse_double(StrView nums, double &res, StrView &unit);
 
     /**
        Exception raised by the above functions
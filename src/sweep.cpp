@@ -0,0 +1,326 @@
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <exception>
+#include <fstream>
+#include <mutex>
+#include <ostream>
+#include <thread>
+
+#include <basestat.hpp>
+#include <randomvar.hpp>
+#include <simul.hpp>
+#include <statearchive.hpp>
+#include <sweep.hpp>
+
+namespace MetaSim {
+
+    using namespace std;
+
+    namespace {
+        string quote(const string &s)
+        {
+            if (s.find_first_of(",\"\r\n") == string::npos) return s;
+            string q = "\"";
+            for (char c : s) {
+                if (c == '"') q += '"';
+                q += c;
+            }
+            return q + '"';
+        }
+
+        /// The shortest text that reads back as v
+        string format(double v)
+        {
+            char buf[32];
+            for (int p = 6; p <= 17; ++p) {
+                snprintf(buf, sizeof(buf), "%.*g", p, v);
+                if (strtod(buf, NULL) == v) break;
+            }
+            return buf;
+        }
+
+        struct Task {
+            size_t point;
+            size_t replica;
+        };
+
+        /// The tasks of a thread: it takes them from the front,
+        /// the other threads steal them from the back
+        struct TaskQueue {
+            mutex m;
+            deque<Task> tasks;
+
+            bool pop(Task &t, bool front) {
+                lock_guard<mutex> lock(m);
+                if (tasks.empty()) return false;
+                if (front) {
+                    t = tasks.front();
+                    tasks.pop_front();
+                }
+                else {
+                    t = tasks.back();
+                    tasks.pop_back();
+                }
+                return true;
+            }
+        };
+    }
+
+    /// The model of the last point built by a thread, in its own
+    /// context
+    class Sweep::Worker {
+    public:
+        size_t point;
+        unique_ptr<SimContext> ctx;
+        shared_ptr<void> model;
+
+        Worker() : point(0), ctx(), model() {}
+        ~Worker() { drop(); }
+
+        /// Destroys the model, then its context
+        void drop() {
+            if (ctx) {
+                SimContext::Scope s(*ctx);
+                model.reset();
+            }
+            ctx.reset();
+        }
+    };
+
+    const string &Sweep::Point::get(const string &name) const
+    {
+        const vector<string> &names = _sweep->_names;
+        size_t i = _index;
+        for (size_t k = names.size(); k-- > 0; ) {
+            const vector<string> &v = _sweep->_values[k];
+            if (names[k] == name) return v[i % v.size()];
+            i /= v.size();
+        }
+        throw Exc("Unknown parameter " + name);
+    }
+
+    double Sweep::Point::getDouble(const string &name) const
+    {
+        const string &s = get(name);
+        char *end;
+        double v = strtod(s.c_str(), &end);
+        if (s.empty() || *end != 0)
+            throw Exc("The value " + s + " of " + name + " is not a number");
+        return v;
+    }
+
+    Sweep::Sweep() :
+        _names(), _values(), _stats(), _replicas(0), _results(),
+        _executed(0), _builds(0), _steals(0)
+    {
+    }
+
+    Sweep &Sweep::add(const string &name, const vector<string> &values)
+    {
+        if (values.empty()) throw Exc("The parameter " + name + " has no values");
+        for (const string &n : _names)
+            if (n == name) throw Exc("The parameter " + name + " is already in the sweep");
+        _names.push_back(name);
+        _values.push_back(values);
+        return *this;
+    }
+
+    Sweep &Sweep::add(const string &name, const vector<double> &values)
+    {
+        vector<string> v;
+        for (double d : values) v.push_back(format(d));
+        return add(name, v);
+    }
+
+    size_t Sweep::getPoints() const
+    {
+        size_t n = 1;
+        for (const vector<string> &v : _values) n *= v.size();
+        return n;
+    }
+
+    void Sweep::run(Tick endTick, size_t replicas, const Factory &factory,
+                    unsigned nThreads)
+    {
+        if (replicas == 0) throw Exc("The number of replicas must be positive");
+        const size_t points = getPoints();
+        const size_t count = points * replicas;
+        if (nThreads == 0) nThreads = thread::hardware_concurrency();
+        if (nThreads == 0) nThreads = 1;
+        if (nThreads > count) nThreads = unsigned(count);
+
+        // the replicas start from the generator and the settings
+        // of the current context
+        SimContext &master = SimContext::current();
+        StateArchive state;
+        master._pstdgen->saveState(state);
+        const RandomGen &gen = *master._pstdgen;
+        const Simulation::ReplicaSetup setup = master.getSimulation().replicaSetup();
+
+        _replicas = replicas;
+        _stats.clear();
+        _results.assign(points, vector<vector<double> >(replicas));
+        vector<vector<exception_ptr> > errors(points, vector<exception_ptr>(replicas));
+        atomic<uint64_t> executed(0);
+        atomic<size_t> builds(0), steals(0);
+        mutex statsMutex;
+
+        // the points are dealt to the threads, with all their
+        // replicas
+        vector<TaskQueue> queues(nThreads);
+        for (size_t p = 0; p < points; ++p)
+            for (size_t r = 0; r < replicas; ++r)
+                queues[p % nThreads].tasks.push_back(Task{ p, r });
+
+        auto work = [&](size_t w) {
+            Worker m;
+            size_t victim = (w + 1) % nThreads;
+            Task t;
+            for (;;) {
+                bool found = queues[w].pop(t, true);
+                // steal from the last victim first: its points
+                // are the ones this thread has built
+                for (size_t i = 0; !found && i < nThreads; ++i) {
+                    size_t v = (victim + i) % nThreads;
+                    if (v != w && queues[v].pop(t, false)) {
+                        found = true;
+                        victim = v;
+                        ++steals;
+                    }
+                }
+                if (!found) break;
+
+                try {
+                    if (!m.ctx || m.point != t.point) {
+                        m.drop();
+                        m.ctx.reset(new SimContext());
+                        SimContext::Scope s(*m.ctx);
+                        m.ctx->disableProgress();
+                        RandomVar::setGenerator(gen.clone());
+                        m.ctx->_streamSeed = setup.streamSeed;
+                        m.ctx->_antitheticRuns = setup.antithetic;
+                        m.ctx->_transitory = setup.transitory;
+                        m.point = t.point;
+                        m.model = factory(Point(*this, t.point));
+                        ++builds;
+                        lock_guard<mutex> lock(statsMutex);
+                        if (_stats.empty())
+                            for (auto k = BaseStat::begin(); k != BaseStat::end(); ++k)
+                                _stats.push_back((*k)->getName());
+                    }
+
+                    SimContext::Scope s(*m.ctx);
+                    // replica r has the stream r of the generator
+                    // and the substreams of the run r
+                    StateArchive a(state);
+                    a.rewind();
+                    m.ctx->_pstdgen->restoreState(a);
+                    m.ctx->_pstdgen->stream(t.replica, replicas);
+                    m.ctx->_firstRun = t.replica;
+
+                    Simulation &sim = m.ctx->getSimulation();
+                    sim.initRuns(1);
+                    sim.singleRun(endTick);
+                    vector<double> &values = _results[t.point][t.replica];
+                    for (auto k = BaseStat::begin(); k != BaseStat::end(); ++k)
+                        values.push_back((*k)->getValue());
+                    executed += sim.execEvents;
+                } catch (...) {
+                    errors[t.point][t.replica] = current_exception();
+                    // the model may be in any state
+                    m.drop();
+                }
+            }
+        };
+
+        vector<thread> pool;
+        for (unsigned i = 1; i < nThreads; ++i) pool.push_back(thread(work, size_t(i)));
+        work(0);
+        for (auto &th : pool) th.join();
+
+        _executed = executed;
+        _builds = builds;
+        _steals = steals;
+        for (size_t p = 0; p < points; ++p)
+            for (size_t r = 0; r < replicas; ++r)
+                if (errors[p][r]) rethrow_exception(errors[p][r]);
+        for (size_t p = 0; p < points; ++p)
+            for (size_t r = 0; r < replicas; ++r)
+                if (_results[p][r].size() != _stats.size())
+                    throw Exc("Point " + to_string(p) + " has " +
+                              to_string(_results[p][r].size()) +
+                              " stats instead of " + to_string(_stats.size()));
+    }
+
+    const vector<double> &Sweep::getValues(size_t point, size_t replica) const
+    {
+        if (point >= _results.size() || replica >= _replicas)
+            throw Exc("No replica " + to_string(replica) + " of point " +
+                      to_string(point));
+        return _results[point][replica];
+    }
+
+    double Sweep::getMean(size_t point, size_t stat) const
+    {
+        double sum = 0;
+        for (size_t r = 0; r < _replicas; ++r) sum += getValues(point, r).at(stat);
+        return sum / double(_replicas);
+    }
+
+    double Sweep::getConfInterval(size_t point, size_t stat, double confidence) const
+    {
+        if (_replicas < 2) return 0;
+        const double mean = getMean(point, stat);
+        double ss = 0;
+        for (size_t r = 0; r < _replicas; ++r) {
+            double d = getValues(point, r).at(stat) - mean;
+            ss += d * d;
+        }
+        const double n = double(_replicas);
+        return BaseStat::tQuantile((1 + confidence) / 2, n - 1) *
+            sqrt(ss / (n - 1) / n);
+    }
+
+    void Sweep::writeCsv(ostream &os, double confidence) const
+    {
+        os << "point";
+        for (const string &n : _names) os << "," << quote(n);
+        os << ",replicas";
+        for (const string &s : _stats) os << "," << quote(s) << "," << quote(s + "_ci");
+        os << "\n";
+
+        char buf[32];
+        for (size_t p = 0; p < _results.size(); ++p) {
+            Point pt(*this, p);
+            os << p;
+            for (const string &n : _names) os << "," << quote(pt.get(n));
+            os << "," << _replicas;
+            for (size_t s = 0; s < _stats.size(); ++s) {
+                snprintf(buf, sizeof(buf), ",%.17g", getMean(p, s));
+                os << buf;
+                snprintf(buf, sizeof(buf), ",%.17g", getConfInterval(p, s, confidence));
+                os << buf;
+            }
+            os << "\n";
+        }
+    }
+
+    void Sweep::writeCsv(const string &path, double confidence) const
+    {
+        ofstream f(path.c_str());
+        if (!f) throw Exc("Cannot open " + path);
+        writeCsv(f, confidence);
+    }
+
+} // namespace MetaSim
@@ -0,0 +1,174 @@
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef __SWEEP_HPP__
+#define __SWEEP_HPP__
+
+#include <cstdint>
+#include <functional>
+#include <iosfwd>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <baseexc.hpp>
+#include <tick.hpp>
+
+namespace MetaSim {
+
+    /**
+       \ingroup metasim_ee
+
+       A parameter sweep: the replicas of every point of a factorial
+       grid of parameters, in parallel in this process. The tasks
+       (a replica of a point) are scheduled on a pool of threads by
+       work stealing: the points are dealt to the threads, every
+       thread performs the replicas of its points in order, and a
+       thread left without tasks steals the last one of another
+       thread, so a long point does not leave the others idle.
+
+       A thread keeps the model of the last point it built, in its
+       own context: the next replica of the same point runs on it
+       again (newRun() of the entities and initValue() of the stats
+       reset it, as between the runs of Simulation::run()), and a
+       new model is built only when the thread moves to another
+       point (see getBuilds()).
+
+       Replica r of every point has the stream r of the generator
+       of the current context, and the substreams of the sequential
+       run r, as in Simulation::run(Tick, int, const ModelFactory
+       &, unsigned): the results do not depend on the number of
+       threads, and the points are compared with common random
+       numbers. The values of the stats of every replica are kept
+       (getValues()), and writeCsv() writes them as one table, with
+       a row for each point.
+
+       @code
+       Sweep sweep;
+       sweep.add("rate", { 0.5, 0.7, 0.9 }).add("service", { "exp(1)", "unif(0,2)" });
+       sweep.run(100000, 30, [](const Sweep::Point &p) {
+           return buildModel(p.getDouble("rate"), p.get("service"));
+       });
+       sweep.writeCsv("sweep.csv");
+       @endcode
+
+       The stats of the models must be created in the same order at
+       every point. If a replica throws an exception, the first one
+       (in point and replica order) is rethrown after all threads
+       complete.
+    */
+    class Sweep {
+    public:
+        /**
+           \ingroup metasim_exc
+        */
+        class Exc : public BaseExc {
+        public:
+            Exc(const std::string &msg) :
+                BaseExc(msg, "Sweep", "sweep.hpp") {}
+        };
+
+        /// A point of the grid: a value for every parameter
+        class Point {
+            const Sweep *_sweep;
+            size_t _index;
+        public:
+            Point(const Sweep &s, size_t i) : _sweep(&s), _index(i) {}
+
+            /// The index of the point, from 0 (the last parameter
+            /// added changes first)
+            inline size_t index() const { return _index; }
+
+            /// The value of a parameter (Exc if unknown)
+            const std::string &get(const std::string &name) const;
+
+            /// The value of a parameter, as a number
+            double getDouble(const std::string &name) const;
+        };
+
+        /// Builds the model of a point, and returns an object that
+        /// owns it (see Simulation::ModelFactory)
+        typedef std::function<std::shared_ptr<void>(const Point &)> Factory;
+
+        Sweep();
+
+        /// Adds a parameter, with its values (not empty)
+        Sweep &add(const std::string &name, const std::vector<std::string> &values);
+        Sweep &add(const std::string &name, const std::vector<double> &values);
+
+        /// Number of points (the product of the numbers of values)
+        size_t getPoints() const;
+
+        inline Point getPoint(size_t i) const { return Point(*this, i); }
+
+        /// The names of the parameters, in order of addition
+        inline const std::vector<std::string> &getParams() const { return _names; }
+
+        /**
+           Performs the replicas of all the points.
+
+           @param length Length of each run.
+           @param replicas Number of replicas of each point.
+           @param factory Builds the model of a point.
+           @param nThreads Number of threads (0: one per hardware
+           thread).
+        */
+        void run(Tick length, size_t replicas, const Factory &factory,
+                 unsigned nThreads = 0);
+
+        /// The names of the stats of the models
+        inline const std::vector<std::string> &getStatNames() const { return _stats; }
+
+        /// The values of the stats in a replica of a point
+        const std::vector<double> &getValues(size_t point, size_t replica) const;
+
+        /// The mean of a stat over the replicas of a point
+        double getMean(size_t point, size_t stat) const;
+
+        /// The half width of the confidence interval of a stat at
+        /// a point (0 with less than 2 replicas)
+        double getConfInterval(size_t point, size_t stat,
+                               double confidence = 0.95) const;
+
+        /// Events executed by the last run()
+        inline uint64_t getExecutedEvents() const { return _executed; }
+
+        /// Models built by the last run()
+        inline size_t getBuilds() const { return _builds; }
+
+        /// Tasks stolen by the threads in the last run()
+        inline size_t getSteals() const { return _steals; }
+
+        /**
+           Writes the results as a CSV table: a row for each point,
+           with its index, the values of the parameters, the number
+           of replicas, and the mean and the half width of the
+           confidence interval of every stat ("<stat>" and
+           "<stat>_ci").
+        */
+        void writeCsv(std::ostream &os, double confidence = 0.95) const;
+        void writeCsv(const std::string &path, double confidence = 0.95) const;
+
+    private:
+        class Worker;
+
+        std::vector<std::string> _names;
+        std::vector<std::vector<std::string> > _values;
+
+        std::vector<std::string> _stats;
+        size_t _replicas;
+        // _results[point][replica]: the values of the stats
+        std::vector<std::vector<std::vector<double> > > _results;
+        uint64_t _executed;
+        size_t _builds;
+        size_t _steals;
+    };
+
+} // namespace MetaSim
+
+#endif
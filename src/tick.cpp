@@ -25,7 +25,11 @@ namespace MetaSim {
     using namespace parse_util;
 
     Tick::unit_t Tick::default_unit = Tick::nanosec;
+#ifdef METASIM_TICK_RESOLUTION
+    constexpr Tick::impl_t Tick::resolution;
+#else
     Tick::impl_t Tick::resolution = 1;
+#endif
 
     std::ostream& operator<<(std::ostream &os, const Tick &t1)
     {
@@ -37,37 +41,51 @@ namespace MetaSim {
         is >> t1.v; return is;
     }    
 
-    void Tick::set_resolution(const string &s) throw (ParseExc)
+    void Tick::set_resolution(const string &s)
     {        
-        string unit;
+        StrView unit;
         double num;
 
-        parse_double(s, num, unit);
+        parse_double(StrView(s), num, unit);
 
         if (unit != "s" && unit != "ms" && unit != "us" && unit != "ns") 
-            throw ParseExc("Tick::setDefaultUnit(const string()", unit);
+            throw ParseExc("Tick::setDefaultUnit(const string()", unit.str());
+
+        impl_t r = 0;
+        if (unit == "s") { r = (impl_t) (num * 1000000000);}
+        else if (unit == "ms")  { r = (impl_t) (num * 1000000); }
+        else if (unit == "us")  { r = (impl_t) (num * 1000); }
+        else if (unit == "ns")  { r = (impl_t) num ; } 
 
-        if (unit == "s") { resolution = (impl_t) (num * 1000000000);}
-        else if (unit == "ms")  { resolution = (impl_t) (num * 1000000); }
-        else if (unit == "us")  { resolution = (impl_t) (num * 1000); }
-        else if (unit == "ns")  { resolution = (impl_t) num ; } 
+#ifdef METASIM_TICK_RESOLUTION
+        // fixed at compile time: only the same value is accepted
+        if (r != resolution)
+            throw ParseExc("Tick::set_resolution(): fixed at compile time to", 
+                           to_string(resolution) + "ns");
+#else
+        resolution = r;
+#endif
     }
     
-    Tick::Tick(const string &s)
+    Tick::Tick(const string &s) : v(parse(StrView(s)).v) {}
+
+    Tick Tick::parse(StrView s)
     {
-        string unit;
+        StrView unit;
         double num;
 
         parse_double(s, num, unit);
 
         if (unit != "s" && unit != "ms" && unit != "us" && unit != "ns" && unit != "") 
-            throw ParseExc("Cannot understand time unit: ", unit);
+            throw ParseExc("Cannot understand time unit: ", unit.str());
 
+        impl_t v = 0;
         if (unit == "") { v = (impl_t)((num * default_unit) / resolution); }
         else if (unit == "s") { v = (impl_t)((num * 1000000000) / resolution);}
         else if (unit == "ms")  { v = (impl_t)((num * 1000000) / resolution); }
         else if (unit == "us")  { v = (impl_t)((num * 1000) / resolution); }
         else if (unit == "ns")  { v = (impl_t)((num) / resolution); }
+        return Tick(v);
     }
 
 
@@ -36,42 +36,55 @@
 #define MAXTICK INT64_MAX
 
 #define FRIEND_DECL_SYMM_OPS(RET, OP)  \
-        friend RET operator OP (const Tick &t1, const Tick &t2); \
-        friend RET operator OP (int64_t t1, const Tick &t2); \
-        friend RET operator OP (const Tick &t1, int64_t t2); \
-        friend RET operator OP (int32_t t1, const Tick &t2); \
-        friend RET operator OP (const Tick &t1, int32_t t2);
+        friend constexpr RET operator OP (const Tick &t1, const Tick &t2); \
+        friend constexpr RET operator OP (int64_t t1, const Tick &t2); \
+        friend constexpr RET operator OP (const Tick &t1, int64_t t2); \
+        friend constexpr RET operator OP (int32_t t1, const Tick &t2); \
+        friend constexpr RET operator OP (const Tick &t1, int32_t t2);
 
 #define FRIEND_DECL_ASYMM_OPS(RET, OP)  \
-        friend RET operator OP (const Tick &t1, int64_t t2); \
-        friend RET operator OP (const Tick &t1, int32_t t2);
+        friend constexpr RET operator OP (const Tick &t1, int64_t t2); \
+        friend constexpr RET operator OP (const Tick &t1, int32_t t2);
 
 
 #define IMPL_SYMM_OPS(RET, OP) \
-    inline RET operator OP(const Tick &t1, const Tick &t2) { \
-        return t1.v OP t2.v;                                 \
-    }                                                        \
-    inline RET operator OP(const Tick &t1, int64_t t2) {    \
-        return t1.v OP t2;                                   \
-    }                                                        \
-    inline RET operator OP(int64_t t1, const Tick &t2) {    \
-        return t1 OP t2.v;                                   \
-    }                                                        \
-    inline RET operator OP(const Tick &t1, int32_t t2) {    \
-        return t1.v OP t2;                                   \
-    }                                                        \
-    inline RET operator OP(int32_t t1, const Tick &t2) {    \
-        return t1 OP t2.v;                                   \
+    constexpr RET operator OP(const Tick &t1, const Tick &t2) { \
+        return RET(t1.v OP t2.v);                               \
+    }                                                           \
+    constexpr RET operator OP(const Tick &t1, int64_t t2) {     \
+        return RET(t1.v OP t2);                                 \
+    }                                                           \
+    constexpr RET operator OP(int64_t t1, const Tick &t2) {     \
+        return RET(t1 OP t2.v);                                 \
+    }                                                           \
+    constexpr RET operator OP(const Tick &t1, int32_t t2) {     \
+        return RET(t1.v OP t2);                                 \
+    }                                                           \
+    constexpr RET operator OP(int32_t t1, const Tick &t2) {     \
+        return RET(t1 OP t2.v);                                 \
     }
 
 #define IMPL_ASYMM_OPS(RET, OP) \
-    inline RET operator OP(const Tick &t1, int64_t t2) {    \
-        return t1.v OP t2;                                   \
-    }                                                        \
-    inline RET operator OP(const Tick &t1, int32_t t2) {    \
-        return t1.v OP t2;                                   \
+    constexpr RET operator OP(const Tick &t1, int64_t t2) {     \
+        return RET(t1.v OP t2);                                 \
+    }                                                           \
+    constexpr RET operator OP(const Tick &t1, int32_t t2) {     \
+        return RET(t1.v OP t2);                                 \
     }
 
+/*
+  The resolution of the ticks (nanoseconds per tick) can be fixed
+  at compile time with -DMETASIM_TICK_RESOLUTION=n (the CMake
+  option of the same name): then the conversions from the units
+  are constant expressions, and Tick::set_resolution() only
+  accepts n. Otherwise it is a variable, 1 by default.
+*/
+#ifdef METASIM_TICK_RESOLUTION
+#define METASIM_TICK_CONSTEXPR constexpr
+#else
+#define METASIM_TICK_CONSTEXPR inline
+#endif
+
 namespace MetaSim {
 
     DECL_EXC(NegativeTickException, "Tick");
@@ -85,7 +98,9 @@ namespace MetaSim {
 
        - automatic cast and conversion from basic types;
        - resolution specification (how many ticks in a second);
-       - conversion from string (with or specification of the unit measure);
+       - conversion from string (with or specification of the unit
+         measure), and from the literals of the units (10_ms, see
+         MetaSim::literals);
        - arithmetic operations and comparison;
        - conversions to string types (with specification of the unit of measure).
 
@@ -106,63 +121,87 @@ namespace MetaSim {
     private:
         impl_t v; // value
 
+#ifdef METASIM_TICK_RESOLUTION
+        static constexpr impl_t resolution = METASIM_TICK_RESOLUTION;
+#else
         static impl_t resolution;
+#endif
         static unit_t default_unit;
 
     public:
-        Tick() { v = 0; }
+        constexpr Tick() : v(0) {}
 // #if __WORDSIZE == 64
 //         Tick(long long int t) { v = t; }
 // #endif
-        Tick(impl_t t) { v = t; }
-        Tick(int32_t t) { v = t; }
+        constexpr Tick(impl_t t) : v(t) {}
+        constexpr Tick(int32_t t) : v(t) {}
 
         /// implementation in tick.pp
         Tick(const std::string &s);
 
+        /// The same, from a view (e.g. of a scenario file)
+        static Tick parse(parse_util::StrView s);
+
         /// explicit conversion with trunking
-        explicit Tick(double t) { v = (impl_t) t; }
+        explicit constexpr Tick(double t) : v(impl_t(t)) {}
 
-        /// rounding
-        /// FIXME: detect first if ::round() is available (e.g., VC2013)
-        #define xx_round(dbl) dbl >= 0.0 ? (int)(dbl + 0.5) : ((dbl - (double)(int)dbl) <= -0.5 ? (int)dbl : (int)(dbl - 0.5))
-        static Tick round(double t) { Tick q; q.v = (impl_t) xx_round(t); return q; }
+        /// rounding, half away from zero
+        static Tick round(double t) { return Tick(impl_t(std::llround(t))); }
 
         /// ceiling
-        static Tick ceil(double t) { Tick q; q.v = (impl_t) ::ceil(t); return q; }
+        static Tick ceil(double t) { return Tick(impl_t(std::ceil(t))); }
 
         /// floor
-        static Tick floor(double t) { Tick q; q.v = (impl_t) ::floor(t); return q; }
+        static Tick floor(double t) { return Tick(impl_t(std::floor(t))); }
+
+        /**
+           The ticks of a time in a unit (e.g. of 10 ms,
+           fromUnit(10, Tick::millisec)), truncated: a constant
+           expression if the resolution is fixed at compile time.
+        */
+        static METASIM_TICK_CONSTEXPR Tick fromUnit(long double n, unit_t u)
+        {
+            return Tick(impl_t(n * static_cast<long double>(u) / resolution));
+        }
+
+        /// The same, for an integer number of units, without rounding
+        static METASIM_TICK_CONSTEXPR Tick fromUnit(unsigned long long n, unit_t u)
+        {
+            return Tick(impl_t(n) * u / resolution);
+        }
+
+        /// The nanoseconds of a tick
+        static METASIM_TICK_CONSTEXPR impl_t getResolution() { return resolution; }
 
         // default assignment operator and copy constructor
 
-        Tick& operator+=(const Tick &t) { v += t.v; return *this; }
-        Tick& operator-=(const Tick &t) { v -= t.v; return *this; }
+        constexpr Tick& operator+=(const Tick &t) { v += t.v; return *this; }
+        constexpr Tick& operator-=(const Tick &t) { v -= t.v; return *this; }
 
-        Tick& operator*=(int64_t t) { v *= t; return *this; }
-        Tick& operator/=(int64_t t) { v /= t; return *this; }
+        constexpr Tick& operator*=(int64_t t) { v *= t; return *this; }
+        constexpr Tick& operator/=(int64_t t) { v /= t; return *this; }
 
         /// pre-increment
-        Tick& operator++() { v++; return *this; }
+        constexpr Tick& operator++() { v++; return *this; }
         /// post-increment
-        Tick operator++(int) { v++; return Tick(v-1); }
+        constexpr Tick operator++(int) { v++; return Tick(v-1); }
 
         /// pre-decrement
-        Tick& operator--() { v++; return *this; }
+        constexpr Tick& operator--() { v--; return *this; }
         /// post-decrement
-        Tick operator--(int) { v--; return Tick(v+1); }
+        constexpr Tick operator--(int) { v--; return Tick(v+1); }
 
         // automatic conversion to double
-        operator double() const { return (double) v; }
+        constexpr operator double() const { return (double) v; }
         /// automatic conversion to long long int
-        operator int64_t () const { return v; }
+        constexpr operator int64_t () const { return v; }
         /// automatic conversion to int
-        operator int32_t () const { return v; }
+        constexpr operator int32_t () const { return int32_t(v); }
 
         static void set_default_unit(Tick::unit_t d) { default_unit = d; }
 
         /// implementation in tick.pp
-        static void set_resolution(const std::string &t) throw (parse_util::ParseExc);
+        static void set_resolution(const std::string &t);
 
         FRIEND_DECL_SYMM_OPS(bool, <);
         FRIEND_DECL_SYMM_OPS(bool, <=);
@@ -177,7 +216,7 @@ namespace MetaSim {
 
         FRIEND_DECL_ASYMM_OPS(Tick, /);
 
-        friend Tick operator-(const Tick &t);
+        friend constexpr Tick operator-(const Tick &t);
 
         friend std::ostream& operator<<(std::ostream& os, const Tick &t1);
         friend std::istream& operator>>(std::istream& is, Tick &t1);
@@ -196,11 +235,44 @@ namespace MetaSim {
 
     IMPL_ASYMM_OPS(Tick, /);
 
-    inline Tick operator-(const Tick &t) { return Tick(-t.v); }
+    constexpr Tick operator-(const Tick &t) { return Tick(-t.v); }
 
     std::ostream& operator<<(std::ostream &os, const Tick &t1);
     std::istream& operator>>(std::istream &is, Tick &t1);
 
+    /**
+       \ingroup metasim_ee
+
+       Literals of the units of time: 10_ms is Tick::fromUnit(10,
+       Tick::millisec), so a time in a model is converted once, at
+       compile time if the resolution is fixed (see
+       METASIM_TICK_RESOLUTION), instead of parsing Tick("10ms").
+
+       @code
+       using namespace MetaSim::literals;
+       arrival.post(SIMUL.getTime() + 250_us);
+       @endcode
+    */
+    namespace literals {
+        METASIM_TICK_CONSTEXPR Tick operator"" _s(unsigned long long n)
+        { return Tick::fromUnit(n, Tick::sec); }
+        METASIM_TICK_CONSTEXPR Tick operator"" _ms(unsigned long long n)
+        { return Tick::fromUnit(n, Tick::millisec); }
+        METASIM_TICK_CONSTEXPR Tick operator"" _us(unsigned long long n)
+        { return Tick::fromUnit(n, Tick::microsec); }
+        METASIM_TICK_CONSTEXPR Tick operator"" _ns(unsigned long long n)
+        { return Tick::fromUnit(n, Tick::nanosec); }
+
+        METASIM_TICK_CONSTEXPR Tick operator"" _s(long double n)
+        { return Tick::fromUnit(n, Tick::sec); }
+        METASIM_TICK_CONSTEXPR Tick operator"" _ms(long double n)
+        { return Tick::fromUnit(n, Tick::millisec); }
+        METASIM_TICK_CONSTEXPR Tick operator"" _us(long double n)
+        { return Tick::fromUnit(n, Tick::microsec); }
+        METASIM_TICK_CONSTEXPR Tick operator"" _ns(long double n)
+        { return Tick::fromUnit(n, Tick::nanosec); }
+    }
+
 } // namespace MetaSim
 
 #endif
@@ -0,0 +1,137 @@
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#include <cstdio>
+
+#include <entity.hpp>
+#include <timeline.hpp>
+
+namespace MetaSim {
+
+    using namespace std;
+
+    namespace {
+        string quote(const string &s)
+        {
+            string q = "\"";
+            for (char c : s) {
+                if (c == '"' || c == '\\') {
+                    q += '\\';
+                    q += c;
+                }
+                else if ((unsigned char)c < 0x20) {
+                    char buf[8];
+                    snprintf(buf, sizeof(buf), "\\u%04x", c);
+                    q += buf;
+                }
+                else q += c;
+            }
+            return q + '"';
+        }
+
+        double micros(Timeline::Clock::duration d)
+        {
+            return chrono::duration<double, micro>(d).count();
+        }
+    }
+
+    Timeline::Timeline(const string &path) :
+        _path(path), _out(path.c_str()), _first(true), _start(Clock::now()),
+        _from(0), _to(MAXTICK), _every(1), _seen(0), _maxSpans(0),
+        _spans(0), _run(0), _buffer(), _names(), _byEntity(), _entities()
+    {
+        if (!_out) throw Exc("Cannot open " + path);
+        _buffer.reserve(BUFFER);
+        _out << "[\n";
+    }
+
+    Timeline::~Timeline()
+    {
+        flush();
+    }
+
+    void Timeline::setWindow(Tick from, Tick to)
+    {
+        if (to <= from) throw Exc("The window of the timeline is empty");
+        _from = from;
+        _to = to;
+    }
+
+    void Timeline::setSampling(uint64_t n)
+    {
+        _every = n == 0 ? 1 : n;
+    }
+
+    void Timeline::startRun()
+    {
+        flush();
+        ++_run;
+        // the viewers name the thread of the run
+        _out << (_first ? "" : ",\n")
+             << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": "
+             << _run << ", \"args\": {\"name\": \"run " << _run - 1 << "\"}}";
+        _first = false;
+    }
+
+    void Timeline::record(size_t name, const string &label, const Entity *entity,
+                          Tick t, size_t queueSize, Clock::time_point begin,
+                          Clock::time_point probes, Clock::time_point end)
+    {
+        if (name >= _names.size()) _names.resize(name + 1);
+        if (_names[name].empty()) _names[name] = label;
+
+        uint32_t ent = 0;
+        if (entity != NULL) {
+            auto i = _byEntity.find(entity);
+            if (i == _byEntity.end()) {
+                _entities.push_back(entity->getName());
+                i = _byEntity.emplace(entity, uint32_t(_entities.size())).first;
+            }
+            ent = i->second;
+        }
+
+        Span s;
+        s.begin = micros(begin - _start);
+        s.dur = micros(end - begin);
+        s.probe = micros(end - probes);
+        s.tick = int64_t(t);
+        s.name = uint32_t(name);
+        s.entity = ent;
+        s.queue = uint32_t(queueSize);
+        s.run = _run;
+        _buffer.push_back(s);
+        ++_spans;
+        if (_buffer.size() >= BUFFER) flush();
+    }
+
+    void Timeline::flush()
+    {
+        char buf[64];
+        for (const Span &s : _buffer) {
+            _out << (_first ? "" : ",\n") << "{\"name\": " << quote(_names[s.name])
+                 << ", \"cat\": \"event\", \"ph\": \"X\"";
+            snprintf(buf, sizeof(buf), ", \"ts\": %.3f, \"dur\": %.3f", s.begin, s.dur);
+            _out << buf << ", \"pid\": 1, \"tid\": " << s.run << ", \"args\": {";
+            if (s.entity != 0)
+                _out << "\"entity\": " << quote(_entities[s.entity - 1]) << ", ";
+            snprintf(buf, sizeof(buf), "%.3f", s.probe);
+            _out << "\"tick\": " << s.tick << ", \"queue\": " << s.queue
+                 << ", \"probe_us\": " << buf << "}}";
+            _first = false;
+        }
+        _buffer.clear();
+        // the array is terminated after every flush, and the end
+        // is overwritten by the next spans: the file is always
+        // valid JSON, even if the timeline is never destroyed
+        // (e.g. in the default context)
+        _out << "\n]\n";
+        _out.flush();
+        _out.seekp(-3, ios::cur);
+    }
+
+} // namespace MetaSim
@@ -0,0 +1,155 @@
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef __TIMELINE_HPP__
+#define __TIMELINE_HPP__
+
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <baseexc.hpp>
+#include <tick.hpp>
+
+namespace MetaSim {
+
+    class Entity;
+
+    /**
+       \ingroup metasim_ee
+
+       A timeline of the executed events, in the JSON format of the
+       Chrome trace viewer (chrome://tracing) and of Perfetto
+       (ui.perfetto.dev): a span of wall time for every event, from
+       the start of its doit() to the end of its particle probes,
+       labelled with the type of the event (or its tag, see
+       Profiler::setTag()) and carrying the name of its entity (see
+       Event::getEntity()), the simulated time, the size of the
+       queue and the time spent in the probes. The runs are shown as
+       separate threads. Where the aggregate counters of the
+       Profiler tell which events are slow on average, the timeline
+       shows when: e.g. a stretch of simulated time where a model
+       goes through a storm of short events.
+
+       The timeline is recorded by the profiler, which measures the
+       events anyway: it is enabled with Profiler::enableTimeline(),
+       or in the default context by setting the environment
+       variable METASIM_TIMELINE to the name of the file (which
+       enables the profiler too):
+
+       @code
+       SimContext::getDefault().enableProfiler();
+       Timeline &t = SimContext::getDefault().getProfiler()->enableTimeline("trace.json");
+       t.setWindow(50000, 60000);
+       t.setSampling(10);
+       SIMUL.run(100000);
+       @endcode
+
+       On long runs, a window of simulated time, a sampling of one
+       event every n and a maximum number of spans keep the file
+       small; the events outside them cost a comparison. The spans
+       are buffered and written every BUFFER spans and at the end
+       of every run, and the file is a complete JSON array after
+       every write.
+    */
+    class Timeline {
+    public:
+        /**
+           \ingroup metasim_exc
+        */
+        class Exc : public BaseExc {
+        public:
+            Exc(const std::string &msg) :
+                BaseExc(msg, "Timeline", "timeline.hpp") {}
+        };
+
+        typedef std::chrono::steady_clock Clock;
+
+        /// Spans kept in memory before they are written
+        static const size_t BUFFER = 4096;
+
+        /// Opens the file (Exc if it cannot)
+        explicit Timeline(const std::string &path);
+
+        ~Timeline();
+
+        inline const std::string &getFile() const { return _path; }
+
+        /// Records only the events of simulated time in [from, to)
+        void setWindow(Tick from, Tick to);
+
+        /// Records one event every n, among those in the window
+        void setSampling(uint64_t n);
+
+        /// Stops recording after n spans (0: no limit)
+        inline void setMaxSpans(uint64_t n) { _maxSpans = n; }
+
+        /// Spans recorded so far
+        inline uint64_t getSpans() const { return _spans; }
+
+        /// Writes the buffered spans to the file
+        void flush();
+
+        /// \name Profiler interface
+        //@{
+        /// The event at time t is to be recorded
+        inline bool accept(Tick t) {
+            if (t < _from || t >= _to) return false;
+            if (_maxSpans != 0 && _spans >= _maxSpans) return false;
+            return _seen++ % _every == 0;
+        }
+
+        /// Records an event, of entry name in the profiler, that
+        /// started at begin and ran its probes from probes to end
+        void record(size_t name, const std::string &label,
+                    const Entity *entity, Tick t, size_t queueSize,
+                    Clock::time_point begin, Clock::time_point probes,
+                    Clock::time_point end);
+
+        /// A new run starts
+        void startRun();
+        //@}
+
+    private:
+        struct Span {
+            double begin;       // microseconds from the start
+            double dur;
+            double probe;
+            int64_t tick;
+            uint32_t name;
+            uint32_t entity;
+            uint32_t queue;
+            uint32_t run;
+        };
+
+        std::string _path;
+        std::ofstream _out;
+        bool _first;
+        Clock::time_point _start;
+
+        Tick _from, _to;
+        uint64_t _every;
+        uint64_t _seen;
+        uint64_t _maxSpans;
+        uint64_t _spans;
+        uint32_t _run;
+
+        std::vector<Span> _buffer;
+        // the labels of the entries of the profiler, and the names
+        // of the entities, by index
+        std::vector<std::string> _names;
+        std::unordered_map<const Entity *, uint32_t> _byEntity;
+        std::vector<std::string> _entities;
+    };
+
+} // namespace MetaSim
+
+#endif
@@ -0,0 +1,592 @@
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#include <algorithm>
+#include <deque>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <typeinfo>
+#include <unordered_set>
+
+#include <basestat.hpp>
+#include <entity.hpp>
+#include <event.hpp>
+#include <lpsync.hpp>
+#include <randomvar.hpp>
+#include <simul.hpp>
+#include <statearchive.hpp>
+#include <timewarp.hpp>
+
+namespace MetaSim {
+
+    using namespace std;
+
+    /**
+       Executes, in the destination LP, an event posted by another
+       LP. It is an ordinary event of the destination LP, so it is
+       saved in the checkpoints and rolled back with the other ones;
+       the event it delivers is never queued.
+    */
+    class TimeWarpSimulation::Delivery : public Event {
+    public:
+        Event *target;
+        bool disp;
+        uint64_t id;
+        // order of arrival in the destination LP
+        uint64_t seq;
+
+        Delivery(Event *e, bool d, uint64_t i, uint64_t s) :
+            Event(e->getPriority()), target(e), disp(d), id(i), seq(s) {}
+
+        virtual void doit() { TimeWarpSimulation::fire(target, getTime()); }
+    };
+
+    /// The state of a logical process
+    struct TimeWarpSimulation::LP {
+        struct Queued {
+            Event *e;
+            Tick t;
+            unsigned long order;
+            Event::SortKey key;
+            int priority;
+            bool disp;
+            // message id, if it is a Delivery (0 otherwise)
+            uint64_t msg;
+        };
+
+        struct Checkpoint {
+            // index in the log of the first event executed after
+            // the checkpoint
+            size_t logIdx;
+            bool hasLvt;
+            Tick lvt;
+            Tick now;
+            long counter;
+            RandomGen *gen;
+            uint64_t inputSeq;
+            vector<Queued> queue;
+            StateArchive state;
+        };
+
+        struct Processed {
+            Event *e;
+            Tick t;
+            // messages sent by the event
+            vector<Message> sent;
+        };
+
+        unique_ptr<SimContext> ctx;
+
+        // events executed since the oldest checkpoint
+        deque<Processed> log;
+        size_t logBase;
+        deque<Checkpoint> ckpts;
+        size_t sinceCkpt;
+
+        // received messages that can still be cancelled or
+        // rolled back, by message id
+        map<uint64_t, Delivery *> inputs;
+        uint64_t inputSeq;
+        uint64_t sendSeq;
+
+        // time of the last executed event (local virtual time)
+        bool hasLvt;
+        Tick lvt;
+
+        LP() : ctx(new SimContext()), log(), logBase(0), ckpts(),
+               sinceCkpt(0), inputs(), inputSeq(0), sendSeq(0),
+               hasLvt(false), lvt(0) {}
+    };
+
+    namespace {
+        // orders of the messages, after the ones of the local events
+        const unsigned long DELIVERY_ORDER = 1UL << 47;
+    }
+
+    TimeWarpSimulation::TimeWarpSimulation(size_t nLP) :
+        _lps(), _index(), _outbox(nLP), _errors(nLP), _barrier(),
+        _batch(256), _window(MAXTICK), _interval(16),
+        _inRound(false), _coasting(false), _done(false), _endTick(0), _bound(0),
+        _rounds(0), _rollbacks(0), _antiMessages(0)
+    {
+        if (nLP == 0) throw Exc("At least one logical process is needed");
+        for (size_t i = 0; i < nLP; ++i) {
+            _lps.push_back(unique_ptr<LP>(new LP()));
+            _lps[i]->ctx->setRouter(this);
+            _index[_lps[i]->ctx.get()] = i;
+        }
+    }
+
+    TimeWarpSimulation::~TimeWarpSimulation()
+    {
+        for (auto &lp : _lps) lp->ctx->setRouter(nullptr);
+    }
+
+    SimContext &TimeWarpSimulation::getLP(size_t i)
+    {
+        if (i >= _lps.size()) throw Exc("Wrong logical process index");
+        return *_lps[i]->ctx;
+    }
+
+    void TimeWarpSimulation::setBatch(size_t n)
+    {
+        if (n == 0) throw Exc("The batch must contain at least one event");
+        _batch = n;
+    }
+
+    void TimeWarpSimulation::setWindow(Tick w)
+    {
+        if (w < 1) throw Exc("The window must be at least 1 tick");
+        _window = w;
+    }
+
+    void TimeWarpSimulation::setCheckpointInterval(size_t n)
+    {
+        if (n == 0) throw Exc("The checkpoint interval must be positive");
+        _interval = n;
+    }
+
+    void TimeWarpSimulation::fire(Event *e, Tick t)
+    {
+        e->_time = t;
+        e->action();
+    }
+
+    void TimeWarpSimulation::route(SimContext &from, Event *e, Tick t, bool disp)
+    {
+        // outside of the rounds (e.g. in newRun()), everything
+        // is sequential: post it directly
+        if (!_inRound) {
+            SimContext::Scope s(e->getContext());
+            e->post(t, disp);
+            return;
+        }
+
+        // while coasting forward, the messages have already been sent
+        if (_coasting) return;
+
+        auto i = _index.find(&from);
+        if (i == _index.end())
+            throw Exc("Posting an event in a logical process from outside");
+        size_t src = i->second;
+        size_t dst = _index.at(&e->getContext());
+
+        Tick now = from.getSimulation().getTime();
+        if (t < now) {
+            stringstream str;
+            str << "Time: " << now << " -- Posting event "
+                << typeid(*e).name() << " from LP " << src
+                << " to LP " << dst << " in the past at time " << t;
+            throw Exc(str.str());
+        }
+        LP &lp = *_lps[src];
+        Message m = { false, e, t, disp, dst, src,
+                      (uint64_t(src) << 48) | ++lp.sendSeq };
+        _outbox[src].push_back(m);
+        lp.log.back().sent.push_back(m);
+    }
+
+    Tick TimeWarpSimulation::nextTime(size_t i)
+    {
+        Event *f = _lps[i]->ctx->firstEvent();
+        return f == NULL ? Tick(MAXTICK) : f->getTime();
+    }
+
+    void TimeWarpSimulation::checkpoint(LP &lp)
+    {
+        SimContext &c = *lp.ctx;
+        lp.ckpts.push_back(LP::Checkpoint());
+        LP::Checkpoint &cp = lp.ckpts.back();
+
+        cp.logIdx = lp.logBase + lp.log.size();
+        cp.hasLvt = lp.hasLvt;
+        cp.lvt = lp.lvt;
+        cp.now = c.getSimulation().getTime();
+        cp.counter = c._eventCounter;
+        cp.gen = c._pstdgen;
+        cp.inputSeq = lp.inputSeq;
+
+        vector<Event *> v;
+        c.getEventQueue().dump(v);
+        cp.queue.reserve(v.size());
+        for (Event *e : v) {
+            if (e->_cancelled) continue;
+            Delivery *d = dynamic_cast<Delivery *>(e);
+            LP::Queued q = { e, e->_time, e->_order, e->_key, e->_priority,
+                             e->_disposable, d != NULL ? d->id : 0 };
+            cp.queue.push_back(q);
+        }
+
+        cp.gen->saveState(cp.state);
+        for (Entity *e : c._entities) if (e) e->saveState(cp.state);
+        for (BaseStat *s : c._stats) s->saveState(cp.state);
+
+        lp.sinceCkpt = 0;
+    }
+
+    void TimeWarpSimulation::rollback(size_t i, Tick t)
+    {
+        LP &lp = *_lps[i];
+        SimContext &c = *lp.ctx;
+        SimContext::Scope s(c);
+        EventQueue &q = c.getEventQueue();
+
+        // the last checkpoint taken before executing any event
+        // at time t or later
+        size_t k = lp.ckpts.size();
+        while (k > 0 && lp.ckpts[k - 1].hasLvt && !(lp.ckpts[k - 1].lvt < t)) --k;
+        if (k == 0) throw Exc("No checkpoint to roll back to");
+        LP::Checkpoint &cp = lp.ckpts[k - 1];
+
+        // the events executed after the checkpoint and earlier than
+        // t are executed again, without sending their messages
+        // (coasting forward); the others are undone, and the
+        // messages they sent are cancelled
+        size_t first = cp.logIdx - lp.logBase, split = first;
+        while (split < lp.log.size() && lp.log[split].t < t) ++split;
+        for (size_t j = split; j < lp.log.size(); ++j)
+            for (Message m : lp.log[j].sent) {
+                m.anti = true;
+                _outbox[i].push_back(m);
+                ++_antiMessages;
+            }
+        vector<vector<Message> > coast;
+        for (size_t j = first; j < split; ++j) coast.push_back(move(lp.log[j].sent));
+
+        // the disposable events that may be dead after the
+        // rollback: they are destroyed, unless they are restored
+        unordered_set<Event *> dead;
+        vector<Event *> v;
+        q.dump(v);
+        q.clear();
+        for (Event *e : v) {
+            // a cancelled event belongs to the model, as a dropped one
+            if (e->_disposable && !e->_cancelled) dead.insert(e);
+            e->_isInQueue = false;
+            e->_cancelled = false;
+        }
+        for (size_t j = first; j < lp.log.size(); ++j)
+            if (lp.log[j].e->_disposable) dead.insert(lp.log[j].e);
+        lp.log.erase(lp.log.begin() + first, lp.log.end());
+
+        // restore the state
+        c.getSimulation().setTime(cp.now);
+        c._eventCounter = cp.counter;
+        c._pstdgen = cp.gen;
+        cp.state.rewind();
+        c._pstdgen->restoreState(cp.state);
+        for (Entity *e : c._entities) if (e) e->restoreState(cp.state);
+        for (BaseStat *st : c._stats) st->restoreState(cp.state);
+
+        // restore the queue, without the cancelled messages...
+        for (auto &qe : cp.queue) {
+            if (qe.msg != 0 && lp.inputs.find(qe.msg) == lp.inputs.end())
+                continue;
+            Event *e = qe.e;
+            e->_time = qe.t;
+            e->_order = qe.order;
+            e->_key = qe.key;
+            e->_priority = qe.priority;
+            e->_disposable = qe.disp;
+            q.insert(e);
+            e->_isInQueue = true;
+        }
+        // ... and with the messages received after the checkpoint
+        for (auto &in : lp.inputs) {
+            Delivery *d = in.second;
+            if (d->seq >= cp.inputSeq) {
+                q.insert(d);
+                d->_isInQueue = true;
+            }
+        }
+
+        lp.hasLvt = cp.hasLvt;
+        lp.lvt = cp.lvt;
+        lp.sinceCkpt = 0;
+        lp.ckpts.erase(lp.ckpts.begin() + k, lp.ckpts.end());
+
+        _coasting = true;
+        try {
+            for (auto &sent : coast) {
+                Event *e = c.firstEvent();
+                if (e == NULL || !(e->getTime() < t))
+                    throw Exc("The events executed again differ from the original ones");
+                execute(lp, e);
+                lp.log.back().sent = move(sent);
+            }
+        } catch (...) {
+            _coasting = false;
+            throw;
+        }
+        _coasting = false;
+
+        unordered_set<Event *> live;
+        v.clear();
+        q.dump(v);
+        for (Event *e : v)
+            if (!e->_cancelled) live.insert(e);
+        for (size_t j = first; j < lp.log.size(); ++j) live.insert(lp.log[j].e);
+        for (Event *e : dead)
+            if (live.find(e) == live.end()) e->dispose();
+
+        ++_rollbacks;
+    }
+
+    void TimeWarpSimulation::cancel(Delivery *d)
+    {
+        d->drop();
+        if (d->disp) d->target->dispose();
+        d->dispose();
+    }
+
+    void TimeWarpSimulation::receive(const Message &m)
+    {
+        LP &lp = *_lps[m.dst];
+        SimContext::Scope s(*lp.ctx);
+
+        if (m.anti) {
+            auto p = lp.inputs.find(m.id);
+            if (p == lp.inputs.end())
+                throw Exc("Anti-message of an unknown message");
+            Delivery *d = p->second;
+            lp.inputs.erase(p);
+            // already executed: undo it (it is not restored,
+            // since it is no longer an input)
+            if (!d->isInQueue()) rollback(m.dst, d->getTime());
+            cancel(d);
+            return;
+        }
+
+        // a straggler
+        if (lp.hasLvt && !(lp.lvt < m.t)) rollback(m.dst, m.t);
+
+        Delivery *d = Event::create<Delivery>(m.e, m.disp, m.id, lp.inputSeq++);
+        lp.inputs[m.id] = d;
+        // the order of a message does not depend on the local
+        // event counter, so the key is the same if the message
+        // is re-inserted by a rollback, and the events executed
+        // again are the same
+        d->_time = m.t;
+        d->_order = DELIVERY_ORDER + d->seq;
+        d->updateKey();
+        lp.ctx->getEventQueue().insert(d);
+        d->_isInQueue = true;
+    }
+
+    void TimeWarpSimulation::deliver()
+    {
+        // the rollbacks send anti-messages, which can cause other
+        // rollbacks: go on until nothing is left in transit
+        while (true) {
+            vector<Message> msgs;
+            for (auto &o : _outbox) {
+                msgs.insert(msgs.end(), o.begin(), o.end());
+                o.clear();
+            }
+            if (msgs.empty()) break;
+
+            sort(msgs.begin(), msgs.end(), [](const Message &a, const Message &b) {
+                    if (a.t != b.t) return a.t < b.t;
+                    if (a.src != b.src) return a.src < b.src;
+                    if (a.id != b.id) return a.id < b.id;
+                    return a.anti && !b.anti;
+                });
+            for (auto &m : msgs) {
+                if (_errors[m.dst]) continue;
+                try {
+                    receive(m);
+                } catch (...) {
+                    _errors[m.dst] = current_exception();
+                }
+            }
+        }
+    }
+
+    void TimeWarpSimulation::commit(LP &lp, Event *e)
+    {
+        Delivery *d = dynamic_cast<Delivery *>(e);
+        if (d != NULL) {
+            lp.inputs.erase(d->id);
+            cancel(d);
+        }
+        else if (e->_disposable && !e->_isInQueue) e->dispose();
+    }
+
+    void TimeWarpSimulation::fossilCollect(LP &lp, Tick gvt)
+    {
+        // no LP will ever roll back earlier than the GVT: keep only
+        // the last checkpoint before it, and commit the events
+        // executed before that checkpoint
+        size_t k = 0;
+        while (k + 1 < lp.ckpts.size() &&
+               (!lp.ckpts[k + 1].hasLvt || lp.ckpts[k + 1].lvt < gvt)) ++k;
+        lp.ckpts.erase(lp.ckpts.begin(), lp.ckpts.begin() + k);
+
+        size_t upto = lp.ckpts.front().logIdx;
+        while (lp.logBase < upto) {
+            commit(lp, lp.log.front().e);
+            lp.log.pop_front();
+            ++lp.logBase;
+        }
+    }
+
+    void TimeWarpSimulation::computeGvt()
+    {
+        Tick gvt = MAXTICK;
+        bool error = false;
+        for (size_t i = 0; i < _lps.size(); ++i) {
+            gvt = min(gvt, nextTime(i));
+            if (_errors[i]) error = true;
+        }
+        _done = error || !(gvt < _endTick);
+        if (_done) return;
+
+        for (auto &lp : _lps) fossilCollect(*lp, gvt);
+        _bound = min(_endTick, addSat(gvt, _window));
+        ++_rounds;
+    }
+
+    // like Simulation::sim_step(), but the disposable events are
+    // destroyed only when committed
+    void TimeWarpSimulation::execute(LP &lp, Event *e)
+    {
+        e->extract();
+        lp.log.push_back(LP::Processed());
+        lp.log.back().e = e;
+        lp.log.back().t = e->getTime();
+        lp.hasLvt = true;
+        lp.lvt = e->getTime();
+        ++lp.sinceCkpt;
+
+        lp.ctx->getSimulation().setTime(e->getTime());
+        e->action();
+    }
+
+    void TimeWarpSimulation::advance(size_t i)
+    {
+        LP &lp = *_lps[i];
+
+        for (size_t n = 0; n < _batch; ++n) {
+            Event *e = lp.ctx->firstEvent();
+            if (e == NULL || !(e->getTime() < _bound)) break;
+            if (lp.sinceCkpt >= _interval) checkpoint(lp);
+            execute(lp, e);
+        }
+    }
+
+    void TimeWarpSimulation::worker(size_t i)
+    {
+        SimContext::Scope s(*_lps[i]->ctx);
+
+        while (true) {
+            _barrier->wait();
+            if (_done) break;
+
+            if (!_errors[i]) {
+                try {
+                    advance(i);
+                } catch (...) {
+                    _errors[i] = current_exception();
+                }
+            }
+
+            _barrier->wait();
+            if (i == 0) {
+                deliver();
+                computeGvt();
+            }
+        }
+    }
+
+    void TimeWarpSimulation::finish()
+    {
+        // everything before the end of the simulation is committed
+        for (auto &lp : _lps) {
+            while (!lp->log.empty()) {
+                commit(*lp, lp->log.front().e);
+                lp->log.pop_front();
+            }
+            lp->logBase = 0;
+            lp->ckpts.clear();
+        }
+        for (auto &o : _outbox) o.clear();
+    }
+
+    void TimeWarpSimulation::singleRun()
+    {
+        size_t n = _lps.size();
+
+        for (auto &lp : _lps) {
+            lp->ctx->getSimulation().initSingleRun();
+            SimContext::Scope s(*lp->ctx);
+            lp->hasLvt = false;
+            lp->lvt = 0;
+            checkpoint(*lp);
+        }
+
+        _barrier.reset(new LPBarrier(n));
+        computeGvt();
+        _inRound = true;
+        vector<thread> th;
+        for (size_t i = 1; i < n; ++i)
+            th.push_back(thread(&TimeWarpSimulation::worker, this, i));
+        worker(0);
+        for (auto &t : th) t.join();
+        _inRound = false;
+
+        finish();
+
+        exception_ptr err;
+        for (size_t i = 0; i < n && !err; ++i) err = _errors[i];
+
+        // like the sequential engine, execute the first event
+        // at or after the end of the simulation
+        if (!err) {
+            size_t first = n;
+            Event *fe = NULL;
+            for (size_t i = 0; i < n; ++i) {
+                Event *f = _lps[i]->ctx->firstEvent();
+                if (f == NULL) continue;
+                if (fe == NULL || f->getTime() < fe->getTime() ||
+                    (f->getTime() == fe->getTime() &&
+                     f->getPriority() < fe->getPriority())) {
+                    fe = f;
+                    first = i;
+                }
+            }
+            if (fe != NULL) _lps[first]->ctx->getSimulation().sim_step();
+        }
+
+        // the messages still pending are never executed
+        for (auto &lp : _lps) {
+            SimContext::Scope s(*lp->ctx);
+            for (auto &in : lp->inputs) cancel(in.second);
+            lp->inputs.clear();
+            lp->ctx->getSimulation().endSingleRun();
+        }
+
+        if (err) {
+            fill(_errors.begin(), _errors.end(), exception_ptr());
+            rethrow_exception(err);
+        }
+    }
+
+    void TimeWarpSimulation::run(Tick endTick, int runs)
+    {
+        if (runs < 1) throw Exc("The number of runs must be positive");
+        if (runs == 2) runs = 3;
+
+        _endTick = endTick;
+        _rounds = _rollbacks = _antiMessages = 0;
+        for (auto &lp : _lps) lp->ctx->getSimulation().initRuns(runs);
+        for (int r = 0; r < runs; ++r) singleRun();
+        for (auto &lp : _lps) lp->ctx->getSimulation().endSim();
+    }
+
+} // namespace MetaSim
@@ -0,0 +1,199 @@
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef __TIMEWARP_HPP__
+#define __TIMEWARP_HPP__
+
+#include <cstdint>
+#include <exception>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include <baseexc.hpp>
+#include <basetype.hpp>
+#include <simcontext.hpp>
+
+namespace MetaSim {
+
+    class Event;
+    class LPBarrier;
+
+    /**
+       \ingroup metasim_ee
+
+       Optimistic parallel simulation engine, based on the Time Warp
+       protocol (Jefferson, 1985).
+
+       As in ParallelSimulation, the model is partitioned into
+       logical processes (LP), each one a SimContext executed by its
+       own thread, but no lookahead is needed: every LP executes its
+       events speculatively, and when it receives an event earlier
+       than the ones it has already executed (a straggler) it rolls
+       back to a previous state and executes them again. The events
+       it had posted in other LPs in the meantime are cancelled by
+       sending anti-messages, which may cause further rollbacks.
+
+       To roll back, each LP periodically takes a checkpoint (see
+       setCheckpointInterval()) of its event queue, of its clock, of
+       its default random generator, and of the state of its
+       entities and statistics, which is saved with
+       Entity::saveState() and BaseStat::saveState(). Therefore, the
+       entities of a model executed by this engine must redefine
+       saveState() and restoreState() to save all the members
+       modified by their event handlers. Other random generators
+       than the default one must be saved by the entities that use
+       them.
+
+       @code
+       TimeWarpSimulation tw(2);
+       {
+           SimContext::Scope s(tw.getLP(0));
+           // create the entities of LP 0
+       }
+       // same for LP 1
+       tw.run(100000);
+       @endcode
+
+       The simulation proceeds in rounds. In each round, every LP
+       executes at most getBatch() events earlier than GVT + window
+       (see setWindow()), where the global virtual time GVT is the
+       time of the first pending event of all LPs. At the end of the
+       round all the messages are delivered and the stragglers are
+       rolled back, in an order that only depends on the model, so
+       the simulation is deterministic. Then the GVT is computed
+       again, and the history older than it is committed (fossil
+       collection): disposable events are destroyed and the useless
+       checkpoints are freed.
+
+       Since the statistics are part of the saved state, the values
+       recorded by rolled back events are undone, and at the end of
+       the run they only contain the values of the committed
+       events. Traces and other probes with side effects out of the
+       model are not undone, and should not be used with this
+       engine.
+
+       An event posted in another LP is executed, at the right time,
+       by an internal event of the destination LP, so it is never
+       inserted in the destination queue: as in ParallelSimulation,
+       the event must not be posted or dropped by its own LP while
+       it is pending.
+
+       The execution is equivalent to the sequential
+       Simulation::run(), except for the order of simultaneous
+       events with equal priority coming from different LPs: the
+       events coming from other LPs are executed after the local
+       ones.
+    */
+    class TimeWarpSimulation : public EventRouter {
+    public:
+        /**
+           \ingroup metasim_exc
+        */
+        class Exc : public BaseExc {
+        public:
+            Exc(const std::string &msg) :
+                BaseExc(msg, "TimeWarpSimulation", "timewarp.cpp") {}
+        };
+
+        /// Creates nLP logical processes
+        explicit TimeWarpSimulation(size_t nLP);
+        ~TimeWarpSimulation();
+
+        /// Number of logical processes
+        inline size_t getLPNum() const { return _lps.size(); }
+
+        /// Returns the context of the i-th logical process
+        SimContext &getLP(size_t i);
+
+        /// Maximum number of events executed by each LP in a round
+        /// (default 256)
+        void setBatch(size_t n);
+        inline size_t getBatch() const { return _batch; }
+
+        /// Maximum distance from the GVT of the events executed
+        /// in a round (default: no limit)
+        void setWindow(Tick w);
+
+        /// Number of events executed between two checkpoints of
+        /// the same LP (default 16)
+        void setCheckpointInterval(size_t n);
+
+        /**
+           Runs the simulation. Like Simulation::run(), it calls
+           newRun() and endRun() on all the entities for each run,
+           and collects the statistics of all the LPs.
+        */
+        void run(Tick endTick, int runs = 1);
+
+        /// Number of rounds executed in the last call of run()
+        inline size_t getRounds() const { return _rounds; }
+
+        /// Number of rollbacks in the last call of run()
+        inline size_t getRollbacks() const { return _rollbacks; }
+
+        /// Number of anti-messages sent in the last call of run()
+        inline size_t getAntiMessages() const { return _antiMessages; }
+
+        virtual void route(SimContext &from, Event *e, Tick t, bool disp);
+
+    private:
+        struct Message {
+            bool anti;
+            Event *e;
+            Tick t;
+            bool disp;
+            size_t dst;
+            size_t src;
+            uint64_t id;
+        };
+
+        class Delivery;
+        struct LP;
+
+        std::vector<std::unique_ptr<LP> > _lps;
+        std::map<const SimContext *, size_t> _index;
+        // messages sent in the current round, one list per sender
+        std::vector<std::vector<Message> > _outbox;
+        std::vector<std::exception_ptr> _errors;
+        std::unique_ptr<LPBarrier> _barrier;
+        size_t _batch;
+        Tick _window;
+        size_t _interval;
+        bool _inRound;
+        bool _coasting;
+        bool _done;
+        Tick _endTick;
+        Tick _bound;
+        size_t _rounds;
+        size_t _rollbacks;
+        size_t _antiMessages;
+
+        static void fire(Event *e, Tick t);
+        Tick nextTime(size_t i);
+        void execute(LP &lp, Event *e);
+        void advance(size_t i);
+        void checkpoint(LP &lp);
+        void rollback(size_t i, Tick t);
+        void receive(const Message &m);
+        void deliver();
+        void fossilCollect(LP &lp, Tick gvt);
+        void commit(LP &lp, Event *e);
+        void cancel(Delivery *d);
+        void computeGvt();
+        void finish();
+        void worker(size_t i);
+        void singleRun();
+
+        TimeWarpSimulation(const TimeWarpSimulation &);
+        TimeWarpSimulation &operator=(const TimeWarpSimulation &);
+    };
+
+} // namespace MetaSim
+
+#endif
@@ -1,4 +1,5 @@
 #include <event.hpp>
+#include <simul.hpp>
 #include <trace.hpp>
 
 namespace MetaSim {
@@ -7,7 +8,7 @@ namespace MetaSim {
     const char * const Trace::Exc::_NO_OPEN = "File is not open";
 
     Trace::Trace(const char *filename, Type type, bool tof) 
-        :_filename(filename), toFile(tof)
+        :_filename(filename), toFile(tof), _filter(TraceFilter::fromEnv())
     {
         if (tof == false) return;
         if (type == _ASCII_TRACE) 
@@ -17,7 +18,7 @@ namespace MetaSim {
     } 
 
     Trace::Trace(const string &filename, Type type, bool tof)
-        : _filename(filename)
+        : _filename(filename), toFile(tof), _filter(TraceFilter::fromEnv())
     {
         if (tof == false) return;
         if (type == _ASCII_TRACE) 
@@ -26,6 +27,13 @@ namespace MetaSim {
             _os.open(_filename.c_str(), ios::binary | ios::out);
     }
 
+    Trace::Trace(const string &filename, RingWriter::Policy policy, size_t ring)
+        : _filename(filename), toFile(true),
+          _ring(new RingWriter(filename, ring, policy)),
+          _filter(TraceFilter::fromEnv())
+    {
+    }
+
     Trace::~Trace() 
     {
         if (_os.is_open()) close();
@@ -33,6 +41,7 @@ namespace MetaSim {
 
     void Trace::open(bool type)
     {
+        if (_ring) throw Exc("An asynchronous trace cannot be opened again");
         _os.close();
         if (type == _ASCII_TRACE) 
             _os.open(_filename.c_str(), ios::out);
@@ -41,8 +50,14 @@ namespace MetaSim {
         if (_os.bad()) throw Exc();
     }
 
+    bool Trace::pass()
+    {
+        return _filter.accept(SIMUL.getTime(), 0);
+    }
+
     void Trace::close()
     {
+        if (_ring) _ring->close();
         _os.close();
     }
 
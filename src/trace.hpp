@@ -1,11 +1,15 @@
 #ifndef __TRACE_HPP__
 #define __TRACE_HPP__
 
+#include <cstdio>
 #include <fstream>
 #include <iostream>
+#include <memory>
 
 #include <baseexc.hpp>
 #include <basetype.hpp>
+#include <ringwriter.hpp>
+#include <tracefilter.hpp>
 
 namespace MetaSim {
     class Event;
@@ -17,13 +21,20 @@ namespace MetaSim {
        \ingroup metasim_stat
 
        This is just the basic interface for the tracing classes. By
-       default, it opens a binary stream. 
+       default, it opens a binary stream. For a binary trace of
+       events, see TraceBinary (tracebinary.hpp).
     */
     class Trace { 
     protected:
         std::string _filename;
         std::ofstream _os;
         bool toFile;
+        // the ring of the asynchronous traces, NULL for _os
+        std::unique_ptr<RingWriter> _ring;
+        TraceFilter _filter;
+
+        // true if a record at the current time passes the filter
+        bool pass();
     public:
         enum Type {BINARY = 0,
                    ASCII = 1};
@@ -50,12 +61,37 @@ namespace MetaSim {
 
         Trace(const std::string &filename, Type type = BINARY, bool tof = true);
 
+        /**
+           An asynchronous trace: the records go in the ring of a
+           RingWriter (see ringwriter.hpp), written in the file by
+           another thread, instead of _os.
+
+           @param filename the name of the file
+           @param policy what a record does when the ring is full
+           @param ring the size of the ring, in bytes
+        */
+        Trace(const std::string &filename, RingWriter::Policy policy,
+              size_t ring = RingWriter::DEFAULT_RING);
+
         /// Opens the file 
         void open(bool type = BINARY);
 
         /// Closes the file
         void close();
 
+        /**
+           Sets the filter of the records: the time of a record is
+           the time of the simulation, its type 0 and its entity
+           -1 (see TraceFilter).
+        */
+        inline void setFilter(const TraceFilter &f) { _filter = f; }
+
+        inline const TraceFilter &getFilter() const { return _filter; }
+
+        /// The writer of an asynchronous trace (its backlog and the
+        /// dropped records), NULL otherwise
+        inline const RingWriter *getWriter() const { return _ring.get(); }
+
         /// Destructor
         virtual ~Trace();
     };
@@ -70,13 +106,46 @@ namespace MetaSim {
     public:
         TraceAscii(const std::string &file) : Trace(file, ASCII){}
 
-        /// Records the value on the file, one value per line.
+        /// An asynchronous trace (see Trace)
+        TraceAscii(const std::string &file, RingWriter::Policy policy,
+                   size_t ring = RingWriter::DEFAULT_RING) :
+            Trace(file, policy, ring) {}
+
+        /// Records the value on the file, one value per line,
+        /// if it passes the filter (see setFilter()).
+        /// The stream is not flushed (see close()).
         //@{
-        void record(double value) { _os << value << std::endl; }
-        void record(long double value){_os << value << std::endl;}
-        void record(int value){_os << value << std::endl;}
-        void record(const std::string &str){_os << str;}
+        void record(double value)
+            {
+                if (!_filter.passesAll() && !pass()) return;
+                if (_ring) line("%g\n", value); else _os << value << '\n';
+            }
+        void record(long double value)
+            {
+                if (!_filter.passesAll() && !pass()) return;
+                if (_ring) line("%Lg\n", value); else _os << value << '\n';
+            }
+        void record(int value)
+            {
+                if (!_filter.passesAll() && !pass()) return;
+                if (_ring) line("%d\n", value); else _os << value << '\n';
+            }
+        void record(const std::string &str)
+            {
+                if (!_filter.passesAll() && !pass()) return;
+                if (_ring) _ring->write(str); else _os << str;
+            }
         //@}
+
+    private:
+        // a line of an asynchronous trace, written as a whole
+        template <typename T>
+        void line(const char *fmt, T value)
+        {
+            char buf[64];
+            int n = snprintf(buf, sizeof(buf), fmt, value);
+            _ring->write(buf, size_t(n));
+        }
     };    
 
 } // namespace MetaSim
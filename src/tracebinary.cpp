@@ -0,0 +1,105 @@
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#include <algorithm>
+#include <cstring>
+
+#include <tracebinary.hpp>
+
+namespace MetaSim {
+
+    using namespace std;
+
+    namespace {
+        const char MAGIC[8] = { 'M', 'S', 'T', 'R', 'A', 'C', 'E', '1' };
+        const uint64_t BOM = 0x0102030405060708ULL;
+        const uint64_t RECORD = sizeof(TraceRecord);
+    }
+
+    static_assert(sizeof(TraceRecord) == 24, "TraceRecord has padding");
+
+    const size_t TraceBinary::HEADER;
+    const size_t TraceReader::BLOCK;
+
+    TraceBinary::TraceBinary(const string &path, size_t ring,
+                             RingWriter::Policy policy) :
+        _file(path, ring, policy), _records(0), _filter(TraceFilter::fromEnv())
+    {
+        _file.write(MAGIC, 8);
+        _file.write(&BOM, 8);
+        _file.write(&RECORD, 8);
+    }
+
+    TraceBinary::~TraceBinary()
+    {
+    }
+
+    /*---------------------------------------------------*/
+
+    TraceReader::TraceReader(const string &path) :
+        _path(path), _file(fopen(path.c_str(), "rb")), _records(0), _pos(0)
+    {
+        if (!_file) throw TraceBinary::Exc("Cannot open " + path);
+        char m[8];
+        uint64_t bom, size;
+        if (fread(m, 1, 8, _file) != 8 || memcmp(m, MAGIC, 8) != 0) {
+            fclose(_file);
+            throw TraceBinary::Exc("Not a binary trace: " + path);
+        }
+        if (fread(&bom, 8, 1, _file) != 1 || fread(&size, 8, 1, _file) != 1 ||
+            bom != BOM || size != RECORD) {
+            fclose(_file);
+            throw TraceBinary::Exc("Wrong byte order or record size: " + path);
+        }
+        fseek(_file, 0, SEEK_END);
+        long len = ftell(_file);
+        fseek(_file, long(TraceBinary::HEADER), SEEK_SET);
+        _records = uint64_t(len - long(TraceBinary::HEADER)) / RECORD;
+        _buf.reserve(BLOCK);
+    }
+
+    TraceReader::~TraceReader()
+    {
+        fclose(_file);
+    }
+
+    bool TraceReader::fill()
+    {
+        _buf.resize(BLOCK);
+        _buf.resize(fread(_buf.data(), sizeof(TraceRecord), BLOCK, _file));
+        _pos = 0;
+        return !_buf.empty();
+    }
+
+    size_t TraceReader::read(TraceRecord *r, size_t n)
+    {
+        size_t k = min(n, _buf.size() - _pos);
+        memcpy(r, _buf.data() + _pos, k * sizeof(TraceRecord));
+        _pos += k;
+        // the rest directly in the destination
+        if (k < n) k += fread(r + k, sizeof(TraceRecord), n - k, _file);
+        return k;
+    }
+
+    uint64_t TraceReader::toText(const string &path, ostream &out)
+    {
+        TraceReader in(path);
+        TraceRecord r;
+        uint64_t n = 0;
+        char line[96];
+        while (in.next(r)) {
+            int len = snprintf(line, sizeof(line), "%lld\t%u\t%d\t%.17g\n",
+                               (long long) r.time, r.type, r.entity, r.payload);
+            out.write(line, len);
+            ++n;
+        }
+        if (!out) throw TraceBinary::Exc("Cannot write the text of " + path);
+        return n;
+    }
+
+} // namespace MetaSim
@@ -0,0 +1,216 @@
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef __TRACEBINARY_HPP__
+#define __TRACEBINARY_HPP__
+
+#include <cstdint>
+#include <cstdio>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include <baseexc.hpp>
+#include <eventpool.hpp>
+#include <ringwriter.hpp>
+#include <tick.hpp>
+#include <tracefilter.hpp>
+
+namespace MetaSim {
+
+    /**
+       \ingroup metasim_stat
+
+       A record of a binary trace: 24 bytes, with no padding.
+     */
+    struct TraceRecord {
+        /// the time (the value of the Tick)
+        int64_t time;
+        /// the type of the event (e.g. EventPool::typeId<E>())
+        uint32_t type;
+        /// the ID of the entity (see Entity::getID()), -1 if none
+        int32_t entity;
+        /// a value of the event (e.g. the length of a queue)
+        double payload;
+    };
+
+    /**
+       \ingroup metasim_stat
+
+       A trace of fixed-size records (TraceRecord). record() copies
+       the record in the lock-free ring of a RingWriter, drained in
+       the file by a writer thread: there is no formatting, no lock
+       and no flush for each record. When the ring is full, the
+       record waits, is dropped or is spilled in memory, after the
+       policy of the writer (see RingWriter). The file is read by
+       TraceReader, and converted to text by TraceReader::toText().
+
+       The file is
+
+       <pre>
+       "MSTRACE1"                  magic
+       uint64 0x0102030405060708   order of the bytes of the writer
+       uint64 24                   size of a record
+       records
+       </pre>
+
+       A trace can be attached to an event as a particle (see
+       particle.hpp): probe() records the time and the type of the
+       event (when it was triggered, see Event::getLastTime()).
+
+       The records that do not pass the filter of the trace (see
+       setFilter()) are discarded before they are copied.
+
+       @code
+       TraceBinary trace("queue.trc");
+       attach_stat(trace, arrival);
+       ...
+       trace.record(SIMUL.getTime(), ENQUEUE, getID(), _queue.size());
+       @endcode
+     */
+    class TraceBinary {
+    public:
+        /**
+           \ingroup metasim_exc
+        */
+        class Exc : public BaseExc {
+        public:
+            Exc(const std::string &msg) :
+                BaseExc(msg, "TraceBinary", "tracebinary.hpp") {}
+        };
+
+        /// The size of the header, in bytes
+        static const size_t HEADER = 24;
+
+        /**
+           Creates (or truncates) the file.
+
+           @param path the name of the file
+           @param ring the size of the ring, in bytes
+           @param policy what record() does when the ring is full
+         */
+        explicit TraceBinary(const std::string &path,
+                             size_t ring = RingWriter::DEFAULT_RING,
+                             RingWriter::Policy policy = RingWriter::BLOCK);
+
+        /// Writes the records and closes the file
+        ~TraceBinary();
+
+        /// Records an event
+        inline void record(Tick t, uint32_t type, int32_t entity = -1,
+                           double payload = 0)
+        {
+            TraceRecord r;
+            r.time = int64_t(t);
+            r.type = type;
+            r.entity = entity;
+            r.payload = payload;
+            record(r);
+        }
+
+        inline void record(const TraceRecord &r)
+        {
+            if (!_filter.accept(r.time, r.type, r.entity)) return;
+            if (_file.write(&r, sizeof(r))) ++_records;
+        }
+
+        /// Records the time and the type of an event
+        template <class E>
+        void probe(E &e)
+        {
+            record(e.getLastTime(), uint32_t(EventPool::typeId<E>()));
+        }
+
+        /// Sets the filter of the records (see TraceFilter)
+        inline void setFilter(const TraceFilter &f) { _filter = f; }
+
+        inline const TraceFilter &getFilter() const { return _filter; }
+
+        /// Wakes up the writer, without waiting
+        inline void flush() { _file.flush(); }
+
+        /// Waits until the records are in the file
+        inline void sync() { _file.sync(); }
+
+        /// Writes the records and closes the file
+        inline void close() { _file.close(); }
+
+        /// Number of records written (or to be written)
+        inline uint64_t getRecords() const { return _records; }
+
+        /// Number of records dropped with a full ring
+        inline uint64_t getDropped() const { return _file.getDropped(); }
+
+        /// Bytes not yet written by the writer
+        inline size_t getBacklog() const { return _file.getBacklog(); }
+
+        inline const RingWriter &getWriter() const { return _file; }
+
+    private:
+        RingWriter _file;
+        uint64_t _records;
+        TraceFilter _filter;
+    };
+
+    /**
+       \ingroup metasim_stat
+
+       Reads a file of TraceBinary by blocks of records.
+
+       @code
+       TraceReader in("queue.trc");
+       TraceRecord r;
+       while (in.next(r)) ...
+       @endcode
+     */
+    class TraceReader {
+    public:
+        /// Records read at once
+        static const size_t BLOCK = 4096;
+
+        /// Opens a trace, and checks the header
+        explicit TraceReader(const std::string &path);
+        ~TraceReader();
+
+        /// Reads the next record, false at the end of the file
+        inline bool next(TraceRecord &r)
+        {
+            if (_pos == _buf.size() && !fill()) return false;
+            r = _buf[_pos++];
+            return true;
+        }
+
+        /// Reads up to n records, and returns their number
+        size_t read(TraceRecord *r, size_t n);
+
+        /// Number of records of the file
+        inline uint64_t getRecords() const { return _records; }
+
+        /**
+           Converts a trace in text, a line for each record:
+           time, type, entity and payload, separated by tabs.
+           Returns the number of records.
+         */
+        static uint64_t toText(const std::string &path, std::ostream &out);
+
+    private:
+        TraceReader(const TraceReader &);
+        TraceReader &operator=(const TraceReader &);
+
+        bool fill();
+
+        std::string _path;
+        std::FILE *_file;
+        uint64_t _records;
+        std::vector<TraceRecord> _buf;
+        size_t _pos;
+    };
+
+} // namespace MetaSim
+
+#endif
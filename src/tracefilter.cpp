@@ -0,0 +1,126 @@
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#include <algorithm>
+#include <cstdlib>
+
+#include <tracefilter.hpp>
+
+namespace MetaSim {
+
+    using namespace std;
+    using namespace parse_util;
+
+    namespace {
+        long long integer(const string &s, const string &spec)
+        {
+            char *end = NULL;
+            string v = remove_spaces(s);
+            long long n = strtoll(v.c_str(), &end, 10);
+            if (v.empty() || *end != 0) throw ParseExc("TraceFilter", spec);
+            return n;
+        }
+    }
+
+    TraceFilter::TraceFilter() :
+        _all(true), _types(), _entities(), _t1(0), _t2(MAXTICK), _every(1),
+        _count(0), _tested(0), _passed(0)
+    {
+    }
+
+    TraceFilter::TraceFilter(const string &spec) : TraceFilter()
+    {
+        vector<string> parts = split(spec, ";");
+        for (const string &p : parts) {
+            if (p.empty()) continue;
+            string token = remove_spaces(get_token(p));
+            vector<string> par = split_param(get_param(p));
+            if (token == "type") {
+                vector<uint32_t> v;
+                for (const string &x : par) v.push_back(uint32_t(integer(x, spec)));
+                setTypes(v);
+            }
+            else if (token == "entity") {
+                vector<int32_t> v;
+                for (const string &x : par) v.push_back(int32_t(integer(x, spec)));
+                setEntities(v);
+            }
+            else if (token == "window" && (par.size() == 1 || par.size() == 2)) {
+                Tick t1(remove_spaces(par[0]));
+                setWindow(t1, par.size() == 2 ? Tick(remove_spaces(par[1])) : Tick(MAXTICK));
+            }
+            else if (token == "every" && par.size() == 1) {
+                long long n = integer(par[0], spec);
+                if (n < 1) throw ParseExc("TraceFilter", spec);
+                setSampling(uint64_t(n));
+            }
+            else throw ParseExc("TraceFilter", spec);
+        }
+    }
+
+    TraceFilter TraceFilter::fromEnv()
+    {
+        const char *spec = getenv("METASIM_TRACE_FILTER");
+        if (spec == NULL || *spec == 0) return TraceFilter();
+        return TraceFilter(spec);
+    }
+
+    void TraceFilter::setTypes(const vector<uint32_t> &types)
+    {
+        _types = types;
+        sort(_types.begin(), _types.end());
+        update();
+    }
+
+    void TraceFilter::setEntities(const vector<int32_t> &entities)
+    {
+        _entities = entities;
+        sort(_entities.begin(), _entities.end());
+        update();
+    }
+
+    void TraceFilter::setWindow(Tick t1, Tick t2)
+    {
+        _t1 = int64_t(t1);
+        _t2 = int64_t(t2);
+        update();
+    }
+
+    void TraceFilter::setSampling(uint64_t n)
+    {
+        _every = max<uint64_t>(n, 1);
+        _count = 0;
+        update();
+    }
+
+    void TraceFilter::clear()
+    {
+        *this = TraceFilter();
+    }
+
+    void TraceFilter::update()
+    {
+        _all = _types.empty() && _entities.empty() && _t1 <= 0 &&
+            _t2 == MAXTICK && _every == 1;
+    }
+
+    bool TraceFilter::test(int64_t t, uint32_t type, int32_t entity)
+    {
+        ++_tested;
+        if (t < _t1 || t > _t2) return false;
+        if (!_types.empty() && !binary_search(_types.begin(), _types.end(), type))
+            return false;
+        if (!_entities.empty() &&
+            !binary_search(_entities.begin(), _entities.end(), entity))
+            return false;
+        if (_every > 1 && _count++ % _every != 0) return false;
+        ++_passed;
+        return true;
+    }
+
+} // namespace MetaSim
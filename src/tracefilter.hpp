@@ -0,0 +1,107 @@
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef __TRACEFILTER_HPP__
+#define __TRACEFILTER_HPP__
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <strtoken.hpp>
+#include <tick.hpp>
+
+namespace MetaSim {
+
+    /**
+       \ingroup metasim_stat
+
+       Selects the records of a trace before they are formatted or
+       copied: by the type of the event, by the ID of the entity, by
+       a window of time [t1, t2] (as DebugStream::setTransitory()
+       does for the debug output) and by sampling one record in N.
+       A record passes if it passes all the criteria that are set;
+       the sampling counts only the records that pass the others.
+       A filter with no criteria passes everything, at the cost of
+       a test of a flag.
+
+       A filter can be described by a string, so that it is set at
+       run time, from a configuration file or the command line:
+
+       <pre>
+       type(1,4);entity(12);window(10ms,2s);every(100)
+       </pre>
+
+       The types are the numbers of the records (for probe(), see
+       EventPool::typeId()). The traces (TraceAscii, TraceBinary,
+       ChunkedTraceWriter) start with the filter of the environment
+       variable METASIM_TRACE_FILTER, if it is set.
+
+       @code
+       TraceBinary trace("queue.trc");
+       trace.setFilter(TraceFilter("entity(3);every(10)"));
+       @endcode
+     */
+    class TraceFilter {
+    public:
+        /// A filter that passes everything
+        TraceFilter();
+
+        /// Parses a description (throws parse_util::ParseExc)
+        explicit TraceFilter(const std::string &spec);
+
+        /// The filter of METASIM_TRACE_FILTER, or one that passes
+        /// everything
+        static TraceFilter fromEnv();
+
+        /// Passes only the events of these types
+        void setTypes(const std::vector<uint32_t> &types);
+
+        /// Passes only the events of these entities
+        void setEntities(const std::vector<int32_t> &entities);
+
+        /// Passes only the events in [t1, t2]
+        void setWindow(Tick t1, Tick t2 = Tick(MAXTICK));
+
+        /// Passes one event in n (1: all)
+        void setSampling(uint64_t n);
+
+        /// Removes all the criteria
+        void clear();
+
+        /// True if the record of an event passes the filter
+        inline bool accept(Tick t, uint32_t type, int32_t entity = -1)
+        {
+            return _all || test(int64_t(t), type, entity);
+        }
+
+        /// True if the filter has no criteria
+        inline bool passesAll() const { return _all; }
+
+        /// Number of records tested, and passed (not counted
+        /// without criteria)
+        inline uint64_t getTested() const { return _tested; }
+        inline uint64_t getPassed() const { return _passed; }
+
+    private:
+        bool test(int64_t t, uint32_t type, int32_t entity);
+        void update();
+
+        bool _all;
+        // sorted, empty for all
+        std::vector<uint32_t> _types;
+        std::vector<int32_t> _entities;
+        int64_t _t1, _t2;
+        uint64_t _every;
+        uint64_t _count;
+        uint64_t _tested, _passed;
+    };
+
+} // namespace MetaSim
+
+#endif
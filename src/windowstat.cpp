@@ -0,0 +1,86 @@
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#include <windowstat.hpp>
+
+namespace MetaSim {
+
+    using namespace std;
+
+    SlidingWindow::SlidingWindow(size_t n) :
+        _length(n), _values(n), _min(n), _max(n), _seq(0), _sum(0), _resum(n)
+    {
+        if (n == 0) throw BaseExc("The length of a window must be positive",
+                                  "SlidingWindow", "windowstat.cpp");
+    }
+
+    void SlidingWindow::push(double v)
+    {
+        if (_values.size() == _length) {
+            _sum -= _values.front();
+            _values.pop_front();
+        }
+        _values.push_back(v);
+        _sum += v;
+        if (--_resum == 0) {
+            _sum = 0;
+            for (size_t i = 0; i < _values.size(); ++i) _sum += _values[i];
+            _resum = _length;
+        }
+
+        // the entries of the deques that left the window, then the
+        // ones that can no longer be the extremes
+        const uint64_t first = _seq + 1 > _length ? _seq + 1 - _length : 0;
+        if (!_min.empty() && _min.front().seq < first) _min.pop_front();
+        if (!_max.empty() && _max.front().seq < first) _max.pop_front();
+        while (!_min.empty() && _min.back().v >= v) _min.pop_back();
+        while (!_max.empty() && _max.back().v <= v) _max.pop_back();
+        _min.push_back(Entry{ _seq, v });
+        _max.push_back(Entry{ _seq, v });
+        ++_seq;
+    }
+
+    void SlidingWindow::clear()
+    {
+        _values.clear();
+        _min.clear();
+        _max.clear();
+        _seq = 0;
+        _sum = 0;
+        _resum = _length;
+    }
+
+    /*---------------------------------------------------*/
+
+    StatWindow::StatWindow(const string &name, size_t length, double i) :
+        BaseStat(name), _win(length), _ini(i)
+    {
+        _val = _ini;
+    }
+
+    void StatWindow::saveState(StateArchive &a) const
+    {
+        a.save(_val);
+        a.save(_win.size());
+        for (size_t i = 0; i < _win.size(); ++i) a.save(_win[i]);
+    }
+
+    void StatWindow::restoreState(StateArchive &a)
+    {
+        a.restore(_val);
+        size_t n;
+        a.restore(n);
+        _win.clear();
+        for (size_t i = 0; i < n; ++i) {
+            double v;
+            a.restore(v);
+            _win.push(v);
+        }
+    }
+
+} // namespace MetaSim
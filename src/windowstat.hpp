@@ -0,0 +1,206 @@
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef __WINDOWSTAT_HPP__
+#define __WINDOWSTAT_HPP__
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <basestat.hpp>
+
+namespace MetaSim {
+
+    /**
+       \ingroup metasim_stat
+
+       A double-ended ring of at most n values, with a capacity
+       rounded up to a power of two: the positions wrap with a
+       mask, without divisions. The values are numbered from the
+       oldest (0) to the newest (size() - 1).
+    */
+    template <class T>
+    class WindowRing {
+        std::vector<T> _buf;
+        size_t _mask;
+        size_t _head;
+        size_t _size;
+
+        static size_t roundUp(size_t n) {
+            size_t c = 1;
+            while (c < n) c <<= 1;
+            return c;
+        }
+    public:
+        explicit WindowRing(size_t n) :
+            _buf(roundUp(n)), _mask(_buf.size() - 1), _head(0), _size(0) {}
+
+        inline size_t size() const { return _size; }
+        inline bool empty() const { return _size == 0; }
+        inline bool full() const { return _size == _buf.size(); }
+        inline size_t capacity() const { return _buf.size(); }
+
+        inline T &operator[](size_t i) { return _buf[(_head + i) & _mask]; }
+        inline const T &operator[](size_t i) const { return _buf[(_head + i) & _mask]; }
+
+        inline T &front() { return _buf[_head]; }
+        inline const T &front() const { return _buf[_head]; }
+        inline T &back() { return (*this)[_size - 1]; }
+        inline const T &back() const { return (*this)[_size - 1]; }
+
+        /// Appends a value (the ring must not be full)
+        inline void push_back(const T &v) { (*this)[_size++] = v; }
+        inline void pop_back() { --_size; }
+        inline void pop_front() { _head = (_head + 1) & _mask; --_size; }
+        inline void clear() { _head = _size = 0; }
+    };
+
+    /**
+       \ingroup metasim_stat
+
+       The sum, mean, minimum and maximum of the last n values
+       pushed, in O(1) amortized time per value: the minimum and
+       the maximum are kept by two monotonic deques (the values
+       that can still become the extreme of the window, in order
+       of arrival), and the sum by adding the new value and
+       subtracting the one that leaves the window. The sum is
+       computed again from the values every n pushes, so the
+       rounding errors do not accumulate.
+    */
+    class SlidingWindow {
+        struct Entry {
+            uint64_t seq;
+            double v;
+        };
+
+        size_t _length;
+        WindowRing<double> _values;
+        WindowRing<Entry> _min;
+        WindowRing<Entry> _max;
+        uint64_t _seq;
+        double _sum;
+        size_t _resum;
+
+    public:
+        /// A window of the last n values (n > 0)
+        explicit SlidingWindow(size_t n);
+
+        /// Adds a value; the oldest one leaves a full window
+        void push(double v);
+
+        /// Removes all the values
+        void clear();
+
+        /// The length of the window
+        inline size_t getLength() const { return _length; }
+
+        /// Number of values in the window (up to getLength())
+        inline size_t size() const { return _values.size(); }
+        inline bool empty() const { return _values.empty(); }
+
+        /// The i-th value of the window, from the oldest (0)
+        inline double operator[](size_t i) const { return _values[i]; }
+
+        inline double sum() const { return _sum; }
+        /// The mean of the values (0 if the window is empty)
+        inline double mean() const { return empty() ? 0 : _sum / size(); }
+        /// The minimum of the values (the window must not be empty)
+        inline double min() const { return _min.front().v; }
+        /// The maximum of the values (the window must not be empty)
+        inline double max() const { return _max.front().v; }
+    };
+
+    /**
+       \ingroup metasim_stat
+
+       A statistic over a sliding window of the last n samples
+       recorded (e.g. the moving mean or the moving maximum of a
+       throughput): the value of the stat in a run is the aggregate
+       of the window at the end of the run, and getWindow() gives
+       all the aggregates at any time. The samples of the
+       transitory are not recorded.
+
+       @code
+       StatWindowMean thr("throughput", 64);
+       ...
+       thr.record(sent);
+       if (thr.getWindow().mean() < threshold) ...
+       @endcode
+
+       Two windows cannot be merged, as their samples have no
+       common order.
+    */
+    class StatWindow : public BaseStat {
+    protected:
+        SlidingWindow _win;
+        double _ini;
+
+        /// The aggregate of the window (not empty)
+        virtual double aggregate() const = 0;
+    public:
+        StatWindow(const std::string &name, size_t length, double i = 0);
+
+        virtual void record(double v)
+            {
+                if (chkTransitory()) return;
+                _win.push(v);
+            }
+        virtual void initValue() { _win.clear(); _val = _ini; }
+
+        /// The aggregate of the window; if no sample was recorded,
+        /// the value is left unchanged (e.g. the one of a
+        /// parallel run)
+        virtual void flush() { if (!_win.empty()) _val = aggregate(); }
+
+        virtual void saveState(StateArchive &a) const;
+        virtual void restoreState(StateArchive &a);
+
+        /// The samples of the window and their aggregates
+        inline const SlidingWindow &getWindow() const { return _win; }
+    };
+
+    /// The sum of the last n samples
+    class StatWindowSum : public StatWindow {
+    protected:
+        virtual double aggregate() const { return _win.sum(); }
+    public:
+        StatWindowSum(const std::string &name, size_t length, double i = 0) :
+            StatWindow(name, length, i) {}
+    };
+
+    /// The mean of the last n samples
+    class StatWindowMean : public StatWindow {
+    protected:
+        virtual double aggregate() const { return _win.mean(); }
+    public:
+        StatWindowMean(const std::string &name, size_t length, double i = 0) :
+            StatWindow(name, length, i) {}
+    };
+
+    /// The minimum of the last n samples
+    class StatWindowMin : public StatWindow {
+    protected:
+        virtual double aggregate() const { return _win.min(); }
+    public:
+        StatWindowMin(const std::string &name, size_t length, double i = 0) :
+            StatWindow(name, length, i) {}
+    };
+
+    /// The maximum of the last n samples
+    class StatWindowMax : public StatWindow {
+    protected:
+        virtual double aggregate() const { return _win.max(); }
+    public:
+        StatWindowMax(const std::string &name, size_t length, double i = 0) :
+            StatWindow(name, length, i) {}
+    };
+
+} // namespace MetaSim
+
+#endif
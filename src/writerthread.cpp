@@ -0,0 +1,34 @@
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#include <writerthread.hpp>
+
+namespace MetaSim {
+
+    using namespace std;
+
+    void WriterThread::checkError()
+    {
+        if (_error) {
+            exception_ptr e = _error;
+            _error = nullptr;
+            rethrow_exception(e);
+        }
+    }
+
+    void WriterThread::stopThread()
+    {
+        {
+            lock_guard<mutex> l(_lock);
+            _stop = true;
+            _cv.notify_all();
+        }
+        _thread.join();
+    }
+
+} // namespace MetaSim
@@ -0,0 +1,85 @@
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef __WRITERTHREAD_HPP__
+#define __WRITERTHREAD_HPP__
+
+#include <condition_variable>
+#include <cstdio>
+#include <exception>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace MetaSim {
+
+    /**
+       \ingroup metasim_util
+
+       The common part of the files written by a helper thread
+       (AsyncWriter, RingWriter, ChunkedTraceWriter): the file, the
+       thread and its lock, the first error of the thread, which is
+       rethrown to the simulation, and the end of close(). The
+       derived class opens the file, starts the thread, and decides
+       how the data goes from the simulation to the thread.
+    */
+    class WriterThread {
+    protected:
+        explicit WriterThread(const std::string &path) :
+            _path(path), _file(NULL), _stop(false) {}
+
+        ~WriterThread() {}
+
+        /// Records the first error of the thread (with _lock held)
+        inline void setError(std::exception_ptr e) { if (!_error) _error = e; }
+
+        /// Rethrows the error of the thread, once (with _lock held)
+        void checkError();
+
+        /// Stops the thread, once it has written what it has
+        void stopThread();
+
+        /// Closes the file, then rethrows e, or an E if the file
+        /// cannot be closed
+        template <class E>
+        void closeFile(std::exception_ptr e)
+        {
+            if (std::fclose(_file) != 0 && !e)
+                e = std::make_exception_ptr(E("Cannot write file " + _path));
+            _file = NULL;
+            if (e) std::rethrow_exception(e);
+        }
+
+        /// The close() of the destructors
+        template <class W>
+        static void closeQuietly(W &w)
+        {
+            try {
+                w.close();
+            } catch (...) {
+                // an error of the file is lost if close() was not called
+            }
+        }
+
+        std::string _path;
+        std::FILE *_file;
+
+        std::mutex _lock;
+        std::condition_variable _cv;
+        bool _stop;
+        std::exception_ptr _error;
+        std::thread _thread;
+
+    private:
+        WriterThread(const WriterThread &);
+        WriterThread &operator=(const WriterThread &);
+    };
+
+} // namespace MetaSim
+
+#endif
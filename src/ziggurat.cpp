@@ -0,0 +1,111 @@
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#include <cmath>
+
+#include <randomvar.hpp>
+#include <ziggurat.hpp>
+
+namespace MetaSim {
+
+    using namespace std;
+
+    namespace {
+        /**
+           The abscissas x[0..N] of the layers of a density f, with
+           x[1] = R the start of the tail and x[N] = 0; x[0] is the
+           width of a rectangle with the area V of the base layer
+           (strip and tail). ratio[i] = x[i+1] / x[i] is the part of
+           layer i under the curve for sure, fx[i] = f(x[i]).
+        */
+        template <int N>
+        struct Tables {
+            double x[N + 1];
+            double ratio[N];
+            double fx[N + 1];
+
+            template <class F, class FInv>
+            Tables(double R, double V, F f, FInv finv)
+            {
+                x[0] = V / f(R);
+                x[1] = R;
+                for (int i = 1; i < N - 1; ++i) x[i + 1] = finv(V / x[i] + f(x[i]));
+                x[N] = 0;
+                for (int i = 0; i < N; ++i) ratio[i] = x[i + 1] / x[i];
+                for (int i = 0; i <= N; ++i) fx[i] = f(x[i]);
+            }
+        };
+
+        // R and V of Marsaglia and Tsang (2000)
+        const Tables<128> &normalTables()
+        {
+            static const Tables<128> t(3.442619855899, 9.91256303526217e-3,
+                                       [](double x) { return exp(-0.5 * x * x); },
+                                       [](double y) { return sqrt(-2.0 * log(y)); });
+            return t;
+        }
+
+        const Tables<256> &expTables()
+        {
+            static const Tables<256> t(7.69711747013104972, 3.949659822581572e-3,
+                                       [](double x) { return exp(-x); },
+                                       [](double y) { return -log(y); });
+            return t;
+        }
+    }
+
+    namespace ziggurat {
+
+        double normal(RandomGen &g)
+        {
+            const Tables<128> &t = normalTables();
+            const double R = t.x[1];
+            for (;;) {
+                double u = g.uniform() * 256;
+                int j = int(u);
+                double f = u - j;
+                int i = j & 127;
+                // the sign without a branch, which would be unpredictable
+                double s = 1 - ((j >> 6) & 2);
+
+                if (f < t.ratio[i]) return s * f * t.x[i];
+                if (i == 0) {
+                    // the tail beyond R (Marsaglia, 1964)
+                    double a, b;
+                    do {
+                        a = -log(g.uniform()) / R;
+                        b = -log(g.uniform());
+                    } while (b + b < a * a);
+                    return s * (R + a);
+                }
+                double z = f * t.x[i];
+                double y = t.fx[i] + g.uniform() * (t.fx[i + 1] - t.fx[i]);
+                if (y < exp(-0.5 * z * z)) return s * z;
+            }
+        }
+
+        double exponential(RandomGen &g)
+        {
+            const Tables<256> &t = expTables();
+            const double R = t.x[1];
+            for (;;) {
+                double u = g.uniform() * 256;
+                int i = int(u);
+                double f = u - i;
+
+                if (f < t.ratio[i]) return f * t.x[i];
+                // the tail is again exponential
+                if (i == 0) return R - log(g.uniform());
+                double z = f * t.x[i];
+                double y = t.fx[i] + g.uniform() * (t.fx[i + 1] - t.fx[i]);
+                if (y < exp(-z)) return z;
+            }
+        }
+    }
+
+} // namespace MetaSim
@@ -0,0 +1,44 @@
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef __ZIGGURAT_HPP__
+#define __ZIGGURAT_HPP__
+
+namespace MetaSim {
+
+    class RandomGen;
+
+    /**
+       \ingroup metasim_random
+
+       The Ziggurat method of Marsaglia and Tsang for the standard
+       normal and exponential distributions. The density is covered
+       by layers of equal area (128 for the normal, 256 for the
+       exponential): most of the times the value is a product of a
+       uniform number and of a table entry, without any mathematical
+       function; exp() and log() are needed only near the border of a
+       layer and in the tail.
+
+       Every attempt draws one uniform number from the generator:
+       its 7 (or 8) most significant bits select the layer (and the
+       sign of a normal), the others the position in the layer. The
+       tables are constant and shared; the samplers have no state,
+       so they can be used from any thread, with its generator.
+    */
+    namespace ziggurat {
+
+        /// A standard normal value (mean 0, variance 1)
+        double normal(RandomGen &g);
+
+        /// An exponential value of rate 1 (mean 1)
+        double exponential(RandomGen &g);
+    }
+
+} // namespace MetaSim
+
+#endif
@@ -0,0 +1,323 @@
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <vector>
+
+#include <basestat.hpp>
+#include <bufferedstat.hpp>
+#include <entity.hpp>
+#include <gevent.hpp>
+#include <history.hpp>
+#include <quantilestat.hpp>
+#include <randomvar.hpp>
+#include <simul.hpp>
+#include <windowstat.hpp>
+
+#include "catch.hpp"
+
+using namespace std;
+using namespace MetaSim;
+
+TEST_CASE("StatMean - stable mean and variance", "[stat]")
+{
+    SimContext ctx;
+    SimContext::Scope s(ctx);
+    StatMean m("m");
+    m.initValue();
+
+    // a large offset: the naive sum of the squares loses all digits
+    const double OFFSET = 1e9;
+    for (int i = 0; i < 1000; ++i) m.record(OFFSET + (i % 2 ? 1 : -1));
+    REQUIRE(m.getSamples() == 1000);
+    REQUIRE(m.getValue() == OFFSET);
+    REQUIRE(m.getSampleVariance() == Approx(1000.0 / 999));
+
+    StatSqrMean q("q");
+    q.initValue();
+    for (int i = 1; i <= 4; ++i) q.record(i);
+    REQUIRE(q.getValue() == Approx(30.0 / 4));
+}
+
+TEST_CASE("BaseStat - merge of the level 1 stats", "[stat]")
+{
+    SimContext ctx;
+    SimContext::Scope s(ctx);
+    RandomGen g(7);
+
+    StatMean all, a, b;
+    StatMax mx, mx2;
+    StatMin mn, mn2;
+    StatCount c, c2;
+    StatPercent p, p2, pall;
+    StatSqrMean q, q2;
+    BufferedStat bm(BufferedStat::MEAN), bm2(BufferedStat::MEAN, "", 7);
+    BaseStat::newRun();
+    for (int i = 0; i < 1000; ++i) {
+        double v = g.uniform() * 100;
+        all.record(v);
+        bool first = i < 300;
+        (first ? a : b).record(v);
+        (first ? mx : mx2).record(v);
+        (first ? mn : mn2).record(v);
+        (first ? c : c2).record(1);
+        (first ? p : p2).record(v > 50);
+        pall.record(v > 50);
+        (first ? q : q2).record(v);
+        (first ? bm : bm2).record(v);
+    }
+    a.merge(b);
+    REQUIRE(a.getSamples() == 1000);
+    REQUIRE(a.getValue() == Approx(all.getValue()));
+    REQUIRE(a.getSampleVariance() == Approx(all.getSampleVariance()));
+    mx.merge(mx2);
+    mn.merge(mn2);
+    c.merge(c2);
+    p.merge(p2);
+    q.merge(q2);
+    bm.merge(bm2);
+    REQUIRE(c.getValue() == 1000);
+    REQUIRE(p.getNumSamples() == pall.getNumSamples());
+    REQUIRE(p.getValue() == Approx(pall.getValue()));
+    REQUIRE(bm.getValue() == Approx(all.getValue()));
+    REQUIRE(bm.getSamples() == 1000);
+    REQUIRE(mx.getValue() >= mx2.getValue());
+    REQUIRE(mn.getValue() <= mn2.getValue());
+    REQUIRE(q.getValue() == Approx(all.getSampleVariance() * 999 / 1000 +
+                                   all.getValue() * all.getValue()));
+
+    // merging an empty stat, and into an empty stat
+    StatMean e;
+    e.initValue();
+    e.merge(all);
+    REQUIRE(e.getValue() == all.getValue());
+    REQUIRE(e.getSampleVariance() == Approx(all.getSampleVariance()));
+
+    REQUIRE_THROWS(a.merge(c));
+    BufferedStat bmax(BufferedStat::MAX);
+    REQUIRE_THROWS(bm.merge(bmax));
+}
+
+TEST_CASE("BaseStat - shards of a run", "[stat]")
+{
+    SimContext master;
+    SimContext shard;
+    vector<double> v;
+    RandomGen g(9);
+    for (int i = 0; i < 500; ++i) v.push_back(g.uniform());
+
+    StatMean *m1, *m2;
+    StatHistogram *h1, *h2;
+    {
+        SimContext::Scope s(shard);
+        m2 = new StatMean("m");
+        h2 = new StatHistogram("h", {0.5, 0.9});
+        BaseStat::newRun();
+        for (size_t i = 250; i < v.size(); ++i) { m2->record(v[i]); h2->record(v[i]); }
+    }
+    SimContext::Scope s(master);
+    m1 = new StatMean("m");
+    h1 = new StatHistogram("h", {0.5, 0.9});
+    BaseStat::init(1);
+    BaseStat::newRun();
+    for (size_t i = 0; i < 250; ++i) { m1->record(v[i]); h1->record(v[i]); }
+
+    BaseStat::mergeShard(shard);
+    BaseStat::endRun();
+    BaseStat::endSim();
+    double mean = 0;
+    for (double x : v) mean += x;
+    REQUIRE(m1->getMean() == Approx(mean / v.size()));
+    REQUIRE(h1->getSketch().getCount() == v.size());
+    REQUIRE(h1->getQuantile(1).getMean() == Approx(0.9).epsilon(0.05));
+
+    StatCount extra;
+    REQUIRE_THROWS(BaseStat::mergeShard(shard));
+
+    delete m1;
+    delete h1;
+    {
+        SimContext::Scope s2(shard);
+        delete m2;
+        delete h2;
+    }
+}
+
+/* A quantity that is 0 in [0, 10), 2 in [10, 30), 1 from 30 */
+class Level : public Entity {
+public:
+    GEvent<Level> step;
+    StatTimeAvg avg;
+    int n;
+
+    Level() : Entity(""), step(this, &Level::onStep), avg("avg"), n(0) {}
+
+    void onStep(Event *) {
+        ++n;
+        if (n == 1) avg.update(2);
+        else if (n == 2) avg.add(-1);
+        if (n < 3) step.post(SIMUL.getTime() + (n == 1 ? 20 : 10));
+    }
+    void newRun() { n = 0; step.post(10); }
+    void endRun() {}
+};
+
+static shared_ptr<void> buildLevel()
+{
+    return make_shared<Level>();
+}
+
+TEST_CASE("BaseStat - values of the runs", "[stat]")
+{
+    SimContext ctx;
+    SimContext::Scope s(ctx);
+    StatMean a("a"), c("c");
+    unique_ptr<StatMean> b(new StatMean("b"));
+    BaseStat::init(4);
+    for (int run = 0; run < 4; ++run) {
+        BaseStat::newRun();
+        a.record(run);
+        b->record(10 * run);
+        c.record(100 * run);
+        BaseStat::endRun();
+    }
+    BaseStat::endSim();
+
+    // a stat destroyed in the middle, and one created after the
+    // runs, which has no values
+    b.reset();
+    StatMean d("d");
+    REQUIRE(vector<BaseStat *>(BaseStat::begin(), BaseStat::end()) ==
+            vector<BaseStat *>({ &a, &c, &d }));
+    REQUIRE(a.getMean() == 1.5);
+    REQUIRE(c.getMean() == 150);
+    REQUIRE(c.getLastValue() == 300);
+    REQUIRE(d.getMean() == 0);
+    REQUIRE(a.getVariance() == Approx(sqrt(5.0 / 12)));
+    REQUIRE(c.getVariance() == Approx(100 * sqrt(5.0 / 12)));
+    REQUIRE(c.getConfInterval(0.9) == Approx(BaseStat::tQuantile(0.95, 3) * c.getVariance()));
+    REQUIRE(a.getConfInterval(0.9) == Approx(BaseStat::tQuantile(0.95, 3) * a.getVariance()));
+
+    // a new simulation drops the column of b
+    BaseStat::init(3);
+    for (int run = 0; run < 3; ++run) {
+        BaseStat::newRun();
+        d.record(run + 1);
+        BaseStat::endRun();
+    }
+    BaseStat::endSim();
+    REQUIRE(d.getMean() == 2);
+    REQUIRE(a.getMean() == 0);
+}
+
+TEST_CASE("BaseStat - MSER truncation point", "[stat]")
+{
+    // 20 biased values, then a stationary series
+    vector<double> v;
+    for (int i = 0; i < 20; ++i) v.push_back(10);
+    for (int i = 0; i < 80; ++i) v.push_back(i % 2 ? 1 : -1);
+    REQUIRE(BaseStat::mser(v) == 20);
+    REQUIRE(BaseStat::mser(v, 1) == 20);
+
+    // no bias
+    vector<double> flat(100, 3);
+    REQUIRE(BaseStat::mser(flat) == 0);
+
+    // a trend: the bias is never over
+    vector<double> trend;
+    for (int i = 0; i < 100; ++i) trend.push_back(i);
+    REQUIRE(BaseStat::mser(trend) == trend.size());
+
+    // less than 2 batches
+    REQUIRE(BaseStat::mser(vector<double>(9, 1)) == 9);
+}
+
+TEST_CASE("StatTimeAvg - time average", "[stat]")
+{
+    SimContext ctx;
+    SimContext::Scope s(ctx);
+    Level l;
+
+    SIMUL.run(40, 3);
+    REQUIRE(l.avg.getMean() == Approx(50.0 / 40));
+
+    // the transitory is not integrated
+    BaseStat::setTransitory(20);
+    SIMUL.run(40, 3);
+    REQUIRE(l.avg.getMean() == Approx(30.0 / 20));
+    REQUIRE(l.avg.getCurrent() == 1);
+
+    // the values of the parallel runs are kept
+    SIMUL.run(40, 3, buildLevel, 2);
+    REQUIRE(l.avg.getMean() == Approx(30.0 / 20));
+}
+
+TEST_CASE("SlidingWindow - aggregates of the last values", "[stat]")
+{
+    history<int> h(3);
+    for (int i = 1; i <= 5; ++i) h.push(i);
+    REQUIRE(h[0] == 5);
+    REQUIRE(h[2] == 3);
+    h[0] = 7;
+    REQUIRE(h[0] == 7);
+
+    // against a scan of the window, with a length that is not a
+    // power of two
+    const size_t N = 5;
+    SlidingWindow w(N);
+    RandomGen g(7);
+    vector<double> all;
+    for (int i = 0; i < 1000; ++i) {
+        double v = i % 97 == 0 ? 100 : double(g.sample() % 20) - 10;
+        w.push(v);
+        all.push_back(v);
+        size_t from = all.size() > N ? all.size() - N : 0;
+        auto b = all.begin() + from;
+        REQUIRE(w.size() == all.size() - from);
+        REQUIRE(w.min() == *min_element(b, all.end()));
+        REQUIRE(w.max() == *max_element(b, all.end()));
+        double sum = 0;
+        for (auto j = b; j != all.end(); ++j) sum += *j;
+        REQUIRE(w.sum() == Approx(sum));
+        REQUIRE(w[0] == *b);
+    }
+    w.clear();
+    REQUIRE(w.empty());
+    REQUIRE(w.mean() == 0);
+}
+
+TEST_CASE("StatWindow - value of a run", "[stat]")
+{
+    SimContext ctx;
+    SimContext::Scope s(ctx);
+    StatWindowMean mean("mean", 3);
+    StatWindowMax max("max", 3);
+    StatWindowSum sum("sum", 2, -1);
+
+    SIMUL.initRuns();
+    SIMUL.initSingleRun();
+    REQUIRE(sum.getValue() == -1);
+    for (double v : { 4.0, 1.0, 2.0, 3.0 }) {
+        mean.record(v);
+        max.record(v);
+        sum.record(v);
+    }
+    REQUIRE(mean.getValue() == 2);
+    REQUIRE(max.getValue() == 3);
+    REQUIRE(sum.getValue() == 5);
+    REQUIRE(max.getWindow().min() == 1);
+
+    StateArchive a;
+    max.saveState(a);
+    max.record(10);
+    REQUIRE(max.getValue() == 10);
+    a.rewind();
+    max.restoreState(a);
+    REQUIRE(max.getValue() == 3);
+    REQUIRE(max.getWindow().size() == 3);
+
+    SIMUL.endSingleRun();
+    REQUIRE(mean.getLastValue() == 2);
+    REQUIRE(mean.getWindow().size() == 3);
+    SIMUL.initSingleRun();
+    REQUIRE(mean.getWindow().empty());
+}
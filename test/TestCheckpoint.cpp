@@ -0,0 +1,139 @@
+#include <memory>
+#include <vector>
+
+#include <basestat.hpp>
+#include <checkpoint.hpp>
+#include <entity.hpp>
+#include <gevent.hpp>
+#include <randomvar.hpp>
+#include <simul.hpp>
+
+#include "catch.hpp"
+#include "myentity.hpp"
+
+using namespace std;
+using namespace MetaSim;
+
+/* A source of random arrivals, each one served by a disposable job */
+class JobSource : public Source {
+    int _arrivals;
+    int _served;
+public:
+    StatCount served;
+
+    JobSource() : _arrivals(0), _served(0) {}
+
+    int arrivals() const { return _arrivals; }
+    int getServed() const { return _served; }
+
+    void onArrival(Event *e) {
+        Source::onArrival(e);
+        ++_arrivals;
+        Event::create<GEvent<JobSource> >(this, &JobSource::onJob)
+            ->post(SIMUL.getTime() + 5, true);
+    }
+    void onJob(Event *) {
+        ++_served;
+        served.record(1);
+    }
+    void newRun() { _arrivals = _served = 0; Source::newRun(); }
+
+    void saveState(StateArchive &a) const {
+        a.save(_arrivals);
+        a.save(_served);
+    }
+    void restoreState(StateArchive &a) {
+        a.restore(_arrivals);
+        a.restore(_served);
+    }
+};
+
+TEST_CASE("Checkpoint - restore the state of a run", "[checkpoint]")
+{
+    SimContext ctx;
+    SimContext::Scope s(ctx);
+    RandomVar::init(7);
+    JobSource src;
+    SIMUL.initRuns();
+    SIMUL.initSingleRun();
+    SIMUL.run_to(500);
+
+    int arrivals = src.arrivals();
+    unique_ptr<Checkpoint> cp(new Checkpoint());
+    REQUIRE(cp->getTime() == 500);
+    // the arrival, and maybe a job
+    REQUIRE(cp->getEvents() >= 1);
+
+    vector<int> a, b;
+    vector<double> v;
+    for (int k = 0; k < 3; ++k) {
+        if (k > 0) cp->restore();
+        REQUIRE(SIMUL.getTime() == 500);
+        REQUIRE(src.arrivals() == arrivals);
+        SIMUL.run_to(5000);
+        a.push_back(src.arrivals());
+        b.push_back(src.getServed());
+        v.push_back(src.interval.getValue());
+    }
+    REQUIRE(a[0] > arrivals);
+    REQUIRE(a[1] == a[0]);
+    REQUIRE(a[2] == a[0]);
+    REQUIRE(b[2] == b[0]);
+    REQUIRE(v[2] == v[0]);
+
+    cp.reset();
+    SIMUL.endSingleRun();
+
+    // an entity created after the checkpoint
+    SIMUL.initSingleRun();
+    SIMUL.run_to(100);
+    Checkpoint late;
+    JobSource other;
+    REQUIRE_THROWS_AS(late.restore(), const Checkpoint::Exc &);
+}
+
+TEST_CASE("Simulation - runs from a shared warm-up", "[checkpoint]")
+{
+    const int RUNS = 4;
+    double mean[2], count[2];
+    uint64_t executed[2];
+    Simulation::WarmupMode modes[2] = { Simulation::WARMUP_RESTORE,
+                                        Simulation::WARMUP_FORK };
+    for (int k = 0; k < 2; ++k) {
+        SimContext ctx;
+        SimContext::Scope s(ctx);
+        RandomVar::init(11);
+        JobSource src;
+        BaseStat::setTransitory(2000);
+        SIMUL.runFromWarmup(10000, RUNS, modes[k], 2);
+
+        REQUIRE(src.interval.getExpNum() == RUNS);
+        REQUIRE(src.interval.getConfInterval() > 0);
+        mean[k] = src.interval.getMean();
+        count[k] = src.served.getMean();
+        executed[k] = SIMUL.getExecutedEvents();
+    }
+    REQUIRE(mean[0] == mean[1]);
+    REQUIRE(count[0] == count[1]);
+    REQUIRE(executed[0] == executed[1]);
+    REQUIRE(mean[0] == Approx(10).epsilon(0.2));
+    // the warm-up is simulated once: about 2 events every 11 ticks
+    REQUIRE(executed[0] < uint64_t(2 * (2000 + RUNS * 8000) / 11 * 1.2));
+}
+
+TEST_CASE("Simulation - runs from a detected warm-up", "[checkpoint]")
+{
+    SimContext ctx;
+    SimContext::Scope s(ctx);
+    RandomVar::init(11);
+    JobSource src;
+    // at least 50 intervals of 40 ticks
+    SIMUL.setWarmupDetection(40, 8000);
+    SIMUL.runFromWarmup(10000, 4);
+
+    const Tick end = SIMUL.getWarmupEnd();
+    REQUIRE(end >= 2000);
+    REQUIRE(end <= 8000);
+    REQUIRE(src.interval.getExpNum() == 4);
+    REQUIRE(src.interval.getMean() == Approx(10).epsilon(0.2));
+}
@@ -0,0 +1,81 @@
+// the debug macros are compiled in this test only
+#define __DEBUG__
+
+#include <sstream>
+#include <string>
+
+#include <debugstream.hpp>
+#include <simcontext.hpp>
+#include <simul.hpp>
+
+#include "catch.hpp"
+
+using namespace std;
+using namespace MetaSim;
+
+static void quiet()
+{
+    DBGENTER("TestQuiet");
+    DBGPRINT("not shown");
+}
+
+static void loud()
+{
+    DBGENTER("TestLoud");
+    DBGPRINT_2("value ", 42);
+    quiet();
+    DBGPRINT("after");
+}
+
+TEST_CASE("DebugStream - interned levels", "[debug]")
+{
+    int a = DebugStream::level("TestLoud");
+    REQUIRE(DebugStream::level("TestLoud") == a);
+    REQUIRE(DebugStream::level("TestQuiet") != a);
+
+    DebugStream d;
+    REQUIRE(!d.isEnabled(a));
+    d.enable("TestLoud");
+    REQUIRE(d.isEnabled(a));
+    d.disable("TestLoud");
+    REQUIRE(!d.isEnabled(a));
+    // ids beyond a word of the mask
+    for (int i = 0; i < 100; ++i) DebugStream::level("TestLevel" + to_string(i));
+    d.enable("TestLevel99");
+    REQUIRE(d.isEnabled(DebugStream::level("TestLevel99")));
+    REQUIRE(!d.isEnabled(DebugStream::level("TestLevel98")));
+}
+
+TEST_CASE("DebugStream - DBGENTER only when a level is enabled", "[debug]")
+{
+    SimContext ctx;
+    SimContext::Scope s(ctx);
+    ostringstream out;
+    SIMUL.dbg.setStream(out);
+
+    REQUIRE(!DebugStream::anyEnabled());
+    loud();
+    REQUIRE(out.str().empty());
+
+    SIMUL.dbg.enable("TestLoud");
+    REQUIRE(DebugStream::anyEnabled());
+    loud();
+    string text = out.str();
+    REQUIRE(text.find("--> ") != string::npos);
+    REQUIRE(text.find("loud") != string::npos);
+    REQUIRE(text.find("  value 42\n") != string::npos);
+    REQUIRE(text.find("after") != string::npos);
+    REQUIRE(text.find("not shown") == string::npos);
+
+    SIMUL.dbg.disable("TestLoud");
+    REQUIRE(!DebugStream::anyEnabled());
+
+    // the string interface
+    out.str("");
+    SIMUL.dbg.enable("All");
+    SIMUL.dbg.enter("TestQuiet", "header");
+    SIMUL.dbg << "inside" << endl;
+    SIMUL.dbg.exit();
+    SIMUL.dbg.disable("All");
+    REQUIRE(out.str() == "header\n  inside\n");
+}
@@ -0,0 +1,121 @@
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <basestat.hpp>
+#include <distrun.hpp>
+#include <entity.hpp>
+#include <gevent.hpp>
+#include <randomvar.hpp>
+#include <simul.hpp>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#include "catch.hpp"
+#include "myentity.hpp"
+
+using namespace std;
+using namespace MetaSim;
+
+#if defined(__unix__) || defined(__APPLE__)
+/* A worker that takes a run and dies: connected here, so that it
+   is the first worker accepted by the server */
+static thread faultyWorker(unsigned short port)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in a = {};
+    a.sin_family = AF_INET;
+    a.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    a.sin_port = htons(port);
+    REQUIRE(connect(fd, reinterpret_cast<sockaddr *>(&a), sizeof(a)) == 0);
+    return thread([fd]() {
+        char c;
+        recv(fd, &c, 1, 0);
+        close(fd);
+    });
+}
+
+TEST_CASE("Distributed replications", "[distrun]")
+{
+    const int RUNS = 12;
+    double mean, conf;
+    uint64_t executed;
+    {
+        SimContext ctx;
+        SimContext::Scope s(ctx);
+        RandomVar::init(1);
+        Source master;
+        SIMUL.run(10000, RUNS, buildModel, 2);
+        mean = master.interval.getMean();
+        conf = master.interval.getConfInterval();
+        executed = SIMUL.getExecutedEvents();
+    }
+
+    SimContext ctx;
+    SimContext::Scope s(ctx);
+    RandomVar::init(1);
+    Source master;
+    unique_ptr<RunServer> server(new RunServer());
+    server->setTimeout(30);
+    const unsigned short port = server->getPort();
+    size_t done[2] = { 0, 0 };
+    thread faulty = faultyWorker(port);
+    vector<thread> workers;
+    for (int k = 0; k < 2; ++k)
+        workers.push_back(thread([&done, k, port]() {
+            RunWorker w("127.0.0.1", port, 10);
+            done[k] = w.serve(buildModel);
+        }));
+
+    SIMUL.run(10000, RUNS, *server);
+    faulty.join();
+    REQUIRE(master.interval.getExpNum() == RUNS);
+    REQUIRE(master.interval.getMean() == mean);
+    REQUIRE(master.interval.getConfInterval() == conf);
+    REQUIRE(SIMUL.getExecutedEvents() == executed);
+    REQUIRE(server->getReissued() == 1);
+
+    // the workers stay connected for the next runs
+    SIMUL.run(10000, 3, *server);
+    REQUIRE(master.interval.getExpNum() == 3);
+
+    // the destructor stops the workers
+    server.reset();
+    for (auto &t : workers) t.join();
+    REQUIRE(done[0] + done[1] == RUNS + 3);
+}
+
+TEST_CASE("Distributed replications, sweep points and failures", "[distrun]")
+{
+    SimContext ctx;
+    SimContext::Scope s(ctx);
+    RandomVar::init(1);
+    Source master;
+    double means[2];
+    {
+        RunServer server;
+        thread worker([&]() {
+            RunWorker w("127.0.0.1", server.getPort(), 10);
+            w.serve([](size_t p) -> shared_ptr<void> {
+                if (p == 2) throw BaseExc("no such point");
+                return make_shared<Source>(p == 0 ? 0.1 : 0.2);
+            });
+        });
+        for (size_t p = 0; p < 2; ++p) {
+            server.setPoint(p);
+            SIMUL.run(10000, 5, server);
+            means[p] = master.interval.getMean();
+        }
+        server.setPoint(2);
+        REQUIRE_THROWS_AS(SIMUL.run(10000, 5, server), const RunServer::Exc &);
+        REQUIRE(server.getWorkers() == 0);
+        worker.join();
+    }
+    REQUIRE(means[0] == Approx(10).epsilon(0.05));
+    REQUIRE(means[1] == Approx(5).epsilon(0.05));
+}
+#endif
@@ -1,3 +1,8 @@
+#include <memory>
+#include <string>
+#include <typeinfo>
+#include <vector>
+
 #include <entity.hpp>
 #include "myentity.hpp"
 
@@ -34,3 +39,126 @@ TEST_CASE("TestEntity.copy", "[entity][clone]")
     ss << "cloned_entity_copy_" << p1->getID() + 1;
     REQUIRE(p2->getName() == ss.str());
 }
+
+/* records the order in which newRun() is called */
+class Member : public Entity {
+    std::vector<int> &_calls;
+public:
+    Member(const std::string &n, std::vector<int> &calls) :
+        Entity(n), _calls(calls) {}
+    void newRun() { _calls.push_back(getID()); }
+    void endRun() {}
+};
+
+TEST_CASE("TestEntity.registry", "[entity]")
+{
+    SimContext ctx;
+    SimContext::Scope s(ctx);
+    std::vector<int> calls;
+    std::vector<std::unique_ptr<Member> > m;
+    for (int i = 0; i < 5; ++i)
+        m.emplace_back(new Member("m" + std::to_string(i), calls));
+
+    // the destroyed entities are skipped, the others are called
+    // in order of ID
+    int id1 = m[1]->getID(), id4 = m[4]->getID();
+    m[1].reset();
+    m[4].reset();
+    REQUIRE(Entity::getPointer(id1) == NULL);
+    REQUIRE(Entity::getPointer(id4) == NULL);
+    REQUIRE(Entity::_find("m1") == NULL);
+    REQUIRE(Entity::_find("m3") == m[3].get());
+    REQUIRE(Entity::getPointer(0) == NULL);
+
+    Entity::callNewRun();
+    REQUIRE(calls == (std::vector<int> { m[0]->getID(), m[2]->getID(),
+                                         m[3]->getID() }));
+
+    // the IDs are not reused
+    m[1].reset(new Member("m1", calls));
+    REQUIRE(m[1]->getID() == id4 + 1);
+    REQUIRE(Entity::getPointer(m[1]->getID()) == m[1].get());
+}
+
+TEST_CASE("TestEntity.defaultName", "[entity]")
+{
+    SimContext ctx;
+    SimContext::Scope s(ctx);
+    std::vector<int> calls;
+
+    Entity::reserve(3);
+    Member a("", calls), b("", calls);
+    Member c("c", calls);
+
+    // the default name is the one of the most derived class
+    std::string n = a.getName();
+    REQUIRE(n == std::string(typeid(Member).name()) + std::to_string(a.getID()));
+    REQUIRE(Entity::_find(n) == &a);
+    // generated when it is looked for, without calling getName()
+    REQUIRE(Entity::_find(std::string(typeid(Member).name()) +
+                          std::to_string(b.getID())) == &b);
+    REQUIRE(Entity::_find(std::string(typeid(Member).name()) + "99") == NULL);
+    REQUIRE(Entity::_find("c") == &c);
+
+    // a name cannot be taken from an unnamed entity
+    REQUIRE_THROWS(Member(n, calls));
+}
+
+/* the name of the class ends with a digit, as the default names */
+class Eth2 : public Entity {
+public:
+    Eth2(const std::string &n) : Entity(n) {}
+    void newRun() {}
+    void endRun() {}
+};
+
+class Plain : public Entity {
+public:
+    Plain(const std::string &n) : Entity(n) {}
+    void newRun() {}
+    void endRun() {}
+};
+
+TEST_CASE("TestEntity.defaultNameDigits", "[entity]")
+{
+    SimContext ctx;
+    SimContext::Scope s(ctx);
+
+    // found by the default name, whether generated or not
+    Eth2 a(""), b("");
+    std::string na = std::string(typeid(Eth2).name()) + std::to_string(a.getID());
+    std::string nb = std::string(typeid(Eth2).name()) + std::to_string(b.getID());
+    REQUIRE(Entity::_find(nb) == &b);
+    REQUIRE(a.getName() == na);
+    REQUIRE(Entity::_find(na) == &a);
+    REQUIRE_THROWS(Eth2{na});
+
+    // a name given before as the default name of a later entity
+    std::string taken = std::string(typeid(Plain).name()) +
+        std::to_string(b.getID() + 2);
+    Plain c(taken);
+    Plain d("");
+    REQUIRE(d.getID() == b.getID() + 2);
+    REQUIRE(Entity::_find(taken) == &c);
+    REQUIRE_THROWS(d.getName());
+}
+
+TEST_CASE("TestEntity.rebuild", "[entity]")
+{
+    SimContext ctx;
+    SimContext::Scope s(ctx);
+    std::vector<int> calls;
+
+    // a model destroyed and built again in the same context
+    int old;
+    {
+        Member a("a", calls), b("", calls);
+        old = b.getID();
+    }
+    Member c("a", calls);
+    REQUIRE(c.getID() == old + 1);
+    REQUIRE(Entity::getPointer(old) == NULL);
+    REQUIRE(Entity::getPointer(old - 1) == NULL);
+    REQUIRE(Entity::getPointer(c.getID()) == &c);
+    REQUIRE(Entity::_find("a") == &c);
+}
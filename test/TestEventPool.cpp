@@ -0,0 +1,158 @@
+#include <deque>
+#include <stdexcept>
+
+#include <entity.hpp>
+#include <event.hpp>
+#include <eventpool.hpp>
+#include <gevent.hpp>
+#include <objectpool.hpp>
+#include <simcontext.hpp>
+#include <simul.hpp>
+
+#include "catch.hpp"
+
+using namespace std;
+using namespace MetaSim;
+
+static int processed = 0;
+static int destroyed = 0;
+
+class Packet : public Event {
+    int _hops;
+public:
+    Packet(int hops) : Event(), _hops(hops) {}
+    Packet(int hops, bool fail) : Event(), _hops(hops) { 
+        if (fail) throw runtime_error("Packet"); 
+    }
+    ~Packet() { destroyed++; }
+    void doit() {
+        processed++;
+        if (_hops > 0)
+            Event::create<Packet>(_hops - 1)->post(SIMUL.getTime() + 1, true);
+    }
+};
+
+class Generator : public Entity {
+public:
+    Generator() : Entity("") {}
+    void newRun() {
+        for (int i = 0; i < 10; ++i) 
+            Event::create<Packet>(100)->post(i, true);
+    }
+    void endRun() {}
+};
+
+TEST_CASE("EventPool - disposable events are recycled", "[eventpool]")
+{
+    SimContext ctx;
+    SimContext::Scope s(ctx);
+    Generator g;
+    processed = destroyed = 0;
+
+    SIMUL.run(50, 3);
+
+    const EventPool *pool = ctx.getEventPool<Packet>();
+    REQUIRE(pool != nullptr);
+    // 10 in flight at any time: one chunk is enough
+    REQUIRE(pool->capacity() == 64);
+    REQUIRE(pool->live() == 0);
+    REQUIRE(processed > 3 * 400);
+    // the ones still in the queue at the end of each run 
+    // have been recycled too
+    REQUIRE(destroyed == processed + 3 * 10);
+}
+
+TEST_CASE("EventPool - dispose and exceptions", "[eventpool]")
+{
+    SimContext ctx;
+    SimContext::Scope s(ctx);
+    destroyed = 0;
+
+    Packet *p = Event::create<Packet>(0);
+    REQUIRE(ctx.getEventPool<Packet>()->live() == 1);
+    p->dispose();
+    REQUIRE(ctx.getEventPool<Packet>()->live() == 0);
+
+    REQUIRE_THROWS(Event::create<Packet>(0, true));
+    REQUIRE(ctx.getEventPool<Packet>()->live() == 0);
+
+    // events created with new are simply deleted
+    (new Packet(0))->dispose();
+    REQUIRE(destroyed == 2);
+}
+
+static int payloads = 0;
+
+struct Payload {
+    int len;
+    explicit Payload(int l) : len(l) { payloads++; }
+    ~Payload() { payloads--; }
+};
+
+TEST_CASE("ObjectPool - handles and counts", "[eventpool]")
+{
+    SimContext ctx;
+    SimContext::Scope s(ctx);
+    ObjectPool<Payload> pool;
+    {
+        ObjectPool<Payload>::Handle a = pool.make(10);
+        ObjectPool<Payload>::Handle b = pool.make(20);
+        REQUIRE(a->len == 10);
+        REQUIRE(pool.live() == 2);
+        ObjectPool<Payload>::Handle c = std::move(b);
+        REQUIRE(!b);
+        REQUIRE(c->len == 20);
+        c.reset();
+        REQUIRE(pool.live() == 1);
+        Payload *p = a.release();
+        REQUIRE(!a);
+        REQUIRE(pool.live() == 1);
+        pool.destroy(p);
+    }
+    REQUIRE(pool.live() == 0);
+    REQUIRE(pool.peak() == 2);
+    REQUIRE(payloads == 0);
+
+    // the memory is reused
+    for (int i = 0; i < 1000; ++i) pool.make(i);
+    REQUIRE(pool.capacity() == ObjectPool<Payload>::CHUNK);
+}
+
+/* Sends payloads that are still in its queue at the end of the run */
+class Sender : public Entity {
+public:
+    ObjectPool<Payload> &pool;
+    deque<ObjectPool<Payload>::Handle> queue;
+    GEvent<Sender> evt;
+
+    Sender(ObjectPool<Payload> &p) : Entity(""), pool(p), queue(),
+                                     evt(this, &Sender::onEvent) {}
+    void onEvent(Event *) {
+        queue.push_back(pool.make(int(SIMUL.getTime())));
+        // one in three is delivered
+        if (int(SIMUL.getTime()) % 3 == 0) queue.pop_front();
+        evt.post(SIMUL.getTime() + 1);
+    }
+    void newRun() {
+        REQUIRE(pool.live() == 0);
+        for (auto &h : queue) REQUIRE(!h);
+        queue.clear();
+        evt.post(0);
+    }
+    void endRun() {}
+};
+
+TEST_CASE("ObjectPool - reset at the end of a run", "[eventpool]")
+{
+    SimContext ctx;
+    SimContext::Scope s(ctx);
+    ObjectPool<Payload> pool;
+    Sender sender(pool);
+    SIMUL.run(100, 3);
+    REQUIRE(pool.live() == 0);
+    REQUIRE(payloads == 0);
+    REQUIRE(pool.peak() > 50);
+    // the handles left in the queue are stale
+    REQUIRE(!sender.queue.empty());
+    REQUIRE(!sender.queue.front());
+}
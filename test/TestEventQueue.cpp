@@ -0,0 +1,429 @@
+#include <algorithm>
+#include <memory>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <entity.hpp>
+#include <event.hpp>
+#include <eventqueue.hpp>
+#include <gevent.hpp>
+#include <simul.hpp>
+
+#include "myentity.hpp"
+
+#include "catch.hpp"
+
+using namespace std;
+using namespace MetaSim;
+
+class DummyEvent : public Event {
+public:
+    int id;
+    const void *owner;
+    DummyEvent(int i = 0, int p = _DEFAULT_PRIORITY, const void *o = NULL) :
+        Event(p), id(i), owner(o) {}
+    void doit() {}
+    const void *getOwner() const { return owner; }
+};
+
+/*
+  Performs a pseudo-random sequence of post, drop, reschedule, lazy
+  cancellations and extractions
+  on the global event queue, and returns the ids of the extracted
+  events, in order of extraction.
+*/
+static vector<int> runSequence(const string &spec, int dist)
+{
+    const int N = 3000;
+    Event::setEventQueue(spec);
+
+    // 9 events in 10 have one of 40 owners
+    static const char owners[40] = {};
+    vector<DummyEvent> evts;
+    evts.reserve(N);
+    for (int i = 0; i < N; ++i)
+        evts.push_back(DummyEvent(i, i % 3, i % 10 ? &owners[i % 40] : NULL));
+
+    mt19937 gen(12345);
+    uniform_int_distribution<int> pick(0, N - 1);
+    exponential_distribution<double> expd(0.01);
+    uniform_int_distribution<int> op(0, 10);
+
+    auto draw = [&](int64_t now) -> Tick {
+        switch (dist) {
+        case 0: return Tick(now + int64_t(gen() % 1000));
+        case 1: return Tick(now + int64_t(expd(gen)));
+        case 2: return Tick(now + int64_t((gen() % 2) ? gen() % 10 : 100000 + gen() % 10));
+        // mostly at the current time (the immediate lanes)
+        default: return Tick(now + int64_t((gen() % 4) ? 0 : gen() % 50));
+        }
+    };
+
+    vector<int> out;
+    int64_t now = 0;
+    for (int step = 0; step < 20 * N; ++step) {
+        int o = op(gen);
+        DummyEvent &e = evts[pick(gen)];
+        if (o < 5) {
+            if (!e.isInQueue()) e.post(draw(now));
+        }
+        else if (o < 6) {
+            e.drop();
+        }
+        else if (o < 7) {
+            e.reschedule(draw(now));
+        }
+        else if (o < 8) {
+            e.cancelLazy();
+        }
+        else {
+            Event *f = Event::getFirst();
+            if (f != NULL) {
+                REQUIRE(int64_t(f->getTime()) >= now);
+                now = int64_t(f->getTime());
+                f->drop();
+                out.push_back(static_cast<DummyEvent *>(f)->id);
+            }
+        }
+    }
+    while (Event *f = Event::getFirst()) {
+        REQUIRE(int64_t(f->getTime()) >= now);
+        now = int64_t(f->getTime());
+        f->drop();
+        out.push_back(static_cast<DummyEvent *>(f)->id);
+    }
+    REQUIRE(Event::getEventQueue().empty());
+    return out;
+}
+
+TEST_CASE("EventQueue - same order for all implementations", "[eventqueue]")
+{
+    const char *specs[] = { "heap(2)", "heap(4)", "heap(8)", "calendar", "ladder",
+                            "twolevel", "lanes(set)", "lanes(calendar)" };
+    for (int dist = 0; dist < 4; ++dist) {
+        // the reference, without the lanes
+        SimContext::current().setImmediateLanes(false);
+        vector<int> ref = runSequence("set", dist);
+        for (bool lanes : { false, true }) {
+            SimContext::current().setImmediateLanes(lanes);
+            for (auto s : specs) {
+                INFO("queue = " << s << ", distribution = " << dist << ", lanes = " << lanes);
+                REQUIRE(runSequence(s, dist) == ref);
+            }
+        }
+    }
+    SimContext::current().setImmediateLanes(false);
+    Event::setEventQueue("set");
+}
+
+/* Posts events at the current time, with three priorities: some of
+   them post themselves again, and drop other ones */
+class Burst : public Entity {
+public:
+    vector<string> log;
+    vector<unique_ptr<DummyEvent> > evts;
+    GEvent<Burst> tick;
+    int steps;
+    size_t inLanes;
+
+    class Logged : public DummyEvent {
+        Burst &_b;
+        int _count;
+    public:
+        Logged(Burst &b, int i, int p) : DummyEvent(i, p), _b(b), _count(0) {}
+        void doit() {
+            _b.log.push_back(to_string(int64_t(SIMUL.getTime())) + ":" + to_string(id));
+            if (id % 5 == 0 && ++_count % 3 != 0) post(SIMUL.getTime());
+            if (id % 7 == 0) _b.evts[(id + 3) % _b.evts.size()]->drop();
+        }
+    };
+
+    Burst() : Entity(""), tick(this, &Burst::onTick), steps(0), inLanes(0) {
+        for (int i = 0; i < 40; ++i)
+            evts.emplace_back(new Logged(*this, i, i % 3 == 0 ? 0 : 8 + i % 2));
+    }
+    void onTick(Event *) {
+        for (auto &e : evts)
+            if (!e->isInQueue()) {
+                if (e->id % 4 == 0) e->process();
+                else e->post(SIMUL.getTime() + (e->id % 3 == 1 ? 0 : 1));
+            }
+        ImmediateLanes *q = dynamic_cast<ImmediateLanes *>(&Event::getEventQueue());
+        if (q != NULL) inLanes = max(inLanes, q->getLaneEvents());
+        if (++steps < 6) tick.post(SIMUL.getTime() + 10);
+    }
+    void newRun() { steps = 0; tick.post(0); }
+    void endRun() {}
+};
+
+TEST_CASE("EventQueue - immediate lanes", "[eventqueue]")
+{
+    vector<string> ref;
+    for (bool lanes : { false, true }) {
+        SimContext ctx;
+        SimContext::Scope scope(ctx);
+        ctx.setImmediateLanes(lanes);
+        Burst b;
+        SIMUL.initRuns();
+        SIMUL.initSingleRun();
+        SIMUL.run_to(25);
+        if (lanes) {
+            ImmediateLanes &q = dynamic_cast<ImmediateLanes &>(ctx.getEventQueue());
+            REQUIRE(q.size() == q.getMain().size() + q.getLaneEvents());
+            // a dump in order, lanes included
+            vector<Event *> v;
+            q.dump(v);
+            REQUIRE(v.size() == q.size());
+            REQUIRE(is_sorted(v.begin(), v.end(), Event::Cmp()));
+        }
+        SIMUL.run_to(100);
+        SIMUL.endSingleRun();
+        if (!lanes) ref = b.log;
+        else REQUIRE(b.log == ref);
+        REQUIRE((b.inLanes > 0) == lanes);
+        REQUIRE(b.log.size() > 200);
+    }
+}
+
+TEST_CASE("EventQueue - drain", "[eventqueue]")
+{
+    const char *specs[] = { "set", "heap", "calendar", "ladder", "twolevel",
+                            "lanes(heap)" };
+    static const char owners[7] = {};
+    for (auto s : specs) {
+        INFO("queue = " << s);
+        SimContext ctx;
+        SimContext::Scope scope(ctx);
+        ctx.setEventQueue(s);
+        vector<DummyEvent> evts;
+        evts.reserve(500);
+        for (int i = 0; i < 500; ++i) evts.push_back(DummyEvent(i, i % 3, &owners[i % 7]));
+        for (int i = 0; i < 500; ++i) evts[i].post(Tick((i * 37) % 101));
+
+        EventQueue &q = ctx.getEventQueue();
+        vector<Event *> d, v(1, nullptr);
+        q.dump(d);
+        // appended, in any order
+        q.drain(v);
+        REQUIRE(q.empty());
+        REQUIRE(q.size() == 0);
+        REQUIRE(v.size() == 501);
+        v.erase(v.begin());
+        sort(v.begin(), v.end(), Event::Cmp());
+        REQUIRE(v == d);
+
+        // the events are inserted again in any order
+        reverse(v.begin(), v.end());
+        for (Event *e : v) q.insert(e);
+        REQUIRE(q.size() == 500);
+
+        // moved to another queue, they come out in the same order
+        ctx.setEventQueue(string(s) == "heap" ? "ladder" : "heap");
+        for (Event *e : d) {
+            REQUIRE(ctx.firstEvent() == e);
+            e->drop();
+        }
+        REQUIRE(ctx.getEventQueue().empty());
+    }
+}
+
+TEST_CASE("EventQueue - reschedule", "[eventqueue]")
+{
+    const char *specs[] = { "set", "heap", "calendar", "ladder", "twolevel" };
+    for (auto s : specs) {
+        INFO("queue = " << s);
+        Event::setEventQueue(s);
+        DummyEvent a(1), b(2), c(3);
+        a.post(10);
+        b.post(20);
+        c.reschedule(30);
+        REQUIRE(c.isInQueue());
+
+        a.reschedule(25);
+        REQUIRE(Event::getFirst() == &b);
+        b.reschedule(25);
+        // same time and priority: FIFO order of the reschedule
+        REQUIRE(Event::getFirst() == &a);
+        a.reschedule(5);
+        REQUIRE(Event::getFirst() == &a);
+        REQUIRE(Event::getEventQueue().size() == 3);
+
+        a.drop(); b.drop(); c.drop();
+        REQUIRE(Event::getEventQueue().empty());
+    }
+    Event::setEventQueue("set");
+}
+
+TEST_CASE("EventQueue - lazy cancellation", "[eventqueue]")
+{
+    const char *specs[] = { "set", "heap", "calendar", "ladder", "twolevel" };
+    for (auto s : specs) {
+        INFO("queue = " << s);
+        SimContext ctx;
+        SimContext::Scope scope(ctx);
+        ctx.setEventQueue(s);
+        DummyEvent a(1), b(2), c(3), d(4);
+        a.post(10);
+        b.post(20);
+        c.post(30);
+        a.cancelLazy();
+        REQUIRE(!a.isInQueue());
+        // the tombstone stays in the queue until it is at its head
+        REQUIRE(ctx.getEventQueue().size() == 3);
+        REQUIRE(Event::getFirst() == &b);
+        REQUIRE(ctx.getEventQueue().size() == 2);
+        REQUIRE(ctx.getSkippedTombstones() == 1);
+
+        // posted again while still in the queue
+        c.cancelLazy();
+        c.post(15);
+        REQUIRE(c.isInQueue());
+        REQUIRE(Event::getFirst() == &c);
+        c.cancelLazy();
+        c.reschedule(40);
+        REQUIRE(Event::getFirst() == &b);
+        REQUIRE(ctx.getEventQueue().size() == 2);
+
+        // dropped, or destroyed, while cancelled
+        b.cancelLazy();
+        b.drop();
+        REQUIRE(ctx.getEventQueue().size() == 1);
+        {
+            DummyEvent e(5);
+            e.post(1);
+            e.cancelLazy();
+        }
+        REQUIRE(ctx.getEventQueue().size() == 1);
+
+        // left behind when the queue is changed
+        d.post(50);
+        d.cancelLazy();
+        ctx.setEventQueue("set");
+        REQUIRE(ctx.getEventQueue().size() == 1);
+        d.post(5);
+        REQUIRE(Event::getFirst() == &d);
+        REQUIRE(ctx.getSkippedTombstones() == 1);
+        c.drop(); d.drop();
+        REQUIRE(ctx.getEventQueue().empty());
+    }
+}
+
+/* A periodic tick that cancels and re-arms a timeout */
+class Watchdog : public Entity {
+public:
+    GEvent<Watchdog> tick, timeout;
+    bool lazy;
+    int ticks, timeouts;
+
+    Watchdog(bool l) : Entity(""), tick(this, &Watchdog::onTick),
+                       timeout(this, &Watchdog::onTimeout), lazy(l),
+                       ticks(0), timeouts(0) {}
+
+    void onTick(Event *) {
+        ++ticks;
+        if (lazy) timeout.cancelLazy();
+        else timeout.drop();
+        if (ticks % 3 != 0) timeout.post(SIMUL.getTime() + 15);
+        tick.post(SIMUL.getTime() + (ticks % 5 != 0 ? 10 : 20));
+    }
+    void onTimeout(Event *) { ++timeouts; }
+    void newRun() { ticks = timeouts = 0; tick.post(0); }
+    void endRun() {}
+};
+
+TEST_CASE("EventQueue - lazy cancellation in a simulation", "[eventqueue]")
+{
+    const char *specs[] = { "set", "heap", "calendar", "ladder", "twolevel" };
+    for (auto s : specs) {
+        INFO("queue = " << s);
+        int ticks[2], timeouts[2];
+        uint64_t executed[2];
+        for (int lazy = 0; lazy < 2; ++lazy) {
+            SimContext ctx;
+            SimContext::Scope scope(ctx);
+            ctx.setEventQueue(s);
+            Watchdog w(lazy);
+            SIMUL.run(10000);
+            ticks[lazy] = w.ticks;
+            timeouts[lazy] = w.timeouts;
+            executed[lazy] = SIMUL.getExecutedEvents();
+            if (lazy) REQUIRE(ctx.getSkippedTombstones() > 0);
+            else REQUIRE(ctx.getSkippedTombstones() == 0);
+        }
+        REQUIRE(timeouts[0] > 0);
+        REQUIRE(ticks[0] == ticks[1]);
+        REQUIRE(timeouts[0] == timeouts[1]);
+        REQUIRE(executed[0] == executed[1]);
+        REQUIRE(executed[0] == uint64_t(ticks[0] + timeouts[0]));
+    }
+}
+
+TEST_CASE("EventQueue - two levels", "[eventqueue]")
+{
+    SimContext ctx;
+    SimContext::Scope scope(ctx);
+    ctx.setEventQueue("twolevel");
+    TwoLevelQueue &q = dynamic_cast<TwoLevelQueue &>(ctx.getEventQueue());
+
+    Watchdog a(false), b(false);
+    REQUIRE(a.tick.getOwner() == &a);
+    DummyEvent d(1);
+    REQUIRE(d.getOwner() == NULL);
+
+    a.tick.post(10);
+    a.timeout.post(5);
+    b.tick.post(7);
+    d.post(6);
+    // one group per entity, and one for the event without owner
+    REQUIRE(q.getGroups() == 3);
+    REQUIRE(q.size() == 4);
+    REQUIRE(Event::getFirst() == &a.timeout);
+    a.timeout.drop();
+    REQUIRE(Event::getFirst() == &d);
+    d.drop();
+    REQUIRE(q.getGroups() == 2);
+    b.tick.reschedule(20);
+    REQUIRE(Event::getFirst() == &a.tick);
+    a.tick.drop();
+    REQUIRE(Event::getFirst() == &b.tick);
+    b.tick.drop();
+    REQUIRE(q.empty());
+    REQUIRE(q.getGroups() == 0);
+}
+
+TEST_CASE("EventQueue - priority range", "[eventqueue]")
+{
+    DummyEvent a(1, Event::MAX_PRIORITY), b(2, Event::MIN_PRIORITY), c(3);
+    a.post(10);
+    b.post(10);
+    c.post(10);
+    REQUIRE(Event::getFirst() == &b);
+    b.drop();
+    REQUIRE(Event::getFirst() == &c);
+    a.drop(); c.drop();
+
+    DummyEvent d(4, Event::MAX_PRIORITY + 1);
+    REQUIRE_THROWS(d.post(10));
+    REQUIRE(!d.isInQueue());
+}
+
+TEST_CASE("EventQueue - unknown implementation", "[eventqueue]")
+{
+    REQUIRE_THROWS(EventQueue::create("fibonacci"));
+    REQUIRE_THROWS(EventQueue::create("heap(3)"));
+}
+
+TEST_CASE("EventQueue - simulation with all implementations", "[eventqueue]")
+{
+    const char *specs[] = { "set", "heap", "calendar", "ladder", "twolevel" };
+    for (auto s : specs) {
+        INFO("queue = " << s);
+        Event::setEventQueue(s);
+        MyEntity me("Pippo");
+        SIMUL.run(12);
+        REQUIRE(me.isAFirst());
+        REQUIRE(me.getCounter() == 2);
+    }
+}
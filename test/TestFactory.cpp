@@ -67,3 +67,11 @@ TEST_CASE("Factory1", "factory1")
         REQUIRE(ptr2->getParam() == "Error");
     }
 }
+
+TEST_CASE("Factory - find", "factory1")
+{
+    FACT(A).regCreateFn("B", &B::create);
+
+    REQUIRE(FACT(A).find("B") == &B::create);
+    REQUIRE(FACT(A).find("D") == nullptr);
+}
@@ -0,0 +1,154 @@
+#include <memory>
+#include <string>
+
+#include <entity.hpp>
+#include <gevent.hpp>
+#include <lambdaevent.hpp>
+#include <particle.hpp>
+#include <simloop.hpp>
+#include <simul.hpp>
+
+#include "catch.hpp"
+
+using namespace std;
+using namespace MetaSim;
+
+/* A periodic entity with a run-time and a compile-time bound event */
+class Blinker : public Entity {
+public:
+    // the handler must be declared before the bound event
+    void onOn(Event *e) { ++ons; last = e; off.post(SIMUL.getTime() + 1); }
+    void onOff(Event *e) { ++offs; last = e; on.post(SIMUL.getTime() + 9); }
+
+    GEvent<Blinker> on;
+    GEvent<Blinker, &Blinker::onOff> off;
+    int ons, offs;
+    Event *last;
+
+    Blinker() : Entity(""), on(this, &Blinker::onOn), off(this),
+                ons(0), offs(0), last(NULL) {}
+
+    void newRun() { ons = offs = 0; on.post(0); }
+    void endRun() {}
+};
+
+TEST_CASE("GEvent - handler bound at compile time", "[gevent]")
+{
+    SimContext ctx;
+    SimContext::Scope s(ctx);
+    Blinker b;
+    SIMUL.run(100);
+    // on at 0, 10, ..., 100; off at 1, 11, ..., 91
+    REQUIRE(b.ons == 11);
+    REQUIRE(b.offs == 10);
+    REQUIRE(b.last == &b.on);
+
+    // the bound event does not store the handler
+    REQUIRE(sizeof(b.off) < sizeof(b.on));
+
+    // copied to another object, the handler is the same
+    Blinker c;
+    GEvent<Blinker, &Blinker::onOff> e(b.off, c);
+    e.doit();
+    REQUIRE(c.offs == 1);
+    REQUIRE(c.last == &e);
+    REQUIRE(c.on.isInQueue());
+    c.on.drop();
+}
+
+/* Counts the on events of a Blinker */
+class OnCount : public StatCount {
+public:
+    void probe(GEvent<Blinker> &e) { record(1); }
+};
+
+TEST_CASE("Simulation - main loop without exceptions", "[gevent]")
+{
+    SimContext ctx;
+    SimContext::Scope s(ctx);
+    Simulation &sim = ctx.getSimulation();
+    sim.setVerbose(false);
+    Blinker b;
+    OnCount c;
+    attach_stat(c, b.on);
+    sim.initRuns();
+    sim.initSingleRun();
+
+    // on at 0, 10, 20, 30; off at 1, 11, 21
+    REQUIRE(sim.loop(StopAfter(30)) == Simulation::LOOP_STOPPED);
+    REQUIRE(sim.getTime() == 30);
+    REQUIRE(b.ons == 4);
+    REQUIRE(b.offs == 3);
+    REQUIRE(c.getValue() == 4);
+
+    // the off at 31, the on at 40
+    REQUIRE(sim.loop(StopAfterEvents(2)) == Simulation::LOOP_STOPPED);
+    REQUIRE(sim.getTime() == 40);
+    REQUIRE(sim.getExecutedEvents() == 9);
+
+    // without the particles, the stat records nothing
+    typedef LoopOptions<false, false> Bare;
+    REQUIRE(sim.loop<Bare>(StopBefore(60)) == Simulation::LOOP_STOPPED);
+    REQUIRE(b.ons == 6);
+    REQUIRE(c.getValue() == 5);
+
+    // any callable stops it
+    REQUIRE(sim.advance([&](Tick, Tick, uint64_t) { return b.ons == 8; }) ==
+            Simulation::LOOP_STOPPED);
+    REQUIRE(sim.getTime() == 70);
+    REQUIRE(c.getValue() == 7);
+
+    // the first event at or after the end is the last one
+    REQUIRE(sim.advance(StopAt(75)) == Simulation::LOOP_STOPPED);
+    REQUIRE(sim.getTime() == 80);
+
+    sim.endSingleRun();
+    REQUIRE(sim.loop(StopAfter(1000)) == Simulation::LOOP_EMPTY);
+}
+
+TEST_CASE("LambdaEvent - callable stored in the event", "[gevent]")
+{
+    SimContext ctx;
+    SimContext::Scope s(ctx);
+
+    int count = 0;
+    Tick when = 0;
+    LambdaEvent e([&] { ++count; when = SIMUL.getTime(); });
+    e.post(5);
+    SIMUL.sim_step();
+    REQUIRE(count == 1);
+    REQUIRE(when == 5);
+
+    // the callable may take the event
+    Event *self = NULL;
+    LambdaEvent f([&](Event *ev) { self = ev; });
+    f.doit();
+    REQUIRE(self == &f);
+}
+
+TEST_CASE("LambdaEvent - disposable events from the pool", "[gevent]")
+{
+    SimContext ctx;
+    SimContext::Scope s(ctx);
+
+    // the captured state is destroyed with the event
+    auto token = make_shared<int>(0);
+    for (int i = 0; i < 10; ++i)
+        Event::create<LambdaEvent>([token, i] { *token += i; })
+            ->post(Tick(i), true);
+    REQUIRE(token.use_count() == 11);
+    for (int i = 0; i < 10; ++i) SIMUL.sim_step();
+    REQUIRE(*token == 45);
+    REQUIRE(token.use_count() == 1);
+
+    const EventPool *p = ctx.getEventPool<LambdaEvent>();
+    REQUIRE(p != nullptr);
+    REQUIRE(p->live() == 0);
+
+    // a larger buffer for larger captures
+    string a = "abc", b = "def";
+    string r;
+    BasicLambdaEvent<128> big([a, b, &r] { r = a + b; });
+    big.doit();
+    REQUIRE(r == "abcdef");
+}
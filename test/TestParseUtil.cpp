@@ -139,3 +139,66 @@ TEST_CASE("ParseUtils4", "parsedouble")
     REQUIRE(unit == "us");
 }
 
+
+TEST_CASE("ParseUtil - views", "[strview]")
+{
+    using parse_util::StrView;
+    const string c = "code1(a,b); code2( x , f(y, z) ); code3(a, b, c);";
+
+    // the views point into the string
+    vector<StrView> instr = parse_util::split_instr(StrView(c));
+    REQUIRE(instr.size() == 3);
+    REQUIRE(instr[1] == "code2( x , f(y, z) )");
+    REQUIRE(instr[1].data() == c.data() + c.find("code2"));
+
+    StrView tok = parse_util::get_token(instr[1]);
+    StrView par = parse_util::get_param(instr[1]);
+    REQUIRE(tok == "code2");
+    REQUIRE(par == " x , f(y, z) ");
+    vector<StrView> params = parse_util::split_param(par);
+    REQUIRE(params.size() == 2);
+    REQUIRE(params[0] == "x");
+    REQUIRE(params[1] == "f(y, z)");
+    REQUIRE(params[1].data() == c.data() + c.find("f(y"));
+
+    // the same results as the functions on strings
+    const string inputs[] = { "", "   ", "a", " a b ", "unif(1, 2)",
+                              "f(a, g(b), c)", "x(", "3.5ms", " 12 " };
+    for (const string &s : inputs) {
+        REQUIRE(parse_util::remove_spaces(StrView(s)).str() == parse_util::remove_spaces(s));
+        REQUIRE(parse_util::to_strings(parse_util::split(StrView(s), StrView(" ")))
+                == parse_util::split(s, " "));
+        REQUIRE(parse_util::to_strings(parse_util::split_param(StrView(s)))
+                == parse_util::split_param(s));
+        REQUIRE(parse_util::get_param(StrView(s)).str() == parse_util::get_param(s));
+        double n1, n2;
+        string u1;
+        StrView u2;
+        parse_util::parse_double(s, n1, u1);
+        parse_util::parse_double(StrView(s), n2, u2);
+        REQUIRE(n1 == n2);
+        REQUIRE(u1 == u2.str());
+    }
+    REQUIRE(parse_util::split_param(string("a, f(b")) == vector<string>({ "a", "f(b" }));
+    REQUIRE_THROWS_AS(parse_util::get_token(StrView("  ")), const std::out_of_range &);
+
+    // a view of a part of a buffer, not terminated
+    const char buf[] = "2500us;";
+    REQUIRE(Tick::parse(StrView(buf, 6)) == Tick("2500us"));
+    REQUIRE(Tick::parse(StrView(buf, 4)) == Tick("2500"));
+    REQUIRE_THROWS_AS(Tick::parse(StrView("3 min")), const parse_util::ParseExc &);
+}
+
+TEST_CASE("ParseUtil - string literals", "[strview]")
+{
+    // the literals call the functions on strings, not the views
+    REQUIRE(parse_util::remove_spaces("  ab ") == "ab");
+    REQUIRE(parse_util::split("a,b", ",") == vector<string>({ "a", "b" }));
+    REQUIRE(parse_util::split_instr("f(1); g(2);") == vector<string>({ "f(1)", "g(2)" }));
+    REQUIRE(parse_util::get_token("exp(1)") == "exp");
+    REQUIRE(parse_util::get_token("x=1", "=") == "x");
+    REQUIRE(parse_util::get_param("exp(1)") == "1");
+    REQUIRE(parse_util::get_param("[a]", "[", "]") == "a");
+    REQUIRE(parse_util::split_param("a, f(b, c)") == vector<string>({ "a", "f(b, c)" }));
+    REQUIRE(parse_util::split_param("a; b", ";") == vector<string>({ "a", "b" }));
+}
@@ -1,5 +1,6 @@
 #include <myentity.hpp>
 #include <basestat.hpp>
+#include <bufferedstat.hpp>
 #include <iostream>
 #include "catch.hpp"
 
@@ -58,3 +59,122 @@ TEST_CASE("Test Particle getLastValue()", "[statistics]")
     REQUIRE(s.getValue() == 9);
     REQUIRE(s.getLastValue() == 9);
 }
+
+/* records the time of the event in the stat S */
+template <class S>
+class TimeStat : public S {
+public:
+    template <class... A>
+    TimeStat(A... a) : S(a...) {}
+    void probe(MetaSim::GEvent<MyEntity> &e) {
+        this->record(double(SIMUL.getTime()));
+    }
+};
+
+/* Counts the calls of its probe */
+class ProbedStat : public StatCount {
+public:
+    int probes;
+    ProbedStat() : probes(0) {}
+    void probe(MetaSim::GEvent<MyEntity> &e) {
+        ++probes;
+        record(1);
+    }
+};
+
+struct ProbedTrace {
+    int probes;
+    ProbedTrace() : probes(0) {}
+    void probe(MetaSim::GEvent<MyEntity> &e) { ++probes; }
+};
+
+TEST_CASE("Test Particle gating during the transitory", "[statistics]")
+{
+    SimContext ctx;
+    SimContext::Scope sc(ctx);
+    MyEntity me("Pippo");
+    ProbedStat gated, ungated;
+    ungated.setGated(false);
+    ProbedTrace trace;
+    attach_stat(gated, me.eventA);
+    attach_stat(ungated, me.eventA);
+    attach_stat(trace, me.eventA);
+    BaseStat::setTransitory(8);
+
+    SIMUL.run(22);
+
+    // 0, 5, 10, 15, 20, 25: the probes of the gated stat are
+    // skipped until 10, the samples of the others are discarded
+    REQUIRE(gated.getValue() == 4);
+    REQUIRE(gated.probes == 4);
+    REQUIRE(ungated.getValue() == 4);
+    REQUIRE(ungated.probes == 6);
+    REQUIRE(trace.probes == 6);
+}
+
+TEST_CASE("Test buffered stats", "[statistics]")
+{
+    SimContext ctx;
+    SimContext::Scope sc(ctx);
+
+    MyEntity me("Pippo");
+    TimeStat<StatMean> mean;
+    TimeStat<StatMin> min;
+    TimeStat<StatMax> max;
+    TimeStat<StatCount> count;
+    // a small buffer, reduced several times in a run
+    TimeStat<BufferedStat> bmean(BufferedStat::MEAN, "", 3);
+    TimeStat<BufferedStat> bmin(BufferedStat::MIN, "", 3);
+    TimeStat<BufferedStat> bmax(BufferedStat::MAX, "", 3);
+    TimeStat<BufferedStat> bcount(BufferedStat::COUNT, "", 3);
+    TimeStat<BufferedStat> bsqr(BufferedStat::SQRMEAN);
+    BaseStat *classic[] = { &mean, &min, &max, &count };
+    BaseStat *buffered[] = { &bmean, &bmin, &bmax, &bcount };
+    attach_stat(mean, me.eventA);
+    attach_stat(min, me.eventA);
+    attach_stat(max, me.eventA);
+    attach_stat(count, me.eventA);
+    attach_stat(bmean, me.eventA);
+    attach_stat(bmin, me.eventA);
+    attach_stat(bmax, me.eventA);
+    attach_stat(bcount, me.eventA);
+    attach_stat(bsqr, me.eventA);
+
+    // the samples before 12 are discarded
+    BaseStat::setTransitory(12);
+    SIMUL.run(50, 3);
+
+    // 15, 20, ..., 45
+    REQUIRE(bsqr.getSamples() == 7);
+    const double sqr = (15*15 + 20*20 + 25*25 + 30*30 + 35*35 + 40*40 +
+                        45*45) / 7.0;
+    for (int k = 0; k < 4; ++k) {
+        REQUIRE(buffered[k]->getValue() == Approx(classic[k]->getValue()));
+        REQUIRE(buffered[k]->getMean() == Approx(classic[k]->getMean()));
+    }
+    REQUIRE(bmean.getValue() == Approx(30));
+    REQUIRE(bmin.getValue() == 15);
+    REQUIRE(bmax.getValue() == 45);
+    REQUIRE(bcount.getValue() == Approx(210));
+    REQUIRE(bsqr.getValue() == Approx(sqr));
+    REQUIRE(bsqr.getBuffered() == 0);
+}
+
+TEST_CASE("Test buffered stats during the run", "[statistics]")
+{
+    SimContext ctx;
+    SimContext::Scope sc(ctx);
+
+    MyEntity me("Pippo");
+    TimeStat<BufferedStat> s(BufferedStat::MAX);
+    attach_stat(s, me.eventA);
+
+    SIMUL.initSingleRun();
+    SIMUL.run_to(12);
+    // the samples are only in the buffer: the value is computed
+    // when it is read
+    REQUIRE(s.getBuffered() == 3);
+    REQUIRE(s.getValue() == 10);
+    REQUIRE(s.getBuffered() == 0);
+    SIMUL.endSingleRun();
+}
@@ -0,0 +1,62 @@
+#include <memory>
+#include <vector>
+
+#include <basestat.hpp>
+#include <entity.hpp>
+#include <gevent.hpp>
+#include <pdes.hpp>
+#include <simul.hpp>
+
+#include "catch.hpp"
+#include "myentity.hpp"
+
+using namespace std;
+using namespace MetaSim;
+
+/* The token rings of myentity.hpp, 10 ticks between stations */
+static const int END = 5000;
+
+static vector<unique_ptr<RingStation> > buildRing(ParallelSimulation *psim)
+{
+    return buildRing(psim, 10, END);
+}
+
+TEST_CASE("ParallelSimulation - same results as the sequential engine", "[pdes]")
+{
+    vector<double> tok, tck;
+    {
+        SimContext ctx;
+        SimContext::Scope s(ctx);
+        auto st = buildRing(0);
+        SIMUL.run(END, 3);
+        for (auto &p : st) {
+            tok.push_back(p->tokens.getMean());
+            tck.push_back(p->ticks.getMean());
+        }
+    }
+
+    for (size_t nlp = 1; nlp <= 4; nlp *= 2) {
+        INFO("LPs = " << nlp);
+        ParallelSimulation psim(nlp);
+        psim.setLookahead(10);
+        auto st = buildRing(&psim);
+        psim.run(END, 3);
+        if (nlp > 1) REQUIRE(psim.getWindows() > 3);
+        for (int i = 0; i < NST; ++i) {
+            REQUIRE(st[i]->tokens.getMean() == tok[i]);
+            REQUIRE(st[i]->ticks.getMean() == tck[i]);
+        }
+    }
+}
+
+TEST_CASE("ParallelSimulation - lookahead violation", "[pdes]")
+{
+    ParallelSimulation psim(2);
+    psim.setLookahead(0, 1, 20);
+    psim.setLookahead(1, 0, 20);
+    auto st = buildRing(&psim);
+    REQUIRE_THROWS_AS(psim.run(1000), const ParallelSimulation::Exc &);
+
+    ParallelSimulation nolink(2);
+    REQUIRE_THROWS_AS(nolink.setLookahead(0, 1, 0), const ParallelSimulation::Exc &);
+}
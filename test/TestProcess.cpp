@@ -0,0 +1,167 @@
+#include <string>
+#include <vector>
+
+#include <entity.hpp>
+#include <process.hpp>
+#include <simul.hpp>
+
+#include "catch.hpp"
+
+using namespace std;
+using namespace MetaSim;
+
+/* Clients that take a unit of a resource for some time */
+class Shop : public Entity {
+    Resource _desk;
+    vector<Process> _clients;
+
+    Process client(int id, Tick arrival, Tick service) {
+        co_await delay(arrival);
+        co_await _desk.acquire();
+        log.push_back(id * 1000 + int(SIMUL.getTime()));
+        co_await delay(service);
+        _desk.release();
+    }
+public:
+    vector<int> log;
+
+    Shop(size_t desks) : Entity(""), _desk(desks) {}
+
+    void add(int id, Tick arrival, Tick service) {
+        _clients.push_back(client(id, arrival, service));
+        _clients.back().start(0);
+    }
+    Resource &desk() { return _desk; }
+    Process &get(size_t i) { return _clients[i]; }
+    void newRun() {}
+    void endRun() {}
+};
+
+TEST_CASE("Process - delays", "[process]")
+{
+    SimContext ctx;
+    SimContext::Scope s(ctx);
+    vector<int64_t> times;
+    auto body = [&]() -> Process {
+        for (int i = 1; i <= 3; ++i) {
+            times.push_back(int64_t(SIMUL.getTime()));
+            co_await delay(5 * i);
+        }
+    };
+    Process p = body();
+    REQUIRE(!p.done());
+    p.start(2);
+    SIMUL.initRuns();
+    SIMUL.initSingleRun();
+    SIMUL.run_to(100);
+    REQUIRE(times == vector<int64_t>({ 2, 7, 17 }));
+    REQUIRE(p.done());
+}
+
+TEST_CASE("Process - resources, in FIFO order", "[process]")
+{
+    SimContext ctx;
+    SimContext::Scope s(ctx);
+    Shop shop(1);
+    shop.add(1, 0, 10);
+    shop.add(2, 1, 10);
+    shop.add(3, 2, 10);
+    SIMUL.initRuns();
+    SIMUL.initSingleRun();
+    SIMUL.run_to(5);
+    REQUIRE(shop.desk().waiting() == 2);
+    REQUIRE(shop.desk().available() == 0);
+    SIMUL.run_to(100);
+    REQUIRE(shop.log == vector<int>({ 1000, 2010, 3020 }));
+    REQUIRE(shop.desk().available() == 1);
+    REQUIRE_THROWS_AS(shop.desk().release(), const Resource::Exc &);
+}
+
+TEST_CASE("Process - killed while waiting", "[process]")
+{
+    SimContext ctx;
+    SimContext::Scope s(ctx);
+    Shop shop(1);
+    shop.add(1, 0, 10);
+    shop.add(2, 1, 10);
+    shop.add(3, 2, 10);
+    SIMUL.initRuns();
+    SIMUL.initSingleRun();
+    SIMUL.run_to(5);
+    // client 2 leaves the queue
+    shop.get(1).kill();
+    REQUIRE(shop.desk().waiting() == 1);
+    SIMUL.run_to(100);
+    REQUIRE(shop.log == vector<int>({ 1000, 3010 }));
+}
+
+TEST_CASE("Process - no coroutine", "[process]")
+{
+    SimContext ctx;
+    SimContext::Scope s(ctx);
+    Process none;
+    REQUIRE_FALSE(none);
+    REQUIRE_THROWS_AS(none.start(0), const Process::Exc &);
+    REQUIRE_THROWS_AS(none.getEvent(), const Process::Exc &);
+
+    Shop shop(1);
+    shop.add(1, 0, 10);
+    shop.get(0).kill();
+    REQUIRE_THROWS_AS(shop.get(0).start(0), const Process::Exc &);
+}
+
+TEST_CASE("Process - signals", "[process]")
+{
+    SimContext ctx;
+    SimContext::Scope s(ctx);
+    Signal ready;
+    string order;
+    auto waiter = [&](char c) -> Process {
+        co_await ready;
+        order += c;
+        order += to_string(int64_t(SIMUL.getTime()));
+    };
+    auto notifier = [&]() -> Process {
+        co_await delay(7);
+        ready.notifyOne();
+        co_await delay(3);
+        ready.notify();
+    };
+    Process a = waiter('a'), b = waiter('b'), c = waiter('c'), n = notifier();
+    a.start(0);
+    b.start(0);
+    c.start(1);
+    n.start(0);
+    SIMUL.initRuns();
+    SIMUL.initSingleRun();
+    SIMUL.run_to(100);
+    REQUIRE(order == "a7b10c10");
+    REQUIRE(ready.waiting() == 0);
+}
+
+TEST_CASE("Process - exceptions and frames", "[process]")
+{
+    SimContext ctx;
+    SimContext::Scope s(ctx);
+    auto failing = []() -> Process {
+        co_await delay(1);
+        throw BaseExc("failed");
+    };
+    Process p = failing();
+    p.start(0);
+    SIMUL.initRuns();
+    SIMUL.initSingleRun();
+    REQUIRE_THROWS_AS(SIMUL.run_to(10), const BaseExc &);
+    REQUIRE(p.done());
+
+    // many processes, restarted: the frames are recycled
+    auto sleeper = []() -> Process { co_await delay(1); };
+    vector<Process> v(100);
+    for (int k = 0; k < 3; ++k)
+        for (Process &q : v) {
+            q = sleeper();
+            q.start(SIMUL.getTime());
+        }
+    SIMUL.run_to(20);
+    for (Process &q : v) REQUIRE(q.done());
+}
@@ -0,0 +1,214 @@
+#include <memory>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+#include <entity.hpp>
+#include <gevent.hpp>
+#include <profiler.hpp>
+#include <progress.hpp>
+#include <timeline.hpp>
+#include <simul.hpp>
+
+#include "catch.hpp"
+
+using namespace std;
+using namespace MetaSim;
+
+/* A periodic timer that also arms and cancels a timeout */
+class Timer : public Entity {
+public:
+    GEvent<Timer> tick, timeout;
+    int ticks;
+
+    Timer() : Entity(""), tick(this, &Timer::onTick),
+              timeout(this, &Timer::onTimeout), ticks(0) {}
+
+    void onTick(Event *) {
+        ++ticks;
+        timeout.drop();
+        timeout.post(SIMUL.getTime() + 100);
+        tick.post(SIMUL.getTime() + 10);
+    }
+    void onTimeout(Event *) {}
+    void newRun() { ticks = 0; tick.post(0); }
+    void endRun() {}
+};
+
+TEST_CASE("Profiler - disabled by default", "[profiler]")
+{
+    SimContext ctx;
+    REQUIRE(ctx.getProfiler() == nullptr);
+    ctx.enableProfiler();
+    REQUIRE(ctx.getProfiler() != nullptr);
+    ctx.enableProfiler(false);
+    REQUIRE(ctx.getProfiler() == nullptr);
+}
+
+TEST_CASE("Profiler - counts per event", "[profiler]")
+{
+    SimContext ctx;
+    SimContext::Scope s(ctx);
+    ctx.enableProfiler();
+    Profiler &p = *ctx.getProfiler();
+    ostringstream out;
+    p.setOutput(&out);
+
+    Timer t;
+    p.setTag(t.tick, "tick");
+    SIMUL.run(1000, 3);
+
+    // the ticks at 0, 10, ..., 1000 of 3 runs
+    const Profiler::Entry *e = p.find("tick");
+    REQUIRE(e != nullptr);
+    REQUIRE(e->executed == 3 * 101);
+    REQUIRE(e->posted == 3 * 102);
+    REQUIRE(e->dropped == 0);
+    REQUIRE(e->doitTime >= 0);
+
+    // the timeout is never executed: it is dropped at every tick
+    // but the first one (the last one is removed by the engine)
+    const Profiler::Entry *to = p.find("MetaSim::GEvent<Timer>");
+    REQUIRE(to != nullptr);
+    REQUIRE(to->executed == 0);
+    REQUIRE(to->posted == 3 * 101);
+    REQUIRE(to->dropped == 3 * 100);
+
+    REQUIRE(p.getExecuted() == 3 * 101);
+    REQUIRE(p.getMaxQueueSize() == 2);
+    REQUIRE(p.getWallTime() > 0);
+    REQUIRE(p.getEventsPerSec() > 0);
+
+    // printed at the end of the simulation
+    REQUIRE(out.str().find("tick") != string::npos);
+    REQUIRE(out.str().find("max queue size") != string::npos);
+}
+
+static shared_ptr<void> buildTimer()
+{
+    return make_shared<Timer>();
+}
+
+TEST_CASE("Profiler - parallel replications are merged", "[profiler]")
+{
+    SimContext ctx;
+    SimContext::Scope s(ctx);
+    ctx.enableProfiler();
+    ctx.getProfiler()->setOutput(NULL);
+    SIMUL.run(1000, 4, buildTimer, 2);
+    REQUIRE(ctx.getProfiler()->getExecuted() == 4 * 101);
+}
+
+TEST_CASE("Progress - reported every n events", "[profiler]")
+{
+    SimContext ctx;
+    SimContext::Scope s(ctx);
+    REQUIRE(ctx.getProgress() == nullptr);
+    vector<Progress::Sample> samples;
+    ctx.enableProgress(50).setCallback([&](const Progress::Sample &p) {
+        samples.push_back(p);
+    });
+
+    Timer t;
+    SIMUL.run(1000, 3);
+
+    // after 50, 100, ..., 300 events, at the end of the 3 runs
+    // and at the end of the simulation
+    REQUIRE(samples.size() == 6 + 3 + 1);
+    double done = 0;
+    for (const Progress::Sample &p : samples) {
+        REQUIRE(p.runs == 3);
+        REQUIRE(p.endTime == 1000);
+        REQUIRE(p.done >= done);
+        REQUIRE(p.wallTime >= 0);
+        done = p.done;
+    }
+    REQUIRE(samples[0].events == 50);
+    REQUIRE(samples[0].run == 0);
+    REQUIRE(samples[0].time == 490);
+    REQUIRE(samples[0].queueSize == 2);
+    REQUIRE(samples[0].eta >= 0);
+    REQUIRE(samples[2].events == 101);
+    REQUIRE(samples[2].done == Approx(1.0 / 3));
+
+    const Progress::Sample &last = ctx.getProgress()->last();
+    REQUIRE(last.final);
+    REQUIRE(last.run == 2);
+    REQUIRE(last.events == 3 * 101);
+    REQUIRE(last.done == 1);
+    REQUIRE(last.eta == 0);
+
+    ctx.disableProgress();
+    REQUIRE(ctx.getProgress() == nullptr);
+}
+
+TEST_CASE("Progress - written to a file", "[profiler]")
+{
+    const string path = "test_progress.json";
+    SimContext ctx;
+    SimContext::Scope s(ctx);
+    ctx.enableProgress(1000000).setFile(path);
+    SIMUL.run(1000, 4, buildTimer, 2);
+
+    // the parallel replications are only reported at the end
+    REQUIRE(ctx.getProgress()->last().events == 4 * 101);
+    ifstream f(path.c_str());
+    string json((istreambuf_iterator<char>(f)), istreambuf_iterator<char>());
+    REQUIRE(json.find("\"events\": 404") != string::npos);
+    REQUIRE(json.find("\"final\": true") != string::npos);
+    remove(path.c_str());
+}
+
+static size_t occurrences(const string &s, const string &x)
+{
+    size_t n = 0;
+    for (size_t i = s.find(x); i != string::npos; i = s.find(x, i + 1)) ++n;
+    return n;
+}
+
+TEST_CASE("Timeline - spans of the events", "[profiler]")
+{
+    const string path = "test_timeline.json";
+    SimContext ctx;
+    SimContext::Scope s(ctx);
+    ctx.enableProfiler();
+    Profiler &p = *ctx.getProfiler();
+    ostringstream out;
+    p.setOutput(&out);
+    Timer t;
+    p.setTag(t.tick, "tick");
+
+    Timeline &tl = p.enableTimeline(path);
+    REQUIRE(p.getTimeline() == &tl);
+    tl.setWindow(100, 500);
+    tl.setSampling(2);
+    REQUIRE_THROWS(tl.setWindow(10, 10));
+    SIMUL.run(1000, 3);
+
+    // the ticks at 100, 110, ..., 490 of 3 runs, one every two
+    REQUIRE(tl.getSpans() == 3 * 20);
+    p.disableTimeline();
+    REQUIRE(p.getTimeline() == nullptr);
+
+    ifstream f(path.c_str());
+    string json((istreambuf_iterator<char>(f)), istreambuf_iterator<char>());
+    REQUIRE(json.compare(0, 2, "[\n") == 0);
+    REQUIRE(json.compare(json.size() - 3, 3, "\n]\n") == 0);
+    REQUIRE(occurrences(json, "\"ph\": \"X\"") == 3 * 20);
+    REQUIRE(occurrences(json, "\"name\": \"tick\"") == 3 * 20);
+    REQUIRE(occurrences(json, "\"entity\": \"" + t.getName() + "\"") == 3 * 20);
+    REQUIRE(occurrences(json, "\"thread_name\"") == 3);
+    REQUIRE(json.find("\"tick\": 100,") != string::npos);
+    REQUIRE(json.find("\"tick\": 120,") != string::npos);
+    REQUIRE(json.find("\"tick\": 110,") == string::npos);
+    REQUIRE(json.find("\"tick\": 500,") == string::npos);
+    remove(path.c_str());
+
+    // at most n spans
+    Timeline &lim = p.enableTimeline(path);
+    lim.setMaxSpans(10);
+    SIMUL.run(1000, 1);
+    REQUIRE(lim.getSpans() == 10);
+    p.disableTimeline();
+    remove(path.c_str());
+}
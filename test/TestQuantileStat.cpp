@@ -0,0 +1,177 @@
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <vector>
+
+#include <entity.hpp>
+#include <gevent.hpp>
+#include <quantilestat.hpp>
+#include <randomvar.hpp>
+#include <simul.hpp>
+
+#include "catch.hpp"
+
+using namespace std;
+using namespace MetaSim;
+
+/* The exact quantile of sorted values, as the histogram */
+static double exact(const vector<double> &v, double q)
+{
+    size_t rank = max(size_t(1), size_t(ceil(q * v.size())));
+    return v[rank - 1];
+}
+
+static vector<double> sample(size_t n, RandNum seed)
+{
+    RandomGen g(seed);
+    vector<double> v(n);
+    for (double &x : v) x = -log(g.uniform()) * 10;
+    return v;
+}
+
+TEST_CASE("HdrHistogram - quantiles", "[quantile]")
+{
+    vector<double> v = sample(100000, 1);
+    HdrHistogram h;
+    for (double x : v) h.record(x);
+    sort(v.begin(), v.end());
+
+    REQUIRE(h.getCount() == v.size());
+    REQUIRE(h.getMin() == v.front());
+    REQUIRE(h.getMax() == v.back());
+    REQUIRE(h.quantile(0) == v.front());
+    REQUIRE(h.quantile(1) == v.back());
+    // relative error of 2^-8
+    for (double q : { 0.01, 0.5, 0.9, 0.99, 0.999 })
+        REQUIRE(h.quantile(q) == Approx(exact(v, q)).epsilon(1.0 / 256));
+
+    // the values out of the range
+    HdrHistogram r(1, 100, 3);
+    r.record(0);
+    r.record(0.5);
+    r.record(1000);
+    REQUIRE(r.quantile(0.3) == 0);
+    REQUIRE(r.quantile(0.9) == 1000);
+
+    REQUIRE_THROWS_AS(HdrHistogram(0, 1), const HdrHistogram::Exc &);
+    REQUIRE_THROWS_AS(HdrHistogram(1, 10, 30), const HdrHistogram::Exc &);
+}
+
+TEST_CASE("HdrHistogram - merge and state", "[quantile]")
+{
+    vector<double> v = sample(10000, 2);
+    HdrHistogram all, a, b;
+    for (size_t i = 0; i < v.size(); ++i) {
+        all.record(v[i]);
+        (i % 2 ? a : b).record(v[i]);
+    }
+    a.merge(b);
+    for (double q : { 0.5, 0.99, 0.999 }) REQUIRE(a.quantile(q) == all.quantile(q));
+    REQUIRE(a.getMean() == Approx(all.getMean()));
+
+    HdrHistogram other(1, 10);
+    REQUIRE_THROWS_AS(a.merge(other), const HdrHistogram::Exc &);
+
+    StateArchive ar;
+    all.saveState(ar);
+    HdrHistogram c;
+    c.record(5);
+    c.restoreState(ar);
+    REQUIRE(c.getCount() == all.getCount());
+    REQUIRE(c.quantile(0.99) == all.quantile(0.99));
+}
+
+TEST_CASE("TDigest - quantiles and merge", "[quantile]")
+{
+    vector<double> v = sample(100000, 3);
+    TDigest d, a, b;
+    for (size_t i = 0; i < v.size(); ++i) {
+        d.record(v[i]);
+        (i % 3 ? a : b).record(v[i]);
+    }
+    vector<double> s = v;
+    sort(s.begin(), s.end());
+
+    // the error in rank is small in the tails
+    for (double q : { 0.5, 0.9, 0.99, 0.999 }) {
+        double x = d.quantile(q);
+        double rank = double(lower_bound(s.begin(), s.end(), x) - s.begin()) / s.size();
+        REQUIRE(fabs(rank - q) < 0.01 * min(q, 1 - q) + 2e-4);
+    }
+    REQUIRE(d.size() <= TDigest::DEFAULT_COMPRESSION);
+    REQUIRE(d.quantile(0) == s.front());
+    REQUIRE(d.quantile(1) == s.back());
+
+    a.merge(b);
+    REQUIRE(a.getCount() == d.getCount());
+    for (double q : { 0.5, 0.99 })
+        REQUIRE(a.quantile(q) == Approx(d.quantile(q)).epsilon(0.01));
+
+    StateArchive ar;
+    d.saveState(ar);
+    TDigest c;
+    c.restoreState(ar);
+    REQUIRE(c.quantile(0.99) == d.quantile(0.99));
+
+    REQUIRE_THROWS_AS(TDigest(5), const TDigest::Exc &);
+}
+
+/* Records exponential service times */
+class Server : public Entity {
+    ExponentialVar _service;
+public:
+    GEvent<Server> done;
+    StatHistogram latency;
+    StatDigest digest;
+
+    Server() : Entity(""), _service(0.1), done(this, &Server::onDone),
+               latency("latency"), digest("digest", {0.99}) {}
+
+    void onDone(Event *) {
+        double t = _service.get();
+        latency.record(t);
+        digest.record(t);
+        done.post(SIMUL.getTime() + 1);
+    }
+    void newRun() { done.post(0); }
+    void endRun() {}
+};
+
+static shared_ptr<void> buildServer()
+{
+    return make_shared<Server>();
+}
+
+TEST_CASE("StatHistogram - quantiles of the runs", "[quantile]")
+{
+    double p99[2], conf[2];
+    for (int k = 0; k < 2; ++k) {
+        SimContext ctx;
+        SimContext::Scope s(ctx);
+        RandomVar::init(5);
+        Server srv;
+        REQUIRE(srv.latency.getQuantiles() == 3);
+        REQUIRE(srv.latency.getQuantile(1).getName() == "latency.p99");
+        REQUIRE(srv.latency.getQuantile(2).getName() == "latency.p99.9");
+
+        if (k == 0) SIMUL.run(20000, 5);
+        else SIMUL.run(20000, 5, buildServer, 2);
+
+        BaseStat &q = srv.latency.getQuantile(1);
+        REQUIRE(q.getExpNum() == 5);
+        p99[k] = q.getMean();
+        conf[k] = q.getConfInterval();
+        // the p99 of an exponential of mean 10
+        REQUIRE(p99[k] == Approx(10 * log(100.0)).epsilon(0.05));
+        REQUIRE(srv.latency.getMean() == Approx(10 * log(2.0)).epsilon(0.05));
+        REQUIRE(srv.digest.getMean() == Approx(p99[k]).epsilon(0.05));
+        REQUIRE(conf[k] > 0);
+    }
+    // the parallel replications give run r the stream r of the
+    // default generator, whatever the number of threads, while the
+    // sequential run() draws all the runs from the generator, one
+    // after the other (only the named streams are split by run):
+    // the factory overload of run() does not reproduce the numbers
+    // of the sequential one, and the results are only close
+    REQUIRE(p99[0] == Approx(p99[1]).epsilon(0.05));
+}
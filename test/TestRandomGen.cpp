@@ -0,0 +1,145 @@
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include <randomgen.hpp>
+#include <randomvar.hpp>
+#include <simcontext.hpp>
+
+#include "catch.hpp"
+
+using namespace std;
+using namespace MetaSim;
+
+static const char *const NAMES[] = { "minstd", "xoshiro256**", "pcg64", "philox" };
+
+TEST_CASE("RandomGen - xoshiro256** reference sequence", "[randomgen]")
+{
+    Xoshiro256Gen g(0);
+    const uint64_t s[4] = { 1, 2, 3, 4 };
+    g.setState(s);
+    REQUIRE(g.next() == 11520);
+    REQUIRE(g.next() == 0);
+    REQUIRE(g.next() == 1509978240);
+
+    const uint64_t zero[4] = { 0, 0, 0, 0 };
+    REQUIRE_THROWS(g.setState(zero));
+}
+
+TEST_CASE("RandomGen - Philox4x32-10 known answers", "[randomgen]")
+{
+    // the test vectors of Random123
+    const uint32_t c0[4] = { 0, 0, 0, 0 }, k0[2] = { 0, 0 };
+    const uint32_t r0[4] = { 0x6627e8d5, 0xe169c58d, 0xbc57ac4c, 0x9b00dbd8 };
+    const uint32_t c1[4] = { 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff },
+                   k1[2] = { 0xffffffff, 0xffffffff };
+    const uint32_t r1[4] = { 0x408f276d, 0x41c83b0e, 0xa20bc7c6, 0x6d5451fd };
+    const uint32_t c2[4] = { 0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344 },
+                   k2[2] = { 0xa4093822, 0x299f31d0 };
+    const uint32_t r2[4] = { 0xd16cfe09, 0x94fdcceb, 0x5001e420, 0x24126ea1 };
+
+    uint32_t out[4];
+    PhiloxGen::block(c0, k0, out);
+    for (int i = 0; i < 4; ++i) REQUIRE(out[i] == r0[i]);
+    PhiloxGen::block(c1, k1, out);
+    for (int i = 0; i < 4; ++i) REQUIRE(out[i] == r1[i]);
+    PhiloxGen::block(c2, k2, out);
+    for (int i = 0; i < 4; ++i) REQUIRE(out[i] == r2[i]);
+}
+
+TEST_CASE("RandomGen - jump, clone and state", "[randomgen]")
+{
+    for (const char *n : NAMES) {
+        INFO(n);
+        unique_ptr<RandomGen> a = RandomGen::create(n, 12345);
+        REQUIRE(a->getName().compare(0, 3, string(n), 0, 3) == 0);
+
+        // jump(k) is the same as k samples
+        unique_ptr<RandomGen> b = a->clone();
+        for (int i = 0; i < 1001; ++i) a->sample();
+        b->jump(1001);
+        REQUIRE(a->sample() == b->sample());
+        REQUIRE(a->uniform() == b->uniform());
+
+        // the state restores the sequence
+        StateArchive st;
+        a->saveState(st);
+        double u[3] = { a->uniform(), a->uniform(), a->uniform() };
+        st.rewind();
+        a->restoreState(st);
+        for (double x : u) REQUIRE(a->uniform() == x);
+
+        // a different seed, a different sequence
+        unique_ptr<RandomGen> c = RandomGen::create(n, 54321);
+        unique_ptr<RandomGen> d = RandomGen::create(n, 12345);
+        REQUIRE(c->sample() != d->sample());
+    }
+    REQUIRE_THROWS_AS(RandomGen::create("mt19937", 1), const RandomGen::Exc &);
+}
+
+TEST_CASE("RandomGen - streams", "[randomgen]")
+{
+    for (const char *n : NAMES) {
+        INFO(n);
+        unique_ptr<RandomGen> base = RandomGen::create(n, 1);
+        unique_ptr<RandomGen> s0 = base->clone(), s1 = base->clone(),
+            s2 = base->clone();
+        s0->stream(0, 3);
+        s1->stream(1, 3);
+        s2->stream(2, 3);
+        REQUIRE(s0->sample() == base->sample());
+        double u0 = s0->uniform(), u1 = s1->uniform(), u2 = s2->uniform();
+        REQUIRE(u0 != u1);
+        REQUIRE(u1 != u2);
+    }
+
+    // the streams of PCG64 are 2^64 numbers apart
+    Pcg64Gen a(3), b(3);
+    a.stream(1, 0);
+    b.jump(uint64_t(1) << 63);
+    b.jump(uint64_t(1) << 63);
+    REQUIRE(a.next() == b.next());
+
+    // the ones of Philox too, and a jump is a change of counter
+    PhiloxGen p(3), q(3);
+    q.jump(5);
+    for (int i = 0; i < 5; ++i) p.next();
+    REQUIRE(p.next() == q.next());
+}
+
+TEST_CASE("RandomGen - uniform values", "[randomgen]")
+{
+    for (const char *n : NAMES) {
+        INFO(n);
+        unique_ptr<RandomGen> g = RandomGen::create(n, 99);
+        const int N = 100000;
+        double sum = 0;
+        for (int i = 0; i < N; ++i) {
+            double u = g->uniform();
+            REQUIRE(u > 0);
+            REQUIRE(u < 1);
+            sum += u;
+            RandNum x = g->sample();
+            REQUIRE(x >= 0);
+            REQUIRE(x < g->getModule());
+        }
+        REQUIRE(sum / N == Approx(0.5).epsilon(0.01));
+    }
+}
+
+TEST_CASE("RandomGen - default generator of a context", "[randomgen]")
+{
+    SimContext ctx;
+    SimContext::Scope s(ctx);
+    UniformVar before(0, 1);
+    RandomVar::setGenerator(RandomGen::create("pcg64", 5));
+    REQUIRE(RandomVar::getDefaultGenerator().getName() == "pcg64");
+
+    // the new variables use the new generator, the old ones
+    // keep the previous one
+    UniformVar after(0, 1);
+    Pcg64Gen ref(5);
+    REQUIRE(after.get() == ref.uniform());
+    RandomGen minstd(1);
+    REQUIRE(before.get() == minstd.uniform());
+}
@@ -1,9 +1,16 @@
+#include <cstdio>
+#include <fstream>
 #include <iostream>
 #include <memory>
 #include <string>
 #include <vector>
+#include <aliastable.hpp>
+#include <datafile.hpp>
+#include <prefetchvar.hpp>
+#include <randomgen.hpp>
 #include <randomvar.hpp>
 #include <regvar.hpp>
+#include <simcontext.hpp>
 #include "catch.hpp"
 
 using namespace std;
@@ -229,3 +236,419 @@ TEST_CASE("RandomVar Cloning", "[RandomVar, Cloning]")
 
     REQUIRE(3 == v2->get());
 }
+
+/* Two variables built by f, each with its own generator seeded with 1 */
+template <class F>
+static void sameStreams(const char *gen, F f,
+                        unique_ptr<RandomVar> &a, unique_ptr<RandomVar> &b)
+{
+    RandomVar::setGenerator(RandomGen::create(gen, 1));
+    a = f();
+    RandomVar::setGenerator(RandomGen::create(gen, 1));
+    b = f();
+}
+
+TEST_CASE("RandomVar - parsed once", "[RandomVar]")
+{
+    SimContext ctx;
+    SimContext::Scope s(ctx);
+    RandomVar::clearParseCache();
+
+    // the second call copies the prototype, on the same generator
+    RandomVar::init(1);
+    unique_ptr<RandomVar> a = RandomVar::parsevar("unif(5,6)");
+    double x = a->get();
+    RandomVar::init(1);
+    unique_ptr<RandomVar> b = RandomVar::parsevar("unif(5,6)");
+    REQUIRE(b->get() == x);
+    REQUIRE(b.get() != a.get());
+    REQUIRE(b->getMinimum() == 5);
+    REQUIRE(b->getMaximum() == 6);
+
+    // a variable is bound to the generator of the current context
+    {
+        SimContext other;
+        SimContext::Scope so(other);
+        RandomVar::init(1);
+        unique_ptr<RandomVar> c = RandomVar::parsevar("unif(5,6)");
+        REQUIRE(c->get() == x);
+    }
+
+    RandomVar::Spec spec("exp(0.5)");
+    REQUIRE(spec.str() == "exp(0.5)");
+    RandomVar::init(3);
+    unique_ptr<RandomVar> d = spec.create();
+    double y = d->get();
+    RandomVar::init(3);
+    REQUIRE(spec.create()->get() == y);
+    REQUIRE(RandomVar::parsevar("exp(0.5)")->getMinimum() == d->getMinimum());
+
+    REQUIRE_THROWS_AS(RandomVar::Spec("nosuchvar(1)"), const parse_util::ParseExc &);
+    REQUIRE_THROWS_AS(RandomVar::parsevar("nosuchvar(1)"), const parse_util::ParseExc &);
+}
+
+TEST_CASE("RandomVar - fill and BufferedVar", "[RandomVar]")
+{
+    SimContext ctx;
+    SimContext::Scope s(ctx);
+
+    const char *specs[] = { "unif(2,5)", "exp(0.5)", "pareto(1,3)", "delta(4)" };
+    for (const char *gen : { "minstd", "xoshiro" }) {
+        for (const char *spec : specs) {
+            INFO(gen << " " << spec);
+            unique_ptr<RandomVar> a, b;
+            auto build = [spec] { return RandomVar::parsevar(spec); };
+
+            // the same values of get()
+            sameStreams(gen, build, a, b);
+            vector<double> v(1000);
+            a->fill(v.data(), v.size());
+            for (double x : v) REQUIRE(x == b->get());
+
+            // also through the buffer, with a partial block
+            sameStreams(gen, build, a, b);
+            BufferedVar buf(move(a), 64);
+            for (int i = 0; i < 100; ++i) REQUIRE(buf.get() == b->get());
+            buf.fill(v.data(), 30);
+            for (int i = 0; i < 30; ++i) REQUIRE(v[i] == b->get());
+            REQUIRE(buf.get() == b->get());
+        }
+    }
+
+    unique_ptr<RandomVar> w1, w2;
+    sameStreams("pcg64", [] { return unique_ptr<RandomVar>(new WeibullVar(1, 2)); },
+                w1, w2);
+    vector<double> v(10);
+    w1->fill(v.data(), v.size());
+    for (double x : v) REQUIRE(x == w2->get());
+
+    REQUIRE_THROWS(BufferedVar(RandomVar::parsevar("exp(1)")).getMaximum());
+}
+
+TEST_CASE("RandomVar - normal values in blocks", "[RandomVar]")
+{
+    SimContext ctx;
+    SimContext::Scope s(ctx);
+    RandomVar::setGenerator(RandomGen::create("pcg64", 3));
+
+    NormalVar n(2, 3);
+    vector<double> v(100001);
+    n.fill(v.data(), v.size());
+    double sum = 0, sqr = 0;
+    for (double x : v) {
+        sum += x;
+        sqr += x * x;
+    }
+    double mean = sum / v.size();
+    REQUIRE(mean == Approx(2).epsilon(0.02));
+    REQUIRE(sqr / v.size() - mean * mean == Approx(9).epsilon(0.02));
+}
+
+/* Largest distance between the empirical and the exact CDF, on a grid */
+template <class CDF>
+static double cdfDistance(RandomVar &v, CDF cdf, double from, double to,
+                          double &tail)
+{
+    const int N = 1000000, B = 200;
+    vector<int> counts(B + 1, 0);
+    int over = 0;
+    for (int i = 0; i < N; ++i) {
+        double x = v.get();
+        if (x >= to) ++over;
+        int b = int((x - from) / (to - from) * B);
+        counts[b < 0 ? 0 : (b > B ? B : b)]++;
+    }
+    double d = 0, acc = 0;
+    for (int b = 0; b < B; ++b) {
+        acc += counts[b];
+        d = max(d, fabs(acc / N - cdf(from + (to - from) * (b + 1) / B)));
+    }
+    tail = double(over) / N;
+    return d;
+}
+
+TEST_CASE("Ziggurat - normal and exponential distributions", "[RandomVar]")
+{
+    SimContext ctx;
+    SimContext::Scope s(ctx);
+    for (const char *gen : { "minstd", "xoshiro" }) {
+        INFO(gen);
+        RandomVar::setGenerator(RandomGen::create(gen, 11));
+        double tail;
+
+        NormalVar n(0, 1);
+        REQUIRE(n.getMethod() == NormalVar::ZIGGURAT);
+        auto phi = [](double x) { return 0.5 * erfc(-x / sqrt(2.0)); };
+        REQUIRE(cdfDistance(n, phi, -3.5, 3.5, tail) < 0.003);
+        // P(Z > 3.5), drawn from the tail beyond R = 3.44
+        REQUIRE(tail == Approx(2 * 2.326e-4).epsilon(0.15));
+
+        ExponentialVar e(2, ExponentialVar::ZIGGURAT);
+        auto expCdf = [](double x) { return 1 - exp(-2 * x); };
+        REQUIRE(cdfDistance(e, expCdf, 0, 4.5, tail) < 0.003);
+        // P(X > 4.5) = exp(-9), beyond R = 7.7 of the unit exponential
+        REQUIRE(tail == Approx(exp(-9.0)).epsilon(0.15));
+
+        NormalVar b(0, 1, NormalVar::BOX_MULLER);
+        REQUIRE(cdfDistance(b, phi, -3.5, 3.5, tail) < 0.003);
+    }
+}
+
+TEST_CASE("NormalVar - Box-Muller pairs in the object", "[RandomVar]")
+{
+    SimContext ctx;
+    SimContext::Scope s(ctx);
+    unique_ptr<RandomVar> a, b;
+
+    // variables with their own streams, used alternately: each
+    // one gets both values of its pairs
+    unique_ptr<RandomVar> c = RandomVar::parsevar("normal(10, 2, boxmuller)");
+    sameStreams("pcg64", [] { return RandomVar::parsevar("normal(0, 1, boxmuller)"); },
+                a, b);
+    for (int i = 0; i < 4; ++i) b->get();
+    for (int i = 0; i < 2; ++i) a->get(), c->get();
+    for (int i = 0; i < 2; ++i) a->get(), c->get();
+    REQUIRE(a->get() == b->get());
+
+    unique_ptr<RandomVar> z = RandomVar::parsevar("exp(1, ziggurat)");
+    REQUIRE(dynamic_cast<ExponentialVar &>(*z).getMethod() == ExponentialVar::ZIGGURAT);
+    REQUIRE_THROWS(RandomVar::parsevar("normal(0, 1, polar)"));
+}
+
+TEST_CASE("PoissonVar - inversion and PTRS", "[RandomVar]")
+{
+    SimContext ctx;
+    SimContext::Scope s(ctx);
+
+    // a small lambda gives the values of the sequential search
+    for (double lambda : { 0.5, 3.0, 9.5 }) {
+        RandomVar::setGenerator(RandomGen::create("minstd", 1));
+        UniformVar u01(0, 1);
+        RandomVar::setGenerator(RandomGen::create("minstd", 1));
+        PoissonVar p(lambda);
+        REQUIRE(p.getMethod() == PoissonVar::INVERSION);
+        vector<double> v(500);
+        p.fill(v.data(), 250);
+        for (int i = 250; i < 500; ++i) v[i] = p.get();
+        for (double x : v) {
+            double u = u01.get(), F = exp(-lambda), S = F;
+            int k = 0;
+            while (u >= S) {
+                ++k;
+                F = F * lambda / k;
+                S += F;
+            }
+            REQUIRE(x == k);
+        }
+    }
+
+    // moments and probabilities of PTRS
+    for (double lambda : { 10.0, 30.0, 400.0, 1e5 }) {
+        INFO(lambda);
+        PoissonVar p(lambda);
+        REQUIRE(p.getMethod() == PoissonVar::PTRS);
+        const int N = 400000;
+        double sum = 0, sqr = 0, mode = 0;
+        int k0 = int(lambda);
+        for (int i = 0; i < N; ++i) {
+            double x = p.get();
+            REQUIRE(x == floor(x));
+            REQUIRE(x >= 0);
+            sum += x;
+            sqr += x * x;
+            if (x == k0) ++mode;
+        }
+        double mean = sum / N;
+        REQUIRE(mean == Approx(lambda).epsilon(0.01));
+        REQUIRE(sqr / N - mean * mean == Approx(lambda).epsilon(0.03));
+        double pk = exp(-lambda + k0 * log(lambda) - lgamma(k0 + 1.0));
+        REQUIRE(mode / N == Approx(pk).epsilon(0.1));
+    }
+
+    REQUIRE_THROWS_AS(PoissonVar(5, PoissonVar::PTRS), const RandomVar::Exc &);
+    unique_ptr<RandomVar> q = RandomVar::parsevar("poisson(50, inversion)");
+    REQUIRE(dynamic_cast<PoissonVar &>(*q).getMethod() == PoissonVar::INVERSION);
+}
+
+TEST_CASE("AliasTable - probabilities", "[RandomVar]")
+{
+    vector<double> w = { 1, 0, 5, 2, 0.5, 1.5 };
+    AliasTable t(w);
+    REQUIRE(t.size() == w.size());
+    for (size_t i = 0; i < w.size(); ++i)
+        REQUIRE(t.getProbability(i) == Approx(w[i] / 10));
+
+    // the frequencies of a grid of uniform numbers
+    vector<int> count(w.size(), 0);
+    const int N = 100000;
+    for (int k = 0; k < N; ++k) count[t.sample((k + 0.5) / N)]++;
+    for (size_t i = 0; i < w.size(); ++i)
+        REQUIRE(fabs(double(count[i]) / N - w[i] / 10) < 1e-4);
+    REQUIRE(t.sample(0.9999999999999999) < w.size());
+
+    REQUIRE_THROWS_AS(AliasTable(vector<double>{ 1, -1 }), const AliasTable::Exc &);
+    REQUIRE_THROWS_AS(AliasTable(vector<double>{ 0, 0 }), const AliasTable::Exc &);
+}
+
+TEST_CASE("GenericVar - PDF from a file", "[RandomVar]")
+{
+    SimContext ctx;
+    SimContext::Scope s(ctx);
+    const char *name = "TestRandomVar_pdf.txt";
+    {
+        ofstream f(name);
+        // 1/1024 is exact: the sum must not exceed 1
+        f.precision(17);
+        for (int v = 1; v <= 1024; ++v) f << v * 3 << " " << 1.0 / 1024 << "\n";
+    }
+    unique_ptr<RandomVar> g = RandomVar::parsevar(string("PDF(") + name + ")");
+    remove(name);
+
+    const int N = 200000;
+    vector<double> v(N);
+    g->fill(v.data(), N / 2);
+    for (int i = N / 2; i < N; ++i) v[i] = g->get();
+    double sum = 0;
+    for (double x : v) {
+        REQUIRE(int(x) % 3 == 0);
+        REQUIRE(x >= 3);
+        REQUIRE(x <= 3072);
+        sum += x;
+    }
+    REQUIRE(sum / N == Approx(1537.5).epsilon(0.01));
+}
+
+TEST_CASE("DetVar - binary traces", "[RandomVar]")
+{
+    const char *text = "TestRandomVar_trace.txt", *bin = "TestRandomVar_trace.bin";
+    {
+        ofstream f(text);
+        for (int i = 0; i < 10; ++i) f << (i * 7) % 10 + 0.5 << " ";
+    }
+    REQUIRE(DataFile::convert(text, bin) == 10);
+    REQUIRE(DataFile::isBinary(bin));
+    REQUIRE_FALSE(DataFile::isBinary(text));
+
+    DetVar load(bin, DetVar::LOAD), map(bin), stream(bin, DetVar::STREAM, 3);
+    REQUIRE(map.getMode() == DetVar::MAP);
+    REQUIRE(stream.size() == 10);
+
+    // the same sequence, starting over after the end
+    vector<double> ref;
+    for (int i = 0; i < 25; ++i) ref.push_back((i % 10 * 7) % 10 + 0.5);
+    for (double x : ref) {
+        REQUIRE(load.get() == x);
+        REQUIRE(map.get() == x);
+        REQUIRE(stream.get() == x);
+    }
+    REQUIRE(map.getMinimum() == 0.5);
+    REQUIRE(map.getMaximum() == 9.5);
+    REQUIRE(stream.getMinimum() == 0.5);
+    REQUIRE(stream.getMaximum() == 9.5);
+
+    // the copies continue from the same point
+    unique_ptr<RandomVar> m2 = map.clone(), s2 = stream.clone();
+    vector<double> v(13);
+    map.fill(v.data(), v.size());
+    for (double x : v) {
+        REQUIRE(m2->get() == x);
+        REQUIRE(s2->get() == x);
+        REQUIRE(stream.get() == x);
+    }
+
+    // one mapping for all the variables of the file
+    unique_ptr<RandomVar> p = RandomVar::parsevar(string("trace(") + bin + ")");
+    REQUIRE(MappedData::open(bin).use_count() == 4);
+    REQUIRE(p->get() == 0.5);
+    p = RandomVar::parsevar(string("trace(") + bin + ", stream)");
+    REQUIRE(dynamic_cast<DetVar &>(*p).getMode() == DetVar::STREAM);
+
+    // a text file is still read in memory
+    DetVar t(text);
+    REQUIRE(t.getMode() == DetVar::LOAD);
+    REQUIRE(t.get() == 0.5);
+    REQUIRE(t.get() == 7.5);
+
+    remove(text);
+    remove(bin);
+    REQUIRE_THROWS_AS(DetVar(bin, DetVar::MAP), const RandomVar::Exc &);
+    {
+        ofstream f(bin, ios::binary);
+        f << "MSDATA01 but not a header";
+    }
+    REQUIRE_THROWS_AS(MappedData::open(bin), const DataFile::Exc &);
+    remove(bin);
+}
+
+/* Throws at the n-th value */
+class FailingVar : public UniformVar {
+    int _n;
+public:
+    explicit FailingVar(int n) : UniformVar(0, 1), _n(n) {}
+    CLONEABLE(RandomVar, FailingVar)
+    double get() { if (_n-- == 0) throw Exc("no more values", "FailingVar"); return 1; }
+    void fill(double *out, size_t n) { for (size_t i = 0; i < n; ++i) out[i] = get(); }
+};
+
+TEST_CASE("PrefetchVar - values of the substream", "[RandomVar]")
+{
+    SimContext ca, cb;
+    unique_ptr<PrefetchVar> p;
+    unique_ptr<RandomVar> ref;
+    {
+        SimContext::Scope s(ca);
+        RandomVar::setGenerator(RandomGen::create("xoshiro", 9));
+        p.reset(new PrefetchVar(RandomVar::parsevar("normal(5, 2)"), "service", 20));
+        REQUIRE(p->getCapacity() == 32);
+    }
+    {
+        SimContext::Scope s(cb);
+        RandomVar::setGenerator(RandomGen::create("xoshiro", 9));
+        ref = RandomVar::parsevar("normal(5, 2)");
+        ref->setStream("service");
+    }
+
+    // the same sequence, also after a new seeding of the runs
+    for (int run = 0; run < 3; ++run) {
+        {
+            SimContext::Scope s(ca);
+            RandomVar::initStreams(run);
+        }
+        {
+            SimContext::Scope s(cb);
+            RandomVar::initStreams(run);
+        }
+        vector<double> v(777);
+        p->fill(v.data(), 7);
+        for (size_t i = 7; i < v.size(); ++i) v[i] = p->get();
+        for (double x : v) REQUIRE(x == ref->get());
+    }
+
+    // a copy starts again from the substream
+    unique_ptr<RandomVar> q;
+    {
+        SimContext::Scope s(ca);
+        q = p->clone();
+    }
+    {
+        SimContext::Scope s(cb);
+        ref->setStream("service");
+        RandomVar::initStreams(2);
+    }
+    for (int i = 0; i < 100; ++i) REQUIRE(q->get() == ref->get());
+    {
+        SimContext::Scope s(ca);
+        q.reset();
+        p.reset();
+    }
+}
+
+TEST_CASE("PrefetchVar - exceptions", "[RandomVar]")
+{
+    SimContext ctx;
+    SimContext::Scope s(ctx);
+    // blocks of 4 values: the first 12 blocks are complete
+    PrefetchVar p(unique_ptr<RandomVar>(new FailingVar(50)), "failing", 16);
+    for (int i = 0; i < 48; ++i) REQUIRE(p.get() == 1);
+    REQUIRE_THROWS_AS(p.get(), const RandomVar::Exc &);
+}
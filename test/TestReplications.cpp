@@ -0,0 +1,422 @@
+#include <algorithm>
+#include <memory>
+#include <sstream>
+#include <vector>
+
+#include <basestat.hpp>
+#include <entity.hpp>
+#include <gevent.hpp>
+#include <randomvar.hpp>
+#include <simul.hpp>
+#include <sweep.hpp>
+
+#include "catch.hpp"
+#include "myentity.hpp"
+
+using namespace std;
+using namespace MetaSim;
+
+TEST_CASE("RandomGen - jump", "[replications]")
+{
+    RandomGen a(12345), b(12345);
+    for (int i = 0; i < 1000; ++i) a.sample();
+    b.jump(1000);
+    REQUIRE(a.getCurrSeed() == b.getCurrSeed());
+    REQUIRE(a.sample() == b.sample());
+}
+
+TEST_CASE("Simulation - parallel replications", "[replications]")
+{
+    const int RUNS = 10;
+    double mean[2], conf[2], cnt[2];
+    uint64_t executed[2];
+    unsigned threads[2] = { 1, 4 };
+
+    for (int k = 0; k < 2; ++k) {
+        SimContext ctx;
+        SimContext::Scope s(ctx);
+        RandomVar::init(1);
+        Source master;
+        SIMUL.run(10000, RUNS, buildModel, threads[k]);
+
+        REQUIRE(master.interval.getExpNum() == RUNS);
+        mean[k] = master.interval.getMean();
+        conf[k] = master.interval.getConfInterval();
+        cnt[k] = master.count.getMean();
+        executed[k] = SIMUL.getExecutedEvents();
+        REQUIRE(conf[k] > 0);
+        REQUIRE(executed[k] == Approx(cnt[k] * RUNS));
+    }
+    REQUIRE(mean[0] == mean[1]);
+    REQUIRE(conf[0] == conf[1]);
+    REQUIRE(cnt[0] == cnt[1]);
+    REQUIRE(executed[0] == executed[1]);
+    REQUIRE(mean[0] == Approx(10).epsilon(0.05));
+}
+
+TEST_CASE("Simulation - parallel replications with a 64 bits generator", "[replications]")
+{
+    const int RUNS = 5;
+    double mean[2];
+    unsigned threads[2] = { 1, 3 };
+    for (int k = 0; k < 2; ++k) {
+        SimContext ctx;
+        SimContext::Scope s(ctx);
+        RandomVar::setGenerator(RandomGen::create("xoshiro", 7));
+        Source master;
+        SIMUL.run(10000, RUNS, buildModel, threads[k]);
+        mean[k] = master.interval.getMean();
+        // the runs have different streams
+        REQUIRE(master.interval.getConfInterval() > 0);
+    }
+    REQUIRE(mean[0] == mean[1]);
+    REQUIRE(mean[0] == Approx(10).epsilon(0.05));
+}
+
+TEST_CASE("Simulation - parallel replications, wrong model", "[replications]")
+{
+    SimContext ctx;
+    SimContext::Scope s(ctx);
+    StatMean only("only");
+    REQUIRE_THROWS(SIMUL.run(100, 3, buildModel, 2));
+}
+
+/* Arrivals from a substream; config B also draws other numbers */
+class CrnSource : public Entity {
+    ExponentialVar _iat;
+    UniformVar _noise;
+    bool _noisy;
+public:
+    GEvent<CrnSource> arrival;
+    StatMean interval;
+    vector<double> sums;
+
+    CrnSource(bool noisy) : Entity(""), _iat(0.1), _noise(0, 1), _noisy(noisy),
+                            arrival(this, &CrnSource::onArrival),
+                            interval("interval")
+    {
+        _iat.setStream("arrivals");
+    }
+
+    void onArrival(Event *) {
+        if (_noisy) _noise.get();
+        double t = _iat.get();
+        interval.record(t);
+        sums.back() += t;
+        arrival.post(SIMUL.getTime() + Tick(t + 1));
+    }
+    void newRun() { sums.push_back(0); arrival.post(0); }
+    void endRun() {}
+};
+
+TEST_CASE("RandomVar - common random numbers", "[replications]")
+{
+    vector<double> sums[3];
+    double mean[3];
+    for (int k = 0; k < 3; ++k) {
+        SimContext ctx;
+        SimContext::Scope s(ctx);
+        RandomVar::init(42);
+        CrnSource src(k == 1);
+        if (k < 2) {
+            SIMUL.run(1000, 4);
+            sums[k] = src.sums;
+        } else {
+            // the same substreams in the parallel runs
+            SIMUL.run(1000, 4, [] { return make_shared<CrnSource>(false); }, 2);
+        }
+        mean[k] = src.interval.getMean();
+    }
+    // the extra draws do not change the arrivals, run by run
+    REQUIRE(sums[0] == sums[1]);
+    REQUIRE(mean[0] == mean[1]);
+    REQUIRE(mean[0] == mean[2]);
+    // but the runs are different
+    REQUIRE(sums[0][0] != sums[0][1]);
+
+    // another seed, other numbers
+    SimContext ctx;
+    SimContext::Scope s(ctx);
+    RandomVar::init(43);
+    CrnSource src(false);
+    SIMUL.run(1000, 4);
+    REQUIRE(src.sums[0] != sums[0][0]);
+}
+
+TEST_CASE("RandomVar - antithetic variates", "[replications]")
+{
+    SimContext ctx;
+    SimContext::Scope s(ctx);
+    UniformVar u(0, 1), a(0, 1);
+    u.setStream("u");
+    a.setStream("a");
+    a.setAntithetic(true);
+
+    // the variable and the run can be antithetic
+    RandomVar::setAntitheticRuns(true);
+    double v[4][3];
+    for (int run = 0; run < 4; ++run) {
+        RandomVar::initStreams(run);
+        for (int i = 0; i < 3; ++i) v[run][i] = u.get();
+    }
+    for (int i = 0; i < 3; ++i) {
+        REQUIRE(v[0][i] + v[1][i] == Approx(1));
+        REQUIRE(v[2][i] + v[3][i] == Approx(1));
+        REQUIRE(v[0][i] != v[2][i]);
+    }
+    // same key, same substream
+    UniformVar b(0, 1);
+    b.setStream("a");
+    RandomVar::initStreams(0);
+    double x = a.get();
+    RandomVar::initStreams(0);
+    REQUIRE(b.get() == Approx(1 - x));
+}
+
+TEST_CASE("BaseStat - t quantiles", "[replications]")
+{
+    REQUIRE(BaseStat::tQuantile(0.975, 1) == Approx(12.7062047));
+    REQUIRE(BaseStat::tQuantile(0.975, 2) == Approx(4.30265273));
+    REQUIRE(BaseStat::tQuantile(0.95, 5) == Approx(2.01504837));
+    REQUIRE(BaseStat::tQuantile(0.975, 10) == Approx(2.22813885));
+    REQUIRE(BaseStat::tQuantile(0.975, 30) == Approx(2.04227246));
+    REQUIRE(BaseStat::tQuantile(0.995, 100) == Approx(2.62589052));
+    REQUIRE(BaseStat::tQuantile(0.975, 1000) == Approx(1.96233908));
+    REQUIRE(BaseStat::tQuantile(0.975, 1e9) == Approx(1.95996398));
+    REQUIRE(BaseStat::tQuantile(0.025, 10) == Approx(-2.22813885));
+    REQUIRE(BaseStat::tQuantile(0.5, 3) == 0);
+}
+
+TEST_CASE("Simulation - sequential replications", "[replications]")
+{
+    SimContext ctx;
+    SimContext::Scope s(ctx);
+    RandomVar::init(1);
+    Source src;
+
+    // the interval of the mean is reached, the count is not selected
+    StoppingRule rule(0.01, 1000);
+    rule.add(src.interval);
+    size_t n = SIMUL.run(10000, rule);
+    REQUIRE(n > 5);
+    REQUIRE(n < 1000);
+    REQUIRE(src.interval.getExpNum() == n);
+    REQUIRE(src.interval.getConfInterval(0.95) <= 0.01 * src.interval.getMean());
+    REQUIRE(src.interval.getConfInterval(0.99) > src.interval.getConfInterval(BaseStat::C95));
+
+    // the minimum number of runs, and the maximum
+    REQUIRE(SIMUL.run(10000, StoppingRule(1, 1000, 0.95, 7)) == 7);
+    REQUIRE(SIMUL.run(10000, StoppingRule(1e-9, 12)) == 12);
+}
+
+TEST_CASE("Simulation - sequential parallel replications", "[replications]")
+{
+    size_t runs[2];
+    double mean[2];
+    unsigned threads[2] = { 1, 3 };
+    for (int k = 0; k < 2; ++k) {
+        SimContext ctx;
+        SimContext::Scope s(ctx);
+        RandomVar::init(1);
+        Source master;
+        StoppingRule rule(0.01, 200);
+        rule.add(master.interval);
+        runs[k] = SIMUL.run(10000, rule, buildModel, threads[k], 4);
+        REQUIRE(runs[k] % 4 == 0);
+        REQUIRE(master.interval.getExpNum() == runs[k]);
+        mean[k] = master.interval.getMean();
+    }
+    // the results do not depend on the number of threads
+    REQUIRE(runs[0] == runs[1]);
+    REQUIRE(mean[0] == mean[1]);
+    REQUIRE(runs[0] < 200);
+}
+
+/* An autoregressive process, sampled at every tick */
+class Drift : public Entity {
+    NormalVar _noise;
+    double _x;
+public:
+    GEvent<Drift> tick;
+    StatMean level;
+    int runs;
+
+    Drift() : Entity(""), _noise(0, 1), _x(0), tick(this, &Drift::onTick),
+              level("level"), runs(0) {}
+
+    void onTick(Event *) {
+        _x = 0.999 * _x + _noise.get();
+        level.record(_x + 100);
+        tick.post(SIMUL.getTime() + 1);
+    }
+    void newRun() { ++runs; _x = 0; tick.post(0); }
+    void endRun() {}
+};
+
+TEST_CASE("Simulation - batch means", "[replications]")
+{
+    SimContext ctx;
+    SimContext::Scope s(ctx);
+    RandomVar::init(3);
+    Source src;
+    BaseStat::setTransitory(1000);
+
+    REQUIRE(SIMUL.runBatches(101000, 10) == 10);
+    REQUIRE(src.interval.getExpNum() == 10);
+    REQUIRE(src.interval.getMean() == Approx(10).epsilon(0.05));
+    REQUIRE(src.interval.getConfInterval() > 0);
+    // an arrival every 10.5 ticks, on average
+    REQUIRE(src.count.getMean() == Approx(10000 / 10.5).epsilon(0.05));
+    REQUIRE(fabs(src.interval.getAutocorrelation()) < 1);
+
+    REQUIRE_THROWS(SIMUL.runBatches(1500, 1000));
+    REQUIRE_THROWS(SIMUL.runBatches(100000, 2));
+}
+
+TEST_CASE("Simulation - adaptive batch means", "[replications]")
+{
+    SimContext ctx;
+    SimContext::Scope s(ctx);
+    RandomVar::init(3);
+    Drift d;
+    BaseStat::setTransitory(2000);
+
+    size_t n = SIMUL.runBatches(162000, 10, Simulation::BATCH_ADAPTIVE);
+    REQUIRE(d.runs == 1);
+    REQUIRE(d.level.getExpNum() == n);
+    // 160 batches of 1000 ticks are correlated
+    REQUIRE(n >= 10);
+    REQUIRE(n < 160);
+    if (n > 10) REQUIRE(fabs(d.level.getAutocorrelation()) <= 1.96 / sqrt(double(n)));
+    REQUIRE(d.level.getMean() == Approx(100).epsilon(0.05));
+}
+
+/* A process that starts far from its steady state (0), or drifts
+   away from it forever */
+class Relax : public Entity {
+    NormalVar _noise;
+    double _x;
+public:
+    GEvent<Relax> tick;
+    StatMean level;
+    bool drift;
+
+    Relax() : Entity(""), _noise(0, 1), _x(0), tick(this, &Relax::onTick),
+              level("level"), drift(false) {}
+
+    void onTick(Event *) {
+        _x = drift ? _x + 1 : 0.99 * _x + _noise.get();
+        level.record(_x);
+        tick.post(SIMUL.getTime() + 1);
+    }
+    void newRun() { _x = 1000; tick.post(0); }
+    void endRun() {}
+};
+
+TEST_CASE("Simulation - detection of the warm-up", "[replications]")
+{
+    SimContext ctx;
+    SimContext::Scope s(ctx);
+    RandomVar::init(5);
+    Relax r;
+
+    // the bias is below the noise after about 700 ticks, and
+    // detected after at least 50 intervals
+    SIMUL.setWarmupDetection(100, 50000);
+    REQUIRE(SIMUL.runBatches(60000, 10) == 10);
+    const Tick end = SIMUL.getWarmupEnd();
+    REQUIRE(end >= 5000);
+    REQUIRE(end < 50000);
+    REQUIRE(r.level.getExpNum() == 10);
+    REQUIRE(fabs(r.level.getMean()) < 2);
+
+    // never over: the warm-up ends at the limit
+    r.drift = true;
+    SIMUL.setWarmupDetection(100, 3000);
+    REQUIRE(SIMUL.runBatches(13000, 10) == 10);
+    REQUIRE(SIMUL.getWarmupEnd() == 3000);
+    REQUIRE(r.level.getMean() > 3000);
+}
+
+/* A source whose interarrival times depend on the point of a sweep */
+class PointSource : public Entity {
+    ExponentialVar _iat;
+    double _step;
+public:
+    GEvent<PointSource> arrival;
+    StatMean interval;
+    StatCount count;
+
+    PointSource(double rate, double step) :
+        Entity(""), _iat(rate), _step(step),
+        arrival(this, &PointSource::onArrival),
+        interval("interval"), count("count") {}
+
+    void onArrival(Event *) {
+        double t = _iat.get();
+        interval.record(t);
+        count.record(1);
+        arrival.post(SIMUL.getTime() + Tick(t + _step));
+    }
+    void newRun() { arrival.post(0); }
+    void endRun() {}
+};
+
+static shared_ptr<void> buildPoint(const Sweep::Point &p)
+{
+    return make_shared<PointSource>(p.getDouble("rate"), p.getDouble("step"));
+}
+
+TEST_CASE("Sweep - points and replicas", "[replications]")
+{
+    Sweep sweep;
+    sweep.add("rate", vector<double>{ 0.1, 1, 5 }).add("step", vector<double>{ 1, 2 });
+    REQUIRE(sweep.getPoints() == 6);
+    REQUIRE(sweep.getPoint(0).get("rate") == "0.1");
+    REQUIRE(sweep.getPoint(1).getDouble("step") == 2);
+    REQUIRE(sweep.getPoint(4).getDouble("rate") == 5);
+    REQUIRE_THROWS_AS(sweep.getPoint(0).get("mean"), const Sweep::Exc &);
+    REQUIRE_THROWS_AS(sweep.add("rate", vector<double>{ 1 }), const Sweep::Exc &);
+
+    const size_t REPLICAS = 5;
+    vector<double> mean[2];
+    unsigned threads[2] = { 1, 4 };
+    for (int k = 0; k < 2; ++k) {
+        SimContext ctx;
+        SimContext::Scope s(ctx);
+        RandomVar::init(1);
+        sweep.run(2000, REPLICAS, buildPoint, threads[k]);
+        REQUIRE(sweep.getStatNames() == vector<string>({ "interval", "count" }));
+        for (size_t p = 0; p < 6; ++p) mean[k].push_back(sweep.getMean(p, 0));
+        REQUIRE(sweep.getConfInterval(3, 0) > 0);
+        // a thread alone builds a model per point
+        if (threads[k] == 1) {
+            REQUIRE(sweep.getBuilds() == 6);
+            REQUIRE(sweep.getSteals() == 0);
+        }
+        else REQUIRE(sweep.getBuilds() < 6 * REPLICAS);
+    }
+    REQUIRE(mean[0] == mean[1]);
+    REQUIRE(mean[0][4] == Approx(0.2).epsilon(0.2));
+
+    // the replicas of a point are the parallel replications of
+    // its model
+    {
+        SimContext ctx;
+        SimContext::Scope s(ctx);
+        RandomVar::init(1);
+        PointSource master(5, 1);
+        Simulation::ModelFactory f = []() { return make_shared<PointSource>(5, 1); };
+        SIMUL.run(2000, REPLICAS, f, 2);
+        REQUIRE(master.interval.getMean() == Approx(mean[0][4]));
+        REQUIRE(sweep.getValues(4, REPLICAS - 1)[1] == master.count.getLastValue());
+    }
+
+    ostringstream out;
+    sweep.writeCsv(out);
+    string csv = out.str();
+    REQUIRE(csv.substr(0, csv.find('\n')) ==
+            "point,rate,step,replicas,interval,interval_ci,count,count_ci");
+    REQUIRE(count(csv.begin(), csv.end(), '\n') == 7);
+    REQUIRE(csv.find("\n4,5,1,5,") != string::npos);
+}
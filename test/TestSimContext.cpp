@@ -0,0 +1,288 @@
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <basestat.hpp>
+#include <entity.hpp>
+#include <gevent.hpp>
+#include <particle.hpp>
+#include <randomgen.hpp>
+#include <simcontext.hpp>
+#include <simul.hpp>
+
+#include "myentity.hpp"
+
+#include "catch.hpp"
+
+using namespace std;
+using namespace MetaSim;
+
+class MyStat : public StatCount {
+public:
+    void probe(MetaSim::GEvent<MyEntity> &e) {
+        record(1);
+    }
+};
+
+TEST_CASE("SimContext - objects are bound to the current context", "[context]")
+{
+    SimContext ctx;
+    MyEntity out("Pippo");
+    {
+        SimContext::Scope s(ctx);
+        REQUIRE(&SimContext::current() == &ctx);
+        REQUIRE(&SIMUL == &ctx.getSimulation());
+
+        // same name, but in another context
+        MyEntity in("Pippo");
+        REQUIRE(&in.getContext() == &ctx);
+        REQUIRE(&in.eventA.getContext() == &ctx);
+        REQUIRE(Entity::_find("Pippo") == &in);
+    }
+    REQUIRE(&SimContext::current() == &SimContext::getDefault());
+    REQUIRE(&out.getContext() == &SimContext::getDefault());
+    REQUIRE(Entity::_find("Pippo") == &out);
+}
+
+TEST_CASE("SimContext - independent simulations", "[context]")
+{
+    SimContext ctx;
+    SimContext::Scope s1(ctx);
+    MyEntity a("Pippo");
+    MyStat sa;
+    attach_stat(sa, a.eventA);
+
+    SimContext ctx2;
+    SimContext::Scope s2(ctx2);
+    MyEntity b("Pippo");
+    MyStat sb;
+    attach_stat(sb, b.eventA);
+
+    // each engine only runs its own entities and stats
+    ctx.getSimulation().run(12);
+    REQUIRE(sa.getValue() == 4);
+    REQUIRE(ctx2.getSimulation().getTime() == 0);
+    REQUIRE(!b.eventA.isInQueue());
+
+    ctx2.getSimulation().run(25);
+    REQUIRE(sa.getValue() == 4);
+    REQUIRE(sb.getValue() == 6);
+}
+
+static double runModel(int i)
+{
+    SimContext ctx;
+    SimContext::Scope s(ctx);
+    MyEntity me("Pippo");
+    MyStat st;
+    attach_stat(st, me.eventA);
+    SIMUL.run(10 * (i + 1));
+    return st.getValue();
+}
+
+TEST_CASE("SimContext - one simulation per thread", "[context]")
+{
+    const int N = 4;
+    vector<double> res(N);
+    vector<thread> th;
+
+    for (int i = 0; i < N; ++i) 
+        th.push_back(thread([i, &res]() { res[i] = runModel(i); }));
+    for (auto &t : th) t.join();
+
+    for (int i = 0; i < N; ++i) REQUIRE(res[i] == runModel(i));
+    REQUIRE(res[0] != res[N-1]);
+}
+
+/* Posts two events in newRun(), and logs their execution */
+class Node : public Entity {
+    vector<double> _state;
+public:
+    GEvent<Node> first, second;
+    string *log;
+
+    Node(string *l, bool independent) :
+        Entity(""), _state(16), first(this, &Node::onEvent),
+        second(this, &Node::onEvent), log(l) {
+        setIndependent(independent);
+    }
+    void onEvent(Event *) { *log += to_string(getID()) + " "; }
+    void newRun() {
+        _state.assign(16, getID());
+        first.post(Tick(getID() % 3));
+        second.post(1);
+    }
+    void endRun() {}
+};
+
+static string runNodes(unsigned threads)
+{
+    SimContext ctx;
+    SimContext::Scope s(ctx);
+    string log;
+    vector<unique_ptr<Node> > nodes;
+    // a dependent entity every 7
+    for (int i = 0; i < 500; ++i) nodes.emplace_back(new Node(&log, i % 7 != 0));
+    Entity::setNewRunThreads(threads);
+    SIMUL.run(10, 2);
+    return log;
+}
+
+TEST_CASE("SimContext - parallel newRun keeps the order of the events", "[context]")
+{
+    string serial = runNodes(1);
+    REQUIRE(serial.size() > 0);
+    REQUIRE(runNodes(4) == serial);
+}
+
+TEST_CASE("SimContext - bulk clear of the queue", "[context]")
+{
+    SimContext ctx;
+    SimContext::Scope s(ctx);
+    string log;
+    Node n(&log, false);
+    SIMUL.initRuns();
+    SIMUL.initSingleRun();
+    for (int i = 0; i < 100; ++i)
+        Event::create<GEvent<Node> >(&n, &Node::onEvent)->post(Tick(5 + i), true);
+    n.second.cancelLazy();
+    REQUIRE(ctx.getEventQueue().size() == 102);
+    SIMUL.endSingleRun();
+    REQUIRE(ctx.getEventQueue().size() == 0);
+    REQUIRE(!n.first.isInQueue());
+    REQUIRE(ctx.getSkippedTombstones() == 1);
+    // the cancelled event can be posted again
+    n.second.post(3);
+    REQUIRE(n.second.isInQueue());
+}
+
+/* A station of a slotted protocol: its events only touch its state */
+class Station : public Entity {
+    RandomGen _gen;
+public:
+    GEvent<Station> slot, timeout, echo;
+    vector<int64_t> log;
+
+    Station() : Entity(""), _gen(getID()), slot(this, &Station::onSlot),
+                timeout(this, &Station::onTimeout),
+                echo(this, &Station::onEcho), log() {}
+
+    void onSlot(Event *) {
+        int64_t t = int64_t(SIMUL.getTime());
+        RandNum r = _gen.sample();
+        log.push_back(t * 10);
+        // re-armed: deferred drop and post
+        timeout.drop();
+        if (r % 4 != 0) timeout.post(SIMUL.getTime() + 3);
+        if (r % 5 == 0)
+            Event::create<GEvent<Station> >(this, &Station::onEcho)->post(
+                SIMUL.getTime() + 1 + r % 3, true);
+        if (r % 7 == 0) echo.process();
+        slot.post(SIMUL.getTime() + 2);
+    }
+    void onTimeout(Event *) { log.push_back(int64_t(SIMUL.getTime()) * 10 + 1); }
+    void onEcho(Event *) { log.push_back(int64_t(SIMUL.getTime()) * 10 + 2); }
+    void newRun() { log.clear(); slot.post(0); }
+    void endRun() {}
+};
+
+class SlotStat : public StatCount {
+public:
+    SlotStat() : StatCount("") {}
+    void probe(GEvent<Station> &) { record(1); }
+};
+
+/* A global event without owner, between the steps */
+class Clock : public Event {
+public:
+    string *log;
+    explicit Clock(string *l) : Event(), log(l) {}
+    void doit() {
+        *log += to_string(int64_t(SIMUL.getTime())) + " ";
+        post(SIMUL.getTime() + 5);
+    }
+};
+
+static vector<int64_t> runStations(unsigned threads, uint64_t &executed,
+                                   uint64_t &steps, double &slots, string &clock)
+{
+    SimContext ctx;
+    SimContext::Scope s(ctx);
+    SIMUL.setStepThreads(threads);
+    vector<unique_ptr<Station> > st;
+    SlotStat stat;
+    for (int i = 0; i < 200; ++i) {
+        st.emplace_back(new Station());
+        attach_stat(stat, st.back()->slot);
+    }
+    Clock c(&clock);
+    c.post(0);
+    SIMUL.run(100);
+    executed = SIMUL.getExecutedEvents();
+    steps = SIMUL.getParallelSteps();
+    slots = stat.getValue();
+    vector<int64_t> all;
+    for (auto &p : st) {
+        all.insert(all.end(), p->log.begin(), p->log.end());
+        all.push_back(-1);
+    }
+    return all;
+}
+
+TEST_CASE("SimContext - parallel steps", "[context]")
+{
+    uint64_t executed[3], steps[3];
+    double slots[3];
+    string clock[3];
+    vector<int64_t> log[3];
+    const unsigned threads[3] = { 1, 4, 2 };
+    for (int k = 0; k < 3; ++k)
+        log[k] = runStations(threads[k], executed[k], steps[k], slots[k], clock[k]);
+    REQUIRE(steps[0] == 0);
+    REQUIRE(steps[1] > 0);
+    for (int k = 1; k < 3; ++k) {
+        REQUIRE(log[k] == log[0]);
+        REQUIRE(executed[k] == executed[0]);
+        REQUIRE(slots[k] == slots[0]);
+        REQUIRE(clock[k] == clock[0]);
+    }
+    REQUIRE(slots[0] > 0);
+}
+
+/* Posts disposable events for the same step; one of them throws */
+class Faulty : public Entity {
+public:
+    int id;
+    int runs;
+    explicit Faulty(int i) : Entity(""), id(i), runs(0) {}
+    void onStep(Event *) {
+        ++runs;
+        if (id == 40) throw std::runtime_error("faulty");
+    }
+    void newRun() {}
+    void endRun() {}
+};
+
+TEST_CASE("SimContext - a parallel step that throws", "[context]")
+{
+    SimContext ctx;
+    SimContext::Scope s(ctx);
+    SIMUL.setStepThreads(4);
+    vector<unique_ptr<Faulty> > fs;
+    for (int i = 0; i < 100; ++i) fs.emplace_back(new Faulty(i));
+    SIMUL.initRuns();
+    SIMUL.initSingleRun();
+    for (auto &f : fs)
+        Event::create<GEvent<Faulty> >(f.get(), &Faulty::onStep)->post(5, true);
+    REQUIRE_THROWS_AS(SIMUL.run_to(10), const std::runtime_error &);
+
+    // the step is lost, and its events are back in the pool
+    REQUIRE(fs[40]->runs == 1);
+    REQUIRE(ctx.getEventQueue().empty());
+    const EventPool *p = ctx.getEventPool<GEvent<Faulty> >();
+    REQUIRE(p != nullptr);
+    REQUIRE(p->live() == 0);
+    SIMUL.endSingleRun();
+}
@@ -0,0 +1,154 @@
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <asyncwriter.hpp>
+#include <basestat.hpp>
+#include <entity.hpp>
+#include <gevent.hpp>
+#include <simul.hpp>
+#include <statoutput.hpp>
+
+#include "catch.hpp"
+
+using namespace std;
+using namespace MetaSim;
+
+static vector<string> lines(const string &path)
+{
+    ifstream f(path.c_str());
+    vector<string> v;
+    string l;
+    while (getline(f, l)) v.push_back(l);
+    return v;
+}
+
+/* Counts the ticks of a run, and records 1 / tick */
+class Ticker : public Entity {
+public:
+    GEvent<Ticker> tick;
+    StatCount count;
+    StatMean mean;
+
+    Ticker() : Entity(""), tick(this, &Ticker::onTick),
+               count("count"), mean("the \"mean\", of 1/t") {}
+
+    void onTick(Event *) {
+        count.record(1);
+        mean.record(1.0 / double(SIMUL.getTime()));
+        tick.post(SIMUL.getTime() + 1);
+    }
+    void newRun() { tick.post(1); }
+    void endRun() {}
+};
+
+TEST_CASE("AsyncWriter - buffers and large blocks", "[output]")
+{
+    const string path = "test_async.bin";
+    string big(3000, 'x');
+    {
+        AsyncWriter w(path, 1024);
+        for (int i = 0; i < 1000; ++i) w.write("0123456789", 10);
+        w.write(big);
+        w.sync();
+        REQUIRE(w.getBytes() == 13000);
+        w.write("end", 3);
+    }
+    ifstream f(path.c_str(), ios::binary);
+    string s((istreambuf_iterator<char>(f)), istreambuf_iterator<char>());
+    REQUIRE(s.size() == 13003);
+    REQUIRE(s.substr(9990, 20) == "0123456789xxxxxxxxxx");
+    REQUIRE(s.substr(13000) == "end");
+    remove(path.c_str());
+
+    REQUIRE_THROWS_AS(AsyncWriter("no/such/dir/file"), const AsyncWriter::Exc &);
+}
+
+TEST_CASE("CsvOutput - a row for each run", "[output]")
+{
+    const string path = "test_runs.csv";
+    {
+        SimContext ctx;
+        SimContext::Scope s(ctx);
+        Ticker t;
+        CsvOutput out(path);
+        SIMUL.run(10, 3);
+        REQUIRE(out.getRows() == 3);
+        out.sync();
+
+        vector<string> v = lines(path);
+        REQUIRE(v.size() == 4);
+        REQUIRE(v[0] == "run,count,\"the \"\"mean\"\", of 1/t\"");
+        for (int i = 0; i < 3; ++i) {
+            istringstream r(v[i + 1]);
+            size_t run;
+            char comma;
+            double c, m;
+            r >> run >> comma >> c >> comma >> m;
+            REQUIRE(run == size_t(i));
+            REQUIRE(c == t.count.getLastValue());
+            REQUIRE(m == t.mean.getLastValue());
+        }
+    }
+    remove(path.c_str());
+}
+
+TEST_CASE("BinaryOutput - columns of the runs and batches", "[output]")
+{
+    const string path = "test_runs.bin";
+    {
+        SimContext ctx;
+        SimContext::Scope s(ctx);
+        Ticker t;
+        BinaryOutput out(path, 4);
+        out.add(t.count);
+        SIMUL.run(10, 6);
+        REQUIRE_THROWS_AS(out.add(t.mean), const StatOutput::Exc &);
+
+        // the batches of a second simulation go in the same table
+        SIMUL.runBatches(100, 5);
+        REQUIRE(out.getRows() == 11);
+    }
+    BinaryOutput::Table tb = BinaryOutput::read(path);
+    REQUIRE(tb.names == vector<string>{"count"});
+    REQUIRE(tb.columns.size() == 1);
+    REQUIRE(tb.columns[0].size() == 11);
+    for (int i = 0; i < 6; ++i) REQUIRE(tb.columns[0][i] == 10);
+    // batches of 20 ticks (the event at the end of a batch is in the next one)
+    for (int i = 6; i < 11; ++i) REQUIRE(fabs(tb.columns[0][i] - 20) <= 1);
+    remove(path.c_str());
+
+    ofstream bad(path.c_str());
+    bad << "not a table";
+    bad.close();
+    REQUIRE_THROWS_AS(BinaryOutput::read(path), const StatOutput::Exc &);
+    remove(path.c_str());
+}
+
+TEST_CASE("GnuPlotOutput - files kept open", "[output]")
+{
+    SimContext ctx;
+    SimContext::Scope s(ctx);
+    StatMean m("test_gnuplot.dat");
+    GnuPlotOutput::init();
+    for (int k = 0; k < 3; ++k) {
+        BaseStat::init(3);
+        for (int i = 0; i < 3; ++i) {
+            BaseStat::newRun();
+            m.record(k + i);
+            BaseStat::endRun();
+        }
+        BaseStat::endSim();
+        GnuPlotOutput::write(k);
+
+        vector<string> v = lines("test_gnuplot.dat");
+        REQUIRE(v.size() == size_t(k + 2));
+        REQUIRE(v[0] == "# test_gnuplot.dat");
+        REQUIRE(v.back().substr(0, 4) == to_string(k) + "\t" + to_string(k + 1) + "\t");
+    }
+    GnuPlotOutput::close();
+    remove("test_gnuplot.dat");
+}
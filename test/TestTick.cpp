@@ -57,3 +57,46 @@ TEST_CASE("TestTick3", "testOverflow")
 
 
 
+
+TEST_CASE("TestTick4", "testConstexpr")
+{
+    constexpr Tick a(10);
+    constexpr Tick b = a * 3 + 5;
+    static_assert(b == 35, "constant Tick arithmetic");
+    static_assert(int64_t(-a) == -10, "constant negation");
+
+    Tick c(5);
+    REQUIRE(--c == 4);
+    REQUIRE(c-- == 4);
+    REQUIRE(c == 3);
+}
+
+TEST_CASE("TestTick5", "testRounding")
+{
+    REQUIRE(Tick::round(2.5) == 3);
+    REQUIRE(Tick::round(-2.5) == -3);
+    REQUIRE(Tick::round(-2.4) == -2);
+    REQUIRE(Tick::floor(-2.5) == -3);
+    REQUIRE(Tick::ceil(2.1) == 3);
+    // beyond the range of int
+    REQUIRE(Tick::round(5e12 + 0.6) == static_cast<int64_t>(5000000000001LL));
+}
+
+TEST_CASE("TestTick6", "testLiterals")
+{
+    using namespace MetaSim::literals;
+    const Tick::impl_t r = Tick::getResolution();
+
+    REQUIRE(10_ms == Tick("10ms"));
+    REQUIRE(5_us == Tick("5us"));
+    REQUIRE(2_s == Tick("2s"));
+    REQUIRE(1.5_ms == Tick("1.5ms"));
+    REQUIRE(int64_t(250_ns) == 250 / r);
+    REQUIRE(3_s + 10_ms == Tick("3010ms"));
+
+#ifdef METASIM_TICK_RESOLUTION
+    constexpr Tick t = 10_ms;
+    static_assert(int64_t(t) == 10000000 / METASIM_TICK_RESOLUTION,
+                  "literals folded at compile time");
+#endif
+}
@@ -0,0 +1,89 @@
+#include <memory>
+#include <vector>
+
+#include <basestat.hpp>
+#include <entity.hpp>
+#include <event.hpp>
+#include <gevent.hpp>
+#include <simul.hpp>
+#include <timewarp.hpp>
+
+#include "catch.hpp"
+#include "myentity.hpp"
+
+using namespace std;
+using namespace MetaSim;
+
+/* 
+   The token rings of myentity.hpp. Unlike the model of TestPdes,
+   the delay between stations is only 1 tick, so a conservative
+   engine would need a window per tick.
+*/
+static const int END = 3000;
+
+static vector<unique_ptr<RingStation> > buildRing(TimeWarpSimulation *tw)
+{
+    return buildRing(tw, 1, END);
+}
+
+TEST_CASE("TimeWarpSimulation - same results as the sequential engine", "[timewarp]")
+{
+    vector<double> tok, job, gap;
+    vector<int> seen;
+    {
+        SimContext ctx;
+        SimContext::Scope s(ctx);
+        auto st = buildRing(0);
+        SIMUL.run(END, 3);
+        for (auto &p : st) {
+            tok.push_back(p->tokens.getMean());
+            job.push_back(p->jobs.getMean());
+            gap.push_back(p->gap.getMean());
+            seen.push_back(p->seen());
+        }
+    }
+
+    for (size_t nlp = 1; nlp <= 4; nlp *= 2) {
+        INFO("LPs = " << nlp);
+        TimeWarpSimulation tw(nlp);
+        tw.setBatch(64);
+        tw.setCheckpointInterval(8);
+        auto st = buildRing(&tw);
+        tw.run(END, 3);
+        if (nlp > 1) REQUIRE(tw.getRollbacks() > 0);
+        if (nlp > 2) REQUIRE(tw.getAntiMessages() > 0);
+        for (int i = 0; i < NST; ++i) {
+            REQUIRE(st[i]->tokens.getMean() == tok[i]);
+            REQUIRE(st[i]->jobs.getMean() == job[i]);
+            REQUIRE(st[i]->gap.getMean() == Approx(gap[i]));
+            REQUIRE(st[i]->seen() == seen[i]);
+        }
+        for (size_t i = 0; i < nlp; ++i) {
+            typedef GEvent<RingStation> Job;
+            const EventPool *p = tw.getLP(i).getEventPool<Job>();
+            REQUIRE(p != nullptr);
+            REQUIRE(p->live() == 0);
+        }
+    }
+}
+
+TEST_CASE("TimeWarpSimulation - a bounded window gives the same results", "[timewarp]")
+{
+    vector<double> tok;
+    {
+        TimeWarpSimulation tw(2);
+        auto st = buildRing(&tw);
+        tw.run(END);
+        for (auto &p : st) tok.push_back(p->tokens.getMean());
+    }
+    TimeWarpSimulation tw(2);
+    tw.setWindow(5);
+    tw.setCheckpointInterval(1);
+    auto st = buildRing(&tw);
+    tw.run(END);
+    for (int i = 0; i < NST; ++i) REQUIRE(st[i]->tokens.getMean() == tok[i]);
+
+    REQUIRE_THROWS_AS(tw.setBatch(0), const TimeWarpSimulation::Exc &);
+    REQUIRE_THROWS_AS(tw.setWindow(0), const TimeWarpSimulation::Exc &);
+    REQUIRE_THROWS_AS(tw.setCheckpointInterval(0), const TimeWarpSimulation::Exc &);
+}
@@ -0,0 +1,313 @@
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <chunktrace.hpp>
+#include <entity.hpp>
+#include <gevent.hpp>
+#include <particle.hpp>
+#include <randomvar.hpp>
+#include <ringwriter.hpp>
+#include <simul.hpp>
+#include <trace.hpp>
+#include <tracebinary.hpp>
+#include <tracefilter.hpp>
+
+#include "catch.hpp"
+
+using namespace std;
+using namespace MetaSim;
+
+TEST_CASE("TraceBinary - records and reader", "[trace]")
+{
+    const string path = "test_trace.trc";
+    const size_t N = 10000;
+    {
+        // a small ring: the records wrap around it
+        TraceBinary t(path, 1000);
+        for (size_t i = 0; i < N; ++i)
+            t.record(Tick(int64_t(i * 10)), uint32_t(i % 3), int32_t(i % 7), i * 0.5);
+        REQUIRE(t.getRecords() == N);
+        t.sync();
+        REQUIRE(t.getBacklog() == 0);
+    }
+    TraceReader in(path);
+    REQUIRE(in.getRecords() == N);
+    TraceRecord r;
+    size_t n = 0;
+    bool ok = true;
+    while (in.next(r)) {
+        ok = ok && r.time == int64_t(n * 10) && r.type == n % 3 &&
+            r.entity == int32_t(n % 7) && r.payload == n * 0.5;
+        ++n;
+    }
+    REQUIRE(ok);
+    REQUIRE(n == N);
+
+    TraceReader blocks(path);
+    TraceRecord first;
+    REQUIRE(blocks.next(first));
+    vector<TraceRecord> v(N);
+    REQUIRE(blocks.read(v.data(), N) == N - 1);
+    REQUIRE(v[N - 2].time == int64_t((N - 1) * 10));
+
+    ostringstream text;
+    REQUIRE(TraceReader::toText(path, text) == N);
+    istringstream lines(text.str());
+    string l;
+    getline(lines, l);
+    REQUIRE(l == "0\t0\t0\t0");
+    getline(lines, l);
+    REQUIRE(l == "10\t1\t1\t0.5");
+    remove(path.c_str());
+
+    ofstream bad(path.c_str());
+    bad << "0.5\n1.5\n";
+    bad.close();
+    REQUIRE_THROWS_AS(TraceReader tr(path), const TraceBinary::Exc &);
+    remove(path.c_str());
+}
+
+static string content(const string &path)
+{
+    ifstream f(path.c_str(), ios::binary);
+    return string((istreambuf_iterator<char>(f)), istreambuf_iterator<char>());
+}
+
+TEST_CASE("RingWriter - policies of a full ring", "[trace]")
+{
+    const string path = "test_ring.bin";
+    string big(200, 'x');
+    {
+        RingWriter w(path, 100, RingWriter::BLOCK);
+        REQUIRE(w.getSize() == 128);
+        for (int i = 0; i < 10000; ++i) REQUIRE(w.write("0123456789", 10));
+        // larger than the ring: in pieces
+        REQUIRE(w.write(big));
+        w.sync();
+        REQUIRE(w.getBacklog() == 0);
+        REQUIRE(w.getDropped() == 0);
+    }
+    string s = content(path);
+    REQUIRE(s.size() == 100200);
+    REQUIRE(s.substr(99990, 20) == "0123456789xxxxxxxxxx");
+
+    {
+        RingWriter w(path, 100, RingWriter::DROP);
+        REQUIRE(w.write("abc", 3));
+        REQUIRE(!w.write(big));
+        REQUIRE(w.write("def", 3));
+        REQUIRE(w.getDropped() == 1);
+        REQUIRE(w.getDroppedBytes() == 200);
+    }
+    REQUIRE(content(path) == "abcdef");
+
+    {
+        // the spilled data stays in order
+        RingWriter w(path, 100, RingWriter::SPILL);
+        string all;
+        for (int i = 0; i < 1000; ++i) {
+            string r = to_string(i) + (i % 100 == 0 ? big : string(","));
+            REQUIRE(w.write(r));
+            all += r;
+        }
+        REQUIRE(w.getSpilled() >= 10 * 200);
+        w.close();
+        REQUIRE(w.getBacklog() == 0);
+        REQUIRE(content(path) == all);
+    }
+    remove(path.c_str());
+}
+
+TEST_CASE("TraceAscii - asynchronous trace", "[trace]")
+{
+    const string path = "test_trace.txt";
+    {
+        TraceAscii t(path, RingWriter::BLOCK, 1024);
+        for (int i = 0; i < 1000; ++i) t.record(i);
+        t.record(0.5);
+        t.record(string("end\n"));
+        REQUIRE(t.getWriter() != NULL);
+        REQUIRE_THROWS_AS(t.open(), const Trace::Exc &);
+    }
+    vector<string> v;
+    ifstream f(path.c_str());
+    string l;
+    while (getline(f, l)) v.push_back(l);
+    REQUIRE(v.size() == 1002);
+    REQUIRE(v[999] == "999");
+    REQUIRE(v[1000] == "0.5");
+    REQUIRE(v[1001] == "end");
+    remove(path.c_str());
+}
+
+/* Posts an event at every tick */
+class Beat : public Entity {
+public:
+    GEvent<Beat> beat;
+
+    Beat() : Entity("beat"), beat(this, &Beat::onBeat) {}
+
+    void onBeat(Event *) { beat.post(SIMUL.getTime() + 2); }
+    void newRun() { beat.post(0); }
+    void endRun() {}
+};
+
+TEST_CASE("TraceBinary - attached to an event", "[trace]")
+{
+    const string path = "test_events.trc";
+    {
+        SimContext ctx;
+        SimContext::Scope s(ctx);
+        Beat b;
+        TraceBinary t(path);
+        attach_stat(t, b.beat);
+        SIMUL.run(10);
+    }
+    TraceReader in(path);
+    TraceRecord r;
+    int64_t last = -2;
+    while (in.next(r)) {
+        REQUIRE(r.time == last + 2);
+        REQUIRE(r.type == uint32_t(EventPool::typeId<GEvent<Beat> >()));
+        REQUIRE(r.entity == -1);
+        last = r.time;
+    }
+    REQUIRE(last >= 8);
+    remove(path.c_str());
+}
+
+TEST_CASE("ChunkedTrace - index, windows and DetVar", "[trace]")
+{
+    const string path = "test_chunks.trc";
+    const size_t N = 10000;
+    const size_t CHUNK = 1000;
+    {
+        ChunkedTraceWriter t(path, ChunkedTrace::defaultCodec(), CHUNK);
+        for (size_t i = 0; i < N; ++i)
+            t.record(Tick(int64_t(i * 10)), uint32_t(i % 3), int32_t(i % 7), i * 0.5);
+        REQUIRE(t.getRecords() == N);
+    }
+    REQUIRE(ChunkedTrace::isChunked(path));
+
+    ChunkedTraceReader in(path);
+    REQUIRE(in.getCodec() == ChunkedTrace::defaultCodec());
+    REQUIRE(in.getRecords() == N);
+    REQUIRE(in.getChunks() == N / CHUNK);
+    REQUIRE(in.getChunk(2).count == CHUNK);
+    REQUIRE(in.getChunk(2).first == int64_t(2 * CHUNK * 10));
+    REQUIRE(in.getChunk(2).last == int64_t((3 * CHUNK - 1) * 10));
+    REQUIRE(in.getDecoded() == 0);
+
+    // a window over the end of the 3rd chunk and the start of the 4th
+    vector<TraceRecord> v;
+    REQUIRE(in.window(Tick(29900), Tick(30090), v) == 20);
+    REQUIRE(in.getDecoded() == 2);
+    REQUIRE(v.front().time == 29900);
+    REQUIRE(v.back().time == 30090);
+    REQUIRE(v.back().entity == int32_t(3009 % 7));
+    REQUIRE(v.back().payload == 3009 * 0.5);
+
+    v.clear();
+    in.readChunk(N / CHUNK - 1, v);
+    REQUIRE(v.size() == CHUNK);
+    REQUIRE(v.back().time == int64_t((N - 1) * 10));
+
+    DetVar d(path);
+    REQUIRE(d.size() == N);
+    REQUIRE(d.get() == 0);
+    REQUIRE(d.get() == 0.5);
+    REQUIRE(d.getMaximum() == (N - 1) * 0.5);
+    remove(path.c_str());
+
+    // not closed: there is no index
+    ofstream bad(path.c_str(), ios::binary);
+    bad << "MSCHUNK1 and nothing else, nor an index at the end";
+    bad.close();
+    REQUIRE(ChunkedTrace::isChunked(path));
+    REQUIRE_THROWS_AS(ChunkedTraceReader cr(path), const ChunkedTrace::Exc &);
+    remove(path.c_str());
+}
+
+TEST_CASE("ChunkedTrace - uncompressed and empty traces", "[trace]")
+{
+    const string path = "test_chunks.trc";
+    {
+        ChunkedTraceWriter t(path, ChunkedTrace::NONE, 64);
+        for (int64_t i = 0; i < 100; ++i) t.record(Tick(100 - i), 1);
+    }
+    {
+        ChunkedTraceReader in(path);
+        REQUIRE(in.getChunks() == 2);
+        // the times of a chunk need not be in order
+        REQUIRE(in.getChunk(0).first == 37);
+        REQUIRE(in.getChunk(0).last == 100);
+        vector<TraceRecord> v;
+        REQUIRE(in.window(Tick(1), Tick(10), v) == 10);
+        REQUIRE(in.getDecoded() == 1);
+    }
+    {
+        ChunkedTraceWriter t(path, ChunkedTrace::NONE);
+    }
+    ChunkedTraceReader in(path);
+    REQUIRE(in.getChunks() == 0);
+    REQUIRE(in.getRecords() == 0);
+    remove(path.c_str());
+}
+
+TEST_CASE("TraceFilter - types, entities, window and sampling", "[trace]")
+{
+    TraceFilter all;
+    REQUIRE(all.passesAll());
+    REQUIRE(all.accept(Tick(5), 7, 3));
+
+    TraceFilter f("type(1, 3); entity(4); window(100, 200); every(2)");
+    REQUIRE(!f.passesAll());
+    REQUIRE(!f.accept(Tick(150), 2, 4));
+    REQUIRE(!f.accept(Tick(150), 1, 5));
+    REQUIRE(!f.accept(Tick(99), 1, 4));
+    REQUIRE(!f.accept(Tick(201), 3, 4));
+    // one in two of the records that pass the rest
+    REQUIRE(f.accept(Tick(100), 1, 4));
+    REQUIRE(!f.accept(Tick(110), 3, 4));
+    REQUIRE(f.accept(Tick(200), 3, 4));
+    REQUIRE(f.getTested() == 7);
+    REQUIRE(f.getPassed() == 2);
+
+    f.clear();
+    REQUIRE(f.passesAll());
+
+    REQUIRE_THROWS_AS(TraceFilter("kind(1)"), const parse_util::ParseExc &);
+    REQUIRE_THROWS_AS(TraceFilter("every(0)"), const parse_util::ParseExc &);
+    REQUIRE_THROWS_AS(TraceFilter("entity(x)"), const parse_util::ParseExc &);
+
+    const string path = "test_filter.trc";
+    {
+        TraceBinary t(path);
+        t.setFilter(TraceFilter("entity(2);every(10)"));
+        for (size_t i = 0; i < 1000; ++i)
+            t.record(Tick(int64_t(i)), 0, int32_t(i % 4), double(i));
+        REQUIRE(t.getRecords() == 25);
+    }
+    TraceReader in(path);
+    TraceRecord r;
+    REQUIRE(in.getRecords() == 25);
+    REQUIRE(in.next(r));
+    REQUIRE(r.time == 2);
+    REQUIRE(in.next(r));
+    REQUIRE(r.time == 42);
+    remove(path.c_str());
+
+    {
+        ChunkedTraceWriter t(path, ChunkedTrace::NONE, 16);
+        t.setFilter(TraceFilter("window(10, 19)"));
+        for (int64_t i = 0; i < 100; ++i) t.record(Tick(i), 0);
+        REQUIRE(t.getRecords() == 10);
+    }
+    ChunkedTraceReader cin(path);
+    REQUIRE(cin.getRecords() == 10);
+    REQUIRE(cin.getChunk(0).first == 10);
+    remove(path.c_str());
+}
@@ -62,3 +62,95 @@ void MyEntity::endRun() {}
 bool MyEntity::isAFirst() { return afirst; }
 int MyEntity::getCounter() { return count; }
 
+
+Source::Source(double rate) : Entity(""), _iat(rate),
+                              arrival(this, &Source::onArrival),
+                              interval("interval"), count("count")
+{
+}
+
+void Source::onArrival(Event *)
+{
+    double t = _iat.get();
+    interval.record(t);
+    count.record(1);
+    arrival.post(SIMUL.getTime() + Tick(t + 1));
+}
+
+void Source::newRun() { arrival.post(0); }
+void Source::endRun() {}
+
+shared_ptr<void> buildModel()
+{
+    return make_shared<Source>();
+}
+
+RingStation::RingStation(int id, bool start, Tick delay, Tick end) :
+    Entity(""), _id(id), _delay(delay + (id * 7) % 5), _period(3 + id % 4),
+    _end(end), _start(start), _seen(0), _last(0), next(0),
+    arrivalA(this, &RingStation::onArrivalA),
+    arrivalB(this, &RingStation::onArrivalB, 4),
+    timer(this, &RingStation::onTimer, 2)
+{
+}
+
+bool RingStation::counting() { return SIMUL.getTime() < _end; }
+
+void RingStation::arrived()
+{
+    if (!counting()) return;
+    tokens.record(1);
+    gap.record(double(SIMUL.getTime() - _last));
+    _last = SIMUL.getTime();
+    ++_seen;
+}
+
+void RingStation::onArrivalA(Event *)
+{
+    arrived();
+    next->arrivalA.post(SIMUL.getTime() + _delay);
+}
+
+void RingStation::onArrivalB(Event *)
+{
+    arrived();
+    next->next->arrivalB.post(SIMUL.getTime() + _delay + 1);
+}
+
+void RingStation::onTimer(Event *)
+{
+    if (counting()) ticks.record(1);
+    Event::create<GEvent<RingStation> >(this, &RingStation::onJob)
+        ->post(SIMUL.getTime() + 2, true);
+    timer.post(SIMUL.getTime() + _period);
+}
+
+void RingStation::onJob(Event *)
+{
+    if (counting()) jobs.record(1);
+}
+
+void RingStation::newRun()
+{
+    _seen = 0;
+    _last = 0;
+    if (_start) {
+        arrivalA.post(0);
+        arrivalB.post(_id);
+    }
+    timer.post(_id);
+}
+
+void RingStation::endRun() {}
+
+void RingStation::saveState(StateArchive &a) const
+{
+    a.save(_seen);
+    a.save(_last);
+}
+
+void RingStation::restoreState(StateArchive &a)
+{
+    a.restore(_seen);
+    a.restore(_last);
+}
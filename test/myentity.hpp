@@ -8,9 +8,14 @@
 #ifndef MYENTITY_HPP_
 #define MYENTITY_HPP_
 
+#include <memory>
+#include <vector>
+
+#include <basestat.hpp>
 #include <entity.hpp>
 #include <gevent.hpp>
 #include <cloneable.hpp>
+#include <randomvar.hpp>
 
 using namespace MetaSim;
 
@@ -64,4 +69,86 @@ public:
     CLONEABLE(CloneableEntity, EntityClone)
 };
 
+/* A source of events with random interarrival times: the model of
+   the tests of the replications */
+class Source : public MetaSim::Entity {
+    MetaSim::ExponentialVar _iat;
+public:
+    MetaSim::GEvent<Source> arrival;
+    MetaSim::StatMean interval;
+    MetaSim::StatCount count;
+
+    Source(double rate = 0.1);
+
+    virtual void onArrival(MetaSim::Event *);
+    void newRun();
+    void endRun();
+};
+
+/* A new Source, as the model of a replication */
+std::shared_ptr<void> buildModel();
+
+/*
+   A station of two token rings, the model of the tests of the
+   parallel engines. When a token arrives, it is forwarded to the
+   next station after a delay. Each station also has a local
+   periodic timer that creates disposable jobs.
+*/
+class RingStation : public MetaSim::Entity {
+    int _id;
+    MetaSim::Tick _delay, _period, _end;
+    bool _start;
+    // modified by the handlers: saved in the checkpoints
+    int _seen;
+    MetaSim::Tick _last;
+public:
+    RingStation *next;
+    MetaSim::GEvent<RingStation> arrivalA, arrivalB, timer;
+    MetaSim::StatCount tokens, ticks, jobs;
+    MetaSim::StatMean gap;
+
+    /* delay is the shortest delay between two stations, end the
+       end of the runs */
+    RingStation(int id, bool start, MetaSim::Tick delay, MetaSim::Tick end);
+
+    int seen() const { return _seen; }
+
+    void onArrivalA(MetaSim::Event *);
+    void onArrivalB(MetaSim::Event *);
+    void onTimer(MetaSim::Event *);
+    void onJob(MetaSim::Event *);
+    void newRun();
+    void endRun();
+
+    void saveState(MetaSim::StateArchive &a) const;
+    void restoreState(MetaSim::StateArchive &a);
+
+private:
+    // the engines execute one event after the end of the
+    // simulation, which is not counted: it is the first one, but
+    // ties between different LPs are broken in a different way
+    bool counting();
+    void arrived();
+};
+
+const int NST = 8;
+
+/* A ring of NST stations: in the LPs of engine, neighbours in
+   different LPs, or in the current context if engine is null */
+template <class Engine>
+std::vector<std::unique_ptr<RingStation> >
+buildRing(Engine *engine, MetaSim::Tick delay, MetaSim::Tick end)
+{
+    std::vector<std::unique_ptr<RingStation> > st;
+    for (int i = 0; i < NST; ++i) {
+        if (engine) {
+            MetaSim::SimContext::Scope s(engine->getLP(i % engine->getLPNum()));
+            st.emplace_back(new RingStation(i, i == 0, delay, end));
+        }
+        else st.emplace_back(new RingStation(i, i == 0, delay, end));
+    }
+    for (int i = 0; i < NST; ++i) st[i]->next = st[(i + 1) % NST].get();
+    return st;
+}
+
 #endif /* MYENTITY_HPP_ */